@@ -0,0 +1,312 @@
+#include "bench.h"
+
+#include <clover/scan.h>
+#include <clover/cpu.h>
+
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+
+
+static const size_t bench_default_sizes[] = {
+    64 * 1024,
+    1024 * 1024,
+    16 * 1024 * 1024
+};
+
+
+/* == Allocations == */
+
+
+#if defined (__GLIBC__)
+
+/* The malloc family is interposed, so every allocation made by the front
+ * end (and by libc on its behalf) is counted */
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t count, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+extern void  __libc_free (void *ptr);
+
+static atomic_size_t alloc_count;
+static atomic_size_t alloc_bytes;
+
+
+static inline void
+alloc_record (size_t size) {
+    atomic_fetch_add_explicit (&alloc_count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit (&alloc_bytes, size, memory_order_relaxed);
+}
+
+
+void *
+malloc (size_t size) {
+    alloc_record (size);
+    return __libc_malloc (size);
+}
+
+
+void *
+calloc (size_t count, size_t size) {
+    alloc_record (count * size);
+    return __libc_calloc (count, size);
+}
+
+
+void *
+realloc (void *ptr, size_t size) {
+    alloc_record (size);
+    return __libc_realloc (ptr, size);
+}
+
+
+void
+free (void *ptr) {
+    __libc_free (ptr);
+}
+
+
+bool
+bench_allocs_supported () {
+    return true;
+}
+
+
+void
+bench_allocs_get (bench_allocs_t *out_allocs) {
+    out_allocs->count = atomic_load_explicit (&alloc_count, memory_order_relaxed);
+    out_allocs->bytes = atomic_load_explicit (&alloc_bytes, memory_order_relaxed);
+}
+
+#else
+
+bool
+bench_allocs_supported () {
+    return false;
+}
+
+
+void
+bench_allocs_get (bench_allocs_t *out_allocs) {
+    out_allocs->count = 0;
+    out_allocs->bytes = 0;
+}
+
+#endif /* __GLIBC__ */
+
+
+/* == Timing == */
+
+
+double
+bench_now () {
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+void
+bench_timer_add (bench_timer_t *timer, double seconds) {
+    if (timer->count < CLV_LENGTH (timer->samples)) {
+        timer->samples[timer->count++] = seconds;
+    }
+}
+
+
+double
+bench_timer_min (bench_timer_t *timer) {
+    double min = (timer->count > 0) ? timer->samples[0] : 0;
+
+    for (unsigned i = 1; i < timer->count; i++) {
+        if (timer->samples[i] < min) {
+            min = timer->samples[i];
+        }
+    }
+
+    return min;
+}
+
+
+static int
+compare_doubles (const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+
+double
+bench_timer_median (bench_timer_t *timer) {
+    double sorted[CLV_LENGTH (timer->samples)];
+
+    if (timer->count == 0) {
+        return 0;
+    }
+
+    memcpy (sorted, timer->samples, timer->count * sizeof (*sorted));
+    qsort (sorted, timer->count, sizeof (*sorted), compare_doubles);
+
+    return sorted[timer->count / 2];
+}
+
+
+/* == Options == */
+
+
+static void
+bench_usage (clv_str prog) {
+    fprintf (stderr, (
+        "Usage: %s [-n <iterations>] [-s <bytes>]... [-S <shape>] [-o <file>]\n"
+        "  -n N     Times each measurement is repeated (default %d)\n"
+        "  -s SIZE  Corpus size in bytes, with an optional K or M suffix\n"
+        "  -S NAME  Only run one corpus shape\n"
+        "  -o FILE  Write the JSON report to FILE instead of stdout\n"
+    ), prog, BENCH_ITERATIONS);
+}
+
+
+static bool
+bench_parse_size (clv_str arg, size_t *out_size) {
+    char *end;
+    unsigned long long size = strtoull (arg, &end, 10);
+
+    if (end == arg) {
+        return false;
+    }
+
+    if (*end == 'K' || *end == 'k') {
+        size *= 1024;
+        end++;
+    } else if (*end == 'M' || *end == 'm') {
+        size *= 1024 * 1024;
+        end++;
+    }
+
+    if (*end != '\0' || size == 0) {
+        return false;
+    }
+
+    *out_size = size;
+
+    return true;
+}
+
+
+bool
+bench_parse_args (int argc, char **argv, bench_opts_t *opts) {
+    *opts = (bench_opts_t){
+        .iterations = BENCH_ITERATIONS,
+        .shape = -1,
+        .out = stdout
+    };
+
+    for (int i = 1; i < argc; i++) {
+        clv_str arg = argv[i];
+        clv_str value = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+        if (strcmp (arg, "-h") == 0) {
+            bench_usage (argv[0]);
+            exit (0);
+        }
+
+        if (value == NULL) {
+            bench_usage (argv[0]);
+            return false;
+        }
+
+        i++;
+
+        if (strcmp (arg, "-n") == 0) {
+            int iterations = atoi (value);
+
+            if (iterations <= 0 || iterations > (int)CLV_LENGTH (((bench_timer_t *)0)->samples)) {
+                fprintf (stderr, "%s: invalid iteration count: %s\n", argv[0], value);
+                return false;
+            }
+
+            opts->iterations = iterations;
+        } else if (strcmp (arg, "-s") == 0) {
+            if (opts->size_count == BENCH_MAX_SIZES || !bench_parse_size (value, &opts->sizes[opts->size_count])) {
+                fprintf (stderr, "%s: invalid size: %s\n", argv[0], value);
+                return false;
+            }
+
+            opts->size_count++;
+        } else if (strcmp (arg, "-S") == 0) {
+            for (int shape = 0; shape < BENCH_SHAPE_COUNT; shape++) {
+                if (strcmp (value, bench_shape_name (shape)) == 0) {
+                    opts->shape = shape;
+                }
+            }
+
+            if (opts->shape < 0) {
+                fprintf (stderr, "%s: unknown shape: %s\n", argv[0], value);
+                return false;
+            }
+        } else if (strcmp (arg, "-o") == 0) {
+            if ((opts->out = fopen (value, "w")) == NULL) {
+                perror (value);
+                return false;
+            }
+        } else {
+            bench_usage (argv[0]);
+            return false;
+        }
+    }
+
+    if (opts->size_count == 0) {
+        memcpy (opts->sizes, bench_default_sizes, sizeof (bench_default_sizes));
+        opts->size_count = CLV_LENGTH (bench_default_sizes);
+    }
+
+    return true;
+}
+
+
+/* == Report == */
+
+
+static bool bench_json_first;
+
+
+void
+bench_json_begin (bench_opts_t *opts, clv_str benchmark) {
+    fprintf (opts->out, "{\n  \"benchmark\": \"%s\",\n  \"isa\": \"%s\",\n  \"cpus\": %u,\n",
+             benchmark, clv_scan_isa_name (clv_scan_get_isa ()), clv_cpu_count ());
+    fprintf (opts->out, "  \"iterations\": %u,\n  \"allocs_counted\": %s,\n  \"results\": [",
+             opts->iterations, bench_allocs_supported () ? "true" : "false");
+
+    bench_json_first = true;
+}
+
+
+void
+bench_json_result (bench_opts_t *opts, clv_str fmt, ...) {
+    va_list args;
+
+    fprintf (opts->out, "%s\n    { ", bench_json_first ? "" : ",");
+
+    va_start (args, fmt);
+    vfprintf (opts->out, fmt, args);
+    va_end (args);
+
+    fputs (" }", opts->out);
+    fflush (opts->out);
+
+    bench_json_first = false;
+}
+
+
+void
+bench_json_end (bench_opts_t *opts) {
+    fputs ("\n  ]\n}\n", opts->out);
+
+    if (opts->out != stdout) {
+        fclose (opts->out);
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef CLOVER_BENCH_H_
+#define CLOVER_BENCH_H_
+
+#include <clover/base.h>
+
+#include <stdio.h>
+
+#define BENCH_ITERATIONS    5
+#define BENCH_MAX_SIZES     8
+
+
+/* Shapes of the synthetic corpora */
+typedef enum {
+    BENCH_IDENTIFIERS,      /* identifiers and keywords */
+    BENCH_COMMENTS,         /* mostly line comments */
+    BENCH_NUMBERS,          /* int, float, hex and binary literals */
+    BENCH_STRINGS,          /* string literals full of escape sequences */
+    BENCH_PROGRAM,          /* well-formed functions, for the parser */
+
+    BENCH_SHAPE_COUNT
+} bench_shape_t;
+
+
+typedef struct {
+    unsigned iterations;
+
+    size_t sizes[BENCH_MAX_SIZES];
+    size_t size_count;
+
+    int shape;              /* only this shape, or -1 */
+    FILE *out;              /* JSON report */
+} bench_opts_t;
+
+
+/* Collected timings of one measurement, in seconds */
+typedef struct {
+    double samples[64];
+    unsigned count;
+} bench_timer_t;
+
+
+/* Allocation counters, as seen by the malloc family */
+typedef struct {
+    size_t count;
+    size_t bytes;
+} bench_allocs_t;
+
+
+bool        bench_parse_args   (int argc, char **argv, bench_opts_t *opts);
+clv_str     bench_shape_name   (bench_shape_t shape);
+
+/* Writes a corpus of about `size` bytes to a temporary file, and returns
+ * its path, which the caller unlinks and frees */
+char       *bench_corpus_write (bench_shape_t shape, size_t size);
+char       *bench_file_write   (const char *data, size_t length);
+
+/* Same, with a program whose main calls one function of about `size`
+ * bytes, having `locals` int locals live throughout, and calling a
+ * small function of the program when `calls` */
+char       *bench_function_write (size_t size, uint32_t locals, bool calls);
+
+double      bench_now          ();
+void        bench_timer_add    (bench_timer_t *timer, double seconds);
+double      bench_timer_min    (bench_timer_t *timer);
+double      bench_timer_median (bench_timer_t *timer);
+
+/* Counters stay at zero when allocations can't be intercepted */
+bool        bench_allocs_supported ();
+void        bench_allocs_get   (bench_allocs_t *out_allocs);
+
+void        bench_json_begin   (bench_opts_t *opts, clv_str benchmark);
+void        bench_json_result  (bench_opts_t *opts, clv_str fmt, ...) __attribute__ ((format (printf, 2, 3)));
+void        bench_json_end     (bench_opts_t *opts);
+
+#endif /* CLOVER_BENCH_H_ */
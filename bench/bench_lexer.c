@@ -0,0 +1,172 @@
+#include "bench.h"
+
+#include <clover/lexer.h>
+#include <clover/log.h>
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+
+/* Lexes the file at `path` through a streaming lexer, reading included */
+static bool
+stream_lex (clv_str path, size_t *out_tokens) {
+    int fd = open (path, O_RDONLY);
+    clv_lexer_t *lexer = (fd >= 0) ? clv_lexer_new (fd, path, 0) : NULL;
+    clv_token_t token;
+    size_t tokens = 0;
+    int status;
+
+    if (lexer == NULL) {
+        if (fd >= 0) {
+            close (fd);
+        }
+
+        return false;
+    }
+
+    while ((status = clv_lexer_next (lexer, &token)) == CLV_LEX_FOUND) {
+        tokens++;
+    }
+
+    clv_lexer_free (lexer);
+    close (fd);
+
+    *out_tokens = tokens;
+
+    return status == CLV_LEX_EOF;
+}
+
+
+static bool
+bench_lexer (bench_opts_t *opts, bench_shape_t shape, size_t size) {
+    char *path = bench_corpus_write (shape, size);
+
+    if (path == NULL) {
+        perror ("bench: unable to write corpus");
+        return false;
+    }
+
+    bench_timer_t load = { 0 };
+    bench_timer_t lex = { 0 };
+    bench_timer_t window = { 0 };
+    bench_allocs_t before, after;
+
+    size_t bytes = 0;
+    size_t tokens = 0;
+    size_t allocs = 0;
+    size_t alloc_bytes = 0;
+    size_t stream_bytes = 0;
+
+    for (unsigned i = 0; i < opts->iterations; i++) {
+        double t0 = bench_now ();
+        clv_source_t *src = clv_source_new (path);
+        double t1 = bench_now ();
+
+        // the compiler lexes every unit into its own arena, so do we
+        clv_arena_t *arena = clv_arena_new (0);
+        clv_tokens_t *stream = NULL;
+
+        if (src == NULL || arena == NULL) {
+            perror ("bench: unable to load corpus");
+            unlink (path);
+            free (path);
+            return false;
+        }
+
+        bench_allocs_get (&before);
+        double t2 = bench_now ();
+        bool ok = clv_lex (src, arena, &stream);
+        double t3 = bench_now ();
+        bench_allocs_get (&after);
+
+        if (!ok) {
+            clv_error ("bench: corpus '%s' doesn't lex", bench_shape_name (shape));
+            unlink (path);
+            free (path);
+            return false;
+        }
+
+        allocs = after.count - before.count;
+        alloc_bytes = after.bytes - before.bytes;
+
+        // the same input through a window, without loading it first
+        size_t stream_tokens = 0;
+
+        bench_allocs_get (&before);
+        double t4 = bench_now ();
+        ok = stream_lex (path, &stream_tokens);
+        double t5 = bench_now ();
+        bench_allocs_get (&after);
+
+        if (!ok || stream_tokens != clv_tokens_length (stream)) {
+            clv_error ("bench: corpus '%s' streams differently", bench_shape_name (shape));
+            unlink (path);
+            free (path);
+            return false;
+        }
+
+        bench_timer_add (&load, t1 - t0);
+        bench_timer_add (&lex, t3 - t2);
+        bench_timer_add (&window, t5 - t4);
+
+        stream_bytes = after.bytes - before.bytes;
+
+        bytes = clv_source_length (src);
+        tokens = clv_tokens_length (stream);
+
+        clv_arena_free (arena);
+        clv_source_free (src);
+    }
+
+    unlink (path);
+    free (path);
+
+    double lex_min = bench_timer_min (&lex);
+
+    bench_json_result (opts,
+        "\"corpus\": \"%s\", \"bytes\": %zu, \"tokens\": %zu, "
+        "\"source_ms_min\": %.3f, \"source_ms_median\": %.3f, "
+        "\"lex_ms_min\": %.3f, \"lex_ms_median\": %.3f, "
+        "\"mb_per_s\": %.1f, \"mtok_per_s\": %.2f, "
+        "\"allocs\": %zu, \"alloc_bytes\": %zu, \"allocs_per_token\": %.6f, "
+        "\"stream_ms_min\": %.3f, \"stream_ms_median\": %.3f, \"stream_alloc_bytes\": %zu",
+        bench_shape_name (shape), bytes, tokens,
+        bench_timer_min (&load) * 1e3, bench_timer_median (&load) * 1e3,
+        lex_min * 1e3, bench_timer_median (&lex) * 1e3,
+        bytes / lex_min / 1e6, tokens / lex_min / 1e6,
+        allocs, alloc_bytes, (tokens > 0) ? (double)allocs / tokens : 0.0,
+        bench_timer_min (&window) * 1e3, bench_timer_median (&window) * 1e3, stream_bytes);
+
+    fprintf (stderr, "lexer  %-12s %9zu bytes  %8.1f MB/s  %7.2f Mtok/s  %.4f allocs/token\n",
+             bench_shape_name (shape), bytes, bytes / lex_min / 1e6, tokens / lex_min / 1e6,
+             (tokens > 0) ? (double)allocs / tokens : 0.0);
+
+    return true;
+}
+
+
+int
+main (int argc, char **argv) {
+    bench_opts_t opts;
+
+    if (!bench_parse_args (argc, argv, &opts)) {
+        return 2;
+    }
+
+    bool good = true;
+
+    bench_json_begin (&opts, "lexer");
+
+    for (size_t i = 0; i < opts.size_count; i++) {
+        for (int shape = 0; shape < BENCH_SHAPE_COUNT; shape++) {
+            if (opts.shape < 0 || opts.shape == shape) {
+                good = bench_lexer (&opts, shape, opts.sizes[i]) && good;
+            }
+        }
+    }
+
+    bench_json_end (&opts);
+
+    return good ? 0 : 1;
+}
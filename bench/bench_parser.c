@@ -0,0 +1,120 @@
+#include "bench.h"
+
+#include <clover/lexer.h>
+#include <clover/parser.h>
+#include <clover/log.h>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+
+static bool
+bench_parser (bench_opts_t *opts, size_t size) {
+    char *path = bench_corpus_write (BENCH_PROGRAM, size);
+    clv_source_t *src;
+
+    if (path == NULL || (src = clv_source_new (path)) == NULL) {
+        perror ("bench: unable to write corpus");
+        return false;
+    }
+
+    unlink (path);
+    free (path);
+
+    bench_timer_t lex = { 0 };
+    bench_timer_t parse = { 0 };
+    bench_allocs_t before, after;
+
+    size_t tokens = 0;
+    size_t nodes = 0;
+    size_t extra = 0;
+    size_t allocs = 0;
+    size_t alloc_bytes = 0;
+
+    for (unsigned i = 0; i < opts->iterations; i++) {
+        clv_arena_t *arena = clv_arena_new (0);
+        clv_tokens_t *stream = NULL;
+        clv_ast_t *ast = NULL;
+
+        double t0 = bench_now ();
+        bool ok = (arena != NULL) && clv_lex (src, arena, &stream);
+        double t1 = bench_now ();
+
+        bench_allocs_get (&before);
+        double t2 = bench_now ();
+        ok = ok && clv_parse (src, stream, arena, &ast);
+        double t3 = bench_now ();
+        bench_allocs_get (&after);
+
+        if (!ok) {
+            clv_error ("bench: corpus doesn't parse");
+            clv_source_free (src);
+            return false;
+        }
+
+        bench_timer_add (&lex, t1 - t0);
+        bench_timer_add (&parse, t3 - t2);
+
+        tokens = clv_tokens_length (stream);
+        nodes = clv_ast_length (ast);
+        extra = clv_ast_extra_length (ast);
+        allocs = after.count - before.count;
+        alloc_bytes = after.bytes - before.bytes;
+
+        clv_arena_free (arena);
+    }
+
+    size_t bytes = clv_source_length (src);
+    double parse_min = bench_timer_min (&parse);
+
+    // node and extra storage of the tree, per node
+    double node_bytes = (nodes * sizeof (clv_node_t) + extra * sizeof (uint32_t)) / (double)nodes;
+
+    bench_json_result (opts,
+        "\"corpus\": \"%s\", \"bytes\": %zu, \"tokens\": %zu, \"nodes\": %zu, \"extra\": %zu, "
+        "\"bytes_per_node\": %.2f, \"lex_ms_min\": %.3f, "
+        "\"parse_ms_min\": %.3f, \"parse_ms_median\": %.3f, "
+        "\"mb_per_s\": %.1f, \"mtok_per_s\": %.2f, "
+        "\"allocs\": %zu, \"alloc_bytes\": %zu, \"allocs_per_token\": %.6f",
+        bench_shape_name (BENCH_PROGRAM), bytes, tokens, nodes, extra,
+        node_bytes, bench_timer_min (&lex) * 1e3,
+        parse_min * 1e3, bench_timer_median (&parse) * 1e3,
+        bytes / parse_min / 1e6, tokens / parse_min / 1e6,
+        allocs, alloc_bytes, (tokens > 0) ? (double)allocs / tokens : 0.0);
+
+    fprintf (stderr, "parser %-12s %9zu bytes  %8.1f MB/s  %7.2f Mtok/s  %5.1f bytes/node  %.4f allocs/token\n",
+             bench_shape_name (BENCH_PROGRAM), bytes, bytes / parse_min / 1e6, tokens / parse_min / 1e6,
+             node_bytes, (tokens > 0) ? (double)allocs / tokens : 0.0);
+
+    clv_source_free (src);
+
+    return true;
+}
+
+
+int
+main (int argc, char **argv) {
+    bench_opts_t opts;
+
+    if (!bench_parse_args (argc, argv, &opts)) {
+        return 2;
+    }
+
+    // only well-formed programs parse
+    if (opts.shape >= 0 && opts.shape != BENCH_PROGRAM) {
+        fprintf (stderr, "%s: only the '%s' shape can be parsed\n", argv[0], bench_shape_name (BENCH_PROGRAM));
+        return 2;
+    }
+
+    bool good = true;
+
+    bench_json_begin (&opts, "parser");
+
+    for (size_t i = 0; i < opts.size_count; i++) {
+        good = bench_parser (&opts, opts.sizes[i]) && good;
+    }
+
+    bench_json_end (&opts);
+
+    return good ? 0 : 1;
+}
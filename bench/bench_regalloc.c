@@ -0,0 +1,164 @@
+#include "bench.h"
+
+#include <clover/lexer.h>
+#include <clover/parser.h>
+#include <clover/codegen.h>
+#include <clover/ssa.h>
+#include <clover/regalloc.h>
+#include <clover/log.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+/* More locals live throughout than registers, for spills */
+#define PROGRAM_LOCALS      16
+
+/* Registers of System V x86-64 given to values, as the native backend has
+ * them */
+#define REGS_ALLOCATABLE    0xf7c8u     /* rbx, rsi, rdi, r8-r10, r12-r15 */
+#define REGS_CALLER_SAVED   0x07c0u     /* rsi, rdi, r8-r10 */
+
+
+/* Words of values needing a location, as the native backend has them:
+ * the payload unless nil, the type unless known */
+static uint32_t
+value_words (const clv_ssa_fn_t *ssa, uint32_t v, void *data) {
+    const clv_ssa_insn_t *insn = &ssa->insns[v];
+
+    (void)data;
+
+    switch (insn->op) {
+    case CLV_SSA_NIL:
+    case CLV_SSA_BOOL:
+    case CLV_SSA_INT:
+    case CLV_SSA_CONST:
+    case CLV_SSA_RET:
+        return 0;
+
+    default:
+        break;
+    }
+
+    return ((insn->type != CLV_SSA_VOID && insn->type != CLV_TYPE_NIL) ? 1u << CLV_REGALLOC_PAYLOAD : 0)
+        | ((insn->type == CLV_SSA_ANY) ? 1u << CLV_REGALLOC_TYPE : 0);
+}
+
+
+static bool
+bench_regalloc (bench_opts_t *opts, size_t size) {
+    static const uint8_t arg_regs[3][CLV_REGALLOC_WORDS] = { { 7, 6 }, { 2, 1 }, { 8, 9 } };
+    static const clv_regalloc_target_t target = {
+        .allocatable = REGS_ALLOCATABLE,
+        .caller_saved = REGS_CALLER_SAVED,
+        .arg_regs = arg_regs,
+        .arg_count = 3,
+        .words = value_words
+    };
+
+    char *path = bench_function_write (size, PROGRAM_LOCALS, true);
+    clv_source_t *src;
+
+    if (path == NULL || (src = clv_source_new (path)) == NULL) {
+        perror ("bench: unable to write corpus");
+        return false;
+    }
+
+    unlink (path);
+    free (path);
+
+    clv_arena_t *arena = clv_arena_new (0);
+    clv_tokens_t *tokens = NULL;
+    clv_ast_t *ast = NULL;
+    clv_module_t *module = NULL;
+
+    if (arena == NULL || !clv_lex (src, arena, &tokens) || !clv_parse (src, tokens, arena, &ast)
+        || !clv_codegen (src, tokens, ast, &module)) {
+        clv_error ("bench: corpus doesn't compile");
+        clv_arena_free (arena);
+        clv_source_free (src);
+        return false;
+    }
+
+    const clv_function_t *fn = clv_module_function (module, clv_module_find_function (module, "big"));
+    bench_timer_t alloc = { 0 };
+    bench_timer_t check = { 0 };
+    clv_ssa_fn_t ssa = { 0 };
+    clv_regalloc_stats_t stats = { 0 };
+    bool good = clv_ssa_build (fn, &ssa) && clv_ssa_uses (&ssa);
+
+    if (!good) {
+        clv_error ("bench: unable to build SSA: %s", strerror (errno));
+    }
+
+    for (unsigned i = 0; good && i < opts->iterations; i++) {
+        double t0 = bench_now ();
+        clv_regalloc_t *ra = clv_regalloc_new (&ssa, &target);
+        double t1 = bench_now ();
+
+        if (ra == NULL) {
+            clv_error ("bench: unable to allocate registers: %s", strerror (errno));
+            good = false;
+            break;
+        }
+
+        good = clv_regalloc_check (ra);
+        double t2 = bench_now ();
+
+        if (!good) {
+            clv_error ("bench: allocation doesn't check");
+        }
+
+        clv_regalloc_stats (ra, &stats);
+        clv_regalloc_free (ra);
+        bench_timer_add (&alloc, t1 - t0);
+        bench_timer_add (&check, t2 - t1);
+    }
+
+    if (good) {
+        double alloc_min = bench_timer_min (&alloc);
+
+        bench_json_result (opts,
+            "\"bytes\": %zu, \"values\": %u, \"blocks\": %u, \"intervals\": %u, \"splits\": %u, "
+            "\"spills\": %u, \"slots\": %u, \"moves\": %u, \"alloc_ms_min\": %.3f, "
+            "\"alloc_ms_median\": %.3f, \"alloc_ns_per_value\": %.1f, \"check_ms_min\": %.3f",
+            clv_source_length (src), ssa.count, ssa.block_count, stats.intervals, stats.splits,
+            stats.spills, stats.slots, stats.moves, alloc_min * 1e3, bench_timer_median (&alloc) * 1e3,
+            alloc_min * 1e9 / ssa.count, bench_timer_min (&check) * 1e3);
+
+        fprintf (stderr, "regalloc %9zu bytes  %8u values  %7u intervals  %6u splits  %6u spills  %4u slots  "
+                 "%7u moves  alloc %8.3f ms  %6.1f ns/value  check %8.3f ms\n",
+                 clv_source_length (src), ssa.count, stats.intervals, stats.splits, stats.spills, stats.slots,
+                 stats.moves, alloc_min * 1e3, alloc_min * 1e9 / ssa.count, bench_timer_min (&check) * 1e3);
+    }
+
+    clv_ssa_free (&ssa);
+    clv_module_free (module);
+    clv_arena_free (arena);
+    clv_source_free (src);
+
+    return good;
+}
+
+
+int
+main (int argc, char **argv) {
+    bench_opts_t opts;
+
+    if (!bench_parse_args (argc, argv, &opts)) {
+        return 2;
+    }
+
+    bool good = true;
+
+    bench_json_begin (&opts, "regalloc");
+
+    for (size_t i = 0; i < opts.size_count; i++) {
+        good = bench_regalloc (&opts, opts.sizes[i]) && good;
+    }
+
+    bench_json_end (&opts);
+
+    return good ? 0 : 1;
+}
@@ -0,0 +1,240 @@
+#include "bench.h"
+
+#include <clover/lexer.h>
+#include <clover/parser.h>
+#include <clover/sema.h>
+#include <clover/pool.h>
+#include <clover/cpu.h>
+#include <clover/log.h>
+
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+
+
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+
+    uint64_t seed;
+} program_t;
+
+
+static uint32_t
+program_rand (program_t *p, uint32_t bound) {
+    p->seed ^= p->seed << 13;
+    p->seed ^= p->seed >> 7;
+    p->seed ^= p->seed << 17;
+
+    return (uint32_t)(p->seed >> 32) % bound;
+}
+
+
+static void
+program_printf (program_t *p, clv_str fmt, ...) __attribute__ ((format (printf, 2, 3)));
+
+static void
+program_printf (program_t *p, clv_str fmt, ...) {
+    va_list args;
+
+    va_start (args, fmt);
+    int length = vsnprintf (NULL, 0, fmt, args);
+    va_end (args);
+
+    while (p->length + length + 1 > p->capacity) {
+        p->capacity = (p->capacity == 0) ? 4096 : p->capacity * 2;
+
+        if ((p->data = realloc (p->data, p->capacity)) == NULL) {
+            perror ("bench: program");
+            exit (1);
+        }
+    }
+
+    va_start (args, fmt);
+    vsnprintf (p->data + p->length, length + 1, fmt, args);
+    va_end (args);
+
+    p->length += length;
+}
+
+
+/* Int expression over a, b and acc, calling functions defined before */
+static void
+program_expr (program_t *p, uint32_t fn, int depth) {
+    static const clv_str operators[] = { "+", "-", "*", "&", "|", "^", "%" };
+    static const clv_str names[] = { "a", "b", "acc", "i", "LIMIT" };
+
+    uint32_t r = program_rand (p, 100);
+
+    if (depth > 3 || r < 30) {
+        if (r % 3 == 0) {
+            program_printf (p, "%u", program_rand (p, 1000));
+        } else {
+            program_printf (p, "%s", names[program_rand (p, CLV_LENGTH (names))]);
+        }
+    } else if (r < 75 || fn == 0) {
+        program_expr (p, fn, depth + 1);
+        program_printf (p, " %s ", operators[program_rand (p, CLV_LENGTH (operators))]);
+        program_expr (p, fn, depth + 1);
+    } else if (r < 90) {
+        program_printf (p, "f%u(", program_rand (p, fn));
+        program_expr (p, fn, depth + 1);
+        program_printf (p, ", ");
+        program_expr (p, fn, depth + 1);
+        program_printf (p, ")");
+    } else {
+        program_printf (p, "(");
+        program_expr (p, fn, depth + 1);
+        program_printf (p, ")");
+    }
+}
+
+
+/* Well-typed functions that call each other, so the whole corpus checks */
+static void
+program_fn (program_t *p, uint32_t fn) {
+    program_printf (p, "fn f%u(a: int, b: int): int {\n    let acc: int = a;\n    let i = 0;\n", fn);
+    program_printf (p, "    while i < b {\n        acc = ");
+    program_expr (p, fn, 0);
+    program_printf (p, ";\n        if acc > 1000 {\n            acc = acc %% 97;\n        } else {\n            acc = ");
+    program_expr (p, fn, 0);
+    program_printf (p, ";\n        }\n        i = i + 1;\n    }\n");
+    program_printf (p, "    let s: string = \"f%u \" + (acc as string);\n", fn);
+    program_printf (p, "    for c in s {\n        if c == ' ' { break; }\n    }\n");
+    program_printf (p, "    io.println(s);\n    return acc + str.len(s);\n}\n\n");
+}
+
+
+static char *
+program_write (size_t size, uint32_t *out_functions) {
+    program_t p = { .seed = 0x2545f4914f6cdd1dull };
+    uint32_t fn = 0;
+
+    program_printf (&p, "import io;\nimport str;\n\nconst LIMIT = 10;\n\n");
+
+    while (p.length < size) {
+        program_fn (&p, fn++);
+    }
+
+    char *path = bench_file_write (p.data, p.length);
+
+    free (p.data);
+    *out_functions = fn;
+
+    return path;
+}
+
+
+static bool
+bench_sema (bench_opts_t *opts, size_t size) {
+    uint32_t functions;
+    char *path = program_write (size, &functions);
+    clv_source_t *src;
+
+    if (path == NULL || (src = clv_source_new (path)) == NULL) {
+        perror ("bench: unable to write corpus");
+        return false;
+    }
+
+    unlink (path);
+    free (path);
+
+    clv_arena_t *arena = clv_arena_new (0);
+    clv_tokens_t *tokens = NULL;
+    clv_ast_t *ast = NULL;
+
+    if (arena == NULL || !clv_lex (src, arena, &tokens) || !clv_parse (src, tokens, arena, &ast)) {
+        clv_error ("bench: corpus doesn't parse");
+        clv_arena_free (arena);
+        clv_source_free (src);
+        return false;
+    }
+
+    unsigned cpus = clv_cpu_count ();
+    double single = 0.0;
+    bool good = true;
+
+    // one thread, then doubling up to every CPU
+    for (unsigned threads = 1; good; threads = (threads * 2 < cpus) ? threads * 2 : cpus) {
+        clv_pool_t *pool = (threads > 1) ? clv_pool_new (threads) : NULL;
+        bench_timer_t declare = { 0 };
+        bench_timer_t check = { 0 };
+
+        for (unsigned i = 0; good && i < opts->iterations; i++) {
+            clv_sema_t *sema = clv_sema_new (1);
+
+            double t0 = bench_now ();
+            good = (sema != NULL) && clv_sema_declare (sema, 0, src, tokens, ast, NULL);
+            double t1 = bench_now ();
+            good = good && clv_sema_check (sema, pool);
+            double t2 = bench_now ();
+
+            if (!good && sema != NULL) {
+                clv_sema_report (sema, 0);
+                clv_error ("bench: corpus doesn't check");
+            }
+
+            bench_timer_add (&declare, t1 - t0);
+            bench_timer_add (&check, t2 - t1);
+
+            clv_sema_free (sema);
+        }
+
+        clv_pool_free (pool);
+
+        if (!good) {
+            break;
+        }
+
+        double check_min = bench_timer_min (&check);
+
+        if (threads == 1) {
+            single = check_min;
+        }
+
+        bench_json_result (opts,
+            "\"bytes\": %zu, \"functions\": %u, \"threads\": %u, "
+            "\"declare_ms_min\": %.3f, \"check_ms_min\": %.3f, \"check_ms_median\": %.3f, "
+            "\"functions_per_s\": %.0f, \"speedup\": %.2f",
+            clv_source_length (src), functions, threads,
+            bench_timer_min (&declare) * 1e3, check_min * 1e3, bench_timer_median (&check) * 1e3,
+            functions / check_min, single / check_min);
+
+        fprintf (stderr, "sema %9zu bytes  %6u fns  %3u threads  declare %8.3f ms  check %8.3f ms  %5.2fx\n",
+                 clv_source_length (src), functions, threads, bench_timer_min (&declare) * 1e3,
+                 check_min * 1e3, single / check_min);
+
+        if (threads == cpus) {
+            break;
+        }
+    }
+
+    clv_arena_free (arena);
+    clv_source_free (src);
+
+    return good;
+}
+
+
+int
+main (int argc, char **argv) {
+    bench_opts_t opts;
+
+    if (!bench_parse_args (argc, argv, &opts)) {
+        return 2;
+    }
+
+    bool good = true;
+
+    bench_json_begin (&opts, "sema");
+
+    for (size_t i = 0; i < opts.size_count; i++) {
+        good = bench_sema (&opts, opts.sizes[i]) && good;
+    }
+
+    bench_json_end (&opts);
+
+    return good ? 0 : 1;
+}
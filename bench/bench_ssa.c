@@ -0,0 +1,151 @@
+#include "bench.h"
+
+#include <clover/lexer.h>
+#include <clover/parser.h>
+#include <clover/codegen.h>
+#include <clover/ssa.h>
+#include <clover/log.h>
+#include <clover/alloc.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#define PROGRAM_LOCALS      8
+
+
+/* Visits every operand of every instruction, as passes do */
+static uint64_t
+ssa_walk (const clv_ssa_fn_t *ssa) {
+    uint64_t sum = 0;
+
+    for (uint32_t i = 0; i < ssa->count; i++) {
+        uint32_t count;
+        const uint32_t *values = clv_ssa_operands (ssa, &ssa->insns[i], &count);
+
+        for (uint32_t k = 0; k < count; k++) {
+            sum += ssa->insns[values[k]].type;
+        }
+    }
+
+    return sum;
+}
+
+
+static bool
+bench_ssa (bench_opts_t *opts, size_t size) {
+    char *path = bench_function_write (size, PROGRAM_LOCALS, false);
+    clv_source_t *src;
+
+    if (path == NULL || (src = clv_source_new (path)) == NULL) {
+        perror ("bench: unable to write corpus");
+        return false;
+    }
+
+    unlink (path);
+    free (path);
+
+    clv_arena_t *arena = clv_arena_new (0);
+    clv_tokens_t *tokens = NULL;
+    clv_ast_t *ast = NULL;
+    clv_module_t *module = NULL;
+
+    if (arena == NULL || !clv_lex (src, arena, &tokens) || !clv_parse (src, tokens, arena, &ast)
+        || !clv_codegen (src, tokens, ast, &module)) {
+        clv_error ("bench: corpus doesn't compile");
+        clv_arena_free (arena);
+        clv_source_free (src);
+        return false;
+    }
+
+    const clv_function_t *fn = clv_module_function (module, clv_module_find_function (module, "big"));
+    bench_timer_t build = { 0 };
+    bench_timer_t walk = { 0 };
+    bench_timer_t uses = { 0 };
+    clv_ssa_fn_t ssa = { 0 };
+    size_t memory = 0;
+    size_t memory_uses = 0;
+    volatile uint64_t sink = 0;
+    bool good = true;
+
+    for (unsigned i = 0; good && i < opts->iterations; i++) {
+        clv_ssa_free (&ssa);
+
+        double t0 = bench_now ();
+        good = clv_ssa_build (fn, &ssa);
+        double t1 = bench_now ();
+
+        if (!good) {
+            clv_error ("bench: unable to build SSA: %s", strerror (errno));
+            break;
+        }
+
+        sink += ssa_walk (&ssa);
+        double t2 = bench_now ();
+        good = clv_ssa_uses (&ssa);
+        double t3 = bench_now ();
+
+        bench_timer_add (&build, t1 - t0);
+        bench_timer_add (&walk, t2 - t1);
+        bench_timer_add (&uses, t3 - t2);
+    }
+
+    (void)sink;
+
+    if (good) {
+        memory_uses = clv_ssa_memory (&ssa);
+        clv_free (ssa.use_first);
+        clv_free (ssa.uses);
+        ssa.use_first = NULL;
+        ssa.uses = NULL;
+        memory = clv_ssa_memory (&ssa);
+
+        double build_min = bench_timer_min (&build);
+        double walk_min = bench_timer_min (&walk);
+
+        bench_json_result (opts,
+            "\"bytes\": %zu, \"code\": %u, \"values\": %u, \"blocks\": %u, "
+            "\"build_ms_min\": %.3f, \"build_ms_median\": %.3f, \"values_per_s\": %.0f, "
+            "\"bytes_per_value\": %.2f, \"bytes_per_value_with_uses\": %.2f, "
+            "\"walk_ns_per_value\": %.3f, \"uses_ms_min\": %.3f",
+            clv_source_length (src), fn->code_length, ssa.count, ssa.block_count,
+            build_min * 1e3, bench_timer_median (&build) * 1e3, ssa.count / build_min,
+            (double)memory / ssa.count, (double)memory_uses / ssa.count,
+            walk_min * 1e9 / ssa.count, bench_timer_min (&uses) * 1e3);
+
+        fprintf (stderr, "ssa %9zu bytes  %8u values  %7u blocks  build %8.3f ms  %6.2f B/value  "
+                 "walk %6.3f ns/value  uses %8.3f ms\n",
+                 clv_source_length (src), ssa.count, ssa.block_count, build_min * 1e3,
+                 (double)memory / ssa.count, walk_min * 1e9 / ssa.count, bench_timer_min (&uses) * 1e3);
+    }
+
+    clv_ssa_free (&ssa);
+    clv_module_free (module);
+    clv_arena_free (arena);
+    clv_source_free (src);
+
+    return good;
+}
+
+
+int
+main (int argc, char **argv) {
+    bench_opts_t opts;
+
+    if (!bench_parse_args (argc, argv, &opts)) {
+        return 2;
+    }
+
+    bool good = true;
+
+    bench_json_begin (&opts, "ssa");
+
+    for (size_t i = 0; i < opts.size_count; i++) {
+        good = bench_ssa (&opts, opts.sizes[i]) && good;
+    }
+
+    bench_json_end (&opts);
+
+    return good ? 0 : 1;
+}
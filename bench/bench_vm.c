@@ -0,0 +1,206 @@
+#include "bench.h"
+
+#include <clover/lexer.h>
+#include <clover/parser.h>
+#include <clover/codegen.h>
+#include <clover/optimize.h>
+#include <clover/vm.h>
+#include <clover/cpu.h>
+#include <clover/log.h>
+
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+
+
+/* Programs whose main returns a checksum, so work can't be skipped */
+static const struct {
+    clv_str name;
+    clv_str code;
+} bench_programs[] = {
+    { "fib",
+      "fn fib(n: int): int {\n"
+      "    if n < 2 { return n; }\n"
+      "    return fib(n - 1) + fib(n - 2);\n"
+      "}\n"
+      "fn main(): int { return fib(27); }\n" },
+
+    { "loops",
+      "fn main(): int {\n"
+      "    let sum = 0;\n"
+      "    for i in 2000 {\n"
+      "        let j = 0;\n"
+      "        while j < 1000 {\n"
+      "            sum = (sum + i * j) & 0xffffff;\n"
+      "            j = j + 1;\n"
+      "        }\n"
+      "    }\n"
+      "    return sum;\n"
+      "}\n" },
+
+    { "strings",
+      "import str;\n"
+      "fn main(): int {\n"
+      "    let total = 0;\n"
+      "    for i in 20000 {\n"
+      "        let s = \"\";\n"
+      "        for j in 16 { s = s + (j as string) + \",\"; }\n"
+      "        total = total + str.len(s);\n"
+      "    }\n"
+      "    return total;\n"
+      "}\n" },
+};
+
+
+/* Runs main of `module` `iterations` times, and keeps the stats and result
+ * of the last run */
+static bool
+bench_run (bench_opts_t *opts, clv_module_t *module, bool jit, unsigned features, bench_timer_t *timer,
+           clv_vm_stats_t *out_stats, int64_t *out_checksum) {
+    for (unsigned i = 0; i < opts->iterations; i++) {
+        clv_vm_t *vm = clv_vm_new (module);
+        clv_value_t result;
+
+        if (vm != NULL) {
+            clv_vm_set_jit (vm, jit);
+            clv_vm_set_jit_features (vm, features);
+        }
+
+        double t0 = bench_now ();
+        bool ok = (vm != NULL) && clv_vm_run (vm, "main", &result);
+        double t1 = bench_now ();
+
+        if (!ok) {
+            clv_vm_free (vm);
+            return false;
+        }
+
+        bench_timer_add (timer, t1 - t0);
+
+        clv_vm_get_stats (vm, out_stats);
+        *out_checksum = result.as.i;
+
+        clv_vm_free (vm);
+    }
+
+    return true;
+}
+
+
+static bool
+bench_vm (bench_opts_t *opts, clv_str name, clv_str code) {
+    char *path = bench_file_write (code, strlen (code));
+    clv_source_t *src;
+
+    if (path == NULL || (src = clv_source_new (path)) == NULL) {
+        perror ("bench: unable to write program");
+        return false;
+    }
+
+    unlink (path);
+    free (path);
+
+    clv_arena_t *arena = clv_arena_new (0);
+    clv_tokens_t *tokens = NULL;
+    clv_ast_t *ast = NULL;
+    clv_module_t *module = NULL;
+
+    if (arena == NULL || !clv_lex (src, arena, &tokens) || !clv_parse (src, tokens, arena, &ast)
+        || !clv_codegen (src, tokens, ast, &module)) {
+        clv_error ("bench: program '%s' doesn't compile", name);
+        clv_arena_free (arena);
+        clv_source_free (src);
+        return false;
+    }
+
+    bench_timer_t run = { 0 };
+    bench_timer_t jit_run = { 0 };
+    bench_timer_t opt_run = { 0 };
+    clv_vm_stats_t stats = { 0 };
+    clv_vm_stats_t jit_stats = { 0 };
+    clv_vm_stats_t opt_stats = { 0 };
+    clv_opt_report_t report;
+    int64_t checksum = 0;
+    int64_t jit_checksum = 0;
+    int64_t opt_checksum = 0;
+
+    // the module is optimized in place, so after the plain runs
+    bool good = bench_run (opts, module, false, 0, &run, &stats, &checksum)
+        && bench_run (opts, module, true, 0, &jit_run, &jit_stats, &jit_checksum)
+        && clv_optimize (module, &report)
+        && bench_run (opts, module, true, clv_cpu_features (), &opt_run, &opt_stats, &opt_checksum);
+
+    if (!good || checksum != jit_checksum || checksum != opt_checksum) {
+        clv_error ("bench: program '%s' failed", name);
+        clv_module_free (module);
+        clv_arena_free (arena);
+        clv_source_free (src);
+        return false;
+    }
+
+    double run_min = bench_timer_min (&run);
+    double jit_min = bench_timer_min (&jit_run);
+    double opt_min = bench_timer_min (&opt_run);
+    double opt_seconds = 0;
+
+    for (uint32_t i = 0; i < report.pass_count; i++) {
+        opt_seconds += report.passes[i].seconds;
+    }
+
+    // what dispatching one instruction costs, on average
+    double ns_per_insn = run_min * 1e9 / stats.instructions;
+
+    bench_json_result (opts,
+        "\"program\": \"%s\", \"instructions\": %" PRIu64 ", \"collections\": %zu, \"checksum\": %" PRId64 ", "
+        "\"run_ms_min\": %.3f, \"run_ms_median\": %.3f, "
+        "\"ns_per_insn\": %.3f, \"minsn_per_s\": %.1f, "
+        "\"jit_ms_min\": %.3f, \"jit_ms_median\": %.3f, \"jit_compiled\": %zu, \"jit_speedup\": %.2f, "
+        "\"opt_compile_ms\": %.3f, \"opt_instructions\": %" PRIu64 ", "
+        "\"opt_ms_min\": %.3f, \"opt_ms_median\": %.3f, \"opt_speedup\": %.2f",
+        name, stats.instructions, stats.collections, checksum,
+        run_min * 1e3, bench_timer_median (&run) * 1e3,
+        ns_per_insn, stats.instructions / run_min / 1e6,
+        jit_min * 1e3, bench_timer_median (&jit_run) * 1e3, jit_stats.compiled, run_min / jit_min,
+        opt_seconds * 1e3, opt_stats.instructions,
+        opt_min * 1e3, bench_timer_median (&opt_run) * 1e3, jit_min / opt_min);
+
+    fprintf (stderr, "vm %-8s %12" PRIu64 " insns  %9.3f ms  %6.2f ns/insn  %7.1f Minsn/s  jit %9.3f ms  %5.2fx  "
+             "opt %7.3f ms + %9.3f ms  %5.2fx\n",
+             name, stats.instructions, run_min * 1e3, ns_per_insn, stats.instructions / run_min / 1e6,
+             jit_min * 1e3, run_min / jit_min, opt_seconds * 1e3, opt_min * 1e3, jit_min / opt_min);
+
+    clv_module_free (module);
+    clv_arena_free (arena);
+    clv_source_free (src);
+
+    return true;
+}
+
+
+int
+main (int argc, char **argv) {
+    bench_opts_t opts;
+
+    if (!bench_parse_args (argc, argv, &opts)) {
+        return 2;
+    }
+
+    // programs are fixed, corpus sizes and shapes don't apply
+    if (opts.shape >= 0) {
+        fprintf (stderr, "%s: shapes don't apply to the vm benchmark\n", argv[0]);
+        return 2;
+    }
+
+    bool good = true;
+
+    bench_json_begin (&opts, "vm");
+
+    for (size_t i = 0; i < CLV_LENGTH (bench_programs); i++) {
+        good = bench_vm (&opts, bench_programs[i].name, bench_programs[i].code) && good;
+    }
+
+    bench_json_end (&opts);
+
+    return good ? 0 : 1;
+}
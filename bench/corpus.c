@@ -0,0 +1,454 @@
+#include "bench.h"
+
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+
+    uint64_t seed;
+} corpus_t;
+
+
+static const clv_str corpus_keywords[] = {
+    "fn", "let", "if", "else", "while", "return", "struct", "match", "for", "in", "const", "nil"
+};
+
+static const clv_str corpus_operators[] = {
+    "+", "-", "*", "/", "<", ">=", "==", "!=", "&&", "||", "<<", "&"
+};
+
+
+/* xorshift64, so corpora are the same from run to run */
+static inline uint32_t
+corpus_rand (corpus_t *c, uint32_t bound) {
+    c->seed ^= c->seed << 13;
+    c->seed ^= c->seed >> 7;
+    c->seed ^= c->seed << 17;
+
+    return (uint32_t)(c->seed >> 32) % bound;
+}
+
+
+static void
+corpus_append (corpus_t *c, const char *data, size_t length) {
+    if (c->length + length + 1 > c->capacity) {
+        size_t capacity = c->capacity * 2;
+
+        while (capacity < c->length + length + 1) {
+            capacity *= 2;
+        }
+
+        if ((c->data = realloc (c->data, capacity)) == NULL) {
+            perror ("bench: corpus");
+            exit (1);
+        }
+
+        c->capacity = capacity;
+    }
+
+    memcpy (&c->data[c->length], data, length);
+    c->length += length;
+}
+
+
+static inline void
+corpus_puts (corpus_t *c, clv_str string) {
+    corpus_append (c, string, strlen (string));
+}
+
+
+static void
+corpus_printf (corpus_t *c, clv_str fmt, ...) __attribute__ ((format (printf, 2, 3)));
+
+static void
+corpus_printf (corpus_t *c, clv_str fmt, ...) {
+    char buffer[256];
+    va_list args;
+
+    va_start (args, fmt);
+    int length = vsnprintf (buffer, sizeof (buffer), fmt, args);
+    va_end (args);
+
+    corpus_append (c, buffer, (length < (int)sizeof (buffer)) ? (size_t)length : sizeof (buffer) - 1);
+}
+
+
+static void
+corpus_word (corpus_t *c, uint32_t min, uint32_t max) {
+    static const char first[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_";
+    static const char rest[] = "abcdefghijklmnopqrstuvwxyz0123456789_";
+
+    char word[64];
+    uint32_t length = min + corpus_rand (c, max - min + 1);
+
+    word[0] = first[corpus_rand (c, sizeof (first) - 1)];
+
+    for (uint32_t i = 1; i < length; i++) {
+        word[i] = rest[corpus_rand (c, sizeof (rest) - 1)];
+    }
+
+    corpus_append (c, word, length);
+}
+
+
+/* Capitalized, so it never is a keyword */
+static void
+corpus_name (corpus_t *c, uint32_t min, uint32_t max) {
+    size_t start = c->length;
+
+    corpus_word (c, min, max);
+
+    if (c->data[start] >= 'a' && c->data[start] <= 'z') {
+        c->data[start] -= 'a' - 'A';
+    }
+}
+
+
+static void
+corpus_separator (corpus_t *c) {
+    uint32_t r = corpus_rand (c, 100);
+
+    if (r < 75) {
+        corpus_puts (c, " ");
+    } else if (r < 90) {
+        corpus_puts (c, "\n    ");
+    } else {
+        corpus_puts (c, (r < 95) ? ", " : "; ");
+    }
+}
+
+
+/* == Shapes == */
+
+
+static void
+corpus_identifiers (corpus_t *c) {
+    if (corpus_rand (c, 10) == 0) {
+        corpus_puts (c, corpus_keywords[corpus_rand (c, CLV_LENGTH (corpus_keywords))]);
+    } else {
+        corpus_word (c, 1, 24);
+    }
+
+    corpus_separator (c);
+}
+
+
+static void
+corpus_comments (corpus_t *c) {
+    static const char text[] = "abcdefghij klmnopqrst uvwxyz ABCDEF 0123456789 .,;:()[]{}\"'/*-+=<>";
+
+    if (corpus_rand (c, 5) == 0) {
+        corpus_puts (c, "let ");
+        corpus_word (c, 1, 12);
+        corpus_puts (c, " = ");
+        corpus_word (c, 1, 12);
+        corpus_puts (c, ";\n");
+        return;
+    }
+
+    char line[128];
+    uint32_t length = 20 + corpus_rand (c, 80);
+
+    for (uint32_t i = 0; i < length; i++) {
+        line[i] = text[corpus_rand (c, sizeof (text) - 1)];
+    }
+
+    corpus_puts (c, (corpus_rand (c, 2) == 0) ? "// " : "    // ");
+    corpus_append (c, line, length);
+    corpus_puts (c, "\n");
+}
+
+
+static void
+corpus_numbers (corpus_t *c) {
+    switch (corpus_rand (c, 4)) {
+    case 0:
+        corpus_printf (c, "%u", corpus_rand (c, 1000000000));
+        break;
+
+    case 1:
+        corpus_printf (c, "%u.%u", corpus_rand (c, 100000), corpus_rand (c, 1000000));
+        break;
+
+    case 2:
+        corpus_printf (c, "0x%X%x", corpus_rand (c, 65536), corpus_rand (c, 1u << 31));
+        break;
+
+    default:
+        corpus_puts (c, "0b");
+
+        for (uint32_t i = 0, n = 1 + corpus_rand (c, 32); i < n; i++) {
+            corpus_puts (c, corpus_rand (c, 2) ? "1" : "0");
+        }
+
+        break;
+    }
+
+    corpus_separator (c);
+}
+
+
+static void
+corpus_strings (corpus_t *c) {
+    static const clv_str escapes[] = {
+        "\\n", "\\t", "\\\\", "\\\"", "\\'", "\\x41", "\\u00e9", "\\U0001F600"
+    };
+
+    corpus_puts (c, "\"");
+
+    for (uint32_t i = 0, n = 2 + corpus_rand (c, 12); i < n; i++) {
+        if (corpus_rand (c, 3) == 0) {
+            corpus_puts (c, escapes[corpus_rand (c, CLV_LENGTH (escapes))]);
+        } else {
+            corpus_word (c, 1, 8);
+            corpus_puts (c, " ");
+        }
+    }
+
+    corpus_puts (c, "\"");
+    corpus_separator (c);
+}
+
+
+static void
+corpus_expr (corpus_t *c, int depth) {
+    uint32_t r = corpus_rand (c, 100);
+
+    if (depth > 3 || r < 35) {
+        if (r % 3 == 0) {
+            corpus_printf (c, "%u", corpus_rand (c, 1000));
+        } else {
+            corpus_name (c, 1, 8);
+        }
+    } else if (r < 70) {
+        corpus_expr (c, depth + 1);
+        corpus_printf (c, " %s ", corpus_operators[corpus_rand (c, CLV_LENGTH (corpus_operators))]);
+        corpus_expr (c, depth + 1);
+    } else if (r < 85) {
+        corpus_name (c, 1, 8);
+        corpus_puts (c, "(");
+        corpus_expr (c, depth + 1);
+        corpus_puts (c, ", ");
+        corpus_expr (c, depth + 1);
+        corpus_puts (c, ")");
+    } else {
+        corpus_puts (c, "(");
+        corpus_expr (c, depth + 1);
+        corpus_puts (c, ")");
+    }
+}
+
+
+static void
+corpus_program (corpus_t *c) {
+    corpus_puts (c, "// generated function\nfn ");
+    corpus_name (c, 4, 12);
+    corpus_puts (c, "(a: int, b: int): int {\n    let i = 0;\n    while i < n {\n        if ");
+    corpus_expr (c, 0);
+    corpus_puts (c, " {\n            i = i + 1;\n        } else {\n            i = ");
+    corpus_expr (c, 0);
+    corpus_puts (c, ";\n        }\n    }\n    let p = Point { x: ");
+    corpus_expr (c, 0);
+    corpus_puts (c, ", y: 2 };\n    io.println(\"{} {}\\n\", p.x, ");
+    corpus_expr (c, 0);
+    corpus_puts (c, ");\n    return ");
+    corpus_expr (c, 0);
+    corpus_puts (c, ";\n}\n\n");
+}
+
+
+static void (*const corpus_shapes[BENCH_SHAPE_COUNT]) (corpus_t *c) = {
+    [BENCH_IDENTIFIERS] = corpus_identifiers,
+    [BENCH_COMMENTS]    = corpus_comments,
+    [BENCH_NUMBERS]     = corpus_numbers,
+    [BENCH_STRINGS]     = corpus_strings,
+    [BENCH_PROGRAM]     = corpus_program,
+};
+
+
+/* == Functions == */
+
+
+/* Int expression over the first `locals` locals and the params */
+static void
+function_expr (corpus_t *c, uint32_t locals, int depth) {
+    static const clv_str operators[] = { "+", "-", "*", "&", "|", "^" };
+
+    uint32_t r = corpus_rand (c, 100);
+
+    if (depth > 2 || r < 40) {
+        if (r % 4 == 0) {
+            corpus_printf (c, "%u", corpus_rand (c, 100));
+        } else if (r % 4 == 1) {
+            corpus_printf (c, "%s", (r & 8) ? "a" : "b");
+        } else {
+            corpus_printf (c, "x%u", corpus_rand (c, locals));
+        }
+    } else {
+        function_expr (c, locals, depth + 1);
+        corpus_printf (c, " %s ", operators[corpus_rand (c, CLV_LENGTH (operators))]);
+        function_expr (c, locals, depth + 1);
+    }
+}
+
+
+static void
+function_assign (corpus_t *c, uint32_t locals, clv_str indent) {
+    corpus_printf (c, "%sx%u = ", indent, corpus_rand (c, locals));
+    function_expr (c, locals, 0);
+    corpus_puts (c, ";\n");
+}
+
+
+/* Statements whose jumps stay short, however long the function */
+static void
+function_stmt (corpus_t *c, uint32_t locals, bool calls) {
+    uint32_t r = corpus_rand (c, 100);
+    uint32_t x = corpus_rand (c, locals);
+
+    if (r < (calls ? 30 : 40)) {
+        function_assign (c, locals, "    ");
+    } else if (r < 40) {
+        corpus_printf (c, "    x%u = add(x%u, ", x, corpus_rand (c, locals));
+        function_expr (c, locals, 1);
+        corpus_puts (c, ");\n");
+    } else if (r < 65) {
+        corpus_printf (c, "    if x%u < x%u {\n", x, corpus_rand (c, locals));
+        function_assign (c, locals, "        ");
+        corpus_puts (c, "    } else {\n");
+        function_assign (c, locals, "        ");
+        corpus_puts (c, "    }\n");
+    } else if (r < 80) {
+        corpus_printf (c, "    while x%u < %u {\n        x%u = x%u + 1;\n", x, corpus_rand (c, 100), x, x);
+        function_assign (c, locals, "        ");
+        corpus_puts (c, "    }\n");
+    } else if (r < 90) {
+        corpus_printf (c, "    for i in %u {\n        x%u = x%u + i;\n    }\n", corpus_rand (c, 10), x, x);
+    } else {
+        corpus_puts (c, "    for c in s {\n        if c == 'l' {\n");
+        function_assign (c, locals, "            ");
+        corpus_puts (c, "        }\n    }\n");
+    }
+}
+
+
+clv_str
+bench_shape_name (bench_shape_t shape) {
+    static const clv_str names[] = { "identifiers", "comments", "numbers", "strings", "program" };
+
+    return CLV_GET_OR (names, shape, "???");
+}
+
+
+char *
+bench_corpus_write (bench_shape_t shape, size_t size) {
+    corpus_t c = {
+        .data = malloc (4096),
+        .capacity = 4096,
+        .seed = 0x9e3779b97f4a7c15ull ^ shape
+    };
+
+    if (c.data == NULL) {
+        return NULL;
+    }
+
+    if (shape == BENCH_PROGRAM) {
+        corpus_puts (&c, "import io;\n\n");
+    }
+
+    while (c.length < size) {
+        corpus_shapes[shape] (&c);
+    }
+
+    char *path = bench_file_write (c.data, c.length);
+
+    free (c.data);
+
+    return path;
+}
+
+
+char *
+bench_file_write (const char *data, size_t length) {
+    clv_str tmpdir = getenv ("TMPDIR");
+    char *path = malloc (4096);
+
+    if (path == NULL) {
+        return NULL;
+    }
+
+    snprintf (path, 4096, "%s/clover-bench-XXXXXX", (tmpdir != NULL) ? tmpdir : "/tmp");
+
+    int fd = mkstemp (path);
+
+    if (fd < 0) {
+        free (path);
+        return NULL;
+    }
+
+    for (size_t done = 0; done < length;) {
+        ssize_t count = write (fd, data + done, length - done);
+
+        if (count < 0 && errno != EINTR) {
+            close (fd);
+            unlink (path);
+            free (path);
+            return NULL;
+        }
+
+        done += (count > 0) ? count : 0;
+    }
+
+    close (fd);
+
+    return path;
+}
+
+
+char *
+bench_function_write (size_t size, uint32_t locals, bool calls) {
+    corpus_t c = {
+        .data = malloc (4096),
+        .capacity = 4096,
+        .seed = 0x2545f4914f6cdd1dull
+    };
+
+    if (c.data == NULL) {
+        return NULL;
+    }
+
+    if (calls) {
+        corpus_puts (&c, "fn add(a: int, b: int): int {\n    return a + b;\n}\n\n");
+    }
+
+    corpus_puts (&c, "fn big(a: int, b: int): int {\n    let s = \"clover\";\n");
+
+    for (uint32_t i = 0; i < locals; i++) {
+        corpus_printf (&c, "    let x%u = %s;\n", i, (i & 1) ? "b" : "a");
+    }
+
+    while (c.length < size) {
+        function_stmt (&c, locals, calls);
+    }
+
+    corpus_puts (&c, "    return x0");
+
+    for (uint32_t i = 1; i < locals; i++) {
+        corpus_printf (&c, " + x%u", i);
+    }
+
+    corpus_puts (&c, ";\n}\n\nfn main(): int {\n    return big(3, 4);\n}\n");
+
+    char *path = bench_file_write (c.data, c.length);
+
+    free (c.data);
+
+    return path;
+}
@@ -6,6 +6,9 @@
 #include <clover/list.h>
 #include <clover/source.h>
 #include <clover/compiler.h>
+#include <clover/cache.h>
+#include <clover/timer.h>
+#include <clover/alloc.h>
 
 #include <version.h>
 
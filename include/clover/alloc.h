@@ -0,0 +1,87 @@
+#ifndef CLOVER_ALLOC_H_
+#define CLOVER_ALLOC_H_
+
+#include <clover/base.h>
+
+/* Subsystems memory is allocated for */
+typedef enum {
+    CLV_TAG_MISC,
+    CLV_TAG_LIST,
+    CLV_TAG_ARENA,          /* chunks of arenas, whatever they hold */
+    CLV_TAG_SOURCE,
+    CLV_TAG_LEXER,
+    CLV_TAG_AST,
+    CLV_TAG_INTERN,
+    CLV_TAG_LOADER,
+    CLV_TAG_SEMA,
+    CLV_TAG_BYTECODE,
+    CLV_TAG_OPTIMIZE,
+    CLV_TAG_SSA,
+    CLV_TAG_REGALLOC,
+    CLV_TAG_NATIVE,
+    CLV_TAG_CACHE,
+    CLV_TAG_BUILD,
+    CLV_TAG_VM,
+    CLV_TAG_JIT,
+
+    CLV_TAGS
+} clv_alloc_tag_t;
+
+
+/* Backend of the allocation functions. Blocks only ever go back to the
+ * backend they came from, which may keep their size and tag before them. */
+typedef struct {
+    clv_str name;
+
+    void *(*alloc)   (size_t size, bool zero, clv_alloc_tag_t tag);
+    void *(*realloc) (void *ptr, size_t size, clv_alloc_tag_t tag);
+    void  (*free)    (void *ptr);
+} clv_allocator_t;
+
+/* malloc and free, as they are */
+extern const clv_allocator_t clv_allocator_libc;
+
+/* Bump allocation out of chunks of each thread, freeing nothing until the
+ * process exits: for builds, which are short */
+extern const clv_allocator_t clv_allocator_arena;
+
+/* libc, counting the bytes and blocks of each tag, and their peaks */
+extern const clv_allocator_t clv_allocator_tracking;
+
+
+/* Makes `allocator` that of the process, which is only possible before
+ * the first allocation, failing with EBUSY after. Otherwise the backend
+ * named by CLOVER_ALLOC is taken, else tracking with DEBUG=1, which
+ * reports the peaks of each tag at exit, else libc. */
+bool  clv_alloc_use (const clv_allocator_t *allocator);
+
+/* Same as the malloc family, failing with ENOMEM. Blocks must be freed
+ * with clv_free, and only those, not what libc allocates on its own, as
+ * open_memstream and realpath do. */
+void *clv_alloc     (clv_alloc_tag_t tag, size_t size);
+void *clv_calloc    (clv_alloc_tag_t tag, size_t count, size_t size);
+void *clv_realloc   (clv_alloc_tag_t tag, void *ptr, size_t size);
+char *clv_strdup    (clv_alloc_tag_t tag, const char *string);
+char *clv_strndup   (clv_alloc_tag_t tag, const char *string, size_t length);
+void  clv_free      (void *ptr);
+
+
+typedef struct {
+    size_t bytes;           /* live */
+    size_t peak;            /* of live bytes */
+    size_t blocks;          /* live */
+    size_t count;           /* of allocations made */
+} clv_alloc_stats_t;
+
+/* Whether the backend is tracking, without which stats stay at zero */
+bool     clv_alloc_tracking     ();
+
+/* Stats of `tag`, or of all of them with CLV_TAGS */
+void     clv_alloc_stats        (clv_alloc_tag_t tag, clv_alloc_stats_t *out_stats);
+
+/* Bytes allocated so far by the calling thread, when tracking */
+uint64_t clv_alloc_thread_bytes ();
+
+clv_str  clv_alloc_tag_name     (clv_alloc_tag_t tag);
+
+#endif /* CLOVER_ALLOC_H_ */
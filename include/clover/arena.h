@@ -0,0 +1,33 @@
+#ifndef CLOVER_ARENA_H_
+#define CLOVER_ARENA_H_
+
+#include <clover/base.h>
+
+/* Default size of the chunks an arena allocates from */
+#define CLV_ARENA_CHUNK_SIZE    (64 * 1024)
+
+/* Alignment of clv_arena_alloc */
+#define CLV_ARENA_ALIGNMENT     (_Alignof (max_align_t))
+
+/* Bump allocator. Allocations are carved out of chunks that are only
+ * released together, when the arena is reset or freed. Not thread-safe. */
+typedef struct clv_arena clv_arena_t;
+
+/* Position of an arena, to roll back to with clv_arena_reset */
+typedef struct {
+    size_t chunks;
+    size_t used;
+} clv_arena_mark_t;
+
+clv_arena_t *clv_arena_new           (size_t chunk_size);
+void        *clv_arena_alloc         (clv_arena_t *self, size_t size);
+void        *clv_arena_alloc_aligned (clv_arena_t *self, size_t size, size_t alignment);
+void        *clv_arena_realloc       (clv_arena_t *self, void *ptr, size_t old_size, size_t new_size);
+char        *clv_arena_strndup       (clv_arena_t *self, const char *string, size_t length);
+size_t       clv_arena_used          (clv_arena_t *self);
+clv_arena_mark_t clv_arena_mark      (clv_arena_t *self);
+void         clv_arena_reset         (clv_arena_t *self, clv_arena_mark_t mark);
+void         clv_arena_clear         (clv_arena_t *self);
+void         clv_arena_free          (clv_arena_t *self);
+
+#endif /* CLOVER_ARENA_H_ */
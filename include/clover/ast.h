@@ -0,0 +1,131 @@
+#ifndef CLOVER_AST_H_
+#define CLOVER_AST_H_
+
+#include <clover/base.h>
+#include <clover/arena.h>
+#include <clover/source.h>
+#include <clover/token.h>
+
+/* Index of a node in its tree. Node 0 is reserved and stands for "none". */
+typedef uint32_t clv_node_id_t;
+
+#define CLV_NODE_NONE       ((clv_node_id_t)0)
+
+
+/* Node kinds. `token` is the index of the token a node is named after, and
+ * `lhs` and `rhs` hold its children as listed below. The rest live in the
+ * extra array of the tree:
+ *  - lhs..rhs span: `rhs` node ids stored from extra[lhs];
+ *  - list: the index of a count in extra, followed by as many node ids;
+ *  - record: the index of a fixed number of values in extra. */
+typedef enum {
+    CLV_NODE_INVALID,
+
+    /* items */
+    CLV_NODE_MODULE,        // lhs..rhs: span of items
+    CLV_NODE_IMPORT,        // 'import', lhs: path
+    CLV_NODE_FN,            // name, lhs: signature, rhs: body or none
+    CLV_NODE_PARAM,         // name, lhs: type or none
+    CLV_NODE_STRUCT,        // name, lhs..rhs: span of fields
+    CLV_NODE_FIELD,         // name, lhs: type, rhs: default value or none
+    CLV_NODE_ENUM,          // name, lhs..rhs: span of variants
+    CLV_NODE_VARIANT,       // name, lhs: value or none
+    CLV_NODE_TRAIT,         // name, lhs..rhs: span of fns
+    CLV_NODE_TYPEDEF,       // name, lhs: type
+    CLV_NODE_GLOBAL,        // name, lhs: type or none, rhs: value
+
+    /* types */
+    CLV_NODE_TYPE_ARRAY,    // '[', lhs: element type
+    CLV_NODE_TYPE_OPTION,   // '?', lhs: type
+    CLV_NODE_TYPE_REF,      // '&', lhs: type
+    CLV_NODE_TYPE_FN,       // 'fn', lhs: signature
+
+    /* statements */
+    CLV_NODE_BLOCK,         // '{', lhs..rhs: span of statements
+    CLV_NODE_LET,           // name, lhs: type or none, rhs: value or none
+    CLV_NODE_IF,            // 'if', lhs: condition, rhs: record { then, else or none }
+    CLV_NODE_WHILE,         // 'while', lhs: condition, rhs: body
+    CLV_NODE_FOR,           // variable, lhs: iterable, rhs: body
+    CLV_NODE_MATCH,         // 'match', lhs: value, rhs: list of arms
+    CLV_NODE_ARM,           // ':', lhs: list of patterns (empty for else), rhs: body
+    CLV_NODE_RETURN,        // 'return', lhs: value or none
+    CLV_NODE_BREAK,         // 'break'
+    CLV_NODE_CONTINUE,      // 'continue'
+    CLV_NODE_DEFER,         // 'defer', lhs: statement
+    CLV_NODE_ASSIGN,        // '=', lhs: target, rhs: value
+    CLV_NODE_EXPR,          // first token, lhs: expression
+
+    /* expressions */
+    CLV_NODE_NAME,          // identifier
+    CLV_NODE_LITERAL,       // number, string, character, true, false or nil
+    CLV_NODE_UNARY,         // operator, lhs: operand
+    CLV_NODE_BINARY,        // operator, lhs and rhs: operands
+    CLV_NODE_CAST,          // 'as', lhs: value, rhs: type
+    CLV_NODE_TRY,           // 'try', lhs: value
+    CLV_NODE_TYPEOF,        // 'typeof', lhs: value
+    CLV_NODE_UNWRAP,        // '?', lhs: value
+    CLV_NODE_CALL,          // '(', lhs: callee, rhs: list of arguments
+    CLV_NODE_INDEX,         // '[', lhs: value, rhs: index
+    CLV_NODE_MEMBER,        // member name, lhs: value
+    CLV_NODE_ARRAY,         // '[', lhs..rhs: span of elements
+    CLV_NODE_INIT,          // '{', lhs: type, rhs: list of field inits
+    CLV_NODE_FIELD_INIT,    // name, lhs: value
+
+    CLV_NODE_KIND_COUNT
+} clv_node_kind_t;
+
+
+/* Node flags */
+#define CLV_NODE_F_PUB      (1 << 0)    /* pub item */
+#define CLV_NODE_F_CONST    (1 << 1)    /* const global or let */
+#define CLV_NODE_F_STATIC   (1 << 2)    /* static global */
+#define CLV_NODE_F_METHOD   (1 << 3)    /* fn Type.name, the type is token - 2 */
+
+
+/* Signature record of CLV_NODE_FN and CLV_NODE_TYPE_FN: the result type
+ * (or none), followed by a list of params. */
+#define CLV_SIG_RESULT      0
+#define CLV_SIG_PARAMS      1
+
+
+typedef struct {
+    uint8_t kind;           /* clv_node_kind_t */
+    uint8_t flags;
+    uint16_t op;            /* token type of operators */
+
+    uint32_t token;
+
+    uint32_t lhs;
+    uint32_t rhs;
+} clv_node_t;
+
+
+/* Syntax tree. Nodes and extra data live in two flat arrays, children
+ * always before their parents, so the whole tree is freed (or written out)
+ * at once. With an arena, both arrays live in it and clv_ast_free is a
+ * no-op. */
+typedef struct clv_ast clv_ast_t;
+
+clv_ast_t        *clv_ast_new          (size_t hint, clv_arena_t *arena);
+clv_node_id_t     clv_ast_push         (clv_ast_t *self, clv_node_kind_t kind, uint32_t token, uint32_t lhs, uint32_t rhs);
+uint32_t          clv_ast_push_extra   (clv_ast_t *self, const uint32_t *values, size_t count);
+clv_node_t       *clv_ast_node         (clv_ast_t *self, clv_node_id_t id);
+const uint32_t   *clv_ast_extra        (clv_ast_t *self, uint32_t index);
+
+/* List of the extra array at `index`, stored as its count then its ids */
+const uint32_t   *clv_ast_extra_list   (clv_ast_t *self, uint32_t index, uint32_t *out_count);
+
+/* Path of an import node, a name or members of names. Modules go by the
+ * last name of their path, which is its token. */
+clv_node_t       *clv_ast_import_path  (clv_ast_t *self, const clv_node_t *import);
+
+clv_node_id_t     clv_ast_get_root     (clv_ast_t *self);
+void              clv_ast_set_root     (clv_ast_t *self, clv_node_id_t root);
+size_t            clv_ast_length       (clv_ast_t *self);
+size_t            clv_ast_extra_length (clv_ast_t *self);
+void              clv_ast_dump         (clv_ast_t *self, clv_source_t *src, clv_tokens_t *tokens);
+void              clv_ast_free         (clv_ast_t *self);
+
+clv_str clv_node_kind_name (clv_node_kind_t kind);
+
+#endif /* CLOVER_AST_H_ */
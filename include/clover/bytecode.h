@@ -0,0 +1,195 @@
+#ifndef CLOVER_BYTECODE_H_
+#define CLOVER_BYTECODE_H_
+
+#include <clover/base.h>
+#include <clover/arena.h>
+
+
+/* Types of runtime values and constants */
+typedef enum {
+    CLV_TYPE_NIL,
+    CLV_TYPE_BOOL,
+    CLV_TYPE_INT,
+    CLV_TYPE_FLOAT,
+    CLV_TYPE_CHAR,
+    CLV_TYPE_STRING,
+    CLV_TYPE_FN,
+    CLV_TYPE_NATIVE,
+
+    CLV_TYPE_COUNT
+} clv_type_t;
+
+
+/* Instructions are 32 bits wide, with the opcode in the low byte:
+ *
+ *    31      24 23      16 15       8 7        0
+ *   |    C     |    B     |    A     |    op    |   ABC
+ *   |         Bx / sBx    |    A     |    op    |   ABx, AsBx
+ *   |              sAx               |    op    |   sAx
+ *
+ * Registers are numbered from the base of the frame. Jump offsets are
+ * relative to the next instruction. */
+typedef uint32_t clv_insn_t;
+
+#define CLV_INSN_OP(i)      ((i) & 0xff)
+#define CLV_INSN_A(i)       (((i) >> 8) & 0xff)
+#define CLV_INSN_B(i)       (((i) >> 16) & 0xff)
+#define CLV_INSN_C(i)       ((i) >> 24)
+#define CLV_INSN_SC(i)      ((int32_t)(i) >> 24)
+#define CLV_INSN_BX(i)      ((i) >> 16)
+#define CLV_INSN_SBX(i)     ((int32_t)(i) >> 16)
+#define CLV_INSN_SAX(i)     ((int32_t)(i) >> 8)
+
+#define CLV_INSN_ABC(op,a,b,c)  ((clv_insn_t)(op) | (clv_insn_t)(a) << 8 | (clv_insn_t)(b) << 16 | (clv_insn_t)(uint8_t)(c) << 24)
+#define CLV_INSN_ABX(op,a,bx)   ((clv_insn_t)(op) | (clv_insn_t)(a) << 8 | (clv_insn_t)(uint16_t)(bx) << 16)
+#define CLV_INSN_SAX_(op,sax)   ((clv_insn_t)(op) | (clv_insn_t)(sax) << 8)
+
+#define CLV_INSN_MAX_REG    255
+#define CLV_INSN_MAX_BX     UINT16_MAX
+#define CLV_INSN_MIN_SBX    INT16_MIN
+#define CLV_INSN_MAX_SBX    INT16_MAX
+#define CLV_INSN_MIN_SC     INT8_MIN
+#define CLV_INSN_MAX_SC     INT8_MAX
+#define CLV_INSN_MIN_SAX    (-(1 << 23))
+#define CLV_INSN_MAX_SAX    ((1 << 23) - 1)
+
+
+/* Operand layouts, for disassembly */
+typedef enum {
+    CLV_FMT_A,          // A
+    CLV_FMT_AB,         // A B
+    CLV_FMT_ABC,        // A B C
+    CLV_FMT_ABSC,       // A B sC
+    CLV_FMT_ABX,        // A Bx
+    CLV_FMT_AK,         // A K[Bx]
+    CLV_FMT_ASBX,       // A sBx
+    CLV_FMT_SAX,        // sAx
+} clv_insn_fmt_t;
+
+
+/* X(name, format): R[x] is a register, K[x] a constant, G[x] a global */
+#define CLV_OPCODES(X) \
+    X (MOVE,        AB)     /* R[A] = R[B] */ \
+    X (LOADK,       AK)     /* R[A] = K[Bx] */ \
+    X (LOADI,       ASBX)   /* R[A] = sBx */ \
+    X (LOADNIL,     A)      /* R[A] = nil */ \
+    X (LOADBOOL,    AB)     /* R[A] = B != 0 */ \
+    X (GETGLOBAL,   ABX)    /* R[A] = G[Bx] */ \
+    X (SETGLOBAL,   ABX)    /* G[Bx] = R[A] */ \
+    X (ADD,         ABC)    /* R[A] = R[B] + R[C] */ \
+    X (SUB,         ABC)    /* R[A] = R[B] - R[C] */ \
+    X (MUL,         ABC)    /* R[A] = R[B] * R[C] */ \
+    X (DIV,         ABC)    /* R[A] = R[B] / R[C] */ \
+    X (MOD,         ABC)    /* R[A] = R[B] % R[C] */ \
+    X (ADDI,        ABSC)   /* R[A] = R[B] + sC */ \
+    X (BAND,        ABC)    /* R[A] = R[B] & R[C] */ \
+    X (BOR,         ABC)    /* R[A] = R[B] | R[C] */ \
+    X (BXOR,        ABC)    /* R[A] = R[B] ^ R[C] */ \
+    X (SHL,         ABC)    /* R[A] = R[B] << R[C] */ \
+    X (SHR,         ABC)    /* R[A] = R[B] >> R[C] */ \
+    X (EQ,          ABC)    /* R[A] = R[B] == R[C] */ \
+    X (NE,          ABC)    /* R[A] = R[B] != R[C] */ \
+    X (LT,          ABC)    /* R[A] = R[B] < R[C] */ \
+    X (LE,          ABC)    /* R[A] = R[B] <= R[C] */ \
+    X (NEG,         AB)     /* R[A] = -R[B] */ \
+    X (NOT,         AB)     /* R[A] = !R[B] */ \
+    X (BNOT,        AB)     /* R[A] = ~R[B] */ \
+    X (CAST,        ABC)    /* R[A] = R[B] as type C */ \
+    X (TYPEOF,      AB)     /* R[A] = name of the type of R[B] */ \
+    X (UNWRAP,      AB)     /* R[A] = R[B], which must not be nil */ \
+    X (JMP,         SAX)    /* pc += sAx */ \
+    X (JMPF,        ASBX)   /* if !R[A] then pc += sBx */ \
+    X (JMPT,        ASBX)   /* if R[A] then pc += sBx */ \
+    X (FORPREP,     ASBX)   /* R[A+1] = 0; pc += sBx to the FORLOOP */ \
+    X (FORLOOP,     ASBX)   /* if R[A+1] < len R[A] then R[A+2] = R[A][R[A+1]++]; pc += sBx */ \
+    X (CALL,        AB)     /* R[A] = R[A](R[A+1], ..., R[A+B]) */ \
+    X (RET,         AB)     /* return B ? R[A] : nil */
+
+typedef enum {
+#define CLV_OPCODE_ENUM(name, fmt)  CLV_OP_##name,
+    CLV_OPCODES (CLV_OPCODE_ENUM)
+#undef CLV_OPCODE_ENUM
+
+    CLV_OP_COUNT
+} clv_opcode_t;
+
+
+/* Constant pool entry. Strings point into the module. Functions of other
+ * modules are named in `s` until the modules are linked. */
+typedef struct {
+    uint8_t type;           /* clv_type_t */
+    uint16_t module;        /* of fns: 0 for this one, or 1 + their import */
+
+    union {
+        int64_t i;
+        double f;
+        uint32_t c;         /* char: a code point */
+        uint32_t index;     /* fn and native */
+
+        struct {
+            const char *data;
+            uint32_t length;
+        } s;
+    } as;
+} clv_const_t;
+
+
+typedef struct {
+    clv_str name;
+    clv_str file;           /* lines are in, NULL for that of the module */
+
+    uint32_t arity;
+    uint32_t registers;     /* frame size, arguments included */
+
+    const clv_insn_t *code;
+    const uint32_t *lines;  /* source line of each instruction */
+    uint32_t code_length;
+
+    const clv_const_t *constants;
+    uint32_t constant_count;
+} clv_function_t;
+
+
+/* Compiled module: functions, each with its own constant pool, and the
+ * names of global variables. Function 0 initializes the globals. Everything
+ * lives in the module's arena and is freed along with it. */
+typedef struct clv_module clv_module_t;
+
+clv_module_t         *clv_module_new            (clv_str file);
+clv_arena_t          *clv_module_arena          (clv_module_t *self);
+uint32_t              clv_module_add_function   (clv_module_t *self, const clv_function_t *fn);
+clv_function_t       *clv_module_function       (clv_module_t *self, uint32_t index);
+uint32_t              clv_module_function_count (clv_module_t *self);
+int64_t               clv_module_find_function  (clv_module_t *self, clv_str name);
+uint32_t              clv_module_add_global     (clv_module_t *self, clv_str name);
+clv_str               clv_module_global_name    (clv_module_t *self, uint32_t index);
+uint32_t              clv_module_global_count   (clv_module_t *self);
+
+/* Modules of the build this one uses functions of, by the name they are
+ * imported as */
+uint32_t              clv_module_add_import     (clv_module_t *self, clv_str name);
+clv_str               clv_module_import_name    (clv_module_t *self, uint32_t index);
+uint32_t              clv_module_import_count   (clv_module_t *self);
+clv_str               clv_module_get_file       (clv_module_t *self);
+void                  clv_module_dump           (clv_module_t *self);
+void                  clv_module_free           (clv_module_t *self);
+
+/* Writes the module out into a clv_alloc'ed buffer, to be read back with
+ * clv_module_load on the same host */
+bool                  clv_module_save           (clv_module_t *self, void **out_data, size_t *out_length);
+
+/* Fails with EINVAL when `data` isn't a saved module */
+clv_module_t         *clv_module_load           (clv_str file, const void *data, size_t length);
+
+/* Links `modules` into a new one, whose function 0 initializes the globals
+ * of each in order. `imports` has, for every module, the index of each of
+ * its imports in `modules`. Functions of the last module keep their names,
+ * others are prefixed with the name of their file. Fails with ENOENT on
+ * missing functions, and EOVERFLOW when globals run out of operands. */
+clv_module_t         *clv_module_link           (clv_module_t **modules, const uint32_t *const *imports, uint32_t count);
+
+clv_str        clv_opcode_name   (clv_opcode_t op);
+clv_insn_fmt_t clv_opcode_format (clv_opcode_t op);
+clv_str        clv_type_name     (clv_type_t type);
+
+#endif /* CLOVER_BYTECODE_H_ */
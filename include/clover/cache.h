@@ -0,0 +1,42 @@
+#ifndef CLOVER_CACHE_H_
+#define CLOVER_CACHE_H_
+
+#include <clover/base.h>
+
+/* Where builds keep their cache, relative to where they run */
+#define CLV_CACHE_DIR       ".clover-cache"
+
+/* Bytes the entries of a cache may take before the least recently used
+ * go */
+#define CLV_CACHE_MAX_SIZE  ((size_t)256 * 1024 * 1024)
+
+
+/* On-disk cache of build artifacts, keyed by hashes of whatever they were
+ * made from. Entries are written to a temporary file and renamed into
+ * place, so concurrent builds sharing a cache only ever see whole ones.
+ * All operations are safe to call from several threads. */
+typedef struct clv_cache clv_cache_t;
+
+/* Opens the cache in `dir`, creating it if needed */
+clv_cache_t *clv_cache_open (clv_str dir, size_t max_size);
+
+/* Reads the entry for `key` into a clv_alloc'ed buffer, and marks it as
+ * used. Fails with ENOENT when there's none, or EINVAL when it's damaged,
+ * in which case it's removed. */
+bool         clv_cache_get  (clv_cache_t *self, uint64_t key, void **out_data, size_t *out_length);
+bool         clv_cache_put  (clv_cache_t *self, uint64_t key, const void *data, size_t length);
+
+/* Maps the entry for `key` in memory, read only, instead of reading it.
+ * Fails like clv_cache_get. */
+const void  *clv_cache_map   (clv_cache_t *self, uint64_t key, size_t *out_length);
+void         clv_cache_unmap (const void *data, size_t length);
+
+/* Returns the clv_alloc'ed path of the entry for `key` */
+char        *clv_cache_path (clv_cache_t *self, uint64_t key);
+
+/* Removes the least recently used entries until the cache fits its size,
+ * and temporary files left behind by builds that died */
+bool         clv_cache_trim (clv_cache_t *self);
+void         clv_cache_free (clv_cache_t *self);
+
+#endif /* CLOVER_CACHE_H_ */
@@ -0,0 +1,14 @@
+#ifndef CLOVER_CODEGEN_H_
+#define CLOVER_CODEGEN_H_
+
+#include <clover/base.h>
+#include <clover/source.h>
+#include <clover/token.h>
+#include <clover/ast.h>
+#include <clover/bytecode.h>
+
+/* Compiles the syntax tree of `src` to bytecode. Errors are reported as
+ * they are found, and the module is only returned if there were none. */
+bool clv_codegen (clv_source_t *src, clv_tokens_t *tokens, clv_ast_t *ast, clv_module_t **out_module);
+
+#endif /* CLOVER_CODEGEN_H_ */
@@ -4,6 +4,31 @@
 #include <clover/base.h>
 #include <clover/list.h>
 
-bool clv_compile (clv_str _manifest, clv_list_t *files, clv_str output, bool debug);
+typedef struct {
+    clv_str manifest;
+    clv_str output;
+    bool debug;
+
+    unsigned jobs;      /* units compiled in parallel, 0 for one per CPU */
+
+    clv_str cache_dir;  /* of compiled units, NULL for none */
+    size_t cache_size;  /* in bytes, before old units are evicted */
+
+    clv_list_t *search_path;    /* of imported modules, or NULL */
+} clv_compile_opts_t;
+
+typedef struct {
+    bool jit;
+    bool optimize;
+
+    clv_list_t *search_path;    /* of imported modules, or NULL */
+} clv_run_opts_t;
+
+/* Builds `files` into an executable, reporting whatever fails on its own */
+bool clv_compile (clv_list_t *files, const clv_compile_opts_t *opts);
+
+/* Runs the main function of `file`, linked with the modules it imports,
+ * whose int result becomes the exit status */
+bool clv_run     (clv_str file, const clv_run_opts_t *opts, int *out_status);
 
 #endif /* CLOVER_COMPILER_H_ */
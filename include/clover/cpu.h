@@ -0,0 +1,16 @@
+#ifndef CLOVER_CPU_H_
+#define CLOVER_CPU_H_
+
+#include <clover/base.h>
+
+/* Host CPU features, detected once at startup */
+#define CLV_CPU_SSE2        (1 << 0)
+#define CLV_CPU_AVX2        (1 << 1)
+#define CLV_CPU_SSE42       (1 << 2)
+#define CLV_CPU_BMI2        (1 << 3)
+
+unsigned clv_cpu_features ();
+bool     clv_cpu_has      (unsigned features);
+unsigned clv_cpu_count    ();
+
+#endif /* CLOVER_CPU_H_ */
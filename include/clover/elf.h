@@ -0,0 +1,89 @@
+#ifndef CLOVER_ELF_H_
+#define CLOVER_ELF_H_
+
+#include <clover/base.h>
+
+/* ELF64 objects for x86-64: relocatable ones, as the native backend writes
+ * them, and the static linker putting them together into an executable,
+ * so builds need no assembler or linker installed. */
+
+/* Sections objects may have */
+typedef enum {
+    CLV_ELF_TEXT,
+    CLV_ELF_RODATA,
+    CLV_ELF_BSS,
+    CLV_ELF_DEBUG_ABBREV,
+    CLV_ELF_DEBUG_INFO,
+    CLV_ELF_DEBUG_LINE,
+
+    CLV_ELF_SECTION_COUNT,
+    CLV_ELF_UNDEF = CLV_ELF_SECTION_COUNT
+} clv_elf_section_t;
+
+
+/* Relocations, as numbered by the x86-64 psABI */
+#define CLV_ELF_R_64        1       /* S + A */
+#define CLV_ELF_R_PC32      2       /* S + A - P */
+#define CLV_ELF_R_PLT32     4       /* S + A - P, for calls */
+#define CLV_ELF_R_32        10      /* S + A, zero extended */
+
+
+/* Defined in executables: writes the `rsi` bytes at `rdi` to stderr, and
+ * exits with status 1 */
+#define CLV_ELF_FAIL        "__clv_fail"
+
+/* Same as CLV_ELF_FAIL, called by functions the backend can't compile,
+ * which executables must not be able to reach */
+#define CLV_ELF_UNSUPPORTED "__clv_unsupported"
+
+
+/* Relocatable object being built */
+typedef struct clv_elf clv_elf_t;
+
+clv_elf_t *clv_elf_new            ();
+
+/* Appends `length` bytes to a section, or zeroes when `data` is NULL, and
+ * returns the offset they start at, or UINT64_MAX when out of memory.
+ * `align` is that of the section, a power of two. */
+uint64_t   clv_elf_append         (clv_elf_t *self, clv_elf_section_t section, const void *data, size_t length,
+                                   size_t align);
+uint8_t   *clv_elf_data           (clv_elf_t *self, clv_elf_section_t section);
+size_t     clv_elf_size           (clv_elf_t *self, clv_elf_section_t section);
+
+/* Adds a symbol, at `offset` of `section`, or undefined, and returns its
+ * index, or UINT32_MAX when out of memory. Global symbols are seen from
+ * other objects, and names are copied. */
+uint32_t   clv_elf_symbol         (clv_elf_t *self, clv_str name, clv_elf_section_t section, uint64_t offset,
+                                   uint64_t size, bool global);
+
+/* Places a symbol added undefined, once where it goes is known */
+bool       clv_elf_define         (clv_elf_t *self, uint32_t symbol, clv_elf_section_t section, uint64_t offset,
+                                   uint64_t size);
+
+/* Symbol standing for the start of a section */
+uint32_t   clv_elf_section_symbol (clv_elf_t *self, clv_elf_section_t section);
+
+bool       clv_elf_relocate       (clv_elf_t *self, clv_elf_section_t section, uint64_t offset, uint32_t type,
+                                   uint32_t symbol, int64_t addend);
+
+/* Writes the object into a clv_alloc'ed buffer */
+bool       clv_elf_write          (clv_elf_t *self, void **out_data, size_t *out_length);
+void       clv_elf_free           (clv_elf_t *self);
+
+
+typedef struct {
+    clv_str name;           /* for diagnostics */
+    const void *data;
+    size_t length;
+} clv_elf_object_t;
+
+/* Links `objects` into an executable at `output`, which calls each symbol
+ * of `init` in order, then `entry`, and exits with the int it returns.
+ * Functions return values as {type, payload}. Fails with EINVAL, after
+ * reporting why, on damaged objects, duplicate or undefined symbols, and
+ * functions calling CLV_ELF_UNSUPPORTED that any of those refer to, even
+ * through others. */
+bool       clv_elf_link           (const clv_elf_object_t *objects, uint32_t count, const clv_str *init,
+                                   uint32_t init_count, clv_str entry, clv_str output);
+
+#endif /* CLOVER_ELF_H_ */
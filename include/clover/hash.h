@@ -0,0 +1,10 @@
+#ifndef CLOVER_HASH_H_
+#define CLOVER_HASH_H_
+
+#include <clover/base.h>
+
+/* Fast 64-bit hash of `data` (XXH64), for content keys. Not for anything
+ * an attacker controls the collisions of. */
+uint64_t clv_hash64 (const void *data, size_t length, uint64_t seed);
+
+#endif /* CLOVER_HASH_H_ */
@@ -0,0 +1,46 @@
+#ifndef CLOVER_INTERFACE_H_
+#define CLOVER_INTERFACE_H_
+
+#include <clover/base.h>
+#include <clover/cache.h>
+
+/* Public function of a module, as its importers see it */
+typedef struct {
+    clv_str name;           /* NUL terminated */
+    uint32_t length;
+    uint32_t arity;
+    const uint8_t *params;  /* static type of each param */
+    uint8_t result;         /* static type it returns */
+} clv_export_t;
+
+
+/* What importers need of a module: its imports, to place it in the build,
+ * and its public functions, to check calls. Interfaces are written to the
+ * cache when a module is compiled, and mapped straight from it by builds
+ * importing the module, so they cost as much as the functions they export,
+ * whatever the size of the module. */
+typedef struct clv_interface clv_interface_t;
+
+/* Cache key of the interface of a source whose hash is `hash` */
+uint64_t         clv_interface_key          (uint64_t hash);
+
+/* Writes an interface into a clv_alloc'ed buffer: `imports` has the path of
+ * each import item, as written, and `hash` is that of the source */
+bool             clv_interface_save         (uint64_t hash, const clv_str *imports, uint32_t import_count,
+                                             const clv_export_t *exports, uint32_t export_count,
+                                             void **out_data, size_t *out_length);
+
+/* Maps the interface of the source whose hash is `hash` from `cache`.
+ * Fails with ENOENT when there's none, and EINVAL when it's damaged or of
+ * another source. */
+clv_interface_t *clv_interface_open         (clv_cache_t *cache, uint64_t hash);
+
+uint32_t         clv_interface_import_count (clv_interface_t *self);
+clv_str          clv_interface_import       (clv_interface_t *self, uint32_t index, uint32_t *out_length);
+
+uint32_t         clv_interface_export_count (clv_interface_t *self);
+clv_export_t     clv_interface_export       (clv_interface_t *self, uint32_t index);
+
+void             clv_interface_free         (clv_interface_t *self);
+
+#endif /* CLOVER_INTERFACE_H_ */
@@ -0,0 +1,37 @@
+#ifndef CLOVER_INTERN_H_
+#define CLOVER_INTERN_H_
+
+#include <clover/base.h>
+
+/* Atoms of strings that were never interned */
+#define CLV_ATOM_NONE   0
+
+
+/* Interned string. Equal strings get the same atom, so they compare as
+ * integers, whichever unit or thread interned them. */
+typedef uint32_t clv_atom_t;
+
+/* Process-wide string table. It's split into shards, each with its own
+ * lock, so threads interning different strings rarely wait on each other.
+ * Strings are copied in and live until the process exits.
+ *
+ * Returns CLV_ATOM_NONE when out of memory, or of atoms. */
+clv_atom_t clv_intern        (const char *string, size_t length);
+
+/* Same, for callers that already hashed `string`, which must have been
+ * with clv_hash64 (string, length, 0) */
+clv_atom_t clv_intern_hashed (const char *string, size_t length, uint64_t hash);
+
+/* Returns the atom of `string` if it was interned, or CLV_ATOM_NONE */
+clv_atom_t clv_intern_find   (const char *string, size_t length);
+
+/* Total of distinct strings interned so far */
+size_t     clv_intern_count  ();
+
+/* Return the NUL terminated string of `atom`, its length, and its hash.
+ * These never lock. */
+clv_str    clv_atom_string   (clv_atom_t atom);
+uint32_t   clv_atom_length   (clv_atom_t atom);
+uint32_t   clv_atom_hash     (clv_atom_t atom);
+
+#endif /* CLOVER_INTERN_H_ */
@@ -0,0 +1,88 @@
+#ifndef CLOVER_IR_H_
+#define CLOVER_IR_H_
+
+#include <clover/base.h>
+#include <clover/bytecode.h>
+
+/* Mid-level IR: the bytecode of a function split into basic blocks, with
+ * operands decoded and jumps pointing at blocks instead of offsets, so
+ * passes can insert and remove instructions freely. */
+
+#define CLV_IR_NO_BLOCK     UINT32_MAX
+
+/* Registers, as sets, for the dataflow of passes */
+typedef struct {
+    uint64_t bits[4];
+} clv_ir_regs_t;
+
+#define CLV_IR_REGS_HAS(set,r)  (((set)->bits[(r) >> 6] >> ((r) & 63)) & 1)
+#define CLV_IR_REGS_ADD(set,r)  ((set)->bits[(r) >> 6] |= (uint64_t)1 << ((r) & 63))
+
+
+/* Operands by format:
+ *  - ABC, ABSC, AB and A: `a`, `b` and `c` as in the bytecode;
+ *  - ABX and AK: `b` is the global or constant;
+ *  - LOADI: `c` is the value;
+ *  - jumps, FORPREP and FORLOOP: `c` is the target block. */
+typedef struct {
+    uint8_t op;             /* clv_opcode_t */
+    uint8_t a;
+    uint16_t b;
+    int32_t c;
+
+    uint32_t line;
+} clv_ir_insn_t;
+
+
+/* Blocks stay in the order of the bytecode, and those not ending with a
+ * jump or a return fall through to the next one */
+typedef struct {
+    clv_ir_insn_t *insns;
+    uint32_t count;
+    uint32_t capacity;
+
+    bool dead;              /* unreachable, and left out of the bytecode */
+} clv_ir_block_t;
+
+
+typedef struct {
+    const clv_function_t *source;
+
+    clv_ir_block_t *blocks;
+    uint32_t block_count;
+
+    clv_const_t *constants;
+    uint32_t constant_count;
+    uint32_t constant_capacity;
+
+    uint32_t registers;
+} clv_ir_fn_t;
+
+
+bool     clv_ir_build        (const clv_function_t *fn, clv_ir_fn_t *out_ir);
+
+/* Writes the IR back as bytecode into `arena`. Fails with ERANGE when a
+ * jump or a constant no longer fits its instruction. */
+bool     clv_ir_emit         (clv_ir_fn_t *self, clv_arena_t *arena, clv_function_t *out_fn);
+void     clv_ir_free         (clv_ir_fn_t *self);
+
+bool     clv_ir_insert       (clv_ir_fn_t *self, uint32_t block, uint32_t index, const clv_ir_insn_t *insns, uint32_t count);
+void     clv_ir_remove       (clv_ir_fn_t *self, uint32_t block, uint32_t index);
+
+/* Returns the index of `k` in the constant pool, adding it if needed, or
+ * UINT32_MAX when out of memory */
+uint32_t clv_ir_constant     (clv_ir_fn_t *self, const clv_const_t *k);
+
+/* Blocks control may go to after `block`, and how many */
+uint32_t clv_ir_successors   (clv_ir_fn_t *self, uint32_t block, uint32_t out_succ[2]);
+size_t   clv_ir_length       (clv_ir_fn_t *self);
+
+/* Registers read and written by an instruction. Calls write all the
+ * registers from their base up, as the callee's frame starts there. */
+void     clv_ir_reads        (const clv_ir_insn_t *insn, clv_ir_regs_t *out_regs);
+void     clv_ir_writes       (const clv_ir_insn_t *insn, clv_ir_regs_t *out_regs);
+
+/* Whether an instruction only writes its registers, and never fails */
+bool     clv_ir_pure         (const clv_ir_insn_t *insn);
+
+#endif /* CLOVER_IR_H_ */
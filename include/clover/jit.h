@@ -0,0 +1,28 @@
+#ifndef CLOVER_JIT_H_
+#define CLOVER_JIT_H_
+
+#include <clover/base.h>
+#include <clover/bytecode.h>
+#include <clover/vm.h>
+
+/* Baseline compiler from bytecode to x86-64 machine code. Each instruction
+ * becomes a fixed template working on the register file of the VM, so
+ * code can be entered and left at any instruction: whatever a template
+ * doesn't handle (calls, returns, allocations, errors and unexpected
+ * types) returns to the interpreter before it changes anything. */
+typedef struct clv_jit_code clv_jit_code_t;
+
+/* Compiles `fn`, whose constants and the globals it uses must outlive the
+ * code, with templates using the CLV_CPU_* `features` where they pay off.
+ * Returns NULL with errno set on failure, or ENOTSUP on hosts other than
+ * x86-64. */
+clv_jit_code_t *clv_jit_compile (const clv_function_t *fn, const clv_value_t *constants, clv_value_t *globals,
+                                 unsigned features);
+
+/* Runs the code from instruction `pc`, with the registers at `base`, and
+ * returns the instruction the interpreter resumes at */
+uint32_t        clv_jit_enter   (clv_jit_code_t *self, clv_value_t *base, uint32_t pc);
+size_t          clv_jit_size    (clv_jit_code_t *self);
+void            clv_jit_free    (clv_jit_code_t *self);
+
+#endif /* CLOVER_JIT_H_ */
@@ -3,92 +3,38 @@
 
 #include <clover/base.h>
 #include <clover/source.h>
-#include <clover/list.h>
+#include <clover/token.h>
 
+/* Initial size of the window of streaming lexers */
+#define CLV_LEXER_BUFFER_SIZE   (64 * 1024)
 
-typedef enum {
-    CLV_TOKEN_COMMENT,      // //
-    CLV_TOKEN_IDENTIFIER,   // self
-    CLV_TOKEN_STRING,       // "string"
-    CLV_TOKEN_CHARACTER,    // 'a'
-    CLV_TOKEN_FLOAT,        // 3.1415926536
-    CLV_TOKEN_INT,          // 10
-    CLV_TOKEN_BIN,          // 0b10101010
-    CLV_TOKEN_HEX,          // 0x7ffffdb0
-    CLV_TOKEN_IMPORT,       // import
-    CLV_TOKEN_FN,           // fn
-    CLV_TOKEN_TYPE,         // type
-    CLV_TOKEN_TRAIT,        // trait
-    CLV_TOKEN_DEFER,        // defer
-    CLV_TOKEN_STRUCT,       // struct
-    CLV_TOKEN_ENUM,         // enum
-    CLV_TOKEN_IN,           // in
-    CLV_TOKEN_AS,           // as
-    CLV_TOKEN_TYPEOF,       // typeof
-    CLV_TOKEN_IF,           // if
-    CLV_TOKEN_ELIF,         // elif
-    CLV_TOKEN_ELSE,         // else
-    CLV_TOKEN_FOR,          // for
-    CLV_TOKEN_WHILE,        // while
-    CLV_TOKEN_CONTINUE,     // continue
-    CLV_TOKEN_BREAK,        // break
-    CLV_TOKEN_MATCH,        // match
-    CLV_TOKEN_RETURN,       // return
-    CLV_TOKEN_LET,          // let
-    CLV_TOKEN_TRY,          // try
-    CLV_TOKEN_NIL,          // nil
-    CLV_TOKEN_TRUE,         // true
-    CLV_TOKEN_FALSE,        // false
-    CLV_TOKEN_PUB,          // pub
-    CLV_TOKEN_STATIC,       // static
-    CLV_TOKEN_CONST,        // const
-    CLV_TOKEN_BIT_NOT,      // ~
-    CLV_TOKEN_BIT_AND,      // &
-    CLV_TOKEN_BIT_OR,       // |
-    CLV_TOKEN_BIT_XOR,      // ^
-    CLV_TOKEN_BIT_SHL,      // <<
-    CLV_TOKEN_BIT_SHR,      // >>
-    CLV_TOKEN_NOT,          // !
-    CLV_TOKEN_AND,          // &&
-    CLV_TOKEN_OR,           // ||
-    CLV_TOKEN_EQ,           // ==
-    CLV_TOKEN_NE,           // !=
-    CLV_TOKEN_LT,           // <
-    CLV_TOKEN_GT,           // >
-    CLV_TOKEN_LE,           // <=
-    CLV_TOKEN_GE,           // >=
-    CLV_TOKEN_ASSIGN,       // =
-    CLV_TOKEN_PLUS,         // +
-    CLV_TOKEN_MINUS,        // -
-    CLV_TOKEN_MULTIPLY,     // *
-    CLV_TOKEN_DIVIDE,       // /
-    CLV_TOKEN_REMAINDER,    // %
-    CLV_TOKEN_PERIOD,       // .
-    CLV_TOKEN_COMMA,        // ,
-    CLV_TOKEN_COLON,        // :
-    CLV_TOKEN_SEMICOLON,    // ;
-    CLV_TOKEN_QUESTIONMARK, // ?
-    CLV_TOKEN_LPARENTHESIS, // (
-    CLV_TOKEN_RPARENTHESIS, // )
-    CLV_TOKEN_LBRACKET,     // [
-    CLV_TOKEN_RBRACKET,     // ]
-    CLV_TOKEN_LBRACE,       // {
-    CLV_TOKEN_RBRACE,       // }
-} clv_tktype_t;
+/* Results of clv_lexer_next */
+#define CLV_LEX_EOF             (-1)    /* end of input */
+#define CLV_LEX_ERROR           0       /* reported errors */
+#define CLV_LEX_FOUND           1
 
 
-typedef struct {
-    clv_tktype_t type;
+bool clv_lex (clv_source_t *src, clv_arena_t *arena, clv_tokens_t **out_tokens);
 
-    uint32_t offset;
-    uint32_t line_offset;
-    uint32_t length;
 
-    uint32_t line;
-    uint32_t column;
-} clv_token_t;
+/* Pull-based lexer over a file descriptor, for inputs too large to load or
+ * that can only be read once, such as pipes. Tokens are lexed out of a
+ * window that's refilled as they are consumed, so memory stays bounded by
+ * the buffer size, or the longest line or literal if they don't fit.
+ *
+ * Token offsets count from the start of the input, truncated to 32 bits. */
+typedef struct clv_lexer clv_lexer_t;
 
+/* `file` names the input in diagnostics. The descriptor isn't closed. */
+clv_lexer_t *clv_lexer_new    (int fd, clv_str file, size_t buffer_size);
 
-bool clv_lex (clv_source_t *src, clv_list_t **out_tokens);
+/* Reads the next token, returning one of CLV_LEX_* */
+int          clv_lexer_next   (clv_lexer_t *self, clv_token_t *out_token);
+
+/* Return the text and the location of the last token, valid until the
+ * next call */
+const char  *clv_lexer_text   (clv_lexer_t *self, const clv_token_t *token);
+void         clv_lexer_locate (clv_lexer_t *self, const clv_token_t *token, clv_location_t *out_location);
+void         clv_lexer_free   (clv_lexer_t *self);
 
 #endif /* CLOVER_LEXER_H_ */
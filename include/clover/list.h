@@ -2,14 +2,17 @@
 #define CLOVER_LIST_H_
 
 #include <clover/base.h>
+#include <clover/arena.h>
 
+/* Doubly linked list. When created with an arena, the list and its nodes
+ * live in it, and clearing or freeing the list only releases the items. */
 typedef struct clv_list clv_list_t;
 
 typedef void (*clv_list_func_t)(void *data);
 
 typedef void *clv_list_iter_t;
 
-clv_list_t *clv_list_new       ();
+clv_list_t *clv_list_new       (clv_arena_t *arena);
 bool        clv_list_push_back (clv_list_t *list, void *ptr);
 bool        clv_list_pop_back  (clv_list_t *list, void **out_ptr);
 size_t      clv_list_length    (clv_list_t *list);
@@ -0,0 +1,84 @@
+#ifndef CLOVER_LOADER_H_
+#define CLOVER_LOADER_H_
+
+#include <clover/base.h>
+#include <clover/list.h>
+#include <clover/source.h>
+#include <clover/token.h>
+#include <clover/ast.h>
+#include <clover/pool.h>
+#include <clover/cache.h>
+#include <clover/interface.h>
+
+/* Extension of the files of modules */
+#define CLV_MODULE_EXT      ".cl"
+
+
+/* Units of a build: the files it is given, and the modules they import,
+ * found on a search path. Each unit is loaded and parsed once, however many
+ * units import it, and imports must not form cycles. */
+typedef struct clv_loader clv_loader_t;
+
+typedef struct {
+    clv_str file;
+    clv_source_t *src;
+    uint64_t hash;          /* of the source, seeded as the loader's cache */
+
+    /* NULL when it failed to load, or was released, or wasn't parsed */
+    clv_tokens_t *tokens;
+    clv_ast_t *ast;
+
+    clv_interface_t *iface; /* when loaded from its interface */
+
+    /* unit of each import item, in order, or UINT32_MAX for native modules,
+     * and its path as written */
+    uint32_t *imports;
+    clv_str *import_paths;
+    uint32_t import_count;
+} clv_unit_t;
+
+/* Runs on a unit once those it imports are done, returning whether it
+ * succeeded. Units importing one it failed on are skipped. */
+typedef bool (*clv_loader_func_t)(void *arg, uint32_t unit);
+
+/* Modules are looked up next to the unit importing them, then in each
+ * directory of `search_path`, which may be NULL. `a.b` is a/b.cl. */
+clv_loader_t     *clv_loader_new       (clv_list_t *search_path);
+
+/* Units whose interface is in `cache`, hashed with `seed`, are loaded from
+ * it rather than parsed */
+void              clv_loader_set_cache (clv_loader_t *self, clv_cache_t *cache, uint64_t seed);
+
+/* Adds a file to the build, unless added already, and returns its unit, or
+ * UINT32_MAX when out of memory. Files must outlive the loader. */
+uint32_t          clv_loader_add       (clv_loader_t *self, clv_str file);
+
+/* Loads the files added and every module they import, parsing units on
+ * `pool`, or on the calling thread without one. Diagnostics are held until
+ * reported. Returns whether every unit loaded, with no import cycles. */
+bool              clv_loader_load      (clv_loader_t *self, clv_pool_t *pool);
+
+/* Emits the diagnostics of loading `unit` */
+void              clv_loader_report    (clv_loader_t *self, uint32_t unit);
+
+uint32_t          clv_loader_count     (clv_loader_t *self);
+clv_unit_t       *clv_loader_unit      (clv_loader_t *self, uint32_t unit);
+
+/* Units loaded, each after those it imports, as of clv_loader_load */
+const uint32_t   *clv_loader_order     (clv_loader_t *self, uint32_t *out_count);
+
+/* Runs `func` on every unit loaded once the units it imports are done: on
+ * `pool`, units that don't depend on each other run concurrently, and
+ * without one, units run in order. Returns whether all units succeeded. */
+bool              clv_loader_schedule  (clv_loader_t *self, clv_pool_t *pool, clv_loader_func_t func, void *arg);
+
+/* Parses a unit loaded from its interface, when more than its declarations
+ * is needed. Units may be parsed concurrently. */
+bool              clv_loader_parse     (clv_loader_t *self, uint32_t unit);
+
+/* Frees what the front end built for `unit` */
+void              clv_loader_release   (clv_loader_t *self, uint32_t unit);
+
+void              clv_loader_free      (clv_loader_t *self);
+
+#endif /* CLOVER_LOADER_H_ */
@@ -3,6 +3,9 @@
 
 #include <clover/base.h>
 
+#include <stdio.h>
+#include <stdarg.h>
+
 #define CLV_LOG_NONE        (0)
 #define CLV_LOG_FORMAT      (1)
 #define CLV_LOG_NEWLINE     (2)
@@ -22,8 +25,40 @@
 #define clv_warning(msg,args...)    clv_log (CLV_WARNING, msg, ## args)
 #define clv_error(msg,args...)      clv_log (CLV_ERROR, msg, ## args)
 
+#define CLV_LOG_RECORD_INLINE   (512)
+
+/* A log record is formatted into a buffer owned by the calling thread, and
+ * then written out in one piece, so records of concurrent threads never
+ * interleave. When the output isn't a terminal, records are batched and
+ * written out together. */
+typedef struct {
+    int level;
+
+    char *data;
+    size_t length;
+    size_t capacity;
+
+    char inline_data[CLV_LOG_RECORD_INLINE];
+} clv_log_record_t;
+
 void _clv_log0 (clv_str file, int lineno, int level, int mode, clv_str msg, ...);
 
 bool clv_log_debug ();
 
+void clv_log_begin   (clv_log_record_t *rec, int level);
+void clv_log_printf  (clv_log_record_t *rec, clv_str fmt, ...);
+void clv_log_vprintf (clv_log_record_t *rec, clv_str fmt, va_list args);
+void clv_log_append  (clv_log_record_t *rec, const char *data, size_t length);
+void clv_log_end     (clv_log_record_t *rec);
+
+/* Emits `data` as a single record */
+void clv_log_write   (int level, const char *data, size_t length);
+
+/* Writes out batched records */
+void clv_log_flush   ();
+
+/* Redirects the records emitted by the calling thread, below CLV_ERROR to
+ * `out` and the rest to `err`. Pass NULL to restore stdout and stderr. */
+void clv_log_capture (FILE *out, FILE *err);
+
 #endif /* CLOVER_LOG_H_ */
@@ -0,0 +1,30 @@
+#ifndef CLOVER_NATIVE_H_
+#define CLOVER_NATIVE_H_
+
+#include <clover/base.h>
+#include <clover/bytecode.h>
+
+/* x86-64 backend: compiles a module from the SSA form of its functions
+ * into an ELF relocatable object, for clv_elf_link.
+ *
+ * Function `name` of a module is the global symbol `prefix.name`, taking
+ * and returning values as {type, payload} pairs of 64 bits, passed as the
+ * System V ABI passes such structs. Globals of a module are its own, in
+ * its bss. Functions using what the backend can't compile yet, anything
+ * but nil, bools and ints, call CLV_ELF_UNSUPPORTED, failing the link of
+ * executables that may run them. */
+
+/* Function 0, initializing the globals, whatever its name */
+#define CLV_NATIVE_INIT     "<globals>"
+
+typedef struct {
+    clv_str prefix;             /* of the module's symbols */
+    const clv_str *imports;     /* prefix of each import, NULL for those not compiled */
+    bool debug;                 /* adds DWARF line info */
+} clv_native_opts_t;
+
+/* Writes the object of `module` into a clv_alloc'ed buffer */
+bool clv_native_compile (clv_module_t *module, const clv_native_opts_t *opts, void **out_data,
+                         size_t *out_length);
+
+#endif /* CLOVER_NATIVE_H_ */
@@ -0,0 +1,40 @@
+#ifndef CLOVER_OPTIMIZE_H_
+#define CLOVER_OPTIMIZE_H_
+
+#include <clover/base.h>
+#include <clover/bytecode.h>
+
+#define CLV_OPT_MAX_PASSES  16
+
+
+typedef struct {
+    clv_str name;
+    double seconds;         /* over all the functions of the module */
+
+    size_t before;          /* instructions */
+    size_t after;
+} clv_opt_pass_t;
+
+
+typedef struct {
+    clv_opt_pass_t passes[CLV_OPT_MAX_PASSES];
+    uint32_t pass_count;
+
+    size_t inlined;         /* calls */
+    size_t folded;          /* instructions computed ahead of time */
+    size_t removed;         /* dead instructions */
+    size_t hoisted;         /* out of loops */
+    size_t skipped;         /* functions left as they were */
+} clv_opt_report_t;
+
+
+/* Rewrites the functions of `module` through the pass pipeline: inlining
+ * of small functions, copy propagation, constant folding, dead code
+ * elimination and loop invariant code motion. A function whose optimized
+ * code no longer fits the bytecode is left as it was. */
+bool clv_optimize        (clv_module_t *module, clv_opt_report_t *out_report);
+
+/* Logs the passes, their timing and what they did */
+void clv_opt_report_dump (const clv_opt_report_t *report);
+
+#endif /* CLOVER_OPTIMIZE_H_ */
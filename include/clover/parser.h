@@ -0,0 +1,14 @@
+#ifndef CLOVER_PARSER_H_
+#define CLOVER_PARSER_H_
+
+#include <clover/base.h>
+#include <clover/source.h>
+#include <clover/token.h>
+#include <clover/ast.h>
+
+/* Parses the tokens of `src` into a syntax tree, which is allocated in
+ * `arena` if given. Syntax errors are reported as they are found; the
+ * parser then skips to the next item, and fails once the module is done. */
+bool clv_parse (clv_source_t *src, clv_tokens_t *tokens, clv_arena_t *arena, clv_ast_t **out_ast);
+
+#endif /* CLOVER_PARSER_H_ */
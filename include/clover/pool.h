@@ -0,0 +1,19 @@
+#ifndef CLOVER_POOL_H_
+#define CLOVER_POOL_H_
+
+#include <clover/base.h>
+
+/* Work-stealing thread pool. Every worker owns a task deque: it pops its
+ * own tasks newest first, and steals the oldest tasks of other workers when
+ * its deque runs dry. Tasks submitted from a worker go to its own deque. */
+typedef struct clv_pool clv_pool_t;
+
+typedef void (*clv_pool_func_t)(void *arg);
+
+clv_pool_t *clv_pool_new     (unsigned threads);
+bool        clv_pool_submit  (clv_pool_t *self, clv_pool_func_t func, void *arg);
+void        clv_pool_wait    (clv_pool_t *self);
+unsigned    clv_pool_threads (clv_pool_t *self);
+void        clv_pool_free    (clv_pool_t *self);
+
+#endif /* CLOVER_POOL_H_ */
@@ -0,0 +1,115 @@
+#ifndef CLOVER_REGALLOC_H_
+#define CLOVER_REGALLOC_H_
+
+#include <clover/base.h>
+#include <clover/ssa.h>
+
+/* Linear scan register allocation on the SSA form of a function, after
+ * Wimmer and Franz: each word of a value gets a live interval, which is
+ * split where it can't keep a register, and each piece gets a register or
+ * a spill slot. Blocks are laid out as the SSA form has them.
+ *
+ * Instruction v reads its operands at USE (v), calls clobber registers at
+ * USE (v) + 1, and v writes its value at DEF (v). Moves between the pieces
+ * of an interval are made at these positions, or on edges between blocks,
+ * which also carry the phis. */
+
+#define CLV_REGALLOC_MAX_REGS   32
+
+#define CLV_REGALLOC_USE(v)     (4 * (v))
+#define CLV_REGALLOC_DEF(v)     (4 * (v) + 2)
+
+/* Locations are registers of the target, numbered as it does, then spill
+ * slots of 8 bytes */
+typedef uint32_t clv_loc_t;
+
+#define CLV_LOC_SLOT(s)         (CLV_REGALLOC_MAX_REGS + (s))
+#define CLV_LOC_IS_SLOT(loc)    ((loc) >= CLV_REGALLOC_MAX_REGS && (loc) < CLV_LOC_TEMP)
+#define CLV_LOC_SLOT_OF(loc)    ((loc) - CLV_REGALLOC_MAX_REGS)
+
+/* Scratch register of the target, holding a value while cycles of moves
+ * are broken */
+#define CLV_LOC_TEMP            (UINT32_MAX - 1)
+
+/* No location: the value isn't live, or the backend rematerializes it */
+#define CLV_LOC_NONE            UINT32_MAX
+
+
+/* Words of a value, as clv_value_t has them */
+typedef enum {
+    CLV_REGALLOC_TYPE,
+    CLV_REGALLOC_PAYLOAD,
+
+    CLV_REGALLOC_WORDS
+} clv_regalloc_word_t;
+
+
+/* Copies a word of `value` to `dst`, from `src`, or rematerialized when
+ * `src` is CLV_LOC_NONE */
+typedef struct {
+    clv_loc_t dst;
+    clv_loc_t src;
+    uint32_t value;
+    uint8_t word;
+} clv_move_t;
+
+
+typedef struct {
+    uint32_t allocatable;       /* registers values may be given */
+    uint32_t caller_saved;      /* registers calls clobber */
+
+    /* registers of the words of each argument passed in registers, or
+     * UINT8_MAX, which parameters are taken from and calls pass in */
+    const uint8_t (*arg_regs)[CLV_REGALLOC_WORDS];
+    uint32_t arg_count;
+
+    /* mask of the words of value `v` needing a location: those of values
+     * the backend computes, rather than rematerializes */
+    uint32_t (*words) (const clv_ssa_fn_t *ssa, uint32_t v, void *data);
+    void *data;
+} clv_regalloc_target_t;
+
+
+typedef struct {
+    uint32_t intervals;         /* words of values live somewhere */
+    uint32_t splits;
+    uint32_t spills;            /* pieces of intervals given a slot */
+    uint32_t slots;
+    uint32_t moves;             /* between pieces, for phis and on edges */
+} clv_regalloc_stats_t;
+
+
+typedef struct clv_regalloc clv_regalloc_t;
+
+/* Allocates the values of `ssa`, which must have its uses listed, and
+ * outlive the allocation. Fails with ENOMEM. */
+clv_regalloc_t   *clv_regalloc_new      (const clv_ssa_fn_t *ssa, const clv_regalloc_target_t *target);
+
+/* Location of a word of `value` at position `pos` */
+clv_loc_t         clv_regalloc_loc      (const clv_regalloc_t *self, uint32_t value, clv_regalloc_word_t word,
+                                         uint32_t pos);
+
+/* Moves to make at position `pos`, in order */
+const clv_move_t *clv_regalloc_moves    (const clv_regalloc_t *self, uint32_t pos, uint32_t *out_count);
+
+/* Moves to make going from block `from` to its successor #`succ`, in order */
+const clv_move_t *clv_regalloc_edge     (const clv_regalloc_t *self, uint32_t from, uint32_t succ,
+                                         uint32_t *out_count);
+
+/* Registers given to values */
+uint32_t          clv_regalloc_used     (const clv_regalloc_t *self);
+void              clv_regalloc_stats    (const clv_regalloc_t *self, clv_regalloc_stats_t *out_stats);
+
+/* Verifies, by following values through the function, that each operand
+ * is where the allocation says, reporting where it isn't */
+bool              clv_regalloc_check    (const clv_regalloc_t *self);
+
+void              clv_regalloc_free     (clv_regalloc_t *self);
+
+/* Orders `count` moves to distinct locations, made all at once, into at
+ * most 2 * `count` moves made one after the other, through CLV_LOC_TEMP
+ * for cycles. Fails with ENOMEM. */
+bool              clv_regalloc_sequence (const clv_move_t *moves, uint32_t count, clv_move_t *out_moves,
+                                         uint32_t *out_count);
+
+#endif /* CLOVER_REGALLOC_H_ */
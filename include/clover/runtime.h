@@ -0,0 +1,29 @@
+#ifndef CLOVER_RUNTIME_H_
+#define CLOVER_RUNTIME_H_
+
+#include <clover/base.h>
+#include <clover/vm.h>
+
+/* Native functions fail by returning false after clv_vm_error */
+typedef bool (*clv_native_fn_t) (clv_vm_t *vm, clv_value_t *args, unsigned count, clv_value_t *out_result);
+
+
+typedef struct {
+    clv_str module;
+    clv_str name;
+
+    int arity;              /* -1 for variadic */
+    clv_native_fn_t fn;
+} clv_native_t;
+
+
+/* Returns the index of the native function `module`.`name`, or -1 */
+int                 clv_native_find        (const char *module, size_t module_length, const char *name, size_t name_length);
+bool                clv_native_module_find (const char *module, size_t length);
+const clv_native_t *clv_native_get         (uint32_t index);
+
+/* Encodes `c` as UTF-8 into `out`, which has room for 4 bytes, and returns
+ * the length. Invalid code points become U+FFFD. */
+size_t              clv_utf8_encode        (uint32_t c, char *out);
+
+#endif /* CLOVER_RUNTIME_H_ */
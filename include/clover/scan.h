@@ -0,0 +1,29 @@
+#ifndef CLOVER_SCAN_H_
+#define CLOVER_SCAN_H_
+
+#include <clover/base.h>
+
+/* Scanning kernels used by the lexer. The best implementation for the host
+ * is picked at startup (AVX2, SSE2 or scalar).
+ *
+ * Kernels read whole vectors and may look up to 32 bytes past the position
+ * they stop at, so the input must be padded with NUL bytes, as sources are
+ * (see CLV_SOURCE_PADDING). */
+
+typedef enum {
+    CLV_SCAN_SCALAR,
+    CLV_SCAN_SSE2,
+    CLV_SCAN_AVX2,
+} clv_scan_isa_t;
+
+/* Skips spaces, tabs and line breaks */
+const char    *clv_scan_blank   (const char *p);
+
+/* Finds the first occurrence of any of the given bytes. */
+const char    *clv_scan_any3    (const char *p, char a, char b, char c);
+
+clv_scan_isa_t clv_scan_get_isa ();
+bool           clv_scan_set_isa (clv_scan_isa_t isa);
+clv_str        clv_scan_isa_name (clv_scan_isa_t isa);
+
+#endif /* CLOVER_SCAN_H_ */
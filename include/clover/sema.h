@@ -0,0 +1,55 @@
+#ifndef CLOVER_SEMA_H_
+#define CLOVER_SEMA_H_
+
+#include <clover/base.h>
+#include <clover/source.h>
+#include <clover/token.h>
+#include <clover/ast.h>
+#include <clover/pool.h>
+#include <clover/interface.h>
+
+/* Semantic analysis of the units of a build. Declarations at module level
+ * are collected first, each unit after the units it imports; the bodies of
+ * functions are then checked independently, on a thread pool. Names are
+ * resolved, and types checked wherever they are known statically: values
+ * are typed at run time, so what can't be told here is left to the virtual
+ * machine. */
+typedef struct clv_sema clv_sema_t;
+
+/* For a build of `units` units, numbered from 0 */
+clv_sema_t *clv_sema_new               (uint32_t units);
+
+/* Collects the declarations of a parsed unit, reporting errors as they are
+ * found, and returns whether there were none. `imports` has the unit of
+ * each import item, in order, or UINT32_MAX for native modules; without
+ * it, only native modules may be imported. Units imported must be declared
+ * already, others may be declared concurrently. The unit and `imports`
+ * must be kept until checked. */
+bool        clv_sema_declare           (clv_sema_t *self, uint32_t unit, clv_source_t *src, clv_tokens_t *tokens,
+                                        clv_ast_t *ast, const uint32_t *imports);
+
+/* Declares a unit from its interface, which must be kept until checked.
+ * Only its public functions are known, and it isn't checked. */
+bool        clv_sema_declare_interface (clv_sema_t *self, uint32_t unit, clv_interface_t *iface);
+
+/* Lists the public functions of a unit declared without errors into a
+ * clv_alloc'ed array, whose names and params belong to the analysis. Returns
+ * their count, or UINT32_MAX when out of memory. */
+uint32_t    clv_sema_exports           (clv_sema_t *self, uint32_t unit, clv_export_t **out_exports);
+
+/* Leaves a declared unit out of checking, when known to be free of errors */
+void        clv_sema_skip              (clv_sema_t *self, uint32_t unit);
+
+/* Checks the functions and globals of every unit declared without errors
+ * and not skipped, on `pool`, or on the calling thread without one.
+ * Diagnostics are held until reported. Returns whether all units are free
+ * of errors. */
+bool        clv_sema_check             (clv_sema_t *self, clv_pool_t *pool);
+
+/* Emits the diagnostics of checking `unit`, in source order, and returns
+ * whether it is free of errors */
+bool        clv_sema_report            (clv_sema_t *self, uint32_t unit);
+
+void        clv_sema_free              (clv_sema_t *self);
+
+#endif /* CLOVER_SEMA_H_ */
@@ -2,20 +2,40 @@
 #define CLOVER_FILE_H_
 
 #include <clover/base.h>
+#include <clover/arena.h>
 
 #include <stdio.h>
 
-/* String buffer */
+/* Number of NUL bytes that always follow the contents of a source, so
+ * scanners may safely read (and vector loads overrun) past the end. */
+#define CLV_SOURCE_PADDING  64
+
+/* Position of a byte in a source, for diagnostics. Lines and columns count
+ * from 1; columns are in bytes. */
+typedef struct {
+    uint32_t line;
+    uint32_t column;
+    uint32_t line_offset;   /* of the start of the line */
+} clv_location_t;
+
+
+/* String buffer. A path of "-" reads from the standard input.
+ * Substrings are copied into `arena` if given, or strndup'ed otherwise. */
 typedef struct clv_source clv_source_t;
 
 clv_source_t *clv_source_new      (clv_str path);
 char          clv_source_at       (clv_source_t *self, size_t index);
 clv_str       clv_source_offset   (clv_source_t *self, size_t offset);
-clv_str       clv_source_substr   (clv_source_t *self, size_t offset, size_t length);
+clv_str       clv_source_substr   (clv_source_t *self, size_t offset, size_t length, clv_arena_t *arena);
 int           clv_source_compare  (clv_source_t *self, clv_str string, size_t offset, size_t length);
 clv_str       clv_source_cstr     (clv_source_t *self);
 size_t        clv_source_length   (clv_source_t *self);
 clv_str       clv_source_get_file (clv_source_t *self);
+
+/* Finds where the byte at `offset` is. The index of line starts this
+ * searches is built on the first call, which makes it unsafe to call
+ * concurrently on the same source before that. */
+bool          clv_source_locate   (clv_source_t *self, size_t offset, clv_location_t *out_location);
 void          clv_source_free     (clv_source_t *self);
 
 #endif /* CLOVER_FILE_H_ */
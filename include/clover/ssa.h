@@ -0,0 +1,149 @@
+#ifndef CLOVER_SSA_H_
+#define CLOVER_SSA_H_
+
+#include <clover/base.h>
+#include <clover/bytecode.h>
+
+/* SSA form of a function, for the passes and backends that need values
+ * rather than registers. Each instruction defines at most one value, named
+ * by its index in the function, and operands are such indices, so the
+ * whole function is a few flat arrays. */
+
+#define CLV_SSA_NONE        UINT32_MAX
+
+/* Static types of values are clv_type_t, or: */
+#define CLV_SSA_ANY         0x7f    /* not known until run */
+#define CLV_SSA_VOID        0x7e    /* defines no value */
+
+#define CLV_SSA_NO_REG      UINT16_MAX
+
+
+/* Operand layouts */
+typedef enum {
+    CLV_SSA_FMT_NONE,       // no operands
+    CLV_SSA_FMT_I,          // immediate
+    CLV_SSA_FMT_V,          // value, or CLV_SSA_NONE for returns
+    CLV_SSA_FMT_VV,         // value value
+    CLV_SSA_FMT_VI,         // value immediate
+    CLV_SSA_FMT_IV,         // immediate value
+    CLV_SSA_FMT_LIST,       // first and count of the operands in the pool
+} clv_ssa_fmt_t;
+
+
+/* X(name, format). Branches go to the first successor of their block when
+ * the value is true. A FORLOOP is a branch on `more`, whether a cursor has
+ * items left, to a block of its own taking `elem`, the item at the cursor,
+ * and `step`, the cursor after it, on to the body. */
+#define CLV_SSA_OPS(X) \
+    X (PARAM,       I)      /* argument #I */ \
+    X (NIL,         NONE) \
+    X (BOOL,        I) \
+    X (INT,         I)      /* signed 32 bits */ \
+    X (CONST,       I)      /* K[I] */ \
+    X (GETGLOBAL,   I)      /* G[I] */ \
+    X (SETGLOBAL,   IV)     /* G[I] = V */ \
+    X (ADD,         VV) \
+    X (SUB,         VV) \
+    X (MUL,         VV) \
+    X (DIV,         VV) \
+    X (MOD,         VV) \
+    X (BAND,        VV) \
+    X (BOR,         VV) \
+    X (BXOR,        VV) \
+    X (SHL,         VV) \
+    X (SHR,         VV) \
+    X (EQ,          VV) \
+    X (NE,          VV) \
+    X (LT,          VV) \
+    X (LE,          VV) \
+    X (NEG,         V) \
+    X (NOT,         V) \
+    X (BNOT,        V) \
+    X (CAST,        VI)     /* V as type I */ \
+    X (TYPEOF,      V) \
+    X (UNWRAP,      V) \
+    X (ITER,        V)      /* first cursor over V, which must be iterable */ \
+    X (MORE,        VV)     /* collection, cursor */ \
+    X (ELEM,        VV) \
+    X (STEP,        VV) \
+    X (CALL,        LIST)   /* callee, then arguments */ \
+    X (PHI,         LIST)   /* a value per predecessor, in their order */ \
+    X (JMP,         NONE) \
+    X (BRANCH,      V) \
+    X (RET,         V)
+
+typedef enum {
+#define CLV_SSA_OP_ENUM(name, fmt)  CLV_SSA_##name,
+    CLV_SSA_OPS (CLV_SSA_OP_ENUM)
+#undef CLV_SSA_OP_ENUM
+
+    CLV_SSA_OP_COUNT
+} clv_ssa_op_t;
+
+
+/* 16 bytes: lines are kept apart, as few walks need them */
+typedef struct {
+    uint8_t op;             /* clv_ssa_op_t */
+    uint8_t type;           /* static type of the value */
+    uint16_t reg;           /* of the bytecode the value was in, or CLV_SSA_NO_REG */
+    uint32_t block;
+    uint32_t args[2];
+} clv_ssa_insn_t;
+
+
+/* Instructions of a block are contiguous, phis first and a jump, branch or
+ * return last */
+typedef struct {
+    uint32_t first;
+    uint32_t count;
+
+    uint32_t succ[2];       /* CLV_SSA_NONE when fewer */
+
+    uint32_t first_pred;    /* in the predecessor pool */
+    uint32_t pred_count;
+
+    uint32_t idom;          /* immediate dominator, CLV_SSA_NONE for the entry */
+} clv_ssa_block_t;
+
+
+typedef struct {
+    const clv_function_t *source;   /* constants and names are those of */
+
+    clv_ssa_insn_t *insns;
+    uint32_t *lines;
+    uint32_t count;
+
+    clv_ssa_block_t *blocks;        /* the entry, then in bytecode order */
+    uint32_t block_count;
+
+    uint32_t *operands;             /* of calls and phis */
+    uint32_t operand_count;
+
+    uint32_t *preds;
+
+    /* users of value v are uses[use_first[v]] up to uses[use_first[v + 1]],
+     * once built */
+    uint32_t *use_first;
+    uint32_t *uses;
+} clv_ssa_fn_t;
+
+
+/* Builds the pruned SSA form of `fn`, leaving out unreachable code */
+bool            clv_ssa_build    (const clv_function_t *fn, clv_ssa_fn_t *out_ssa);
+
+/* Lists the users of every value, replacing lists built before */
+bool            clv_ssa_uses     (clv_ssa_fn_t *self);
+
+/* Values an instruction reads, in place, and how many */
+const uint32_t *clv_ssa_operands (const clv_ssa_fn_t *self, const clv_ssa_insn_t *insn, uint32_t *out_count);
+
+/* Bytes taken by the function's arrays */
+size_t          clv_ssa_memory   (const clv_ssa_fn_t *self);
+
+void            clv_ssa_dump     (const clv_ssa_fn_t *self);
+void            clv_ssa_free     (clv_ssa_fn_t *self);
+
+clv_str         clv_ssa_op_name  (clv_ssa_op_t op);
+clv_ssa_fmt_t   clv_ssa_format   (clv_ssa_op_t op);
+
+#endif /* CLOVER_SSA_H_ */
@@ -0,0 +1,58 @@
+#ifndef CLOVER_TIMER_H_
+#define CLOVER_TIMER_H_
+
+#include <clover/base.h>
+
+/* Phases of a build, timed in scopes that nest: a phase opened while
+ * another is open on the same thread is part of it */
+typedef enum {
+    CLV_PHASE_BUILD,
+    CLV_PHASE_READ,         /* of sources, and their interfaces */
+    CLV_PHASE_LEX,
+    CLV_PHASE_PARSE,
+    CLV_PHASE_DECLARE,
+    CLV_PHASE_CHECK,
+    CLV_PHASE_LOWER,        /* to bytecode */
+    CLV_PHASE_OPTIMIZE,
+    CLV_PHASE_EMIT,         /* of machine code */
+    CLV_PHASE_SSA,
+    CLV_PHASE_REGALLOC,
+    CLV_PHASE_CACHE,
+    CLV_PHASE_LINK,
+
+    CLV_PHASES
+} clv_phase_t;
+
+
+extern bool _clv_timer_on;
+
+void _clv_timer_begin (clv_phase_t phase, clv_str unit);
+void _clv_timer_end   ();
+
+/* Opens a scope of `phase` on the calling thread, for the unit of file
+ * `unit`, or that of the enclosing scope when NULL. Arguments are only
+ * evaluated when timing, which otherwise costs a branch. */
+#define clv_timer_begin(phase,unit) \
+    do { if (_clv_timer_on) _clv_timer_begin ((phase), (unit)); } while (0)
+
+/* Closes the innermost scope of the calling thread */
+#define clv_timer_end() \
+    do { if (_clv_timer_on) _clv_timer_end (); } while (0)
+
+
+/* Starts timing, before any scope is opened */
+void    clv_timer_enable  ();
+
+clv_str clv_timer_phase   (clv_phase_t phase);
+
+/* Writes the wall and CPU time, bytes allocated and peak RSS of each phase
+ * and unit out as a table, on stderr */
+void    clv_timer_report  ();
+
+/* Writes scopes out to `file` as Chrome trace events. Fails with errno. */
+bool    clv_timer_trace   (clv_str file);
+
+/* Stops timing, and drops the scopes timed */
+void    clv_timer_free    ();
+
+#endif /* CLOVER_TIMER_H_ */
@@ -0,0 +1,84 @@
+#ifndef CLOVER_VM_H_
+#define CLOVER_VM_H_
+
+#include <clover/base.h>
+#include <clover/bytecode.h>
+
+#include <stdio.h>
+
+/* Registers of all active frames, in values */
+#define CLV_VM_STACK_SIZE   (256 * 1024)
+
+/* Depth of nested calls */
+#define CLV_VM_MAX_FRAMES   (16 * 1024)
+
+
+/* Header of garbage collected objects */
+typedef struct clv_object {
+    struct clv_object *next;
+
+    uint8_t type;           /* clv_type_t */
+    uint8_t marked;
+    uint8_t permanent;      /* constants, never collected */
+} clv_object_t;
+
+
+typedef struct {
+    clv_object_t object;
+
+    size_t length;
+    char data[];            /* NUL terminated */
+} clv_string_t;
+
+
+typedef struct {
+    uint8_t type;           /* clv_type_t */
+
+    union {
+        bool b;
+        int64_t i;
+        double f;
+        uint32_t c;
+        uint32_t index;     /* fn and native */
+        clv_object_t *object;
+    } as;
+} clv_value_t;
+
+
+typedef struct {
+    uint64_t instructions;  /* interpreted so far */
+    size_t collections;
+    size_t allocated;       /* bytes of live objects, as of now */
+    size_t compiled;        /* functions turned into machine code */
+} clv_vm_stats_t;
+
+
+/* Register-based interpreter for the bytecode of a module, which must
+ * outlive it */
+typedef struct clv_vm clv_vm_t;
+
+clv_vm_t *clv_vm_new              (clv_module_t *module);
+void      clv_vm_set_output       (clv_vm_t *self, FILE *out);
+
+/* Compiles hot functions to machine code, where supported */
+void      clv_vm_set_jit          (clv_vm_t *self, bool enabled);
+
+/* CLV_CPU_* features machine code may use, none by default so that code
+ * runs anywhere */
+void      clv_vm_set_jit_features (clv_vm_t *self, unsigned features);
+
+/* Initializes the globals of the module, then calls the function `entry`
+ * without arguments. Runtime errors are reported along with a backtrace. */
+bool      clv_vm_run              (clv_vm_t *self, clv_str entry, clv_value_t *out_result);
+void      clv_vm_get_stats        (clv_vm_t *self, clv_vm_stats_t *out_stats);
+void      clv_vm_free             (clv_vm_t *self);
+
+/* For native functions */
+FILE          *clv_vm_output     (clv_vm_t *self);
+clv_string_t  *clv_vm_new_string (clv_vm_t *self, const char *data, size_t length);
+bool           clv_vm_error      (clv_vm_t *self, clv_str fmt, ...) __attribute__ ((format (printf, 2, 3)));
+
+/* Writes `value` out as io.print does */
+void           clv_vm_print      (clv_vm_t *self, const clv_value_t *value, FILE *out);
+
+#endif /* CLOVER_VM_H_ */
@@ -0,0 +1,42 @@
+#ifndef CLOVER_X86_H_
+#define CLOVER_X86_H_
+
+#include <clover/base.h>
+#include <clover/alloc.h>
+
+/* x86-64 code buffers, and the encodings the JIT and the native backend
+ * both use. Emitting never fails: a buffer out of memory keeps what it
+ * had and is marked, to check once it is done. */
+
+/* Second byte of jcc rel32, or jmp rel32 */
+#define CLV_X86_JMP         0xe9
+#define CLV_X86_JE          0x84
+#define CLV_X86_JNE         0x85
+#define CLV_X86_JGE         0x8d
+
+typedef struct {
+    uint8_t *data;          /* clv_alloc'ed, with `tag` */
+    size_t length;
+    size_t capacity;
+    clv_alloc_tag_t tag;
+    bool error;             /* out of memory */
+} clv_x86_buffer_t;
+
+void     clv_x86_bytes  (clv_x86_buffer_t *b, const void *data, size_t length);
+void     clv_x86_u8     (clv_x86_buffer_t *b, uint8_t value);
+void     clv_x86_u16    (clv_x86_buffer_t *b, uint16_t value);
+void     clv_x86_u32    (clv_x86_buffer_t *b, uint32_t value);
+void     clv_x86_u64    (clv_x86_buffer_t *b, uint64_t value);
+
+/* Emits `op` with register `reg` and a [base + disp32] operand. REX bits
+ * are up to `op`, and `base` can't be rsp or r12, which take a SIB. */
+void     clv_x86_mem    (clv_x86_buffer_t *b, const char *op, size_t length, int reg, int base, int32_t disp);
+
+/* Emits a jmp, or the jcc `cc`, with a rel32 to patch, and returns its
+ * offset */
+uint32_t clv_x86_branch (clv_x86_buffer_t *b, uint8_t cc);
+
+/* Points the rel32 at `site` to `target` */
+void     clv_x86_patch  (clv_x86_buffer_t *b, uint32_t site, size_t target);
+
+#endif /* CLOVER_X86_H_ */
@@ -0,0 +1,463 @@
+#include <clover/alloc.h>
+#include <clover/log.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <errno.h>
+
+#define ALLOC_CHUNK_SIZE    (1024 * 1024)
+
+/* Blocks of arenas taking more than this get a chunk of their own */
+#define ALLOC_CHUNK_LIMIT   (ALLOC_CHUNK_SIZE / 8)
+
+
+static const clv_str alloc_tags[CLV_TAGS] = {
+    [CLV_TAG_MISC]     = "misc",
+    [CLV_TAG_LIST]     = "list",
+    [CLV_TAG_ARENA]    = "arena",
+    [CLV_TAG_SOURCE]   = "source",
+    [CLV_TAG_LEXER]    = "lexer",
+    [CLV_TAG_AST]      = "ast",
+    [CLV_TAG_INTERN]   = "intern",
+    [CLV_TAG_LOADER]   = "loader",
+    [CLV_TAG_SEMA]     = "sema",
+    [CLV_TAG_BYTECODE] = "bytecode",
+    [CLV_TAG_OPTIMIZE] = "optimize",
+    [CLV_TAG_SSA]      = "ssa",
+    [CLV_TAG_REGALLOC] = "regalloc",
+    [CLV_TAG_NATIVE]   = "native",
+    [CLV_TAG_CACHE]    = "cache",
+    [CLV_TAG_BUILD]    = "build",
+    [CLV_TAG_VM]       = "vm",
+    [CLV_TAG_JIT]      = "jit",
+};
+
+
+/* Kept before the blocks of the arena and tracking backends, keeping them
+ * as aligned as malloc does */
+typedef struct {
+    _Alignas (max_align_t) size_t size;
+    uint32_t tag;
+} alloc_header_t;
+
+
+static _Atomic (const clv_allocator_t *) alloc_backend = NULL;
+
+
+/* == libc == */
+
+
+static void *
+libc_alloc (size_t size, bool zero, clv_alloc_tag_t tag) {
+    (void)tag;
+
+    return zero ? calloc (1, size) : malloc (size);
+}
+
+
+static void *
+libc_realloc (void *ptr, size_t size, clv_alloc_tag_t tag) {
+    (void)tag;
+
+    return realloc (ptr, size);
+}
+
+
+const clv_allocator_t clv_allocator_libc = { "libc", libc_alloc, libc_realloc, free };
+
+
+/* == Arena == */
+
+
+/* Chunk of the calling thread. Those it's done with are never freed. */
+static _Thread_local struct {
+    char *data;
+    size_t used;
+    size_t size;
+
+    alloc_header_t *last;   /* may be grown in place */
+} alloc_arena;
+
+
+static inline size_t
+arena_round (size_t size) {
+    return (size + _Alignof (max_align_t) - 1) & ~(_Alignof (max_align_t) - 1);
+}
+
+
+static void *
+arena_alloc (size_t size, bool zero, clv_alloc_tag_t tag) {
+    if (size > SIZE_MAX - 2 * sizeof (alloc_header_t)) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    size_t need = sizeof (alloc_header_t) + arena_round (size);
+    alloc_header_t *header;
+
+    if (need > ALLOC_CHUNK_LIMIT) {
+        if ((header = malloc (need)) == NULL) {
+            return NULL;
+        }
+    } else {
+        if (alloc_arena.size - alloc_arena.used < need) {
+            char *data = malloc (ALLOC_CHUNK_SIZE);
+
+            if (data == NULL) {
+                return NULL;
+            }
+
+            alloc_arena.data = data;
+            alloc_arena.used = 0;
+            alloc_arena.size = ALLOC_CHUNK_SIZE;
+        }
+
+        header = (alloc_header_t *)&alloc_arena.data[alloc_arena.used];
+        alloc_arena.used += need;
+        alloc_arena.last = header;
+    }
+
+    header->size = size;
+    header->tag = tag;
+
+    if (zero) {
+        memset (header + 1, 0, size);
+    }
+
+    return header + 1;
+}
+
+
+static void *
+arena_realloc (void *ptr, size_t size, clv_alloc_tag_t tag) {
+    if (ptr == NULL) {
+        return arena_alloc (size, false, tag);
+    }
+
+    alloc_header_t *header = (alloc_header_t *)ptr - 1;
+
+    // the last block of the chunk grows into what's left of it
+    if (header == alloc_arena.last && size <= SIZE_MAX - 2 * sizeof (alloc_header_t)) {
+        size_t start = (char *)ptr - alloc_arena.data;
+
+        if (arena_round (size) <= alloc_arena.size - start) {
+            alloc_arena.used = start + arena_round (size);
+            header->size = size;
+            return ptr;
+        }
+    }
+
+    void *data = arena_alloc (size, false, header->tag);
+
+    if (data != NULL) {
+        memcpy (data, ptr, (header->size < size) ? header->size : size);
+    }
+
+    return data;
+}
+
+
+static void
+arena_free (void *ptr) {
+    (void)ptr;
+}
+
+
+const clv_allocator_t clv_allocator_arena = { "arena", arena_alloc, arena_realloc, arena_free };
+
+
+/* == Tracking == */
+
+
+/* Stats of each tag, then of them all */
+static struct {
+    atomic_size_t bytes;
+    atomic_size_t peak;
+    atomic_size_t blocks;
+    atomic_size_t count;
+} alloc_stats[CLV_TAGS + 1];
+
+static _Thread_local uint64_t alloc_thread_bytes = 0;
+
+
+static void
+tracking_add (uint32_t tag, size_t size, size_t blocks) {
+    uint32_t tags[] = { tag, CLV_TAGS };
+
+    for (uint32_t i = 0; i < CLV_LENGTH (tags); i++) {
+        size_t bytes = atomic_fetch_add_explicit (&alloc_stats[tags[i]].bytes, size, memory_order_relaxed) + size;
+        size_t peak = atomic_load_explicit (&alloc_stats[tags[i]].peak, memory_order_relaxed);
+
+        while (bytes > peak && !atomic_compare_exchange_weak_explicit (&alloc_stats[tags[i]].peak, &peak, bytes,
+                                                                       memory_order_relaxed, memory_order_relaxed));
+
+        atomic_fetch_add_explicit (&alloc_stats[tags[i]].blocks, blocks, memory_order_relaxed);
+        atomic_fetch_add_explicit (&alloc_stats[tags[i]].count, 1, memory_order_relaxed);
+    }
+
+    alloc_thread_bytes += size;
+}
+
+
+static void
+tracking_sub (uint32_t tag, size_t size, size_t blocks) {
+    uint32_t tags[] = { tag, CLV_TAGS };
+
+    for (uint32_t i = 0; i < CLV_LENGTH (tags); i++) {
+        atomic_fetch_sub_explicit (&alloc_stats[tags[i]].bytes, size, memory_order_relaxed);
+        atomic_fetch_sub_explicit (&alloc_stats[tags[i]].blocks, blocks, memory_order_relaxed);
+    }
+}
+
+
+static void *
+tracking_alloc (size_t size, bool zero, clv_alloc_tag_t tag) {
+    if (size > SIZE_MAX - sizeof (alloc_header_t)) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    size_t need = sizeof (alloc_header_t) + size;
+    alloc_header_t *header = zero ? calloc (1, need) : malloc (need);
+
+    if (header == NULL) {
+        return NULL;
+    }
+
+    header->size = size;
+    header->tag = tag;
+    tracking_add (tag, size, 1);
+
+    return header + 1;
+}
+
+
+static void *
+tracking_realloc (void *ptr, size_t size, clv_alloc_tag_t tag) {
+    if (ptr == NULL) {
+        return tracking_alloc (size, false, tag);
+    }
+
+    if (size > SIZE_MAX - sizeof (alloc_header_t)) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    alloc_header_t *header = realloc ((alloc_header_t *)ptr - 1, sizeof (alloc_header_t) + size);
+
+    if (header == NULL) {
+        return NULL;
+    }
+
+    // blocks keep the tag they were allocated with
+    tracking_sub (header->tag, header->size, 0);
+    tracking_add (header->tag, size, 0);
+    header->size = size;
+
+    return header + 1;
+}
+
+
+static void
+tracking_free (void *ptr) {
+    if (ptr == NULL) {
+        return;
+    }
+
+    alloc_header_t *header = (alloc_header_t *)ptr - 1;
+
+    tracking_sub (header->tag, header->size, 1);
+    free (header);
+}
+
+
+const clv_allocator_t clv_allocator_tracking = { "tracking", tracking_alloc, tracking_realloc, tracking_free };
+
+
+static void
+alloc_report () {
+    clv_alloc_stats_t total;
+    clv_log_record_t rec;
+
+    clv_alloc_stats (CLV_TAGS, &total);
+
+    clv_log_begin (&rec, CLV_INFO);
+    clv_log_printf (&rec, "memory: peak of %.1f kB, over %zu allocations\n", total.peak / 1024.0, total.count);
+    clv_log_printf (&rec, "%-10s %12s %12s %10s %12s\n", "tag", "peak kB", "live kB", "blocks", "allocations");
+
+    for (uint32_t tag = 0; tag < CLV_TAGS; tag++) {
+        clv_alloc_stats_t stats;
+
+        clv_alloc_stats (tag, &stats);
+
+        if (stats.count > 0) {
+            clv_log_printf (&rec, "%-10s %12.1f %12.1f %10zu %12zu\n", alloc_tags[tag], stats.peak / 1024.0,
+                            stats.bytes / 1024.0, stats.blocks, stats.count);
+        }
+    }
+
+    clv_log_end (&rec);
+
+    // the log may have flushed its batch at exit already
+    clv_log_flush ();
+}
+
+
+/* == Backend == */
+
+
+/* Backend the process starts with */
+static const clv_allocator_t *
+alloc_default (bool *out_unknown) {
+    static const clv_allocator_t *const backends[] = {
+        &clv_allocator_libc,
+        &clv_allocator_arena,
+        &clv_allocator_tracking
+    };
+
+    clv_str name = getenv ("CLOVER_ALLOC");
+
+    for (size_t i = 0; name != NULL && i < CLV_LENGTH (backends); i++) {
+        if (strcmp (name, backends[i]->name) == 0) {
+            return backends[i];
+        }
+    }
+
+    *out_unknown = name != NULL;
+
+    return clv_log_debug () ? &clv_allocator_tracking : &clv_allocator_libc;
+}
+
+
+/* Makes `allocator` that of the process, unless there's one already,
+ * which is returned instead */
+static const clv_allocator_t *
+alloc_install (const clv_allocator_t *allocator) {
+    const clv_allocator_t *expected = NULL;
+
+    if (!atomic_compare_exchange_strong_explicit (&alloc_backend, &expected, allocator,
+                                                  memory_order_acq_rel, memory_order_acquire)) {
+        return expected;
+    }
+
+    if (allocator == &clv_allocator_tracking && clv_log_debug ()) {
+        atexit (alloc_report);
+    }
+
+    return allocator;
+}
+
+
+static inline const clv_allocator_t *
+alloc_get () {
+    const clv_allocator_t *allocator = atomic_load_explicit (&alloc_backend, memory_order_acquire);
+
+    if (__builtin_expect (allocator == NULL, 0)) {
+        bool unknown = false;
+
+        allocator = alloc_install (alloc_default (&unknown));
+
+        // once there is a backend, as logging allocates
+        if (unknown) {
+            clv_warning ("unknown allocator '%s', using %s", getenv ("CLOVER_ALLOC"), allocator->name);
+        }
+    }
+
+    return allocator;
+}
+
+
+bool
+clv_alloc_use (const clv_allocator_t *allocator) {
+    if (alloc_install (allocator) != allocator) {
+        errno = EBUSY;
+        return false;
+    }
+
+    return true;
+}
+
+
+void *
+clv_alloc (clv_alloc_tag_t tag, size_t size) {
+    return alloc_get ()->alloc (size, false, tag);
+}
+
+
+void *
+clv_calloc (clv_alloc_tag_t tag, size_t count, size_t size) {
+    if (size != 0 && count > SIZE_MAX / size) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    return alloc_get ()->alloc (count * size, true, tag);
+}
+
+
+void *
+clv_realloc (clv_alloc_tag_t tag, void *ptr, size_t size) {
+    return alloc_get ()->realloc (ptr, size, tag);
+}
+
+
+char *
+clv_strndup (clv_alloc_tag_t tag, const char *string, size_t length) {
+    length = strnlen (string, length);
+
+    char *copy = clv_alloc (tag, length + 1);
+
+    if (copy != NULL) {
+        memcpy (copy, string, length);
+        copy[length] = '\0';
+    }
+
+    return copy;
+}
+
+
+char *
+clv_strdup (clv_alloc_tag_t tag, const char *string) {
+    return clv_strndup (tag, string, SIZE_MAX);
+}
+
+
+void
+clv_free (void *ptr) {
+    if (ptr != NULL) {
+        alloc_get ()->free (ptr);
+    }
+}
+
+
+/* == Stats == */
+
+
+bool
+clv_alloc_tracking () {
+    return alloc_get () == &clv_allocator_tracking;
+}
+
+
+void
+clv_alloc_stats (clv_alloc_tag_t tag, clv_alloc_stats_t *out_stats) {
+    tag = (tag < CLV_TAGS) ? tag : CLV_TAGS;
+
+    out_stats->bytes = atomic_load_explicit (&alloc_stats[tag].bytes, memory_order_relaxed);
+    out_stats->peak = atomic_load_explicit (&alloc_stats[tag].peak, memory_order_relaxed);
+    out_stats->blocks = atomic_load_explicit (&alloc_stats[tag].blocks, memory_order_relaxed);
+    out_stats->count = atomic_load_explicit (&alloc_stats[tag].count, memory_order_relaxed);
+}
+
+
+uint64_t
+clv_alloc_thread_bytes () {
+    return alloc_thread_bytes;
+}
+
+
+clv_str
+clv_alloc_tag_name (clv_alloc_tag_t tag) {
+    return (tag < CLV_TAGS) ? alloc_tags[tag] : "???";
+}
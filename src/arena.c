@@ -0,0 +1,292 @@
+#include <clover/arena.h>
+#include <clover/alloc.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#define ARENA_MIN_CHUNK_SIZE    (1024)
+
+
+typedef struct arena_chunk {
+    struct arena_chunk *prev;
+    size_t size;        /* usable bytes after the header */
+    size_t used;
+
+    _Alignas (max_align_t) char data[];
+} arena_chunk_t;
+
+
+struct clv_arena {
+    arena_chunk_t *chunk;   /* current chunk, the newest one */
+    size_t chunks;
+    size_t chunk_size;
+    size_t used;            /* bytes handed out over all chunks */
+
+    void *last;             /* last allocation, may be grown in place */
+};
+
+
+static inline bool
+is_power_of_two (size_t value) {
+    return value != 0 && (value & (value - 1)) == 0;
+}
+
+
+/* Rounds `offset` up, so the address it points to in `chunk` is aligned */
+static inline size_t
+arena_align (arena_chunk_t *chunk, size_t offset, size_t alignment) {
+    uintptr_t address = (uintptr_t)&chunk->data[offset];
+
+    return offset + (((address + alignment - 1) & ~(uintptr_t)(alignment - 1)) - address);
+}
+
+
+static arena_chunk_t *
+arena_chunk_new (clv_arena_t *self, size_t size) {
+    if (size < self->chunk_size) {
+        size = self->chunk_size;
+    }
+
+    if (size > SIZE_MAX - sizeof (arena_chunk_t)) {
+        errno = EOVERFLOW;
+        return NULL;
+    }
+
+    arena_chunk_t *chunk = clv_alloc (CLV_TAG_ARENA, sizeof (*chunk) + size);
+
+    if (chunk == NULL) {
+        return NULL;
+    }
+
+    chunk->prev = self->chunk;
+    chunk->size = size;
+    chunk->used = 0;
+
+    self->chunk = chunk;
+    self->chunks++;
+
+    return chunk;
+}
+
+
+clv_arena_t *
+clv_arena_new (size_t chunk_size) {
+    clv_arena_t *arena = clv_alloc (CLV_TAG_ARENA, sizeof (*arena));
+
+    if (arena == NULL) {
+        return NULL;
+    }
+
+    if (chunk_size == 0) {
+        chunk_size = CLV_ARENA_CHUNK_SIZE;
+    } else if (chunk_size < ARENA_MIN_CHUNK_SIZE) {
+        chunk_size = ARENA_MIN_CHUNK_SIZE;
+    }
+
+    arena->chunk = NULL;
+    arena->chunks = 0;
+    arena->chunk_size = chunk_size;
+    arena->used = 0;
+    arena->last = NULL;
+
+    return arena;
+}
+
+
+void *
+clv_arena_alloc_aligned (clv_arena_t *self, size_t size, size_t alignment) {
+    if (self == NULL || !is_power_of_two (alignment)) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    arena_chunk_t *chunk = self->chunk;
+    size_t offset = 0;
+
+    if (chunk != NULL) {
+        offset = arena_align (chunk, chunk->used, alignment);
+    }
+
+    if (chunk == NULL || offset > chunk->size || size > chunk->size - offset) {
+        // the slack of the current chunk is given up, alignment above the
+        // chunk's own is paid for by over-allocating
+        size_t extra = (alignment > CLV_ARENA_ALIGNMENT) ? alignment : 0;
+
+        if (size > SIZE_MAX - extra || (chunk = arena_chunk_new (self, size + extra)) == NULL) {
+            return NULL;
+        }
+
+        offset = arena_align (chunk, 0, alignment);
+    }
+
+    void *ptr = &chunk->data[offset];
+
+    self->used += size + (offset - chunk->used);
+    chunk->used = offset + size;
+    self->last = ptr;
+
+    return ptr;
+}
+
+
+void *
+clv_arena_alloc (clv_arena_t *self, size_t size) {
+    return clv_arena_alloc_aligned (self, size, CLV_ARENA_ALIGNMENT);
+}
+
+
+void *
+clv_arena_realloc (clv_arena_t *self, void *ptr, size_t old_size, size_t new_size) {
+    if (self == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (ptr == NULL) {
+        return clv_arena_alloc (self, new_size);
+    }
+
+    arena_chunk_t *chunk = self->chunk;
+
+    if (ptr == self->last) {
+        size_t offset = (char *)ptr - chunk->data;
+
+        // the last allocation grows and shrinks in place while it fits
+        if (new_size <= chunk->size - offset) {
+            self->used = self->used - old_size + new_size;
+            chunk->used = offset + new_size;
+            return ptr;
+        }
+
+        // a chunk holding nothing else is resized as a whole
+        if (offset == 0 && new_size <= SIZE_MAX - sizeof (*chunk)) {
+            arena_chunk_t *temp = clv_realloc (CLV_TAG_ARENA, chunk, sizeof (*chunk) + new_size);
+
+            if (temp == NULL) {
+                return NULL;
+            }
+
+            temp->size = new_size;
+            temp->used = new_size;
+
+            self->chunk = temp;
+            self->used = self->used - old_size + new_size;
+            self->last = temp->data;
+
+            return temp->data;
+        }
+    }
+
+    if (new_size <= old_size) {
+        return ptr;
+    }
+
+    void *data = clv_arena_alloc (self, new_size);
+
+    if (data != NULL) {
+        memcpy (data, ptr, old_size);
+    }
+
+    return data;
+}
+
+
+char *
+clv_arena_strndup (clv_arena_t *self, const char *string, size_t length) {
+    if (string == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    length = strnlen (string, length);
+
+    char *copy = clv_arena_alloc_aligned (self, length + 1, 1);
+
+    if (copy == NULL) {
+        return NULL;
+    }
+
+    memcpy (copy, string, length);
+    copy[length] = '\0';
+
+    return copy;
+}
+
+
+size_t
+clv_arena_used (clv_arena_t *self) {
+    if (self == NULL) {
+        errno = EINVAL;
+        return 0;
+    }
+
+    return self->used;
+}
+
+
+clv_arena_mark_t
+clv_arena_mark (clv_arena_t *self) {
+    if (self == NULL || self->chunk == NULL) {
+        return (clv_arena_mark_t){ 0, 0 };
+    }
+
+    return (clv_arena_mark_t){ self->chunks, self->chunk->used };
+}
+
+
+void
+clv_arena_reset (clv_arena_t *self, clv_arena_mark_t mark) {
+    if (self == NULL || mark.chunks > self->chunks) {
+        errno = EINVAL;
+        return;
+    }
+
+    // chunks created after the mark are released, except the first one
+    // when rolling back to empty, so a reused arena keeps some memory
+    while (self->chunks > mark.chunks) {
+        arena_chunk_t *chunk = self->chunk;
+
+        self->used -= chunk->used;
+
+        if (chunk->prev == NULL) {
+            chunk->used = 0;
+            break;
+        }
+
+        self->chunk = chunk->prev;
+        self->chunks--;
+        clv_free (chunk);
+    }
+
+    if (mark.chunks > 0) {
+        self->used -= self->chunk->used - mark.used;
+        self->chunk->used = mark.used;
+    }
+
+    self->last = NULL;
+}
+
+
+void
+clv_arena_clear (clv_arena_t *self) {
+    clv_arena_reset (self, (clv_arena_mark_t){ 0, 0 });
+}
+
+
+void
+clv_arena_free (clv_arena_t *self) {
+    if (self == NULL) {
+        return;
+    }
+
+    arena_chunk_t *chunk = self->chunk;
+
+    while (chunk != NULL) {
+        arena_chunk_t *prev = chunk->prev;
+        clv_free (chunk);
+        chunk = prev;
+    }
+
+    clv_free (self);
+}
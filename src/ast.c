@@ -0,0 +1,369 @@
+#include <clover/ast.h>
+#include <clover/log.h>
+#include <clover/alloc.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#define AST_MIN_CAPACITY    64
+
+
+struct clv_ast {
+    clv_node_t *nodes;
+    size_t length;
+    size_t capacity;
+
+    uint32_t *extra;
+    size_t extra_length;
+    size_t extra_capacity;
+
+    clv_node_id_t root;
+
+    clv_arena_t *arena;     /* owner of the arrays and of the tree, if any */
+};
+
+
+/* Where the children of each kind are, for walking the tree generically */
+enum {
+    AST_L_LEAF,
+    AST_L_LHS,          /* lhs */
+    AST_L_BOTH,         /* lhs, rhs */
+    AST_L_SPAN,         /* lhs..rhs span */
+    AST_L_FN,           /* lhs signature, rhs */
+    AST_L_IF,           /* lhs, rhs record { then, else } */
+    AST_L_LHS_LIST,     /* lhs, rhs list */
+    AST_L_LIST_RHS,     /* lhs list, rhs */
+};
+
+
+static const struct ast_kind {
+    clv_str name;
+    uint8_t layout;
+} ast_kinds[CLV_NODE_KIND_COUNT] = {
+    [CLV_NODE_INVALID]      = { "invalid",      AST_L_LEAF },
+    [CLV_NODE_MODULE]       = { "module",       AST_L_SPAN },
+    [CLV_NODE_IMPORT]       = { "import",       AST_L_LHS },
+    [CLV_NODE_FN]           = { "fn",           AST_L_FN },
+    [CLV_NODE_PARAM]        = { "param",        AST_L_LHS },
+    [CLV_NODE_STRUCT]       = { "struct",       AST_L_SPAN },
+    [CLV_NODE_FIELD]        = { "field",        AST_L_BOTH },
+    [CLV_NODE_ENUM]         = { "enum",         AST_L_SPAN },
+    [CLV_NODE_VARIANT]      = { "variant",      AST_L_LHS },
+    [CLV_NODE_TRAIT]        = { "trait",        AST_L_SPAN },
+    [CLV_NODE_TYPEDEF]      = { "typedef",      AST_L_LHS },
+    [CLV_NODE_GLOBAL]       = { "global",       AST_L_BOTH },
+    [CLV_NODE_TYPE_ARRAY]   = { "type-array",   AST_L_LHS },
+    [CLV_NODE_TYPE_OPTION]  = { "type-option",  AST_L_LHS },
+    [CLV_NODE_TYPE_REF]     = { "type-ref",     AST_L_LHS },
+    [CLV_NODE_TYPE_FN]      = { "type-fn",      AST_L_FN },
+    [CLV_NODE_BLOCK]        = { "block",        AST_L_SPAN },
+    [CLV_NODE_LET]          = { "let",          AST_L_BOTH },
+    [CLV_NODE_IF]           = { "if",           AST_L_IF },
+    [CLV_NODE_WHILE]        = { "while",        AST_L_BOTH },
+    [CLV_NODE_FOR]          = { "for",          AST_L_BOTH },
+    [CLV_NODE_MATCH]        = { "match",        AST_L_LHS_LIST },
+    [CLV_NODE_ARM]          = { "arm",          AST_L_LIST_RHS },
+    [CLV_NODE_RETURN]       = { "return",       AST_L_LHS },
+    [CLV_NODE_BREAK]        = { "break",        AST_L_LEAF },
+    [CLV_NODE_CONTINUE]     = { "continue",     AST_L_LEAF },
+    [CLV_NODE_DEFER]        = { "defer",        AST_L_LHS },
+    [CLV_NODE_ASSIGN]       = { "assign",       AST_L_BOTH },
+    [CLV_NODE_EXPR]         = { "expr",         AST_L_LHS },
+    [CLV_NODE_NAME]         = { "name",         AST_L_LEAF },
+    [CLV_NODE_LITERAL]      = { "literal",      AST_L_LEAF },
+    [CLV_NODE_UNARY]        = { "unary",        AST_L_LHS },
+    [CLV_NODE_BINARY]       = { "binary",       AST_L_BOTH },
+    [CLV_NODE_CAST]         = { "cast",         AST_L_BOTH },
+    [CLV_NODE_TRY]          = { "try",          AST_L_LHS },
+    [CLV_NODE_TYPEOF]       = { "typeof",       AST_L_LHS },
+    [CLV_NODE_UNWRAP]       = { "unwrap",       AST_L_LHS },
+    [CLV_NODE_CALL]         = { "call",         AST_L_LHS_LIST },
+    [CLV_NODE_INDEX]        = { "index",        AST_L_BOTH },
+    [CLV_NODE_MEMBER]       = { "member",       AST_L_LHS },
+    [CLV_NODE_ARRAY]        = { "array",        AST_L_SPAN },
+    [CLV_NODE_INIT]         = { "init",         AST_L_LHS_LIST },
+    [CLV_NODE_FIELD_INIT]   = { "field-init",   AST_L_LHS },
+};
+
+
+static bool
+ast_reserve (clv_ast_t *self, void **data, size_t *capacity, size_t need, size_t size) {
+    if (need <= *capacity) {
+        return true;
+    }
+
+    size_t new_capacity = (*capacity < AST_MIN_CAPACITY) ? AST_MIN_CAPACITY : *capacity;
+
+    while (new_capacity < need) {
+        new_capacity *= 2;
+    }
+
+    // ids and extra indices are 32 bits wide
+    if (new_capacity > UINT32_MAX || new_capacity > SIZE_MAX / size) {
+        errno = EOVERFLOW;
+        return false;
+    }
+
+    void *temp;
+
+    if (self->arena != NULL) {
+        temp = clv_arena_realloc (self->arena, *data, *capacity * size, new_capacity * size);
+    } else {
+        temp = clv_realloc (CLV_TAG_AST, *data, new_capacity * size);
+    }
+
+    if (temp == NULL) {
+        return false;
+    }
+
+    *data = temp;
+    *capacity = new_capacity;
+
+    return true;
+}
+
+
+clv_ast_t *
+clv_ast_new (size_t hint, clv_arena_t *arena) {
+    clv_ast_t *ast = (arena != NULL) ? clv_arena_alloc (arena, sizeof (*ast)) : clv_alloc (CLV_TAG_AST, sizeof (*ast));
+
+    if (ast == NULL) {
+        return NULL;
+    }
+
+    memset (ast, 0, sizeof (*ast));
+    ast->arena = arena;
+
+    // extra data takes about half as many words as there are nodes
+    if (!ast_reserve (ast, (void **)&ast->nodes, &ast->capacity, hint + 1, sizeof (*ast->nodes))
+        || !ast_reserve (ast, (void **)&ast->extra, &ast->extra_capacity, hint / 2, sizeof (*ast->extra))) {
+        clv_ast_free (ast);
+        return NULL;
+    }
+
+    // node 0 stands for "none"
+    ast->nodes[0] = (clv_node_t){ .kind = CLV_NODE_INVALID };
+    ast->length = 1;
+
+    return ast;
+}
+
+
+clv_node_id_t
+clv_ast_push (clv_ast_t *self, clv_node_kind_t kind, uint32_t token, uint32_t lhs, uint32_t rhs) {
+    if (!ast_reserve (self, (void **)&self->nodes, &self->capacity, self->length + 1, sizeof (*self->nodes))) {
+        return CLV_NODE_NONE;
+    }
+
+    self->nodes[self->length] = (clv_node_t){
+        .kind = kind,
+        .token = token,
+        .lhs = lhs,
+        .rhs = rhs
+    };
+
+    return self->length++;
+}
+
+
+uint32_t
+clv_ast_push_extra (clv_ast_t *self, const uint32_t *values, size_t count) {
+    if (!ast_reserve (self, (void **)&self->extra, &self->extra_capacity, self->extra_length + count, sizeof (*self->extra))) {
+        return UINT32_MAX;
+    }
+
+    uint32_t index = self->extra_length;
+
+    if (count > 0) {
+        memcpy (&self->extra[index], values, count * sizeof (*values));
+        self->extra_length += count;
+    }
+
+    return index;
+}
+
+
+clv_node_t *
+clv_ast_node (clv_ast_t *self, clv_node_id_t id) {
+    return &self->nodes[id];
+}
+
+
+const uint32_t *
+clv_ast_extra (clv_ast_t *self, uint32_t index) {
+    return &self->extra[index];
+}
+
+
+const uint32_t *
+clv_ast_extra_list (clv_ast_t *self, uint32_t index, uint32_t *out_count) {
+    *out_count = self->extra[index];
+
+    return &self->extra[index + 1];
+}
+
+
+clv_node_t *
+clv_ast_import_path (clv_ast_t *self, const clv_node_t *import) {
+    return &self->nodes[import->lhs];
+}
+
+
+clv_node_id_t
+clv_ast_get_root (clv_ast_t *self) {
+    return self->root;
+}
+
+
+void
+clv_ast_set_root (clv_ast_t *self, clv_node_id_t root) {
+    self->root = root;
+}
+
+
+size_t
+clv_ast_length (clv_ast_t *self) {
+    return self->length;
+}
+
+
+size_t
+clv_ast_extra_length (clv_ast_t *self) {
+    return self->extra_length;
+}
+
+
+void
+clv_ast_free (clv_ast_t *self) {
+    if (self == NULL || self->arena != NULL) {
+        return;
+    }
+
+    clv_free (self->nodes);
+    clv_free (self->extra);
+    clv_free (self);
+}
+
+
+clv_str
+clv_node_kind_name (clv_node_kind_t kind) {
+    if (kind >= CLV_NODE_KIND_COUNT) {
+        return "???";
+    }
+
+    return ast_kinds[kind].name;
+}
+
+
+/* == Dump == */
+
+
+typedef struct {
+    clv_ast_t *ast;
+    clv_source_t *src;
+    clv_token_t *tokens;
+
+    clv_log_record_t rec;
+} ast_dump_t;
+
+
+static void ast_dump_node (ast_dump_t *dump, clv_node_id_t id, int depth);
+
+
+static void
+ast_dump_list (ast_dump_t *dump, const uint32_t *ids, uint32_t count, int depth) {
+    for (uint32_t i = 0; i < count; i++) {
+        ast_dump_node (dump, ids[i], depth);
+    }
+}
+
+
+static void
+ast_dump_node (ast_dump_t *dump, clv_node_id_t id, int depth) {
+    if (id == CLV_NODE_NONE) {
+        return;
+    }
+
+    clv_ast_t *ast = dump->ast;
+    clv_node_t *node = &ast->nodes[id];
+    clv_token_t *token = &dump->tokens[node->token];
+
+    clv_log_printf (&dump->rec, "%*s%s  %.*s", depth * 2, "", clv_node_kind_name (node->kind),
+                    (int)token->length, clv_source_offset (dump->src, token->offset));
+
+    if (node->flags & CLV_NODE_F_PUB) {
+        clv_log_append (&dump->rec, "  pub", 5);
+    }
+
+    if (node->flags & CLV_NODE_F_CONST) {
+        clv_log_append (&dump->rec, "  const", 7);
+    }
+
+    if (node->flags & CLV_NODE_F_STATIC) {
+        clv_log_append (&dump->rec, "  static", 8);
+    }
+
+    if (node->flags & CLV_NODE_F_METHOD) {
+        clv_log_append (&dump->rec, "  method", 8);
+    }
+
+    clv_log_append (&dump->rec, "\n", 1);
+
+    const uint32_t *extra;
+
+    switch (ast_kinds[node->kind].layout) {
+    case AST_L_LHS:
+        ast_dump_node (dump, node->lhs, depth + 1);
+        break;
+
+    case AST_L_BOTH:
+        ast_dump_node (dump, node->lhs, depth + 1);
+        ast_dump_node (dump, node->rhs, depth + 1);
+        break;
+
+    case AST_L_SPAN:
+        ast_dump_list (dump, &ast->extra[node->lhs], node->rhs, depth + 1);
+        break;
+
+    case AST_L_FN:
+        extra = &ast->extra[node->lhs];
+        ast_dump_list (dump, &extra[CLV_SIG_PARAMS + 1], extra[CLV_SIG_PARAMS], depth + 1);
+        ast_dump_node (dump, extra[CLV_SIG_RESULT], depth + 1);
+        ast_dump_node (dump, node->rhs, depth + 1);
+        break;
+
+    case AST_L_IF:
+        extra = &ast->extra[node->rhs];
+        ast_dump_node (dump, node->lhs, depth + 1);
+        ast_dump_node (dump, extra[0], depth + 1);
+        ast_dump_node (dump, extra[1], depth + 1);
+        break;
+
+    case AST_L_LHS_LIST:
+        extra = &ast->extra[node->rhs];
+        ast_dump_node (dump, node->lhs, depth + 1);
+        ast_dump_list (dump, &extra[1], extra[0], depth + 1);
+        break;
+
+    case AST_L_LIST_RHS:
+        extra = &ast->extra[node->lhs];
+        ast_dump_list (dump, &extra[1], extra[0], depth + 1);
+        ast_dump_node (dump, node->rhs, depth + 1);
+        break;
+    }
+}
+
+
+void
+clv_ast_dump (clv_ast_t *self, clv_source_t *src, clv_tokens_t *tokens) {
+    ast_dump_t dump = {
+        .ast = self,
+        .src = src,
+        .tokens = clv_tokens_data (tokens)
+    };
+
+    clv_log_begin (&dump.rec, CLV_INFO);
+    ast_dump_node (&dump, self->root, 0);
+    clv_log_end (&dump.rec);
+}
@@ -0,0 +1,1024 @@
+#include <clover/bytecode.h>
+#include <clover/log.h>
+#include <clover/hash.h>
+#include <clover/alloc.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+
+#define MODULE_MIN_CAPACITY     16
+
+#define DUMP_RECORD_SIZE        (32 * 1024)
+
+
+struct clv_module {
+    clv_str file;
+
+    clv_function_t *functions;
+    uint32_t function_count;
+    uint32_t function_capacity;
+
+    clv_str *globals;
+    uint32_t global_count;
+    uint32_t global_capacity;
+
+    clv_str *imports;
+    uint32_t import_count;
+    uint32_t import_capacity;
+
+    clv_arena_t *arena;     /* code, constants and names */
+};
+
+
+static const struct {
+    clv_str name;
+    uint8_t fmt;
+} opcodes[CLV_OP_COUNT] = {
+#define OPCODE_INFO(name, fmt)  [CLV_OP_##name] = { #name, CLV_FMT_##fmt },
+    CLV_OPCODES (OPCODE_INFO)
+#undef OPCODE_INFO
+};
+
+
+static const clv_str type_names[CLV_TYPE_COUNT] = {
+    [CLV_TYPE_NIL]    = "nil",
+    [CLV_TYPE_BOOL]   = "bool",
+    [CLV_TYPE_INT]    = "int",
+    [CLV_TYPE_FLOAT]  = "float",
+    [CLV_TYPE_CHAR]   = "char",
+    [CLV_TYPE_STRING] = "string",
+    [CLV_TYPE_FN]     = "fn",
+    [CLV_TYPE_NATIVE] = "fn",
+};
+
+
+static bool
+module_reserve (void **data, uint32_t *capacity, uint32_t need, size_t size) {
+    if (need <= *capacity) {
+        return true;
+    }
+
+    size_t new_capacity = (*capacity < MODULE_MIN_CAPACITY) ? MODULE_MIN_CAPACITY : *capacity;
+
+    while (new_capacity < need) {
+        new_capacity *= 2;
+    }
+
+    if (new_capacity > UINT32_MAX) {
+        errno = EOVERFLOW;
+        return false;
+    }
+
+    void *temp = clv_realloc (CLV_TAG_BYTECODE, *data, new_capacity * size);
+
+    if (temp == NULL) {
+        return false;
+    }
+
+    *data = temp;
+    *capacity = new_capacity;
+
+    return true;
+}
+
+
+clv_module_t *
+clv_module_new (clv_str file) {
+    clv_module_t *module = clv_calloc (CLV_TAG_BYTECODE, 1, sizeof (*module));
+
+    if (module == NULL) {
+        return NULL;
+    }
+
+    if ((module->arena = clv_arena_new (0)) == NULL
+        || (module->file = clv_arena_strndup (module->arena, file, strlen (file))) == NULL) {
+        clv_module_free (module);
+        return NULL;
+    }
+
+    return module;
+}
+
+
+clv_arena_t *
+clv_module_arena (clv_module_t *self) {
+    return self->arena;
+}
+
+
+/* Returns the index of the new function, or UINT32_MAX */
+uint32_t
+clv_module_add_function (clv_module_t *self, const clv_function_t *fn) {
+    if (!module_reserve ((void **)&self->functions, &self->function_capacity, self->function_count + 1, sizeof (*fn))) {
+        return UINT32_MAX;
+    }
+
+    self->functions[self->function_count] = *fn;
+
+    return self->function_count++;
+}
+
+
+clv_function_t *
+clv_module_function (clv_module_t *self, uint32_t index) {
+    return (index < self->function_count) ? &self->functions[index] : NULL;
+}
+
+
+uint32_t
+clv_module_function_count (clv_module_t *self) {
+    return self->function_count;
+}
+
+
+/* Returns the index of the function called `name`, or -1 */
+int64_t
+clv_module_find_function (clv_module_t *self, clv_str name) {
+    for (uint32_t i = 0; i < self->function_count; i++) {
+        if (self->functions[i].name != NULL && strcmp (self->functions[i].name, name) == 0) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+
+/* Returns the index of the new global, or UINT32_MAX */
+uint32_t
+clv_module_add_global (clv_module_t *self, clv_str name) {
+    if (!module_reserve ((void **)&self->globals, &self->global_capacity, self->global_count + 1, sizeof (*self->globals))) {
+        return UINT32_MAX;
+    }
+
+    self->globals[self->global_count] = name;
+
+    return self->global_count++;
+}
+
+
+clv_str
+clv_module_global_name (clv_module_t *self, uint32_t index) {
+    return (index < self->global_count) ? self->globals[index] : NULL;
+}
+
+
+uint32_t
+clv_module_global_count (clv_module_t *self) {
+    return self->global_count;
+}
+
+
+/* Returns the index of the new import, or UINT32_MAX */
+uint32_t
+clv_module_add_import (clv_module_t *self, clv_str name) {
+    // constants tell their module in 16 bits
+    if (self->import_count == UINT16_MAX) {
+        errno = EOVERFLOW;
+        return UINT32_MAX;
+    }
+
+    if (!module_reserve ((void **)&self->imports, &self->import_capacity, self->import_count + 1, sizeof (*self->imports))) {
+        return UINT32_MAX;
+    }
+
+    self->imports[self->import_count] = name;
+
+    return self->import_count++;
+}
+
+
+clv_str
+clv_module_import_name (clv_module_t *self, uint32_t index) {
+    return (index < self->import_count) ? self->imports[index] : NULL;
+}
+
+
+uint32_t
+clv_module_import_count (clv_module_t *self) {
+    return self->import_count;
+}
+
+
+clv_str
+clv_module_get_file (clv_module_t *self) {
+    return self->file;
+}
+
+
+void
+clv_module_free (clv_module_t *self) {
+    if (self == NULL) {
+        return;
+    }
+
+    clv_arena_free (self->arena);
+    clv_free (self->functions);
+    clv_free (self->globals);
+    clv_free (self->imports);
+    clv_free (self);
+}
+
+
+clv_str
+clv_opcode_name (clv_opcode_t op) {
+    return (op < CLV_OP_COUNT) ? opcodes[op].name : "???";
+}
+
+
+clv_insn_fmt_t
+clv_opcode_format (clv_opcode_t op) {
+    return opcodes[op].fmt;
+}
+
+
+clv_str
+clv_type_name (clv_type_t type) {
+    return (type < CLV_TYPE_COUNT) ? type_names[type] : "???";
+}
+
+
+/* == Serialization == */
+
+
+/* Native byte order: saved modules are only read back on the same host */
+#define MODULE_MAGIC            0x4d564c43      /* "CLVM" */
+#define MODULE_FORMAT           2
+#define MODULE_NO_NAME          UINT32_MAX
+
+
+typedef struct {
+    uint8_t *data;
+    size_t length;
+    size_t capacity;
+    bool error;
+} module_writer_t;
+
+
+typedef struct {
+    const uint8_t *data;
+    const uint8_t *end;
+    bool error;
+} module_reader_t;
+
+
+static void
+write_bytes (module_writer_t *w, const void *data, size_t length) {
+    if (w->length + length > w->capacity) {
+        size_t capacity = (w->capacity == 0) ? 4096 : w->capacity;
+
+        while (capacity < w->length + length) {
+            capacity *= 2;
+        }
+
+        uint8_t *temp = clv_realloc (CLV_TAG_BYTECODE, w->data, capacity);
+
+        if (temp == NULL) {
+            w->error = true;
+            return;
+        }
+
+        w->data = temp;
+        w->capacity = capacity;
+    }
+
+    memcpy (w->data + w->length, data, length);
+    w->length += length;
+}
+
+
+static inline void
+write_u32 (module_writer_t *w, uint32_t value) {
+    write_bytes (w, &value, sizeof (value));
+}
+
+
+static void
+write_string (module_writer_t *w, const char *data, uint32_t length) {
+    write_u32 (w, length);
+    write_bytes (w, data, length);
+}
+
+
+static void
+read_bytes (module_reader_t *r, void *out, size_t length) {
+    if ((size_t)(r->end - r->data) < length) {
+        r->error = true;
+        memset (out, 0, length);
+        return;
+    }
+
+    memcpy (out, r->data, length);
+    r->data += length;
+}
+
+
+static inline uint32_t
+read_u32 (module_reader_t *r) {
+    uint32_t value;
+
+    read_bytes (r, &value, sizeof (value));
+
+    return value;
+}
+
+
+/* Copies a string into `arena`, or returns NULL for MODULE_NO_NAME */
+static const char *
+read_string (module_reader_t *r, clv_arena_t *arena, uint32_t *out_length) {
+    uint32_t length = read_u32 (r);
+
+    *out_length = 0;
+
+    if (r->error || length == MODULE_NO_NAME) {
+        return NULL;
+    }
+
+    if ((size_t)(r->end - r->data) < length) {
+        r->error = true;
+        return NULL;
+    }
+
+    const char *string = clv_arena_strndup (arena, (const char *)r->data, length);
+
+    r->error = r->error || (string == NULL);
+    r->data += length;
+    *out_length = length;
+
+    return string;
+}
+
+
+static void
+write_function (module_writer_t *w, const clv_function_t *fn) {
+    clv_str names[] = { fn->name, fn->file };
+
+    for (size_t i = 0; i < CLV_LENGTH (names); i++) {
+        if (names[i] != NULL) {
+            write_string (w, names[i], strlen (names[i]));
+        } else {
+            write_u32 (w, MODULE_NO_NAME);
+        }
+    }
+
+    write_u32 (w, fn->arity);
+    write_u32 (w, fn->registers);
+    write_u32 (w, fn->code_length);
+    write_u32 (w, fn->constant_count);
+    write_bytes (w, fn->code, fn->code_length * sizeof (*fn->code));
+    write_bytes (w, fn->lines, fn->code_length * sizeof (*fn->lines));
+
+    for (uint32_t i = 0; i < fn->constant_count; i++) {
+        const clv_const_t *k = &fn->constants[i];
+
+        write_bytes (w, &k->type, 1);
+        write_bytes (w, &k->module, sizeof (k->module));
+
+        if (k->type == CLV_TYPE_STRING || k->module != 0) {
+            write_string (w, k->as.s.data, k->as.s.length);
+        } else {
+            write_bytes (w, &k->as, sizeof (k->as.i));
+        }
+    }
+}
+
+
+static bool
+read_function (module_reader_t *r, clv_module_t *module, uint32_t function_count, clv_function_t *out_fn) {
+    uint32_t length;
+
+    *out_fn = (clv_function_t){ .name = read_string (r, module->arena, &length) };
+    out_fn->file = read_string (r, module->arena, &length);
+
+    out_fn->arity = read_u32 (r);
+    out_fn->registers = read_u32 (r);
+    out_fn->code_length = read_u32 (r);
+    out_fn->constant_count = read_u32 (r);
+
+    // counts are checked against what is left before allocating for them
+    size_t code_size = (size_t)out_fn->code_length * sizeof (clv_insn_t);
+
+    if (r->error || out_fn->registers > CLV_INSN_MAX_REG || code_size * 2 > (size_t)(r->end - r->data)
+        || out_fn->constant_count > (size_t)(r->end - r->data)) {
+        return false;
+    }
+
+    clv_insn_t *code = clv_arena_alloc (module->arena, code_size);
+    uint32_t *lines = clv_arena_alloc (module->arena, code_size);
+    clv_const_t *constants = clv_arena_alloc (module->arena, out_fn->constant_count * sizeof (*constants));
+
+    if (code == NULL || lines == NULL || (constants == NULL && out_fn->constant_count > 0)) {
+        return false;
+    }
+
+    read_bytes (r, code, code_size);
+    read_bytes (r, lines, code_size);
+
+    for (uint32_t pc = 0; pc < out_fn->code_length; pc++) {
+        if (CLV_INSN_OP (code[pc]) >= CLV_OP_COUNT) {
+            return false;
+        }
+    }
+
+    for (uint32_t i = 0; i < out_fn->constant_count && !r->error; i++) {
+        clv_const_t *k = &constants[i];
+
+        memset (k, 0, sizeof (*k));
+        read_bytes (r, &k->type, 1);
+        read_bytes (r, &k->module, sizeof (k->module));
+
+        if (k->type == CLV_TYPE_STRING || k->module != 0) {
+            k->as.s.data = read_string (r, module->arena, &k->as.s.length);
+            r->error = r->error || (k->as.s.data == NULL);
+        } else {
+            read_bytes (r, &k->as, sizeof (k->as.i));
+        }
+
+        if (k->type >= CLV_TYPE_COUNT || (k->module != 0 && (k->type != CLV_TYPE_FN || k->module > module->import_count))
+            || (k->type == CLV_TYPE_FN && k->module == 0 && k->as.index >= function_count)) {
+            return false;
+        }
+    }
+
+    out_fn->code = code;
+    out_fn->lines = lines;
+    out_fn->constants = constants;
+
+    return !r->error;
+}
+
+
+bool
+clv_module_save (clv_module_t *self, void **out_data, size_t *out_length) {
+    module_writer_t w = { 0 };
+
+    write_u32 (&w, MODULE_MAGIC);
+    write_u32 (&w, MODULE_FORMAT);
+    write_u32 (&w, self->function_count);
+    write_u32 (&w, self->global_count);
+
+    for (uint32_t i = 0; i < self->global_count; i++) {
+        write_string (&w, self->globals[i], strlen (self->globals[i]));
+    }
+
+    write_u32 (&w, self->import_count);
+
+    for (uint32_t i = 0; i < self->import_count; i++) {
+        write_string (&w, self->imports[i], strlen (self->imports[i]));
+    }
+
+    for (uint32_t i = 0; i < self->function_count; i++) {
+        write_function (&w, &self->functions[i]);
+    }
+
+    if (w.error) {
+        clv_free (w.data);
+        errno = ENOMEM;
+        return false;
+    }
+
+    *out_data = w.data;
+    *out_length = w.length;
+
+    return true;
+}
+
+
+clv_module_t *
+clv_module_load (clv_str file, const void *data, size_t length) {
+    module_reader_t r = { .data = data, .end = (const uint8_t *)data + length };
+    clv_module_t *module = clv_module_new (file);
+
+    if (module == NULL) {
+        return NULL;
+    }
+
+    uint32_t magic = read_u32 (&r);
+    uint32_t format = read_u32 (&r);
+    uint32_t function_count = read_u32 (&r);
+    uint32_t global_count = read_u32 (&r);
+    bool good = !r.error && magic == MODULE_MAGIC && format == MODULE_FORMAT
+        && function_count <= length && global_count <= length;
+
+    for (uint32_t i = 0; good && i < global_count; i++) {
+        uint32_t name_length;
+        const char *name = read_string (&r, module->arena, &name_length);
+
+        good = (name != NULL) && clv_module_add_global (module, name) != UINT32_MAX;
+    }
+
+    uint32_t import_count = read_u32 (&r);
+
+    good = good && !r.error && import_count <= length;
+
+    for (uint32_t i = 0; good && i < import_count; i++) {
+        uint32_t name_length;
+        const char *name = read_string (&r, module->arena, &name_length);
+
+        good = (name != NULL) && clv_module_add_import (module, name) != UINT32_MAX;
+    }
+
+    for (uint32_t i = 0; good && i < function_count; i++) {
+        clv_function_t fn;
+
+        good = read_function (&r, module, function_count, &fn) && clv_module_add_function (module, &fn) != UINT32_MAX;
+    }
+
+    if (!good || r.data != r.end) {
+        clv_module_free (module);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    return module;
+}
+
+
+/* == Linking == */
+
+
+/* Functions of every module linked, by module and name */
+typedef struct {
+    uint64_t hash;
+    uint32_t module;
+    uint32_t index;         /* in the module, UINT32_MAX for free slots */
+} link_slot_t;
+
+
+typedef struct {
+    clv_module_t **modules;
+    const uint32_t *const *imports;
+    uint32_t count;
+
+    clv_module_t *out;
+
+    uint32_t *function_base;    /* of each module, in the linked one */
+    uint32_t *global_base;
+
+    clv_str file;               /* of the module being linked, NULL for the last */
+
+    link_slot_t *table;
+    uint32_t table_mask;
+} linker_t;
+
+
+static void *
+link_copy (linker_t *l, const void *data, size_t length) {
+    void *copy = clv_arena_alloc_aligned (l->out->arena, length + 1, 1);
+
+    if (copy != NULL) {
+        memcpy (copy, data, length);
+        ((char *)copy)[length] = '\0';
+    }
+
+    return copy;
+}
+
+
+static bool
+link_index (linker_t *l) {
+    size_t total = 0;
+    uint32_t capacity = MODULE_MIN_CAPACITY;
+
+    for (uint32_t i = 0; i < l->count; i++) {
+        total += l->modules[i]->function_count;
+    }
+
+    // at most half full
+    while (capacity < total * 2) {
+        capacity *= 2;
+    }
+
+    if ((l->table = clv_alloc (CLV_TAG_BYTECODE, capacity * sizeof (*l->table))) == NULL) {
+        return false;
+    }
+
+    l->table_mask = capacity - 1;
+
+    for (uint32_t i = 0; i < capacity; i++) {
+        l->table[i].index = UINT32_MAX;
+    }
+
+    for (uint32_t m = 0; m < l->count; m++) {
+        for (uint32_t i = 0; i < l->modules[m]->function_count; i++) {
+            clv_str name = l->modules[m]->functions[i].name;
+
+            if (name == NULL) {
+                continue;
+            }
+
+            uint64_t hash = clv_hash64 (name, strlen (name), m);
+            uint32_t slot = hash & l->table_mask;
+
+            while (l->table[slot].index != UINT32_MAX) {
+                slot = (slot + 1) & l->table_mask;
+            }
+
+            l->table[slot] = (link_slot_t){ .hash = hash, .module = m, .index = i };
+        }
+    }
+
+    return true;
+}
+
+
+/* Returns the index of the function `name` of `module`, or -1 */
+static int64_t
+link_find (linker_t *l, uint32_t module, const char *name, size_t length) {
+    uint64_t hash = clv_hash64 (name, length, module);
+
+    for (uint32_t slot = hash & l->table_mask;; slot = (slot + 1) & l->table_mask) {
+        link_slot_t *entry = &l->table[slot];
+
+        if (entry->index == UINT32_MAX) {
+            return -1;
+        }
+
+        clv_str found = l->modules[module]->functions[entry->index].name;
+
+        if (entry->hash == hash && entry->module == module && strncmp (found, name, length) == 0
+            && found[length] == '\0') {
+            return entry->index;
+        }
+    }
+}
+
+
+/* Copies `name` into the linked module, prefixed with the name of the file
+ * of `module`, its base name without extension, unless it's the last one */
+static clv_str
+link_name (linker_t *l, uint32_t module, clv_str name) {
+    if (name == NULL) {
+        return NULL;
+    }
+
+    if (module == l->count - 1) {
+        return link_copy (l, name, strlen (name));
+    }
+
+    clv_str file = l->modules[module]->file;
+    clv_str stem = (strrchr (file, '/') != NULL) ? strrchr (file, '/') + 1 : file;
+    clv_str dot = strrchr (stem, '.');
+    size_t stem_length = (dot != NULL && dot != stem) ? (size_t)(dot - stem) : strlen (stem);
+    size_t length = strlen (name);
+
+    char *qualified = clv_arena_alloc_aligned (l->out->arena, stem_length + 1 + length + 1, 1);
+
+    if (qualified != NULL) {
+        memcpy (qualified, stem, stem_length);
+        qualified[stem_length] = '.';
+        memcpy (qualified + stem_length + 1, name, length + 1);
+    }
+
+    return qualified;
+}
+
+
+static bool
+link_constant (linker_t *l, uint32_t module, const clv_const_t *k, clv_const_t *out) {
+    *out = *k;
+
+    if (k->type == CLV_TYPE_STRING) {
+        out->as.s.data = link_copy (l, k->as.s.data, k->as.s.length);
+        return out->as.s.data != NULL;
+    }
+
+    if (k->type != CLV_TYPE_FN) {
+        return true;
+    }
+
+    if (k->module == 0) {
+        out->as.index = l->function_base[module] + k->as.index;
+        return true;
+    }
+
+    uint32_t target = l->imports[module][k->module - 1];
+    int64_t index = link_find (l, target, k->as.s.data, k->as.s.length);
+
+    if (index < 0) {
+        clv_error ("%s: no function '%.*s' in %s", l->modules[module]->file, (int)k->as.s.length, k->as.s.data,
+                   l->modules[target]->file);
+        errno = ENOENT;
+        return false;
+    }
+
+    *out = (clv_const_t){ .type = CLV_TYPE_FN, .as.index = l->function_base[target] + index };
+
+    return true;
+}
+
+
+static bool
+link_function (linker_t *l, uint32_t module, const clv_function_t *fn) {
+    clv_arena_t *arena = l->out->arena;
+    clv_function_t copy = *fn;
+    size_t code_size = fn->code_length * sizeof (*fn->code);
+
+    clv_insn_t *code = clv_arena_alloc (arena, code_size);
+    uint32_t *lines = clv_arena_alloc (arena, code_size);
+    clv_const_t *constants = clv_arena_alloc (arena, fn->constant_count * sizeof (*constants));
+
+    copy.name = link_name (l, module, fn->name);
+    copy.file = (fn->file != NULL) ? link_copy (l, fn->file, strlen (fn->file)) : l->file;
+
+    if ((code == NULL && code_size > 0) || (lines == NULL && code_size > 0)
+        || (constants == NULL && fn->constant_count > 0) || (copy.name == NULL && fn->name != NULL)
+        || (copy.file == NULL && fn->file != NULL)) {
+        return false;
+    }
+
+    memcpy (code, fn->code, code_size);
+    memcpy (lines, fn->lines, code_size);
+
+    // globals are numbered after those of the modules before
+    for (uint32_t pc = 0; pc < fn->code_length; pc++) {
+        clv_opcode_t op = CLV_INSN_OP (code[pc]);
+
+        if (op == CLV_OP_GETGLOBAL || op == CLV_OP_SETGLOBAL) {
+            code[pc] = CLV_INSN_ABX (op, CLV_INSN_A (code[pc]), CLV_INSN_BX (code[pc]) + l->global_base[module]);
+        }
+    }
+
+    for (uint32_t i = 0; i < fn->constant_count; i++) {
+        if (!link_constant (l, module, &fn->constants[i], &constants[i])) {
+            return false;
+        }
+    }
+
+    copy.code = code;
+    copy.lines = lines;
+    copy.constants = constants;
+
+    return clv_module_add_function (l->out, &copy) != UINT32_MAX;
+}
+
+
+/* Function 0 of the linked module calls those of each module in turn */
+static bool
+link_init (linker_t *l) {
+    clv_arena_t *arena = l->out->arena;
+    uint32_t length = l->count * 2 + 1;
+
+    clv_insn_t *code = clv_arena_alloc (arena, length * sizeof (*code));
+    uint32_t *lines = clv_arena_alloc (arena, length * sizeof (*lines));
+    clv_const_t *constants = clv_arena_alloc (arena, l->count * sizeof (*constants));
+
+    if (code == NULL || lines == NULL || constants == NULL) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < l->count; i++) {
+        constants[i] = (clv_const_t){ .type = CLV_TYPE_FN, .as.index = l->function_base[i] };
+        code[i * 2] = CLV_INSN_ABX (CLV_OP_LOADK, 0, i);
+        code[i * 2 + 1] = CLV_INSN_ABC (CLV_OP_CALL, 0, 0, 0);
+    }
+
+    code[length - 1] = CLV_INSN_ABC (CLV_OP_RET, 0, 0, 0);
+    memset (lines, 0, length * sizeof (*lines));
+
+    clv_function_t init = {
+        .name = link_name (l, l->count - 1, l->modules[l->count - 1]->functions[0].name),
+        .registers = 1,
+        .code = code,
+        .lines = lines,
+        .code_length = length,
+        .constants = constants,
+        .constant_count = l->count
+    };
+
+    return clv_module_add_function (l->out, &init) != UINT32_MAX;
+}
+
+
+static bool
+link_modules (linker_t *l) {
+    uint32_t functions = 1;
+    uint32_t globals = 0;
+
+    for (uint32_t i = 0; i < l->count; i++) {
+        clv_module_t *module = l->modules[i];
+
+        // every module has at least its initializer
+        if (module->function_count == 0) {
+            errno = EINVAL;
+            return false;
+        }
+
+        l->function_base[i] = functions;
+        l->global_base[i] = globals;
+
+        functions += module->function_count;
+        globals += module->global_count;
+    }
+
+    if (globals > CLV_INSN_MAX_BX + 1u || l->count > CLV_INSN_MAX_BX + 1u) {
+        errno = EOVERFLOW;
+        return false;
+    }
+
+    if (!link_index (l) || !link_init (l)) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < l->count; i++) {
+        clv_module_t *module = l->modules[i];
+
+        // lines of the last module are in the file of the linked one
+        l->file = (i < l->count - 1) ? link_copy (l, module->file, strlen (module->file)) : NULL;
+
+        if (l->file == NULL && i < l->count - 1) {
+            return false;
+        }
+
+        for (uint32_t g = 0; g < module->global_count; g++) {
+            clv_str name = link_name (l, i, module->globals[g]);
+
+            if (name == NULL || clv_module_add_global (l->out, name) == UINT32_MAX) {
+                return false;
+            }
+        }
+
+        for (uint32_t f = 0; f < module->function_count; f++) {
+            if (!link_function (l, i, &module->functions[f])) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+
+clv_module_t *
+clv_module_link (clv_module_t **modules, const uint32_t *const *imports, uint32_t count) {
+    if (count == 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    linker_t l = {
+        .modules = modules,
+        .imports = imports,
+        .count = count,
+        .out = clv_module_new (modules[count - 1]->file),
+        .function_base = clv_alloc (CLV_TAG_BYTECODE, count * sizeof (*l.function_base)),
+        .global_base = clv_alloc (CLV_TAG_BYTECODE, count * sizeof (*l.global_base))
+    };
+
+    bool good = l.out != NULL && l.function_base != NULL && l.global_base != NULL && link_modules (&l);
+
+    // errno is kept across the cleanup
+    int error = errno;
+
+    clv_free (l.function_base);
+    clv_free (l.global_base);
+    clv_free (l.table);
+
+    if (!good) {
+        clv_module_free (l.out);
+        errno = error;
+        return NULL;
+    }
+
+    return l.out;
+}
+
+
+/* == Dump == */
+
+
+static void
+dump_const (clv_log_record_t *rec, clv_module_t *module, const clv_const_t *k) {
+    switch (k->type) {
+    case CLV_TYPE_INT:
+        clv_log_printf (rec, "%" PRId64, k->as.i);
+        break;
+
+    case CLV_TYPE_FLOAT:
+        clv_log_printf (rec, "%.17g", k->as.f);
+        break;
+
+    case CLV_TYPE_CHAR:
+        clv_log_printf (rec, "'\\U%08x'", k->as.c);
+        break;
+
+    case CLV_TYPE_STRING:
+        clv_log_append (rec, "\"", 1);
+
+        for (uint32_t i = 0; i < k->as.s.length; i++) {
+            unsigned char c = k->as.s.data[i];
+
+            if (c < 0x20 || c == '"' || c == '\\' || c >= 0x7f) {
+                clv_log_printf (rec, "\\x%02x", c);
+            } else {
+                clv_log_append (rec, (const char *)&c, 1);
+            }
+        }
+
+        clv_log_append (rec, "\"", 1);
+        break;
+
+    case CLV_TYPE_FN:
+        if (k->module != 0) {
+            clv_log_printf (rec, "fn %s.%.*s", module->imports[k->module - 1], (int)k->as.s.length, k->as.s.data);
+        } else {
+            clv_log_printf (rec, "fn %s", module->functions[k->as.index].name);
+        }
+
+        break;
+
+    case CLV_TYPE_NATIVE:
+        clv_log_printf (rec, "native #%u", k->as.index);
+        break;
+
+    default:
+        clv_log_append (rec, "???", 3);
+        break;
+    }
+}
+
+
+static void
+dump_insn (clv_log_record_t *rec, clv_module_t *module, const clv_function_t *fn, uint32_t pc) {
+    clv_insn_t insn = fn->code[pc];
+    clv_opcode_t op = CLV_INSN_OP (insn);
+
+    clv_log_printf (rec, "  %5u  [%4u]  %-10s", pc, fn->lines[pc], clv_opcode_name (op));
+
+    if (op >= CLV_OP_COUNT) {
+        clv_log_append (rec, "\n", 1);
+        return;
+    }
+
+    switch (opcodes[op].fmt) {
+    case CLV_FMT_A:
+        clv_log_printf (rec, "%u", CLV_INSN_A (insn));
+        break;
+
+    case CLV_FMT_AB:
+        clv_log_printf (rec, "%u %u", CLV_INSN_A (insn), CLV_INSN_B (insn));
+        break;
+
+    case CLV_FMT_ABC:
+        clv_log_printf (rec, "%u %u %u", CLV_INSN_A (insn), CLV_INSN_B (insn), CLV_INSN_C (insn));
+        break;
+
+    case CLV_FMT_ABSC:
+        clv_log_printf (rec, "%u %u %d", CLV_INSN_A (insn), CLV_INSN_B (insn), CLV_INSN_SC (insn));
+        break;
+
+    case CLV_FMT_ABX:
+        clv_log_printf (rec, "%u %u", CLV_INSN_A (insn), CLV_INSN_BX (insn));
+
+        if (op == CLV_OP_GETGLOBAL || op == CLV_OP_SETGLOBAL) {
+            clv_log_printf (rec, "\t; %s", clv_module_global_name (module, CLV_INSN_BX (insn)));
+        }
+
+        break;
+
+    case CLV_FMT_AK:
+        clv_log_printf (rec, "%u %u\t; ", CLV_INSN_A (insn), CLV_INSN_BX (insn));
+        dump_const (rec, module, &fn->constants[CLV_INSN_BX (insn)]);
+        break;
+
+    case CLV_FMT_ASBX:
+        clv_log_printf (rec, "%u %d\t; to %d", CLV_INSN_A (insn), CLV_INSN_SBX (insn),
+                        (int)pc + 1 + CLV_INSN_SBX (insn));
+        break;
+
+    case CLV_FMT_SAX:
+        clv_log_printf (rec, "%d\t; to %d", CLV_INSN_SAX (insn), (int)pc + 1 + CLV_INSN_SAX (insn));
+        break;
+    }
+
+    clv_log_append (rec, "\n", 1);
+}
+
+
+void
+clv_module_dump (clv_module_t *self) {
+    clv_log_record_t rec;
+
+    clv_log_begin (&rec, CLV_INFO);
+
+    for (uint32_t i = 0; i < self->function_count; i++) {
+        const clv_function_t *fn = &self->functions[i];
+
+        clv_log_printf (&rec, "fn %s: %u params, %u registers, %u constants, %u instructions\n",
+                        fn->name, fn->arity, fn->registers, fn->constant_count, fn->code_length);
+
+        for (uint32_t pc = 0; pc < fn->code_length; pc++) {
+            dump_insn (&rec, self, fn, pc);
+
+            // keep the record bounded on large modules
+            if (rec.length >= DUMP_RECORD_SIZE) {
+                clv_log_end (&rec);
+                clv_log_begin (&rec, CLV_INFO);
+            }
+        }
+    }
+
+    clv_log_end (&rec);
+}
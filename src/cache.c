@@ -0,0 +1,420 @@
+#include <clover/cache.h>
+#include <clover/hash.h>
+#include <clover/log.h>
+#include <clover/alloc.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+
+#define CACHE_MAGIC         0x43564c43      /* "CLVC" */
+#define CACHE_FORMAT        1
+
+#define CACHE_SUFFIX        ".clv"
+#define CACHE_TEMP_PREFIX   "tmp."
+
+/* Temporary files older than this belong to builds that died */
+#define CACHE_STALE_SECONDS (60 * 60)
+
+#define CACHE_MIN_ENTRIES   64
+
+
+struct clv_cache {
+    char *dir;
+    size_t max_size;
+
+    atomic_uint next_temp;  /* tells temporary files of threads apart */
+};
+
+
+/* Precedes the data of each entry */
+typedef struct {
+    uint32_t magic;
+    uint32_t format;
+    uint64_t key;
+    uint64_t length;
+    uint64_t checksum;      /* of the data, seeded with the key */
+} cache_header_t;
+
+
+typedef struct {
+    char *name;
+    size_t size;
+    struct timespec used;
+} cache_entry_t;
+
+
+static bool
+write_all (int fd, const void *data, size_t length) {
+    const char *p = data;
+
+    while (length > 0) {
+        ssize_t count = write (fd, p, length);
+
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return false;
+        }
+
+        p += count;
+        length -= count;
+    }
+
+    return true;
+}
+
+
+static bool
+read_all (int fd, void *data, size_t length) {
+    char *p = data;
+
+    while (length > 0) {
+        ssize_t count = read (fd, p, length);
+
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return false;
+        }
+
+        if (count == 0) {
+            errno = EINVAL;
+            return false;
+        }
+
+        p += count;
+        length -= count;
+    }
+
+    return true;
+}
+
+
+clv_cache_t *
+clv_cache_open (clv_str dir, size_t max_size) {
+    int error = errno;
+
+    if (mkdir (dir, 0777) != 0) {
+        if (errno != EEXIST) {
+            return NULL;
+        }
+
+        // an existing cache is the usual case, not an error to report
+        errno = error;
+    }
+
+    clv_cache_t *cache = clv_calloc (CLV_TAG_CACHE, 1, sizeof (*cache));
+
+    if (cache == NULL || (cache->dir = clv_strdup (CLV_TAG_CACHE, dir)) == NULL) {
+        clv_free (cache);
+        return NULL;
+    }
+
+    cache->max_size = max_size;
+    atomic_init (&cache->next_temp, 0);
+
+    return cache;
+}
+
+
+/* Returns a clv_alloc'ed "dir/name" */
+static char *
+cache_file (clv_cache_t *self, clv_str fmt, ...) {
+    size_t size = strlen (self->dir) + 64;
+    char *path = clv_alloc (CLV_TAG_CACHE, size);
+    va_list args;
+
+    if (path == NULL) {
+        return NULL;
+    }
+
+    int length = snprintf (path, size, "%s/", self->dir);
+
+    va_start (args, fmt);
+    vsnprintf (path + length, size - length, fmt, args);
+    va_end (args);
+
+    return path;
+}
+
+
+char *
+clv_cache_path (clv_cache_t *self, uint64_t key) {
+    return cache_file (self, "%016" PRIx64 CACHE_SUFFIX, key);
+}
+
+
+bool
+clv_cache_get (clv_cache_t *self, uint64_t key, void **out_data, size_t *out_length) {
+    char *path = clv_cache_path (self, key);
+    int fd;
+
+    if (path == NULL) {
+        return false;
+    }
+
+    if ((fd = open (path, O_RDONLY)) < 0) {
+        clv_free (path);
+        return false;
+    }
+
+    cache_header_t header;
+    struct stat st;
+    void *data = NULL;
+
+    bool good = fstat (fd, &st) == 0 && (size_t)st.st_size >= sizeof (header) && read_all (fd, &header, sizeof (header))
+        && header.magic == CACHE_MAGIC && header.format == CACHE_FORMAT && header.key == key
+        && header.length == (uint64_t)st.st_size - sizeof (header);
+
+    if (good && (data = clv_alloc (CLV_TAG_CACHE, header.length + 1)) == NULL) {
+        close (fd);
+        clv_free (path);
+        return false;
+    }
+
+    good = good && read_all (fd, data, header.length) && clv_hash64 (data, header.length, key) == header.checksum;
+
+    if (good) {
+        // the modification time doubles as the last use, for eviction
+        futimens (fd, NULL);
+
+        *out_data = data;
+        *out_length = header.length;
+    } else {
+        clv_debug ("cache: dropping damaged entry %s", path);
+        unlink (path);
+        clv_free (data);
+        errno = EINVAL;
+    }
+
+    close (fd);
+    clv_free (path);
+
+    return good;
+}
+
+
+bool
+clv_cache_put (clv_cache_t *self, uint64_t key, const void *data, size_t length) {
+    cache_header_t header = {
+        .magic = CACHE_MAGIC,
+        .format = CACHE_FORMAT,
+        .key = key,
+        .length = length,
+        .checksum = clv_hash64 (data, length, key),
+    };
+
+    char *path = clv_cache_path (self, key);
+    char *temp = cache_file (self, CACHE_TEMP_PREFIX "%ld.%u", (long)getpid (), atomic_fetch_add (&self->next_temp, 1));
+
+    if (path == NULL || temp == NULL) {
+        clv_free (path);
+        clv_free (temp);
+        return false;
+    }
+
+    int fd = open (temp, O_WRONLY | O_CREAT | O_EXCL, 0644);
+    bool good = (fd >= 0) && write_all (fd, &header, sizeof (header)) && write_all (fd, data, length);
+
+    if (fd >= 0 && close (fd) != 0) {
+        good = false;
+    }
+
+    // readers see either the old entry or the whole new one
+    if (!good || rename (temp, path) != 0) {
+        int error = errno;
+
+        unlink (temp);
+        errno = error;
+        good = false;
+    }
+
+    clv_free (temp);
+    clv_free (path);
+
+    return good;
+}
+
+
+const void *
+clv_cache_map (clv_cache_t *self, uint64_t key, size_t *out_length) {
+    char *path = clv_cache_path (self, key);
+    int fd;
+
+    if (path == NULL) {
+        return NULL;
+    }
+
+    if ((fd = open (path, O_RDONLY)) < 0) {
+        clv_free (path);
+        return NULL;
+    }
+
+    const cache_header_t *header = MAP_FAILED;
+    struct stat st;
+
+    if (fstat (fd, &st) == 0 && (size_t)st.st_size >= sizeof (*header)) {
+        header = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+
+    bool good = header != MAP_FAILED && header->magic == CACHE_MAGIC && header->format == CACHE_FORMAT
+        && header->key == key && header->length == (uint64_t)st.st_size - sizeof (*header)
+        && clv_hash64 (header + 1, header->length, key) == header->checksum;
+
+    if (good) {
+        futimens (fd, NULL);
+        *out_length = header->length;
+    } else {
+        clv_debug ("cache: dropping damaged entry %s", path);
+        unlink (path);
+
+        if (header != MAP_FAILED) {
+            munmap (CLV_VOIDPTR (header), st.st_size);
+        }
+
+        errno = EINVAL;
+    }
+
+    close (fd);
+    clv_free (path);
+
+    return good ? header + 1 : NULL;
+}
+
+
+void
+clv_cache_unmap (const void *data, size_t length) {
+    if (data != NULL) {
+        munmap (CLV_VOIDPTR ((const cache_header_t *)data - 1), length + sizeof (cache_header_t));
+    }
+}
+
+
+static int
+entry_compare (const void *a, const void *b) {
+    const struct timespec *x = &((const cache_entry_t *)a)->used;
+    const struct timespec *y = &((const cache_entry_t *)b)->used;
+
+    if (x->tv_sec != y->tv_sec) {
+        return (x->tv_sec > y->tv_sec) - (x->tv_sec < y->tv_sec);
+    }
+
+    return (x->tv_nsec > y->tv_nsec) - (x->tv_nsec < y->tv_nsec);
+}
+
+
+static bool
+entry_name (clv_str name) {
+    size_t length = strlen (name);
+
+    return length == 16 + strlen (CACHE_SUFFIX) && strspn (name, "0123456789abcdef") == 16
+        && strcmp (name + 16, CACHE_SUFFIX) == 0;
+}
+
+
+bool
+clv_cache_trim (clv_cache_t *self) {
+    DIR *dir = opendir (self->dir);
+
+    if (dir == NULL) {
+        return false;
+    }
+
+    cache_entry_t *entries = NULL;
+    size_t count = 0;
+    size_t capacity = 0;
+    size_t total = 0;
+    time_t now = time (NULL);
+    bool good = true;
+    struct dirent *item;
+
+    while (good && (item = readdir (dir)) != NULL) {
+        struct stat st;
+        bool temp = strncmp (item->d_name, CACHE_TEMP_PREFIX, strlen (CACHE_TEMP_PREFIX)) == 0;
+
+        if ((!temp && !entry_name (item->d_name)) || fstatat (dirfd (dir), item->d_name, &st, 0) != 0) {
+            continue;
+        }
+
+        if (temp) {
+            if (now - st.st_mtime > CACHE_STALE_SECONDS) {
+                unlinkat (dirfd (dir), item->d_name, 0);
+            }
+
+            continue;
+        }
+
+        if (count == capacity) {
+            size_t new_capacity = (capacity == 0) ? CACHE_MIN_ENTRIES : capacity * 2;
+            cache_entry_t *temp_entries = clv_realloc (CLV_TAG_CACHE, entries, new_capacity * sizeof (*entries));
+
+            if (temp_entries == NULL) {
+                good = false;
+                break;
+            }
+
+            entries = temp_entries;
+            capacity = new_capacity;
+        }
+
+        if ((entries[count].name = clv_strdup (CLV_TAG_CACHE, item->d_name)) == NULL) {
+            good = false;
+            break;
+        }
+
+        entries[count].size = st.st_size;
+        entries[count].used = st.st_mtim;
+        total += st.st_size;
+        count++;
+    }
+
+    if (good && total > self->max_size) {
+        qsort (entries, count, sizeof (*entries), entry_compare);
+
+        // another build may have removed some already
+        for (size_t i = 0; i < count && total > self->max_size; i++) {
+            if (unlinkat (dirfd (dir), entries[i].name, 0) == 0 || errno == ENOENT) {
+                total -= entries[i].size;
+            }
+        }
+
+        clv_debug ("cache: trimmed to %zu bytes", total);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        clv_free (entries[i].name);
+    }
+
+    clv_free (entries);
+    closedir (dir);
+
+    return good;
+}
+
+
+void
+clv_cache_free (clv_cache_t *self) {
+    if (self == NULL) {
+        return;
+    }
+
+    clv_free (self->dir);
+    clv_free (self);
+}
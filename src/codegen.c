@@ -0,0 +1,2083 @@
+#include <clover/codegen.h>
+#include <clover/runtime.h>
+#include <clover/intern.h>
+#include <clover/log.h>
+#include <clover/alloc.h>
+
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+
+#define CODEGEN_INIT_NAME       "<globals>"     /* function 0 */
+
+#define CODEGEN_MAX_LOCALS      CLV_INSN_MAX_REG
+#define CODEGEN_MAX_DEFERS      64      /* pending in one function */
+#define CODEGEN_MAX_CODE        (1u << 23)      /* so any jump reaches */
+
+#define CODEGEN_NO_JUMP         UINT32_MAX
+
+#define CODEGEN_MIN_CAPACITY    64
+
+#define CODEGEN_MAX_NAME        256     /* of qualified names looked up */
+
+
+/* Names defined at module level */
+typedef enum {
+    SYM_FN,             // value: function index
+    SYM_GLOBAL,         // value: global index
+    SYM_MODULE,         // value: 0 for native modules, or 1 + the import
+    SYM_VARIANT,        // value: the value of the variant
+    SYM_TYPE,
+} symbol_kind_t;
+
+
+typedef struct {
+    const char *name;
+    uint32_t length;
+    clv_atom_t atom;        /* of the name */
+
+    uint8_t kind;
+    bool is_const;
+    int64_t value;
+
+    uint32_t token;
+} symbol_t;
+
+
+typedef struct {
+    clv_source_t *src;
+    clv_ast_t *ast;
+    clv_token_t *tokens;
+    clv_module_t *module;
+    clv_arena_t *arena;     /* the module's */
+
+    symbol_t *symbols;
+    uint32_t symbol_count;
+    uint32_t symbol_capacity;
+
+    /* open addressing, symbol index + 1 or 0 for free slots */
+    uint32_t *table;
+    uint32_t table_mask;
+
+    /* line of the token instructions were last emitted for */
+    uint32_t line_token;
+    uint32_t line;
+
+    bool error;
+} codegen_t;
+
+
+typedef struct {
+    clv_atom_t atom;        /* of the name, none for hidden registers */
+
+    uint8_t reg;
+    bool is_const;
+} local_t;
+
+
+typedef struct {
+    clv_node_id_t stmt;
+    uint32_t locals;        /* locals in scope where it was deferred */
+} defer_t;
+
+
+typedef struct loop {
+    struct loop *outer;
+
+    uint32_t breaks;        /* jump lists */
+    uint32_t continues;
+
+    uint32_t defers;        /* pending when entered */
+    uint32_t in_defer;
+} loop_t;
+
+
+typedef struct {
+    uint32_t locals;
+    uint32_t defers;
+    uint32_t free_reg;
+} scope_t;
+
+
+typedef struct {
+    codegen_t *cg;
+    uint32_t token;         /* of the node being compiled */
+
+    clv_insn_t *code;
+    uint32_t *lines;
+    uint32_t length;
+    uint32_t capacity;
+
+    clv_const_t *constants;
+    uint32_t constant_count;
+    uint32_t constant_capacity;
+
+    local_t locals[CODEGEN_MAX_LOCALS];
+    uint32_t local_count;
+
+    /* locals out of scope of the statement being deferred */
+    uint32_t hidden_start;
+    uint32_t hidden_end;
+
+    defer_t defers[CODEGEN_MAX_DEFERS];
+    uint32_t defer_count;
+    uint32_t in_defer;
+
+    loop_t *loop;
+
+    uint32_t free_reg;
+    uint32_t max_reg;
+} fn_state_t;
+
+
+/* Where the value of a name comes from */
+typedef struct {
+    enum { REF_LOCAL, REF_GLOBAL, REF_CONST } kind;
+    bool is_const;
+
+    uint32_t index;         /* register or global */
+    clv_const_t k;
+} ref_t;
+
+
+static const uint8_t binary_opcodes[256] = {
+    [CLV_TOKEN_PLUS]      = CLV_OP_ADD,
+    [CLV_TOKEN_MINUS]     = CLV_OP_SUB,
+    [CLV_TOKEN_MULTIPLY]  = CLV_OP_MUL,
+    [CLV_TOKEN_DIVIDE]    = CLV_OP_DIV,
+    [CLV_TOKEN_REMAINDER] = CLV_OP_MOD,
+    [CLV_TOKEN_BIT_AND]   = CLV_OP_BAND,
+    [CLV_TOKEN_BIT_OR]    = CLV_OP_BOR,
+    [CLV_TOKEN_BIT_XOR]   = CLV_OP_BXOR,
+    [CLV_TOKEN_BIT_SHL]   = CLV_OP_SHL,
+    [CLV_TOKEN_BIT_SHR]   = CLV_OP_SHR,
+    [CLV_TOKEN_EQ]        = CLV_OP_EQ,
+    [CLV_TOKEN_NE]        = CLV_OP_NE,
+    [CLV_TOKEN_LT]        = CLV_OP_LT,
+    [CLV_TOKEN_LE]        = CLV_OP_LE,
+    [CLV_TOKEN_GT]        = CLV_OP_LT,    // operands swapped
+    [CLV_TOKEN_GE]        = CLV_OP_LE,
+};
+
+
+static const uint8_t unary_opcodes[256] = {
+    [CLV_TOKEN_MINUS]   = CLV_OP_NEG,
+    [CLV_TOKEN_NOT]     = CLV_OP_NOT,
+    [CLV_TOKEN_BIT_NOT] = CLV_OP_BNOT,
+};
+
+
+static const struct {
+    clv_str name;
+    uint8_t type;
+} cast_types[] = {
+    { "bool",   CLV_TYPE_BOOL },
+    { "int",    CLV_TYPE_INT },
+    { "float",  CLV_TYPE_FLOAT },
+    { "char",   CLV_TYPE_CHAR },
+    { "string", CLV_TYPE_STRING },
+};
+
+
+/* == Auxiliary Functions == */
+
+
+static void
+gen_error (codegen_t *cg, uint32_t token, clv_str msg, ...) {
+    va_list args;
+
+    clv_log_record_t rec;
+
+    clv_location_t loc = { .line = 1, .column = 1 };
+
+    clv_source_locate (cg->src, cg->tokens[token].offset, &loc);
+
+    clv_str line = clv_source_offset (cg->src, loc.line_offset);
+
+    clv_log_begin (&rec, CLV_ERROR);
+    clv_log_printf (&rec, "%s:%u:%u: ", clv_source_get_file (cg->src), loc.line, loc.column);
+
+    va_start (args, msg);
+    clv_log_vprintf (&rec, msg, args);
+    va_end (args);
+
+    clv_log_printf (&rec, "\n %3u | ", loc.line);
+    clv_log_append (&rec, line, strcspn (line, "\r\n"));
+    clv_log_append (&rec, "\n", 1);
+    clv_log_end (&rec);
+
+    cg->error = true;
+}
+
+
+/* Returns the line of `token`. Instructions come in runs for the same
+ * token, so the last one is remembered. */
+static uint32_t
+gen_line (codegen_t *cg, uint32_t token) {
+    if (token != cg->line_token) {
+        clv_location_t loc = { .line = 0 };
+
+        clv_source_locate (cg->src, cg->tokens[token].offset, &loc);
+
+        cg->line_token = token;
+        cg->line = loc.line;
+    }
+
+    return cg->line;
+}
+
+
+static inline clv_node_t *
+node_at (codegen_t *cg, clv_node_id_t id) {
+    return clv_ast_node (cg->ast, id);
+}
+
+
+static inline const char *
+token_text (codegen_t *cg, uint32_t token) {
+    return clv_source_offset (cg->src, cg->tokens[token].offset);
+}
+
+
+static inline bool
+token_equal (codegen_t *cg, uint32_t token, clv_str string) {
+    size_t length = strlen (string);
+
+    return cg->tokens[token].length == length && memcmp (token_text (cg, token), string, length) == 0;
+}
+
+
+/* == Symbols == */
+
+
+static symbol_t *
+symbol_find (codegen_t *cg, clv_atom_t atom) {
+    if (cg->table == NULL || atom == CLV_ATOM_NONE) {
+        return NULL;
+    }
+
+    for (uint32_t i = clv_atom_hash (atom);; i++) {
+        uint32_t slot = cg->table[i & cg->table_mask];
+
+        if (slot == 0) {
+            return NULL;
+        }
+
+        if (cg->symbols[slot - 1].atom == atom) {
+            return &cg->symbols[slot - 1];
+        }
+    }
+}
+
+
+/* Finds the member named by `token` of `symbol`, which is named
+ * symbol.member. Names never interned can't be defined. */
+static symbol_t *
+symbol_find_member (codegen_t *cg, symbol_t *symbol, uint32_t token) {
+    char name[CODEGEN_MAX_NAME];
+    uint32_t length = cg->tokens[token].length;
+
+    if (symbol->length + 1 + length > sizeof (name)) {
+        return NULL;
+    }
+
+    memcpy (name, symbol->name, symbol->length);
+    name[symbol->length] = '.';
+    memcpy (name + symbol->length + 1, token_text (cg, token), length);
+
+    return symbol_find (cg, clv_intern_find (name, symbol->length + 1 + length));
+}
+
+
+static bool
+symbol_rehash (codegen_t *cg, uint32_t capacity) {
+    uint32_t *table = clv_calloc (CLV_TAG_BYTECODE, capacity, sizeof (*table));
+
+    if (table == NULL) {
+        return false;
+    }
+
+    clv_free (cg->table);
+
+    cg->table = table;
+    cg->table_mask = capacity - 1;
+
+    for (uint32_t i = 0; i < cg->symbol_count; i++) {
+        uint32_t slot = clv_atom_hash (cg->symbols[i].atom);
+
+        while (table[slot & cg->table_mask] != 0) {
+            slot++;
+        }
+
+        table[slot & cg->table_mask] = i + 1;
+    }
+
+    return true;
+}
+
+
+/* Defines `name`, which must live as long as the module */
+static symbol_t *
+symbol_add (codegen_t *cg, uint32_t token, const char *name, uint32_t length, symbol_kind_t kind) {
+    clv_atom_t atom = clv_intern (name, length);
+
+    if (atom == CLV_ATOM_NONE) {
+        gen_error (cg, token, "unable to define symbol: %s", strerror (errno));
+        return NULL;
+    }
+
+    symbol_t *existing = symbol_find (cg, atom);
+
+    if (existing != NULL) {
+        gen_error (cg, token, "'%.*s' is already defined at line %u", (int)length, name,
+                   gen_line (cg, existing->token));
+        return NULL;
+    }
+
+    if (cg->symbol_count == cg->symbol_capacity) {
+        uint32_t capacity = (cg->symbol_capacity == 0) ? CODEGEN_MIN_CAPACITY : cg->symbol_capacity * 2;
+        symbol_t *temp = clv_realloc (CLV_TAG_BYTECODE, cg->symbols, capacity * sizeof (*temp));
+
+        if (temp == NULL) {
+            gen_error (cg, token, "unable to define symbol: %s", strerror (errno));
+            return NULL;
+        }
+
+        cg->symbols = temp;
+        cg->symbol_capacity = capacity;
+    }
+
+    cg->symbols[cg->symbol_count++] = (symbol_t){
+        .name = name,
+        .length = length,
+        .atom = atom,
+        .kind = kind,
+        .token = token
+    };
+
+    // at most half full
+    if (cg->symbol_count * 2 > cg->table_mask) {
+        if (!symbol_rehash (cg, (cg->table_mask + 1) * 2)) {
+            cg->symbol_count--;
+            gen_error (cg, token, "unable to define symbol: %s", strerror (errno));
+            return NULL;
+        }
+    } else {
+        uint32_t slot = clv_atom_hash (atom);
+
+        while (cg->table[slot & cg->table_mask] != 0) {
+            slot++;
+        }
+
+        cg->table[slot & cg->table_mask] = cg->symbol_count;
+    }
+
+    return &cg->symbols[cg->symbol_count - 1];
+}
+
+
+/* == Emission == */
+
+
+static bool
+emit (fn_state_t *fs, clv_insn_t insn) {
+    if (fs->length == fs->capacity) {
+        uint32_t capacity = (fs->capacity == 0) ? CODEGEN_MIN_CAPACITY : fs->capacity * 2;
+        clv_insn_t *code = NULL;
+        uint32_t *lines = NULL;
+
+        if (fs->length >= CODEGEN_MAX_CODE) {
+            gen_error (fs->cg, fs->token, "function is too large");
+            return false;
+        }
+
+        if ((code = clv_realloc (CLV_TAG_BYTECODE, fs->code, capacity * sizeof (*code))) != NULL) {
+            fs->code = code;
+        }
+
+        if ((lines = clv_realloc (CLV_TAG_BYTECODE, fs->lines, capacity * sizeof (*lines))) != NULL) {
+            fs->lines = lines;
+        }
+
+        if (code == NULL || lines == NULL) {
+            gen_error (fs->cg, fs->token, "unable to grow function: %s", strerror (errno));
+            return false;
+        }
+
+        fs->capacity = capacity;
+    }
+
+    fs->code[fs->length] = insn;
+    fs->lines[fs->length] = gen_line (fs->cg, fs->token);
+    fs->length++;
+
+    return true;
+}
+
+
+static inline bool
+emit_abc (fn_state_t *fs, clv_opcode_t op, uint32_t a, uint32_t b, uint32_t c) {
+    return emit (fs, CLV_INSN_ABC (op, a, b, c));
+}
+
+
+static inline bool
+emit_abx (fn_state_t *fs, clv_opcode_t op, uint32_t a, uint32_t bx) {
+    return emit (fs, CLV_INSN_ABX (op, a, bx));
+}
+
+
+static bool
+emit_move (fn_state_t *fs, uint32_t dst, uint32_t src) {
+    return (dst == src) || emit_abc (fs, CLV_OP_MOVE, dst, src, 0);
+}
+
+
+/* Adds `k` to the constant pool, unless it's there already */
+static bool
+emit_const (fn_state_t *fs, uint32_t dst, const clv_const_t *k) {
+    uint32_t index;
+
+    for (index = 0; index < fs->constant_count; index++) {
+        const clv_const_t *other = &fs->constants[index];
+
+        if (other->type != k->type || other->module != k->module) {
+            continue;
+        }
+
+        // functions of other modules go by name
+        if (k->type == CLV_TYPE_STRING || k->module != 0) {
+            if (other->as.s.length == k->as.s.length && memcmp (other->as.s.data, k->as.s.data, k->as.s.length) == 0) {
+                break;
+            }
+        } else if (memcmp (&other->as, &k->as, sizeof (k->as)) == 0) {
+            break;
+        }
+    }
+
+    if (index == fs->constant_count) {
+        if (index > CLV_INSN_MAX_BX) {
+            gen_error (fs->cg, fs->token, "function has too many constants");
+            return false;
+        }
+
+        if (fs->constant_count == fs->constant_capacity) {
+            uint32_t capacity = (fs->constant_capacity == 0) ? CODEGEN_MIN_CAPACITY : fs->constant_capacity * 2;
+            clv_const_t *temp = clv_realloc (CLV_TAG_BYTECODE, fs->constants, capacity * sizeof (*temp));
+
+            if (temp == NULL) {
+                gen_error (fs->cg, fs->token, "unable to grow constant pool: %s", strerror (errno));
+                return false;
+            }
+
+            fs->constants = temp;
+            fs->constant_capacity = capacity;
+        }
+
+        // unused bytes of the union are compared above
+        memset (&fs->constants[index], 0, sizeof (*k));
+        fs->constants[index].type = k->type;
+        fs->constants[index].module = k->module;
+        fs->constants[index].as = k->as;
+        fs->constant_count++;
+    }
+
+    return emit_abx (fs, CLV_OP_LOADK, dst, index);
+}
+
+
+static bool
+emit_int (fn_state_t *fs, uint32_t dst, int64_t value) {
+    if (value >= CLV_INSN_MIN_SBX && value <= CLV_INSN_MAX_SBX) {
+        return emit_abx (fs, CLV_OP_LOADI, dst, (uint16_t)value);
+    }
+
+    clv_const_t k = { .type = CLV_TYPE_INT, .as.i = value };
+
+    return emit_const (fs, dst, &k);
+}
+
+
+/* == Jumps == */
+
+
+/* Pending jumps form lists, linked through their own offsets. The last
+ * one jumps to itself. */
+static inline int32_t
+jump_offset (fn_state_t *fs, uint32_t pc) {
+    clv_insn_t insn = fs->code[pc];
+
+    return (CLV_INSN_OP (insn) == CLV_OP_JMP) ? CLV_INSN_SAX (insn) : CLV_INSN_SBX (insn);
+}
+
+
+static bool
+jump_set (fn_state_t *fs, uint32_t pc, uint32_t target) {
+    clv_insn_t insn = fs->code[pc];
+    int64_t offset = (int64_t)target - (pc + 1);
+
+    if (CLV_INSN_OP (insn) == CLV_OP_JMP) {
+        if (offset < CLV_INSN_MIN_SAX || offset > CLV_INSN_MAX_SAX) {
+            gen_error (fs->cg, fs->token, "function is too large");
+            return false;
+        }
+
+        fs->code[pc] = CLV_INSN_SAX_ (CLV_OP_JMP, (uint32_t)offset & 0xffffff);
+    } else {
+        if (offset < CLV_INSN_MIN_SBX || offset > CLV_INSN_MAX_SBX) {
+            gen_error (fs->cg, fs->token, "jump is too long, split the function up");
+            return false;
+        }
+
+        fs->code[pc] = CLV_INSN_ABX (CLV_INSN_OP (insn), CLV_INSN_A (insn), (uint16_t)offset);
+    }
+
+    return true;
+}
+
+
+/* Emits a jump to be patched, and returns a list of it */
+static uint32_t
+jump_emit (fn_state_t *fs, clv_opcode_t op, uint32_t a) {
+    uint32_t pc = fs->length;
+
+    if (!emit (fs, (op == CLV_OP_JMP) ? CLV_INSN_SAX_ (op, 0xffffff) : CLV_INSN_ABX (op, a, 0xffff))) {
+        return CODEGEN_NO_JUMP;
+    }
+
+    return pc;
+}
+
+
+static inline uint32_t
+jump_next (fn_state_t *fs, uint32_t pc) {
+    int32_t offset = jump_offset (fs, pc);
+
+    return (offset == -1) ? CODEGEN_NO_JUMP : pc + 1 + offset;
+}
+
+
+static bool
+jump_concat (fn_state_t *fs, uint32_t *list, uint32_t other) {
+    if (other == CODEGEN_NO_JUMP) {
+        return true;
+    }
+
+    if (*list == CODEGEN_NO_JUMP) {
+        *list = other;
+        return true;
+    }
+
+    uint32_t pc = *list;
+    uint32_t next;
+
+    while ((next = jump_next (fs, pc)) != CODEGEN_NO_JUMP) {
+        pc = next;
+    }
+
+    return jump_set (fs, pc, other);
+}
+
+
+static bool
+jump_patch (fn_state_t *fs, uint32_t list, uint32_t target) {
+    while (list != CODEGEN_NO_JUMP) {
+        uint32_t next = jump_next (fs, list);
+
+        if (!jump_set (fs, list, target)) {
+            return false;
+        }
+
+        list = next;
+    }
+
+    return true;
+}
+
+
+static inline bool
+jump_patch_here (fn_state_t *fs, uint32_t list) {
+    return jump_patch (fs, list, fs->length);
+}
+
+
+/* == Registers and Scopes == */
+
+
+static bool
+reg_alloc (fn_state_t *fs, uint32_t *out_reg) {
+    if (fs->free_reg >= CLV_INSN_MAX_REG) {
+        gen_error (fs->cg, fs->token, "function needs more than %d registers", CLV_INSN_MAX_REG);
+        return false;
+    }
+
+    *out_reg = fs->free_reg++;
+
+    if (fs->free_reg > fs->max_reg) {
+        fs->max_reg = fs->free_reg;
+    }
+
+    return true;
+}
+
+
+/* First register past the locals */
+static inline uint32_t
+locals_end (fn_state_t *fs) {
+    return (fs->local_count > 0) ? fs->locals[fs->local_count - 1].reg + 1u : 0;
+}
+
+
+static bool
+local_declare (fn_state_t *fs, uint32_t token, uint32_t reg, bool is_const) {
+    if (fs->local_count == CODEGEN_MAX_LOCALS) {
+        gen_error (fs->cg, fs->token, "function has too many variables");
+        return false;
+    }
+
+    fs->locals[fs->local_count++] = (local_t){
+        .atom = (token != UINT32_MAX) ? fs->cg->tokens[token].atom : CLV_ATOM_NONE,
+        .reg = reg,
+        .is_const = is_const
+    };
+
+    return true;
+}
+
+
+static local_t *
+local_find (fn_state_t *fs, clv_atom_t atom) {
+    for (uint32_t i = fs->local_count; i-- > 0;) {
+        local_t *local = &fs->locals[i];
+
+        if (i >= fs->hidden_start && i < fs->hidden_end) {
+            continue;
+        }
+
+        if (local->atom == atom) {
+            return local;
+        }
+    }
+
+    return NULL;
+}
+
+
+static bool gen_statement (fn_state_t *fs, clv_node_id_t id);
+
+
+static inline void
+scope_enter (fn_state_t *fs, scope_t *scope) {
+    *scope = (scope_t){
+        .locals = fs->local_count,
+        .defers = fs->defer_count,
+        .free_reg = fs->free_reg
+    };
+}
+
+
+/* Runs the statement of a defer, as seen from where it was deferred */
+static bool
+gen_deferred (fn_state_t *fs, defer_t *defer) {
+    uint32_t hidden_start = fs->hidden_start;
+    uint32_t hidden_end = fs->hidden_end;
+
+    // only the outermost range matters, as nested ones are within it
+    if (fs->in_defer == 0) {
+        fs->hidden_start = defer->locals;
+        fs->hidden_end = fs->local_count;
+    }
+
+    fs->in_defer++;
+    bool good = gen_statement (fs, defer->stmt);
+    fs->in_defer--;
+
+    fs->hidden_start = hidden_start;
+    fs->hidden_end = hidden_end;
+
+    return good;
+}
+
+
+/* Runs the statements deferred since `count`, last first */
+static bool
+gen_defers (fn_state_t *fs, uint32_t count) {
+    for (uint32_t i = fs->defer_count; i-- > count;) {
+        defer_t defer = fs->defers[i];
+
+        if (!gen_deferred (fs, &defer)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+static bool
+scope_leave (fn_state_t *fs, scope_t *scope) {
+    bool good = gen_defers (fs, scope->defers);
+
+    fs->defer_count = scope->defers;
+    fs->local_count = scope->locals;
+    fs->free_reg = scope->free_reg;
+
+    return good;
+}
+
+
+/* == Literals == */
+
+
+static uint32_t
+hex_value (const char *p, int digits) {
+    uint32_t value = 0;
+
+    for (int i = 0; i < digits; i++) {
+        char c = p[i];
+
+        value = (value << 4) | ((c <= '9') ? c - '0' : (c | 0x20) - 'a' + 10);
+    }
+
+    return value;
+}
+
+
+/* Decodes the escape sequence after a backslash at `*p`. \x yields a byte,
+ * others a code point. */
+static uint32_t
+decode_escape (const char **p, bool *out_byte) {
+    char c = *(*p)++;
+
+    *out_byte = false;
+
+    switch (c) {
+    case 'a': return '\a';
+    case 'b': return '\b';
+    case 'e': return 0x1b;
+    case 'f': return '\f';
+    case 'n': return '\n';
+    case 'r': return '\r';
+    case 't': return '\t';
+    case 'v': return '\v';
+
+    case 'x':
+    case 'X':
+        *out_byte = true;
+        *p += 2;
+        return hex_value (*p - 2, 2);
+
+    case 'u':
+        *p += 4;
+        return hex_value (*p - 4, 4);
+
+    case 'U':
+        *p += 8;
+        return hex_value (*p - 8, 8);
+
+    default:
+        return (uint8_t)c;
+    }
+}
+
+
+static bool
+gen_string (fn_state_t *fs, uint32_t token, uint32_t dst) {
+    codegen_t *cg = fs->cg;
+
+    const char *p = token_text (cg, token) + 1;
+    const char *end = p + cg->tokens[token].length - 2;
+
+    // escapes never grow the text
+    char *data = clv_arena_alloc (cg->arena, end - p + 1);
+    size_t length = 0;
+
+    if (data == NULL) {
+        gen_error (cg, token, "unable to allocate string: %s", strerror (errno));
+        return false;
+    }
+
+    while (p < end) {
+        if (*p != '\\') {
+            data[length++] = *p++;
+            continue;
+        }
+
+        bool byte;
+
+        p++;
+        uint32_t c = decode_escape (&p, &byte);
+
+        if (byte) {
+            data[length++] = c;
+        } else {
+            length += clv_utf8_encode (c, data + length);
+        }
+    }
+
+    clv_const_t k = {
+        .type = CLV_TYPE_STRING,
+        .as.s = { .data = data, .length = length }
+    };
+
+    return emit_const (fs, dst, &k);
+}
+
+
+static bool
+gen_char (fn_state_t *fs, uint32_t token, uint32_t dst) {
+    const char *p = token_text (fs->cg, token) + 1;
+
+    if (fs->cg->tokens[token].length == 2) {
+        gen_error (fs->cg, token, "empty character literal");
+        return false;
+    }
+
+    bool byte;
+    clv_const_t k = { .type = CLV_TYPE_CHAR };
+
+    if (*p == '\\') {
+        p++;
+        k.as.c = decode_escape (&p, &byte);
+    } else {
+        k.as.c = (uint8_t)*p;
+    }
+
+    return emit_const (fs, dst, &k);
+}
+
+
+/* Reads integer literals; hex and binary ones may set the sign bit */
+static bool
+parse_int (codegen_t *cg, uint32_t token, int64_t *out_value) {
+    clv_token_t *tk = &cg->tokens[token];
+    const char *p = token_text (cg, token);
+    const char *end = p + tk->length;
+
+    int base = 10;
+    uint64_t limit = INT64_MAX;
+    uint64_t value = 0;
+
+    if (tk->type == CLV_TOKEN_HEX || tk->type == CLV_TOKEN_BIN) {
+        base = (tk->type == CLV_TOKEN_HEX) ? 16 : 2;
+        limit = UINT64_MAX;
+        p += 2;
+    }
+
+    for (; p < end; p++) {
+        uint64_t digit = (*p <= '9') ? (uint64_t)(*p - '0') : (uint64_t)((*p | 0x20) - 'a' + 10);
+
+        if (value > (limit - digit) / base) {
+            gen_error (cg, token, "integer literal is too large");
+            return false;
+        }
+
+        value = value * base + digit;
+    }
+
+    *out_value = (int64_t)value;
+
+    return true;
+}
+
+
+static bool
+gen_literal (fn_state_t *fs, clv_node_t *node, uint32_t dst) {
+    codegen_t *cg = fs->cg;
+    clv_token_t *tk = &cg->tokens[node->token];
+    int64_t value;
+
+    switch (tk->type) {
+    case CLV_TOKEN_INT:
+    case CLV_TOKEN_HEX:
+    case CLV_TOKEN_BIN:
+        return parse_int (cg, node->token, &value) && emit_int (fs, dst, value);
+
+    case CLV_TOKEN_FLOAT: {
+        char buffer[64];
+
+        if (tk->length >= sizeof (buffer)) {
+            gen_error (cg, node->token, "float literal is too long");
+            return false;
+        }
+
+        memcpy (buffer, token_text (cg, node->token), tk->length);
+        buffer[tk->length] = '\0';
+
+        clv_const_t k = { .type = CLV_TYPE_FLOAT, .as.f = strtod (buffer, NULL) };
+
+        return emit_const (fs, dst, &k);
+    }
+
+    case CLV_TOKEN_STRING:
+        return gen_string (fs, node->token, dst);
+
+    case CLV_TOKEN_CHARACTER:
+        return gen_char (fs, node->token, dst);
+
+    case CLV_TOKEN_TRUE:
+    case CLV_TOKEN_FALSE:
+        return emit_abc (fs, CLV_OP_LOADBOOL, dst, tk->type == CLV_TOKEN_TRUE, 0);
+
+    default:
+        return emit_abc (fs, CLV_OP_LOADNIL, dst, 0, 0);
+    }
+}
+
+
+/* Value of small integer literals, for immediate operands */
+static bool
+literal_int (codegen_t *cg, clv_node_id_t id, int64_t *out_value) {
+    clv_node_t *node = node_at (cg, id);
+
+    if (node->kind != CLV_NODE_LITERAL || cg->tokens[node->token].type != CLV_TOKEN_INT) {
+        return false;
+    }
+
+    const char *p = token_text (cg, node->token);
+    uint32_t length = cg->tokens[node->token].length;
+    int64_t value = 0;
+
+    // anything longer is not small
+    if (length > 4) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < length; i++) {
+        value = value * 10 + (p[i] - '0');
+    }
+
+    *out_value = value;
+
+    return true;
+}
+
+
+/* == Names == */
+
+
+static bool
+resolve_symbol (fn_state_t *fs, uint32_t token, symbol_t *symbol, ref_t *out_ref) {
+    switch (symbol->kind) {
+    case SYM_FN:
+        *out_ref = (ref_t){ .kind = REF_CONST, .k = { .type = CLV_TYPE_FN, .as.index = symbol->value } };
+        return true;
+
+    case SYM_GLOBAL:
+        *out_ref = (ref_t){ .kind = REF_GLOBAL, .index = symbol->value, .is_const = symbol->is_const };
+        return true;
+
+    case SYM_VARIANT:
+        *out_ref = (ref_t){ .kind = REF_CONST, .k = { .type = CLV_TYPE_INT, .as.i = symbol->value } };
+        return true;
+
+    case SYM_MODULE:
+        gen_error (fs->cg, token, "module '%.*s' is not a value", (int)symbol->length, symbol->name);
+        return false;
+
+    default:
+        gen_error (fs->cg, token, "type '%.*s' is not a value", (int)symbol->length, symbol->name);
+        return false;
+    }
+}
+
+
+/* Emits the reference a name, or a path of a module member, variant or
+ * method, stands for: a local, a global or a constant. Functions of other
+ * modules are constants named after them, resolved when linking. */
+static bool
+resolve (fn_state_t *fs, clv_node_id_t id, ref_t *out_ref) {
+    codegen_t *cg = fs->cg;
+    clv_node_t *node = node_at (cg, id);
+
+    const char *name = token_text (cg, node->token);
+    uint32_t length = cg->tokens[node->token].length;
+    clv_atom_t atom = cg->tokens[node->token].atom;
+
+    if (node->kind == CLV_NODE_NAME) {
+        local_t *local = local_find (fs, atom);
+
+        if (local != NULL) {
+            *out_ref = (ref_t){ .kind = REF_LOCAL, .index = local->reg, .is_const = local->is_const };
+            return true;
+        }
+
+        symbol_t *symbol = symbol_find (cg, atom);
+
+        if (symbol == NULL) {
+            gen_error (cg, node->token, "unknown name '%.*s'", (int)length, name);
+            return false;
+        }
+
+        return resolve_symbol (fs, node->token, symbol, out_ref);
+    }
+
+    clv_node_t *outer = node_at (cg, node->lhs);
+    symbol_t *symbol = NULL;
+
+    if (outer->kind == CLV_NODE_NAME) {
+        clv_atom_t outer_atom = cg->tokens[outer->token].atom;
+
+        if (local_find (fs, outer_atom) == NULL) {
+            symbol = symbol_find (cg, outer_atom);
+        }
+    }
+
+    if (symbol == NULL || (symbol->kind != SYM_MODULE && symbol->kind != SYM_TYPE)) {
+        gen_error (cg, node->token, "members of values are not supported yet");
+        return false;
+    }
+
+    // functions of other modules are resolved by name when linking
+    if (symbol->kind == SYM_MODULE && symbol->value != 0) {
+        char *member = clv_arena_strndup (cg->arena, name, length);
+
+        if (member == NULL) {
+            gen_error (cg, node->token, "unable to import function: %s", strerror (errno));
+            return false;
+        }
+
+        *out_ref = (ref_t){
+            .kind = REF_CONST,
+            .k = { .type = CLV_TYPE_FN, .module = symbol->value, .as.s = { .data = member, .length = length } }
+        };
+
+        return true;
+    }
+
+    if (symbol->kind == SYM_MODULE) {
+        int native = clv_native_find (symbol->name, symbol->length, name, length);
+
+        if (native < 0) {
+            gen_error (cg, node->token, "module '%.*s' has no member '%.*s'", (int)symbol->length, symbol->name, (int)length, name);
+            return false;
+        }
+
+        *out_ref = (ref_t){ .kind = REF_CONST, .k = { .type = CLV_TYPE_NATIVE, .as.index = native } };
+        return true;
+    }
+
+    symbol_t *member = symbol_find_member (cg, symbol, node->token);
+
+    if (member == NULL) {
+        gen_error (cg, node->token, "'%.*s' has no member '%.*s'", (int)symbol->length, symbol->name, (int)length, name);
+        return false;
+    }
+
+    return resolve_symbol (fs, node->token, member, out_ref);
+}
+
+
+static bool
+gen_ref (fn_state_t *fs, ref_t *ref, uint32_t dst) {
+    switch (ref->kind) {
+    case REF_LOCAL:
+        return emit_move (fs, dst, ref->index);
+
+    case REF_GLOBAL:
+        return emit_abx (fs, CLV_OP_GETGLOBAL, dst, ref->index);
+
+    default:
+        return (ref->k.type == CLV_TYPE_INT) ? emit_int (fs, dst, ref->k.as.i) : emit_const (fs, dst, &ref->k);
+    }
+}
+
+
+/* == Expressions == */
+
+
+static bool gen_expr (fn_state_t *fs, clv_node_id_t id, uint32_t dst);
+
+
+/* Evaluates into a register: the one of a local, or a new temporary */
+static bool
+gen_operand (fn_state_t *fs, clv_node_id_t id, uint32_t *out_reg) {
+    clv_node_t *node = node_at (fs->cg, id);
+
+    if (node->kind == CLV_NODE_NAME) {
+        local_t *local = local_find (fs, fs->cg->tokens[node->token].atom);
+
+        if (local != NULL) {
+            *out_reg = local->reg;
+            return true;
+        }
+    }
+
+    return reg_alloc (fs, out_reg) && gen_expr (fs, id, *out_reg);
+}
+
+
+/* && and || yield the operand that decided the result */
+static bool
+gen_logical (fn_state_t *fs, clv_node_t *node, uint32_t dst) {
+    uint32_t top = fs->free_reg;
+    uint32_t target = dst;
+
+    // the right operand may read the local being assigned
+    if (dst < locals_end (fs) && !reg_alloc (fs, &target)) {
+        return false;
+    }
+
+    uint32_t skip;
+
+    if (!gen_expr (fs, node->lhs, target)
+        || (skip = jump_emit (fs, (node->op == CLV_TOKEN_AND) ? CLV_OP_JMPF : CLV_OP_JMPT, target)) == CODEGEN_NO_JUMP
+        || !gen_expr (fs, node->rhs, target)
+        || !jump_patch_here (fs, skip)
+        || !emit_move (fs, dst, target)) {
+        return false;
+    }
+
+    fs->free_reg = top;
+
+    return true;
+}
+
+
+static bool
+gen_binary (fn_state_t *fs, clv_node_t *node, uint32_t dst) {
+    if (node->op == CLV_TOKEN_AND || node->op == CLV_TOKEN_OR) {
+        return gen_logical (fs, node, dst);
+    }
+
+    uint32_t top = fs->free_reg;
+    clv_opcode_t op = binary_opcodes[node->op];
+    uint32_t b, c;
+    int64_t imm;
+
+    // x + n and x - n, with a small n
+    if ((op == CLV_OP_ADD || op == CLV_OP_SUB) && literal_int (fs->cg, node->rhs, &imm)) {
+        imm = (op == CLV_OP_SUB) ? -imm : imm;
+
+        if (imm >= CLV_INSN_MIN_SC && imm <= CLV_INSN_MAX_SC) {
+            if (!gen_operand (fs, node->lhs, &b) || !emit_abc (fs, CLV_OP_ADDI, dst, b, (int8_t)imm)) {
+                return false;
+            }
+
+            fs->free_reg = top;
+            return true;
+        }
+    }
+
+    if (!gen_operand (fs, node->lhs, &b) || !gen_operand (fs, node->rhs, &c)) {
+        return false;
+    }
+
+    if (node->op == CLV_TOKEN_GT || node->op == CLV_TOKEN_GE) {
+        uint32_t temp = b;
+
+        b = c;
+        c = temp;
+    }
+
+    fs->free_reg = top;
+
+    return emit_abc (fs, op, dst, b, c);
+}
+
+
+static bool
+gen_unary (fn_state_t *fs, clv_node_t *node, uint32_t dst) {
+    uint32_t top = fs->free_reg;
+    int64_t value;
+    uint32_t b;
+
+    if (node->op == CLV_TOKEN_MINUS && literal_int (fs->cg, node->lhs, &value)) {
+        return emit_int (fs, dst, -value);
+    }
+
+    if (!gen_operand (fs, node->lhs, &b)) {
+        return false;
+    }
+
+    fs->free_reg = top;
+
+    return emit_abc (fs, unary_opcodes[node->op], dst, b, 0);
+}
+
+
+static bool
+gen_cast (fn_state_t *fs, clv_node_t *node, uint32_t dst) {
+    codegen_t *cg = fs->cg;
+    clv_node_t *type = node_at (cg, node->rhs);
+    uint32_t top = fs->free_reg;
+    uint32_t b;
+
+    for (size_t i = 0; type->kind == CLV_NODE_NAME && i < CLV_LENGTH (cast_types); i++) {
+        if (!token_equal (cg, type->token, cast_types[i].name)) {
+            continue;
+        }
+
+        if (!gen_operand (fs, node->lhs, &b)) {
+            return false;
+        }
+
+        fs->free_reg = top;
+
+        return emit_abc (fs, CLV_OP_CAST, dst, b, cast_types[i].type);
+    }
+
+    gen_error (cg, type->token, "only casts to bool, int, float, char and string are supported");
+
+    return false;
+}
+
+
+static bool
+gen_call (fn_state_t *fs, clv_node_t *node, uint32_t dst) {
+    uint32_t top = fs->free_reg;
+    uint32_t base;
+    uint32_t count;
+
+    const uint32_t *args = clv_ast_extra_list (fs->cg->ast, node->rhs, &count);
+
+    // a temporary on top of the stack can hold the callee
+    if (dst + 1 == fs->free_reg && dst >= locals_end (fs)) {
+        base = dst;
+    } else if (!reg_alloc (fs, &base)) {
+        return false;
+    }
+
+    if (count > CLV_INSN_MAX_REG) {
+        gen_error (fs->cg, node->token, "too many arguments");
+        return false;
+    }
+
+    if (!gen_expr (fs, node->lhs, base)) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t arg;
+
+        if (!reg_alloc (fs, &arg) || !gen_expr (fs, args[i], arg)) {
+            return false;
+        }
+    }
+
+    fs->token = node->token;
+
+    if (!emit_abc (fs, CLV_OP_CALL, base, count, 0) || !emit_move (fs, dst, base)) {
+        return false;
+    }
+
+    fs->free_reg = top;
+
+    return true;
+}
+
+
+static bool
+gen_expr_inner (fn_state_t *fs, clv_node_t *node, clv_node_id_t id, uint32_t dst) {
+    uint32_t top = fs->free_reg;
+    ref_t ref;
+    uint32_t b;
+
+    switch (node->kind) {
+    case CLV_NODE_LITERAL:
+        return gen_literal (fs, node, dst);
+
+    case CLV_NODE_NAME:
+    case CLV_NODE_MEMBER:
+        return resolve (fs, id, &ref) && gen_ref (fs, &ref, dst);
+
+    case CLV_NODE_BINARY:
+        return gen_binary (fs, node, dst);
+
+    case CLV_NODE_UNARY:
+        return gen_unary (fs, node, dst);
+
+    case CLV_NODE_CAST:
+        return gen_cast (fs, node, dst);
+
+    case CLV_NODE_CALL:
+        return gen_call (fs, node, dst);
+
+    case CLV_NODE_TYPEOF:
+    case CLV_NODE_UNWRAP:
+        if (!gen_operand (fs, node->lhs, &b)) {
+            return false;
+        }
+
+        fs->free_reg = top;
+
+        return emit_abc (fs, (node->kind == CLV_NODE_TYPEOF) ? CLV_OP_TYPEOF : CLV_OP_UNWRAP, dst, b, 0);
+
+    case CLV_NODE_TRY:
+        gen_error (fs->cg, node->token, "'try' is not supported yet");
+        return false;
+
+    case CLV_NODE_INDEX:
+    case CLV_NODE_ARRAY:
+        gen_error (fs->cg, node->token, "arrays are not supported yet");
+        return false;
+
+    case CLV_NODE_INIT:
+        gen_error (fs->cg, node->token, "structs are not supported yet");
+        return false;
+
+    default:
+        gen_error (fs->cg, node->token, "expected an expression");
+        return false;
+    }
+}
+
+
+/* Evaluates an expression into `dst`, which is only written once the
+ * operands have been read */
+static bool
+gen_expr (fn_state_t *fs, clv_node_id_t id, uint32_t dst) {
+    clv_node_t *node = node_at (fs->cg, id);
+    uint32_t token = fs->token;
+
+    fs->token = node->token;
+    bool good = gen_expr_inner (fs, node, id, dst);
+    fs->token = token;
+
+    return good;
+}
+
+
+/* == Statements == */
+
+
+static bool gen_block (fn_state_t *fs, clv_node_t *node);
+
+
+/* Emits a jump taken when `id` is false, and returns a list of it */
+static uint32_t
+gen_condition (fn_state_t *fs, clv_node_id_t id, bool jump_if) {
+    uint32_t top = fs->free_reg;
+    uint32_t reg;
+
+    if (!gen_operand (fs, id, &reg)) {
+        return CODEGEN_NO_JUMP;
+    }
+
+    fs->free_reg = top;
+
+    return jump_emit (fs, jump_if ? CLV_OP_JMPT : CLV_OP_JMPF, reg);
+}
+
+
+static bool
+gen_let (fn_state_t *fs, clv_node_t *node) {
+    uint32_t reg;
+
+    // the value can't see the variable itself
+    if (!reg_alloc (fs, &reg)
+        || (node->rhs != CLV_NODE_NONE && !gen_expr (fs, node->rhs, reg))
+        || (node->rhs == CLV_NODE_NONE && !emit_abc (fs, CLV_OP_LOADNIL, reg, 0, 0))) {
+        return false;
+    }
+
+    return local_declare (fs, node->token, reg, (node->flags & CLV_NODE_F_CONST) != 0);
+}
+
+
+static bool
+gen_assign (fn_state_t *fs, clv_node_t *node) {
+    codegen_t *cg = fs->cg;
+    clv_node_t *target = node_at (cg, node->lhs);
+    uint32_t top = fs->free_reg;
+    ref_t ref;
+    uint32_t reg;
+
+    if (target->kind != CLV_NODE_NAME) {
+        gen_error (cg, target->token, "only variables can be assigned to");
+        return false;
+    }
+
+    if (!resolve (fs, node->lhs, &ref)) {
+        return false;
+    }
+
+    if (ref.kind == REF_CONST || ref.is_const) {
+        gen_error (cg, target->token, "cannot assign to constant '%.*s'", (int)cg->tokens[target->token].length,
+                   token_text (cg, target->token));
+        return false;
+    }
+
+    if (ref.kind == REF_LOCAL) {
+        return gen_expr (fs, node->rhs, ref.index);
+    }
+
+    if (!gen_operand (fs, node->rhs, &reg)) {
+        return false;
+    }
+
+    fs->free_reg = top;
+
+    return emit_abx (fs, CLV_OP_SETGLOBAL, reg, ref.index);
+}
+
+
+static bool
+gen_if (fn_state_t *fs, clv_node_t *node) {
+    const uint32_t *branches = clv_ast_extra (fs->cg->ast, node->rhs);
+    uint32_t skip_then = gen_condition (fs, node->lhs, false);
+
+    if (skip_then == CODEGEN_NO_JUMP || !gen_statement (fs, branches[0])) {
+        return false;
+    }
+
+    if (branches[1] == CLV_NODE_NONE) {
+        return jump_patch_here (fs, skip_then);
+    }
+
+    uint32_t skip_else = jump_emit (fs, CLV_OP_JMP, 0);
+
+    return skip_else != CODEGEN_NO_JUMP && jump_patch_here (fs, skip_then)
+        && gen_statement (fs, branches[1]) && jump_patch_here (fs, skip_else);
+}
+
+
+static void
+loop_enter (fn_state_t *fs, loop_t *loop) {
+    *loop = (loop_t){
+        .outer = fs->loop,
+        .breaks = CODEGEN_NO_JUMP,
+        .continues = CODEGEN_NO_JUMP,
+        .defers = fs->defer_count,
+        .in_defer = fs->in_defer
+    };
+
+    fs->loop = loop;
+}
+
+
+/* Conditions go after the body, so each iteration takes one jump */
+static bool
+gen_while (fn_state_t *fs, clv_node_t *node) {
+    loop_t loop;
+    uint32_t enter = jump_emit (fs, CLV_OP_JMP, 0);
+    uint32_t body = fs->length;
+
+    loop_enter (fs, &loop);
+
+    bool good = enter != CODEGEN_NO_JUMP && gen_statement (fs, node->rhs);
+
+    fs->loop = loop.outer;
+
+    if (!good || !jump_patch_here (fs, enter) || !jump_patch_here (fs, loop.continues)) {
+        return false;
+    }
+
+    uint32_t again = gen_condition (fs, node->lhs, true);
+
+    return again != CODEGEN_NO_JUMP && jump_patch (fs, again, body) && jump_patch_here (fs, loop.breaks);
+}
+
+
+/* The iterable, its position and the variable take three registers */
+static bool
+gen_for (fn_state_t *fs, clv_node_t *node) {
+    scope_t scope;
+    loop_t loop;
+    uint32_t iter, index, var;
+
+    scope_enter (fs, &scope);
+
+    if (!reg_alloc (fs, &iter) || !gen_expr (fs, node->lhs, iter)
+        || !local_declare (fs, UINT32_MAX, iter, true)
+        || !reg_alloc (fs, &index) || !local_declare (fs, UINT32_MAX, index, true)
+        || !reg_alloc (fs, &var)) {
+        return false;
+    }
+
+    uint32_t prep = jump_emit (fs, CLV_OP_FORPREP, iter);
+    uint32_t body = fs->length;
+
+    if (prep == CODEGEN_NO_JUMP || !local_declare (fs, node->token, var, false)) {
+        return false;
+    }
+
+    loop_enter (fs, &loop);
+
+    bool good = gen_statement (fs, node->rhs);
+
+    fs->loop = loop.outer;
+
+    if (!good || !jump_patch_here (fs, prep) || !jump_patch_here (fs, loop.continues)) {
+        return false;
+    }
+
+    uint32_t again = jump_emit (fs, CLV_OP_FORLOOP, iter);
+
+    return again != CODEGEN_NO_JUMP && jump_patch (fs, again, body)
+        && jump_patch_here (fs, loop.breaks) && scope_leave (fs, &scope);
+}
+
+
+/* Arms compare the value to their patterns in order */
+static bool
+gen_match (fn_state_t *fs, clv_node_t *node) {
+    codegen_t *cg = fs->cg;
+    uint32_t top = fs->free_reg;
+    uint32_t done = CODEGEN_NO_JUMP;
+    uint32_t value, test, count;
+
+    if (!gen_operand (fs, node->lhs, &value) || !reg_alloc (fs, &test)) {
+        return false;
+    }
+
+    const uint32_t *arms = clv_ast_extra_list (cg->ast, node->rhs, &count);
+
+    for (uint32_t i = 0; i < count; i++) {
+        clv_node_t *arm = node_at (cg, arms[i]);
+        uint32_t taken = CODEGEN_NO_JUMP;
+        uint32_t skip = CODEGEN_NO_JUMP;
+        uint32_t pattern_count;
+
+        const uint32_t *patterns = clv_ast_extra_list (cg->ast, arm->lhs, &pattern_count);
+
+        for (uint32_t j = 0; j < pattern_count; j++) {
+            uint32_t arm_top = fs->free_reg;
+            uint32_t pattern;
+
+            if (!gen_operand (fs, patterns[j], &pattern) || !emit_abc (fs, CLV_OP_EQ, test, value, pattern)) {
+                return false;
+            }
+
+            fs->free_reg = arm_top;
+
+            if (!jump_concat (fs, &taken, jump_emit (fs, CLV_OP_JMPT, test))) {
+                return false;
+            }
+        }
+
+        // arms without patterns are the else arm
+        if (pattern_count > 0 && (skip = jump_emit (fs, CLV_OP_JMP, 0)) == CODEGEN_NO_JUMP) {
+            return false;
+        }
+
+        if (!jump_patch_here (fs, taken)) {
+            return false;
+        }
+
+        clv_node_t *body = node_at (cg, arm->rhs);
+        uint32_t reg;
+
+        if (body->kind == CLV_NODE_BLOCK) {
+            if (!gen_block (fs, body)) {
+                return false;
+            }
+        } else if (!gen_operand (fs, arm->rhs, &reg)) {
+            return false;
+        }
+
+        fs->free_reg = test + 1;
+
+        if (!jump_concat (fs, &done, jump_emit (fs, CLV_OP_JMP, 0)) || !jump_patch_here (fs, skip)) {
+            return false;
+        }
+    }
+
+    fs->free_reg = top;
+
+    return jump_patch_here (fs, done);
+}
+
+
+static bool
+gen_return (fn_state_t *fs, clv_node_t *node) {
+    uint32_t top = fs->free_reg;
+    uint32_t reg = 0;
+
+    if (fs->in_defer > 0) {
+        gen_error (fs->cg, node->token, "cannot return from a deferred statement");
+        return false;
+    }
+
+    if (node->lhs != CLV_NODE_NONE) {
+        // deferred statements may change the variable returned
+        bool copy = fs->defer_count > 0;
+
+        if (!(copy ? (reg_alloc (fs, &reg) && gen_expr (fs, node->lhs, reg)) : gen_operand (fs, node->lhs, &reg))) {
+            return false;
+        }
+    }
+
+    if (!gen_defers (fs, 0)) {
+        return false;
+    }
+
+    fs->free_reg = top;
+
+    return emit_abc (fs, CLV_OP_RET, reg, node->lhs != CLV_NODE_NONE, 0);
+}
+
+
+static bool
+gen_jump_out (fn_state_t *fs, clv_node_t *node) {
+    loop_t *loop = fs->loop;
+    bool is_break = (node->kind == CLV_NODE_BREAK);
+
+    if (loop == NULL || loop->in_defer != fs->in_defer) {
+        gen_error (fs->cg, node->token, "'%s' outside of a loop", is_break ? "break" : "continue");
+        return false;
+    }
+
+    if (!gen_defers (fs, loop->defers)) {
+        return false;
+    }
+
+    return jump_concat (fs, is_break ? &loop->breaks : &loop->continues, jump_emit (fs, CLV_OP_JMP, 0));
+}
+
+
+static bool
+gen_block (fn_state_t *fs, clv_node_t *node) {
+    const uint32_t *stmts = clv_ast_extra (fs->cg->ast, node->lhs);
+    scope_t scope;
+
+    scope_enter (fs, &scope);
+
+    for (uint32_t i = 0; i < node->rhs; i++) {
+        if (!gen_statement (fs, stmts[i])) {
+            return false;
+        }
+    }
+
+    return scope_leave (fs, &scope);
+}
+
+
+static bool
+gen_statement_inner (fn_state_t *fs, clv_node_t *node) {
+    uint32_t top = fs->free_reg;
+    uint32_t reg;
+
+    switch (node->kind) {
+    case CLV_NODE_BLOCK:
+        return gen_block (fs, node);
+
+    case CLV_NODE_LET:
+        return gen_let (fs, node);
+
+    case CLV_NODE_ASSIGN:
+        return gen_assign (fs, node);
+
+    case CLV_NODE_IF:
+        return gen_if (fs, node);
+
+    case CLV_NODE_WHILE:
+        return gen_while (fs, node);
+
+    case CLV_NODE_FOR:
+        return gen_for (fs, node);
+
+    case CLV_NODE_MATCH:
+        return gen_match (fs, node);
+
+    case CLV_NODE_RETURN:
+        return gen_return (fs, node);
+
+    case CLV_NODE_BREAK:
+    case CLV_NODE_CONTINUE:
+        return gen_jump_out (fs, node);
+
+    case CLV_NODE_DEFER:
+        if (fs->defer_count == CODEGEN_MAX_DEFERS) {
+            gen_error (fs->cg, node->token, "too many deferred statements (maximum is %d)", CODEGEN_MAX_DEFERS);
+            return false;
+        }
+
+        fs->defers[fs->defer_count++] = (defer_t){ .stmt = node->lhs, .locals = fs->local_count };
+        return true;
+
+    case CLV_NODE_EXPR:
+        if (!gen_operand (fs, node->lhs, &reg)) {
+            return false;
+        }
+
+        fs->free_reg = top;
+        return true;
+
+    default:
+        gen_error (fs->cg, node->token, "expected a statement");
+        return false;
+    }
+}
+
+
+static bool
+gen_statement (fn_state_t *fs, clv_node_id_t id) {
+    clv_node_t *node = node_at (fs->cg, id);
+    uint32_t token = fs->token;
+
+    fs->token = node->token;
+    bool good = gen_statement_inner (fs, node);
+    fs->token = token;
+
+    return good;
+}
+
+
+/* == Functions == */
+
+
+/* Moves the code of `fs` to function `index` of the module */
+static bool
+fn_finish (fn_state_t *fs, uint32_t index) {
+    codegen_t *cg = fs->cg;
+    clv_function_t *fn = clv_module_function (cg->module, index);
+
+    clv_insn_t *code = clv_arena_alloc (cg->arena, fs->length * sizeof (*code));
+    uint32_t *lines = clv_arena_alloc (cg->arena, fs->length * sizeof (*lines));
+    clv_const_t *constants = NULL;
+
+    if (fs->constant_count > 0) {
+        constants = clv_arena_alloc (cg->arena, fs->constant_count * sizeof (*constants));
+    }
+
+    if (code == NULL || lines == NULL || (constants == NULL && fs->constant_count > 0)) {
+        gen_error (cg, fs->token, "unable to allocate function: %s", strerror (errno));
+        return false;
+    }
+
+    memcpy (code, fs->code, fs->length * sizeof (*code));
+    memcpy (lines, fs->lines, fs->length * sizeof (*lines));
+
+    if (fs->constant_count > 0) {
+        memcpy (constants, fs->constants, fs->constant_count * sizeof (*constants));
+    }
+
+    fn->code = code;
+    fn->lines = lines;
+    fn->code_length = fs->length;
+    fn->constants = constants;
+    fn->constant_count = fs->constant_count;
+    fn->registers = fs->max_reg;
+
+    return true;
+}
+
+
+static void
+fn_free (fn_state_t *fs) {
+    clv_free (fs->code);
+    clv_free (fs->lines);
+    clv_free (fs->constants);
+}
+
+
+static bool
+gen_fn (codegen_t *cg, clv_node_t *node, uint32_t index) {
+    fn_state_t *fs = clv_calloc (CLV_TAG_BYTECODE, 1, sizeof (*fs));
+
+    if (fs == NULL) {
+        gen_error (cg, node->token, "unable to compile function: %s", strerror (errno));
+        return false;
+    }
+
+    fs->cg = cg;
+    fs->token = node->token;
+
+    uint32_t count;
+    const uint32_t *params = clv_ast_extra_list (cg->ast, node->lhs + CLV_SIG_PARAMS, &count);
+    bool good = true;
+
+    for (uint32_t i = 0; good && i < count; i++) {
+        uint32_t reg;
+
+        good = reg_alloc (fs, &reg) && local_declare (fs, node_at (cg, params[i])->token, reg, false);
+    }
+
+    good = good && gen_block (fs, node_at (cg, node->rhs));
+
+    // falling off the end returns nil
+    good = good && emit_abc (fs, CLV_OP_RET, 0, 0, 0) && fn_finish (fs, index);
+
+    if (good) {
+        clv_module_function (cg->module, index)->arity = count;
+    }
+
+    fn_free (fs);
+    clv_free (fs);
+
+    return good;
+}
+
+
+/* Function 0 evaluates the initializers of globals, in order */
+static bool
+gen_globals (codegen_t *cg, const uint32_t *items, uint32_t count) {
+    fn_state_t *fs = clv_calloc (CLV_TAG_BYTECODE, 1, sizeof (*fs));
+    bool good = true;
+
+    if (fs == NULL) {
+        gen_error (cg, 0, "unable to compile globals: %s", strerror (errno));
+        return false;
+    }
+
+    fs->cg = cg;
+
+    for (uint32_t i = 0; good && i < count; i++) {
+        clv_node_t *node = node_at (cg, items[i]);
+
+        if (node->kind != CLV_NODE_GLOBAL) {
+            continue;
+        }
+
+        symbol_t *symbol = symbol_find (cg, cg->tokens[node->token].atom);
+
+        fs->token = node->token;
+        fs->free_reg = 0;
+
+        good = gen_expr (fs, node->rhs, 0) && emit_abx (fs, CLV_OP_SETGLOBAL, 0, symbol->value);
+    }
+
+    good = good && emit_abc (fs, CLV_OP_RET, 0, 0, 0) && fn_finish (fs, 0);
+
+    fn_free (fs);
+    clv_free (fs);
+
+    return good;
+}
+
+
+/* == Items == */
+
+
+static symbol_t *
+define_fn (codegen_t *cg, clv_node_t *node) {
+    const char *name = token_text (cg, node->token);
+    uint32_t length = cg->tokens[node->token].length;
+
+    // methods are named Type.name
+    if (node->flags & CLV_NODE_F_METHOD) {
+        uint32_t type = node->token - 2;
+        uint32_t type_length = cg->tokens[type].length;
+        char *qualified = clv_arena_alloc (cg->arena, type_length + 1 + length + 1);
+
+        if (qualified == NULL) {
+            gen_error (cg, node->token, "unable to define function: %s", strerror (errno));
+            return NULL;
+        }
+
+        memcpy (qualified, token_text (cg, type), type_length);
+        qualified[type_length] = '.';
+        memcpy (qualified + type_length + 1, name, length);
+        qualified[type_length + 1 + length] = '\0';
+
+        name = qualified;
+        length += type_length + 1;
+    } else if ((name = clv_arena_strndup (cg->arena, name, length)) == NULL) {
+        gen_error (cg, node->token, "unable to define function: %s", strerror (errno));
+        return NULL;
+    }
+
+    symbol_t *symbol = symbol_add (cg, node->token, name, length, SYM_FN);
+
+    if (symbol == NULL) {
+        return NULL;
+    }
+
+    clv_function_t fn = { .name = name };
+
+    if ((symbol->value = clv_module_add_function (cg->module, &fn)) == UINT32_MAX) {
+        gen_error (cg, node->token, "unable to define function: %s", strerror (errno));
+        return NULL;
+    }
+
+    return symbol;
+}
+
+
+/* Variants are integers, counting up from the previous one */
+static bool
+define_enum (codegen_t *cg, clv_node_t *node) {
+    const char *name = token_text (cg, node->token);
+    uint32_t length = cg->tokens[node->token].length;
+    const uint32_t *variants = clv_ast_extra (cg->ast, node->lhs);
+    int64_t value = 0;
+
+    if (symbol_add (cg, node->token, name, length, SYM_TYPE) == NULL) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < node->rhs; i++) {
+        clv_node_t *variant = node_at (cg, variants[i]);
+        uint32_t variant_length = cg->tokens[variant->token].length;
+
+        if (variant->lhs != CLV_NODE_NONE) {
+            clv_node_t *init = node_at (cg, variant->lhs);
+            bool negative = (init->kind == CLV_NODE_UNARY && init->op == CLV_TOKEN_MINUS);
+
+            if (negative) {
+                init = node_at (cg, init->lhs);
+            }
+
+            if (init->kind != CLV_NODE_LITERAL || cg->tokens[init->token].type < CLV_TOKEN_INT
+                || cg->tokens[init->token].type > CLV_TOKEN_HEX) {
+                gen_error (cg, init->token, "values of variants must be integer literals");
+                return false;
+            }
+
+            if (!parse_int (cg, init->token, &value)) {
+                return false;
+            }
+
+            value = negative ? (int64_t)(0 - (uint64_t)value) : value;
+        }
+
+        char *qualified = clv_arena_alloc (cg->arena, length + 1 + variant_length);
+
+        if (qualified == NULL) {
+            gen_error (cg, variant->token, "unable to define variant: %s", strerror (errno));
+            return false;
+        }
+
+        memcpy (qualified, name, length);
+        qualified[length] = '.';
+        memcpy (qualified + length + 1, token_text (cg, variant->token), variant_length);
+
+        symbol_t *symbol = symbol_add (cg, variant->token, qualified, length + 1 + variant_length, SYM_VARIANT);
+
+        if (symbol == NULL) {
+            return false;
+        }
+
+        symbol->value = value++;
+    }
+
+    return true;
+}
+
+
+static bool
+define_item (codegen_t *cg, clv_node_t *node) {
+    const char *name = token_text (cg, node->token);
+    uint32_t length = cg->tokens[node->token].length;
+    symbol_t *symbol;
+
+    switch (node->kind) {
+    case CLV_NODE_IMPORT: {
+        clv_node_t *path = clv_ast_import_path (cg->ast, node);
+
+        name = token_text (cg, path->token);
+        length = cg->tokens[path->token].length;
+
+        if ((symbol = symbol_add (cg, path->token, name, length, SYM_MODULE)) == NULL) {
+            return false;
+        }
+
+        // anything but a native module was found when loading the build
+        if (path->kind == CLV_NODE_NAME && clv_native_module_find (name, length)) {
+            return true;
+        }
+
+        char *import = clv_arena_strndup (cg->arena, name, length);
+        uint32_t index;
+
+        if (import == NULL || (index = clv_module_add_import (cg->module, import)) == UINT32_MAX) {
+            gen_error (cg, path->token, "unable to import module: %s", strerror (errno));
+            return false;
+        }
+
+        symbol->value = index + 1;
+        return true;
+    }
+
+    case CLV_NODE_FN:
+        return define_fn (cg, node) != NULL;
+
+    case CLV_NODE_GLOBAL: {
+        char *global = clv_arena_strndup (cg->arena, name, length);
+        uint32_t index;
+
+        if (global == NULL || (index = clv_module_add_global (cg->module, global)) == UINT32_MAX) {
+            gen_error (cg, node->token, "unable to define global: %s", strerror (errno));
+            return false;
+        }
+
+        if ((symbol = symbol_add (cg, node->token, global, length, SYM_GLOBAL)) == NULL) {
+            return false;
+        }
+
+        symbol->value = index;
+        symbol->is_const = (node->flags & CLV_NODE_F_CONST) != 0;
+        return true;
+    }
+
+    case CLV_NODE_ENUM:
+        return define_enum (cg, node);
+
+    default:
+        // structs, traits and type aliases only name types for now
+        return symbol_add (cg, node->token, name, length, SYM_TYPE) != NULL;
+    }
+}
+
+
+bool
+clv_codegen (clv_source_t *src, clv_tokens_t *tokens, clv_ast_t *ast, clv_module_t **out_module) {
+    clv_module_t *module = clv_module_new (clv_source_get_file (src));
+
+    if (module == NULL) {
+        clv_error ("unable to create module: %s", strerror (errno));
+        return false;
+    }
+
+    codegen_t cg = {
+        .src = src,
+        .ast = ast,
+        .tokens = clv_tokens_data (tokens),
+        .module = module,
+        .arena = clv_module_arena (module),
+        .line_token = UINT32_MAX
+    };
+
+    clv_node_t *root = clv_ast_node (ast, clv_ast_get_root (ast));
+    const uint32_t *items = clv_ast_extra (ast, root->lhs);
+    clv_function_t init = { .name = CODEGEN_INIT_NAME };
+
+    if (clv_module_add_function (module, &init) == UINT32_MAX || !symbol_rehash (&cg, CODEGEN_MIN_CAPACITY)) {
+        clv_error ("unable to create module: %s", strerror (errno));
+        clv_module_free (module);
+        return false;
+    }
+
+    // items may be used before they are defined
+    for (uint32_t i = 0; i < root->rhs; i++) {
+        define_item (&cg, node_at (&cg, items[i]));
+    }
+
+    if (!cg.error) {
+        gen_globals (&cg, items, root->rhs);
+
+        for (uint32_t i = 0; i < root->rhs; i++) {
+            clv_node_t *node = node_at (&cg, items[i]);
+
+            if (node->kind != CLV_NODE_FN) {
+                continue;
+            }
+
+            symbol_t *symbol = &cg.symbols[0];
+
+            // the symbol was the first one named after this token
+            for (uint32_t j = 0; j < cg.symbol_count; j++) {
+                if (cg.symbols[j].token == node->token && cg.symbols[j].kind == SYM_FN) {
+                    symbol = &cg.symbols[j];
+                    break;
+                }
+            }
+
+            gen_fn (&cg, node, symbol->value);
+        }
+    }
+
+    clv_free (cg.symbols);
+    clv_free (cg.table);
+
+    if (cg.error) {
+        clv_module_free (module);
+        return false;
+    }
+
+    *out_module = module;
+
+    return true;
+}
@@ -2,97 +2,758 @@
 #include <clover/source.h>
 #include <clover/assert.h>
 #include <clover/log.h>
+#include <clover/timer.h>
 
-#include <clover/lexer.h>
+#include <clover/loader.h>
+#include <clover/sema.h>
+#include <clover/codegen.h>
+#include <clover/optimize.h>
+#include <clover/ssa.h>
+#include <clover/native.h>
+#include <clover/elf.h>
+#include <clover/vm.h>
+#include <clover/pool.h>
+#include <clover/cpu.h>
+#include <clover/cache.h>
+#include <clover/interface.h>
+#include <clover/hash.h>
+#include <clover/alloc.h>
+
+#include <version.h>
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
 
+#define CLV_DEFAULT_OUTPUT  "a.out"
+
+
+typedef struct build build_t;
+
+typedef struct {
+    build_t *build;
+    uint32_t unit;
+
+    clv_str obj_file;
+    bool success;
+    bool cached;            /* its object is up to date, nothing to generate */
+    bool declared;
+    uint64_t key;
+
+    clv_module_t *module;   /* kept for linking */
+
+    /* machine code, when building executables */
+    char *prefix;           /* of its symbols: the base name of its file */
+    void *object;
+    size_t object_length;
+    bool has_main;
+
+    /* diagnostics, captured so units don't interleave */
+    FILE *out_stream;
+    FILE *err_stream;
+    char *out;
+    size_t out_length;
+    char *err;
+    size_t err_length;
+} compile_job_t;
+
+
+/* Units of a build, each a job */
+struct build {
+    clv_loader_t *loader;
+    clv_sema_t *sema;
+
+    compile_job_t *jobs;
+    uint32_t count;
+
+    clv_cache_t *cache;     /* or NULL */
+    uint64_t seed;          /* of cache keys */
+    bool link;              /* whether to keep modules */
+    bool native;            /* whether to compile units to objects */
+    bool debug;             /* of objects */
+};
+
+
+/* Hashed along with each source into its cache key: whatever else
+ * changes what a unit compiles to */
+static uint64_t
+cache_seed (const clv_compile_opts_t *opts) {
+    static const char build[] = CLOVER_VERSION "\n" CLOVER_BUILDINFO "\n";
+
+    return clv_hash64 (build, sizeof (build) - 1, opts->debug);
+}
+
+
+/* Objects are cached apart from the modules they are compiled from, and
+ * per prefix, which their symbols are named after: copies of a file under
+ * another name share the module, not the object */
+static inline uint64_t
+object_key (const compile_job_t *job) {
+    uint64_t seed = clv_hash64 (job->prefix, strlen (job->prefix), 0x6f626a656374ull);
+
+    return clv_hash64 (&job->key, sizeof (job->key), seed);
+}
+
+
+/* Whether the cache has a usable artifact for the unit of `job`, and its
+ * object when building executables */
+static bool
+unit_cached (build_t *b, compile_job_t *job, clv_str file) {
+    void *data;
+    size_t length;
+
+    if (!clv_cache_get (b->cache, job->key, &data, &length)) {
+        return false;
+    }
+
+    clv_module_t *module = clv_module_load (file, data, length);
+
+    clv_free (data);
+
+    if (module == NULL) {
+        return false;
+    }
+
+    job->has_main = clv_module_find_function (module, "main") >= 0;
+    clv_module_free (module);
+
+    if (b->native && !clv_cache_get (b->cache, object_key (job), &job->object, &job->object_length)) {
+        return false;
+    }
 
+    clv_debug ("cache: %s is up to date", file);
+
+    return (job->obj_file = clv_cache_path (b->cache, job->key)) != NULL;
+}
+
+
+/* Failing to cache isn't an error, the unit is just compiled again */
 static void
-dump_tokens (clv_source_t *source, clv_list_t *tokens) {
-    clv_list_iter_t iter = clv_list_get_head (tokens);
+unit_store (clv_cache_t *cache, uint64_t key, clv_module_t *module, clv_str file, clv_str *out_objfile) {
+    void *data;
+    size_t length;
 
-    for (; iter != NULL; iter = clv_list_iter_get_next (iter)) {
-        clv_token_t *token = clv_list_iter_get_data (iter);
+    if (!clv_module_save (module, &data, &length)) {
+        clv_warning ("unable to cache %s: %s", file, strerror (errno));
+        return;
+    }
 
-        printf ("[%-18p]  prev: %-18p  next: %-18p  ", iter,
-                clv_list_iter_get_prev (iter),
-                clv_list_iter_get_next (iter));
-        fflush (stdout);
-        fwrite (clv_source_offset (source, token->offset), 1, token->length, stdout);
-        putc ('\n', stdout);
+    if (clv_cache_put (cache, key, data, length)) {
+        *out_objfile = clv_cache_path (cache, key);
+    } else {
+        clv_warning ("unable to cache %s: %s", file, strerror (errno));
     }
+
+    clv_free (data);
 }
 
 
+/* Failing to cache isn't an error, importers just parse the unit again */
+static void
+interface_store (build_t *b, uint32_t unit) {
+    clv_unit_t *u = clv_loader_unit (b->loader, unit);
+    clv_export_t *exports;
+    uint32_t count = clv_sema_exports (b->sema, unit, &exports);
+    void *data;
+    size_t length;
+
+    if (count == UINT32_MAX
+        || !clv_interface_save (u->hash, u->import_paths, u->import_count, exports, count, &data, &length)) {
+        clv_warning ("unable to cache the interface of %s: %s", u->file, strerror (errno));
+        clv_free (exports);
+        return;
+    }
+
+    if (!clv_cache_put (b->cache, clv_interface_key (u->hash), data, length)) {
+        clv_warning ("unable to cache the interface of %s: %s", u->file, strerror (errno));
+    }
+
+    clv_free (data);
+    clv_free (exports);
+}
+
+
+/* Collects the declarations of `unit`, whose imports are declared. Keys
+ * cover the keys of imports, so importers compile again along with them. */
 static bool
-compile_unit (clv_str file, clv_str *out_objfile) {
-    clv_assert (file != NULL, return false);
-    clv_assert (out_objfile != NULL, return false);
+unit_declare (build_t *b, uint32_t unit) {
+    compile_job_t *job = &b->jobs[unit];
+    clv_unit_t *u = clv_loader_unit (b->loader, unit);
+
+    job->key = u->hash;
+
+    for (uint32_t i = 0; i < u->import_count; i++) {
+        if (u->imports[i] != UINT32_MAX) {
+            job->key = clv_hash64 (&b->jobs[u->imports[i]].key, sizeof (job->key), job->key);
+        }
+    }
+
+    // importers still need the declarations of units up to date
+    if (b->cache != NULL) {
+        clv_timer_begin (CLV_PHASE_CACHE, u->file);
+        job->cached = unit_cached (b, job, u->file);
+        clv_timer_end ();
+    }
+
+    if (!job->cached) {
+        clv_free (job->object);
+        job->object = NULL;
+    }
+
+    // units loaded from their interface still compile when an import changed
+    if (!job->cached && u->ast == NULL && !clv_loader_parse (b->loader, unit)) {
+        return false;
+    }
+
+    job->declared = true;
+
+    clv_timer_begin (CLV_PHASE_DECLARE, u->file);
+    bool good = (u->ast == NULL) ? clv_sema_declare_interface (b->sema, unit, u->iface)
+              : clv_sema_declare (b->sema, unit, u->src, u->tokens, u->ast, u->imports);
+    clv_timer_end ();
+
+    if (!good || u->ast == NULL) {
+        return good;
+    }
+
+    if (job->cached) {
+        clv_sema_skip (b->sema, unit);
+    }
+
+    return true;
+}
+
 
-    clv_source_t *src = clv_source_new (file);
+/* Compiles the module of `job` to machine code, its imports prefixed as
+ * the units they are */
+static bool
+unit_native (compile_job_t *job) {
+    build_t *b = job->build;
+    clv_unit_t *u = clv_loader_unit (b->loader, job->unit);
+    clv_str *imports = clv_alloc (CLV_TAG_BUILD, (u->import_count + 1) * sizeof (*imports));
+    uint32_t count = 0;
 
-    if (src == NULL) {
-        clv_error ("%s: %s", strerror (errno), file);
+    if (imports == NULL) {
+        clv_error ("unable to compile %s: %s", u->file, strerror (errno));
         return false;
     }
 
-    clv_list_t *tokens;
-    bool result = true;
+    // native modules aren't imports of the module
+    for (uint32_t i = 0; i < u->import_count; i++) {
+        if (u->imports[i] != UINT32_MAX) {
+            imports[count++] = b->jobs[u->imports[i]].prefix;
+        }
+    }
+
+    clv_native_opts_t opts = { .prefix = job->prefix, .imports = imports, .debug = b->debug };
+    bool good = clv_native_compile (job->module, &opts, &job->object, &job->object_length);
+
+    if (!good && errno != EINVAL) {
+        clv_error ("unable to compile %s: %s", u->file, strerror (errno));
+    }
+
+    clv_free (imports);
 
-    if (!clv_lex (src, &tokens)) {
-        result = false;
+    return good;
+}
+
+
+/* Generates the code of a checked unit, and releases its front end */
+static void
+unit_finish (compile_job_t *job) {
+    build_t *b = job->build;
+    clv_unit_t *u = clv_loader_unit (b->loader, job->unit);
+
+    if (job->cached) {
+        job->success = true;
+    } else if ((job->success = clv_sema_report (b->sema, job->unit))) {
+        clv_timer_begin (CLV_PHASE_LOWER, u->file);
+        job->success = clv_codegen (u->src, u->tokens, u->ast, &job->module);
+        clv_timer_end ();
+
+        job->has_main = job->success && clv_module_find_function (job->module, "main") >= 0;
+
+        if (job->success && b->native) {
+            clv_timer_begin (CLV_PHASE_EMIT, u->file);
+            job->success = unit_native (job);
+            clv_timer_end ();
+        }
+    }
+
+    if (job->success && b->cache != NULL) {
+        clv_timer_begin (CLV_PHASE_CACHE, u->file);
+
+        if (!job->cached) {
+            unit_store (b->cache, job->key, job->module, u->file, &job->obj_file);
+
+            // the module alone is never taken as up to date
+            if (b->native && !clv_cache_put (b->cache, object_key (job), job->object, job->object_length)) {
+                clv_warning ("unable to cache the object of %s: %s", u->file, strerror (errno));
+            }
+        }
+
+        if (u->iface == NULL) {
+            interface_store (b, job->unit);
+        }
+
+        clv_timer_end ();
+    }
+
+    if (!b->link) {
+        clv_module_free (job->module);
+        job->module = NULL;
+    }
+
+    clv_loader_release (b->loader, job->unit);
+}
+
+
+/* Symbol of function `name` of a unit, clv_alloc'ed */
+static char *
+unit_symbol (const compile_job_t *job, clv_str name) {
+    size_t length = strlen (job->prefix) + 1 + strlen (name) + 1;
+    char *symbol = clv_alloc (CLV_TAG_BUILD, length);
+
+    if (symbol != NULL) {
+        snprintf (symbol, length, "%s.%s", job->prefix, name);
+    }
+
+    return symbol;
+}
+
+
+/* Links the objects of a build into an executable, which initializes the
+ * globals of each unit after those it imports, then runs the main of the
+ * first unit having one: files given come before their imports */
+static bool
+build_exec (build_t *b, const clv_compile_opts_t *opts) {
+    uint32_t count;
+    const uint32_t *order = clv_loader_order (b->loader, &count);
+    clv_elf_object_t *objects = clv_calloc (CLV_TAG_BUILD, count, sizeof (*objects));
+    char **init = clv_calloc (CLV_TAG_BUILD, count, sizeof (*init));
+    char *entry = NULL;
+    bool good = false;
+
+    if (opts->manifest != NULL) {
+        clv_warning ("%s: manifests aren't used by the linker, ignoring it", opts->manifest);
+    }
+
+    if (objects == NULL || init == NULL) {
+        clv_error ("unable to link: %s", strerror (errno));
         goto cleanup;
     }
 
-    dump_tokens (src, tokens);
+    for (uint32_t i = 0; i < b->count && entry == NULL; i++) {
+        if (b->jobs[i].has_main && (entry = unit_symbol (&b->jobs[i], "main")) == NULL) {
+            clv_error ("unable to link: %s", strerror (errno));
+            goto cleanup;
+        }
+    }
+
+    if (entry == NULL) {
+        clv_error ("no main function to start from");
+        goto cleanup;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        compile_job_t *job = &b->jobs[order[i]];
+        clv_str file = clv_loader_unit (b->loader, order[i])->file;
+
+        // symbols are named after files
+        for (uint32_t k = 0; k < i; k++) {
+            if (strcmp (job->prefix, b->jobs[order[k]].prefix) == 0) {
+                clv_error ("%s: unable to link along with %s, a module of the same name", file,
+                           clv_loader_unit (b->loader, order[k])->file);
+                goto cleanup;
+            }
+        }
+
+        if ((init[i] = unit_symbol (job, CLV_NATIVE_INIT)) == NULL) {
+            clv_error ("unable to link: %s", strerror (errno));
+            goto cleanup;
+        }
+
+        objects[i] = (clv_elf_object_t){ .name = file, .data = job->object, .length = job->object_length };
+    }
+
+    clv_timer_begin (CLV_PHASE_LINK, NULL);
+    good = clv_elf_link (objects, count, (const clv_str *)init, count, entry,
+                         (opts->output != NULL) ? opts->output : CLV_DEFAULT_OUTPUT);
+    clv_timer_end ();
 
 cleanup:
-    clv_source_free (src);
+    for (uint32_t i = 0; init != NULL && i < count; i++) {
+        clv_free (init[i]);
+    }
 
-    return result;
+    clv_free (init);
+    clv_free (objects);
+    clv_free (entry);
+
+    return good;
 }
 
 
 static bool
-write_exec (clv_str _manifest, clv_str output) {
-    clv_error ("%s: stub", __func__);
-    return false;
+declare_job (void *arg, uint32_t unit) {
+    build_t *b = arg;
+    compile_job_t *job = &b->jobs[unit];
+
+    // without a buffer, diagnostics go straight to stdout and stderr
+    clv_log_capture (job->out_stream, job->err_stream);
+    bool good = unit_declare (b, unit);
+    clv_log_capture (NULL, NULL);
+
+    return good;
 }
 
 
-bool
-clv_compile (clv_str _manifest, clv_list_t *files, clv_str output, bool debug) {
-    clv_list_t *units = clv_list_new ();
+static void
+finish_job (void *arg) {
+    compile_job_t *job = arg;
+
+    if (!job->declared) {
+        return;
+    }
+
+    clv_log_capture (job->out_stream, job->err_stream);
+    unit_finish (job);
+    clv_log_capture (NULL, NULL);
+}
+
 
-    if (units == NULL) {
+/* Units are loaded and parsed in parallel, their declarations collected
+ * each after those it imports, then their functions checked and code
+ * generated on the same pool */
+static bool
+build_units (build_t *b, clv_pool_t *pool) {
+    bool good = clv_loader_load (b->loader, pool);
+
+    b->count = clv_loader_count (b->loader);
+
+    if ((b->jobs = clv_calloc (CLV_TAG_BUILD, b->count, sizeof (*b->jobs))) == NULL && b->count > 0) {
+        clv_error ("unable to start build: %s", strerror (errno));
         return false;
     }
 
-    bool good = true;
+    if ((b->sema = clv_sema_new (b->count)) == NULL) {
+        clv_error ("unable to start analysis: %s", strerror (errno));
+        return false;
+    }
+
+    for (uint32_t i = 0; i < b->count; i++) {
+        compile_job_t *job = &b->jobs[i];
+        clv_str file = clv_loader_unit (b->loader, i)->file;
+        clv_str stem = (strrchr (file, '/') != NULL) ? strrchr (file, '/') + 1 : file;
+        clv_str dot = strrchr (stem, '.');
+
+        job->build = b;
+        job->unit = i;
+        job->prefix = clv_strndup (CLV_TAG_BUILD, stem,
+                                   (dot != NULL && dot != stem) ? (size_t)(dot - stem) : strlen (stem));
+
+        if (job->prefix == NULL) {
+            clv_error ("unable to start build: %s", strerror (errno));
+            return false;
+        }
+
+        job->out_stream = open_memstream (&job->out, &job->out_length);
+        job->err_stream = open_memstream (&job->err, &job->err_length);
+    }
 
-    clv_list_iter_t iter = clv_list_get_head (files);
+    good = clv_loader_schedule (b->loader, pool, declare_job, b) && good;
 
-    for (; iter != NULL; iter = clv_list_iter_get_next (iter)) {
-        clv_str file = clv_list_iter_get_data (iter);
-        clv_str obj_file = NULL;
+    clv_sema_check (b->sema, pool);
 
-        if (compile_unit (file, &obj_file)) {
-            clv_list_push_back (units, CLV_VOIDPTR (obj_file));
-        } else {
-            good = false;
-            break;
+    for (uint32_t i = 0; i < b->count; i++) {
+        if (pool == NULL || !clv_pool_submit (pool, finish_job, &b->jobs[i])) {
+            finish_job (&b->jobs[i]);
         }
     }
 
-    if (good && !write_exec (_manifest, output)) {
+    clv_pool_wait (pool);
+
+    // report in input order, whatever order the units finished in
+    for (uint32_t i = 0; i < b->count; i++) {
+        compile_job_t *job = &b->jobs[i];
+
+        clv_loader_report (b->loader, i);
+
+        if (job->out_stream != NULL) {
+            fclose (job->out_stream);
+            job->out_stream = NULL;
+        }
+
+        if (job->err_stream != NULL) {
+            fclose (job->err_stream);
+            job->err_stream = NULL;
+        }
+
+        if (job->out != NULL) {
+            clv_log_write (CLV_INFO, job->out, job->out_length);
+        }
+
+        if (job->err != NULL) {
+            clv_log_write (CLV_ERROR, job->err, job->err_length);
+        }
+
+        good = good && job->success;
+    }
+
+    return good;
+}
+
+
+static void
+build_free (build_t *b) {
+    for (uint32_t i = 0; b->jobs != NULL && i < b->count; i++) {
+        compile_job_t *job = &b->jobs[i];
+
+        if (job->out_stream != NULL) {
+            fclose (job->out_stream);
+        }
+
+        if (job->err_stream != NULL) {
+            fclose (job->err_stream);
+        }
+
+        clv_module_free (job->module);
+        clv_free (CLV_VOIDPTR (job->obj_file));
+        clv_free (job->prefix);
+        clv_free (job->object);
+        free (job->out);
+        free (job->err);
+    }
+
+    clv_free (b->jobs);
+    clv_sema_free (b->sema);
+    clv_loader_free (b->loader);
+}
+
+
+/* Links the modules of a build, each after those it imports */
+static clv_module_t *
+build_link (build_t *b) {
+    uint32_t count;
+    const uint32_t *order = clv_loader_order (b->loader, &count);
+
+    // nothing to link on its own
+    if (count == 1) {
+        clv_module_t *module = b->jobs[order[0]].module;
+
+        b->jobs[order[0]].module = NULL;
+        return module;
+    }
+
+    clv_module_t **modules = clv_calloc (CLV_TAG_BUILD, count, sizeof (*modules));
+    uint32_t **imports = clv_calloc (CLV_TAG_BUILD, count, sizeof (*imports));
+    uint32_t *position = clv_calloc (CLV_TAG_BUILD, b->count, sizeof (*position));
+    clv_module_t *linked = NULL;
+
+    if (modules == NULL || imports == NULL || position == NULL) {
+        clv_error ("unable to link: %s", strerror (errno));
+        goto cleanup;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        clv_unit_t *u = clv_loader_unit (b->loader, order[i]);
+        uint32_t n = 0;
+
+        modules[i] = b->jobs[order[i]].module;
+        position[order[i]] = i;
+
+        imports[i] = clv_alloc (CLV_TAG_BUILD, u->import_count * sizeof (**imports));
+
+        if (imports[i] == NULL && u->import_count > 0) {
+            clv_error ("unable to link: %s", strerror (errno));
+            goto cleanup;
+        }
+
+        // native modules aren't imports of the module
+        for (uint32_t j = 0; j < u->import_count; j++) {
+            if (u->imports[j] != UINT32_MAX) {
+                imports[i][n++] = position[u->imports[j]];
+            }
+        }
+
+        clv_assert (n == clv_module_import_count (modules[i]), goto cleanup);
+    }
+
+    clv_timer_begin (CLV_PHASE_LINK, NULL);
+    linked = clv_module_link (modules, (const uint32_t *const *)imports, count);
+    clv_timer_end ();
+
+    if (linked == NULL) {
+        clv_error ("unable to link %s: %s", clv_module_get_file (modules[count - 1]), strerror (errno));
+    }
+
+cleanup:
+    for (uint32_t i = 0; imports != NULL && i < count; i++) {
+        clv_free (imports[i]);
+    }
+
+    clv_free (modules);
+    clv_free (imports);
+    clv_free (position);
+
+    return linked;
+}
+
+
+/* Dumps the SSA form of every function of `module` */
+static void
+dump_ssa (clv_module_t *module) {
+    for (uint32_t i = 0; i < clv_module_function_count (module); i++) {
+        const clv_function_t *fn = clv_module_function (module, i);
+        clv_ssa_fn_t ssa;
+
+        if (!clv_ssa_build (fn, &ssa)) {
+            clv_warning ("unable to build the SSA form of %s: %s", fn->name, strerror (errno));
+            continue;
+        }
+
+        clv_ssa_dump (&ssa);
+        clv_ssa_free (&ssa);
+    }
+}
+
+
+static bool
+compile_build (clv_list_t *files, const clv_compile_opts_t *opts) {
+    build_t b = { .seed = cache_seed (opts), .native = true, .debug = opts->debug };
+
+    if ((b.loader = clv_loader_new (opts->search_path)) == NULL) {
+        clv_error ("unable to start build: %s", strerror (errno));
+        return false;
+    }
+
+    for (clv_list_iter_t iter = clv_list_get_head (files); iter != NULL; iter = clv_list_iter_get_next (iter)) {
+        if (clv_loader_add (b.loader, clv_list_iter_get_data (iter)) == UINT32_MAX) {
+            clv_error ("unable to start build: %s", strerror (errno));
+            clv_loader_free (b.loader);
+            return false;
+        }
+    }
+
+    if (opts->cache_dir != NULL && (b.cache = clv_cache_open (opts->cache_dir, opts->cache_size)) == NULL) {
+        clv_warning ("unable to open cache %s: %s", opts->cache_dir, strerror (errno));
+    }
+
+    clv_loader_set_cache (b.loader, b.cache, b.seed);
+
+    unsigned threads = (opts->jobs > 0) ? opts->jobs : clv_cpu_count ();
+    clv_pool_t *pool = NULL;
+
+    if (threads > 1 && (pool = clv_pool_new (threads)) == NULL) {
+        clv_warning ("unable to start %u threads, compiling sequentially", threads);
+    }
+
+    bool good = build_units (&b, pool);
+
+    clv_pool_free (pool);
+
+    if (b.cache != NULL && !clv_cache_trim (b.cache)) {
+        clv_warning ("unable to trim cache %s: %s", opts->cache_dir, strerror (errno));
+    }
+
+    clv_cache_free (b.cache);
+
+    if (good && !build_exec (&b, opts)) {
         good = false;
     }
 
-    clv_list_free (units, (clv_list_func_t)free);
+    build_free (&b);
+
+    return good;
+}
+
+
+bool
+clv_compile (clv_list_t *files, const clv_compile_opts_t *opts) {
+    clv_timer_begin (CLV_PHASE_BUILD, NULL);
+    bool good = compile_build (files, opts);
+    clv_timer_end ();
+
+    return good;
+}
+
+
+bool
+clv_run (clv_str file, const clv_run_opts_t *opts, int *out_status) {
+    clv_assert (file != NULL, return false);
+    clv_assert (out_status != NULL, return false);
+
+    build_t b = { .link = true };
+
+    if ((b.loader = clv_loader_new (opts->search_path)) == NULL
+        || clv_loader_add (b.loader, file) == UINT32_MAX) {
+        clv_error ("unable to start build: %s", strerror (errno));
+        clv_loader_free (b.loader);
+        return false;
+    }
+
+    clv_module_t *module = NULL;
+    clv_vm_t *vm = NULL;
+    clv_value_t result;
+    bool good = false;
+
+    clv_timer_begin (CLV_PHASE_BUILD, NULL);
+    bool built = build_units (&b, NULL) && (module = build_link (&b)) != NULL;
+    clv_timer_end ();
+
+    // the module keeps what it needs, the build is done with
+    build_free (&b);
+
+    if (!built) {
+        return false;
+    }
+
+    if (opts->optimize) {
+        clv_opt_report_t report;
+
+        clv_timer_begin (CLV_PHASE_OPTIMIZE, NULL);
+        bool optimized = clv_optimize (module, &report);
+        clv_timer_end ();
+
+        if (!optimized) {
+            clv_error ("unable to optimize: %s", strerror (errno));
+            goto cleanup;
+        }
+
+        if (clv_log_debug ()) {
+            clv_opt_report_dump (&report);
+        }
+    }
+
+    if (clv_log_debug ()) {
+        clv_module_dump (module);
+        dump_ssa (module);
+    }
+
+    if ((vm = clv_vm_new (module)) == NULL) {
+        clv_error ("unable to create virtual machine: %s", strerror (errno));
+        goto cleanup;
+    }
+
+    clv_vm_set_jit (vm, opts->jit);
+
+    // machine code is only tuned to the host when optimizing
+    if (opts->optimize) {
+        clv_vm_set_jit_features (vm, clv_cpu_features ());
+    }
+
+    if (!clv_vm_run (vm, "main", &result)) {
+        goto cleanup;
+    }
+
+    // the exit status is whatever main returns, if an int
+    *out_status = (result.type == CLV_TYPE_INT) ? (int)result.as.i : 0;
+    good = true;
+
+cleanup:
+    clv_vm_free (vm);
+    clv_module_free (module);
 
     return good;
 }
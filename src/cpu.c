@@ -0,0 +1,51 @@
+#include <clover/cpu.h>
+
+#include <unistd.h>
+
+
+static unsigned cpu_features = 0;
+
+
+__attribute__ ((constructor (101)))
+static void
+cpu_detect () {
+#if defined (__x86_64__) || defined (__i386__)
+    __builtin_cpu_init ();
+
+    if (__builtin_cpu_supports ("sse2")) {
+        cpu_features |= CLV_CPU_SSE2;
+    }
+
+    if (__builtin_cpu_supports ("avx2")) {
+        cpu_features |= CLV_CPU_AVX2;
+    }
+
+    if (__builtin_cpu_supports ("sse4.2")) {
+        cpu_features |= CLV_CPU_SSE42;
+    }
+
+    if (__builtin_cpu_supports ("bmi2")) {
+        cpu_features |= CLV_CPU_BMI2;
+    }
+#endif
+}
+
+
+unsigned
+clv_cpu_features () {
+    return cpu_features;
+}
+
+
+bool
+clv_cpu_has (unsigned features) {
+    return (cpu_features & features) == features;
+}
+
+
+unsigned
+clv_cpu_count () {
+    long count = sysconf (_SC_NPROCESSORS_ONLN);
+
+    return (count > 0) ? (unsigned)count : 1;
+}
@@ -0,0 +1,1447 @@
+#include <clover/elf.h>
+#include <clover/bytecode.h>
+#include <clover/hash.h>
+#include <clover/log.h>
+#include <clover/alloc.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define ELF_MIN_CAPACITY    64
+
+/* Executables are loaded here, and their bss a page after the code */
+#define ELF_BASE            0x400000ull
+#define ELF_PAGE            0x1000ull
+
+#define ELF_ALIGN(x,a)      (((x) + (a) - 1) & ~(uint64_t)((a) - 1))
+
+
+/* == File format == */
+
+/* Only what objects and executables for x86-64 Linux use, little endian */
+
+#define EI_NIDENT           16
+#define ELFCLASS64          2
+#define ELFDATA2LSB         1
+#define EV_CURRENT          1
+#define ET_REL              1
+#define ET_EXEC             2
+#define EM_X86_64           62
+
+#define SHT_PROGBITS        1
+#define SHT_SYMTAB          2
+#define SHT_STRTAB          3
+#define SHT_RELA            4
+#define SHT_NOBITS          8
+
+#define SHF_WRITE           0x1
+#define SHF_ALLOC           0x2
+#define SHF_EXECINSTR       0x4
+#define SHF_INFO_LINK       0x40
+
+#define SHN_UNDEF           0
+#define SHN_LORESERVE       0xff00
+
+#define STB_LOCAL           0
+#define STB_GLOBAL          1
+#define STT_NOTYPE          0
+#define STT_OBJECT          1
+#define STT_FUNC            2
+#define STT_SECTION         3
+
+#define PT_LOAD             1
+#define PT_GNU_STACK        0x6474e551
+#define PF_X                1
+#define PF_W                2
+#define PF_R                4
+
+
+typedef struct {
+    uint8_t ident[EI_NIDENT];
+    uint16_t type;
+    uint16_t machine;
+    uint32_t version;
+    uint64_t entry;
+    uint64_t phoff;
+    uint64_t shoff;
+    uint32_t flags;
+    uint16_t ehsize;
+    uint16_t phentsize;
+    uint16_t phnum;
+    uint16_t shentsize;
+    uint16_t shnum;
+    uint16_t shstrndx;
+} elf_ehdr_t;
+
+
+typedef struct {
+    uint32_t type;
+    uint32_t flags;
+    uint64_t offset;
+    uint64_t vaddr;
+    uint64_t paddr;
+    uint64_t filesz;
+    uint64_t memsz;
+    uint64_t align;
+} elf_phdr_t;
+
+
+typedef struct {
+    uint32_t name;
+    uint32_t type;
+    uint64_t flags;
+    uint64_t addr;
+    uint64_t offset;
+    uint64_t size;
+    uint32_t link;
+    uint32_t info;
+    uint64_t addralign;
+    uint64_t entsize;
+} elf_shdr_t;
+
+
+typedef struct {
+    uint32_t name;
+    uint8_t info;
+    uint8_t other;
+    uint16_t shndx;
+    uint64_t value;
+    uint64_t size;
+} elf_sym_t;
+
+
+typedef struct {
+    uint64_t offset;
+    uint64_t info;
+    int64_t addend;
+} elf_rela_t;
+
+
+_Static_assert (sizeof (elf_ehdr_t) == 64, "ELF header");
+_Static_assert (sizeof (elf_phdr_t) == 56, "program header");
+_Static_assert (sizeof (elf_shdr_t) == 64, "section header");
+_Static_assert (sizeof (elf_sym_t) == 24, "symbol");
+_Static_assert (sizeof (elf_rela_t) == 24, "relocation");
+
+
+static const struct {
+    clv_str name;
+    clv_str rela_name;
+    uint32_t type;
+    uint64_t flags;
+} sections[CLV_ELF_SECTION_COUNT] = {
+    [CLV_ELF_TEXT]          = { ".text",         ".rela.text",         SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR },
+    [CLV_ELF_RODATA]        = { ".rodata",       ".rela.rodata",       SHT_PROGBITS, SHF_ALLOC },
+    [CLV_ELF_BSS]           = { ".bss",          ".rela.bss",          SHT_NOBITS,   SHF_ALLOC | SHF_WRITE },
+    [CLV_ELF_DEBUG_ABBREV]  = { ".debug_abbrev", ".rela.debug_abbrev", SHT_PROGBITS, 0 },
+    [CLV_ELF_DEBUG_INFO]    = { ".debug_info",   ".rela.debug_info",   SHT_PROGBITS, 0 },
+    [CLV_ELF_DEBUG_LINE]    = { ".debug_line",   ".rela.debug_line",   SHT_PROGBITS, 0 },
+};
+
+
+static void
+elf_ident (elf_ehdr_t *ehdr, uint16_t type) {
+    static const uint8_t ident[EI_NIDENT] = { 0x7f, 'E', 'L', 'F', ELFCLASS64, ELFDATA2LSB, EV_CURRENT };
+
+    *ehdr = (elf_ehdr_t){
+        .type = type,
+        .machine = EM_X86_64,
+        .version = EV_CURRENT,
+        .ehsize = sizeof (elf_ehdr_t),
+        .shentsize = sizeof (elf_shdr_t)
+    };
+
+    memcpy (ehdr->ident, ident, EI_NIDENT);
+}
+
+
+/* Strings of a string table, built in a clv_alloc'ed buffer */
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+} elf_strings_t;
+
+
+/* Returns the offset of `s`, or UINT32_MAX when out of memory */
+static uint32_t
+strings_add (elf_strings_t *t, clv_str s) {
+    size_t length = strlen (s) + 1;
+
+    if (t->length + length > t->capacity) {
+        size_t capacity = (t->capacity == 0) ? 256 : t->capacity;
+
+        while (t->length + length > capacity) {
+            capacity *= 2;
+        }
+
+        char *data = clv_realloc (CLV_TAG_NATIVE, t->data, capacity);
+
+        if (data == NULL) {
+            return UINT32_MAX;
+        }
+
+        t->data = data;
+        t->capacity = capacity;
+    }
+
+    // the first string is always the empty one
+    if (t->length == 0 && length > 1) {
+        t->data[t->length++] = '\0';
+        return strings_add (t, s);
+    }
+
+    memcpy (t->data + t->length, s, length);
+    t->length += length;
+
+    return t->length - length;
+}
+
+
+static bool
+elf_reserve (void **data, uint32_t *capacity, uint32_t need, size_t size) {
+    if (need <= *capacity) {
+        return true;
+    }
+
+    uint32_t new_capacity = (*capacity == 0) ? ELF_MIN_CAPACITY : *capacity * 2;
+
+    while (new_capacity < need) {
+        new_capacity *= 2;
+    }
+
+    void *temp = clv_realloc (CLV_TAG_NATIVE, *data, new_capacity * size);
+
+    if (temp == NULL) {
+        return false;
+    }
+
+    *data = temp;
+    *capacity = new_capacity;
+
+    return true;
+}
+
+
+/* == Objects == */
+
+
+typedef struct {
+    uint64_t offset;
+    uint32_t type;
+    uint32_t symbol;
+    int64_t addend;
+} elf_reloc_t;
+
+
+typedef struct {
+    char *name;
+    uint8_t section;        /* clv_elf_section_t */
+    bool global;
+    bool is_section;
+    uint64_t value;
+    uint64_t size;
+} elf_symbol_t;
+
+
+typedef struct {
+    uint8_t *data;          /* NULL for the bss */
+    size_t length;
+    size_t capacity;
+    size_t align;
+
+    elf_reloc_t *relocs;
+    uint32_t reloc_count;
+    uint32_t reloc_capacity;
+} elf_section_t;
+
+
+struct clv_elf {
+    elf_section_t sections[CLV_ELF_SECTION_COUNT];
+
+    elf_symbol_t *symbols;
+    uint32_t symbol_count;
+    uint32_t symbol_capacity;
+
+    uint32_t section_symbols[CLV_ELF_SECTION_COUNT];
+};
+
+
+clv_elf_t *
+clv_elf_new () {
+    clv_elf_t *self = clv_calloc (CLV_TAG_NATIVE, 1, sizeof (*self));
+
+    if (self == NULL) {
+        return NULL;
+    }
+
+    for (int i = 0; i < CLV_ELF_SECTION_COUNT; i++) {
+        self->sections[i].align = 1;
+        self->section_symbols[i] = UINT32_MAX;
+    }
+
+    return self;
+}
+
+
+uint64_t
+clv_elf_append (clv_elf_t *self, clv_elf_section_t section, const void *data, size_t length, size_t align) {
+    elf_section_t *s = &self->sections[section];
+    size_t offset = ELF_ALIGN (s->length, align);
+
+    if (align > s->align) {
+        s->align = align;
+    }
+
+    if (section != CLV_ELF_BSS && offset + length > s->capacity) {
+        size_t capacity = (s->capacity == 0) ? 4096 : s->capacity;
+
+        while (offset + length > capacity) {
+            capacity *= 2;
+        }
+
+        uint8_t *temp = clv_realloc (CLV_TAG_NATIVE, s->data, capacity);
+
+        if (temp == NULL) {
+            return UINT64_MAX;
+        }
+
+        s->data = temp;
+        s->capacity = capacity;
+    }
+
+    if (section != CLV_ELF_BSS) {
+        memset (s->data + s->length, 0, offset - s->length);
+
+        if (data != NULL) {
+            memcpy (s->data + offset, data, length);
+        } else {
+            memset (s->data + offset, 0, length);
+        }
+    }
+
+    s->length = offset + length;
+
+    return offset;
+}
+
+
+uint8_t *
+clv_elf_data (clv_elf_t *self, clv_elf_section_t section) {
+    return self->sections[section].data;
+}
+
+
+size_t
+clv_elf_size (clv_elf_t *self, clv_elf_section_t section) {
+    return self->sections[section].length;
+}
+
+
+static uint32_t
+elf_symbol_add (clv_elf_t *self, const elf_symbol_t *symbol) {
+    if (!elf_reserve ((void **)&self->symbols, &self->symbol_capacity, self->symbol_count + 1,
+                      sizeof (*self->symbols))) {
+        clv_free (symbol->name);
+        return UINT32_MAX;
+    }
+
+    self->symbols[self->symbol_count] = *symbol;
+
+    return self->symbol_count++;
+}
+
+
+uint32_t
+clv_elf_symbol (clv_elf_t *self, clv_str name, clv_elf_section_t section, uint64_t offset, uint64_t size,
+                bool global) {
+    char *copy = clv_strdup (CLV_TAG_NATIVE, name);
+
+    if (copy == NULL) {
+        return UINT32_MAX;
+    }
+
+    return elf_symbol_add (self, &(elf_symbol_t){
+        .name = copy,
+        .section = section,
+        .global = global || section == CLV_ELF_UNDEF,
+        .value = offset,
+        .size = size
+    });
+}
+
+
+bool
+clv_elf_define (clv_elf_t *self, uint32_t symbol, clv_elf_section_t section, uint64_t offset, uint64_t size) {
+    if (symbol >= self->symbol_count || self->symbols[symbol].section != CLV_ELF_UNDEF) {
+        errno = EINVAL;
+        return false;
+    }
+
+    self->symbols[symbol].section = section;
+    self->symbols[symbol].value = offset;
+    self->symbols[symbol].size = size;
+
+    return true;
+}
+
+
+uint32_t
+clv_elf_section_symbol (clv_elf_t *self, clv_elf_section_t section) {
+    if (self->section_symbols[section] == UINT32_MAX) {
+        self->section_symbols[section] = elf_symbol_add (self, &(elf_symbol_t){
+            .section = section,
+            .is_section = true
+        });
+    }
+
+    return self->section_symbols[section];
+}
+
+
+bool
+clv_elf_relocate (clv_elf_t *self, clv_elf_section_t section, uint64_t offset, uint32_t type, uint32_t symbol,
+                  int64_t addend) {
+    elf_section_t *s = &self->sections[section];
+
+    if (symbol >= self->symbol_count) {
+        errno = EINVAL;
+        return false;
+    }
+
+    if (!elf_reserve ((void **)&s->relocs, &s->reloc_capacity, s->reloc_count + 1, sizeof (*s->relocs))) {
+        return false;
+    }
+
+    s->relocs[s->reloc_count++] = (elf_reloc_t){ .offset = offset, .type = type, .symbol = symbol, .addend = addend };
+
+    return true;
+}
+
+
+/* Objects are laid out as the ELF header, each section, its relocations,
+ * the symbol and string tables, and the section headers */
+bool
+clv_elf_write (clv_elf_t *self, void **out_data, size_t *out_length) {
+    // section headers: null, sections with anything in them or symbols,
+    // then their relocations, .symtab, .strtab and .shstrtab
+    uint32_t index[CLV_ELF_SECTION_COUNT] = { 0 };
+    uint32_t rela_index[CLV_ELF_SECTION_COUNT] = { 0 };
+    uint32_t shnum = 1;
+
+    for (uint32_t i = 0; i < self->symbol_count; i++) {
+        if (self->symbols[i].section != CLV_ELF_UNDEF) {
+            index[self->symbols[i].section] = 1;
+        }
+    }
+
+    for (int s = 0; s < CLV_ELF_SECTION_COUNT; s++) {
+        if (index[s] != 0 || self->sections[s].length > 0 || self->sections[s].reloc_count > 0) {
+            index[s] = shnum++;
+        }
+    }
+
+    for (int s = 0; s < CLV_ELF_SECTION_COUNT; s++) {
+        if (self->sections[s].reloc_count > 0) {
+            rela_index[s] = shnum++;
+        }
+    }
+
+    uint32_t symtab = shnum++;
+    uint32_t strtab = shnum++;
+    uint32_t shstrtab = shnum++;
+
+    // locals first: the null symbol, then sections, then the rest
+    uint32_t *order = clv_alloc (CLV_TAG_NATIVE, (self->symbol_count + 1) * sizeof (*order));
+    elf_sym_t *syms = clv_calloc (CLV_TAG_NATIVE, self->symbol_count + 1, sizeof (*syms));
+    elf_strings_t names = { 0 };
+    elf_strings_t section_names = { 0 };
+    uint8_t *data = NULL;
+    uint32_t count = 1;
+    uint32_t first_global = 1;
+    bool good = order != NULL && syms != NULL;
+
+    for (int pass = 0; good && pass < 3; pass++) {
+        if (pass == 2) {
+            first_global = count;
+        }
+
+        for (uint32_t i = 0; i < self->symbol_count; i++) {
+            elf_symbol_t *sym = &self->symbols[i];
+
+            if ((pass == 0) != sym->is_section || (pass == 2) != (sym->global && !sym->is_section)) {
+                continue;
+            }
+
+            uint32_t name = sym->is_section ? 0 : strings_add (&names, sym->name);
+            uint8_t type = sym->is_section ? STT_SECTION : (sym->section == CLV_ELF_TEXT) ? STT_FUNC
+                : (sym->section == CLV_ELF_UNDEF) ? STT_NOTYPE : STT_OBJECT;
+
+            good = good && name != UINT32_MAX;
+            order[i] = count;
+            syms[count++] = (elf_sym_t){
+                .name = name,
+                .info = (uint8_t)((sym->global ? STB_GLOBAL : STB_LOCAL) << 4 | type),
+                .shndx = (sym->section == CLV_ELF_UNDEF) ? SHN_UNDEF : index[sym->section],
+                .value = sym->value,
+                .size = sym->size
+            };
+        }
+    }
+
+    // contents, aligned to 16 so any section may follow any other
+    size_t length = sizeof (elf_ehdr_t);
+    size_t offsets[CLV_ELF_SECTION_COUNT] = { 0 };
+    size_t rela_offsets[CLV_ELF_SECTION_COUNT] = { 0 };
+
+    for (int s = 0; s < CLV_ELF_SECTION_COUNT; s++) {
+        length = ELF_ALIGN (length, 16);
+        offsets[s] = length;
+        length += (s != CLV_ELF_BSS) ? self->sections[s].length : 0;
+    }
+
+    for (int s = 0; s < CLV_ELF_SECTION_COUNT; s++) {
+        length = ELF_ALIGN (length, 8);
+        rela_offsets[s] = length;
+        length += self->sections[s].reloc_count * sizeof (elf_rela_t);
+    }
+
+    length = ELF_ALIGN (length, 8);
+
+    size_t symtab_offset = length;
+
+    length += count * sizeof (elf_sym_t);
+
+    size_t strtab_offset = length;
+
+    good = good && (names.length > 0 || strings_add (&names, "") != UINT32_MAX);
+    length += names.length;
+
+    for (int s = 0; good && s < CLV_ELF_SECTION_COUNT; s++) {
+        good = strings_add (&section_names, sections[s].name) != UINT32_MAX
+            && strings_add (&section_names, sections[s].rela_name) != UINT32_MAX;
+    }
+
+    good = good && strings_add (&section_names, ".symtab") != UINT32_MAX
+        && strings_add (&section_names, ".strtab") != UINT32_MAX
+        && strings_add (&section_names, ".shstrtab") != UINT32_MAX;
+
+    size_t shstrtab_offset = length;
+
+    length = ELF_ALIGN (length + section_names.length, 8);
+
+    size_t shoff = length;
+
+    length += shnum * sizeof (elf_shdr_t);
+
+    if (!good || (data = clv_calloc (CLV_TAG_NATIVE, 1, length)) == NULL) {
+        clv_free (order);
+        clv_free (syms);
+        clv_free (names.data);
+        clv_free (section_names.data);
+        errno = ENOMEM;
+        return false;
+    }
+
+    elf_ehdr_t *ehdr = (elf_ehdr_t *)data;
+    elf_shdr_t *shdrs = (elf_shdr_t *)(data + shoff);
+
+    elf_ident (ehdr, ET_REL);
+    ehdr->shoff = shoff;
+    ehdr->shnum = shnum;
+    ehdr->shstrndx = shstrtab;
+
+    // names in .shstrtab, as added above
+    uint32_t name = 1;
+
+    for (int s = 0; s < CLV_ELF_SECTION_COUNT; s++) {
+        uint32_t rela_name = name + strlen (sections[s].name) + 1;
+
+        if (index[s] != 0) {
+            shdrs[index[s]] = (elf_shdr_t){
+                .name = name,
+                .type = sections[s].type,
+                .flags = sections[s].flags,
+                .offset = offsets[s],
+                .size = self->sections[s].length,
+                .addralign = self->sections[s].align
+            };
+
+            if (s != CLV_ELF_BSS) {
+                memcpy (data + offsets[s], self->sections[s].data, self->sections[s].length);
+            }
+        }
+
+        if (rela_index[s] != 0) {
+            elf_rela_t *rela = (elf_rela_t *)(data + rela_offsets[s]);
+
+            shdrs[rela_index[s]] = (elf_shdr_t){
+                .name = rela_name,
+                .type = SHT_RELA,
+                .flags = SHF_INFO_LINK,
+                .offset = rela_offsets[s],
+                .size = self->sections[s].reloc_count * sizeof (elf_rela_t),
+                .link = symtab,
+                .info = index[s],
+                .addralign = 8,
+                .entsize = sizeof (elf_rela_t)
+            };
+
+            for (uint32_t i = 0; i < self->sections[s].reloc_count; i++) {
+                elf_reloc_t *r = &self->sections[s].relocs[i];
+
+                rela[i] = (elf_rela_t){
+                    .offset = r->offset,
+                    .info = (uint64_t)order[r->symbol] << 32 | r->type,
+                    .addend = r->addend
+                };
+            }
+        }
+
+        name = rela_name + strlen (sections[s].rela_name) + 1;
+    }
+
+    shdrs[symtab] = (elf_shdr_t){
+        .name = name,
+        .type = SHT_SYMTAB,
+        .offset = symtab_offset,
+        .size = count * sizeof (elf_sym_t),
+        .link = strtab,
+        .info = first_global,
+        .addralign = 8,
+        .entsize = sizeof (elf_sym_t)
+    };
+
+    shdrs[strtab] = (elf_shdr_t){
+        .name = name + sizeof (".symtab"),
+        .type = SHT_STRTAB,
+        .offset = strtab_offset,
+        .size = names.length,
+        .addralign = 1
+    };
+
+    shdrs[shstrtab] = (elf_shdr_t){
+        .name = name + sizeof (".symtab") + sizeof (".strtab"),
+        .type = SHT_STRTAB,
+        .offset = shstrtab_offset,
+        .size = section_names.length,
+        .addralign = 1
+    };
+
+    memcpy (data + symtab_offset, syms, count * sizeof (elf_sym_t));
+    memcpy (data + strtab_offset, names.data, names.length);
+    memcpy (data + shstrtab_offset, section_names.data, section_names.length);
+
+    clv_free (order);
+    clv_free (syms);
+    clv_free (names.data);
+    clv_free (section_names.data);
+
+    *out_data = data;
+    *out_length = length;
+
+    return true;
+}
+
+
+void
+clv_elf_free (clv_elf_t *self) {
+    if (self == NULL) {
+        return;
+    }
+
+    for (int s = 0; s < CLV_ELF_SECTION_COUNT; s++) {
+        clv_free (self->sections[s].data);
+        clv_free (self->sections[s].relocs);
+    }
+
+    for (uint32_t i = 0; i < self->symbol_count; i++) {
+        clv_free (self->symbols[i].name);
+    }
+
+    clv_free (self->symbols);
+    clv_free (self);
+}
+
+
+/* == Linking == */
+
+
+/* Object being linked, checked as it is read */
+typedef struct {
+    clv_str name;
+    const uint8_t *data;
+    size_t length;
+
+    const elf_shdr_t *shdrs;
+    uint32_t shnum;
+
+    const elf_sym_t *syms;
+    uint32_t sym_count;
+    const char *strtab;
+    size_t strtab_length;
+
+    int8_t *kinds;          /* output section of each section, or -1 */
+    uint64_t *bases;        /* offset of each section in its output section */
+
+    uint32_t first;         /* index of its first symbol, among those of all objects */
+} link_input_t;
+
+
+/* Global symbol, by name */
+typedef struct {
+    clv_str name;
+    uint32_t input;
+    uint32_t symbol;
+} link_global_t;
+
+
+/* Symbol of an object */
+typedef struct {
+    uint32_t input;
+    uint32_t symbol;
+} link_ref_t;
+
+
+typedef struct {
+    link_input_t *inputs;
+    uint32_t count;
+
+    link_global_t *globals;
+    uint32_t global_mask;
+
+    uint64_t sizes[CLV_ELF_SECTION_COUNT];
+    uint64_t aligns[CLV_ELF_SECTION_COUNT];
+    uint64_t addrs[CLV_ELF_SECTION_COUNT];      /* 0 for those not loaded */
+    uint64_t offsets[CLV_ELF_SECTION_COUNT];    /* in the file */
+} linker_t;
+
+
+/* Fails on anything the backend never writes */
+static bool
+input_read (link_input_t *in) {
+    const elf_ehdr_t *ehdr = (const elf_ehdr_t *)in->data;
+
+    if (in->length < sizeof (*ehdr) || memcmp (ehdr->ident, "\x7f" "ELF", 4) != 0
+        || ehdr->ident[4] != ELFCLASS64 || ehdr->ident[5] != ELFDATA2LSB || ehdr->type != ET_REL
+        || ehdr->machine != EM_X86_64 || ehdr->shentsize != sizeof (elf_shdr_t) || ehdr->shoff > in->length
+        || ehdr->shnum > (in->length - ehdr->shoff) / sizeof (elf_shdr_t) || ehdr->shstrndx >= ehdr->shnum) {
+        return false;
+    }
+
+    in->shdrs = (const elf_shdr_t *)(in->data + ehdr->shoff);
+    in->shnum = ehdr->shnum;
+    in->kinds = clv_alloc (CLV_TAG_NATIVE, in->shnum);
+    in->bases = clv_calloc (CLV_TAG_NATIVE, in->shnum, sizeof (*in->bases));
+
+    if (in->kinds == NULL || in->bases == NULL) {
+        return false;
+    }
+
+    const elf_shdr_t *names = &in->shdrs[ehdr->shstrndx];
+
+    if (names->offset > in->length || names->size > in->length - names->offset || names->size == 0
+        || in->data[names->offset + names->size - 1] != '\0') {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < in->shnum; i++) {
+        const elf_shdr_t *sh = &in->shdrs[i];
+
+        in->kinds[i] = -1;
+
+        if (sh->type != SHT_NOBITS && (sh->offset > in->length || sh->size > in->length - sh->offset)) {
+            return false;
+        }
+
+        if (sh->name >= names->size) {
+            return false;
+        }
+
+        clv_str name = (const char *)in->data + names->offset + sh->name;
+
+        for (int s = 0; s < CLV_ELF_SECTION_COUNT; s++) {
+            if (strcmp (name, sections[s].name) == 0) {
+                in->kinds[i] = s;
+            }
+        }
+
+        if (sh->type == SHT_SYMTAB) {
+            const elf_shdr_t *strings = (sh->link < in->shnum) ? &in->shdrs[sh->link] : NULL;
+
+            if (in->syms != NULL || sh->entsize != sizeof (elf_sym_t) || strings == NULL || strings->size == 0
+                || strings->offset > in->length || strings->size > in->length - strings->offset
+                || in->data[strings->offset + strings->size - 1] != '\0') {
+                return false;
+            }
+
+            in->syms = (const elf_sym_t *)(in->data + sh->offset);
+            in->sym_count = sh->size / sizeof (elf_sym_t);
+            in->strtab = (const char *)in->data + strings->offset;
+            in->strtab_length = strings->size;
+        }
+    }
+
+    for (uint32_t i = 0; i < in->sym_count; i++) {
+        const elf_sym_t *sym = &in->syms[i];
+
+        if (sym->name >= in->strtab_length || (sym->shndx >= in->shnum && sym->shndx < SHN_LORESERVE)) {
+            return false;
+        }
+    }
+
+    return in->syms != NULL;
+}
+
+
+static link_global_t *
+linker_lookup (linker_t *l, clv_str name) {
+    uint32_t slot = clv_hash64 (name, strlen (name), 0);
+
+    for (;; slot++) {
+        link_global_t *g = &l->globals[slot & l->global_mask];
+
+        if (g->name == NULL || strcmp (g->name, name) == 0) {
+            return g;
+        }
+    }
+}
+
+
+static inline clv_str
+symbol_name (const link_input_t *in, const elf_sym_t *sym) {
+    return in->strtab + sym->name;
+}
+
+
+/* Address of a symbol, or its offset in its output section for those not
+ * loaded. Undefined symbols resolve to the global they name. */
+static bool
+symbol_address (linker_t *l, uint32_t input, uint32_t symbol, uint64_t *out_address) {
+    const link_input_t *in = &l->inputs[input];
+
+    if (symbol >= in->sym_count) {
+        return false;
+    }
+
+    const elf_sym_t *sym = &in->syms[symbol];
+
+    if (sym->shndx == SHN_UNDEF) {
+        link_global_t *g = linker_lookup (l, symbol_name (in, sym));
+
+        if (g->name == NULL) {
+            clv_error ("%s: undefined symbol '%s'", in->name, symbol_name (in, sym));
+            return false;
+        }
+
+        return symbol_address (l, g->input, g->symbol, out_address);
+    }
+
+    if (sym->shndx >= in->shnum || in->kinds[sym->shndx] < 0) {
+        return false;
+    }
+
+    *out_address = l->addrs[in->kinds[sym->shndx]] + in->bases[sym->shndx] + sym->value;
+
+    return true;
+}
+
+
+static bool
+linker_relocate (linker_t *l, uint32_t input, const elf_shdr_t *rela, uint8_t *out) {
+    link_input_t *in = &l->inputs[input];
+
+    if (rela->info >= in->shnum || in->kinds[rela->info] < 0 || rela->entsize != sizeof (elf_rela_t)) {
+        return false;
+    }
+
+    const elf_shdr_t *target = &in->shdrs[rela->info];
+    int kind = in->kinds[rela->info];
+    uint8_t *base = out + l->offsets[kind] + in->bases[rela->info];
+    const elf_rela_t *relocs = (const elf_rela_t *)(in->data + rela->offset);
+
+    for (uint64_t i = 0; i < rela->size / sizeof (elf_rela_t); i++) {
+        const elf_rela_t *r = &relocs[i];
+        uint32_t type = (uint32_t)r->info;
+        uint64_t s;
+        uint64_t p = l->addrs[kind] + in->bases[rela->info] + r->offset;
+
+        if (!symbol_address (l, input, r->info >> 32, &s)) {
+            return false;
+        }
+
+        uint64_t value = s + r->addend;
+        size_t size = (type == CLV_ELF_R_64) ? 8 : 4;
+
+        if (r->offset > target->size || size > target->size - r->offset || kind == CLV_ELF_BSS) {
+            return false;
+        }
+
+        switch (type) {
+        case CLV_ELF_R_64:
+            memcpy (base + r->offset, &value, 8);
+            break;
+
+        case CLV_ELF_R_PC32:
+        case CLV_ELF_R_PLT32: {
+            int64_t rel = (int64_t)(value - p);
+
+            if (rel != (int32_t)rel) {
+                return false;
+            }
+
+            memcpy (base + r->offset, &(int32_t){ (int32_t)rel }, 4);
+            break;
+        }
+
+        case CLV_ELF_R_32:
+            if (value > UINT32_MAX) {
+                return false;
+            }
+
+            memcpy (base + r->offset, &(uint32_t){ (uint32_t)value }, 4);
+            break;
+
+        default:
+            clv_error ("%s: unsupported relocation type %u", in->name, type);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+/* Defined symbol a symbol of `*input` stands for, in place, following
+ * undefined ones to the global they name. False for those undefined. */
+static bool
+linker_resolve (linker_t *l, uint32_t *input, uint32_t *symbol) {
+    const link_input_t *in = &l->inputs[*input];
+
+    if (*symbol >= in->sym_count) {
+        return false;
+    }
+
+    if (in->syms[*symbol].shndx != SHN_UNDEF) {
+        return true;
+    }
+
+    link_global_t *g = linker_lookup (l, symbol_name (in, &in->syms[*symbol]));
+
+    *input = g->input;
+    *symbol = g->symbol;
+
+    return g->name != NULL;
+}
+
+
+/* Fails on each function calling CLV_ELF_UNSUPPORTED that _start refers
+ * to, directly or through the functions it refers to, which executables
+ * would run into. Whatever can't be resolved is left to relocation. */
+static bool
+linker_check_reachable (linker_t *l) {
+    uint32_t total = 0;
+
+    for (uint32_t i = 0; i < l->count; i++) {
+        l->inputs[i].first = total;
+        total += l->inputs[i].sym_count;
+    }
+
+    uint8_t *seen = clv_calloc (CLV_TAG_NATIVE, total, 1);
+    link_ref_t *stack = clv_alloc (CLV_TAG_NATIVE, total * sizeof (*stack));
+    link_global_t *start = linker_lookup (l, "_start");
+    uint32_t depth = 0;
+    bool good = true;
+
+    if (seen == NULL || stack == NULL || start->name == NULL) {
+        clv_free (seen);
+        clv_free (stack);
+        return false;
+    }
+
+    seen[l->inputs[start->input].first + start->symbol] = true;
+    stack[depth++] = (link_ref_t){ .input = start->input, .symbol = start->symbol };
+
+    while (depth > 0) {
+        link_ref_t from = stack[--depth];
+        const link_input_t *in = &l->inputs[from.input];
+        const elf_sym_t *sym = &in->syms[from.symbol];
+        bool unsupported = false;
+
+        if (sym->shndx >= in->shnum || in->kinds[sym->shndx] != CLV_ELF_TEXT) {
+            continue;
+        }
+
+        for (uint32_t k = 0; k < in->shnum; k++) {
+            const elf_shdr_t *rela = &in->shdrs[k];
+
+            if (rela->type != SHT_RELA || rela->info != sym->shndx || rela->entsize != sizeof (elf_rela_t)) {
+                continue;
+            }
+
+            const elf_rela_t *relocs = (const elf_rela_t *)(in->data + rela->offset);
+
+            for (uint64_t i = 0; i < rela->size / sizeof (elf_rela_t); i++) {
+                uint32_t input = from.input;
+                uint32_t symbol = relocs[i].info >> 32;
+
+                if (relocs[i].offset < sym->value || relocs[i].offset - sym->value >= sym->size
+                    || symbol >= in->sym_count || (in->syms[symbol].info & 0xf) == STT_SECTION) {
+                    continue;
+                }
+
+                if (strcmp (symbol_name (in, &in->syms[symbol]), CLV_ELF_UNSUPPORTED) == 0) {
+                    unsupported = true;
+                    continue;
+                }
+
+                if (!linker_resolve (l, &input, &symbol) || seen[l->inputs[input].first + symbol]) {
+                    continue;
+                }
+
+                seen[l->inputs[input].first + symbol] = true;
+                stack[depth++] = (link_ref_t){ .input = input, .symbol = symbol };
+            }
+        }
+
+        if (unsupported) {
+            clv_error ("%s: %s may be run, but the native backend can't compile it", in->name,
+                       symbol_name (in, sym));
+            good = false;
+        }
+    }
+
+    clv_free (seen);
+    clv_free (stack);
+
+    return good;
+}
+
+
+/* Code the executable starts at: calls the init functions and the entry,
+ * then exits with what it returned if an int, or 0 */
+static bool
+start_object (const clv_str *init, uint32_t init_count, clv_str entry, void **out_data, size_t *out_length) {
+    static const uint8_t prologue[] = {
+        0x31, 0xed,                         // xor ebp, ebp
+        0x48, 0x83, 0xe4, 0xf0,             // and rsp, -16
+    };
+
+    static const uint8_t epilogue[] = {
+        0x31, 0xff,                         // xor edi, edi
+        0x48, 0x83, 0xf8, CLV_TYPE_INT,     // cmp rax, CLV_TYPE_INT
+        0x75, 0x02,                         // jne 1f
+        0x89, 0xd7,                         // mov edi, edx
+        0xb8, 0xe7, 0x00, 0x00, 0x00,       // 1: mov eax, SYS_exit_group
+        0x0f, 0x05,                         // syscall
+    };
+
+    static const uint8_t fail[] = {
+        0x48, 0x89, 0xf2,                   // mov rdx, rsi
+        0x48, 0x89, 0xfe,                   // mov rsi, rdi
+        0xbf, 0x02, 0x00, 0x00, 0x00,       // mov edi, 2
+        0xb8, 0x01, 0x00, 0x00, 0x00,       // mov eax, SYS_write
+        0x0f, 0x05,                         // syscall
+        0xbf, 0x01, 0x00, 0x00, 0x00,       // mov edi, 1
+        0xb8, 0xe7, 0x00, 0x00, 0x00,       // mov eax, SYS_exit_group
+        0x0f, 0x05,                         // syscall
+    };
+
+    clv_elf_t *elf = clv_elf_new ();
+    bool good = elf != NULL && clv_elf_append (elf, CLV_ELF_TEXT, prologue, sizeof (prologue), 16) != UINT64_MAX;
+
+    for (uint32_t i = 0; good && i <= init_count; i++) {
+        static const uint8_t call[] = { 0xe8, 0, 0, 0, 0 };
+        uint64_t site = clv_elf_append (elf, CLV_ELF_TEXT, call, sizeof (call), 1);
+        uint32_t symbol = clv_elf_symbol (elf, (i < init_count) ? init[i] : entry, CLV_ELF_UNDEF, 0, 0, true);
+
+        good = site != UINT64_MAX && symbol != UINT32_MAX
+            && clv_elf_relocate (elf, CLV_ELF_TEXT, site + 1, CLV_ELF_R_PLT32, symbol, -4);
+    }
+
+    uint64_t end = good ? clv_elf_append (elf, CLV_ELF_TEXT, epilogue, sizeof (epilogue), 1) : UINT64_MAX;
+    uint64_t at = (end != UINT64_MAX) ? clv_elf_append (elf, CLV_ELF_TEXT, fail, sizeof (fail), 16) : UINT64_MAX;
+
+    good = at != UINT64_MAX
+        && clv_elf_symbol (elf, "_start", CLV_ELF_TEXT, 0, end + sizeof (epilogue), true) != UINT32_MAX
+        && clv_elf_symbol (elf, CLV_ELF_FAIL, CLV_ELF_TEXT, at, sizeof (fail), true) != UINT32_MAX
+        && clv_elf_symbol (elf, CLV_ELF_UNSUPPORTED, CLV_ELF_TEXT, at, sizeof (fail), true) != UINT32_MAX
+        && clv_elf_write (elf, out_data, out_length);
+
+    clv_elf_free (elf);
+
+    return good;
+}
+
+
+/* Sections of the executable: null, those of objects with anything in
+ * them, and the tables */
+typedef struct {
+    uint32_t index[CLV_ELF_SECTION_COUNT];
+    uint32_t symtab;
+    uint32_t strtab;
+    uint32_t shstrtab;
+    uint32_t count;
+} exec_sections_t;
+
+
+static bool
+exec_write (linker_t *l, uint64_t entry, clv_str output) {
+    exec_sections_t sh = { .count = 1 };
+
+    for (int s = 0; s < CLV_ELF_SECTION_COUNT; s++) {
+        sh.index[s] = (l->sizes[s] > 0) ? sh.count++ : 0;
+    }
+
+    sh.symtab = sh.count++;
+    sh.strtab = sh.count++;
+    sh.shstrtab = sh.count++;
+
+    // the symbols of every function and global object, for tools
+    elf_strings_t names = { 0 };
+    elf_strings_t section_names = { 0 };
+    elf_sym_t *syms = NULL;
+    uint32_t sym_count = 1;
+    uint32_t capacity = 0;
+    bool good = strings_add (&names, "") != UINT32_MAX;
+
+    for (uint32_t i = 0; good && i < l->count; i++) {
+        link_input_t *in = &l->inputs[i];
+
+        for (uint32_t k = 0; good && k < in->sym_count; k++) {
+            const elf_sym_t *sym = &in->syms[k];
+            uint64_t address;
+
+            if (sym->info >> 4 != STB_GLOBAL || sym->shndx == SHN_UNDEF || sym->shndx >= in->shnum
+                || in->kinds[sym->shndx] < 0 || !symbol_address (l, i, k, &address)) {
+                continue;
+            }
+
+            uint32_t name = strings_add (&names, symbol_name (in, sym));
+
+            good = name != UINT32_MAX && elf_reserve ((void **)&syms, &capacity, sym_count + 1, sizeof (*syms));
+
+            if (good) {
+                syms[0] = (elf_sym_t){ 0 };
+                syms[sym_count++] = (elf_sym_t){
+                    .name = name,
+                    .info = sym->info,
+                    .shndx = sh.index[in->kinds[sym->shndx]],
+                    .value = address,
+                    .size = sym->size
+                };
+            }
+        }
+    }
+
+    for (int s = 0; good && s < CLV_ELF_SECTION_COUNT; s++) {
+        good = strings_add (&section_names, sections[s].name) != UINT32_MAX;
+    }
+
+    good = good && strings_add (&section_names, ".symtab") != UINT32_MAX
+        && strings_add (&section_names, ".strtab") != UINT32_MAX
+        && strings_add (&section_names, ".shstrtab") != UINT32_MAX;
+
+    uint32_t phnum = (l->sizes[CLV_ELF_BSS] > 0) ? 3 : 2;
+    size_t symtab_offset = ELF_ALIGN (l->offsets[CLV_ELF_SECTION_COUNT - 1] + l->sizes[CLV_ELF_SECTION_COUNT - 1], 8);
+    size_t strtab_offset = symtab_offset + sym_count * sizeof (elf_sym_t);
+    size_t shstrtab_offset = strtab_offset + names.length;
+    size_t shoff = ELF_ALIGN (shstrtab_offset + section_names.length, 8);
+    size_t length = shoff + sh.count * sizeof (elf_shdr_t);
+    uint8_t *data = good ? clv_calloc (CLV_TAG_NATIVE, 1, length) : NULL;
+
+    if (data == NULL) {
+        clv_free (syms);
+        clv_free (names.data);
+        clv_free (section_names.data);
+        errno = ENOMEM;
+        return false;
+    }
+
+    elf_ehdr_t *ehdr = (elf_ehdr_t *)data;
+    elf_phdr_t *phdrs = (elf_phdr_t *)(data + sizeof (*ehdr));
+    elf_shdr_t *shdrs = (elf_shdr_t *)(data + shoff);
+
+    elf_ident (ehdr, ET_EXEC);
+    ehdr->entry = entry;
+    ehdr->phoff = sizeof (*ehdr);
+    ehdr->phentsize = sizeof (elf_phdr_t);
+    ehdr->phnum = phnum;
+    ehdr->shoff = shoff;
+    ehdr->shnum = sh.count;
+    ehdr->shstrndx = sh.shstrtab;
+
+    // headers, code and constants in one segment, the bss in another
+    uint64_t text_end = l->offsets[CLV_ELF_RODATA] + l->sizes[CLV_ELF_RODATA];
+
+    phdrs[0] = (elf_phdr_t){
+        .type = PT_LOAD,
+        .flags = PF_R | PF_X,
+        .vaddr = ELF_BASE,
+        .paddr = ELF_BASE,
+        .filesz = text_end,
+        .memsz = text_end,
+        .align = ELF_PAGE
+    };
+
+    phdrs[phnum - 1] = (elf_phdr_t){ .type = PT_GNU_STACK, .flags = PF_R | PF_W, .align = 16 };
+
+    if (phnum == 3) {
+        uint64_t vaddr = l->addrs[CLV_ELF_BSS] & ~(ELF_PAGE - 1);
+
+        phdrs[1] = (elf_phdr_t){
+            .type = PT_LOAD,
+            .flags = PF_R | PF_W,
+            .offset = text_end & ~(ELF_PAGE - 1),
+            .vaddr = vaddr,
+            .paddr = vaddr,
+            .memsz = l->addrs[CLV_ELF_BSS] + l->sizes[CLV_ELF_BSS] - vaddr,
+            .align = ELF_PAGE
+        };
+    }
+
+    uint32_t name = 1;
+
+    for (int s = 0; s < CLV_ELF_SECTION_COUNT; s++) {
+        if (sh.index[s] != 0) {
+            shdrs[sh.index[s]] = (elf_shdr_t){
+                .name = name,
+                .type = sections[s].type,
+                .flags = sections[s].flags,
+                .addr = l->addrs[s],
+                .offset = l->offsets[s],
+                .size = l->sizes[s],
+                .addralign = l->aligns[s]
+            };
+        }
+
+        name += strlen (sections[s].name) + 1;
+    }
+
+    shdrs[sh.symtab] = (elf_shdr_t){
+        .name = name,
+        .type = SHT_SYMTAB,
+        .offset = symtab_offset,
+        .size = sym_count * sizeof (elf_sym_t),
+        .link = sh.strtab,
+        .info = 1,
+        .addralign = 8,
+        .entsize = sizeof (elf_sym_t)
+    };
+
+    shdrs[sh.strtab] = (elf_shdr_t){
+        .name = name + sizeof (".symtab"),
+        .type = SHT_STRTAB,
+        .offset = strtab_offset,
+        .size = names.length,
+        .addralign = 1
+    };
+
+    shdrs[sh.shstrtab] = (elf_shdr_t){
+        .name = name + sizeof (".symtab") + sizeof (".strtab"),
+        .type = SHT_STRTAB,
+        .offset = shstrtab_offset,
+        .size = section_names.length,
+        .addralign = 1
+    };
+
+    if (sym_count > 1) {
+        memcpy (data + symtab_offset, syms, sym_count * sizeof (elf_sym_t));
+    }
+
+    memcpy (data + strtab_offset, names.data, names.length);
+    memcpy (data + shstrtab_offset, section_names.data, section_names.length);
+
+    clv_free (syms);
+    clv_free (names.data);
+    clv_free (section_names.data);
+
+    // contents of sections, then relocations applied in place
+    for (uint32_t i = 0; good && i < l->count; i++) {
+        link_input_t *in = &l->inputs[i];
+
+        for (uint32_t k = 0; k < in->shnum; k++) {
+            if (in->kinds[k] >= 0 && in->kinds[k] != CLV_ELF_BSS) {
+                memcpy (data + l->offsets[in->kinds[k]] + in->bases[k], in->data + in->shdrs[k].offset,
+                        in->shdrs[k].size);
+            }
+        }
+
+        for (uint32_t k = 0; good && k < in->shnum; k++) {
+            if (in->shdrs[k].type == SHT_RELA) {
+                good = linker_relocate (l, i, &in->shdrs[k], data);
+            }
+        }
+
+        if (!good) {
+            clv_error ("%s: unable to link, the object is damaged", in->name);
+        }
+    }
+
+    int fd = good ? open (output, O_WRONLY | O_CREAT | O_TRUNC, 0777) : -1;
+
+    if (good && fd < 0) {
+        clv_error ("unable to write %s: %s", output, strerror (errno));
+        good = false;
+    }
+
+    for (size_t done = 0; good && done < length;) {
+        ssize_t n = write (fd, data + done, length - done);
+
+        if (n < 0 && errno != EINTR) {
+            clv_error ("unable to write %s: %s", output, strerror (errno));
+            good = false;
+        }
+
+        done += (n > 0) ? (size_t)n : 0;
+    }
+
+    if (fd >= 0 && close (fd) != 0 && good) {
+        clv_error ("unable to write %s: %s", output, strerror (errno));
+        good = false;
+    }
+
+    clv_free (data);
+
+    if (!good) {
+        errno = EINVAL;
+    }
+
+    return good;
+}
+
+
+bool
+clv_elf_link (const clv_elf_object_t *objects, uint32_t count, const clv_str *init, uint32_t init_count,
+              clv_str entry, clv_str output) {
+    linker_t l = { .count = count + 1 };
+    void *start = NULL;
+    size_t start_length;
+    bool good = false;
+
+    // the start code comes first, then objects in order
+    l.inputs = clv_calloc (CLV_TAG_NATIVE, l.count, sizeof (*l.inputs));
+
+    if (l.inputs == NULL || !start_object (init, init_count, entry, &start, &start_length)) {
+        clv_free (l.inputs);
+        errno = ENOMEM;
+        return false;
+    }
+
+    l.inputs[0] = (link_input_t){ .name = "<start>", .data = start, .length = start_length };
+
+    for (uint32_t i = 0; i < count; i++) {
+        l.inputs[i + 1] = (link_input_t){ .name = objects[i].name, .data = objects[i].data, .length = objects[i].length };
+    }
+
+    uint32_t global_count = 0;
+
+    for (uint32_t i = 0; i < l.count; i++) {
+        if (!input_read (&l.inputs[i])) {
+            clv_error ("%s: not an object the linker can read", l.inputs[i].name);
+            goto cleanup;
+        }
+
+        global_count += l.inputs[i].sym_count;
+    }
+
+    // at most half full
+    uint32_t capacity = 16;
+
+    while (capacity < global_count * 2) {
+        capacity *= 2;
+    }
+
+    if ((l.globals = clv_calloc (CLV_TAG_NATIVE, capacity, sizeof (*l.globals))) == NULL) {
+        goto cleanup;
+    }
+
+    l.global_mask = capacity - 1;
+
+    for (uint32_t i = 0; i < l.count; i++) {
+        link_input_t *in = &l.inputs[i];
+
+        for (uint32_t k = 0; k < in->sym_count; k++) {
+            const elf_sym_t *sym = &in->syms[k];
+
+            if (sym->info >> 4 != STB_GLOBAL || sym->shndx == SHN_UNDEF) {
+                continue;
+            }
+
+            link_global_t *g = linker_lookup (&l, symbol_name (in, sym));
+
+            if (g->name != NULL) {
+                clv_error ("%s: '%s' is already defined in %s", in->name, symbol_name (in, sym),
+                           l.inputs[g->input].name);
+                goto cleanup;
+            }
+
+            *g = (link_global_t){ .name = symbol_name (in, sym), .input = i, .symbol = k };
+        }
+
+        // sections of a kind follow each other, in the order of objects
+        for (uint32_t k = 0; k < in->shnum; k++) {
+            int kind = in->kinds[k];
+
+            if (kind >= 0) {
+                uint64_t align = (in->shdrs[k].addralign > 1) ? in->shdrs[k].addralign : 1;
+
+                if (align & (align - 1)) {
+                    clv_error ("%s: not an object the linker can read", in->name);
+                    goto cleanup;
+                }
+
+                l.sizes[kind] = ELF_ALIGN (l.sizes[kind], align);
+                in->bases[k] = l.sizes[kind];
+                l.sizes[kind] += in->shdrs[k].size;
+                l.aligns[kind] = (align > l.aligns[kind]) ? align : l.aligns[kind];
+            }
+        }
+    }
+
+    // file offsets, and addresses of what is loaded: the bss starts on the
+    // page after the rest, and isn't in the file
+    uint32_t phnum = (l.sizes[CLV_ELF_BSS] > 0) ? 3 : 2;
+    uint64_t offset = sizeof (elf_ehdr_t) + phnum * sizeof (elf_phdr_t);
+
+    for (int s = 0; s < CLV_ELF_SECTION_COUNT; s++) {
+        uint64_t align = (l.aligns[s] > 16) ? l.aligns[s] : 16;
+
+        if (s == CLV_ELF_BSS) {
+            l.offsets[s] = offset;
+            l.addrs[s] = ELF_ALIGN (ELF_BASE + offset, ELF_PAGE) + (offset & (ELF_PAGE - 1));
+            l.addrs[s] = ELF_ALIGN (l.addrs[s], align);
+            continue;
+        }
+
+        l.offsets[s] = offset = ELF_ALIGN (offset, align);
+        l.addrs[s] = (sections[s].flags & SHF_ALLOC) ? ELF_BASE + offset : 0;
+        offset += l.sizes[s];
+    }
+
+    uint64_t start_address;
+
+    link_global_t *g = linker_lookup (&l, "_start");
+
+    good = g->name != NULL && linker_check_reachable (&l) && symbol_address (&l, g->input, g->symbol, &start_address)
+        && exec_write (&l, start_address, output);
+
+cleanup:
+    for (uint32_t i = 0; i < l.count; i++) {
+        clv_free (l.inputs[i].kinds);
+        clv_free (l.inputs[i].bases);
+    }
+
+    clv_free (l.inputs);
+    clv_free (l.globals);
+    clv_free (start);
+
+    if (!good) {
+        errno = EINVAL;
+    }
+
+    return good;
+}
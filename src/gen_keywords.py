@@ -0,0 +1,112 @@
+#!/usr/bin/env python3
+#
+# Generates a perfect hash table for the keywords listed in keywords.in.
+#
+# The hash only looks at the length, the first, second and last character
+# of a word:
+#
+#   h = (first * A + second * B + last * C + length) & (SIZE - 1)
+#
+# The second character is needed because "type" and "true" agree on the
+# length and on both ends. A, B, C and SIZE are searched for here, so that
+# no two keywords share a slot. Lookups then cost one hash and a single
+# memcmp.
+#
+# Usage: gen_keywords.py <keywords.in> <keywords.h>
+
+import sys
+
+
+def parse(path):
+    keywords = []
+
+    with open(path) as fp:
+        for line in fp:
+            line = line.split('#', 1)[0].strip()
+
+            if line:
+                word, token = line.split()
+                keywords.append((word, token))
+
+    return keywords
+
+
+def slot(word, a, b, c, size):
+    return (ord(word[0]) * a + ord(word[1]) * b + ord(word[-1]) * c + len(word)) & (size - 1)
+
+
+def search(keywords):
+    size = 1
+
+    while size < len(keywords):
+        size *= 2
+
+    if min(len(word) for word, _ in keywords) < 2:
+        sys.exit('gen_keywords.py: keywords must have at least two characters')
+
+    while size <= 1024:
+        for a in range(1, 64):
+            for b in range(1, 64):
+                for c in range(1, 64):
+                    slots = {slot(word, a, b, c, size) for word, _ in keywords}
+
+                    if len(slots) == len(keywords):
+                        return a, b, c, size
+
+        size *= 2
+
+    sys.exit('gen_keywords.py: no perfect hash found')
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit('usage: gen_keywords.py <keywords.in> <keywords.h>')
+
+    keywords = parse(sys.argv[1])
+    a, b, c, size = search(keywords)
+
+    table = [None] * size
+
+    for word, token in keywords:
+        table[slot(word, a, b, c, size)] = (word, token)
+
+    lengths = [len(word) for word, _ in keywords]
+
+    out = []
+    out.append('/* Generated by gen_keywords.py from keywords.in, do not edit. */')
+    out.append('')
+    out.append('#ifndef CLOVER_KEYWORDS_H_')
+    out.append('#define CLOVER_KEYWORDS_H_')
+    out.append('')
+    out.append('#define KEYWORD_MIN_LENGTH      %d' % min(lengths))
+    out.append('#define KEYWORD_MAX_LENGTH      %d' % max(lengths))
+    out.append('#define KEYWORD_TABLE_SIZE      %d' % size)
+    out.append('')
+    out.append('#define keyword_hash(word,length) \\')
+    out.append('    (((uint32_t)(uint8_t)(word)[0] * %d + \\' % a)
+    out.append('      (uint32_t)(uint8_t)(word)[1] * %d + \\' % b)
+    out.append('      (uint32_t)(uint8_t)(word)[(length) - 1] * %d + \\' % c)
+    out.append('      (uint32_t)(length)) & %d)' % (size - 1))
+    out.append('')
+    out.append('static const struct {')
+    out.append('    char value[KEYWORD_MAX_LENGTH];')
+    out.append('    uint8_t length;')
+    out.append('    uint8_t type;')
+    out.append('} keyword_table[KEYWORD_TABLE_SIZE] = {')
+
+    for i, entry in enumerate(table):
+        if entry is not None:
+            word, token = entry
+            out.append('    [%d] = { "%s", %d, %s },' % (i, word, len(word), token))
+
+    out.append('};')
+    out.append('')
+    out.append('#endif /* CLOVER_KEYWORDS_H_ */')
+    out.append('')
+
+    with open(sys.argv[2], 'w') as fp:
+        fp.write('\n'.join(out))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,102 @@
+#include <clover/hash.h>
+
+#include <string.h>
+
+#define PRIME1      0x9e3779b185ebca87ULL
+#define PRIME2      0xc2b2ae3d27d4eb4fULL
+#define PRIME3      0x165667b19e3779f9ULL
+#define PRIME4      0x85ebca77c2b2ae63ULL
+#define PRIME5      0x27d4eb2f165667c5ULL
+
+
+static inline uint64_t
+rotl (uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+
+static inline uint64_t
+read64 (const uint8_t *p) {
+    uint64_t value;
+
+    memcpy (&value, p, sizeof (value));
+
+    return value;
+}
+
+
+static inline uint32_t
+read32 (const uint8_t *p) {
+    uint32_t value;
+
+    memcpy (&value, p, sizeof (value));
+
+    return value;
+}
+
+
+static inline uint64_t
+hash_round (uint64_t acc, uint64_t input) {
+    return rotl (acc + input * PRIME2, 31) * PRIME1;
+}
+
+
+static inline uint64_t
+hash_merge (uint64_t acc, uint64_t lane) {
+    return (acc ^ hash_round (0, lane)) * PRIME1 + PRIME4;
+}
+
+
+uint64_t
+clv_hash64 (const void *data, size_t length, uint64_t seed) {
+    const uint8_t *p = data;
+    const uint8_t *end = p + length;
+    uint64_t h;
+
+    // four independent lanes over 32 byte stripes
+    if (length >= 32) {
+        uint64_t v1 = seed + PRIME1 + PRIME2;
+        uint64_t v2 = seed + PRIME2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - PRIME1;
+
+        do {
+            v1 = hash_round (v1, read64 (p));
+            v2 = hash_round (v2, read64 (p + 8));
+            v3 = hash_round (v3, read64 (p + 16));
+            v4 = hash_round (v4, read64 (p + 24));
+            p += 32;
+        } while (end - p >= 32);
+
+        h = rotl (v1, 1) + rotl (v2, 7) + rotl (v3, 12) + rotl (v4, 18);
+        h = hash_merge (h, v1);
+        h = hash_merge (h, v2);
+        h = hash_merge (h, v3);
+        h = hash_merge (h, v4);
+    } else {
+        h = seed + PRIME5;
+    }
+
+    h += length;
+
+    for (; end - p >= 8; p += 8) {
+        h = rotl (h ^ hash_round (0, read64 (p)), 27) * PRIME1 + PRIME4;
+    }
+
+    if (end - p >= 4) {
+        h = rotl (h ^ (read32 (p) * PRIME1), 23) * PRIME2 + PRIME3;
+        p += 4;
+    }
+
+    for (; p < end; p++) {
+        h = rotl (h ^ (*p * PRIME5), 11) * PRIME1;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+
+    return h;
+}
@@ -0,0 +1,315 @@
+#include <clover/interface.h>
+#include <clover/hash.h>
+#include <clover/alloc.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#define INTERFACE_MAGIC     0x49564c43      /* "CLVI" */
+#define INTERFACE_FORMAT    1
+
+/* Tells keys of interfaces apart from those of the modules of the same
+ * source */
+#define INTERFACE_SEED      0x6966616365ull
+
+
+/* Interfaces are laid out as the header, then the imports, the exports,
+ * the types of the params of all exports, and the string table, so they
+ * are read where mapped. Names are offsets into the string table, where
+ * each is NUL terminated and stored once. */
+typedef struct {
+    uint32_t magic;
+    uint32_t format;
+    uint64_t hash;          /* of the source */
+    uint32_t import_count;
+    uint32_t export_count;
+    uint32_t param_count;
+    uint32_t string_length;
+} interface_header_t;
+
+
+typedef struct {
+    uint32_t name;
+    uint32_t length;
+} interface_import_t;
+
+
+typedef struct {
+    uint32_t name;
+    uint32_t length;
+    uint32_t params;        /* index of the type of the first */
+    uint32_t arity;
+    uint8_t result;
+    uint8_t reserved[3];
+} interface_export_t;
+
+
+struct clv_interface {
+    const void *data;
+    size_t length;
+
+    const interface_header_t *header;
+    const interface_import_t *imports;
+    const interface_export_t *exports;
+    const uint8_t *params;
+    const char *strings;
+};
+
+
+/* Strings of an interface being written, each added once */
+typedef struct {
+    const char **names;
+    uint32_t *lengths;
+    uint32_t *offsets;
+    uint32_t count;
+
+    /* open addressing, string index + 1 or 0 for free slots */
+    uint32_t *table;
+    uint32_t table_mask;
+
+    uint32_t length;
+} interface_strings_t;
+
+
+/* Returns the offset of `name` in the string table */
+static uint32_t
+strings_add (interface_strings_t *s, const char *name, uint32_t length) {
+    uint32_t slot = clv_hash64 (name, length, 0);
+
+    for (;; slot++) {
+        uint32_t index = s->table[slot & s->table_mask];
+
+        if (index == 0) {
+            break;
+        }
+
+        if (s->lengths[index - 1] == length && memcmp (s->names[index - 1], name, length) == 0) {
+            return s->offsets[index - 1];
+        }
+    }
+
+    s->table[slot & s->table_mask] = s->count + 1;
+    s->names[s->count] = name;
+    s->lengths[s->count] = length;
+    s->offsets[s->count++] = s->length;
+    s->length += length + 1;
+
+    return s->offsets[s->count - 1];
+}
+
+
+uint64_t
+clv_interface_key (uint64_t hash) {
+    return clv_hash64 (&hash, sizeof (hash), INTERFACE_SEED);
+}
+
+
+bool
+clv_interface_save (uint64_t hash, const clv_str *imports, uint32_t import_count, const clv_export_t *exports,
+                    uint32_t export_count, void **out_data, size_t *out_length) {
+    uint32_t count = import_count + export_count;
+    uint32_t capacity = 16;
+
+    // at most half full
+    while (capacity < count * 2) {
+        capacity *= 2;
+    }
+
+    interface_strings_t s = {
+        .names = clv_alloc (CLV_TAG_LOADER, count * sizeof (*s.names)),
+        .lengths = clv_alloc (CLV_TAG_LOADER, count * sizeof (*s.lengths)),
+        .offsets = clv_alloc (CLV_TAG_LOADER, count * sizeof (*s.offsets)),
+        .table = clv_calloc (CLV_TAG_LOADER, capacity, sizeof (*s.table)),
+        .table_mask = capacity - 1
+    };
+
+    interface_import_t *import_records = clv_alloc (CLV_TAG_LOADER, import_count * sizeof (*import_records));
+    interface_export_t *export_records = clv_alloc (CLV_TAG_LOADER, export_count * sizeof (*export_records));
+    uint8_t *data = NULL;
+    uint32_t param_count = 0;
+
+    if (s.table == NULL || ((s.names == NULL || s.lengths == NULL || s.offsets == NULL) && count > 0)
+        || (import_records == NULL && import_count > 0) || (export_records == NULL && export_count > 0)) {
+        goto cleanup;
+    }
+
+    for (uint32_t i = 0; i < import_count; i++) {
+        uint32_t length = strlen (imports[i]);
+
+        import_records[i] = (interface_import_t){ .name = strings_add (&s, imports[i], length), .length = length };
+    }
+
+    for (uint32_t i = 0; i < export_count; i++) {
+        export_records[i] = (interface_export_t){
+            .name = strings_add (&s, exports[i].name, exports[i].length),
+            .length = exports[i].length,
+            .params = param_count,
+            .arity = exports[i].arity,
+            .result = exports[i].result
+        };
+
+        param_count += exports[i].arity;
+    }
+
+    // strings start aligned, as do the records of mappings
+    size_t params = sizeof (interface_header_t) + import_count * sizeof (*import_records)
+        + export_count * sizeof (*export_records);
+    size_t strings = params + ((param_count + 7) & ~7u);
+    size_t length = strings + s.length;
+
+    if ((data = clv_calloc (CLV_TAG_LOADER, 1, length)) == NULL) {
+        goto cleanup;
+    }
+
+    *(interface_header_t *)data = (interface_header_t){
+        .magic = INTERFACE_MAGIC,
+        .format = INTERFACE_FORMAT,
+        .hash = hash,
+        .import_count = import_count,
+        .export_count = export_count,
+        .param_count = param_count,
+        .string_length = s.length
+    };
+
+    uint8_t *p = data + sizeof (interface_header_t);
+
+    memcpy (p, import_records, import_count * sizeof (*import_records));
+    memcpy (p + import_count * sizeof (*import_records), export_records, export_count * sizeof (*export_records));
+
+    for (uint32_t i = 0; i < export_count; i++) {
+        memcpy (data + params + export_records[i].params, exports[i].params, exports[i].arity);
+    }
+
+    for (uint32_t i = 0; i < s.count; i++) {
+        memcpy (data + strings + s.offsets[i], s.names[i], s.lengths[i]);
+    }
+
+    *out_data = data;
+    *out_length = length;
+
+cleanup:
+    clv_free (s.names);
+    clv_free (s.lengths);
+    clv_free (s.offsets);
+    clv_free (s.table);
+    clv_free (import_records);
+    clv_free (export_records);
+
+    if (data == NULL) {
+        errno = ENOMEM;
+    }
+
+    return data != NULL;
+}
+
+
+/* Whether `name` is a NUL terminated string of the table */
+static inline bool
+interface_name (const clv_interface_t *self, uint32_t name, uint32_t length) {
+    uint32_t size = self->header->string_length;
+
+    return name < size && length < size - name && self->strings[name + length] == '\0';
+}
+
+
+clv_interface_t *
+clv_interface_open (clv_cache_t *cache, uint64_t hash) {
+    size_t length;
+    const uint8_t *data = clv_cache_map (cache, clv_interface_key (hash), &length);
+
+    if (data == NULL) {
+        return NULL;
+    }
+
+    const interface_header_t *header = (const interface_header_t *)data;
+    clv_interface_t *self = NULL;
+    bool good = length >= sizeof (*header) && header->magic == INTERFACE_MAGIC && header->format == INTERFACE_FORMAT
+        && header->hash == hash && header->import_count <= length && header->export_count <= length;
+
+    if (good) {
+        size_t params = sizeof (*header) + header->import_count * sizeof (interface_import_t)
+            + header->export_count * sizeof (interface_export_t);
+        size_t strings = params + (((size_t)header->param_count + 7) & ~(size_t)7);
+
+        good = strings + header->string_length == length && (self = clv_alloc (CLV_TAG_LOADER, sizeof (*self))) != NULL;
+
+        if (good) {
+            *self = (clv_interface_t){
+                .data = data,
+                .length = length,
+                .header = header,
+                .imports = (const interface_import_t *)(header + 1),
+                .exports = (const interface_export_t *)((const interface_import_t *)(header + 1) + header->import_count),
+                .params = data + params,
+                .strings = (const char *)data + strings
+            };
+        }
+    }
+
+    // checked once here, so lookups needn't
+    for (uint32_t i = 0; good && i < header->import_count; i++) {
+        good = interface_name (self, self->imports[i].name, self->imports[i].length);
+    }
+
+    for (uint32_t i = 0; good && i < header->export_count; i++) {
+        const interface_export_t *e = &self->exports[i];
+
+        good = interface_name (self, e->name, e->length) && e->params <= header->param_count
+            && e->arity <= header->param_count - e->params;
+    }
+
+    if (!good) {
+        clv_free (self);
+        clv_cache_unmap (data, length);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    return self;
+}
+
+
+uint32_t
+clv_interface_import_count (clv_interface_t *self) {
+    return self->header->import_count;
+}
+
+
+clv_str
+clv_interface_import (clv_interface_t *self, uint32_t index, uint32_t *out_length) {
+    *out_length = self->imports[index].length;
+
+    return self->strings + self->imports[index].name;
+}
+
+
+uint32_t
+clv_interface_export_count (clv_interface_t *self) {
+    return self->header->export_count;
+}
+
+
+clv_export_t
+clv_interface_export (clv_interface_t *self, uint32_t index) {
+    const interface_export_t *e = &self->exports[index];
+
+    return (clv_export_t){
+        .name = self->strings + e->name,
+        .length = e->length,
+        .arity = e->arity,
+        .params = self->params + e->params,
+        .result = e->result
+    };
+}
+
+
+void
+clv_interface_free (clv_interface_t *self) {
+    if (self == NULL) {
+        return;
+    }
+
+    clv_cache_unmap (self->data, self->length);
+    clv_free (self);
+}
@@ -0,0 +1,275 @@
+#include <clover/intern.h>
+#include <clover/arena.h>
+#include <clover/hash.h>
+#include <clover/alloc.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <errno.h>
+
+#define INTERN_SHARD_BITS       4
+#define INTERN_SHARDS           (1u << INTERN_SHARD_BITS)
+
+#define INTERN_MIN_SLOTS        256
+
+/* Entries of the first page of a shard. Each page is twice the size of the
+ * one before, so a few pages hold all the entries an atom can tell. */
+#define INTERN_PAGE_SIZE        256
+#define INTERN_MAX_PAGES        21
+
+/* Atoms are the entry index + 1 above the shard bits, so none is 0 */
+#define INTERN_MAX_ENTRIES      ((UINT32_MAX >> INTERN_SHARD_BITS) - 1)
+
+#define INTERN_ATOM(shard, index)   ((((index) + 1) << INTERN_SHARD_BITS) | (shard))
+#define INTERN_SHARD(atom)          ((atom) & (INTERN_SHARDS - 1))
+#define INTERN_INDEX(atom)          (((atom) >> INTERN_SHARD_BITS) - 1)
+
+
+typedef struct {
+    const char *string;
+    uint32_t length;
+    uint32_t hash;
+} intern_entry_t;
+
+
+typedef struct {
+    _Alignas (64) pthread_mutex_t lock;
+
+    clv_arena_t *arena;     /* of the strings */
+
+    /* open addressing: entry index + 1, or 0 for free slots, and the hash
+     * of the entry above, so probes rarely touch entries */
+    uint64_t *slots;
+    uint32_t mask;
+    uint32_t count;
+
+    /* entries never move, so atoms are read without the lock */
+    intern_entry_t *pages[INTERN_MAX_PAGES];
+} intern_shard_t;
+
+
+static intern_shard_t intern_shards[INTERN_SHARDS];
+static atomic_size_t intern_total;
+
+
+__attribute__ ((constructor (103)))
+static void
+intern_init () {
+    for (uint32_t i = 0; i < INTERN_SHARDS; i++) {
+        pthread_mutex_init (&intern_shards[i].lock, NULL);
+    }
+}
+
+
+static inline intern_entry_t *
+intern_entry (intern_shard_t *shard, uint32_t index) {
+    uint32_t page = 31 - __builtin_clz (index / INTERN_PAGE_SIZE + 1);
+
+    return &shard->pages[page][index - INTERN_PAGE_SIZE * ((1u << page) - 1)];
+}
+
+
+#define INTERN_SLOT(index, hash)    ((uint64_t)(hash) << 32 | ((index) + 1))
+#define INTERN_SLOT_INDEX(slot)     ((uint32_t)(slot) - 1)
+
+
+/* Returns the slot of `string`, or the free slot where it would go */
+static uint64_t *
+intern_probe (intern_shard_t *shard, const char *string, uint32_t length, uint32_t hash) {
+    for (uint32_t i = hash;; i++) {
+        uint64_t *slot = &shard->slots[i & shard->mask];
+
+        if (*slot == 0) {
+            return slot;
+        }
+
+        if ((*slot >> 32) != hash) {
+            continue;
+        }
+
+        intern_entry_t *entry = intern_entry (shard, INTERN_SLOT_INDEX (*slot));
+
+        if (entry->length == length && memcmp (entry->string, string, length) == 0) {
+            return slot;
+        }
+    }
+}
+
+
+static bool
+intern_rehash (intern_shard_t *shard, uint32_t capacity) {
+    uint64_t *slots = clv_calloc (CLV_TAG_INTERN, capacity, sizeof (*slots));
+
+    if (slots == NULL) {
+        return false;
+    }
+
+    for (uint32_t index = 0; index < shard->count; index++) {
+        uint32_t hash = intern_entry (shard, index)->hash;
+        uint32_t i = hash;
+
+        while (slots[i & (capacity - 1)] != 0) {
+            i++;
+        }
+
+        slots[i & (capacity - 1)] = INTERN_SLOT (index, hash);
+    }
+
+    clv_free (shard->slots);
+
+    shard->slots = slots;
+    shard->mask = capacity - 1;
+
+    return true;
+}
+
+
+/* Copies `string` into a new entry */
+static bool
+intern_add (intern_shard_t *shard, const char *string, uint32_t length, uint32_t hash, uint32_t *out_index) {
+    uint32_t index = shard->count;
+
+    if (index >= INTERN_MAX_ENTRIES) {
+        errno = EOVERFLOW;
+        return false;
+    }
+
+    if (shard->arena == NULL && (shard->arena = clv_arena_new (0)) == NULL) {
+        return false;
+    }
+
+    uint32_t page = 31 - __builtin_clz (index / INTERN_PAGE_SIZE + 1);
+
+    size_t size = (INTERN_PAGE_SIZE << page) * sizeof (intern_entry_t);
+
+    if (shard->pages[page] == NULL && (shard->pages[page] = clv_alloc (CLV_TAG_INTERN, size)) == NULL) {
+        return false;
+    }
+
+    char *copy = clv_arena_strndup (shard->arena, string, length);
+
+    if (copy == NULL) {
+        return false;
+    }
+
+    *intern_entry (shard, index) = (intern_entry_t){ .string = copy, .length = length, .hash = hash };
+
+    shard->count++;
+    atomic_fetch_add_explicit (&intern_total, 1, memory_order_relaxed);
+
+    *out_index = index;
+
+    return true;
+}
+
+
+clv_atom_t
+clv_intern (const char *string, size_t length) {
+    return clv_intern_hashed (string, length, clv_hash64 (string, length, 0));
+}
+
+
+clv_atom_t
+clv_intern_hashed (const char *string, size_t length, uint64_t hash) {
+    if (length > UINT32_MAX) {
+        errno = EOVERFLOW;
+        return CLV_ATOM_NONE;
+    }
+
+    uint32_t shard_index = hash >> (64 - INTERN_SHARD_BITS);
+    intern_shard_t *shard = &intern_shards[shard_index];
+    clv_atom_t atom = CLV_ATOM_NONE;
+
+    pthread_mutex_lock (&shard->lock);
+
+    if (shard->slots == NULL && !intern_rehash (shard, INTERN_MIN_SLOTS)) {
+        pthread_mutex_unlock (&shard->lock);
+        return CLV_ATOM_NONE;
+    }
+
+    uint64_t *slot = intern_probe (shard, string, length, hash);
+    uint32_t index;
+
+    if (*slot != 0) {
+        atom = INTERN_ATOM (shard_index, INTERN_SLOT_INDEX (*slot));
+    } else if (intern_add (shard, string, length, hash, &index)) {
+        *slot = INTERN_SLOT (index, (uint32_t)hash);
+        atom = INTERN_ATOM (shard_index, index);
+
+        // at most half full: a table that can't grow takes no more
+        if (shard->count * 2 > shard->mask && !intern_rehash (shard, (shard->mask + 1) * 2)) {
+            *slot = 0;
+            shard->count--;
+            atom = CLV_ATOM_NONE;
+        }
+    }
+
+    pthread_mutex_unlock (&shard->lock);
+
+    return atom;
+}
+
+
+clv_atom_t
+clv_intern_find (const char *string, size_t length) {
+    if (length > UINT32_MAX) {
+        return CLV_ATOM_NONE;
+    }
+
+    uint64_t hash = clv_hash64 (string, length, 0);
+    uint32_t shard_index = hash >> (64 - INTERN_SHARD_BITS);
+    intern_shard_t *shard = &intern_shards[shard_index];
+    clv_atom_t atom = CLV_ATOM_NONE;
+
+    pthread_mutex_lock (&shard->lock);
+
+    if (shard->slots != NULL) {
+        uint64_t *slot = intern_probe (shard, string, length, hash);
+
+        if (*slot != 0) {
+            atom = INTERN_ATOM (shard_index, INTERN_SLOT_INDEX (*slot));
+        }
+    }
+
+    pthread_mutex_unlock (&shard->lock);
+
+    return atom;
+}
+
+
+size_t
+clv_intern_count () {
+    return atomic_load_explicit (&intern_total, memory_order_relaxed);
+}
+
+
+clv_str
+clv_atom_string (clv_atom_t atom) {
+    if (atom == CLV_ATOM_NONE) {
+        return NULL;
+    }
+
+    return intern_entry (&intern_shards[INTERN_SHARD (atom)], INTERN_INDEX (atom))->string;
+}
+
+
+uint32_t
+clv_atom_length (clv_atom_t atom) {
+    if (atom == CLV_ATOM_NONE) {
+        return 0;
+    }
+
+    return intern_entry (&intern_shards[INTERN_SHARD (atom)], INTERN_INDEX (atom))->length;
+}
+
+
+uint32_t
+clv_atom_hash (clv_atom_t atom) {
+    if (atom == CLV_ATOM_NONE) {
+        return 0;
+    }
+
+    return intern_entry (&intern_shards[INTERN_SHARD (atom)], INTERN_INDEX (atom))->hash;
+}
@@ -0,0 +1,551 @@
+#include <clover/ir.h>
+#include <clover/alloc.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#define IR_MIN_CAPACITY     8
+
+
+static inline bool
+ir_is_jump (clv_opcode_t op) {
+    return op == CLV_OP_JMP || op == CLV_OP_JMPF || op == CLV_OP_JMPT
+        || op == CLV_OP_FORPREP || op == CLV_OP_FORLOOP;
+}
+
+
+/* Offset of the target of a jump, relative to the next instruction */
+static inline int32_t
+ir_jump_offset (clv_insn_t insn) {
+    return (CLV_INSN_OP (insn) == CLV_OP_JMP) ? CLV_INSN_SAX (insn) : CLV_INSN_SBX (insn);
+}
+
+
+static bool
+ir_reserve (clv_ir_block_t *block, uint32_t need) {
+    if (need <= block->capacity) {
+        return true;
+    }
+
+    uint32_t capacity = (block->capacity == 0) ? IR_MIN_CAPACITY : block->capacity;
+
+    while (capacity < need) {
+        capacity *= 2;
+    }
+
+    clv_ir_insn_t *insns = clv_realloc (CLV_TAG_OPTIMIZE, block->insns, capacity * sizeof (*insns));
+
+    if (insns == NULL) {
+        return false;
+    }
+
+    block->insns = insns;
+    block->capacity = capacity;
+
+    return true;
+}
+
+
+/* == Building == */
+
+
+static void
+ir_decode (clv_insn_t insn, const uint32_t *block_of, uint32_t pc, clv_ir_insn_t *out) {
+    clv_opcode_t op = CLV_INSN_OP (insn);
+
+    *out = (clv_ir_insn_t){ .op = op, .a = CLV_INSN_A (insn) };
+
+    if (ir_is_jump (op)) {
+        out->a = (op == CLV_OP_JMP) ? 0 : CLV_INSN_A (insn);
+        out->c = block_of[pc + 1 + ir_jump_offset (insn)];
+        return;
+    }
+
+    switch (clv_opcode_format (op)) {
+    case CLV_FMT_AB:
+        out->b = CLV_INSN_B (insn);
+        break;
+
+    case CLV_FMT_ABC:
+        out->b = CLV_INSN_B (insn);
+        out->c = CLV_INSN_C (insn);
+        break;
+
+    case CLV_FMT_ABSC:
+        out->b = CLV_INSN_B (insn);
+        out->c = CLV_INSN_SC (insn);
+        break;
+
+    case CLV_FMT_ABX:
+    case CLV_FMT_AK:
+        out->b = CLV_INSN_BX (insn);
+        break;
+
+    case CLV_FMT_ASBX:
+        out->c = CLV_INSN_SBX (insn);
+        break;
+
+    default:
+        break;
+    }
+}
+
+
+bool
+clv_ir_build (const clv_function_t *fn, clv_ir_fn_t *out_ir) {
+    uint32_t length = fn->code_length;
+    uint32_t *block_of = clv_calloc (CLV_TAG_OPTIMIZE, length + 1, sizeof (*block_of));
+
+    *out_ir = (clv_ir_fn_t){ .source = fn, .registers = fn->registers };
+
+    if (block_of == NULL) {
+        return false;
+    }
+
+    // leaders are marked with 1 first, then numbered
+    block_of[0] = 1;
+
+    for (uint32_t pc = 0; pc < length; pc++) {
+        clv_insn_t insn = fn->code[pc];
+
+        if (ir_is_jump (CLV_INSN_OP (insn))) {
+            block_of[pc + 1 + ir_jump_offset (insn)] = 1;
+            block_of[pc + 1] = 1;
+        } else if (CLV_INSN_OP (insn) == CLV_OP_RET) {
+            block_of[pc + 1] = 1;
+        }
+    }
+
+    uint32_t count = 0;
+
+    for (uint32_t pc = 0; pc < length; pc++) {
+        count += block_of[pc];
+        block_of[pc] = count - 1;
+    }
+
+    out_ir->blocks = clv_calloc (CLV_TAG_OPTIMIZE, count, sizeof (*out_ir->blocks));
+    out_ir->block_count = count;
+    out_ir->constant_count = fn->constant_count;
+    out_ir->constant_capacity = fn->constant_count;
+
+    if (fn->constant_count > 0) {
+        out_ir->constants = clv_alloc (CLV_TAG_OPTIMIZE, fn->constant_count * sizeof (*out_ir->constants));
+    }
+
+    if (out_ir->blocks == NULL || (out_ir->constants == NULL && fn->constant_count > 0)) {
+        clv_free (block_of);
+        clv_ir_free (out_ir);
+        return false;
+    }
+
+    if (fn->constant_count > 0) {
+        memcpy (out_ir->constants, fn->constants, fn->constant_count * sizeof (*out_ir->constants));
+    }
+
+    for (uint32_t pc = 0; pc < length; pc++) {
+        clv_ir_block_t *block = &out_ir->blocks[block_of[pc]];
+
+        if (!ir_reserve (block, block->count + 1)) {
+            clv_free (block_of);
+            clv_ir_free (out_ir);
+            return false;
+        }
+
+        ir_decode (fn->code[pc], block_of, pc, &block->insns[block->count]);
+        block->insns[block->count++].line = fn->lines[pc];
+    }
+
+    clv_free (block_of);
+
+    return true;
+}
+
+
+void
+clv_ir_free (clv_ir_fn_t *self) {
+    for (uint32_t i = 0; i < self->block_count; i++) {
+        clv_free (self->blocks[i].insns);
+    }
+
+    clv_free (self->blocks);
+    clv_free (self->constants);
+
+    self->blocks = NULL;
+    self->constants = NULL;
+    self->block_count = 0;
+}
+
+
+/* == Emission == */
+
+
+/* Whether the jump ending `block` goes where control would fall anyway */
+static bool
+ir_jump_redundant (clv_ir_fn_t *self, uint32_t block) {
+    clv_ir_block_t *b = &self->blocks[block];
+    clv_ir_insn_t *last = &b->insns[b->count - 1];
+
+    // testing a value never fails, so conditional jumps go too
+    if (last->op != CLV_OP_JMP && last->op != CLV_OP_JMPF && last->op != CLV_OP_JMPT) {
+        return false;
+    }
+
+    if ((uint32_t)last->c <= block) {
+        return false;
+    }
+
+    for (uint32_t i = block + 1; i < (uint32_t)last->c; i++) {
+        if (!self->blocks[i].dead && self->blocks[i].count > 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+static bool
+ir_encode (const clv_ir_insn_t *insn, uint32_t pc, const uint32_t *starts, clv_insn_t *out) {
+    clv_opcode_t op = insn->op;
+
+    if (ir_is_jump (op)) {
+        int64_t offset = (int64_t)starts[insn->c] - (pc + 1);
+
+        if (op == CLV_OP_JMP) {
+            if (offset < CLV_INSN_MIN_SAX || offset > CLV_INSN_MAX_SAX) {
+                return false;
+            }
+
+            *out = CLV_INSN_SAX_ (op, (uint32_t)offset & 0xffffff);
+            return true;
+        }
+
+        if (offset < CLV_INSN_MIN_SBX || offset > CLV_INSN_MAX_SBX) {
+            return false;
+        }
+
+        *out = CLV_INSN_ABX (op, insn->a, offset);
+        return true;
+    }
+
+    switch (clv_opcode_format (op)) {
+    case CLV_FMT_ABX:
+    case CLV_FMT_AK:
+        *out = CLV_INSN_ABX (op, insn->a, insn->b);
+        return true;
+
+    case CLV_FMT_ASBX:
+        *out = CLV_INSN_ABX (op, insn->a, insn->c);
+        return insn->c >= CLV_INSN_MIN_SBX && insn->c <= CLV_INSN_MAX_SBX;
+
+    default:
+        *out = CLV_INSN_ABC (op, insn->a, insn->b, insn->c);
+        return true;
+    }
+}
+
+
+bool
+clv_ir_emit (clv_ir_fn_t *self, clv_arena_t *arena, clv_function_t *out_fn) {
+    uint32_t *starts = clv_alloc (CLV_TAG_OPTIMIZE, (self->block_count + 1) * sizeof (*starts));
+    bool *drop = clv_calloc (CLV_TAG_OPTIMIZE, self->block_count + 1, sizeof (*drop));
+    uint32_t length = 0;
+
+    if (starts == NULL || drop == NULL) {
+        clv_free (starts);
+        clv_free (drop);
+        return false;
+    }
+
+    for (uint32_t i = 0; i < self->block_count; i++) {
+        clv_ir_block_t *block = &self->blocks[i];
+
+        starts[i] = length;
+
+        if (block->dead || block->count == 0) {
+            continue;
+        }
+
+        drop[i] = ir_jump_redundant (self, i);
+        length += block->count - drop[i];
+    }
+
+    clv_insn_t *code = clv_arena_alloc (arena, length * sizeof (*code));
+    uint32_t *lines = clv_arena_alloc (arena, length * sizeof (*lines));
+    clv_const_t *constants = NULL;
+    bool good = (code != NULL && lines != NULL);
+
+    if (good && self->constant_count > 0) {
+        if ((constants = clv_arena_alloc (arena, self->constant_count * sizeof (*constants))) != NULL) {
+            memcpy (constants, self->constants, self->constant_count * sizeof (*constants));
+        }
+
+        good = (constants != NULL);
+    }
+
+    uint32_t pc = 0;
+
+    for (uint32_t i = 0; good && i < self->block_count; i++) {
+        clv_ir_block_t *block = &self->blocks[i];
+
+        if (block->dead) {
+            continue;
+        }
+
+        for (uint32_t j = 0; good && j < block->count - (block->count > 0 && drop[i]); j++, pc++) {
+            lines[pc] = block->insns[j].line;
+
+            if (!ir_encode (&block->insns[j], pc, starts, &code[pc])) {
+                errno = ERANGE;
+                good = false;
+            }
+        }
+    }
+
+    clv_free (starts);
+    clv_free (drop);
+
+    if (!good) {
+        return false;
+    }
+
+    *out_fn = *self->source;
+    out_fn->registers = self->registers;
+    out_fn->code = code;
+    out_fn->lines = lines;
+    out_fn->code_length = length;
+    out_fn->constants = constants;
+    out_fn->constant_count = self->constant_count;
+
+    return true;
+}
+
+
+/* == Editing == */
+
+
+bool
+clv_ir_insert (clv_ir_fn_t *self, uint32_t block, uint32_t index, const clv_ir_insn_t *insns, uint32_t count) {
+    clv_ir_block_t *b = &self->blocks[block];
+
+    if (!ir_reserve (b, b->count + count)) {
+        return false;
+    }
+
+    memmove (&b->insns[index + count], &b->insns[index], (b->count - index) * sizeof (*insns));
+    memcpy (&b->insns[index], insns, count * sizeof (*insns));
+    b->count += count;
+
+    return true;
+}
+
+
+void
+clv_ir_remove (clv_ir_fn_t *self, uint32_t block, uint32_t index) {
+    clv_ir_block_t *b = &self->blocks[block];
+
+    memmove (&b->insns[index], &b->insns[index + 1], (b->count - index - 1) * sizeof (*b->insns));
+    b->count--;
+}
+
+
+uint32_t
+clv_ir_constant (clv_ir_fn_t *self, const clv_const_t *k) {
+    for (uint32_t i = 0; i < self->constant_count; i++) {
+        const clv_const_t *other = &self->constants[i];
+
+        if (other->type != k->type || other->module != k->module) {
+            continue;
+        }
+
+        // functions of other modules go by name
+        if (k->type == CLV_TYPE_STRING || k->module != 0) {
+            if (other->as.s.length == k->as.s.length && memcmp (other->as.s.data, k->as.s.data, k->as.s.length) == 0) {
+                return i;
+            }
+        } else if (memcmp (&other->as, &k->as, sizeof (k->as)) == 0) {
+            return i;
+        }
+    }
+
+    if (self->constant_count == self->constant_capacity) {
+        uint32_t capacity = (self->constant_capacity == 0) ? IR_MIN_CAPACITY : self->constant_capacity * 2;
+        clv_const_t *temp = clv_realloc (CLV_TAG_OPTIMIZE, self->constants, capacity * sizeof (*temp));
+
+        if (temp == NULL) {
+            return UINT32_MAX;
+        }
+
+        self->constants = temp;
+        self->constant_capacity = capacity;
+    }
+
+    // unused bytes of the union are compared above
+    memset (&self->constants[self->constant_count], 0, sizeof (*k));
+    self->constants[self->constant_count].type = k->type;
+    self->constants[self->constant_count].as = k->as;
+
+    return self->constant_count++;
+}
+
+
+/* == Queries == */
+
+
+uint32_t
+clv_ir_successors (clv_ir_fn_t *self, uint32_t block, uint32_t out_succ[2]) {
+    clv_ir_block_t *b = &self->blocks[block];
+    bool next = (block + 1 < self->block_count);
+
+    if (b->count == 0) {
+        out_succ[0] = block + 1;
+        return next;
+    }
+
+    clv_ir_insn_t *last = &b->insns[b->count - 1];
+
+    switch (last->op) {
+    case CLV_OP_RET:
+        return 0;
+
+    case CLV_OP_JMP:
+    case CLV_OP_FORPREP:
+        out_succ[0] = last->c;
+        return 1;
+
+    case CLV_OP_JMPF:
+    case CLV_OP_JMPT:
+    case CLV_OP_FORLOOP:
+        out_succ[0] = last->c;
+        out_succ[1] = block + 1;
+        return 1 + next;
+
+    default:
+        out_succ[0] = block + 1;
+        return next;
+    }
+}
+
+
+size_t
+clv_ir_length (clv_ir_fn_t *self) {
+    size_t length = 0;
+
+    for (uint32_t i = 0; i < self->block_count; i++) {
+        length += self->blocks[i].dead ? 0 : self->blocks[i].count;
+    }
+
+    return length;
+}
+
+
+void
+clv_ir_reads (const clv_ir_insn_t *insn, clv_ir_regs_t *out_regs) {
+    *out_regs = (clv_ir_regs_t){ 0 };
+
+    switch (insn->op) {
+    case CLV_OP_MOVE:
+    case CLV_OP_ADDI:
+    case CLV_OP_NEG:
+    case CLV_OP_NOT:
+    case CLV_OP_BNOT:
+    case CLV_OP_CAST:
+    case CLV_OP_TYPEOF:
+    case CLV_OP_UNWRAP:
+        CLV_IR_REGS_ADD (out_regs, insn->b);
+        break;
+
+    case CLV_OP_ADD: case CLV_OP_SUB: case CLV_OP_MUL: case CLV_OP_DIV: case CLV_OP_MOD:
+    case CLV_OP_BAND: case CLV_OP_BOR: case CLV_OP_BXOR: case CLV_OP_SHL: case CLV_OP_SHR:
+    case CLV_OP_EQ: case CLV_OP_NE: case CLV_OP_LT: case CLV_OP_LE:
+        CLV_IR_REGS_ADD (out_regs, insn->b);
+        CLV_IR_REGS_ADD (out_regs, (uint32_t)insn->c);
+        break;
+
+    case CLV_OP_SETGLOBAL:
+    case CLV_OP_JMPF:
+    case CLV_OP_JMPT:
+    case CLV_OP_FORPREP:
+        CLV_IR_REGS_ADD (out_regs, insn->a);
+        break;
+
+    case CLV_OP_FORLOOP:
+        CLV_IR_REGS_ADD (out_regs, insn->a);
+        CLV_IR_REGS_ADD (out_regs, insn->a + 1u);
+        break;
+
+    case CLV_OP_CALL:
+        for (uint32_t i = 0; i <= insn->b; i++) {
+            CLV_IR_REGS_ADD (out_regs, insn->a + i);
+        }
+
+        break;
+
+    case CLV_OP_RET:
+        if (insn->b != 0) {
+            CLV_IR_REGS_ADD (out_regs, insn->a);
+        }
+
+        break;
+
+    default:
+        break;
+    }
+}
+
+
+void
+clv_ir_writes (const clv_ir_insn_t *insn, clv_ir_regs_t *out_regs) {
+    *out_regs = (clv_ir_regs_t){ 0 };
+
+    switch (insn->op) {
+    case CLV_OP_SETGLOBAL:
+    case CLV_OP_JMP:
+    case CLV_OP_JMPF:
+    case CLV_OP_JMPT:
+    case CLV_OP_RET:
+        break;
+
+    case CLV_OP_FORPREP:
+        CLV_IR_REGS_ADD (out_regs, insn->a + 1u);
+        break;
+
+    case CLV_OP_FORLOOP:
+        CLV_IR_REGS_ADD (out_regs, insn->a + 1u);
+        CLV_IR_REGS_ADD (out_regs, insn->a + 2u);
+        break;
+
+    case CLV_OP_CALL:
+        for (uint32_t i = insn->a; i < CLV_INSN_MAX_REG; i++) {
+            CLV_IR_REGS_ADD (out_regs, i);
+        }
+
+        break;
+
+    default:
+        CLV_IR_REGS_ADD (out_regs, insn->a);
+        break;
+    }
+}
+
+
+bool
+clv_ir_pure (const clv_ir_insn_t *insn) {
+    switch (insn->op) {
+    case CLV_OP_MOVE:
+    case CLV_OP_LOADK:
+    case CLV_OP_LOADI:
+    case CLV_OP_LOADNIL:
+    case CLV_OP_LOADBOOL:
+    case CLV_OP_GETGLOBAL:
+    case CLV_OP_EQ:
+    case CLV_OP_NE:
+    case CLV_OP_NOT:
+    case CLV_OP_TYPEOF:
+        return true;
+
+    default:
+        return false;
+    }
+}
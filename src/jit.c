@@ -0,0 +1,626 @@
+#define _DEFAULT_SOURCE /* MAP_ANONYMOUS */
+
+#include <clover/jit.h>
+#include <clover/cpu.h>
+#include <clover/alloc.h>
+#include <clover/x86.h>
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+
+#if defined (__x86_64__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+
+struct clv_jit_code {
+    uint8_t *code;
+    size_t size;            /* mapped */
+    uint32_t *offsets;      /* of each instruction in the code */
+};
+
+
+#if defined (__x86_64__)
+
+/* Templates address values as [rbx + 16 * register] */
+_Static_assert (sizeof (clv_value_t) == 16, "values must take 16 bytes");
+_Static_assert (offsetof (clv_value_t, as) == 8, "payloads must follow the type");
+
+#define REG(x)              ((int32_t)(x) * 16)
+#define VAL(x)              ((int32_t)(x) * 16 + 8)
+
+#define JIT_NONE            UINT32_MAX
+
+/* Registers, as encoded in ModRM */
+#define RAX                 0
+#define RCX                 1
+#define RDX                 2
+#define RBX                 3
+
+/* Second byte of setcc */
+#define JIT_SETE            0x94
+#define JIT_SETNE           0x95
+#define JIT_SETL            0x9c
+#define JIT_SETLE           0x9e
+
+
+/* Code entered at `target`, with the registers in rbx */
+typedef uint32_t (*jit_entry_t) (clv_value_t *base, const void *target);
+
+
+/* A rel32 at `site` to patch with the address of instruction `pc` */
+typedef struct {
+    uint32_t site;
+    uint32_t pc;
+} jit_fixup_t;
+
+
+typedef struct {
+    jit_fixup_t *items;
+    uint32_t count;
+    uint32_t capacity;
+} jit_fixups_t;
+
+
+typedef struct {
+    clv_x86_buffer_t code;
+
+    jit_fixups_t jumps;     /* to other instructions */
+    jit_fixups_t exits;     /* back to the interpreter */
+
+    unsigned features;      /* CLV_CPU_* the templates may use */
+    uint32_t epilogue;
+} jit_buffer_t;
+
+
+/* == Emission == */
+
+
+/* Emits `op` with a [rbx + disp32] operand */
+static inline void
+emit_mem (jit_buffer_t *b, const char *op, size_t length, int reg, int32_t disp) {
+    clv_x86_mem (&b->code, op, length, reg, RBX, disp);
+}
+
+
+/* mov byte [rbx + disp], imm8 */
+static inline void
+emit_store_u8 (jit_buffer_t *b, int32_t disp, uint8_t value) {
+    emit_mem (b, "\xc6", 1, 0, disp);
+    clv_x86_u8 (&b->code, value);
+}
+
+
+/* cmp byte [rbx + disp], imm8 */
+static inline void
+emit_cmp_u8 (jit_buffer_t *b, int32_t disp, uint8_t value) {
+    emit_mem (b, "\x80", 1, 7, disp);
+    clv_x86_u8 (&b->code, value);
+}
+
+
+/* mov rax, imm64 */
+static inline void
+emit_load_address (jit_buffer_t *b, const void *address) {
+    clv_x86_bytes (&b->code, "\x48\xb8", 2);
+    clv_x86_u64 (&b->code, (uint64_t)(uintptr_t)address);
+}
+
+
+static inline void
+patch_here (jit_buffer_t *b, uint32_t site) {
+    clv_x86_patch (&b->code, site, b->code.length);
+}
+
+
+static void
+fixup_add (jit_buffer_t *b, jit_fixups_t *list, uint32_t site, uint32_t pc) {
+    if (list->count == list->capacity) {
+        uint32_t capacity = (list->capacity == 0) ? 64 : list->capacity * 2;
+        jit_fixup_t *temp = clv_realloc (CLV_TAG_JIT, list->items, capacity * sizeof (*temp));
+
+        if (temp == NULL) {
+            b->code.error = true;
+            return;
+        }
+
+        list->items = temp;
+        list->capacity = capacity;
+    }
+
+    list->items[list->count++] = (jit_fixup_t){ .site = site, .pc = pc };
+}
+
+
+/* Branches to the code of instruction `pc` */
+static inline void
+jit_jump (jit_buffer_t *b, uint8_t cc, uint32_t pc) {
+    fixup_add (b, &b->jumps, clv_x86_branch (&b->code, cc), pc);
+}
+
+
+/* Branches back to the interpreter, which resumes at `pc` */
+static inline void
+jit_exit (jit_buffer_t *b, uint8_t cc, uint32_t pc) {
+    fixup_add (b, &b->exits, clv_x86_branch (&b->code, cc), pc);
+}
+
+
+/* Leaves unless R(reg) is of `type` */
+static inline void
+jit_guard (jit_buffer_t *b, uint32_t reg, clv_type_t type, uint32_t pc) {
+    emit_cmp_u8 (b, REG (reg), type);
+    jit_exit (b, CLV_X86_JNE, pc);
+}
+
+
+/* == Templates == */
+
+
+static void
+jit_copy (jit_buffer_t *b, int32_t dst, int32_t src) {
+    emit_mem (b, "\xf3\x0f\x6f", 3, 0, src);    // movdqu xmm0, [src]
+    emit_mem (b, "\xf3\x0f\x7f", 3, 0, dst);    // movdqu [dst], xmm0
+}
+
+
+/* Copies between R(reg) and a value at a fixed address */
+static void
+jit_copy_absolute (jit_buffer_t *b, uint32_t reg, const clv_value_t *value, bool store) {
+    emit_load_address (b, value);
+
+    if (store) {
+        emit_mem (b, "\xf3\x0f\x6f", 3, 0, REG (reg));
+        clv_x86_bytes (&b->code, "\xf3\x0f\x7f\x00", 4);  // movdqu [rax], xmm0
+    } else {
+        clv_x86_bytes (&b->code, "\xf3\x0f\x6f\x00", 4);  // movdqu xmm0, [rax]
+        emit_mem (b, "\xf3\x0f\x7f", 3, 0, REG (reg));
+    }
+}
+
+
+/* R(a) = R(b) op R(c), for ints, and for floats when `float_op` is given */
+static void
+jit_arith (jit_buffer_t *b, clv_insn_t insn, uint32_t pc, const char *int_op, size_t length, const char *float_op) {
+    uint32_t a = CLV_INSN_A (insn);
+    uint32_t rb = CLV_INSN_B (insn);
+    uint32_t rc = CLV_INSN_C (insn);
+    uint32_t not_int = JIT_NONE;
+
+    if (float_op != NULL) {
+        emit_cmp_u8 (b, REG (rb), CLV_TYPE_INT);
+        not_int = clv_x86_branch (&b->code, CLV_X86_JNE);
+    } else {
+        jit_guard (b, rb, CLV_TYPE_INT, pc);
+    }
+
+    jit_guard (b, rc, CLV_TYPE_INT, pc);
+
+    emit_mem (b, "\x48\x8b", 2, RAX, VAL (rb));
+    emit_mem (b, int_op, length, RAX, VAL (rc));
+    emit_mem (b, "\x48\x89", 2, RAX, VAL (a));
+    emit_store_u8 (b, REG (a), CLV_TYPE_INT);
+
+    if (float_op == NULL) {
+        return;
+    }
+
+    uint32_t done = clv_x86_branch (&b->code, CLV_X86_JMP);
+
+    patch_here (b, not_int);
+    jit_guard (b, rb, CLV_TYPE_FLOAT, pc);
+    jit_guard (b, rc, CLV_TYPE_FLOAT, pc);
+
+    emit_mem (b, "\xf2\x0f\x10", 3, 0, VAL (rb));   // movsd xmm0, [b]
+    emit_mem (b, float_op, 3, 0, VAL (rc));
+    emit_mem (b, "\xf2\x0f\x11", 3, 0, VAL (a));    // movsd [a], xmm0
+    emit_store_u8 (b, REG (a), CLV_TYPE_FLOAT);
+
+    patch_here (b, done);
+}
+
+
+/* Quotient or remainder of ints, leaving zero and -1 divisors to the
+ * interpreter */
+static void
+jit_divide (jit_buffer_t *b, clv_insn_t insn, uint32_t pc, bool remainder) {
+    uint32_t a = CLV_INSN_A (insn);
+
+    jit_guard (b, CLV_INSN_B (insn), CLV_TYPE_INT, pc);
+    jit_guard (b, CLV_INSN_C (insn), CLV_TYPE_INT, pc);
+
+    emit_mem (b, "\x48\x8b", 2, RCX, VAL (CLV_INSN_C (insn)));
+    clv_x86_bytes (&b->code, "\x48\x85\xc9", 3);          // test rcx, rcx
+    jit_exit (b, CLV_X86_JE, pc);
+    clv_x86_bytes (&b->code, "\x48\x83\xf9\xff", 4);      // cmp rcx, -1
+    jit_exit (b, CLV_X86_JE, pc);
+
+    emit_mem (b, "\x48\x8b", 2, RAX, VAL (CLV_INSN_B (insn)));
+    clv_x86_bytes (&b->code, "\x48\x99\x48\xf7\xf9", 5);  // cqo; idiv rcx
+    emit_mem (b, "\x48\x89", 2, remainder ? RDX : RAX, VAL (a));
+    emit_store_u8 (b, REG (a), CLV_TYPE_INT);
+}
+
+
+/* `op` shifts rax by cl, and `bmi2_op` is the VEX prefix and opcode of
+ * the BMI2 form, shifting [rbx + disp] by rcx into rax */
+static void
+jit_shift (jit_buffer_t *b, clv_insn_t insn, uint32_t pc, const char *op, const char *bmi2_op) {
+    uint32_t a = CLV_INSN_A (insn);
+
+    jit_guard (b, CLV_INSN_B (insn), CLV_TYPE_INT, pc);
+    jit_guard (b, CLV_INSN_C (insn), CLV_TYPE_INT, pc);
+
+    emit_mem (b, "\x48\x8b", 2, RCX, VAL (CLV_INSN_C (insn)));
+
+    // shlx and sarx mask the count themselves, and leave flags alone
+    if (b->features & CLV_CPU_BMI2) {
+        emit_mem (b, bmi2_op, 4, RAX, VAL (CLV_INSN_B (insn)));
+    } else {
+        emit_mem (b, "\x48\x8b", 2, RAX, VAL (CLV_INSN_B (insn)));
+        clv_x86_bytes (&b->code, "\x83\xe1\x3f", 3);  // and ecx, 63
+        clv_x86_bytes (&b->code, op, 3);
+    }
+
+    emit_mem (b, "\x48\x89", 2, RAX, VAL (a));
+    emit_store_u8 (b, REG (a), CLV_TYPE_INT);
+}
+
+
+/* R(a) = R(b) cc R(c), for ints */
+static void
+jit_compare (jit_buffer_t *b, clv_insn_t insn, uint32_t pc, uint8_t setcc) {
+    uint32_t a = CLV_INSN_A (insn);
+
+    jit_guard (b, CLV_INSN_B (insn), CLV_TYPE_INT, pc);
+    jit_guard (b, CLV_INSN_C (insn), CLV_TYPE_INT, pc);
+
+    emit_mem (b, "\x48\x8b", 2, RAX, VAL (CLV_INSN_B (insn)));
+    emit_mem (b, "\x48\x3b", 2, RAX, VAL (CLV_INSN_C (insn)));
+    clv_x86_u8 (&b->code, 0x0f);
+    clv_x86_u8 (&b->code, setcc);
+    clv_x86_u8 (&b->code, 0xc0);                // setcc al
+    emit_mem (b, "\x88", 1, RAX, VAL (a));
+    emit_store_u8 (b, REG (a), CLV_TYPE_BOOL);
+}
+
+
+static void
+jit_unary (jit_buffer_t *b, clv_insn_t insn, uint32_t pc, const char *op) {
+    uint32_t a = CLV_INSN_A (insn);
+
+    jit_guard (b, CLV_INSN_B (insn), CLV_TYPE_INT, pc);
+
+    emit_mem (b, "\x48\x8b", 2, RAX, VAL (CLV_INSN_B (insn)));
+    clv_x86_bytes (&b->code, op, 3);
+    emit_mem (b, "\x48\x89", 2, RAX, VAL (a));
+    emit_store_u8 (b, REG (a), CLV_TYPE_INT);
+}
+
+
+/* Tests R(reg), nil and false being falsy, and returns three branches to
+ * patch: sites[0] is taken when falsy, sites[1] when truthy, and sites[2]
+ * when `jump_if`; anything else falls through. */
+static void
+jit_test (jit_buffer_t *b, uint32_t reg, bool jump_if, uint32_t sites[3]) {
+    emit_mem (b, "\x0f\xb6", 2, RAX, REG (reg));   // movzx eax, byte [reg]
+    clv_x86_u8 (&b->code, 0x3c);
+    clv_x86_u8 (&b->code, CLV_TYPE_NIL);            // cmp al, nil
+    sites[0] = clv_x86_branch (&b->code, CLV_X86_JE);
+    clv_x86_u8 (&b->code, 0x3c);
+    clv_x86_u8 (&b->code, CLV_TYPE_BOOL);           // cmp al, bool
+    sites[1] = clv_x86_branch (&b->code, CLV_X86_JNE);
+    emit_cmp_u8 (b, VAL (reg), 0);
+    sites[2] = clv_x86_branch (&b->code, jump_if ? CLV_X86_JNE : CLV_X86_JE);
+}
+
+
+static void
+jit_insn (jit_buffer_t *b, clv_insn_t insn, uint32_t pc, const clv_value_t *constants, clv_value_t *globals) {
+    uint32_t a = CLV_INSN_A (insn);
+    uint32_t sites[3];
+    uint32_t skip;
+
+    switch (CLV_INSN_OP (insn)) {
+    case CLV_OP_MOVE:
+        jit_copy (b, REG (a), REG (CLV_INSN_B (insn)));
+        break;
+
+    case CLV_OP_LOADK:
+        jit_copy_absolute (b, a, &constants[CLV_INSN_BX (insn)], false);
+        break;
+
+    case CLV_OP_LOADI:
+        emit_store_u8 (b, REG (a), CLV_TYPE_INT);
+        emit_mem (b, "\x48\xc7", 2, 0, VAL (a));
+        clv_x86_u32 (&b->code, (uint32_t)(int32_t)CLV_INSN_SBX (insn));
+        break;
+
+    case CLV_OP_LOADNIL:
+        emit_store_u8 (b, REG (a), CLV_TYPE_NIL);
+        break;
+
+    case CLV_OP_LOADBOOL:
+        emit_store_u8 (b, REG (a), CLV_TYPE_BOOL);
+        emit_store_u8 (b, VAL (a), CLV_INSN_B (insn) != 0);
+        break;
+
+    case CLV_OP_GETGLOBAL:
+        jit_copy_absolute (b, a, &globals[CLV_INSN_BX (insn)], false);
+        break;
+
+    case CLV_OP_SETGLOBAL:
+        jit_copy_absolute (b, a, &globals[CLV_INSN_BX (insn)], true);
+        break;
+
+    case CLV_OP_ADD:
+        jit_arith (b, insn, pc, "\x48\x03", 2, "\xf2\x0f\x58");
+        break;
+
+    case CLV_OP_SUB:
+        jit_arith (b, insn, pc, "\x48\x2b", 2, "\xf2\x0f\x5c");
+        break;
+
+    case CLV_OP_MUL:
+        jit_arith (b, insn, pc, "\x48\x0f\xaf", 3, "\xf2\x0f\x59");
+        break;
+
+    case CLV_OP_DIV:
+    case CLV_OP_MOD:
+        jit_divide (b, insn, pc, CLV_INSN_OP (insn) == CLV_OP_MOD);
+        break;
+
+    case CLV_OP_ADDI:
+        jit_guard (b, CLV_INSN_B (insn), CLV_TYPE_INT, pc);
+        emit_mem (b, "\x48\x8b", 2, RAX, VAL (CLV_INSN_B (insn)));
+        clv_x86_bytes (&b->code, "\x48\x05", 2);          // add rax, imm32
+        clv_x86_u32 (&b->code, (uint32_t)(int32_t)CLV_INSN_SC (insn));
+        emit_mem (b, "\x48\x89", 2, RAX, VAL (a));
+        emit_store_u8 (b, REG (a), CLV_TYPE_INT);
+        break;
+
+    case CLV_OP_BAND:
+        jit_arith (b, insn, pc, "\x48\x23", 2, NULL);
+        break;
+
+    case CLV_OP_BOR:
+        jit_arith (b, insn, pc, "\x48\x0b", 2, NULL);
+        break;
+
+    case CLV_OP_BXOR:
+        jit_arith (b, insn, pc, "\x48\x33", 2, NULL);
+        break;
+
+    case CLV_OP_SHL:
+        jit_shift (b, insn, pc, "\x48\xd3\xe0", "\xc4\xe2\xf1\xf7");
+        break;
+
+    case CLV_OP_SHR:
+        jit_shift (b, insn, pc, "\x48\xd3\xf8", "\xc4\xe2\xf2\xf7");
+        break;
+
+    case CLV_OP_EQ:
+        jit_compare (b, insn, pc, JIT_SETE);
+        break;
+
+    case CLV_OP_NE:
+        jit_compare (b, insn, pc, JIT_SETNE);
+        break;
+
+    case CLV_OP_LT:
+        jit_compare (b, insn, pc, JIT_SETL);
+        break;
+
+    case CLV_OP_LE:
+        jit_compare (b, insn, pc, JIT_SETLE);
+        break;
+
+    case CLV_OP_NEG:
+        jit_unary (b, insn, pc, "\x48\xf7\xd8");
+        break;
+
+    case CLV_OP_BNOT:
+        jit_unary (b, insn, pc, "\x48\xf7\xd0");
+        break;
+
+    case CLV_OP_NOT:
+        // the result is written once the operand has been read
+        jit_test (b, CLV_INSN_B (insn), false, sites);
+
+        patch_here (b, sites[1]);
+        emit_store_u8 (b, VAL (a), 0);
+        skip = clv_x86_branch (&b->code, CLV_X86_JMP);
+
+        patch_here (b, sites[0]);
+        patch_here (b, sites[2]);
+        emit_store_u8 (b, VAL (a), 1);
+
+        patch_here (b, skip);
+        emit_store_u8 (b, REG (a), CLV_TYPE_BOOL);
+        break;
+
+    case CLV_OP_JMP:
+        jit_jump (b, CLV_X86_JMP, pc + 1 + CLV_INSN_SAX (insn));
+        break;
+
+    case CLV_OP_JMPF:
+        jit_test (b, a, false, sites);
+        fixup_add (b, &b->jumps, sites[0], pc + 1 + CLV_INSN_SBX (insn));
+        fixup_add (b, &b->jumps, sites[2], pc + 1 + CLV_INSN_SBX (insn));
+        patch_here (b, sites[1]);
+        break;
+
+    case CLV_OP_JMPT:
+        jit_test (b, a, true, sites);
+        fixup_add (b, &b->jumps, sites[1], pc + 1 + CLV_INSN_SBX (insn));
+        fixup_add (b, &b->jumps, sites[2], pc + 1 + CLV_INSN_SBX (insn));
+        patch_here (b, sites[0]);
+        break;
+
+    case CLV_OP_FORLOOP:
+        // counting loops only, strings are left to the interpreter
+        jit_guard (b, a, CLV_TYPE_INT, pc);
+        emit_mem (b, "\x48\x8b", 2, RAX, VAL (a + 1));
+        emit_mem (b, "\x48\x3b", 2, RAX, VAL (a));
+        skip = clv_x86_branch (&b->code, CLV_X86_JGE);
+        clv_x86_bytes (&b->code, "\x48\x8d\x48\x01", 4);  // lea rcx, [rax + 1]
+        emit_mem (b, "\x48\x89", 2, RCX, VAL (a + 1));
+        emit_mem (b, "\x48\x89", 2, RAX, VAL (a + 2));
+        emit_store_u8 (b, REG (a + 2), CLV_TYPE_INT);
+        jit_jump (b, CLV_X86_JMP, pc + 1 + CLV_INSN_SBX (insn));
+        patch_here (b, skip);
+        break;
+
+    default:
+        // calls, returns, casts and the like
+        jit_exit (b, CLV_X86_JMP, pc);
+        break;
+    }
+}
+
+
+/* Maps `b` as read-only code, never writable and executable at once */
+static clv_jit_code_t *
+jit_map (jit_buffer_t *b, uint32_t *offsets) {
+    size_t page = sysconf (_SC_PAGESIZE);
+    size_t size = (b->code.length + page - 1) & ~(page - 1);
+
+    clv_jit_code_t *code = clv_alloc (CLV_TAG_JIT, sizeof (*code));
+    uint8_t *memory = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (code == NULL || memory == MAP_FAILED) {
+        clv_free (code);
+        return NULL;
+    }
+
+    memcpy (memory, b->code.data, b->code.length);
+
+    if (mprotect (memory, size, PROT_READ | PROT_EXEC) != 0) {
+        int error = errno;
+
+        munmap (memory, size);
+        clv_free (code);
+        errno = error;
+        return NULL;
+    }
+
+    *code = (clv_jit_code_t){ .code = memory, .size = size, .offsets = offsets };
+
+    return code;
+}
+
+
+clv_jit_code_t *
+clv_jit_compile (const clv_function_t *fn, const clv_value_t *constants, clv_value_t *globals, unsigned features) {
+    jit_buffer_t b = { .code = { .tag = CLV_TAG_JIT }, .features = features };
+    clv_jit_code_t *code = NULL;
+
+    uint32_t *offsets = clv_alloc (CLV_TAG_JIT, fn->code_length * sizeof (*offsets));
+    uint32_t *stubs = clv_alloc (CLV_TAG_JIT, fn->code_length * sizeof (*stubs));
+
+    if (offsets == NULL || stubs == NULL) {
+        goto cleanup;
+    }
+
+    // push rbx; mov rbx, rdi; jmp rsi
+    clv_x86_bytes (&b.code, "\x53\x48\x89\xfb\xff\xe6", 6);
+
+    // pop rbx; ret, with the resume instruction in eax
+    b.epilogue = b.code.length;
+    clv_x86_bytes (&b.code, "\x5b\xc3", 2);
+
+    for (uint32_t pc = 0; pc < fn->code_length; pc++) {
+        offsets[pc] = b.code.length;
+        stubs[pc] = JIT_NONE;
+
+        jit_insn (&b, fn->code[pc], pc, constants, globals);
+    }
+
+    // one stub per instruction that leaves: mov eax, pc; jmp epilogue
+    for (uint32_t i = 0; i < b.exits.count && !b.code.error; i++) {
+        jit_fixup_t *exit = &b.exits.items[i];
+
+        if (stubs[exit->pc] == JIT_NONE) {
+            stubs[exit->pc] = b.code.length;
+
+            clv_x86_u8 (&b.code, 0xb8);
+            clv_x86_u32 (&b.code, exit->pc);
+            clv_x86_patch (&b.code, clv_x86_branch (&b.code, CLV_X86_JMP), b.epilogue);
+        }
+
+        clv_x86_patch (&b.code, exit->site, stubs[exit->pc]);
+    }
+
+    for (uint32_t i = 0; i < b.jumps.count && !b.code.error; i++) {
+        clv_x86_patch (&b.code, b.jumps.items[i].site, offsets[b.jumps.items[i].pc]);
+    }
+
+    if (!b.code.error) {
+        code = jit_map (&b, offsets);
+    } else {
+        errno = ENOMEM;
+    }
+
+cleanup:
+    if (code == NULL) {
+        clv_free (offsets);
+    }
+
+    clv_free (stubs);
+    clv_free (b.code.data);
+    clv_free (b.jumps.items);
+    clv_free (b.exits.items);
+
+    return code;
+}
+
+
+uint32_t
+clv_jit_enter (clv_jit_code_t *self, clv_value_t *base, uint32_t pc) {
+    jit_entry_t entry = (jit_entry_t)(uintptr_t)self->code;
+
+    return entry (base, self->code + self->offsets[pc]);
+}
+
+
+#else /* !__x86_64__ */
+
+
+clv_jit_code_t *
+clv_jit_compile (const clv_function_t *fn, const clv_value_t *constants, clv_value_t *globals, unsigned features) {
+    errno = ENOTSUP;
+    return NULL;
+}
+
+
+uint32_t
+clv_jit_enter (clv_jit_code_t *self, clv_value_t *base, uint32_t pc) {
+    return pc;
+}
+
+
+#endif
+
+
+size_t
+clv_jit_size (clv_jit_code_t *self) {
+    return self->size;
+}
+
+
+void
+clv_jit_free (clv_jit_code_t *self) {
+    if (self == NULL) {
+        return;
+    }
+
+#if defined (__x86_64__)
+    munmap (self->code, self->size);
+#endif
+
+    clv_free (self->offsets);
+    clv_free (self);
+}
@@ -1,282 +1,364 @@
 #include <clover/lexer.h>
+#include <clover/scan.h>
+#include <clover/hash.h>
 #include <clover/log.h>
+#include <clover/alloc.h>
 
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
 #include <errno.h>
+#include <unistd.h>
 
-#define LEXER_ESCAPES           "abefnrtv\"\'\\"
-#define LEXER_ESCAPES_PAIR      "\a\b\e\f\n\r\t\v\'\\"
-#define LEXER_DELIMITERS        " .,:;()[]{}<>^'\"|/!?&%*-+=\r\n"
-
-#define LEXER_DIGITS            "0123456789"
+#include "keywords.h"
 
 #define LEXER_ID_MAX_LENGTH     63      /* 63 */
 
-#define LEXER_EOF               (-1)    /* end of file */
-#define LEXER_ERROR             0       /* syntax errors */
-#define LEXER_FOUND             1       /* found token */
-#define LEXER_NOT_FOUND         2       /* token not found, try next find function */
+#define LEXER_BYTES_PER_TOKEN   8       /* token stream size hint */
+
+#define LEXER_ATOM_CACHE        1024    /* names remembered by each lexer */
+
+#define LEXER_EOF               CLV_LEX_EOF
+#define LEXER_ERROR             CLV_LEX_ERROR
+#define LEXER_FOUND             CLV_LEX_FOUND
+
+
+/* Character classes. The class of the first byte of a token selects the
+ * scanner that consumes the rest of it. */
+enum {
+    LEX_C_INVALID,
+    LEX_C_BLANK,        /* \t space */
+    LEX_C_NEWLINE,      /* \r \n */
+    LEX_C_ALPHA,        /* keywords and identifiers */
+    LEX_C_DIGIT,        /* numbers */
+    LEX_C_QUOTE,        /* "string" */
+    LEX_C_APOSTROPHE,   /* 'c' */
+    LEX_C_SLASH,        /* comment or division */
+    LEX_C_LT,           /* < << */
+    LEX_C_GT,           /* > >> */
+    LEX_C_EQUAL,        /* = == */
+    LEX_C_SINGLE,       /* single character operators and symbols */
+    LEX_C_PAIR,         /* & && | || ! != */
+};
+
+/* Character flags */
+#define LEX_F_DELIMITER         (1 << 0)    /* ends a word */
+#define LEX_F_WORD              (1 << 1)    /* [A-Za-z0-9_] */
+#define LEX_F_DIGIT             (1 << 2)    /* [0-9] */
+#define LEX_F_XDIGIT            (1 << 3)    /* [0-9A-Fa-f] */
+#define LEX_F_BIN               (1 << 4)    /* [01] */
+#define LEX_F_ESCAPE            (1 << 5)    /* single character escapes */
+
+
+#define lex_class(ch)           (lex_classes[(uint8_t)(ch)])
+#define lex_flags(ch)           (lex_flags[(uint8_t)(ch)])
+#define lex_has(ch,flag)        ((lex_flags (ch) & (flag)) != 0)
+
+
+static const uint8_t lex_classes[256] = {
+    ['\t'] = LEX_C_BLANK,
+    [' ']  = LEX_C_BLANK,
+    ['\r'] = LEX_C_NEWLINE,
+    ['\n'] = LEX_C_NEWLINE,
+
+    ['a' ... 'z'] = LEX_C_ALPHA,
+    ['A' ... 'Z'] = LEX_C_ALPHA,
+    ['_']         = LEX_C_ALPHA,
+    ['0' ... '9'] = LEX_C_DIGIT,
+
+    ['"']  = LEX_C_QUOTE,
+    ['\''] = LEX_C_APOSTROPHE,
+    ['/']  = LEX_C_SLASH,
+    ['<']  = LEX_C_LT,
+    ['>']  = LEX_C_GT,
+    ['=']  = LEX_C_EQUAL,
+
+    ['&'] = LEX_C_PAIR,   ['|'] = LEX_C_PAIR,   ['^'] = LEX_C_SINGLE,
+    ['!'] = LEX_C_PAIR,   ['+'] = LEX_C_SINGLE, ['-'] = LEX_C_SINGLE,
+    ['*'] = LEX_C_SINGLE, ['%'] = LEX_C_SINGLE, ['.'] = LEX_C_SINGLE,
+    [','] = LEX_C_SINGLE, [':'] = LEX_C_SINGLE, [';'] = LEX_C_SINGLE,
+    ['?'] = LEX_C_SINGLE, ['('] = LEX_C_SINGLE, [')'] = LEX_C_SINGLE,
+    ['['] = LEX_C_SINGLE, [']'] = LEX_C_SINGLE, ['{'] = LEX_C_SINGLE,
+    ['}'] = LEX_C_SINGLE, ['~'] = LEX_C_SINGLE,
+};
+
+
+static const uint8_t lex_singles[256] = {
+    ['~'] = CLV_TOKEN_BIT_NOT,
+    ['&'] = CLV_TOKEN_BIT_AND,
+    ['|'] = CLV_TOKEN_BIT_OR,
+    ['^'] = CLV_TOKEN_BIT_XOR,
+    ['!'] = CLV_TOKEN_NOT,
+    ['+'] = CLV_TOKEN_PLUS,
+    ['-'] = CLV_TOKEN_MINUS,
+    ['*'] = CLV_TOKEN_MULTIPLY,
+    ['%'] = CLV_TOKEN_REMAINDER,
+    ['.'] = CLV_TOKEN_PERIOD,
+    [','] = CLV_TOKEN_COMMA,
+    [':'] = CLV_TOKEN_COLON,
+    [';'] = CLV_TOKEN_SEMICOLON,
+    ['?'] = CLV_TOKEN_QUESTIONMARK,
+    ['('] = CLV_TOKEN_LPARENTHESIS,
+    [')'] = CLV_TOKEN_RPARENTHESIS,
+    ['['] = CLV_TOKEN_LBRACKET,
+    [']'] = CLV_TOKEN_RBRACKET,
+    ['{'] = CLV_TOKEN_LBRACE,
+    ['}'] = CLV_TOKEN_RBRACE,
+};
+
+
+/* Operators that become another one when followed by `second` */
+static const struct lex_pair {
+    char second;
+    uint8_t type;
+} lex_pairs[256] = {
+    ['&'] = { '&', CLV_TOKEN_AND },
+    ['|'] = { '|', CLV_TOKEN_OR },
+    ['!'] = { '=', CLV_TOKEN_NE },
+};
+
+
+static const uint8_t lex_flags[256] = {
+    ['\0'] = LEX_F_DELIMITER | LEX_F_ESCAPE,
+    ['\r'] = LEX_F_DELIMITER,
+    ['\n'] = LEX_F_DELIMITER,
+    [' ']  = LEX_F_DELIMITER,
+
+    ['.'] = LEX_F_DELIMITER, [','] = LEX_F_DELIMITER, [':'] = LEX_F_DELIMITER,
+    [';'] = LEX_F_DELIMITER, ['('] = LEX_F_DELIMITER, [')'] = LEX_F_DELIMITER,
+    ['['] = LEX_F_DELIMITER, [']'] = LEX_F_DELIMITER, ['{'] = LEX_F_DELIMITER,
+    ['}'] = LEX_F_DELIMITER, ['<'] = LEX_F_DELIMITER, ['>'] = LEX_F_DELIMITER,
+    ['^'] = LEX_F_DELIMITER, ['|'] = LEX_F_DELIMITER, ['/'] = LEX_F_DELIMITER,
+    ['!'] = LEX_F_DELIMITER, ['?'] = LEX_F_DELIMITER, ['&'] = LEX_F_DELIMITER,
+    ['%'] = LEX_F_DELIMITER, ['*'] = LEX_F_DELIMITER, ['-'] = LEX_F_DELIMITER,
+    ['+'] = LEX_F_DELIMITER, ['='] = LEX_F_DELIMITER, ['~'] = LEX_F_DELIMITER,
+
+    ['"']  = LEX_F_DELIMITER | LEX_F_ESCAPE,
+    ['\''] = LEX_F_DELIMITER | LEX_F_ESCAPE,
+    ['\\'] = LEX_F_ESCAPE,
+
+    ['a'] = LEX_F_WORD | LEX_F_XDIGIT | LEX_F_ESCAPE,
+    ['b'] = LEX_F_WORD | LEX_F_XDIGIT | LEX_F_ESCAPE,
+    ['c'] = LEX_F_WORD | LEX_F_XDIGIT,
+    ['d'] = LEX_F_WORD | LEX_F_XDIGIT,
+    ['e'] = LEX_F_WORD | LEX_F_XDIGIT | LEX_F_ESCAPE,
+    ['f'] = LEX_F_WORD | LEX_F_XDIGIT | LEX_F_ESCAPE,
+    ['g' ... 'z'] = LEX_F_WORD,
+    ['A' ... 'F'] = LEX_F_WORD | LEX_F_XDIGIT,
+    ['G' ... 'Z'] = LEX_F_WORD,
+    ['0' ... '1'] = LEX_F_WORD | LEX_F_DIGIT | LEX_F_XDIGIT | LEX_F_BIN,
+    ['2' ... '9'] = LEX_F_WORD | LEX_F_DIGIT | LEX_F_XDIGIT,
+    ['_']         = LEX_F_WORD,
+
+    ['n'] = LEX_F_WORD | LEX_F_ESCAPE,
+    ['r'] = LEX_F_WORD | LEX_F_ESCAPE,
+    ['t'] = LEX_F_WORD | LEX_F_ESCAPE,
+    ['v'] = LEX_F_WORD | LEX_F_ESCAPE,
+};
 
 
-#define lex_at(st,index)        (clv_source_at ((st)->src, (index)))
-#define lex_offset(st,offset)   (clv_source_offset ((st)->src, (offset)))
+typedef struct {
+    uint32_t hash;          /* high half, the low one picks the entry */
+    clv_atom_t atom;
+} lex_atom_t;
 
 
 typedef struct {
-    clv_source_t *src;
+    clv_source_t *src;      /* NULL when streaming */
+    clv_str file;
 
-    uint32_t offset;
-    uint32_t prev_offset;
-    uint32_t line_offset;
+    const char *data;
+    const char *end;
 
-    uint32_t line;
-    uint32_t column;
-
-    struct {
-        uint32_t offset;
-        uint32_t prev_offset;
-        uint32_t line_offset;
+    uint32_t offset;
+    uint32_t line;          /* of `data`, when streaming */
 
-        uint32_t line;
-        uint32_t column;
-    } _save;
+    lex_atom_t atoms[LEXER_ATOM_CACHE];
 
     bool error;
 } lexer_state_t;
 
 
-typedef struct {
-    clv_str value;
-    size_t  length;
-    clv_tktype_t type;
-} lexer_pair_t;
+/* == Auxiliary Functions == */
 
 
-typedef int (*lexer_func_t)(lexer_state_t *st, clv_token_t *out_token);
+/* Counts the line breaks from `p` up to `end`, which is the start of a
+ * token, and finds the start of the last line. Breaks are counted the way
+ * clv_source_locate does. */
+static uint32_t
+lex_count_lines (const char *p, const char *end, const char **out_line_start) {
+    uint32_t lines = 0;
 
+    *out_line_start = p;
 
-/* == Auxiliary Functions == */
+    while ((p = clv_scan_any3 (p, '\n', '\r', '\0')) < end) {
+        if (*p == '\0') {
+            p++;
+            continue;
+        }
+
+        p += (p[0] == '\r' && p[1] == '\n') ? 2 : 1;
+
+        *out_line_start = p;
+        lines++;
+    }
+
+    return lines;
+}
+
+
+/* Finds where the byte at `offset` of the data is */
+static void
+lex_locate (const lexer_state_t *st, uint32_t offset, clv_location_t *out_location) {
+    if (st->src != NULL && clv_source_locate (st->src, offset, out_location)) {
+        return;
+    }
+
+    const char *line_start;
+    uint32_t lines = lex_count_lines (st->data, st->data + offset, &line_start);
+
+    *out_location = (clv_location_t){
+        .line = st->line + lines,
+        .column = st->data + offset - line_start + 1,
+        .line_offset = line_start - st->data
+    };
+}
 
 
+/* Reports an error at the current position */
 static void
 lex_error (lexer_state_t *st, clv_str msg, ...) {
     va_list args;
 
-    clv_str file = clv_source_get_file (st->src);
+    clv_log_record_t rec;
+    clv_location_t loc;
 
-    int length = strcspn (lex_offset (st, st->line_offset), "\r\n");
+    lex_locate (st, st->offset, &loc);
 
-    fprintf (stderr, "%s:%d:%d: ", file, st->line, st->column);
+    clv_str file = st->file;
+    clv_str line = st->data + loc.line_offset;
+
+    int length = strcspn (line, "\r\n");
+
+    clv_log_begin (&rec, CLV_ERROR);
+    clv_log_printf (&rec, "%s:%u:%u: ", file, loc.line, loc.column);
 
     va_start (args, msg);
-    vfprintf (stderr, msg, args);
+    clv_log_vprintf (&rec, msg, args);
     va_end (args);
 
-    putc ('\n', stderr);
-
-    fprintf (stderr, " %3d | ", st->line);
-    fwrite (lex_offset (st, st->line_offset), 1, length, stderr);
-    fputc ('\n', stderr);
+    clv_log_printf (&rec, "\n %3u | ", loc.line);
+    clv_log_append (&rec, line, length);
+    clv_log_append (&rec, "\n", 1);
+    clv_log_end (&rec);
 }
 
 
 static inline void
-lex_commit (lexer_state_t *st, clv_token_t *out_token, clv_tktype_t type) {
+lex_commit (lexer_state_t *st, clv_token_t *out_token, clv_tktype_t type, const char *end) {
+    uint32_t length = end - (st->data + st->offset);
+
     *out_token = (clv_token_t){
         .type = type,
-        .offset = st->prev_offset,
-        .line_offset = st->line_offset,
-        .length = st->offset - st->prev_offset,
-        .line = st->line,
-        .column = st->column
+        .length = length,
+        .offset = st->offset
     };
 
     // commit lexer state
-    st->column += st->offset - st->prev_offset;
-    st->prev_offset = st->offset;
-}
-
-
-static inline bool
-lex_equal (lexer_state_t *st, clv_str string, int length) {
-    return strncmp (lex_offset (st, st->offset), string, length) == 0;
+    st->offset += length;
 }
 
 
-static inline bool
-lex_arity (lexer_state_t *st, int length) {
-    return st->offset + length <= clv_source_length (st->src);
-}
-
+static inline const char *
+lex_skip_word (const char *p) {
+    // the NUL terminator past the end is a delimiter, too
+    while (!lex_has (*p, LEX_F_DELIMITER)) {
+        p++;
+    }
 
-static void
-lex_save (lexer_state_t *st) {
-    st->_save.offset = st->offset;
-    st->_save.line_offset = st->line_offset;
-    st->_save.prev_offset = st->prev_offset;
-    st->_save.line = st->line;
-    st->_save.column = st->column;
+    return p;
 }
 
 
-static void
-lex_restore (lexer_state_t *st) {
-    st->offset = st->_save.offset;
-    st->line_offset = st->_save.line_offset;
-    st->prev_offset = st->_save.prev_offset;
-    st->line = st->_save.line;
-    st->column = st->_save.column;
+static inline bool
+lex_isblank (char ch) {
+    return lex_class (ch) == LEX_C_BLANK || lex_class (ch) == LEX_C_NEWLINE;
 }
 
 
 static void
 lex_skip_blank (lexer_state_t *st) {
-    int count;
-
-    for (int left = 2; left > 0; left--) {
-        if (!lex_arity (st, 1)) {
-            break;
-        }
-
-        count = strspn (lex_offset (st, st->offset), "\t ");
-
-        if (count > 0) {
-            st->offset += count;
-            st->column += count;
-
-            left = 2;
-            continue;
-        }
+    const char *p = st->data + st->offset;
 
-        count = strspn (lex_offset (st, st->offset), "\r\n");
-
-        if (count > 0) {
-            st->offset += count;
-            st->line_offset = st->offset;
-            st->line += count;
-            st->column = 1;
-
-            left = 2;
-            continue;
-        }
+    if (!lex_isblank (p[0])) {
+        return;
     }
 
-    st->prev_offset = st->offset;
-}
-
+    // most tokens are separated by a single space
+    if (p[0] == ' ' && !lex_isblank (p[1])) {
+        st->offset++;
+        return;
+    }
 
-static inline bool
-lex_isalpha (char ch) {
-    return ((ch >= 'a' && ch <= 'z') ||
-            (ch >= 'A' && ch <= 'Z'));
+    st->offset = clv_scan_blank (p) - st->data;
 }
 
 
-static inline bool
-lex_isalnum (char ch) {
-    return ((ch >= '0' && ch <= '9') ||
-            (ch >= 'a' && ch <= 'z') ||
-            (ch >= 'A' && ch <= 'Z'));
-}
-
+static inline clv_tktype_t
+lex_keyword (const char *word, size_t length) {
+    if (length < KEYWORD_MIN_LENGTH || length > KEYWORD_MAX_LENGTH) {
+        return CLV_TOKEN_IDENTIFIER;
+    }
 
-static inline bool
-lex_isdigit (char ch) {
-    return (ch >= '0' && ch <= '9');
-}
+    uint32_t slot = keyword_hash (word, length);
 
+    if (keyword_table[slot].length == length && memcmp (keyword_table[slot].value, word, length) == 0) {
+        return keyword_table[slot].type;
+    }
 
-static inline bool
-lex_isxdigit (char ch) {
-    return ((ch >= '0' && ch <= '9') ||
-            (ch >= 'a' && ch <= 'f') ||
-            (ch >= 'A' && ch <= 'F'));
+    return CLV_TOKEN_IDENTIFIER;
 }
 
 
 /* == Validation Functions == */
 
 
-static bool
-lex_check_escape (lexer_state_t *st) {
-    char ch = lex_at (st, st->offset);
-
-    bool found = true;
+static const char *
+lex_check_escape (lexer_state_t *st, const char *p) {
+    int digits = 0;
 
-    if (strchr (LEXER_ESCAPES, ch) != NULL) {
-        st->offset += 1;
-    } else if (ch == 'x' || ch == 'X') { /* \xHH */
-        st->offset += 1;
-
-        for (int i = 0; i < 2; i++) {
-            ch = lex_at (st, st->offset + i);
-
-            if (!lex_isxdigit (ch)) {
-                found = false;
-                break;
-            }
-        }
-
-        st->offset += 2;
-    } else if (ch == 'u') { /* \uHHHH */
-        st->offset += 1;
-
-        for (int i = 0; i < 4; i++) {
-            ch = lex_at (st, st->offset + i);
-
-            if (!lex_isxdigit (ch)) {
-                found = false;
-                break;
-            }
-        }
-
-        st->offset += 4;
-    } else if (ch == 'U') { /* \UHHHHHHHH */
-        st->offset += 1;
+    if (lex_has (*p, LEX_F_ESCAPE)) {
+        return p + 1;
+    } else if (*p == 'x' || *p == 'X') { /* \xHH */
+        digits = 2;
+    } else if (*p == 'u') { /* \uHHHH */
+        digits = 4;
+    } else if (*p == 'U') { /* \UHHHHHHHH */
+        digits = 8;
+    }
 
-        for (int i = 0; i < 8; i++) {
-            ch = lex_at (st, st->offset + i);
+    p++;
 
-            if (!lex_isxdigit (ch)) {
-                found = false;
-                break;
-            }
+    for (int i = 0; i < digits; i++) {
+        if (p + i >= st->end || !lex_has (p[i], LEX_F_XDIGIT)) {
+            digits = 0;
+            break;
         }
-
-        st->offset += 8;
-    } else {
-        found = false;
     }
 
-    if (!found) {
+    if (digits == 0) {
         lex_error (st, "invalid escape sequence");
+        return NULL;
     }
 
-    return found;
+    return p + digits;
 }
 
 
 static bool
-lex_check_identifier (lexer_state_t *st) {
-    char ch = lex_at (st, st->prev_offset);
-
-    if (!(lex_isalpha (ch) || ch == '_')) {
-        return false;
-    }
-
-    int length = st->offset - st->prev_offset - 1;
-
-    if (length > LEXER_ID_MAX_LENGTH) {
-        lex_error (st, "identifier is too long (%d). maximum length is %d.", length, LEXER_ID_MAX_LENGTH);
-        return false;
-    }
-
-    for (int i = 0; i < length; i++) {
-        ch = lex_at (st, st->prev_offset + i + 1);
-
-        if (!(lex_isalnum (ch) || ch == '_')) {
+lex_check_digits (lexer_state_t *st, const char *p, const char *end, int flag) {
+    for (; p < end; p++) {
+        if (!lex_has (*p, flag)) {
             lex_error (st, "invalid syntax");
             return false;
         }
@@ -286,527 +368,532 @@ lex_check_identifier (lexer_state_t *st) {
 }
 
 
-static bool
-lex_check_float (lexer_state_t *st) {
-    clv_debug ("%s: not implemented", __func__);
-    return true;
-}
-
-
-static bool
-lex_check_bin (lexer_state_t *st) {
-    if (clv_source_compare (st->src, "0b", st->prev_offset, 2) != 0) {
-        return false;
-    }
+/* == Scan Functions == */
 
-    int length = st->offset - st->prev_offset - 2;
 
-    for (int i = 0; i < length; i++) {
-        char ch = lex_at (st, st->prev_offset + i + 2);
+static int
+scan_comment (lexer_state_t *st, const char *p, clv_token_t *out_token) {
+    p = clv_scan_any3 (p, '\n', '\0', '\0');
 
-        if (!(ch == '0' || ch == '1')) {
-            lex_error (st, "invalid syntax");
-            return false;
-        }
-    }
+    lex_commit (st, out_token, CLV_TOKEN_COMMENT, p);
 
-    return true;
+    return LEXER_FOUND;
 }
 
 
-static bool
-lex_check_hex (lexer_state_t *st) {
-    if (clv_source_compare (st->src, "0x", st->prev_offset, 2) != 0) {
-        return false;
-    }
-
-    int length = st->offset - st->prev_offset - 2;
-
-    for (int i = 0; i < length; i++) {
-        char ch = lex_at (st, st->prev_offset + i + 2);
+static int
+scan_string (lexer_state_t *st, const char *p, clv_token_t *out_token) {
+    while ((p = clv_scan_any3 (p, '"', '\\', '\0')) >= st->end || *p != '"') {
+        if (p >= st->end) {
+            lex_error (st, "unclosed string literal");
+            return LEXER_ERROR;
+        }
 
-        if (!lex_isxdigit (ch)) {
-            lex_error (st, "invalid syntax");
-            return false;
+        if (*p++ == '\\' && (p = lex_check_escape (st, p)) == NULL) {
+            return LEXER_ERROR;
         }
     }
 
-    return true;
+    lex_commit (st, out_token, CLV_TOKEN_STRING, p + 1);
+
+    return LEXER_FOUND;
 }
 
 
-static bool
-lex_check_int (lexer_state_t *st) {
-    int length = st->offset - st->prev_offset;
+static int
+scan_character (lexer_state_t *st, const char *p, clv_token_t *out_token) {
+    int num_chars = 0;
 
-    for (int i = 0; i < length; i++) {
-        char ch = lex_at (st, st->prev_offset + i);
+    const char *q;
 
-        if (!lex_isdigit (ch)) {
-            lex_error (st, "invalid syntax");
-            return false;
+    while ((q = clv_scan_any3 (p, '\'', '\\', '\0')) >= st->end || *q != '\'') {
+        if (q >= st->end) {
+            lex_error (st, "unclosed character literal");
+            return LEXER_ERROR;
         }
-    }
-
-    return true;
-}
-
-
-/* == Find Functions == */
 
+        num_chars += q - p + 1;
+        p = q + 1;
 
-static int
-find_comment (lexer_state_t *st, clv_token_t *out_token) {
-    if (!lex_arity (st, 2)) {
-        return LEXER_EOF;
+        if (*q == '\\' && (p = lex_check_escape (st, p)) == NULL) {
+            return LEXER_ERROR;
+        }
     }
 
-    if (!lex_equal (st, "//", 2)) {
-        return LEXER_NOT_FOUND;
-    }
+    num_chars += q - p;
+    p = q;
 
-    st->offset += strcspn (lex_offset (st, st->offset), "\n");
+    if (num_chars > 1) {
+        lex_error (st, "multiple characters in character literal");
+        return LEXER_ERROR;
+    }
 
-    lex_commit (st, out_token, CLV_TOKEN_COMMENT);
+    lex_commit (st, out_token, CLV_TOKEN_CHARACTER, p + 1);
 
     return LEXER_FOUND;
 }
 
 
 static int
-find_string (lexer_state_t *st, clv_token_t *out_token) {
-    if (!lex_arity (st, 1)) {
-        return LEXER_EOF;
-    }
+scan_word (lexer_state_t *st, const char *p, clv_token_t *out_token) {
+    const char *end = p + 1;
 
-    if (lex_at (st, st->offset) != '"') {
-        return LEXER_NOT_FOUND;
+    while (lex_has (*end, LEX_F_WORD)) {
+        end++;
     }
 
-    st->offset += 1;
-
-    while (lex_at (st, st->offset) != '"') {
-        if (!lex_arity (st, 1)) {
-            lex_error (st, "unclosed string literal");
-            return LEXER_EOF;
-        }
+    if (!lex_has (*end, LEX_F_DELIMITER)) {
+        lex_error (st, "invalid syntax");
+        return LEXER_ERROR;
+    }
 
-        if (lex_at (st, st->offset) == '\\') {
-            st->offset += 1;
+    int length = end - p;
 
-            if (!lex_check_escape (st)) {
-                return LEXER_ERROR;
-            }
-        } else {
-            st->offset += 1;
-        }
+    if (length > LEXER_ID_MAX_LENGTH + 1) {
+        lex_error (st, "identifier is too long (%d). maximum length is %d.", length - 1, LEXER_ID_MAX_LENGTH);
+        return LEXER_ERROR;
     }
 
-    st->offset += 1;
-
-    lex_commit (st, out_token, CLV_TOKEN_COMMENT);
+    lex_commit (st, out_token, lex_keyword (p, length), end);
 
     return LEXER_FOUND;
 }
 
 
 static int
-find_character (lexer_state_t *st, clv_token_t *out_token) {
-    if (!lex_arity (st, 1)) {
-        return LEXER_EOF;
-    }
+scan_number (lexer_state_t *st, const char *p, clv_token_t *out_token) {
+    const char *q = p;
 
-    if (lex_at (st, st->offset) != '\'') {
-        return LEXER_NOT_FOUND;
+    while (lex_has (*q, LEX_F_DIGIT)) {
+        q++;
     }
 
-    st->offset += 1;
-
-    int num_chars = 0;
+    if (*q == '.' && q < st->end) {
+        for (q++; lex_has (*q, LEX_F_DIGIT); q++);
 
-    while (lex_at (st, st->offset) != '\'') {
-        if (!lex_arity (st, 1)) {
-            lex_error (st, "unclosed character literal");
-            return LEXER_EOF;
-        }
-
-        if (lex_at (st, st->offset) == '\\') {
-            st->offset += 1;
+        lex_commit (st, out_token, CLV_TOKEN_FLOAT, q);
+        return LEXER_FOUND;
+    }
 
-            if (!lex_check_escape (st)) {
-                return LEXER_ERROR;
-            }
-        } else {
-            st->offset += 1;
-        }
+    const char *end = lex_skip_word (p);
 
-        num_chars++;
+    clv_tktype_t type;
+    int flag;
+
+    if (p[0] == '0' && p[1] == 'b') {
+        type = CLV_TOKEN_BIN;
+        flag = LEX_F_BIN;
+        p += 2;
+    } else if (p[0] == '0' && p[1] == 'x') {
+        type = CLV_TOKEN_HEX;
+        flag = LEX_F_XDIGIT;
+        p += 2;
+    } else {
+        type = CLV_TOKEN_INT;
+        flag = LEX_F_DIGIT;
     }
 
-    st->offset += 1;
-
-    if (num_chars > 1) {
-        lex_error (st, "multiple characters in character literal");
+    if (!lex_check_digits (st, p, end, flag)) {
         return LEXER_ERROR;
     }
 
-    lex_commit (st, out_token, CLV_TOKEN_CHARACTER);
+    lex_commit (st, out_token, type, end);
 
     return LEXER_FOUND;
 }
 
 
 static int
-find_operator (lexer_state_t *st, clv_token_t *out_token) {
-    static const lexer_pair_t operators[] = {
-        { "&",  1, CLV_TOKEN_BIT_AND   },
-        { "|",  1, CLV_TOKEN_BIT_OR    },
-        { "^",  1, CLV_TOKEN_BIT_XOR   },
-        { "<<", 2, CLV_TOKEN_BIT_SHL   },
-        { ">>", 2, CLV_TOKEN_BIT_SHR   },
-        { "!",  1, CLV_TOKEN_NOT       },
-        { "&&", 2, CLV_TOKEN_AND       },
-        { "||", 2, CLV_TOKEN_OR        },
-        { "==", 2, CLV_TOKEN_EQ        },
-        { "!=", 2, CLV_TOKEN_NE        },
-        { "<",  1, CLV_TOKEN_LT        },
-        { ">",  1, CLV_TOKEN_GT        },
-        { "<=", 2, CLV_TOKEN_LE        },
-        { ">=", 2, CLV_TOKEN_GE        },
-        { "=",  1, CLV_TOKEN_ASSIGN    },
-        { "+",  1, CLV_TOKEN_PLUS      },
-        { "-",  1, CLV_TOKEN_MINUS     },
-        { "*",  1, CLV_TOKEN_MULTIPLY  },
-        { "/",  1, CLV_TOKEN_DIVIDE    },
-        { "%",  1, CLV_TOKEN_REMAINDER },
-        { ".",  1, CLV_TOKEN_PERIOD    }
-    };
+find_token (lexer_state_t *st, clv_token_t *out_token) {
+    lex_skip_blank (st);
+
+    const char *p = st->data + st->offset;
 
-    if (!lex_arity (st, 1)) {
+    if (p >= st->end) {
         return LEXER_EOF;
     }
 
-    for (int i = 0; i < CLV_LENGTH (operators); i++) {
-        lexer_pair_t op = operators[i];
+    switch (lex_class (*p)) {
+    case LEX_C_ALPHA:
+        return scan_word (st, p, out_token);
 
-        if (!lex_arity (st, op.length)) {
-            continue;
-        }
+    case LEX_C_DIGIT:
+        return scan_number (st, p, out_token);
 
-        if (!lex_equal (st, op.value, op.length)) {
-            continue;
+    case LEX_C_QUOTE:
+        return scan_string (st, p + 1, out_token);
+
+    case LEX_C_APOSTROPHE:
+        return scan_character (st, p + 1, out_token);
+
+    case LEX_C_SLASH:
+        if (p[1] == '/') {
+            return scan_comment (st, p + 2, out_token);
         }
 
-        st->offset += op.length;
+        lex_commit (st, out_token, CLV_TOKEN_DIVIDE, p + 1);
+        return LEXER_FOUND;
 
-        lex_commit (st, out_token, op.type);
+    case LEX_C_LT:
+        if (p[1] == '<') {
+            lex_commit (st, out_token, CLV_TOKEN_BIT_SHL, p + 2);
+        } else if (p[1] == '=') {
+            lex_commit (st, out_token, CLV_TOKEN_LE, p + 2);
+        } else {
+            lex_commit (st, out_token, CLV_TOKEN_LT, p + 1);
+        }
 
         return LEXER_FOUND;
-    }
 
-    return LEXER_NOT_FOUND;
-}
+    case LEX_C_GT:
+        if (p[1] == '>') {
+            lex_commit (st, out_token, CLV_TOKEN_BIT_SHR, p + 2);
+        } else if (p[1] == '=') {
+            lex_commit (st, out_token, CLV_TOKEN_GE, p + 2);
+        } else {
+            lex_commit (st, out_token, CLV_TOKEN_GT, p + 1);
+        }
 
+        return LEXER_FOUND;
 
-static int
-find_symbol (lexer_state_t *st, clv_token_t *out_token) {
-    static const lexer_pair_t symbols[] = {
-        { ",", 1, CLV_TOKEN_COMMA        },
-        { ":", 1, CLV_TOKEN_COLON        },
-        { ";", 1, CLV_TOKEN_SEMICOLON    },
-        { "?", 1, CLV_TOKEN_QUESTIONMARK },
-        { "(", 1, CLV_TOKEN_LPARENTHESIS },
-        { ")", 1, CLV_TOKEN_RPARENTHESIS },
-        { "[", 1, CLV_TOKEN_LBRACKET     },
-        { "]", 1, CLV_TOKEN_RBRACKET     },
-        { "{", 1, CLV_TOKEN_LBRACE       },
-        { "}", 1, CLV_TOKEN_RBRACE       }
-    };
+    case LEX_C_EQUAL:
+        if (p[1] == '=') {
+            lex_commit (st, out_token, CLV_TOKEN_EQ, p + 2);
+        } else {
+            lex_commit (st, out_token, CLV_TOKEN_ASSIGN, p + 1);
+        }
 
-    if (!lex_arity (st, 1)) {
-        return LEXER_EOF;
-    }
+        return LEXER_FOUND;
 
-    for (int i = 0; i < CLV_LENGTH (symbols); i++) {
-        lexer_pair_t sym = symbols[i];
+    case LEX_C_SINGLE:
+        lex_commit (st, out_token, lex_singles[(uint8_t)*p], p + 1);
+        return LEXER_FOUND;
 
-        if (lex_at (st, st->offset) != sym.value[0]) {
-            continue;
+    case LEX_C_PAIR:
+        if (p[1] == lex_pairs[(uint8_t)*p].second) {
+            lex_commit (st, out_token, lex_pairs[(uint8_t)*p].type, p + 2);
+        } else {
+            lex_commit (st, out_token, lex_singles[(uint8_t)*p], p + 1);
         }
 
-        st->offset++;
+        return LEXER_FOUND;
+
+    default:
+        lex_error (st, "invalid token");
+        return LEXER_ERROR;
+    }
+}
 
-        lex_commit (st, out_token, sym.type);
 
-        return LEXER_FOUND;
+/* Interns the text of a token. Units use the same names over and over, so
+ * the last atom of each bucket is remembered, sparing most lookups in the
+ * shared table and its locks. */
+static clv_atom_t
+lex_intern (lexer_state_t *st, const char *text, uint32_t length) {
+    uint64_t hash = clv_hash64 (text, length, 0);
+    lex_atom_t *cached = &st->atoms[hash & (LEXER_ATOM_CACHE - 1)];
+
+    if (cached->atom != CLV_ATOM_NONE && cached->hash == (uint32_t)(hash >> 32)
+        && clv_atom_length (cached->atom) == length && memcmp (clv_atom_string (cached->atom), text, length) == 0) {
+        return cached->atom;
     }
 
-    return LEXER_NOT_FOUND;
+    clv_atom_t atom = clv_intern_hashed (text, length, hash);
+
+    *cached = (lex_atom_t){ .hash = hash >> 32, .atom = atom };
+
+    return atom;
 }
 
 
+/* Finds the next token, rejects those too long to represent, and interns
+ * the text of names and strings */
 static int
-find_keyword (lexer_state_t *st, clv_token_t *out_token) {
-    static const struct {
-        clv_str value;
-        clv_tktype_t type;
-    } keywords[] = {
-        { "import",   CLV_TOKEN_IMPORT   },
-        { "fn",       CLV_TOKEN_FN       },
-        { "type",     CLV_TOKEN_TYPE     },
-        { "trait",    CLV_TOKEN_TRAIT    },
-        { "defer",    CLV_TOKEN_DEFER    },
-        { "struct",   CLV_TOKEN_STRUCT   },
-        { "enum",     CLV_TOKEN_ENUM     },
-        { "in",       CLV_TOKEN_IN       },
-        { "as",       CLV_TOKEN_AS       },
-        { "typeof",   CLV_TOKEN_TYPEOF   },
-        { "if",       CLV_TOKEN_IF       },
-        { "elif",     CLV_TOKEN_ELIF     },
-        { "else",     CLV_TOKEN_ELSE     },
-        { "for",      CLV_TOKEN_FOR      },
-        { "while",    CLV_TOKEN_WHILE    },
-        { "continue", CLV_TOKEN_CONTINUE },
-        { "break",    CLV_TOKEN_BREAK    },
-        { "match",    CLV_TOKEN_MATCH    },
-        { "return",   CLV_TOKEN_RETURN   },
-        { "let",      CLV_TOKEN_LET      },
-        { "try",      CLV_TOKEN_TRY      },
-        { "nil",      CLV_TOKEN_NIL      },
-        { "true",     CLV_TOKEN_TRUE     },
-        { "false",    CLV_TOKEN_FALSE    },
-        { "pub",      CLV_TOKEN_PUB      },
-        { "static",   CLV_TOKEN_STATIC   },
-        { "const",    CLV_TOKEN_CONST    },
-    };
+lex_next (lexer_state_t *st, clv_token_t *out_token) {
+    int status = find_token (st, out_token);
 
-    if (!lex_arity (st, 1)) {
-        return LEXER_EOF;
+    if (status != LEXER_FOUND) {
+        return status;
     }
 
-    int length = strcspn (lex_offset (st, st->offset), LEXER_DELIMITERS);
+    if (st->offset - out_token->offset > CLV_TOKEN_MAX_LENGTH) {
+        st->offset = out_token->offset;
+        lex_error (st, "token is too long. maximum length is %u bytes.", CLV_TOKEN_MAX_LENGTH);
+        return LEXER_ERROR;
+    }
 
-    for (int i = 0; i < CLV_LENGTH (keywords); i++) {
-        if (!lex_arity (st, length)) {
-            continue;
-        }
+    if (out_token->type == CLV_TOKEN_IDENTIFIER || out_token->type == CLV_TOKEN_STRING) {
+        out_token->atom = lex_intern (st, st->data + out_token->offset, out_token->length);
 
-        if (lex_equal (st, keywords[i].value, length)) {
-            st->offset += length;
-            lex_commit (st, out_token, keywords[i].type);
-            return LEXER_FOUND;
+        if (out_token->atom == CLV_ATOM_NONE) {
+            st->offset = out_token->offset;
+            lex_error (st, "unable to intern token: %s", strerror (errno));
+            return LEXER_ERROR;
         }
     }
 
-    return LEXER_NOT_FOUND;
+    return status;
 }
 
 
-static int
-find_identifier (lexer_state_t *st, clv_token_t *out_token) {
-    if (!lex_arity (st, 1)) {
-        return LEXER_EOF;
+bool
+clv_lex (clv_source_t *src, clv_arena_t *arena, clv_tokens_t **out_tokens) {
+    size_t hint = clv_source_length (src) / LEXER_BYTES_PER_TOKEN;
+
+    clv_tokens_t *tokens = clv_tokens_new (hint, arena);
+
+    if (tokens == NULL) {
+        clv_error ("unable to create token stream: %s", strerror (errno));
+        return false;
     }
 
-    char first_ch = lex_at (st, st->offset);
+    lexer_state_t st = {
+        .src = src,
+        .file = clv_source_get_file (src),
+        .data = clv_source_cstr (src),
+        .end = clv_source_cstr (src) + clv_source_length (src),
+        .line = 1
+    };
+
+    clv_token_t tk;
+    int status;
 
-    if (!(lex_isalpha (first_ch) || first_ch == '_')) {
-        return LEXER_NOT_FOUND;
+    while ((status = lex_next (&st, &tk)) == LEXER_FOUND) {
+        if (!clv_tokens_push_back (tokens, &tk)) {
+            clv_error ("failed to store token: %s", strerror (errno));
+            st.error = true;
+            break;
+        }
     }
 
-    int length = strcspn (lex_offset (st, st->offset), LEXER_DELIMITERS);
-    st->offset += length;
+    if (status == LEXER_ERROR) {
+        st.error = true;
+    }
 
-    if (!lex_check_identifier (st)) {
-        return LEXER_ERROR;
+    if (clv_tokens_length (tokens) == 0) {
+        clv_error ("file is empty: %s", clv_source_get_file (src));
+        clv_tokens_free (tokens);
+        return false;
     }
 
-    lex_commit (st, out_token, CLV_TOKEN_IDENTIFIER);
+    *out_tokens = tokens;
 
-    return LEXER_FOUND;
+    return !st.error;
 }
 
 
-static int
-find_float (lexer_state_t *st, clv_token_t *out_token) {
-    if (!lex_arity (st, 1)) {
-        return LEXER_EOF;
-    }
+/* == Streaming == */
 
-    if (!lex_isdigit (lex_at (st, st->offset))) {
-        return LEXER_NOT_FOUND;
-    }
 
-    lex_save (st);
+struct clv_lexer {
+    lexer_state_t st;
+
+    char *file;
+    int fd;
+    bool eof;
+
+    char *buffer;           /* the window, padded like sources */
+    size_t capacity;        /* without the padding */
+    size_t fill;
+    uint64_t base;          /* input offset of the start of the buffer */
+
+    const char *last_break; /* last line break in the buffer, or its start */
+};
 
-    int int_len = strspn (lex_offset (st, st->offset), LEXER_DIGITS);
-    st->offset += int_len;
 
-    if (lex_at (st, st->offset) != '.') {
-        lex_restore (st);
-        return LEXER_NOT_FOUND;
+clv_lexer_t *
+clv_lexer_new (int fd, clv_str file, size_t buffer_size) {
+    clv_lexer_t *lexer = clv_calloc (CLV_TAG_LEXER, 1, sizeof (*lexer));
+
+    if (buffer_size == 0) {
+        buffer_size = CLV_LEXER_BUFFER_SIZE;
     }
 
-    st->offset += 1;
+    if (lexer == NULL) {
+        return NULL;
+    }
 
-    int frac_len = strspn (lex_offset (st, st->offset), LEXER_DIGITS);
-    st->offset += frac_len;
+    lexer->file = clv_strdup (CLV_TAG_LEXER, file);
+    lexer->buffer = clv_calloc (CLV_TAG_LEXER, 1, buffer_size + CLV_SOURCE_PADDING);
 
-    if (!lex_check_float (st)) {
-        return LEXER_ERROR;
+    if (lexer->file == NULL || lexer->buffer == NULL) {
+        clv_lexer_free (lexer);
+        return NULL;
     }
 
-    lex_commit (st, out_token, CLV_TOKEN_FLOAT);
+    lexer->fd = fd;
+    lexer->capacity = buffer_size;
+    lexer->last_break = lexer->buffer;
 
-    return LEXER_FOUND;
+    lexer->st = (lexer_state_t){
+        .file = lexer->file,
+        .data = lexer->buffer,
+        .end = lexer->buffer,
+        .line = 1
+    };
+
+    return lexer;
 }
 
 
-static int
-find_bin (lexer_state_t *st, clv_token_t *out_token) {
-    if (!lex_arity (st, 2)) {
-        return LEXER_EOF;
+/* Drops what's before the current line, which diagnostics still need, and
+ * reads more input after the rest. The buffer only grows when that line
+ * takes all of it. */
+static bool
+lexer_refill (clv_lexer_t *self) {
+    lexer_state_t *st = &self->st;
+    const char *p = st->data + st->offset;
+
+    // a \r that ends the window may be half of a \r\n, so it stays
+    if (p == st->end && p > st->data && p[-1] == '\r') {
+        p--;
     }
 
-    if (!lex_equal (st, "0b", 2)) {
-        return LEXER_NOT_FOUND;
+    while (p > st->data && p[-1] != '\n' && p[-1] != '\r') {
+        p--;
     }
 
-    int length = strcspn (lex_offset (st, st->offset), LEXER_DELIMITERS);
+    size_t keep = p - st->data;
 
-    st->offset += length;
+    if (keep > 0) {
+        const char *line_start;
 
-    if (!lex_check_bin (st)) {
-        return LEXER_ERROR;
+        st->line += lex_count_lines (st->data, p, &line_start);
+
+        memmove (self->buffer, self->buffer + keep, self->fill - keep);
+        self->fill -= keep;
+        self->base += keep;
+        st->offset -= keep;
     }
 
-    lex_commit (st, out_token, CLV_TOKEN_BIN);
-
-    return LEXER_FOUND;
-}
+    if (self->fill == self->capacity) {
+        char *temp = clv_realloc (CLV_TAG_LEXER, self->buffer, self->capacity * 2 + CLV_SOURCE_PADDING);
 
+        if (temp == NULL) {
+            return false;
+        }
 
-static int
-find_hex (lexer_state_t *st, clv_token_t *out_token) {
-    if (!lex_equal (st, "0x", 2)) {
-        return LEXER_NOT_FOUND;
+        self->buffer = temp;
+        self->capacity *= 2;
     }
 
-    int length = strcspn (lex_offset (st, st->offset), LEXER_DELIMITERS);
+    ssize_t count;
 
-    st->offset += length;
-
-    if (!lex_check_hex (st)) {
-        return LEXER_ERROR;
+    while ((count = read (self->fd, self->buffer + self->fill, self->capacity - self->fill)) < 0) {
+        if (errno != EINTR) {
+            return false;
+        }
     }
 
-    lex_commit (st, out_token, CLV_TOKEN_HEX);
+    self->fill += count;
+    self->eof = (count == 0);
 
-    return LEXER_FOUND;
-}
+    memset (self->buffer + self->fill, 0, CLV_SOURCE_PADDING);
 
+    st->data = self->buffer;
+    st->end = self->buffer + self->fill;
 
-static int
-find_int (lexer_state_t *st, clv_token_t *out_token) {
-    if (!lex_arity (st, 1)) {
-        return LEXER_EOF;
-    }
+    self->last_break = self->buffer;
 
-    if (!lex_isdigit (lex_at (st, st->offset))) {
-        return LEXER_NOT_FOUND;
+    for (const char *p = st->end; p > self->buffer; p--) {
+        if (p[-1] == '\n' || p[-1] == '\r') {
+            self->last_break = p - 1;
+            break;
+        }
     }
 
-    int length = strcspn (lex_offset (st, st->offset), LEXER_DELIMITERS);
+    return true;
+}
 
-    st->offset += length;
 
-    if (!lex_check_int (st)) {
-        return LEXER_ERROR;
+/* Whether the token at the current position is known to end inside the
+ * window: its line does, or for literals, which may span lines, their
+ * closing quote. Scanners can then treat the end of the window as the end
+ * of the input. */
+static bool
+lexer_ready (clv_lexer_t *self) {
+    const lexer_state_t *st = &self->st;
+    const char *p = st->data + st->offset;
+
+    if (self->eof) {
+        return true;
     }
 
-    lex_commit (st, out_token, CLV_TOKEN_INT);
+    if (p >= st->end) {
+        return false;
+    }
 
-    return LEXER_FOUND;
-}
+    if (*p == '"' || *p == '\'') {
+        const char *q = p + 1;
 
+        // the padding covers a backslash that ends the window
+        while ((q = clv_scan_any3 (q, *p, '\\', '\0')) < st->end && *q == '\\') {
+            q += 2;
+        }
 
-static clv_token_t *
-find_token (lexer_state_t *st) {
-    static const lexer_func_t find_fns[] = {
-        find_comment,
-        find_string,
-        find_character,
-        find_operator,
-        find_symbol,
-        find_keyword,
-        find_identifier,
-        find_float,
-        find_bin,
-        find_hex,
-        find_int,
-    };
+        return q < st->end;
+    }
 
-    lex_skip_blank (st);
+    return p < self->last_break || clv_scan_any3 (p, '\n', '\r', '\0') < st->end;
+}
 
-    if (!lex_arity (st, 1)) {
-        return NULL;
-    }
 
-    clv_token_t *token = malloc (sizeof (*token));
+int
+clv_lexer_next (clv_lexer_t *self, clv_token_t *out_token) {
+    lexer_state_t *st = &self->st;
 
-    if (token == NULL) {
-        clv_error ("failed to store token: %s", strerror (errno));
-        return NULL;
+    // errors end the stream
+    if (st->error) {
+        return LEXER_ERROR;
     }
 
-    int status;
-
-    for (int i = 0; i < CLV_LENGTH (find_fns); i++) {
-        status = find_fns[i] (st, token);
+    for (;;) {
+        lex_skip_blank (st);
 
-        if (status == LEXER_FOUND) {
+        if (lexer_ready (self)) {
             break;
-        } else if (status == LEXER_EOF) {
-            return NULL;
-        } else if (status == LEXER_ERROR) {
+        }
+
+        if (!lexer_refill (self)) {
+            clv_error ("unable to read %s: %s", self->file, strerror (errno));
             st->error = true;
-            return NULL;
+            return LEXER_ERROR;
         }
     }
 
-    if (status == LEXER_NOT_FOUND) {
-        clv_error ("Invalid token!");
-        return NULL;
+    int status = lex_next (st, out_token);
+
+    if (status == LEXER_FOUND) {
+        out_token->offset += self->base;
+    } else if (status == LEXER_ERROR) {
+        st->error = true;
     }
 
-    return token;
+    return status;
 }
 
 
-bool
-clv_lex (clv_source_t *src, clv_list_t **out_tokens) {
-    clv_list_t *tokens = clv_list_new ();
+const char *
+clv_lexer_text (clv_lexer_t *self, const clv_token_t *token) {
+    return self->buffer + (uint32_t)(token->offset - (uint32_t)self->base);
+}
 
-    if (tokens == NULL) {
-        clv_error ("%s: unable to create list: %s", strerror (errno));
-        return false;
-    }
 
-    lexer_state_t st = { src, 0, 0, 0, 1, 1 };
+void
+clv_lexer_locate (clv_lexer_t *self, const clv_token_t *token, clv_location_t *out_location) {
+    lex_locate (&self->st, (uint32_t)(token->offset - (uint32_t)self->base), out_location);
 
-    clv_token_t *tk;
+    out_location->line_offset += self->base;
+}
 
-    while ((tk = find_token (&st)) != NULL) {
-        clv_list_push_back (tokens, tk);
-    }
 
-    if (clv_list_length (tokens) == 0) {
-        clv_error ("file is empty: %s", clv_source_get_file (src));
-        clv_list_free (tokens, NULL);
-        return false;
+void
+clv_lexer_free (clv_lexer_t *self) {
+    if (self == NULL) {
+        return;
     }
 
-    *out_tokens = tokens;
-
-    return !st.error;
+    clv_free (self->buffer);
+    clv_free (self->file);
+    clv_free (self);
 }
@@ -1,4 +1,5 @@
 #include <clover/list.h>
+#include <clover/alloc.h>
 
 #include <stdlib.h>
 #include <errno.h>
@@ -7,6 +8,8 @@ struct clv_list {
     struct clv_list_node *head;
     struct clv_list_node *tail;
     size_t count;
+
+    clv_arena_t *arena;
 };
 
 struct clv_list_node {
@@ -16,9 +19,23 @@ struct clv_list_node {
 };
 
 
+static void
+_clv_list_free_node (clv_list_t *list, struct clv_list_node *node) {
+    if (list->arena == NULL) {
+        clv_free (node);
+    }
+}
+
+
 static struct clv_list_node *
-_clv_list_make_node (void *ptr) {
-    struct clv_list_node *node = malloc (sizeof (*node));
+_clv_list_make_node (clv_list_t *list, void *ptr) {
+    struct clv_list_node *node;
+
+    if (list->arena != NULL) {
+        node = clv_arena_alloc (list->arena, sizeof (*node));
+    } else {
+        node = clv_alloc (CLV_TAG_LIST, sizeof (*node));
+    }
 
     if (node == NULL) {
         return NULL;
@@ -33,8 +50,9 @@ _clv_list_make_node (void *ptr) {
 
 
 struct clv_list *
-clv_list_new () {
-    clv_list_t *list = malloc (sizeof (*list));
+clv_list_new (clv_arena_t *arena) {
+    clv_list_t *list = (arena != NULL) ? clv_arena_alloc (arena, sizeof (*list))
+                     : clv_alloc (CLV_TAG_LIST, sizeof (*list));
 
     if (list == NULL) {
         return NULL;
@@ -43,6 +61,7 @@ clv_list_new () {
     list->head = NULL;
     list->tail = NULL;
     list->count = 0;
+    list->arena = arena;
 
     return list;
 }
@@ -53,7 +72,7 @@ clv_list_push_back (clv_list_t *list, void *ptr) {
         return false;
     }
 
-    struct clv_list_node *node = _clv_list_make_node (ptr);
+    struct clv_list_node *node = _clv_list_make_node (list, ptr);
 
     if (node == NULL) {
         return false;
@@ -80,7 +99,7 @@ clv_list_pop_back (clv_list_t *list, void **out_ptr) {
         return false;
     }
 
-    if (list->tail != NULL) {
+    if (list->tail == NULL) {
         errno = ENOENT;
         return false;
     }
@@ -89,12 +108,14 @@ clv_list_pop_back (clv_list_t *list, void **out_ptr) {
 
     prev = list->tail->prev;
     *out_ptr = list->tail->ptr;
-    free (list->tail);
+    _clv_list_free_node (list, list->tail);
 
     list->tail = prev;
 
     if (prev == NULL) {
         list->head = NULL;
+    } else {
+        prev->next = NULL;
     }
 
     list->count--;
@@ -128,7 +149,7 @@ clv_list_clear (clv_list_t *list, clv_list_func_t _free_ptr) {
         }
 
         temp = curr->next;
-        free (curr);
+        _clv_list_free_node (list, curr);
 
         curr = temp;
     }
@@ -140,8 +161,15 @@ clv_list_clear (clv_list_t *list, clv_list_func_t _free_ptr) {
 
 void
 clv_list_free (clv_list_t *list, clv_list_func_t _free_ptr) {
+    if (list == NULL) {
+        return;
+    }
+
     clv_list_clear (list, _free_ptr);
-    free (list);
+
+    if (list->arena == NULL) {
+        clv_free (list);
+    }
 }
 
 
@@ -0,0 +1,1004 @@
+#define _DEFAULT_SOURCE /* realpath */
+#include <clover/loader.h>
+#include <clover/lexer.h>
+#include <clover/parser.h>
+#include <clover/runtime.h>
+#include <clover/hash.h>
+#include <clover/log.h>
+#include <clover/timer.h>
+#include <clover/alloc.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#define LOADER_MIN_CAPACITY     16
+
+#define DUMP_RECORD_SIZE        (32 * 1024)
+
+
+typedef struct {
+    clv_unit_t unit;
+    clv_loader_t *loader;
+    uint32_t index;
+
+    char *found;            /* file, when the loader found it */
+    char *key;              /* real path, telling files apart */
+    uint64_t hash;          /* of the key */
+    clv_arena_t *arena;     /* of the front end */
+
+    uint32_t *import_tokens;
+    bool failed;            /* to find its imports, or imports itself */
+
+    /* diagnostics, captured so units don't interleave */
+    FILE *out_stream;
+    FILE *err_stream;
+    char *out;
+    size_t out_length;
+    char *err;
+    size_t err_length;
+
+    /* units importing this one, once per import item */
+    uint32_t first_dependent;
+    uint32_t dependent_count;
+} loader_unit_t;
+
+
+struct clv_loader {
+    clv_str *search_path;
+    size_t search_count;
+
+    clv_cache_t *cache;     /* of interfaces, or NULL */
+    uint64_t seed;          /* of hashes of sources */
+
+    loader_unit_t **units;
+    uint32_t unit_count;
+    uint32_t unit_capacity;
+
+    /* open addressing over keys, unit index + 1 or 0 for free slots */
+    uint32_t *table;
+    uint32_t table_mask;
+
+    uint32_t *order;
+    uint32_t order_count;
+
+    uint32_t *dependents;
+};
+
+
+typedef struct loader_schedule loader_schedule_t;
+
+typedef struct {
+    loader_schedule_t *schedule;
+    uint32_t unit;
+} loader_task_t;
+
+
+/* State of a run of clv_loader_schedule */
+struct loader_schedule {
+    clv_loader_t *loader;
+    clv_pool_t *pool;
+
+    clv_loader_func_t func;
+    void *arg;
+
+    atomic_uint *pending;   /* of each unit, imports not done yet */
+    atomic_bool *skipped;   /* some import failed */
+    atomic_uint done;
+    atomic_bool good;
+
+    loader_task_t *tasks;
+};
+
+
+/* == Auxiliary Functions == */
+
+
+static void
+loader_error (loader_unit_t *unit, uint32_t token, clv_str msg, ...) {
+    clv_log_record_t rec;
+
+    clv_location_t loc = { .line = 1, .column = 1 };
+    clv_token_t *tokens = clv_tokens_data (unit->unit.tokens);
+
+    clv_source_locate (unit->unit.src, tokens[token].offset, &loc);
+
+    clv_str line = clv_source_offset (unit->unit.src, loc.line_offset);
+    va_list args;
+
+    va_start (args, msg);
+    clv_log_begin (&rec, CLV_ERROR);
+    clv_log_printf (&rec, "%s:%u:%u: ", unit->unit.file, loc.line, loc.column);
+    clv_log_vprintf (&rec, msg, args);
+    clv_log_printf (&rec, "\n %3u | ", loc.line);
+    clv_log_append (&rec, line, strcspn (line, "\r\n"));
+    clv_log_append (&rec, "\n", 1);
+    clv_log_end (&rec);
+    va_end (args);
+}
+
+
+static void
+dump_tokens (clv_source_t *source, clv_tokens_t *tokens) {
+    clv_log_record_t rec;
+
+    size_t count = clv_tokens_length (tokens);
+    clv_token_t *data = clv_tokens_data (tokens);
+
+    clv_log_begin (&rec, CLV_INFO);
+
+    for (size_t i = 0; i < count; i++) {
+        clv_token_t *token = &data[i];
+        clv_location_t loc = { .line = 0 };
+
+        clv_source_locate (source, token->offset, &loc);
+
+        clv_log_printf (&rec, "[%6zu]  %4u:%-4u  ", i, loc.line, loc.column);
+        clv_log_append (&rec, clv_source_offset (source, token->offset), token->length);
+        clv_log_append (&rec, "\n", 1);
+
+        // keep the record bounded on large units
+        if (rec.length >= DUMP_RECORD_SIZE) {
+            clv_log_end (&rec);
+            clv_log_begin (&rec, CLV_INFO);
+        }
+    }
+
+    clv_log_end (&rec);
+}
+
+
+/* == Units == */
+
+
+static loader_unit_t *
+unit_find (clv_loader_t *self, const char *key, uint64_t hash) {
+    for (uint32_t i = hash;; i++) {
+        uint32_t slot = self->table[i & self->table_mask];
+
+        if (slot == 0) {
+            return NULL;
+        }
+
+        if (self->units[slot - 1]->hash == hash && strcmp (self->units[slot - 1]->key, key) == 0) {
+            return self->units[slot - 1];
+        }
+    }
+}
+
+
+static bool
+unit_rehash (clv_loader_t *self, uint32_t capacity) {
+    uint32_t *table = clv_calloc (CLV_TAG_LOADER, capacity, sizeof (*table));
+
+    if (table == NULL) {
+        return false;
+    }
+
+    clv_free (self->table);
+
+    self->table = table;
+    self->table_mask = capacity - 1;
+
+    for (uint32_t i = 0; i < self->unit_count; i++) {
+        uint32_t slot = self->units[i]->hash;
+
+        while (table[slot & self->table_mask] != 0) {
+            slot++;
+        }
+
+        table[slot & self->table_mask] = i + 1;
+    }
+
+    return true;
+}
+
+
+/* Returns the unit of `file`, added unless there is one already, or
+ * UINT32_MAX when out of memory. `found` is `file` when it was allocated
+ * by the loader, and freed unless taken by a new unit. */
+static uint32_t
+unit_add (clv_loader_t *self, clv_str file, char *found) {
+    char path[PATH_MAX];
+
+    // missing files are reported once loaded
+    char *key = clv_strdup (CLV_TAG_LOADER, (realpath (file, path) != NULL) ? path : file);
+
+    if (key == NULL) {
+        clv_free (found);
+        return UINT32_MAX;
+    }
+
+    uint64_t hash = clv_hash64 (key, strlen (key), 0);
+    loader_unit_t *unit = unit_find (self, key, hash);
+
+    if (unit != NULL) {
+        clv_free (key);
+        clv_free (found);
+        return unit->index;
+    }
+
+    if (self->unit_count == self->unit_capacity) {
+        uint32_t capacity = (self->unit_capacity == 0) ? LOADER_MIN_CAPACITY : self->unit_capacity * 2;
+        loader_unit_t **temp = clv_realloc (CLV_TAG_LOADER, self->units, capacity * sizeof (*temp));
+
+        if (temp == NULL) {
+            clv_free (key);
+            clv_free (found);
+            return UINT32_MAX;
+        }
+
+        self->units = temp;
+        self->unit_capacity = capacity;
+    }
+
+    if ((unit = clv_calloc (CLV_TAG_LOADER, 1, sizeof (*unit))) == NULL) {
+        clv_free (key);
+        clv_free (found);
+        return UINT32_MAX;
+    }
+
+    *unit = (loader_unit_t){
+        .unit = { .file = file },
+        .loader = self,
+        .index = self->unit_count,
+        .found = found,
+        .key = key,
+        .hash = hash
+    };
+
+    self->units[self->unit_count++] = unit;
+
+    // at most half full
+    if (self->unit_count * 2 > self->table_mask) {
+        if (!unit_rehash (self, (self->table_mask + 1) * 2)) {
+            self->unit_count--;
+            clv_free (unit->key);
+            clv_free (unit->found);
+            clv_free (unit);
+            return UINT32_MAX;
+        }
+    } else {
+        uint32_t slot = hash;
+
+        while (self->table[slot & self->table_mask] != 0) {
+            slot++;
+        }
+
+        self->table[slot & self->table_mask] = self->unit_count;
+    }
+
+    return unit->index;
+}
+
+
+/* Lexes and parses a unit whose source is open, on whatever thread */
+static bool
+unit_parse (loader_unit_t *unit) {
+    clv_unit_t *u = &unit->unit;
+
+    if (u->ast != NULL) {
+        return true;
+    }
+
+    if (unit->arena == NULL && (unit->arena = clv_arena_new (0)) == NULL) {
+        clv_error ("unable to create arena: %s", strerror (errno));
+        return false;
+    }
+
+    clv_timer_begin (CLV_PHASE_LEX, u->file);
+    bool good = clv_lex (u->src, unit->arena, &u->tokens);
+    clv_timer_end ();
+
+    if (!good) {
+        return false;
+    }
+
+    if (clv_log_debug ()) {
+        dump_tokens (u->src, u->tokens);
+    }
+
+    clv_timer_begin (CLV_PHASE_PARSE, u->file);
+    good = clv_parse (u->src, u->tokens, unit->arena, &u->ast);
+    clv_timer_end ();
+
+    if (!good) {
+        u->ast = NULL;
+        return false;
+    }
+
+    if (clv_log_debug ()) {
+        clv_ast_dump (u->ast, u->src, u->tokens);
+    }
+
+    // imports found through the interface are told where they are now
+    if (u->imports != NULL) {
+        clv_node_t *root = clv_ast_node (u->ast, clv_ast_get_root (u->ast));
+        const uint32_t *items = clv_ast_extra (u->ast, root->lhs);
+
+        for (uint32_t i = 0, count = 0; i < root->rhs && count < u->import_count; i++) {
+            clv_node_t *node = clv_ast_node (u->ast, items[i]);
+
+            if (node->kind == CLV_NODE_IMPORT) {
+                unit->import_tokens[count++] = clv_ast_import_path (u->ast, node)->token;
+            }
+        }
+    }
+
+    return true;
+}
+
+
+/* Loads a unit, from its interface when there's one for its source */
+static void
+unit_load (void *arg) {
+    loader_unit_t *unit = arg;
+    clv_unit_t *u = &unit->unit;
+    clv_loader_t *loader = unit->loader;
+
+    // without a buffer, diagnostics go straight to stdout and stderr
+    clv_log_capture (unit->out_stream, unit->err_stream);
+    clv_timer_begin (CLV_PHASE_READ, u->file);
+
+    if ((u->src = clv_source_new (u->file)) == NULL) {
+        clv_error ("%s: %s", strerror (errno), u->file);
+        clv_timer_end ();
+    } else {
+        u->hash = clv_hash64 (clv_source_cstr (u->src), clv_source_length (u->src), loader->seed);
+        u->iface = (loader->cache != NULL) ? clv_interface_open (loader->cache, u->hash) : NULL;
+        clv_timer_end ();
+
+        if (u->iface != NULL) {
+            clv_debug ("loader: %s from its interface", u->file);
+        } else {
+            unit_parse (unit);
+        }
+    }
+
+    clv_log_capture (NULL, NULL);
+}
+
+
+/* == Imports == */
+
+
+/* Writes the path of module `id` out as a relative file name, a.b as a/b */
+static bool
+import_path (loader_unit_t *unit, clv_node_id_t id, char *buffer, size_t *length) {
+    clv_node_t *node = clv_ast_node (unit->unit.ast, id);
+    clv_token_t *token = &clv_tokens_data (unit->unit.tokens)[node->token];
+
+    if (node->kind == CLV_NODE_MEMBER) {
+        if (!import_path (unit, node->lhs, buffer, length)) {
+            return false;
+        }
+
+        buffer[(*length)++] = '/';
+    }
+
+    // room for a separator or the extension after it
+    if (*length + token->length + sizeof (CLV_MODULE_EXT) + 1 > PATH_MAX) {
+        return false;
+    }
+
+    memcpy (buffer + *length, clv_source_offset (unit->unit.src, token->offset), token->length);
+    *length += token->length;
+
+    return true;
+}
+
+
+/* Looks `relative` up next to `unit`, then on the search path. Returns a
+ * clv_alloc'ed path, or NULL when not found. */
+static char *
+import_find (clv_loader_t *self, loader_unit_t *unit, const char *relative) {
+    char path[PATH_MAX];
+    clv_str file = unit->unit.file;
+    clv_str slash = strrchr (file, '/');
+
+    for (size_t i = 0; i <= self->search_count; i++) {
+        struct stat st;
+        int length;
+
+        if (i > 0) {
+            length = snprintf (path, sizeof (path), "%s/%s", self->search_path[i - 1], relative);
+        } else if (slash != NULL) {
+            length = snprintf (path, sizeof (path), "%.*s/%s", (int)(slash - file), file, relative);
+        } else {
+            length = snprintf (path, sizeof (path), "%s", relative);
+        }
+
+        if (length > 0 && (size_t)length < sizeof (path) && stat (path, &st) == 0 && S_ISREG (st.st_mode)) {
+            return clv_strdup (CLV_TAG_LOADER, path);
+        }
+    }
+
+    return NULL;
+}
+
+
+/* Number of import items of a parsed unit */
+static uint32_t
+import_count (clv_unit_t *u) {
+    clv_node_t *root = clv_ast_node (u->ast, clv_ast_get_root (u->ast));
+    const uint32_t *items = clv_ast_extra (u->ast, root->lhs);
+    uint32_t count = 0;
+
+    for (uint32_t i = 0; i < root->rhs; i++) {
+        count += clv_ast_node (u->ast, items[i])->kind == CLV_NODE_IMPORT;
+    }
+
+    return count;
+}
+
+
+/* Finds the units of the imports of `unit`, adding those new to the build.
+ * Units loaded from their interface can't tell where an import is, so
+ * they report nothing, and are parsed to try again. */
+static bool
+import_resolve (clv_loader_t *self, loader_unit_t *unit) {
+    clv_unit_t *u = &unit->unit;
+    uint32_t count = (u->ast != NULL) ? import_count (u) : clv_interface_import_count (u->iface);
+
+    clv_free (u->imports);
+    clv_free (u->import_paths);
+    clv_free (unit->import_tokens);
+
+    u->imports = clv_alloc (CLV_TAG_LOADER, count * sizeof (*u->imports));
+    u->import_paths = clv_alloc (CLV_TAG_LOADER, count * sizeof (*u->import_paths));
+    u->import_count = 0;
+    unit->import_tokens = clv_alloc (CLV_TAG_LOADER, count * sizeof (*unit->import_tokens));
+
+    if ((u->imports == NULL || u->import_paths == NULL || unit->import_tokens == NULL) && count > 0) {
+        clv_error ("unable to load %s: %s", u->file, strerror (errno));
+        return false;
+    }
+
+    const uint32_t *items = NULL;
+    clv_token_t *tokens = NULL;
+    bool good = true;
+
+    if (u->ast != NULL) {
+        items = clv_ast_extra (u->ast, clv_ast_node (u->ast, clv_ast_get_root (u->ast))->lhs);
+        tokens = clv_tokens_data (u->tokens);
+    }
+
+    for (uint32_t i = 0, item = 0; i < count; i++) {
+        uint32_t *import = &u->imports[u->import_count];
+        char relative[PATH_MAX];
+        size_t length = 0;
+        bool fits = true;
+        bool native;
+
+        *import = UINT32_MAX;
+        unit->import_tokens[u->import_count] = UINT32_MAX;
+
+        if (u->ast != NULL) {
+            clv_node_t *node = clv_ast_node (u->ast, items[item++]);
+
+            while (node->kind != CLV_NODE_IMPORT) {
+                node = clv_ast_node (u->ast, items[item++]);
+            }
+
+            clv_node_t *path = clv_ast_import_path (u->ast, node);
+            clv_token_t *token = &tokens[path->token];
+
+            fits = import_path (unit, node->lhs, relative, &length);
+            native = path->kind == CLV_NODE_NAME
+                && clv_native_module_find (clv_source_offset (u->src, token->offset), token->length);
+            unit->import_tokens[u->import_count] = path->token;
+
+            // named as imported, a/b back to a.b
+            char *name = clv_arena_strndup (unit->arena, relative, length);
+
+            for (size_t j = 0; name != NULL && j < length; j++) {
+                name[j] = (name[j] == '/') ? '.' : name[j];
+            }
+
+            if ((u->import_paths[u->import_count] = name) == NULL) {
+                clv_error ("unable to load %s: %s", u->file, strerror (errno));
+                return false;
+            }
+        } else {
+            uint32_t name_length;
+            clv_str name = clv_interface_import (u->iface, i, &name_length);
+
+            fits = name_length + sizeof (CLV_MODULE_EXT) + 1 <= PATH_MAX;
+            native = strchr (name, '.') == NULL && clv_native_module_find (name, name_length);
+            u->import_paths[u->import_count] = name;
+
+            for (; fits && length < name_length; length++) {
+                relative[length] = (name[length] == '.') ? '/' : name[length];
+            }
+        }
+
+        clv_str name = u->import_paths[u->import_count];
+        uint32_t token = unit->import_tokens[u->import_count++];
+        char *file = NULL;
+
+        if (native) {
+            continue;
+        }
+
+        if (fits) {
+            memcpy (relative + length, CLV_MODULE_EXT, sizeof (CLV_MODULE_EXT));
+            file = import_find (self, unit, relative);
+        }
+
+        if (file == NULL) {
+            if (u->ast != NULL) {
+                loader_error (unit, token, "unknown module '%s'", name);
+            }
+
+            good = false;
+        } else if ((*import = unit_add (self, file, file)) == UINT32_MAX) {
+            if (u->ast != NULL) {
+                loader_error (unit, token, "unable to load module: %s", strerror (errno));
+            }
+
+            good = false;
+        }
+    }
+
+    return good;
+}
+
+
+/* Reports the cycle closed by the import `item` of unit `u`, made of the
+ * units on `stack` from the one imported */
+static void
+import_cycle (clv_loader_t *self, const uint32_t *stack, uint32_t depth, uint32_t u, uint32_t item) {
+    loader_unit_t *unit = self->units[u];
+    uint32_t import = unit->unit.imports[item];
+    uint32_t first = depth;
+    size_t length = 0;
+
+    while (stack[first - 1] != import) {
+        first--;
+    }
+
+    first--;
+
+    for (uint32_t i = first; i < depth; i++) {
+        length += strlen (self->units[stack[i]]->unit.file) + 4;
+        self->units[stack[i]]->failed = true;
+    }
+
+    char *chain = clv_alloc (CLV_TAG_LOADER, length + strlen (self->units[import]->unit.file) + 1);
+
+    clv_log_capture (unit->out_stream, unit->err_stream);
+
+    // only parsed units tell where their imports are
+    if (!unit_parse (unit)) {
+        clv_error ("%s: import cycle", unit->unit.file);
+    } else if (chain != NULL) {
+        length = 0;
+
+        for (uint32_t i = first; i < depth; i++) {
+            length += sprintf (chain + length, "%s -> ", self->units[stack[i]]->unit.file);
+        }
+
+        strcpy (chain + length, self->units[import]->unit.file);
+        loader_error (unit, unit->import_tokens[item], "import cycle: %s", chain);
+    } else {
+        loader_error (unit, unit->import_tokens[item], "import cycle");
+    }
+
+    clv_log_capture (NULL, NULL);
+    clv_free (chain);
+}
+
+
+/* Orders units after those they import, depth first, reports cycles, and
+ * lists the units importing each */
+static bool
+import_sort (clv_loader_t *self) {
+    uint32_t count = self->unit_count;
+    uint8_t *state = clv_calloc (CLV_TAG_LOADER, count, sizeof (*state));      // 0 new, 1 on the stack, 2 done
+    uint32_t *stack = clv_alloc (CLV_TAG_LOADER, count * sizeof (*stack));
+    uint32_t *next = clv_calloc (CLV_TAG_LOADER, count, sizeof (*next));       // import to visit next, of each
+    uint32_t total = 0;
+    bool good = true;
+
+    self->order = clv_alloc (CLV_TAG_LOADER, count * sizeof (*self->order));
+
+    for (uint32_t i = 0; i < count; i++) {
+        clv_unit_t *u = &self->units[i]->unit;
+
+        for (uint32_t j = 0; j < u->import_count; j++) {
+            if (u->imports[j] != UINT32_MAX) {
+                self->units[u->imports[j]]->dependent_count++;
+                total++;
+            }
+        }
+    }
+
+    self->dependents = clv_alloc (CLV_TAG_LOADER, total * sizeof (*self->dependents));
+
+    if (state == NULL || stack == NULL || next == NULL || self->order == NULL || (self->dependents == NULL && total > 0)) {
+        clv_error ("unable to order units: %s", strerror (errno));
+        clv_free (state);
+        clv_free (stack);
+        clv_free (next);
+        return false;
+    }
+
+    for (uint32_t root = 0; root < count; root++) {
+        uint32_t depth = 0;
+
+        if (state[root] != 0) {
+            continue;
+        }
+
+        stack[depth++] = root;
+        state[root] = 1;
+
+        while (depth > 0) {
+            uint32_t u = stack[depth - 1];
+            clv_unit_t *unit = &self->units[u]->unit;
+
+            if (next[u] == unit->import_count) {
+                state[u] = 2;
+                self->order[self->order_count++] = u;
+                depth--;
+                continue;
+            }
+
+            uint32_t import = unit->imports[next[u]++];
+
+            if (import == UINT32_MAX || state[import] == 2) {
+                continue;
+            }
+
+            if (state[import] == 1) {
+                import_cycle (self, stack, depth, u, next[u] - 1);
+                good = false;
+                continue;
+            }
+
+            stack[depth++] = import;
+            state[import] = 1;
+        }
+    }
+
+    // dependents are listed in the order of units, then of their imports
+    for (uint32_t i = 0, first = 0; i < count; i++) {
+        self->units[i]->first_dependent = first;
+        first += self->units[i]->dependent_count;
+        next[i] = 0;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        clv_unit_t *u = &self->units[i]->unit;
+
+        for (uint32_t j = 0; j < u->import_count; j++) {
+            loader_unit_t *import = (u->imports[j] != UINT32_MAX) ? self->units[u->imports[j]] : NULL;
+
+            if (import != NULL) {
+                self->dependents[import->first_dependent + next[import->index]++] = i;
+            }
+        }
+    }
+
+    clv_free (state);
+    clv_free (stack);
+    clv_free (next);
+
+    return good;
+}
+
+
+/* == Loader == */
+
+
+clv_loader_t *
+clv_loader_new (clv_list_t *search_path) {
+    clv_loader_t *self = clv_calloc (CLV_TAG_LOADER, 1, sizeof (*self));
+
+    if (self == NULL) {
+        return NULL;
+    }
+
+    size_t count = (search_path != NULL) ? clv_list_length (search_path) : 0;
+
+    if ((self->search_path = clv_alloc (CLV_TAG_LOADER, count * sizeof (*self->search_path))) == NULL && count > 0) {
+        clv_loader_free (self);
+        return NULL;
+    }
+
+    for (clv_list_iter_t iter = (count > 0) ? clv_list_get_head (search_path) : NULL; iter != NULL;
+         iter = clv_list_iter_get_next (iter)) {
+        self->search_path[self->search_count++] = clv_list_iter_get_data (iter);
+    }
+
+    if (!unit_rehash (self, LOADER_MIN_CAPACITY)) {
+        clv_loader_free (self);
+        return NULL;
+    }
+
+    return self;
+}
+
+
+void
+clv_loader_set_cache (clv_loader_t *self, clv_cache_t *cache, uint64_t seed) {
+    self->cache = cache;
+    self->seed = seed;
+}
+
+
+uint32_t
+clv_loader_add (clv_loader_t *self, clv_str file) {
+    return unit_add (self, file, NULL);
+}
+
+
+bool
+clv_loader_load (clv_loader_t *self, clv_pool_t *pool) {
+    bool good = true;
+
+    // a wave of units is parsed at once, then the modules they import make
+    // up the next, which keeps the numbering of units the same every build
+    for (uint32_t begin = 0, end; begin < self->unit_count; begin = end) {
+        end = self->unit_count;
+
+        for (uint32_t i = begin; i < end; i++) {
+            loader_unit_t *unit = self->units[i];
+
+            unit->out_stream = open_memstream (&unit->out, &unit->out_length);
+            unit->err_stream = open_memstream (&unit->err, &unit->err_length);
+
+            if (pool == NULL || !clv_pool_submit (pool, unit_load, unit)) {
+                unit_load (unit);
+            }
+        }
+
+        clv_pool_wait (pool);
+
+        for (uint32_t i = begin; i < end; i++) {
+            loader_unit_t *unit = self->units[i];
+
+            if (unit->unit.ast == NULL && unit->unit.iface == NULL) {
+                good = false;
+                continue;
+            }
+
+            clv_log_capture (unit->out_stream, unit->err_stream);
+            unit->failed = !import_resolve (self, unit);
+
+            if (unit->failed && unit->unit.ast == NULL && unit_parse (unit)) {
+                unit->failed = !import_resolve (self, unit);
+            }
+
+            clv_log_capture (NULL, NULL);
+
+            good = good && !unit->failed;
+        }
+    }
+
+    good = import_sort (self) && good;
+
+    for (uint32_t i = 0; i < self->unit_count; i++) {
+        loader_unit_t *unit = self->units[i];
+
+        if (unit->out_stream != NULL) {
+            fclose (unit->out_stream);
+            unit->out_stream = NULL;
+        }
+
+        if (unit->err_stream != NULL) {
+            fclose (unit->err_stream);
+            unit->err_stream = NULL;
+        }
+    }
+
+    return good;
+}
+
+
+void
+clv_loader_report (clv_loader_t *self, uint32_t unit) {
+    loader_unit_t *u = self->units[unit];
+
+    if (u->out != NULL) {
+        clv_log_write (CLV_INFO, u->out, u->out_length);
+    }
+
+    if (u->err != NULL) {
+        clv_log_write (CLV_ERROR, u->err, u->err_length);
+    }
+}
+
+
+uint32_t
+clv_loader_count (clv_loader_t *self) {
+    return self->unit_count;
+}
+
+
+clv_unit_t *
+clv_loader_unit (clv_loader_t *self, uint32_t unit) {
+    return (unit < self->unit_count) ? &self->units[unit]->unit : NULL;
+}
+
+
+const uint32_t *
+clv_loader_order (clv_loader_t *self, uint32_t *out_count) {
+    *out_count = self->order_count;
+
+    return self->order;
+}
+
+
+/* == Scheduling == */
+
+
+static void schedule_run (void *arg);
+
+
+/* Imports of `unit` it has to wait for */
+static uint32_t
+schedule_imports (clv_unit_t *unit) {
+    uint32_t count = 0;
+
+    for (uint32_t i = 0; i < unit->import_count; i++) {
+        count += (unit->imports[i] != UINT32_MAX);
+    }
+
+    return count;
+}
+
+
+static void
+schedule_unit (loader_schedule_t *s, uint32_t unit) {
+    if (s->pool == NULL || !clv_pool_submit (s->pool, schedule_run, &s->tasks[unit])) {
+        schedule_run (&s->tasks[unit]);
+    }
+}
+
+
+/* Runs a unit whose imports are done, then releases those importing it */
+static void
+schedule_run (void *arg) {
+    loader_task_t *task = arg;
+    loader_schedule_t *s = task->schedule;
+    loader_unit_t *unit = s->loader->units[task->unit];
+
+    bool good = (unit->unit.ast != NULL || unit->unit.iface != NULL) && !unit->failed && !atomic_load (&s->skipped[task->unit])
+        && s->func (s->arg, task->unit);
+
+    if (!good) {
+        atomic_store (&s->good, false);
+    }
+
+    atomic_fetch_add (&s->done, 1);
+
+    for (uint32_t i = 0; i < unit->dependent_count; i++) {
+        uint32_t dependent = s->loader->dependents[unit->first_dependent + i];
+
+        if (!good) {
+            atomic_store (&s->skipped[dependent], true);
+        }
+
+        // the last import done lets the unit run
+        if (s->pool != NULL && atomic_fetch_sub (&s->pending[dependent], 1) == 1) {
+            schedule_unit (s, dependent);
+        }
+    }
+}
+
+
+bool
+clv_loader_schedule (clv_loader_t *self, clv_pool_t *pool, clv_loader_func_t func, void *arg) {
+    uint32_t count = self->unit_count;
+    loader_schedule_t s = {
+        .loader = self,
+        .pool = pool,
+        .func = func,
+        .arg = arg,
+        .pending = clv_alloc (CLV_TAG_LOADER, count * sizeof (*s.pending)),
+        .skipped = clv_alloc (CLV_TAG_LOADER, count * sizeof (*s.skipped)),
+        .tasks = clv_alloc (CLV_TAG_LOADER, count * sizeof (*s.tasks))
+    };
+
+    if ((s.pending == NULL || s.skipped == NULL || s.tasks == NULL) && count > 0) {
+        clv_error ("unable to schedule units: %s", strerror (errno));
+        clv_free (s.pending);
+        clv_free (s.skipped);
+        clv_free (s.tasks);
+        return false;
+    }
+
+    atomic_init (&s.done, 0);
+    atomic_init (&s.good, true);
+
+    for (uint32_t i = 0; i < count; i++) {
+        atomic_init (&s.pending[i], schedule_imports (&self->units[i]->unit));
+        atomic_init (&s.skipped[i], false);
+        s.tasks[i] = (loader_task_t){ .schedule = &s, .unit = i };
+    }
+
+    if (pool == NULL) {
+        for (uint32_t i = 0; i < self->order_count; i++) {
+            schedule_run (&s.tasks[self->order[i]]);
+        }
+    } else {
+        // counters drop as soon as units run, so units ready at first are
+        // told by their imports instead
+        for (uint32_t i = 0; i < count; i++) {
+            if (schedule_imports (&self->units[i]->unit) == 0) {
+                schedule_unit (&s, i);
+            }
+        }
+
+        clv_pool_wait (pool);
+    }
+
+    // units in cycles, or importing one, never ran
+    bool good = atomic_load (&s.good) && atomic_load (&s.done) == count;
+
+    clv_free (s.pending);
+    clv_free (s.skipped);
+    clv_free (s.tasks);
+
+    return good;
+}
+
+
+bool
+clv_loader_parse (clv_loader_t *self, uint32_t unit) {
+    loader_unit_t *u = self->units[unit];
+
+    return u->unit.src != NULL && unit_parse (u);
+}
+
+
+void
+clv_loader_release (clv_loader_t *self, uint32_t unit) {
+    loader_unit_t *u = self->units[unit];
+
+    clv_arena_free (u->arena);
+    clv_source_free (u->unit.src);
+    clv_interface_free (u->unit.iface);
+
+    u->arena = NULL;
+    u->unit.src = NULL;
+    u->unit.iface = NULL;
+    u->unit.tokens = NULL;
+    u->unit.ast = NULL;
+}
+
+
+void
+clv_loader_free (clv_loader_t *self) {
+    if (self == NULL) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < self->unit_count; i++) {
+        loader_unit_t *unit = self->units[i];
+
+        clv_loader_release (self, i);
+
+        clv_free (unit->found);
+        clv_free (unit->key);
+        clv_free (unit->unit.imports);
+        clv_free (unit->unit.import_paths);
+        clv_free (unit->import_tokens);
+        free (unit->out);
+        free (unit->err);
+        clv_free (unit);
+    }
+
+    clv_free (self->search_path);
+    clv_free (self->units);
+    clv_free (self->table);
+    clv_free (self->order);
+    clv_free (self->dependents);
+    clv_free (self);
+}
@@ -1,9 +1,18 @@
 #include <clover/log.h>
+#include <clover/alloc.h>
 
 #include <stdio.h>
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
+
+#define LOG_BATCH_SIZE      (64 * 1024)     /* batch limit for non-terminals */
+
+#define LOG_UNKNOWN         (-1)
 
 
 static const struct log_fmt {
@@ -18,51 +27,307 @@ static const struct log_fmt {
 };
 
 
+static _Thread_local struct {
+    FILE *out;
+    FILE *err;
+} log_capture = { NULL, NULL };
+
+
+/* Records bound to a file that isn't a terminal. Records of both outputs
+ * share one buffer, which is written out whenever the output changes, so
+ * they keep their relative order when stdout and stderr are the same file. */
+static struct {
+    pthread_mutex_t lock;
+
+    int fd;
+    size_t length;
+    char data[LOG_BATCH_SIZE];
+} log_batch = { .lock = PTHREAD_MUTEX_INITIALIZER, .fd = -1 };
+
+static atomic_int log_isatty[3] = { LOG_UNKNOWN, LOG_UNKNOWN, LOG_UNKNOWN };
+
+static pthread_once_t log_atexit_once = PTHREAD_ONCE_INIT;
+
+
+/* == Output == */
+
+
+static void
+log_write_fd (int fd, const char *data, size_t length) {
+    while (length > 0) {
+        ssize_t count = write (fd, data, length);
+
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return;
+        }
+
+        data += count;
+        length -= count;
+    }
+}
+
+
+static bool
+log_isatty_fd (int fd) {
+    int value = atomic_load_explicit (&log_isatty[fd], memory_order_relaxed);
+
+    if (value == LOG_UNKNOWN) {
+        value = isatty (fd);
+        atomic_store_explicit (&log_isatty[fd], value, memory_order_relaxed);
+    }
+
+    return value;
+}
+
+
+// must be called with the batch lock held
+static void
+log_batch_flush_locked () {
+    if (log_batch.length > 0) {
+        log_write_fd (log_batch.fd, log_batch.data, log_batch.length);
+        log_batch.length = 0;
+    }
+}
+
+
+static void
+log_register_atexit () {
+    atexit (clv_log_flush);
+}
+
+
+static void
+log_emit (int level, const char *data, size_t length) {
+    if (length == 0) {
+        return;
+    }
+
+    FILE *capture = (level >= CLV_ERROR) ? log_capture.err : log_capture.out;
+
+    if (capture != NULL) {
+        fwrite (data, 1, length, capture);
+        return;
+    }
+
+    int fd = (level >= CLV_ERROR) ? STDERR_FILENO : STDOUT_FILENO;
+
+    // logging must not clobber the errno callers are about to report
+    int saved_errno = errno;
+
+    pthread_mutex_lock (&log_batch.lock);
+
+    if (log_isatty_fd (fd)) {
+        // terminals are written immediately, after whatever was batched
+        log_batch_flush_locked ();
+        log_write_fd (fd, data, length);
+    } else {
+        pthread_once (&log_atexit_once, log_register_atexit);
+
+        if (log_batch.fd != fd || log_batch.length + length > LOG_BATCH_SIZE) {
+            log_batch_flush_locked ();
+            log_batch.fd = fd;
+        }
+
+        if (length > LOG_BATCH_SIZE) {
+            log_write_fd (fd, data, length);
+        } else {
+            memcpy (&log_batch.data[log_batch.length], data, length);
+            log_batch.length += length;
+        }
+
+        // errors usually precede an exit, don't sit on them
+        if (level >= CLV_ERROR) {
+            log_batch_flush_locked ();
+        }
+    }
+
+    pthread_mutex_unlock (&log_batch.lock);
+
+    errno = saved_errno;
+}
+
+
+/* == Records == */
+
+
+static bool
+log_reserve (clv_log_record_t *rec, size_t extra) {
+    if (rec->length + extra < rec->capacity) {
+        return true;
+    }
+
+    size_t capacity = rec->capacity * 2;
+
+    while (capacity <= rec->length + extra) {
+        capacity *= 2;
+    }
+
+    char *data;
+
+    if (rec->data == rec->inline_data) {
+        if ((data = clv_alloc (CLV_TAG_MISC, capacity)) != NULL) {
+            memcpy (data, rec->data, rec->length);
+        }
+    } else {
+        data = clv_realloc (CLV_TAG_MISC, rec->data, capacity);
+    }
+
+    if (data == NULL) {
+        return false;
+    }
+
+    rec->data = data;
+    rec->capacity = capacity;
+
+    return true;
+}
+
+
+void
+clv_log_begin (clv_log_record_t *rec, int level) {
+    rec->level = level;
+    rec->data = rec->inline_data;
+    rec->length = 0;
+    rec->capacity = sizeof (rec->inline_data);
+}
+
+
+void
+clv_log_vprintf (clv_log_record_t *rec, clv_str fmt, va_list args) {
+    va_list copy;
+
+    va_copy (copy, args);
+    int count = vsnprintf (&rec->data[rec->length], rec->capacity - rec->length, fmt, copy);
+    va_end (copy);
+
+    if (count < 0) {
+        return;
+    }
+
+    if (rec->length + count >= rec->capacity) {
+        if (!log_reserve (rec, count)) {
+            // keep what fit
+            rec->length = rec->capacity - 1;
+            return;
+        }
+
+        vsnprintf (&rec->data[rec->length], rec->capacity - rec->length, fmt, args);
+    }
+
+    rec->length += count;
+}
+
+
+void
+clv_log_printf (clv_log_record_t *rec, clv_str fmt, ...) {
+    va_list args;
+
+    va_start (args, fmt);
+    clv_log_vprintf (rec, fmt, args);
+    va_end (args);
+}
+
+
+void
+clv_log_append (clv_log_record_t *rec, const char *data, size_t length) {
+    if (!log_reserve (rec, length)) {
+        return;
+    }
+
+    memcpy (&rec->data[rec->length], data, length);
+    rec->length += length;
+}
+
+
+void
+clv_log_end (clv_log_record_t *rec) {
+    log_emit (rec->level, rec->data, rec->length);
+
+    if (rec->data != rec->inline_data) {
+        clv_free (rec->data);
+    }
+
+    rec->data = NULL;
+}
+
+
+void
+clv_log_write (int level, const char *data, size_t length) {
+    log_emit (level, data, length);
+}
+
+
+void
+clv_log_flush () {
+    pthread_mutex_lock (&log_batch.lock);
+    log_batch_flush_locked ();
+    pthread_mutex_unlock (&log_batch.lock);
+}
+
+
+void
+clv_log_capture (FILE *out, FILE *err) {
+    log_capture.out = out;
+    log_capture.err = err;
+}
+
+
 void
 _clv_log0 (clv_str file, int lineno, int level, int mode, clv_str msg, ...) {
     va_list args;
 
-    FILE *out;
+    clv_log_record_t rec;
     struct log_fmt fmt;
 
     if (level == CLV_DEBUG && !clv_log_debug ()) {
         return;
     }
 
-    out = (level >= CLV_ERROR) ? stderr : stdout;
+    clv_log_begin (&rec, level);
     fmt = log_fmts[(level >= CLV_DEBUG && level <= CLV_ERROR) ? 1 + level : 0];
 
 #if defined (CLV_DEBUG) && CLV_DEBUG
-    fprintf (out, "[%s:%u] ", file, lineno);
+    clv_log_printf (&rec, "[%s:%u] ", file, lineno);
 #endif /* CLV_DEBUG */
 
     if (mode & CLV_LOG_FORMAT) {
-        fprintf (out, fmt.format, fmt.level);
+        clv_log_printf (&rec, fmt.format, fmt.level);
     }
 
     va_start (args, msg);
-    vfprintf (out, msg, args);
+    clv_log_vprintf (&rec, msg, args);
     va_end (args);
 
     if (mode & CLV_LOG_NEWLINE) {
-        fputc ('\n', out);
+        clv_log_append (&rec, "\n", 1);
     }
+
+    clv_log_end (&rec);
 }
 
 
 bool
 clv_log_debug () {
-    static int debug = -1;
+    static atomic_int debug = LOG_UNKNOWN;
 
-    if (debug < 0) {
-        char *debug_env = getenv("DEBUG");
+    int value = atomic_load_explicit (&debug, memory_order_acquire);
 
-        if (debug_env != NULL) {
-            debug = (strcmp (debug_env, "1") == 0);
-        } else {
-            debug = false;
+    if (value == LOG_UNKNOWN) {
+        char *debug_env = getenv ("DEBUG");
+
+        int expected = LOG_UNKNOWN;
+        value = (debug_env != NULL && strcmp (debug_env, "1") == 0);
+
+        // every thread computes the same value, the first one publishes it
+        if (!atomic_compare_exchange_strong_explicit (&debug, &expected, value,
+                                                      memory_order_acq_rel, memory_order_acquire)) {
+            value = expected;
         }
     }
 
-    return (bool)debug;
+    return (bool)value;
 }
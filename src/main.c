@@ -6,7 +6,7 @@
 #include <errno.h>
 
 
-#define CLV_OPTIONS_INIT    ((struct clv_options){ false, NULL, true, true, NULL, false, NULL, NULL })
+#define CLV_OPTIONS_INIT    ((struct clv_options){ false, NULL, NULL, false, NULL, true, true, NULL, false, NULL, NULL, 0 })
 
 #define isoption(x)         (strlen ((x)) >= 2 && (x)[0] == '-')
 #define strequal(a,b)       (strcmp ((a), (b)) == 0)
@@ -15,6 +15,10 @@
 static struct clv_options {
     bool compile_mode;
     clv_list_t *args;
+    clv_list_t *include_dirs;
+
+    bool time_report;
+    clv_str trace_file;
 
     /* runtime options */
 
@@ -27,6 +31,7 @@ static struct clv_options {
     bool cp_debug;
     clv_str cp_manifest_file;
     clv_str cp_output_file;
+    unsigned cp_jobs;
 } options = CLV_OPTIONS_INIT;
 
 
@@ -52,8 +57,8 @@ static void
 show_help () {
     printf ((
         "Usage:\n"
-        "  clover [-f flag1,-flag2...] <file> [--] [args...]\n"
-        "  clover -c [-d] [-m <manifest>] [-o <output>] [--] file...\n"
+        "  clover [-f flag1,-flag2...] [-I <dir>] <file> [--] [args...]\n"
+        "  clover -c [-d] [-I <dir>] [-j <jobs>] [-m <manifest>] [-o <output>] [--] file...\n"
         "\nRun options:\n"
         "  -f FLAGS         Set runtime flags\n"
         "\nFlags:\n"
@@ -62,9 +67,13 @@ show_help () {
         "\nCompile options:\n"
         "  -c               Compile program\n"
         "  -d               Enable debug symbols\n"
+        "  -j JOBS          Compile JOBS files in parallel (default: one per CPU)\n"
         "  -m MANIFEST      Set manifest file\n"
         "  -o FILE          Set output file name\n"
         "\nGeneral options:\n"
+        "  -I DIR           Search DIR for imported modules\n"
+        "  -ftime-report    Report the time and memory each phase and module takes\n"
+        "  --trace FILE     Write phases out to FILE as Chrome trace events\n"
         "  -h  --help       Displays this message and exits\n"
         "  -v  --version    Displays program version and exits\n"
     ));
@@ -89,6 +98,7 @@ show_version () {
 static void
 free_options () {
     clv_list_free (options.args, NULL);
+    clv_list_free (options.include_dirs, NULL);
 }
 
 
@@ -119,6 +129,22 @@ parse_flags (clv_str flags) {
 }
 
 
+static unsigned
+parse_jobs (clv_str value) {
+    char *end;
+
+    errno = 0;
+    long jobs = strtol (value, &end, 10);
+
+    if (errno != 0 || *end != '\0' || jobs < 1 || jobs > 4096) {
+        clv_error ("invalid number of jobs: '%s'. use -h to get help", value);
+        exit (1);
+    }
+
+    return jobs;
+}
+
+
 static void
 parse_options (int argc, const char **argv) {
     bool end_options = false;
@@ -137,9 +163,20 @@ parse_options (int argc, const char **argv) {
                 options.compile_mode = true;
             } else if (strequal (curr, "-d")) {
                 options.cp_debug = true;
+            } else if (strequal (curr, "-ftime-report")) {
+                options.time_report = true;
+            } else if (strequal (curr, "--trace")) {
+                check_arity (1, i, argc, argv);
+                options.trace_file = argv[++i];
             } else if (strequal (curr, "-f")) {
                 check_arity (1, i, argc, argv);
                 parse_flags (argv[++i]);
+            } else if (strequal (curr, "-I")) {
+                check_arity (1, i, argc, argv);
+                clv_list_push_back (options.include_dirs, CLV_VOIDPTR (argv[++i]));
+            } else if (strequal (curr, "-j")) {
+                check_arity (1, i, argc, argv);
+                options.cp_jobs = parse_jobs (argv[++i]);
             } else if (strequal (curr, "-m")) {
                 check_arity (1, i, argc, argv);
                 options.cp_manifest_file = argv[++i];
@@ -158,6 +195,7 @@ parse_options (int argc, const char **argv) {
     }
 
     check_compile_mode_option ("-d", (options.cp_debug));
+    check_compile_mode_option ("-j", (options.cp_jobs != 0));
     check_compile_mode_option ("-m", (options.cp_manifest_file != NULL));
     check_compile_mode_option ("-o", (options.cp_output_file != NULL));
 }
@@ -165,9 +203,10 @@ parse_options (int argc, const char **argv) {
 
 static void
 init_options () {
-    options.args = clv_list_new ();
+    options.args = clv_list_new (NULL);
+    options.include_dirs = clv_list_new (NULL);
 
-    if (!options.args) {
+    if (!options.args || !options.include_dirs) {
         perror ("failed to create args list");
         exit (1);
     }
@@ -189,27 +228,67 @@ dump_options () {
         clv_xlog (CLV_DEBUG, " %s", arg);
     }
 
-    putchar ('\n');
+    clv_xlog (CLV_DEBUG, "\n");
 }
 
 
-inline static void
+inline static int
 compile_program () {
-    if (!clv_compile (options.cp_manifest_file, options.args, options.cp_output_file, options.cp_debug)) {
-        if (errno != 0) {
-            clv_error ("%s", strerror (errno));
-        }
+    clv_compile_opts_t opts = {
+        .manifest = options.cp_manifest_file,
+        .output = options.cp_output_file,
+        .debug = options.cp_debug,
+        .jobs = options.cp_jobs,
+        .search_path = options.include_dirs,
+        .cache_dir = CLV_CACHE_DIR,
+        .cache_size = CLV_CACHE_MAX_SIZE
+    };
+
+    // failures are reported by the build itself
+    if (!clv_compile (options.args, &opts)) {
+        clv_xlog (CLV_INFO, "compilation failed.\n");
+        return 1;
+    }
+
+    return 0;
+}
 
-        puts ("compilation failed.");
+
+inline static int
+run_program () {
+    clv_run_opts_t opts = {
+        .jit = options.rt_flag_jit,
+        .optimize = options.rt_flag_optimize,
+        .search_path = options.include_dirs
+    };
+
+    clv_list_iter_t iter = clv_list_get_head (options.args);
+    int status = 0;
+
+    if (iter == NULL) {
+        clv_error ("missing file to run. use -h to get help");
         exit (1);
     }
+
+    if (!clv_run (clv_list_iter_get_data (iter), &opts, &status)) {
+        return 1;
+    }
+
+    return status;
 }
 
 
-inline static void
-run_program () {
-    clv_error ("not implemented: code execution");
-    exit (1);
+static void
+report_timings () {
+    if (options.time_report) {
+        clv_timer_report ();
+    }
+
+    if (options.trace_file != NULL && !clv_timer_trace (options.trace_file)) {
+        clv_error ("unable to write trace %s: %s", options.trace_file, strerror (errno));
+    }
+
+    clv_timer_free ();
 }
 
 
@@ -227,9 +306,17 @@ main (int argc, const char **argv) {
         dump_options ();
     }
 
-    if (options.compile_mode) {
-        compile_program ();
-    } else {
-        run_program ();
+    bool timing = options.time_report || options.trace_file != NULL;
+
+    if (timing) {
+        clv_timer_enable ();
     }
+
+    int status = options.compile_mode ? compile_program () : run_program ();
+
+    if (timing) {
+        report_timings ();
+    }
+
+    return status;
 }
@@ -0,0 +1,1650 @@
+#include <clover/native.h>
+#include <clover/ssa.h>
+#include <clover/regalloc.h>
+#include <clover/elf.h>
+#include <clover/x86.h>
+#include <clover/hash.h>
+#include <clover/log.h>
+#include <clover/timer.h>
+#include <clover/alloc.h>
+
+#include <version.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+
+#define RAX                 0
+#define RCX                 1
+#define RDX                 2
+#define RBX                 3
+#define RSP                 4
+#define RBP                 5
+#define RSI                 6
+#define RDI                 7
+#define R8                  8
+#define R9                  9
+#define R10                 10
+#define R11                 11
+#define R12                 12
+#define R13                 13
+#define R14                 14
+#define R15                 15
+
+/* Registers values are given. Instructions work in rax, rcx and rdx, and
+ * cycles of moves go through r11. */
+#define NATIVE_ALLOCATABLE  ((1u << RBX) | (1u << RSI) | (1u << RDI) | (1u << R8) | (1u << R9) | (1u << R10) \
+                             | (1u << R12) | (1u << R13) | (1u << R14) | (1u << R15))
+#define NATIVE_CALLER_SAVED ((1u << RSI) | (1u << RDI) | (1u << R8) | (1u << R9) | (1u << R10))
+#define NATIVE_TEMP         R11
+#define NATIVE_NO_REG       (-1)
+
+/* Arguments past the third are passed on the stack */
+#define NATIVE_REG_ARGS     3
+
+/* Frames are addressed with 32 bits displacements */
+#define NATIVE_MAX_SLOTS    (INT32_MAX / 32)
+
+#define NATIVE_MESSAGE_SIZE 256
+
+#define NATIVE_DW_LANG_C99  0x0c
+
+/* Type and payload registers of each argument passed in registers */
+static const uint8_t arg_regs[NATIVE_REG_ARGS][CLV_REGALLOC_WORDS] = { { RDI, RSI }, { RDX, RCX }, { R8, R9 } };
+
+/* Registers calls keep, saved by functions giving them to values */
+static const uint8_t callee_saved[] = { RBX, R12, R13, R14, R15 };
+
+
+typedef struct {
+    uint32_t site;
+    uint32_t block;
+} native_jump_t;
+
+
+/* Branch to a call of CLV_ELF_FAIL with a message in .rodata */
+typedef struct {
+    uint32_t site;
+    uint32_t message;
+    uint32_t length;
+    uint32_t line;
+} native_trap_t;
+
+
+/* Source line of the code from `address` of .text on */
+typedef struct {
+    uint64_t address;
+    uint32_t line;
+} native_row_t;
+
+
+/* Symbol of a function of another module */
+typedef struct {
+    char *name;
+    uint32_t symbol;
+} native_import_t;
+
+
+typedef struct {
+    clv_module_t *module;
+    const clv_native_opts_t *opts;
+    clv_elf_t *elf;
+
+    uint32_t *fn_symbols;
+    uint64_t *fn_offsets;       /* in .text, once compiled */
+    uint64_t *fn_sizes;
+    uint32_t text_symbol;
+    uint32_t rodata_symbol;
+    uint32_t bss_symbol;
+    uint32_t fail_symbol;
+    uint32_t unsupported_symbol;
+
+    native_import_t *imports;
+    uint32_t import_count;
+    uint32_t import_capacity;   /* a power of two, at most half full */
+
+    native_row_t *rows;
+    uint32_t row_count;
+    uint32_t row_capacity;
+
+    /* of the function being compiled */
+    const clv_function_t *fn;
+    const clv_ssa_fn_t *ssa;
+    clv_str file;
+    uint32_t line;
+    uint64_t base;              /* where it goes in .text */
+    clv_x86_buffer_t code;
+
+    clv_regalloc_t *ra;
+    uint8_t saves[sizeof (callee_saved)];
+    uint32_t save_count;
+    uint32_t *block_offsets;
+
+    native_jump_t *jumps;
+    uint32_t jump_count;
+    uint32_t jump_capacity;
+
+    native_trap_t *traps;
+    uint32_t trap_count;
+    uint32_t trap_capacity;
+
+    bool error;
+} native_t;
+
+
+static bool
+native_reserve (void **data, uint32_t *capacity, uint32_t need, size_t size) {
+    if (need <= *capacity) {
+        return true;
+    }
+
+    uint32_t new_capacity = (*capacity == 0) ? 64 : *capacity * 2;
+
+    while (new_capacity < need) {
+        new_capacity *= 2;
+    }
+
+    void *temp = clv_realloc (CLV_TAG_NATIVE, *data, new_capacity * size);
+
+    if (temp == NULL) {
+        return false;
+    }
+
+    *data = temp;
+    *capacity = new_capacity;
+
+    return true;
+}
+
+
+/* == Emitting == */
+
+
+static void
+emit_uleb (clv_x86_buffer_t *b, uint64_t value) {
+    do {
+        uint8_t byte = value & 0x7f;
+
+        value >>= 7;
+        clv_x86_u8 (b, byte | ((value != 0) ? 0x80 : 0));
+    } while (value != 0);
+}
+
+
+static void
+emit_sleb (clv_x86_buffer_t *b, int64_t value) {
+    for (bool more = true; more;) {
+        uint8_t byte = value & 0x7f;
+
+        value >>= 7;
+        more = !((value == 0 && !(byte & 0x40)) || (value == -1 && (byte & 0x40)));
+        clv_x86_u8 (b, byte | (more ? 0x80 : 0));
+    }
+}
+
+
+static inline void
+emit_string (clv_x86_buffer_t *b, clv_str s) {
+    clv_x86_bytes (b, s, strlen (s) + 1);
+}
+
+
+/* mov reg, [rbp + disp] */
+static inline void
+emit_load (clv_x86_buffer_t *b, int reg, int32_t disp) {
+    clv_x86_mem (b, (reg & 8) ? "\x4c\x8b" : "\x48\x8b", 2, reg, RBP, disp);
+}
+
+
+/* mov [rbp + disp], reg */
+static inline void
+emit_store (clv_x86_buffer_t *b, int reg, int32_t disp) {
+    clv_x86_mem (b, (reg & 8) ? "\x4c\x89" : "\x48\x89", 2, reg, RBP, disp);
+}
+
+
+/* mov reg, imm, sign extended from 32 bits when it fits */
+static void
+emit_mov_imm (clv_x86_buffer_t *b, int reg, int64_t value) {
+    clv_x86_u8 (b, 0x48 | ((reg & 8) ? 1 : 0));
+
+    if (value == (int32_t)value) {
+        clv_x86_u8 (b, 0xc7);
+        clv_x86_u8 (b, 0xc0 | (reg & 7));
+        clv_x86_u32 (b, (uint32_t)value);
+    } else {
+        clv_x86_u8 (b, 0xb8 | (reg & 7));
+        clv_x86_u64 (b, (uint64_t)value);
+    }
+}
+
+
+/* == Functions == */
+
+
+#define USE(v)      CLV_REGALLOC_USE (v)
+#define DEF(v)      CLV_REGALLOC_DEF (v)
+
+
+static inline const clv_ssa_insn_t *
+insn_at (native_t *n, uint32_t v) {
+    return &n->ssa->insns[v];
+}
+
+
+static inline int
+native_reg (clv_loc_t loc) {
+    return (loc == CLV_LOC_TEMP) ? NATIVE_TEMP : (int)loc;
+}
+
+
+/* Emits `op` with register `reg` and the r/m operand `loc`, a register or
+ * a slot of the frame, after the REX prefix `rex` and what they need */
+static void
+native_rm (native_t *n, uint8_t rex, const char *op, size_t length, int reg, clv_loc_t loc) {
+    clv_x86_buffer_t *code = &n->code;
+    bool slot = CLV_LOC_IS_SLOT (loc);
+    int rm = slot ? RBP : native_reg (loc);
+
+    rex |= ((reg & 8) ? 0x44 : 0) | ((rm & 8) ? 0x41 : 0);
+
+    if (rex != 0) {
+        clv_x86_u8 (code, rex);
+    }
+
+    clv_x86_bytes (code, op, length);
+
+    if (slot) {
+        clv_x86_u8 (code, 0x80 | ((reg & 7) << 3) | RBP);
+        clv_x86_u32 (code, (uint32_t)(-8 * (int32_t)(n->save_count + CLV_LOC_SLOT_OF (loc) + 1)));
+    } else {
+        clv_x86_u8 (code, 0xc0 | ((reg & 7) << 3) | (rm & 7));
+    }
+}
+
+
+/* Type `v` has when run, which for more values than its static type is
+ * known, as there are only nils, bools and ints */
+static uint8_t
+native_type (const clv_ssa_fn_t *ssa, uint32_t v) {
+    const clv_ssa_insn_t *insn = &ssa->insns[v];
+
+    switch (insn->op) {
+    case CLV_SSA_ADD:
+    case CLV_SSA_SUB:
+    case CLV_SSA_MUL:
+    case CLV_SSA_DIV:
+    case CLV_SSA_MOD:
+    case CLV_SSA_BAND:
+    case CLV_SSA_BOR:
+    case CLV_SSA_BXOR:
+    case CLV_SSA_SHL:
+    case CLV_SSA_SHR:
+    case CLV_SSA_NEG:
+    case CLV_SSA_BNOT:
+    case CLV_SSA_ELEM:
+        return CLV_TYPE_INT;
+
+    default:
+        return insn->type;
+    }
+}
+
+
+/* What a word of `v` without a location is: its static type, or the
+ * constant it is */
+static int64_t
+native_remat (native_t *n, uint32_t v, uint8_t word) {
+    const clv_ssa_insn_t *insn = insn_at (n, v);
+
+    if (word == CLV_REGALLOC_TYPE) {
+        return native_type (n->ssa, v);
+    }
+
+    switch (insn->op) {
+    case CLV_SSA_BOOL:
+    case CLV_SSA_INT:
+        return (int32_t)insn->args[0];
+
+    case CLV_SSA_CONST:
+        return n->fn->constants[insn->args[0]].as.i;
+
+    default:
+        return 0;
+    }
+}
+
+
+/* Words of `v` needing a location: the payload unless nil, and the type
+ * unless known. Constants are rematerialized. */
+static uint32_t
+native_words (const clv_ssa_fn_t *ssa, uint32_t v, void *data) {
+    const clv_ssa_insn_t *insn = &ssa->insns[v];
+    uint32_t words = 0;
+
+    (void)data;
+
+    switch (insn->op) {
+    case CLV_SSA_NIL:
+    case CLV_SSA_BOOL:
+    case CLV_SSA_INT:
+    case CLV_SSA_CONST:
+    case CLV_SSA_RET:
+        return 0;
+
+    default:
+        break;
+    }
+
+    uint8_t type = native_type (ssa, v);
+
+    if (type != CLV_SSA_VOID && type != CLV_TYPE_NIL) {
+        words |= 1u << CLV_REGALLOC_PAYLOAD;
+    }
+
+    if (type == CLV_SSA_ANY) {
+        words |= 1u << CLV_REGALLOC_TYPE;
+    }
+
+    return words;
+}
+
+
+static const clv_regalloc_target_t native_target = {
+    .allocatable = NATIVE_ALLOCATABLE,
+    .caller_saved = NATIVE_CALLER_SAVED,
+    .arg_regs = arg_regs,
+    .arg_count = NATIVE_REG_ARGS,
+    .words = native_words
+};
+
+
+static inline clv_loc_t
+native_loc (native_t *n, uint32_t v, uint8_t word, uint32_t pos) {
+    return clv_regalloc_loc (n->ra, v, word, pos);
+}
+
+
+/* mov reg, word of `v` at `pos` */
+static void
+native_load (native_t *n, int reg, uint32_t v, uint8_t word, uint32_t pos) {
+    clv_loc_t loc = native_loc (n, v, word, pos);
+
+    if (loc == CLV_LOC_NONE) {
+        emit_mov_imm (&n->code, reg, native_remat (n, v, word));
+    } else if (CLV_LOC_IS_SLOT (loc) || native_reg (loc) != reg) {
+        native_rm (n, 0x48, "\x8b", 1, reg, loc);
+    }
+}
+
+
+/* mov loc, reg */
+static void
+native_store (native_t *n, clv_loc_t loc, int reg) {
+    if (CLV_LOC_IS_SLOT (loc) || native_reg (loc) != reg) {
+        native_rm (n, 0x48, "\x89", 1, reg, loc);
+    }
+}
+
+
+/* mov loc, imm, through rcx when a slot takes more than 32 bits */
+static void
+native_store_imm (native_t *n, clv_loc_t loc, int64_t value) {
+    if (!CLV_LOC_IS_SLOT (loc)) {
+        emit_mov_imm (&n->code, native_reg (loc), value);
+    } else if (value == (int32_t)value) {
+        native_rm (n, 0x48, "\xc7", 1, 0, loc);
+        clv_x86_u32 (&n->code, (uint32_t)value);
+    } else {
+        emit_mov_imm (&n->code, RCX, value);
+        native_store (n, loc, RCX);
+    }
+}
+
+
+/* cmp qword loc, imm8 */
+static inline void
+native_cmp_imm (native_t *n, clv_loc_t loc, int8_t value) {
+    native_rm (n, 0x48, "\x83", 1, 7, loc);
+    clv_x86_u8 (&n->code, (uint8_t)value);
+}
+
+
+/* Combines reg with a word of `v` by `op` reg, r/m, or with an immediate
+ * by 0x81 /`digit` or, when `digit` is negative, imul reg, reg, imm32 */
+static void
+native_op (native_t *n, const char *op, size_t length, int digit, int reg, uint32_t v, uint8_t word, uint32_t pos) {
+    clv_loc_t loc = native_loc (n, v, word, pos);
+    int64_t value = (loc == CLV_LOC_NONE) ? native_remat (n, v, word) : 0;
+
+    if (loc != CLV_LOC_NONE) {
+        native_rm (n, 0x48, op, length, reg, loc);
+    } else if (value == (int32_t)value) {
+        native_rm (n, 0x48, (digit < 0) ? "\x69" : "\x81", 1, (digit < 0) ? reg : digit, reg);
+        clv_x86_u32 (&n->code, (uint32_t)value);
+    } else {
+        emit_mov_imm (&n->code, RCX, value);
+        native_rm (n, 0x48, op, length, reg, RCX);
+    }
+}
+
+
+/* Makes moves one after the other, memory to memory through rcx */
+static void
+native_moves (native_t *n, const clv_move_t *moves, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        const clv_move_t *m = &moves[i];
+
+        if (m->src == CLV_LOC_NONE) {
+            native_store_imm (n, m->dst, native_remat (n, m->value, m->word));
+        } else if (CLV_LOC_IS_SLOT (m->src) && CLV_LOC_IS_SLOT (m->dst)) {
+            native_rm (n, 0x48, "\x8b", 1, RCX, m->src);
+            native_store (n, m->dst, RCX);
+        } else if (CLV_LOC_IS_SLOT (m->src)) {
+            native_rm (n, 0x48, "\x8b", 1, native_reg (m->dst), m->src);
+        } else {
+            native_store (n, m->dst, native_reg (m->src));
+        }
+    }
+}
+
+
+static inline void
+native_moves_at (native_t *n, uint32_t pos) {
+    uint32_t count;
+    const clv_move_t *moves = clv_regalloc_moves (n->ra, pos, &count);
+
+    native_moves (n, moves, count);
+}
+
+
+/* Puts what `v` defines, in registers `payload` and `type`, where it goes,
+ * once the moves made as it is defined are. Types are known when `type` is
+ * NATIVE_NO_REG. */
+static void
+native_def (native_t *n, uint32_t v, int payload, int type) {
+    clv_loc_t loc;
+
+    native_moves_at (n, DEF (v));
+
+    if ((loc = native_loc (n, v, CLV_REGALLOC_PAYLOAD, DEF (v))) != CLV_LOC_NONE) {
+        native_store (n, loc, payload);
+    }
+
+    if ((loc = native_loc (n, v, CLV_REGALLOC_TYPE, DEF (v))) == CLV_LOC_NONE) {
+        return;
+    }
+
+    if (type != NATIVE_NO_REG) {
+        native_store (n, loc, type);
+    } else {
+        native_store_imm (n, loc, native_type (n->ssa, v));
+    }
+}
+
+
+/* Relocation at `site` of the code of the function */
+static void
+native_relocate (native_t *n, uint32_t site, uint32_t type, uint32_t symbol, int64_t addend) {
+    if (!clv_elf_relocate (n->elf, CLV_ELF_TEXT, n->base + site, type, symbol, addend)) {
+        n->error = true;
+    }
+}
+
+
+/* Branches to block `block` */
+static void
+native_jump (native_t *n, uint8_t cc, uint32_t block) {
+    uint32_t site = clv_x86_branch (&n->code, cc);
+
+    if (!native_reserve ((void **)&n->jumps, &n->jump_capacity, n->jump_count + 1, sizeof (*n->jumps))) {
+        n->error = true;
+        return;
+    }
+
+    n->jumps[n->jump_count++] = (native_jump_t){ .site = site, .block = block };
+}
+
+
+/* Adds the report of a runtime error on the line being compiled to
+ * .rodata, and returns its offset */
+static uint32_t
+native_message (native_t *n, clv_str error, uint32_t *out_length) {
+    char message[NATIVE_MESSAGE_SIZE];
+    int length = snprintf (message, sizeof (message), "%s:%u: runtime error: %s", n->file, n->line, error);
+
+    length = (length < (int)sizeof (message) - 1) ? length : (int)sizeof (message) - 2;
+    message[length++] = '\n';
+    *out_length = length;
+
+    uint64_t offset = clv_elf_append (n->elf, CLV_ELF_RODATA, message, length, 1);
+
+    if (offset > UINT32_MAX) {
+        n->error = true;
+        return 0;
+    }
+
+    return offset;
+}
+
+
+/* Branches to a runtime error */
+static void
+native_trap (native_t *n, uint8_t cc, clv_str fmt, ...) __attribute__ ((format (printf, 3, 4)));
+
+static void
+native_trap (native_t *n, uint8_t cc, clv_str fmt, ...) {
+    char error[NATIVE_MESSAGE_SIZE];
+    va_list args;
+
+    va_start (args, fmt);
+    vsnprintf (error, sizeof (error), fmt, args);
+    va_end (args);
+
+    uint32_t site = clv_x86_branch (&n->code, cc);
+    uint32_t length;
+    uint32_t message = native_message (n, error, &length);
+
+    if (!native_reserve ((void **)&n->traps, &n->trap_capacity, n->trap_count + 1, sizeof (*n->traps))) {
+        n->error = true;
+        return;
+    }
+
+    n->traps[n->trap_count++] = (native_trap_t){
+        .site = site,
+        .message = message,
+        .length = length,
+        .line = n->line
+    };
+}
+
+
+/* Calls `symbol`, CLV_ELF_FAIL or CLV_ELF_UNSUPPORTED, with a message of
+ * .rodata */
+static void
+native_fail (native_t *n, uint32_t symbol, uint32_t message, uint32_t length) {
+    clv_x86_bytes (&n->code, "\x48\x8d\x3d", 3);            // lea rdi, [rip + message]
+    native_relocate (n, n->code.length, CLV_ELF_R_PC32, n->rodata_symbol, (int64_t)message - 4);
+    clv_x86_u32 (&n->code, 0);
+    clv_x86_u8 (&n->code, 0xbe);                            // mov esi, length
+    clv_x86_u32 (&n->code, length);
+    clv_x86_u8 (&n->code, 0xe8);                            // call symbol
+    native_relocate (n, n->code.length, CLV_ELF_R_PLT32, symbol, -4);
+    clv_x86_u32 (&n->code, 0);
+}
+
+
+static void
+native_row (native_t *n, uint32_t line) {
+    if (!n->opts->debug || line == n->line) {
+        return;
+    }
+
+    if (!native_reserve ((void **)&n->rows, &n->row_capacity, n->row_count + 1, sizeof (*n->rows))) {
+        n->error = true;
+        return;
+    }
+
+    n->rows[n->row_count++] = (native_row_t){ .address = n->base + n->code.length, .line = line };
+}
+
+
+/* Traps unless `x`, read by `v`, is an int. Values are nil, bools or ints. */
+static void
+native_guard_int (native_t *n, uint32_t v, uint32_t x, clv_str error) {
+    uint8_t type = native_type (n->ssa, x);
+
+    if (type == CLV_TYPE_INT) {
+        return;
+    }
+
+    if (type == CLV_SSA_ANY) {
+        native_cmp_imm (n, native_loc (n, x, CLV_REGALLOC_TYPE, USE (v)), CLV_TYPE_INT);
+    }
+
+    native_trap (n, (type == CLV_SSA_ANY) ? CLV_X86_JNE : CLV_X86_JMP, "%s", error);
+}
+
+
+/* Defines `v` as `x`, read at `pos` */
+static void
+native_copy (native_t *n, uint32_t v, uint32_t x, uint32_t pos) {
+    native_load (n, RAX, x, CLV_REGALLOC_PAYLOAD, pos);
+
+    if (native_loc (n, v, CLV_REGALLOC_TYPE, DEF (v)) != CLV_LOC_NONE) {
+        native_load (n, RDX, x, CLV_REGALLOC_TYPE, pos);
+    }
+
+    native_def (n, v, RAX, RDX);
+}
+
+
+/* Sets eax to whether `x`, read by `v`, is falsy: nil, or a false bool.
+ * Payloads of nil are always 0. */
+static void
+native_falsy (native_t *n, uint32_t v, uint32_t x) {
+    clv_loc_t payload = native_loc (n, x, CLV_REGALLOC_PAYLOAD, USE (v));
+
+    switch (native_type (n->ssa, x)) {
+    case CLV_TYPE_NIL:
+        clv_x86_bytes (&n->code, "\xb8\x01\x00\x00\x00", 5);  // mov eax, 1
+        break;
+
+    case CLV_TYPE_BOOL:
+        if (payload == CLV_LOC_NONE) {
+            clv_x86_u8 (&n->code, 0xb8);                      // mov eax, imm32
+            clv_x86_u32 (&n->code, native_remat (n, x, CLV_REGALLOC_PAYLOAD) == 0);
+            break;
+        }
+
+        native_cmp_imm (n, payload, 0);
+        clv_x86_bytes (&n->code, "\x0f\x94\xc0", 3);          // sete al
+        clv_x86_bytes (&n->code, "\x0f\xb6\xc0", 3);          // movzx eax, al
+        break;
+
+    case CLV_TYPE_INT:
+        clv_x86_bytes (&n->code, "\x31\xc0", 2);              // xor eax, eax
+        break;
+
+    default:
+        native_cmp_imm (n, native_loc (n, x, CLV_REGALLOC_TYPE, USE (v)), CLV_TYPE_INT);
+        clv_x86_bytes (&n->code, "\x0f\x92\xc0", 3);          // setb al
+        native_cmp_imm (n, payload, 0);
+        clv_x86_bytes (&n->code, "\x0f\x94\xc1", 3);          // sete cl
+        clv_x86_bytes (&n->code, "\x20\xc8", 2);              // and al, cl
+        clv_x86_bytes (&n->code, "\x0f\xb6\xc0", 3);          // movzx eax, al
+        break;
+    }
+}
+
+
+/* Goes on to successor #`s` of `from`, moving values to where it has
+ * them, and falling through when it comes next */
+static void
+native_goto (native_t *n, uint32_t from, uint32_t s, bool last) {
+    uint32_t to = n->ssa->blocks[from].succ[s];
+    uint32_t count;
+    const clv_move_t *moves = clv_regalloc_edge (n->ra, from, s, &count);
+
+    native_moves (n, moves, count);
+
+    if (!last || to != from + 1) {
+        native_jump (n, CLV_X86_JMP, to);
+    }
+}
+
+
+static void
+native_branch (native_t *n, uint32_t v, const clv_ssa_insn_t *insn) {
+    const clv_ssa_block_t *b = &n->ssa->blocks[insn->block];
+    uint32_t yes = b->succ[0];
+    uint32_t no = b->succ[1];
+    uint8_t type = native_type (n->ssa, insn->args[0]);
+    uint32_t yes_moves;
+    uint32_t no_moves;
+
+    if (no == CLV_SSA_NONE || no == yes || type == CLV_TYPE_INT || type == CLV_TYPE_NIL) {
+        native_moves_at (n, DEF (v));
+        native_goto (n, insn->block, (type == CLV_TYPE_NIL && no != CLV_SSA_NONE) ? 1 : 0, true);
+        return;
+    }
+
+    native_falsy (n, v, insn->args[0]);
+    native_moves_at (n, DEF (v));
+    clv_x86_bytes (&n->code, "\x85\xc0", 2);                // test eax, eax
+
+    clv_regalloc_edge (n->ra, insn->block, 0, &yes_moves);
+    clv_regalloc_edge (n->ra, insn->block, 1, &no_moves);
+
+    if (no_moves == 0) {
+        native_jump (n, CLV_X86_JNE, no);
+        native_goto (n, insn->block, 0, true);
+    } else if (yes_moves == 0) {
+        native_jump (n, CLV_X86_JE, yes);
+        native_goto (n, insn->block, 1, true);
+    } else {
+        uint32_t site = clv_x86_branch (&n->code, CLV_X86_JNE);
+
+        native_goto (n, insn->block, 0, false);
+        clv_x86_patch (&n->code, site, n->code.length);
+        native_goto (n, insn->block, 1, true);
+    }
+}
+
+
+/* Symbol of the function a constant names */
+static uint32_t
+native_callee (native_t *n, const clv_const_t *k) {
+    if (k->module == 0) {
+        return n->fn_symbols[k->as.index];
+    }
+
+    char name[NATIVE_MESSAGE_SIZE];
+    clv_str prefix = n->opts->imports[k->module - 1];
+    int length = snprintf (name, sizeof (name), "%s.%.*s", prefix, (int)k->as.s.length, k->as.s.data);
+
+    if (length >= (int)sizeof (name)) {
+        n->error = true;
+        return UINT32_MAX;
+    }
+
+    if (n->import_count + 1 > n->import_capacity / 2) {
+        uint32_t capacity = (n->import_capacity == 0) ? 64 : n->import_capacity * 2;
+        native_import_t *imports = clv_calloc (CLV_TAG_NATIVE, capacity, sizeof (*imports));
+
+        if (imports == NULL) {
+            n->error = true;
+            return UINT32_MAX;
+        }
+
+        for (uint32_t i = 0; i < n->import_capacity; i++) {
+            if (n->imports[i].name != NULL) {
+                uint32_t slot = clv_hash64 (n->imports[i].name, strlen (n->imports[i].name), 0);
+
+                while (imports[slot & (capacity - 1)].name != NULL) {
+                    slot++;
+                }
+
+                imports[slot & (capacity - 1)] = n->imports[i];
+            }
+        }
+
+        clv_free (n->imports);
+        n->imports = imports;
+        n->import_capacity = capacity;
+    }
+
+    uint32_t slot = clv_hash64 (name, length, 0);
+    native_import_t *entry;
+
+    for (;; slot++) {
+        entry = &n->imports[slot & (n->import_capacity - 1)];
+
+        if (entry->name == NULL) {
+            break;
+        }
+
+        if (strcmp (entry->name, name) == 0) {
+            return entry->symbol;
+        }
+    }
+
+    if ((entry->name = clv_strdup (CLV_TAG_NATIVE, name)) == NULL
+        || (entry->symbol = clv_elf_symbol (n->elf, name, CLV_ELF_UNDEF, 0, 0, true)) == UINT32_MAX) {
+        clv_free (entry->name);
+        entry->name = NULL;
+        n->error = true;
+        return UINT32_MAX;
+    }
+
+    n->import_count++;
+
+    return entry->symbol;
+}
+
+
+static void
+native_call (native_t *n, uint32_t v, const clv_ssa_insn_t *insn) {
+    const uint32_t *operands = &n->ssa->operands[insn->args[0]];
+    uint32_t count = insn->args[1] - 1;
+    const clv_const_t *k = &n->fn->constants[insn_at (n, operands[0])->args[0]];
+    clv_move_t moves[NATIVE_REG_ARGS * CLV_REGALLOC_WORDS];
+    clv_move_t ordered[2 * NATIVE_REG_ARGS * CLV_REGALLOC_WORDS];
+    uint32_t move_count = 0;
+    uint32_t ordered_count;
+
+    if (k->module == 0) {
+        const clv_function_t *callee = clv_module_function (n->module, k->as.index);
+
+        if (callee->arity != count) {
+            native_trap (n, CLV_X86_JMP, "%s expects %u arguments, not %u", callee->name, callee->arity, count);
+            return;
+        }
+    }
+
+    for (uint32_t i = NATIVE_REG_ARGS; i < count; i++) {
+        int32_t out = 16 * (i - NATIVE_REG_ARGS);
+
+        for (uint8_t w = 0; w < CLV_REGALLOC_WORDS; w++) {
+            native_load (n, RAX, operands[1 + i], w, USE (v));
+            clv_x86_bytes (&n->code, "\x48\x89\x84\x24", 4);  // mov [rsp + out], rax
+            clv_x86_u32 (&n->code, out + 8 * w);
+        }
+    }
+
+    // arguments may be in the registers of others
+    for (uint32_t i = 0; i < count && i < NATIVE_REG_ARGS; i++) {
+        for (uint8_t w = 0; w < CLV_REGALLOC_WORDS; w++) {
+            moves[move_count++] = (clv_move_t){
+                .dst = arg_regs[i][w],
+                .src = native_loc (n, operands[1 + i], w, USE (v)),
+                .value = operands[1 + i],
+                .word = w
+            };
+        }
+    }
+
+    if (!clv_regalloc_sequence (moves, move_count, ordered, &ordered_count)) {
+        n->error = true;
+        return;
+    }
+
+    native_moves (n, ordered, ordered_count);
+
+    clv_x86_u8 (&n->code, 0xe8);                              // call
+    native_relocate (n, n->code.length, CLV_ELF_R_PLT32, native_callee (n, k), -4);
+    clv_x86_u32 (&n->code, 0);
+
+    native_def (n, v, RDX, RAX);
+}
+
+
+/* Global `index` of the module to or from `reg` */
+static void
+native_global (native_t *n, const char *op, int reg, uint32_t index, uint32_t part) {
+    clv_x86_bytes (&n->code, op, 2);
+    clv_x86_u8 (&n->code, (reg << 3) | RBP);                // [rip + disp32]
+    native_relocate (n, n->code.length, CLV_ELF_R_PC32, n->bss_symbol, 16 * (int64_t)index + 8 * part - 4);
+    clv_x86_u32 (&n->code, 0);
+}
+
+
+/* Int arithmetic by `op` rax, r/m, or 0x81 /`digit` with an immediate */
+static void
+native_arith (native_t *n, uint32_t v, const clv_ssa_insn_t *insn, const char *op, size_t length, int digit,
+              clv_str symbol) {
+    native_guard_int (n, v, insn->args[0], symbol);
+    native_guard_int (n, v, insn->args[1], symbol);
+
+    native_load (n, RAX, insn->args[0], CLV_REGALLOC_PAYLOAD, USE (v));
+    native_op (n, op, length, digit, RAX, insn->args[1], CLV_REGALLOC_PAYLOAD, USE (v));
+    native_def (n, v, RAX, NATIVE_NO_REG);
+}
+
+
+/* The one quotient that doesn't fit wraps around */
+static void
+native_divide (native_t *n, uint32_t v, const clv_ssa_insn_t *insn, bool remainder) {
+    clv_str symbol = remainder ? "unsupported operands for %" : "unsupported operands for /";
+
+    native_guard_int (n, v, insn->args[0], symbol);
+    native_guard_int (n, v, insn->args[1], symbol);
+
+    native_load (n, RCX, insn->args[1], CLV_REGALLOC_PAYLOAD, USE (v));
+    native_load (n, RAX, insn->args[0], CLV_REGALLOC_PAYLOAD, USE (v));
+    clv_x86_bytes (&n->code, "\x48\x85\xc9", 3);              // test rcx, rcx
+    native_trap (n, CLV_X86_JE, "division by zero");
+    clv_x86_bytes (&n->code, "\x48\x83\xf9\xff", 4);          // cmp rcx, -1
+
+    if (remainder) {
+        clv_x86_bytes (&n->code, "\x75\x04", 2);              // jne 1f
+        clv_x86_bytes (&n->code, "\x31\xd2", 2);              // xor edx, edx
+        clv_x86_bytes (&n->code, "\xeb\x05", 2);              // jmp 2f
+        clv_x86_bytes (&n->code, "\x48\x99\x48\xf7\xf9", 5);  // 1: cqo; idiv rcx
+        native_def (n, v, RDX, NATIVE_NO_REG);                // 2:
+    } else {
+        clv_x86_bytes (&n->code, "\x75\x05", 2);              // jne 1f
+        clv_x86_bytes (&n->code, "\x48\xf7\xd8", 3);          // neg rax
+        clv_x86_bytes (&n->code, "\xeb\x05", 2);              // jmp 2f
+        clv_x86_bytes (&n->code, "\x48\x99\x48\xf7\xf9", 5);  // 1: cqo; idiv rcx
+        native_def (n, v, RAX, NATIVE_NO_REG);                // 2:
+    }
+}
+
+
+static void
+native_shift (native_t *n, uint32_t v, const clv_ssa_insn_t *insn, const char *op, clv_str symbol) {
+    native_guard_int (n, v, insn->args[0], symbol);
+    native_guard_int (n, v, insn->args[1], symbol);
+
+    // counts are masked to 6 bits, as the VM does
+    native_load (n, RCX, insn->args[1], CLV_REGALLOC_PAYLOAD, USE (v));
+    native_load (n, RAX, insn->args[0], CLV_REGALLOC_PAYLOAD, USE (v));
+    clv_x86_bytes (&n->code, op, 3);
+    native_def (n, v, RAX, NATIVE_NO_REG);
+}
+
+
+/* Defines `v` as the setcc of flags, a bool */
+static void
+native_setcc (native_t *n, uint32_t v, uint8_t setcc) {
+    clv_x86_u8 (&n->code, 0x0f);
+    clv_x86_u8 (&n->code, setcc);
+    clv_x86_u8 (&n->code, 0xc0);                            // setcc al
+    clv_x86_bytes (&n->code, "\x0f\xb6\xc0", 3);            // movzx eax, al
+    native_def (n, v, RAX, NATIVE_NO_REG);
+}
+
+
+static void
+native_compare (native_t *n, uint32_t v, const clv_ssa_insn_t *insn, uint8_t setcc, clv_str symbol) {
+    native_guard_int (n, v, insn->args[0], symbol);
+    native_guard_int (n, v, insn->args[1], symbol);
+
+    native_load (n, RAX, insn->args[0], CLV_REGALLOC_PAYLOAD, USE (v));
+    native_op (n, "\x3b", 1, 7, RAX, insn->args[1], CLV_REGALLOC_PAYLOAD, USE (v));
+    native_setcc (n, v, setcc);
+}
+
+
+/* Values of the same type and payload are equal: there are no floats */
+static void
+native_equal (native_t *n, uint32_t v, const clv_ssa_insn_t *insn, uint8_t setcc) {
+    native_load (n, RAX, insn->args[0], CLV_REGALLOC_TYPE, USE (v));
+    native_op (n, "\x33", 1, 6, RAX, insn->args[1], CLV_REGALLOC_TYPE, USE (v));
+    native_load (n, RDX, insn->args[0], CLV_REGALLOC_PAYLOAD, USE (v));
+    native_op (n, "\x33", 1, 6, RDX, insn->args[1], CLV_REGALLOC_PAYLOAD, USE (v));
+    clv_x86_bytes (&n->code, "\x48\x09\xd0", 3);            // or rax, rdx
+    native_setcc (n, v, setcc);
+}
+
+
+static void
+native_unary (native_t *n, uint32_t v, const clv_ssa_insn_t *insn, const char *op, clv_str symbol) {
+    native_guard_int (n, v, insn->args[0], symbol);
+
+    native_load (n, RAX, insn->args[0], CLV_REGALLOC_PAYLOAD, USE (v));
+    clv_x86_bytes (&n->code, op, 3);
+    native_def (n, v, RAX, NATIVE_NO_REG);
+}
+
+
+static void
+native_cast (native_t *n, uint32_t v, const clv_ssa_insn_t *insn) {
+    uint32_t x = insn->args[0];
+    uint8_t type = native_type (n->ssa, x);
+
+    if (type == insn->args[1]) {
+        native_copy (n, v, x, USE (v));
+        return;
+    }
+
+    if (insn->args[1] == CLV_TYPE_BOOL) {
+        native_falsy (n, v, x);
+        clv_x86_bytes (&n->code, "\x34\x01", 2);            // xor al, 1
+        native_def (n, v, RAX, NATIVE_NO_REG);
+        return;
+    }
+
+    // to int: bools are 0 or 1 already
+    if (type == CLV_SSA_ANY) {
+        native_cmp_imm (n, native_loc (n, x, CLV_REGALLOC_TYPE, USE (v)), CLV_TYPE_NIL);
+    }
+
+    if (type == CLV_SSA_ANY || type == CLV_TYPE_NIL) {
+        native_trap (n, (type == CLV_TYPE_NIL) ? CLV_X86_JMP : CLV_X86_JE, "cannot cast nil to int");
+    }
+
+    native_load (n, RAX, x, CLV_REGALLOC_PAYLOAD, USE (v));
+    native_def (n, v, RAX, NATIVE_NO_REG);
+}
+
+
+/* Parameter `index`, passed on the stack */
+static void
+native_param (native_t *n, uint32_t v, uint32_t index) {
+    int32_t in = 16 + 16 * (int32_t)(index - NATIVE_REG_ARGS);
+
+    native_moves_at (n, DEF (v));
+
+    for (uint8_t w = 0; w < CLV_REGALLOC_WORDS; w++) {
+        clv_loc_t loc = native_loc (n, v, w, DEF (v));
+
+        if (loc == CLV_LOC_NONE) {
+            continue;
+        }
+
+        emit_load (&n->code, CLV_LOC_IS_SLOT (loc) ? RAX : native_reg (loc), in + 8 * w);
+
+        if (CLV_LOC_IS_SLOT (loc)) {
+            native_store (n, loc, RAX);
+        }
+    }
+}
+
+
+static void
+native_insn (native_t *n, uint32_t v) {
+    const clv_ssa_insn_t *insn = insn_at (n, v);
+    clv_x86_buffer_t *code = &n->code;
+
+    switch ((clv_ssa_op_t)insn->op) {
+    case CLV_SSA_PARAM:
+        if (insn->args[0] < NATIVE_REG_ARGS) {
+            native_def (n, v, arg_regs[insn->args[0]][CLV_REGALLOC_PAYLOAD],
+                        arg_regs[insn->args[0]][CLV_REGALLOC_TYPE]);
+        } else {
+            native_param (n, v, insn->args[0]);
+        }
+
+        break;
+
+    // constants are rematerialized where read, and functions only ever
+    // called, by name
+    case CLV_SSA_NIL:
+    case CLV_SSA_BOOL:
+    case CLV_SSA_INT:
+    case CLV_SSA_CONST:
+    case CLV_SSA_PHI:
+        native_moves_at (n, DEF (v));
+        break;
+
+    case CLV_SSA_GETGLOBAL:
+        native_global (n, "\x48\x8b", RAX, insn->args[0], 0);
+        native_global (n, "\x48\x8b", RDX, insn->args[0], 1);
+        native_def (n, v, RDX, RAX);
+        break;
+
+    case CLV_SSA_SETGLOBAL:
+        native_load (n, RAX, insn->args[1], CLV_REGALLOC_TYPE, USE (v));
+        native_load (n, RDX, insn->args[1], CLV_REGALLOC_PAYLOAD, USE (v));
+        native_global (n, "\x48\x89", RAX, insn->args[0], 0);
+        native_global (n, "\x48\x89", RDX, insn->args[0], 1);
+        native_moves_at (n, DEF (v));
+        break;
+
+    case CLV_SSA_ADD:  native_arith (n, v, insn, "\x03", 1, 0, "unsupported operands for +"); break;
+    case CLV_SSA_SUB:  native_arith (n, v, insn, "\x2b", 1, 5, "unsupported operands for -"); break;
+    case CLV_SSA_MUL:  native_arith (n, v, insn, "\x0f\xaf", 2, -1, "unsupported operands for *"); break;
+    case CLV_SSA_BAND: native_arith (n, v, insn, "\x23", 1, 4, "unsupported operands for &"); break;
+    case CLV_SSA_BOR:  native_arith (n, v, insn, "\x0b", 1, 1, "unsupported operands for |"); break;
+    case CLV_SSA_BXOR: native_arith (n, v, insn, "\x33", 1, 6, "unsupported operands for ^"); break;
+    case CLV_SSA_DIV:  native_divide (n, v, insn, false); break;
+    case CLV_SSA_MOD:  native_divide (n, v, insn, true); break;
+    case CLV_SSA_SHL:  native_shift (n, v, insn, "\x48\xd3\xe0", "unsupported operands for <<"); break;
+    case CLV_SSA_SHR:  native_shift (n, v, insn, "\x48\xd3\xf8", "unsupported operands for >>"); break;
+    case CLV_SSA_LT:   native_compare (n, v, insn, 0x9c, "unsupported operands for <"); break;
+    case CLV_SSA_LE:   native_compare (n, v, insn, 0x9e, "unsupported operands for <="); break;
+    case CLV_SSA_EQ:   native_equal (n, v, insn, 0x94); break;
+    case CLV_SSA_NE:   native_equal (n, v, insn, 0x95); break;
+    case CLV_SSA_NEG:  native_unary (n, v, insn, "\x48\xf7\xd8", "unsupported operand for -"); break;
+    case CLV_SSA_BNOT: native_unary (n, v, insn, "\x48\xf7\xd0", "unsupported operand for ~"); break;
+
+    case CLV_SSA_NOT:
+        native_falsy (n, v, insn->args[0]);
+        native_def (n, v, RAX, NATIVE_NO_REG);
+        break;
+
+    case CLV_SSA_CAST:
+        native_cast (n, v, insn);
+        break;
+
+    case CLV_SSA_UNWRAP:
+        if (native_type (n->ssa, insn->args[0]) == CLV_SSA_ANY) {
+            native_cmp_imm (n, native_loc (n, insn->args[0], CLV_REGALLOC_TYPE, USE (v)), CLV_TYPE_NIL);
+            native_trap (n, CLV_X86_JE, "unwrapped a nil value");
+        } else if (native_type (n->ssa, insn->args[0]) == CLV_TYPE_NIL) {
+            native_trap (n, CLV_X86_JMP, "unwrapped a nil value");
+        }
+
+        native_copy (n, v, insn->args[0], USE (v));
+        break;
+
+    case CLV_SSA_ITER:
+        native_guard_int (n, v, insn->args[0], "cannot iterate over this value");
+        clv_x86_bytes (code, "\x31\xc0", 2);                // xor eax, eax
+        native_def (n, v, RAX, NATIVE_NO_REG);
+        break;
+
+    // collections are ints, their items the cursor
+    case CLV_SSA_MORE:
+        native_load (n, RAX, insn->args[1], CLV_REGALLOC_PAYLOAD, USE (v));
+        native_op (n, "\x3b", 1, 7, RAX, insn->args[0], CLV_REGALLOC_PAYLOAD, USE (v));
+        native_setcc (n, v, 0x9c);
+        break;
+
+    case CLV_SSA_ELEM:
+    case CLV_SSA_STEP:
+        native_load (n, RAX, insn->args[1], CLV_REGALLOC_PAYLOAD, USE (v));
+
+        if (insn->op == CLV_SSA_STEP) {
+            clv_x86_bytes (code, "\x48\xff\xc0", 3);        // inc rax
+        }
+
+        native_def (n, v, RAX, NATIVE_NO_REG);
+        break;
+
+    case CLV_SSA_CALL:
+        native_call (n, v, insn);
+        break;
+
+    case CLV_SSA_JMP:
+        native_moves_at (n, DEF (v));
+        native_goto (n, insn->block, 0, true);
+        break;
+
+    case CLV_SSA_BRANCH:
+        native_branch (n, v, insn);
+        break;
+
+    case CLV_SSA_RET:
+        if (insn->args[0] == CLV_SSA_NONE) {
+            clv_x86_bytes (code, "\x31\xc0\x31\xd2", 4);    // xor eax, eax; xor edx, edx
+        } else {
+            native_load (n, RAX, insn->args[0], CLV_REGALLOC_TYPE, USE (v));
+            native_load (n, RDX, insn->args[0], CLV_REGALLOC_PAYLOAD, USE (v));
+        }
+
+        for (uint32_t i = 0; i < n->save_count; i++) {
+            emit_load (code, n->saves[i], -8 * (int32_t)(i + 1));
+        }
+
+        clv_x86_bytes (code, "\xc9\xc3", 2);                // leave; ret
+        break;
+
+    case CLV_SSA_TYPEOF:
+    case CLV_SSA_OP_COUNT:
+        break;
+    }
+}
+
+
+/* What of `ssa` the backend can't compile, if anything, and where */
+static bool
+native_unsupported (native_t *n, const clv_ssa_fn_t *ssa, char *reason, size_t size, uint32_t *out_line) {
+    for (uint32_t v = 0; v < ssa->count; v++) {
+        const clv_ssa_insn_t *insn = &ssa->insns[v];
+
+        *out_line = ssa->lines[v];
+
+        switch (insn->op) {
+        case CLV_SSA_CONST: {
+            const clv_const_t *k = &ssa->source->constants[insn->args[0]];
+
+            if (k->type == CLV_TYPE_INT) {
+                break;
+            }
+
+            if (k->type == CLV_TYPE_NATIVE || (k->type == CLV_TYPE_FN && k->module != 0
+                                               && n->opts->imports[k->module - 1] == NULL)) {
+                snprintf (reason, size, "calls native functions");
+                return true;
+            }
+
+            if (k->type != CLV_TYPE_FN) {
+                snprintf (reason, size, "uses %s values", clv_type_name (k->type));
+                return true;
+            }
+
+            // functions must be called directly
+            for (uint32_t u = ssa->use_first[v]; u < ssa->use_first[v + 1]; u++) {
+                const clv_ssa_insn_t *user = &ssa->insns[ssa->uses[u]];
+                uint32_t count;
+                const uint32_t *operands = clv_ssa_operands (ssa, user, &count);
+
+                for (uint32_t i = (user->op == CLV_SSA_CALL) ? 1 : 0; i < count; i++) {
+                    if (operands[i] == v) {
+                        snprintf (reason, size, "uses functions as values");
+                        return true;
+                    }
+                }
+            }
+
+            break;
+        }
+
+        case CLV_SSA_CALL: {
+            const clv_ssa_insn_t *callee = &ssa->insns[ssa->operands[insn->args[0]]];
+
+            if (callee->op != CLV_SSA_CONST || ssa->source->constants[callee->args[0]].type != CLV_TYPE_FN) {
+                snprintf (reason, size, "calls values that aren't known functions");
+                return true;
+            }
+
+            break;
+        }
+
+        case CLV_SSA_CAST:
+            if (insn->args[1] != CLV_TYPE_INT && insn->args[1] != CLV_TYPE_BOOL) {
+                snprintf (reason, size, "casts to %s", clv_type_name (insn->args[1]));
+                return true;
+            }
+
+            break;
+
+        case CLV_SSA_TYPEOF:
+            snprintf (reason, size, "uses typeof");
+            return true;
+
+        default:
+            break;
+        }
+    }
+
+    return false;
+}
+
+
+static bool
+native_body (native_t *n, const clv_ssa_fn_t *ssa) {
+    clv_regalloc_stats_t stats;
+    uint32_t used = clv_regalloc_used (n->ra);
+    uint32_t out = 0;
+
+    clv_regalloc_stats (n->ra, &stats);
+
+    if (stats.slots > NATIVE_MAX_SLOTS) {
+        return false;
+    }
+
+    // below the saved registers and spill slots, arguments passed on the
+    // stack
+    for (uint32_t v = 0; v < ssa->count; v++) {
+        const clv_ssa_insn_t *insn = &ssa->insns[v];
+
+        if (insn->op == CLV_SSA_CALL && insn->args[1] - 1 > NATIVE_REG_ARGS) {
+            uint32_t size = 16 * (insn->args[1] - 1 - NATIVE_REG_ARGS);
+
+            out = (size > out) ? size : out;
+        }
+    }
+
+    n->save_count = 0;
+
+    for (uint32_t i = 0; i < sizeof (callee_saved); i++) {
+        if (used & (1u << callee_saved[i])) {
+            n->saves[n->save_count++] = callee_saved[i];
+        }
+    }
+
+    uint32_t frame = ((8 * (n->save_count + stats.slots) + 15) & ~15u) + out;
+
+    // the prologue is on the line the body starts at
+    if (ssa->count > 0) {
+        native_row (n, ssa->lines[0]);
+        n->line = ssa->lines[0];
+    }
+
+    clv_x86_bytes (&n->code, "\x55\x48\x89\xe5", 4);        // push rbp; mov rbp, rsp
+    clv_x86_bytes (&n->code, "\x48\x81\xec", 3);            // sub rsp, frame
+    clv_x86_u32 (&n->code, frame);
+
+    for (uint32_t i = 0; i < n->save_count; i++) {
+        emit_store (&n->code, n->saves[i], -8 * (int32_t)(i + 1));
+    }
+
+    for (uint32_t i = 0; i < ssa->block_count; i++) {
+        const clv_ssa_block_t *b = &ssa->blocks[i];
+
+        n->block_offsets[i] = n->code.length;
+
+        for (uint32_t v = b->first; v < b->first + b->count; v++) {
+            native_row (n, ssa->lines[v]);
+            n->line = ssa->lines[v];
+            native_moves_at (n, USE (v));
+            native_insn (n, v);
+        }
+    }
+
+    for (uint32_t i = 0; i < n->jump_count; i++) {
+        clv_x86_patch (&n->code, n->jumps[i].site, n->block_offsets[n->jumps[i].block]);
+    }
+
+    // errors are out of the way, after the code
+    for (uint32_t i = 0; i < n->trap_count; i++) {
+        clv_x86_patch (&n->code, n->traps[i].site, n->code.length);
+        native_row (n, n->traps[i].line);
+        n->line = n->traps[i].line;
+        native_fail (n, n->fail_symbol, n->traps[i].message, n->traps[i].length);
+    }
+
+    return true;
+}
+
+
+/* Allocates registers, timed apart from emitting code */
+static clv_regalloc_t *
+native_regalloc (const clv_ssa_fn_t *ssa) {
+    clv_timer_begin (CLV_PHASE_REGALLOC, NULL);
+    clv_regalloc_t *ra = clv_regalloc_new (ssa, &native_target);
+    clv_timer_end ();
+
+    return ra;
+}
+
+
+static bool
+native_function (native_t *n, uint32_t index) {
+    const clv_function_t *fn = clv_module_function (n->module, index);
+    clv_ssa_fn_t ssa;
+
+    clv_timer_begin (CLV_PHASE_SSA, NULL);
+    bool built = clv_ssa_build (fn, &ssa);
+    clv_timer_end ();
+
+    if (!built) {
+        return false;
+    }
+
+    char reason[NATIVE_MESSAGE_SIZE];
+    uint32_t line = 0;
+    int error = ENOMEM;
+
+    n->fn = fn;
+    n->ssa = &ssa;
+    n->file = (fn->file != NULL) ? fn->file : clv_module_get_file (n->module);
+    n->line = 0;
+    n->base = (clv_elf_size (n->elf, CLV_ELF_TEXT) + 15) & ~(uint64_t)15;
+    n->code.length = 0;
+    n->jump_count = 0;
+    n->trap_count = 0;
+    n->ra = NULL;
+    n->block_offsets = clv_alloc (CLV_TAG_NATIVE, ssa.block_count * sizeof (*n->block_offsets));
+
+    if (n->block_offsets == NULL || !clv_ssa_uses (&ssa)) {
+        n->error = true;
+    } else if (native_unsupported (n, &ssa, reason, sizeof (reason), &line)) {
+        clv_warning ("%s:%u: %s can't be compiled, as it %s, so executables can't run it", n->file, line, fn->name,
+                     reason);
+
+        char message[NATIVE_MESSAGE_SIZE];
+        uint32_t length;
+
+        snprintf (message, sizeof (message), "%s is not supported by the native backend", fn->name);
+        native_row (n, line);
+        n->line = line;
+        uint32_t offset = native_message (n, message, &length);
+
+        native_fail (n, n->unsupported_symbol, offset, length);
+    } else if ((n->ra = native_regalloc (&ssa)) == NULL) {
+        n->error = true;
+    } else if (clv_log_debug () && !clv_regalloc_check (n->ra)) {
+        error = EINVAL;
+        n->error = true;
+    } else if (!native_body (n, &ssa)) {
+        error = EOVERFLOW;
+        n->error = true;
+    }
+
+    clv_regalloc_free (n->ra);
+    clv_free (n->block_offsets);
+    n->ra = NULL;
+    n->block_offsets = NULL;
+    clv_ssa_free (&ssa);
+
+    if (n->error || n->code.error) {
+        errno = error;
+        return false;
+    }
+
+    uint64_t offset = clv_elf_append (n->elf, CLV_ELF_TEXT, n->code.data, n->code.length, 16);
+
+    n->fn_offsets[index] = offset;
+    n->fn_sizes[index] = n->code.length;
+
+    if (offset != n->base || !clv_elf_define (n->elf, n->fn_symbols[index], CLV_ELF_TEXT, offset, n->code.length)) {
+        errno = ENOMEM;
+        return false;
+    }
+
+    return true;
+}
+
+
+/* == Debug info == */
+
+
+/* Appends a DWARF section, with relocations of 64 bits at `addresses` to
+ * .text, and of 32 bits at `offset` to the start of `target` */
+static bool
+native_section (native_t *n, clv_elf_section_t section, const clv_x86_buffer_t *b, const uint32_t *addresses,
+                const uint64_t *addends, uint32_t count, uint32_t offset, clv_elf_section_t target) {
+    if (b->error || clv_elf_append (n->elf, section, b->data, b->length, 1) == UINT64_MAX) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (!clv_elf_relocate (n->elf, section, addresses[i], CLV_ELF_R_64, n->text_symbol, addends[i])) {
+            return false;
+        }
+    }
+
+    return target == CLV_ELF_UNDEF
+        || clv_elf_relocate (n->elf, section, offset, CLV_ELF_R_32, clv_elf_section_symbol (n->elf, target), 0);
+}
+
+
+/* Line numbers of the code of the module, as one sequence */
+static bool
+native_debug_line (native_t *n) {
+    clv_x86_buffer_t b = { .tag = CLV_TAG_NATIVE };
+    uint64_t text_size = clv_elf_size (n->elf, CLV_ELF_TEXT);
+
+    // DWARF 4 header
+    static const uint8_t opcode_lengths[] = { 0, 1, 1, 1, 1, 0, 0, 0, 1, 0, 0, 1 };
+
+    clv_x86_u32 (&b, 0);                           // unit length, set below
+    clv_x86_u16 (&b, 4);
+    clv_x86_u32 (&b, 0);                           // header length, set below
+
+    size_t header = b.length;
+
+    clv_x86_u8 (&b, 1);                            // minimum instruction length
+    clv_x86_u8 (&b, 1);                            // maximum operations per instruction
+    clv_x86_u8 (&b, 1);                            // default is_stmt
+    clv_x86_u8 (&b, (uint8_t)-5);                  // line base
+    clv_x86_u8 (&b, 14);                           // line range
+    clv_x86_u8 (&b, sizeof (opcode_lengths) + 1);  // opcode base
+    clv_x86_bytes (&b, opcode_lengths, sizeof (opcode_lengths));
+    clv_x86_u8 (&b, 0);                            // no include directories
+    emit_string (&b, clv_module_get_file (n->module));
+    emit_uleb (&b, 0);                             // directory, mtime and length
+    emit_uleb (&b, 0);
+    emit_uleb (&b, 0);
+    clv_x86_u8 (&b, 0);
+
+    uint32_t header_length = b.length - header;
+
+    // DW_LNE_set_address
+    clv_x86_bytes (&b, "\x00\x09\x02", 3);
+
+    uint32_t address = b.length;
+
+    clv_x86_u64 (&b, 0);
+
+    uint64_t pc = 0;
+    int64_t line = 1;
+
+    for (uint32_t i = 0; i < n->row_count; i++) {
+        if (n->rows[i].address > pc) {
+            clv_x86_u8 (&b, 0x02);                 // DW_LNS_advance_pc
+            emit_uleb (&b, n->rows[i].address - pc);
+        }
+
+        if (n->rows[i].line != line) {
+            clv_x86_u8 (&b, 0x03);                 // DW_LNS_advance_line
+            emit_sleb (&b, (int64_t)n->rows[i].line - line);
+        }
+
+        clv_x86_u8 (&b, 0x01);                     // DW_LNS_copy
+        pc = n->rows[i].address;
+        line = n->rows[i].line;
+    }
+
+    if (text_size > pc) {
+        clv_x86_u8 (&b, 0x02);
+        emit_uleb (&b, text_size - pc);
+    }
+
+    clv_x86_bytes (&b, "\x00\x01\x01", 3);         // DW_LNE_end_sequence
+
+    if (!b.error) {
+        uint32_t unit_length = b.length - 4;
+
+        memcpy (b.data, &unit_length, 4);
+        memcpy (b.data + 6, &header_length, 4);
+    }
+
+    bool good = native_section (n, CLV_ELF_DEBUG_LINE, &b, &address, &(uint64_t){ 0 }, 1, 0, CLV_ELF_UNDEF);
+
+    clv_free (b.data);
+
+    return good;
+}
+
+
+/* A compile unit, with a subprogram for every function */
+static bool
+native_debug_info (native_t *n) {
+    static const uint8_t abbrev[] = {
+        1, 0x11, 1,                             // DW_TAG_compile_unit, with children
+        0x25, 0x08,                             // DW_AT_producer, DW_FORM_string
+        0x13, 0x05,                             // DW_AT_language, DW_FORM_data2
+        0x03, 0x08,                             // DW_AT_name, DW_FORM_string
+        0x1b, 0x08,                             // DW_AT_comp_dir, DW_FORM_string
+        0x11, 0x01,                             // DW_AT_low_pc, DW_FORM_addr
+        0x12, 0x07,                             // DW_AT_high_pc, DW_FORM_data8
+        0x10, 0x17,                             // DW_AT_stmt_list, DW_FORM_sec_offset
+        0, 0,
+        2, 0x2e, 0,                             // DW_TAG_subprogram, without children
+        0x03, 0x08,                             // DW_AT_name, DW_FORM_string
+        0x3f, 0x19,                             // DW_AT_external, DW_FORM_flag_present
+        0x11, 0x01,                             // DW_AT_low_pc, DW_FORM_addr
+        0x12, 0x07,                             // DW_AT_high_pc, DW_FORM_data8
+        0, 0,
+        0
+    };
+
+    uint32_t count = clv_module_function_count (n->module);
+    uint32_t *addresses = clv_alloc (CLV_TAG_NATIVE, (count + 1) * sizeof (*addresses));
+    uint64_t *addends = clv_calloc (CLV_TAG_NATIVE, count + 1, sizeof (*addends));
+    clv_x86_buffer_t b = { .tag = CLV_TAG_NATIVE };
+    char dir[PATH_MAX];
+    bool good = false;
+
+    if (addresses == NULL || addends == NULL
+        || clv_elf_append (n->elf, CLV_ELF_DEBUG_ABBREV, abbrev, sizeof (abbrev), 1) == UINT64_MAX) {
+        goto cleanup;
+    }
+
+    clv_x86_u32 (&b, 0);                        // unit length, set below
+    clv_x86_u16 (&b, 4);
+
+    uint32_t abbrev_offset = b.length;
+
+    clv_x86_u32 (&b, 0);
+    clv_x86_u8 (&b, 8);                         // address size
+
+    emit_uleb (&b, 1);
+    emit_string (&b, "clover " CLOVER_VERSION);
+    clv_x86_u16 (&b, NATIVE_DW_LANG_C99);
+    emit_string (&b, clv_module_get_file (n->module));
+    emit_string (&b, (getcwd (dir, sizeof (dir)) != NULL) ? dir : ".");
+    addresses[0] = b.length;
+    clv_x86_u64 (&b, 0);
+    clv_x86_u64 (&b, clv_elf_size (n->elf, CLV_ELF_TEXT));
+    clv_x86_u32 (&b, 0);                        // .debug_line of this object
+
+    uint32_t stmt_list = b.length - 4;
+
+    for (uint32_t i = 0; i < count; i++) {
+        const clv_function_t *fn = clv_module_function (n->module, i);
+
+        emit_uleb (&b, 2);
+        emit_string (&b, fn->name);
+        addresses[i + 1] = b.length;
+        addends[i + 1] = n->fn_offsets[i];
+        clv_x86_u64 (&b, 0);
+        clv_x86_u64 (&b, n->fn_sizes[i]);
+    }
+
+    clv_x86_u8 (&b, 0);
+
+    if (!b.error) {
+        uint32_t unit_length = b.length - 4;
+
+        memcpy (b.data, &unit_length, 4);
+    }
+
+    good = native_section (n, CLV_ELF_DEBUG_INFO, &b, addresses, addends, count + 1, abbrev_offset,
+                           CLV_ELF_DEBUG_ABBREV)
+        && clv_elf_relocate (n->elf, CLV_ELF_DEBUG_INFO, stmt_list, CLV_ELF_R_32,
+                             clv_elf_section_symbol (n->elf, CLV_ELF_DEBUG_LINE), 0);
+
+cleanup:
+    clv_free (addresses);
+    clv_free (addends);
+    clv_free (b.data);
+
+    return good;
+}
+
+
+/* == Modules == */
+
+
+bool
+clv_native_compile (clv_module_t *module, const clv_native_opts_t *opts, void **out_data, size_t *out_length) {
+    native_t n = { .module = module, .opts = opts, .code = { .tag = CLV_TAG_NATIVE } };
+    uint32_t count = clv_module_function_count (module);
+    uint32_t globals = clv_module_global_count (module);
+    bool good = false;
+
+    n.elf = clv_elf_new ();
+    n.fn_symbols = clv_alloc (CLV_TAG_NATIVE, count * sizeof (*n.fn_symbols));
+    n.fn_offsets = clv_alloc (CLV_TAG_NATIVE, count * sizeof (*n.fn_offsets));
+    n.fn_sizes = clv_alloc (CLV_TAG_NATIVE, count * sizeof (*n.fn_sizes));
+    errno = ENOMEM;
+
+    if (n.elf == NULL || n.fn_symbols == NULL || n.fn_offsets == NULL || n.fn_sizes == NULL) {
+        goto cleanup;
+    }
+
+    n.text_symbol = clv_elf_section_symbol (n.elf, CLV_ELF_TEXT);
+    n.rodata_symbol = clv_elf_section_symbol (n.elf, CLV_ELF_RODATA);
+    n.bss_symbol = clv_elf_section_symbol (n.elf, CLV_ELF_BSS);
+    n.fail_symbol = clv_elf_symbol (n.elf, CLV_ELF_FAIL, CLV_ELF_UNDEF, 0, 0, true);
+    n.unsupported_symbol = clv_elf_symbol (n.elf, CLV_ELF_UNSUPPORTED, CLV_ELF_UNDEF, 0, 0, true);
+
+    // globals start nil, all zeroes
+    if (n.text_symbol == UINT32_MAX || n.rodata_symbol == UINT32_MAX || n.bss_symbol == UINT32_MAX
+        || n.fail_symbol == UINT32_MAX || n.unsupported_symbol == UINT32_MAX
+        || clv_elf_append (n.elf, CLV_ELF_BSS, NULL, 16 * (size_t)globals, 16) != 0) {
+        goto cleanup;
+    }
+
+    // functions may be called before they are placed
+    for (uint32_t i = 0; i < count; i++) {
+        char name[NATIVE_MESSAGE_SIZE];
+
+        snprintf (name, sizeof (name), "%s.%s", opts->prefix,
+                  (i == 0) ? CLV_NATIVE_INIT : clv_module_function (module, i)->name);
+
+        if ((n.fn_symbols[i] = clv_elf_symbol (n.elf, name, CLV_ELF_UNDEF, 0, 0, true)) == UINT32_MAX) {
+            goto cleanup;
+        }
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (!native_function (&n, i)) {
+            clv_error ("%s: unable to compile %s: %s", clv_module_get_file (module),
+                       clv_module_function (module, i)->name, strerror (errno));
+            errno = EINVAL;
+            goto cleanup;
+        }
+    }
+
+    good = (!opts->debug || (native_debug_line (&n) && native_debug_info (&n)))
+        && clv_elf_write (n.elf, out_data, out_length);
+
+cleanup:
+    for (uint32_t i = 0; i < n.import_capacity; i++) {
+        clv_free (n.imports[i].name);
+    }
+
+    clv_free (n.imports);
+    clv_free (n.rows);
+    clv_free (n.jumps);
+    clv_free (n.traps);
+    clv_free (n.code.data);
+    clv_free (n.fn_symbols);
+    clv_free (n.fn_offsets);
+    clv_free (n.fn_sizes);
+    clv_elf_free (n.elf);
+
+    return good;
+}
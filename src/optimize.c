@@ -0,0 +1,1325 @@
+#include <clover/optimize.h>
+#include <clover/ir.h>
+#include <clover/log.h>
+#include <clover/cpu.h>
+#include <clover/alloc.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+
+/* Largest function inlined, in instructions */
+#define OPT_INLINE_MAX      16
+
+/* Register operands named in the instruction itself */
+#define FIELD_A             (1 << 0)
+#define FIELD_B             (1 << 1)
+#define FIELD_C             (1 << 2)
+
+#define NO_REG              (-1)
+
+
+typedef struct {
+    clv_module_t *module;
+    clv_opt_report_t *report;
+} opt_ctx_t;
+
+typedef bool (*opt_pass_fn) (opt_ctx_t *ctx, clv_ir_fn_t *ir);
+
+
+/* == Operands == */
+
+
+static inline bool
+opt_binary (clv_opcode_t op) {
+    return op >= CLV_OP_ADD && op <= CLV_OP_LE && op != CLV_OP_ADDI;
+}
+
+
+/* Registers read through the fields of `insn`. Calls and for loops read
+ * ranges of registers besides. */
+static unsigned
+opt_read_fields (const clv_ir_insn_t *insn) {
+    switch (insn->op) {
+    case CLV_OP_MOVE:
+    case CLV_OP_ADDI:
+    case CLV_OP_NEG:
+    case CLV_OP_NOT:
+    case CLV_OP_BNOT:
+    case CLV_OP_CAST:
+    case CLV_OP_TYPEOF:
+    case CLV_OP_UNWRAP:
+        return FIELD_B;
+
+    case CLV_OP_SETGLOBAL:
+    case CLV_OP_JMPF:
+    case CLV_OP_JMPT:
+        return FIELD_A;
+
+    case CLV_OP_RET:
+        return (insn->b != 0) ? FIELD_A : 0;
+
+    default:
+        return opt_binary (insn->op) ? FIELD_B | FIELD_C : 0;
+    }
+}
+
+
+static unsigned
+opt_write_fields (const clv_ir_insn_t *insn) {
+    switch (insn->op) {
+    case CLV_OP_SETGLOBAL:
+    case CLV_OP_JMP:
+    case CLV_OP_JMPF:
+    case CLV_OP_JMPT:
+    case CLV_OP_FORPREP:
+    case CLV_OP_FORLOOP:
+    case CLV_OP_CALL:
+    case CLV_OP_RET:
+        return 0;
+
+    default:
+        return FIELD_A;
+    }
+}
+
+
+static inline bool
+opt_implicit_reads (const clv_ir_insn_t *insn) {
+    return insn->op == CLV_OP_FORPREP || insn->op == CLV_OP_FORLOOP || insn->op == CLV_OP_CALL;
+}
+
+
+/* Replaces reads of register `from` through the fields of `insn` */
+static void
+opt_rename_reads (clv_ir_insn_t *insn, uint32_t from, uint32_t to) {
+    unsigned fields = opt_read_fields (insn);
+
+    if ((fields & FIELD_A) && insn->a == from) {
+        insn->a = to;
+    }
+
+    if ((fields & FIELD_B) && insn->b == from) {
+        insn->b = to;
+    }
+
+    if ((fields & FIELD_C) && (uint32_t)insn->c == from) {
+        insn->c = to;
+    }
+}
+
+
+static inline void
+regs_union (clv_ir_regs_t *self, const clv_ir_regs_t *other) {
+    for (int i = 0; i < 4; i++) {
+        self->bits[i] |= other->bits[i];
+    }
+}
+
+
+static inline void
+regs_minus (clv_ir_regs_t *self, const clv_ir_regs_t *other) {
+    for (int i = 0; i < 4; i++) {
+        self->bits[i] &= ~other->bits[i];
+    }
+}
+
+
+static inline bool
+regs_intersect (const clv_ir_regs_t *a, const clv_ir_regs_t *b) {
+    return ((a->bits[0] & b->bits[0]) | (a->bits[1] & b->bits[1])
+          | (a->bits[2] & b->bits[2]) | (a->bits[3] & b->bits[3])) != 0;
+}
+
+
+/* == Dataflow == */
+
+
+/* Marks the blocks control never reaches as dead, and returns how many
+ * instructions went with them */
+static size_t
+opt_unreachable (clv_ir_fn_t *ir) {
+    uint32_t *stack = clv_alloc (CLV_TAG_OPTIMIZE, ir->block_count * sizeof (*stack));
+    bool *seen = clv_calloc (CLV_TAG_OPTIMIZE, ir->block_count, sizeof (*seen));
+    size_t removed = 0;
+
+    if (stack == NULL || seen == NULL) {
+        clv_free (stack);
+        clv_free (seen);
+        return 0;
+    }
+
+    uint32_t top = 0;
+
+    stack[top++] = 0;
+    seen[0] = true;
+
+    while (top > 0) {
+        uint32_t succ[2];
+        uint32_t count = clv_ir_successors (ir, stack[--top], succ);
+
+        for (uint32_t i = 0; i < count; i++) {
+            if (!seen[succ[i]]) {
+                seen[succ[i]] = true;
+                stack[top++] = succ[i];
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < ir->block_count; i++) {
+        if (!seen[i] && !ir->blocks[i].dead) {
+            ir->blocks[i].dead = true;
+            removed += ir->blocks[i].count;
+        }
+    }
+
+    clv_free (stack);
+    clv_free (seen);
+
+    return removed;
+}
+
+
+/* Registers live on entry to and exit from each block */
+static bool
+opt_liveness (clv_ir_fn_t *ir, clv_ir_regs_t **out_live_in, clv_ir_regs_t **out_live_out) {
+    clv_ir_regs_t *live_in = clv_calloc (CLV_TAG_OPTIMIZE, ir->block_count, sizeof (*live_in));
+    clv_ir_regs_t *live_out = clv_calloc (CLV_TAG_OPTIMIZE, ir->block_count, sizeof (*live_out));
+
+    if (live_in == NULL || live_out == NULL) {
+        clv_free (live_in);
+        clv_free (live_out);
+        return false;
+    }
+
+    for (bool changed = true; changed; ) {
+        changed = false;
+
+        // backwards, as liveness flows against control
+        for (uint32_t b = ir->block_count; b-- > 0; ) {
+            clv_ir_block_t *block = &ir->blocks[b];
+
+            if (block->dead) {
+                continue;
+            }
+
+            uint32_t succ[2];
+            uint32_t count = clv_ir_successors (ir, b, succ);
+            clv_ir_regs_t live = { 0 };
+
+            for (uint32_t i = 0; i < count; i++) {
+                regs_union (&live, &live_in[succ[i]]);
+            }
+
+            live_out[b] = live;
+
+            for (uint32_t i = block->count; i-- > 0; ) {
+                clv_ir_regs_t regs;
+
+                clv_ir_writes (&block->insns[i], &regs);
+                regs_minus (&live, &regs);
+                clv_ir_reads (&block->insns[i], &regs);
+                regs_union (&live, &regs);
+            }
+
+            if (memcmp (&live, &live_in[b], sizeof (live)) != 0) {
+                live_in[b] = live;
+                changed = true;
+            }
+        }
+    }
+
+    *out_live_in = live_in;
+    *out_live_out = live_out;
+
+    return true;
+}
+
+
+/* == Inlining == */
+
+
+/* Replaces the call at `index` with the body of function `callee`, which
+ * keeps its lines but no longer shows in backtraces. Returns how many instructions took its place, 0 when the callee can't
+ * be inlined, or -1 when out of memory. */
+static int
+opt_inline_call (opt_ctx_t *ctx, clv_ir_fn_t *ir, uint32_t block, uint32_t index, uint32_t callee) {
+    clv_ir_insn_t call = ir->blocks[block].insns[index];
+    const clv_function_t *fn = clv_module_function (ctx->module, callee);
+    uint32_t delta = call.a + 1u;
+
+    // lines only tell where they are within one file
+    if (fn->arity != call.b || fn->code_length > OPT_INLINE_MAX || delta + fn->registers > CLV_INSN_MAX_REG
+        || fn->file != ir->source->file) {
+        return 0;
+    }
+
+    clv_ir_fn_t body;
+
+    if (!clv_ir_build (fn, &body)) {
+        return -1;
+    }
+
+    // straight line code only, whose one return comes last
+    clv_ir_block_t *src = &body.blocks[0];
+    bool good = (body.block_count == 1 && src->insns[src->count - 1].op == CLV_OP_RET);
+
+    for (uint32_t i = 0; good && i + 1 < src->count; i++) {
+        clv_opcode_t op = src->insns[i].op;
+
+        good = (op < CLV_OP_JMP || op > CLV_OP_RET);
+    }
+
+    if (!good) {
+        clv_ir_free (&body);
+        return 0;
+    }
+
+    clv_ir_insn_t insns[CLV_INSN_MAX_REG + OPT_INLINE_MAX];
+    clv_ir_regs_t written = { 0 };
+    uint32_t count = 0;
+
+    for (uint32_t r = 0; r < fn->arity; r++) {
+        CLV_IR_REGS_ADD (&written, r);
+    }
+
+    // the frame of a call starts out nil past the arguments
+    for (uint32_t i = 0; i < src->count; i++) {
+        clv_ir_regs_t regs;
+
+        clv_ir_reads (&src->insns[i], &regs);
+
+        for (uint32_t r = 0; r < fn->registers; r++) {
+            if (CLV_IR_REGS_HAS (&regs, r) && !CLV_IR_REGS_HAS (&written, r)) {
+                insns[count++] = (clv_ir_insn_t){ .op = CLV_OP_LOADNIL, .a = r + delta, .line = call.line };
+                CLV_IR_REGS_ADD (&written, r);
+            }
+        }
+
+        clv_ir_writes (&src->insns[i], &regs);
+        regs_union (&written, &regs);
+    }
+
+    for (uint32_t i = 0; i + 1 < src->count; i++) {
+        clv_ir_insn_t insn = src->insns[i];
+        unsigned fields = opt_read_fields (&insn) | opt_write_fields (&insn);
+
+        insn.a += (fields & FIELD_A) ? delta : 0;
+        insn.b += (fields & FIELD_B) ? delta : 0;
+        insn.c += (fields & FIELD_C) ? (int32_t)delta : 0;
+
+        if (insn.op == CLV_OP_LOADK) {
+            uint32_t k = clv_ir_constant (ir, &body.constants[insn.b]);
+
+            if (k > CLV_INSN_MAX_BX) {
+                clv_ir_free (&body);
+                return 0;
+            }
+
+            insn.b = k;
+        }
+
+        insns[count++] = insn;
+    }
+
+    clv_ir_insn_t *ret = &src->insns[src->count - 1];
+
+    if (ret->b != 0) {
+        insns[count++] = (clv_ir_insn_t){ .op = CLV_OP_MOVE, .a = call.a, .b = ret->a + delta, .line = call.line };
+    } else {
+        insns[count++] = (clv_ir_insn_t){ .op = CLV_OP_LOADNIL, .a = call.a, .line = call.line };
+    }
+
+    clv_ir_free (&body);
+    clv_ir_remove (ir, block, index);
+
+    if (!clv_ir_insert (ir, block, index, insns, count)) {
+        return -1;
+    }
+
+    if (ir->registers < delta + fn->registers) {
+        ir->registers = delta + fn->registers;
+    }
+
+    ctx->report->inlined++;
+
+    return count;
+}
+
+
+/* Inlines calls to small functions known within a block */
+static bool
+opt_inline (opt_ctx_t *ctx, clv_ir_fn_t *ir) {
+    int64_t callee[CLV_INSN_MAX_REG + 1];
+
+    for (uint32_t b = 0; b < ir->block_count; b++) {
+        clv_ir_block_t *block = &ir->blocks[b];
+
+        for (uint32_t r = 0; r <= CLV_INSN_MAX_REG; r++) {
+            callee[r] = NO_REG;
+        }
+
+        for (uint32_t i = 0; i < block->count; i++) {
+            clv_ir_insn_t *insn = &block->insns[i];
+            clv_ir_regs_t writes;
+
+            if (insn->op == CLV_OP_CALL && callee[insn->a] != NO_REG) {
+                uint32_t base = insn->a;
+                int count = opt_inline_call (ctx, ir, b, i, callee[base]);
+
+                if (count < 0) {
+                    return false;
+                }
+
+                if (count > 0) {
+                    for (uint32_t r = base; r <= CLV_INSN_MAX_REG; r++) {
+                        callee[r] = NO_REG;
+                    }
+
+                    i += count - 1;
+                    continue;
+                }
+            }
+
+            clv_ir_writes (insn, &writes);
+
+            for (uint32_t r = 0; r <= CLV_INSN_MAX_REG; r++) {
+                if (CLV_IR_REGS_HAS (&writes, r)) {
+                    callee[r] = NO_REG;
+                }
+            }
+
+            if (insn->op == CLV_OP_LOADK && ir->constants[insn->b].type == CLV_TYPE_FN && ir->constants[insn->b].module == 0) {
+                callee[insn->a] = ir->constants[insn->b].as.index;
+            }
+        }
+    }
+
+    return true;
+}
+
+
+/* == Copy propagation == */
+
+
+/* Reads registers copies were taken from rather than the copies, within
+ * each block, so the moves may die */
+static bool
+opt_copyprop (opt_ctx_t *ctx, clv_ir_fn_t *ir) {
+    int16_t copy_of[CLV_INSN_MAX_REG + 1];
+
+    for (uint32_t b = 0; b < ir->block_count; b++) {
+        clv_ir_block_t *block = &ir->blocks[b];
+
+        for (uint32_t r = 0; r <= CLV_INSN_MAX_REG; r++) {
+            copy_of[r] = NO_REG;
+        }
+
+        for (uint32_t i = 0; i < block->count; i++) {
+            clv_ir_insn_t *insn = &block->insns[i];
+            unsigned fields = opt_read_fields (insn);
+            clv_ir_regs_t writes;
+
+            if ((fields & FIELD_A) && copy_of[insn->a] != NO_REG) {
+                insn->a = copy_of[insn->a];
+            }
+
+            if ((fields & FIELD_B) && copy_of[insn->b] != NO_REG) {
+                insn->b = copy_of[insn->b];
+            }
+
+            if ((fields & FIELD_C) && copy_of[insn->c] != NO_REG) {
+                insn->c = copy_of[insn->c];
+            }
+
+            if (insn->op == CLV_OP_MOVE && insn->a == insn->b) {
+                clv_ir_remove (ir, b, i--);
+                ctx->report->removed++;
+                continue;
+            }
+
+            clv_ir_writes (insn, &writes);
+
+            for (uint32_t r = 0; r <= CLV_INSN_MAX_REG; r++) {
+                if (CLV_IR_REGS_HAS (&writes, r)
+                    || (copy_of[r] != NO_REG && CLV_IR_REGS_HAS (&writes, (uint32_t)copy_of[r]))) {
+                    copy_of[r] = NO_REG;
+                }
+            }
+
+            if (insn->op == CLV_OP_MOVE) {
+                copy_of[insn->a] = insn->b;
+            }
+        }
+    }
+
+    return true;
+}
+
+
+/* == Constant folding == */
+
+
+typedef struct {
+    bool known;
+    clv_const_t k;          /* bools as 0 or 1 in `i` */
+} opt_value_t;
+
+
+static inline bool
+opt_falsy (const clv_const_t *k) {
+    return k->type == CLV_TYPE_NIL || (k->type == CLV_TYPE_BOOL && k->as.i == 0);
+}
+
+
+static inline bool
+opt_number (const clv_const_t *k, double *out_number) {
+    if (k->type == CLV_TYPE_INT) {
+        *out_number = (double)k->as.i;
+    } else if (k->type == CLV_TYPE_FLOAT) {
+        *out_number = k->as.f;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+
+/* As value_equal in the VM */
+static bool
+opt_equal (const clv_const_t *a, const clv_const_t *b) {
+    double x, y;
+
+    if (a->type != b->type) {
+        return opt_number (a, &x) && opt_number (b, &y) && x == y;
+    }
+
+    switch (a->type) {
+    case CLV_TYPE_NIL:
+        return true;
+
+    case CLV_TYPE_BOOL:
+    case CLV_TYPE_INT:
+        return a->as.i == b->as.i;
+
+    case CLV_TYPE_FLOAT:
+        return a->as.f == b->as.f;
+
+    case CLV_TYPE_CHAR:
+        return a->as.c == b->as.c;
+
+    case CLV_TYPE_STRING:
+        return a->as.s.length == b->as.s.length && memcmp (a->as.s.data, b->as.s.data, a->as.s.length) == 0;
+
+    default:
+        return a->as.index == b->as.index;
+    }
+}
+
+
+#define K_BOOL(x)       ((clv_const_t){ .type = CLV_TYPE_BOOL, .as.i = (x) })
+#define K_INT(x)        ((clv_const_t){ .type = CLV_TYPE_INT, .as.i = (x) })
+#define K_FLOAT(x)      ((clv_const_t){ .type = CLV_TYPE_FLOAT, .as.f = (x) })
+
+#define INT_WRAP(a,op,b)    ((int64_t)((uint64_t)(a) op (uint64_t)(b)))
+
+
+/* Computes `b op c` exactly as the VM does, unless it would fail there */
+static bool
+opt_eval (clv_opcode_t op, const clv_const_t *b, const clv_const_t *c, clv_const_t *out) {
+    double x, y;
+
+    if (op == CLV_OP_EQ || op == CLV_OP_NE) {
+        *out = K_BOOL (opt_equal (b, c) == (op == CLV_OP_EQ));
+        return true;
+    }
+
+    if (b->type == CLV_TYPE_INT && c->type == CLV_TYPE_INT) {
+        int64_t i = b->as.i;
+        int64_t j = c->as.i;
+
+        switch (op) {
+        case CLV_OP_ADD:  *out = K_INT (INT_WRAP (i, +, j)); return true;
+        case CLV_OP_SUB:  *out = K_INT (INT_WRAP (i, -, j)); return true;
+        case CLV_OP_MUL:  *out = K_INT (INT_WRAP (i, *, j)); return true;
+        case CLV_OP_BAND: *out = K_INT (i & j); return true;
+        case CLV_OP_BOR:  *out = K_INT (i | j); return true;
+        case CLV_OP_BXOR: *out = K_INT (i ^ j); return true;
+        case CLV_OP_SHL:  *out = K_INT (INT_WRAP (i, <<, j & 63)); return true;
+        case CLV_OP_SHR:  *out = K_INT (i >> (j & 63)); return true;
+        case CLV_OP_LT:   *out = K_BOOL (i < j); return true;
+        case CLV_OP_LE:   *out = K_BOOL (i <= j); return true;
+
+        case CLV_OP_DIV:
+        case CLV_OP_MOD:
+            // division by zero stays, to fail at runtime
+            if (j == 0) {
+                return false;
+            }
+
+            if (j == -1) {
+                *out = K_INT ((op == CLV_OP_DIV) ? INT_WRAP (0, -, i) : 0);
+            } else {
+                *out = K_INT ((op == CLV_OP_DIV) ? i / j : i % j);
+            }
+
+            return true;
+
+        default:
+            return false;
+        }
+    }
+
+    if (opt_number (b, &x) && opt_number (c, &y)) {
+        switch (op) {
+        case CLV_OP_ADD: *out = K_FLOAT (x + y); return true;
+        case CLV_OP_SUB: *out = K_FLOAT (x - y); return true;
+        case CLV_OP_MUL: *out = K_FLOAT (x * y); return true;
+        case CLV_OP_DIV: *out = K_FLOAT (x / y); return true;
+        case CLV_OP_MOD: *out = K_FLOAT (fmod (x, y)); return true;
+        case CLV_OP_LT:  *out = K_BOOL (x < y); return true;
+        case CLV_OP_LE:  *out = K_BOOL (x <= y); return true;
+
+        default:
+            return false;
+        }
+    }
+
+    if (b->type == CLV_TYPE_CHAR && c->type == CLV_TYPE_CHAR && (op == CLV_OP_LT || op == CLV_OP_LE)) {
+        *out = K_BOOL ((op == CLV_OP_LT) ? b->as.c < c->as.c : b->as.c <= c->as.c);
+        return true;
+    }
+
+    return false;
+}
+
+
+static bool
+opt_eval_unary (const clv_ir_insn_t *insn, const clv_const_t *b, clv_const_t *out) {
+    switch (insn->op) {
+    case CLV_OP_MOVE:
+        *out = *b;
+        return true;
+
+    case CLV_OP_NOT:
+        *out = K_BOOL (opt_falsy (b));
+        return true;
+
+    case CLV_OP_NEG:
+        if (b->type == CLV_TYPE_INT) {
+            *out = K_INT (INT_WRAP (0, -, b->as.i));
+        } else if (b->type == CLV_TYPE_FLOAT) {
+            *out = K_FLOAT (-b->as.f);
+        } else {
+            return false;
+        }
+
+        return true;
+
+    case CLV_OP_BNOT:
+        *out = K_INT (~b->as.i);
+        return b->type == CLV_TYPE_INT;
+
+    case CLV_OP_ADDI:
+        if (b->type == CLV_TYPE_INT) {
+            *out = K_INT (INT_WRAP (b->as.i, +, insn->c));
+        } else if (b->type == CLV_TYPE_FLOAT) {
+            *out = K_FLOAT (b->as.f + insn->c);
+        } else {
+            return false;
+        }
+
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+
+/* Turns `insn` into a load of `k`, if it fits */
+static bool
+opt_load (clv_ir_fn_t *ir, clv_ir_insn_t *insn, const clv_const_t *k) {
+    clv_ir_insn_t load = { .a = insn->a, .line = insn->line };
+
+    if (k->type == CLV_TYPE_NIL) {
+        load.op = CLV_OP_LOADNIL;
+    } else if (k->type == CLV_TYPE_BOOL) {
+        load.op = CLV_OP_LOADBOOL;
+        load.b = (k->as.i != 0);
+    } else if (k->type == CLV_TYPE_INT && k->as.i >= CLV_INSN_MIN_SBX && k->as.i <= CLV_INSN_MAX_SBX) {
+        load.op = CLV_OP_LOADI;
+        load.c = (int32_t)k->as.i;
+    } else {
+        uint32_t index = clv_ir_constant (ir, k);
+
+        if (index > CLV_INSN_MAX_BX) {
+            return false;
+        }
+
+        load.op = CLV_OP_LOADK;
+        load.b = index;
+    }
+
+    *insn = load;
+
+    return true;
+}
+
+
+/* Computes operations on constants known within each block, and resolves
+ * branches on them */
+static bool
+opt_fold (opt_ctx_t *ctx, clv_ir_fn_t *ir) {
+    opt_value_t values[CLV_INSN_MAX_REG + 1];
+
+    for (uint32_t b = 0; b < ir->block_count; b++) {
+        clv_ir_block_t *block = &ir->blocks[b];
+
+        memset (values, 0, sizeof (values));
+
+        for (uint32_t i = 0; i < block->count; i++) {
+            clv_ir_insn_t *insn = &block->insns[i];
+            clv_ir_regs_t writes;
+            clv_const_t result;
+            bool folded = false;
+
+            if (opt_binary (insn->op) && values[insn->b].known && values[insn->c].known) {
+                folded = opt_eval (insn->op, &values[insn->b].k, &values[insn->c].k, &result);
+            } else if (opt_read_fields (insn) == FIELD_B && values[insn->b].known) {
+                // copies of constants become loads, leaving the original dead
+                folded = opt_eval_unary (insn, &values[insn->b].k, &result);
+            } else if ((insn->op == CLV_OP_JMPF || insn->op == CLV_OP_JMPT) && values[insn->a].known) {
+                if (opt_falsy (&values[insn->a].k) == (insn->op == CLV_OP_JMPF)) {
+                    *insn = (clv_ir_insn_t){ .op = CLV_OP_JMP, .c = insn->c, .line = insn->line };
+                } else {
+                    clv_ir_remove (ir, b, i--);
+                }
+
+                ctx->report->folded++;
+                continue;
+            }
+
+            if (folded && opt_load (ir, insn, &result)) {
+                ctx->report->folded++;
+            }
+
+            clv_ir_writes (insn, &writes);
+
+            for (uint32_t r = 0; r <= CLV_INSN_MAX_REG; r++) {
+                if (CLV_IR_REGS_HAS (&writes, r)) {
+                    values[r].known = false;
+                }
+            }
+
+            switch (insn->op) {
+            case CLV_OP_LOADK:
+                values[insn->a] = (opt_value_t){ true, ir->constants[insn->b] };
+                break;
+
+            case CLV_OP_LOADI:
+                values[insn->a] = (opt_value_t){ true, K_INT (insn->c) };
+                break;
+
+            case CLV_OP_LOADNIL:
+                values[insn->a] = (opt_value_t){ true, { .type = CLV_TYPE_NIL } };
+                break;
+
+            case CLV_OP_LOADBOOL:
+                values[insn->a] = (opt_value_t){ true, K_BOOL (insn->b != 0) };
+                break;
+
+            default:
+                break;
+            }
+        }
+    }
+
+    return true;
+}
+
+
+/* == Dead code elimination == */
+
+
+/* Removes unreachable blocks, and pure instructions whose results are
+ * never read */
+static bool
+opt_dce (opt_ctx_t *ctx, clv_ir_fn_t *ir) {
+    ctx->report->removed += opt_unreachable (ir);
+
+    for (bool changed = true; changed; ) {
+        clv_ir_regs_t *live_in;
+        clv_ir_regs_t *live_out;
+
+        if (!opt_liveness (ir, &live_in, &live_out)) {
+            return false;
+        }
+
+        changed = false;
+
+        for (uint32_t b = 0; b < ir->block_count; b++) {
+            clv_ir_block_t *block = &ir->blocks[b];
+            clv_ir_regs_t live = live_out[b];
+
+            if (block->dead) {
+                continue;
+            }
+
+            for (uint32_t i = block->count; i-- > 0; ) {
+                clv_ir_insn_t *insn = &block->insns[i];
+                clv_ir_regs_t regs;
+
+                clv_ir_writes (insn, &regs);
+
+                if (clv_ir_pure (insn) && !regs_intersect (&regs, &live)) {
+                    clv_ir_remove (ir, b, i);
+                    ctx->report->removed++;
+                    changed = true;
+                    continue;
+                }
+
+                regs_minus (&live, &regs);
+                clv_ir_reads (insn, &regs);
+                regs_union (&live, &regs);
+            }
+        }
+
+        clv_free (live_in);
+        clv_free (live_out);
+    }
+
+    return true;
+}
+
+
+/* == Loop invariant code motion == */
+
+
+typedef struct {
+    uint32_t *preds;        /* of all blocks, from `pred_start` */
+    uint32_t *pred_start;
+    uint32_t *idom;         /* CLV_IR_NO_BLOCK if unreachable */
+    uint32_t *order;        /* reverse postorder number */
+
+    clv_ir_regs_t *live_in;
+    clv_ir_regs_t *live_out;
+
+    bool *in_loop;
+} opt_cfg_t;
+
+
+static void
+opt_cfg_free (opt_cfg_t *cfg) {
+    clv_free (cfg->preds);
+    clv_free (cfg->pred_start);
+    clv_free (cfg->idom);
+    clv_free (cfg->order);
+    clv_free (cfg->live_in);
+    clv_free (cfg->live_out);
+    clv_free (cfg->in_loop);
+}
+
+
+static uint32_t
+opt_intersect (opt_cfg_t *cfg, uint32_t a, uint32_t b) {
+    while (a != b) {
+        while (cfg->order[a] > cfg->order[b]) {
+            a = cfg->idom[a];
+        }
+
+        while (cfg->order[b] > cfg->order[a]) {
+            b = cfg->idom[b];
+        }
+    }
+
+    return a;
+}
+
+
+/* Predecessors, dominators (as in Cooper, Harvey and Kennedy) and
+ * liveness of the blocks */
+static bool
+opt_cfg (clv_ir_fn_t *ir, opt_cfg_t *cfg) {
+    uint32_t n = ir->block_count;
+    uint32_t *rpo = clv_alloc (CLV_TAG_OPTIMIZE, n * sizeof (*rpo));
+    uint32_t *stack = clv_alloc (CLV_TAG_OPTIMIZE, 2 * n * sizeof (*stack));
+
+    *cfg = (opt_cfg_t){
+        .pred_start = clv_calloc (CLV_TAG_OPTIMIZE, n + 1, sizeof (uint32_t)),
+        .preds = clv_alloc (CLV_TAG_OPTIMIZE, 2 * n * sizeof (uint32_t) + 1),
+        .idom = clv_alloc (CLV_TAG_OPTIMIZE, n * sizeof (uint32_t)),
+        .order = clv_alloc (CLV_TAG_OPTIMIZE, n * sizeof (uint32_t)),
+        .in_loop = clv_calloc (CLV_TAG_OPTIMIZE, n, sizeof (bool)),
+    };
+
+    if (rpo == NULL || stack == NULL || cfg->pred_start == NULL || cfg->preds == NULL || cfg->idom == NULL
+        || cfg->order == NULL || cfg->in_loop == NULL || !opt_liveness (ir, &cfg->live_in, &cfg->live_out)) {
+        clv_free (rpo);
+        clv_free (stack);
+        opt_cfg_free (cfg);
+        return false;
+    }
+
+    for (uint32_t b = 0; b < n; b++) {
+        uint32_t succ[2];
+        uint32_t count = ir->blocks[b].dead ? 0 : clv_ir_successors (ir, b, succ);
+
+        for (uint32_t i = 0; i < count; i++) {
+            cfg->pred_start[succ[i] + 1]++;
+        }
+
+        cfg->idom[b] = CLV_IR_NO_BLOCK;
+        cfg->order[b] = UINT32_MAX;
+    }
+
+    for (uint32_t b = 0; b < n; b++) {
+        cfg->pred_start[b + 1] += cfg->pred_start[b];
+    }
+
+    // the stack is free yet, and keeps where predecessors go meanwhile
+    for (uint32_t b = 0; b < n; b++) {
+        stack[b] = cfg->pred_start[b];
+    }
+
+    for (uint32_t b = 0; b < n; b++) {
+        uint32_t succ[2];
+        uint32_t count = ir->blocks[b].dead ? 0 : clv_ir_successors (ir, b, succ);
+
+        for (uint32_t i = 0; i < count; i++) {
+            cfg->preds[stack[succ[i]]++] = b;
+        }
+    }
+
+    // postorder, by a depth first walk keeping the next successor to visit
+    uint32_t top = 0;
+    uint32_t visited = 0;
+
+    memset (stack, 0, 2 * n * sizeof (*stack));
+    cfg->order[0] = 0;
+    stack[top++] = 0;
+
+    while (top > 0) {
+        uint32_t b = stack[2 * (top - 1)];
+        uint32_t *next = &stack[2 * (top - 1) + 1];
+        uint32_t succ[2];
+        uint32_t count = clv_ir_successors (ir, b, succ);
+
+        if (*next < count) {
+            uint32_t s = succ[(*next)++];
+
+            if (cfg->order[s] == UINT32_MAX) {
+                cfg->order[s] = 0;
+                stack[2 * top] = s;
+                stack[2 * top + 1] = 0;
+                top++;
+            }
+        } else {
+            rpo[visited++] = b;
+            top--;
+        }
+    }
+
+    for (uint32_t i = 0; i < visited; i++) {
+        cfg->order[rpo[i]] = visited - 1 - i;
+    }
+
+    cfg->idom[0] = 0;
+
+    for (bool changed = true; changed; ) {
+        changed = false;
+
+        for (uint32_t i = visited - 1; i-- > 0; ) {
+            uint32_t b = rpo[i];
+            uint32_t idom = CLV_IR_NO_BLOCK;
+
+            for (uint32_t p = cfg->pred_start[b]; p < cfg->pred_start[b + 1]; p++) {
+                uint32_t pred = cfg->preds[p];
+
+                if (cfg->idom[pred] == CLV_IR_NO_BLOCK) {
+                    continue;
+                }
+
+                idom = (idom == CLV_IR_NO_BLOCK) ? pred : opt_intersect (cfg, pred, idom);
+            }
+
+            if (idom != cfg->idom[b]) {
+                cfg->idom[b] = idom;
+                changed = true;
+            }
+        }
+    }
+
+    clv_free (rpo);
+    clv_free (stack);
+
+    return true;
+}
+
+
+static bool
+opt_dominates (opt_cfg_t *cfg, uint32_t a, uint32_t b) {
+    while (b != a && b != 0 && cfg->idom[b] != CLV_IR_NO_BLOCK) {
+        b = cfg->idom[b];
+    }
+
+    return b == a;
+}
+
+
+/* Renames the register `insn` writes to a fresh one, along with its reads
+ * up to the next write in the block, if nothing else reads the value */
+static bool
+opt_rename_def (clv_ir_fn_t *ir, opt_cfg_t *cfg, uint32_t b, uint32_t index) {
+    clv_ir_block_t *block = &ir->blocks[b];
+    uint32_t reg = block->insns[index].a;
+    uint32_t end = block->count;
+
+    if (ir->registers >= CLV_INSN_MAX_REG) {
+        return false;
+    }
+
+    for (uint32_t i = index + 1; i < block->count; i++) {
+        clv_ir_regs_t regs;
+
+        clv_ir_reads (&block->insns[i], &regs);
+
+        if (CLV_IR_REGS_HAS (&regs, reg) && opt_implicit_reads (&block->insns[i])) {
+            return false;
+        }
+
+        clv_ir_writes (&block->insns[i], &regs);
+
+        if (CLV_IR_REGS_HAS (&regs, reg)) {
+            end = i + 1;
+            break;
+        }
+    }
+
+    if (end == block->count && CLV_IR_REGS_HAS (&cfg->live_out[b], reg)) {
+        return false;
+    }
+
+    uint32_t fresh = ir->registers++;
+
+    for (uint32_t i = index + 1; i < end; i++) {
+        opt_rename_reads (&block->insns[i], reg, fresh);
+    }
+
+    block->insns[index].a = fresh;
+
+    return true;
+}
+
+
+/* Hoists one invariant instruction out of the loop headed by `header`, if
+ * any. The loop is `cfg->in_loop`. */
+static bool
+opt_hoist (clv_ir_fn_t *ir, opt_cfg_t *cfg, uint32_t header, bool *out_hoisted) {
+    uint32_t preheader = CLV_IR_NO_BLOCK;
+
+    *out_hoisted = false;
+
+    for (uint32_t p = cfg->pred_start[header]; p < cfg->pred_start[header + 1]; p++) {
+        uint32_t pred = cfg->preds[p];
+
+        if (cfg->in_loop[pred]) {
+            continue;
+        }
+
+        if (preheader != CLV_IR_NO_BLOCK) {
+            return true;
+        }
+
+        preheader = pred;
+    }
+
+    uint32_t succ[2];
+
+    if (preheader == CLV_IR_NO_BLOCK || clv_ir_successors (ir, preheader, succ) != 1) {
+        return true;
+    }
+
+    // what the loop writes, and what is read once it's left
+    uint8_t defs[CLV_INSN_MAX_REG + 1] = { 0 };
+    clv_ir_regs_t written = { 0 };
+    clv_ir_regs_t exit_live = { 0 };
+    bool calls = false;
+    bool stores = false;
+
+    for (uint32_t b = 0; b < ir->block_count; b++) {
+        clv_ir_block_t *block = &ir->blocks[b];
+
+        if (!cfg->in_loop[b]) {
+            continue;
+        }
+
+        for (uint32_t i = 0; i < block->count; i++) {
+            clv_ir_regs_t regs;
+
+            clv_ir_writes (&block->insns[i], &regs);
+            regs_union (&written, &regs);
+
+            for (uint32_t r = 0; r <= CLV_INSN_MAX_REG; r++) {
+                if (CLV_IR_REGS_HAS (&regs, r) && defs[r] < UINT8_MAX) {
+                    defs[r]++;
+                }
+            }
+
+            calls = calls || block->insns[i].op == CLV_OP_CALL;
+            stores = stores || block->insns[i].op == CLV_OP_SETGLOBAL;
+        }
+
+        uint32_t count = clv_ir_successors (ir, b, succ);
+
+        for (uint32_t i = 0; i < count; i++) {
+            if (!cfg->in_loop[succ[i]]) {
+                regs_union (&exit_live, &cfg->live_in[succ[i]]);
+            }
+        }
+    }
+
+    for (uint32_t b = 0; b < ir->block_count; b++) {
+        clv_ir_block_t *block = &ir->blocks[b];
+
+        if (!cfg->in_loop[b]) {
+            continue;
+        }
+
+        for (uint32_t i = 0; i < block->count; i++) {
+            clv_ir_insn_t *insn = &block->insns[i];
+            clv_ir_regs_t regs;
+
+            if (!clv_ir_pure (insn) || (insn->op == CLV_OP_GETGLOBAL && (calls || stores))) {
+                continue;
+            }
+
+            clv_ir_reads (insn, &regs);
+
+            if (regs_intersect (&regs, &written)) {
+                continue;
+            }
+
+            // a register reused within the loop gets a fresh one, unless
+            // calls may clobber it
+            if (defs[insn->a] == 1) {
+                if (CLV_IR_REGS_HAS (&cfg->live_in[header], insn->a) || CLV_IR_REGS_HAS (&exit_live, insn->a)) {
+                    continue;
+                }
+            } else if (calls || !opt_rename_def (ir, cfg, b, i)) {
+                continue;
+            }
+
+            clv_ir_insn_t hoisted = *insn;
+            clv_ir_block_t *pre = &ir->blocks[preheader];
+            uint32_t at = pre->count;
+
+            if (at > 0 && (pre->insns[at - 1].op == CLV_OP_JMP || pre->insns[at - 1].op == CLV_OP_FORPREP)) {
+                at--;
+            }
+
+            clv_ir_remove (ir, b, i);
+            *out_hoisted = true;
+
+            return clv_ir_insert (ir, preheader, at, &hoisted, 1);
+        }
+    }
+
+    return true;
+}
+
+
+/* Moves instructions computing the same value on every iteration of a
+ * loop to its preheader, one at a time until none is left */
+static bool
+opt_licm (opt_ctx_t *ctx, clv_ir_fn_t *ir) {
+    for (bool hoisted = true; hoisted; ) {
+        opt_cfg_t cfg;
+
+        if (!opt_cfg (ir, &cfg)) {
+            return false;
+        }
+
+        hoisted = false;
+
+        for (uint32_t h = 0; h < ir->block_count && !hoisted; h++) {
+            uint32_t *stack = NULL;
+            uint32_t top = 0;
+            bool loop = false;
+
+            if (cfg.idom[h] == CLV_IR_NO_BLOCK) {
+                continue;
+            }
+
+            memset (cfg.in_loop, 0, ir->block_count * sizeof (*cfg.in_loop));
+            cfg.in_loop[h] = true;
+
+            // the natural loop: blocks reaching a back edge to `h` without
+            // going through it
+            for (uint32_t p = cfg.pred_start[h]; p < cfg.pred_start[h + 1]; p++) {
+                uint32_t tail = cfg.preds[p];
+
+                if (!opt_dominates (&cfg, h, tail)) {
+                    continue;
+                }
+
+                loop = true;
+
+                if (cfg.in_loop[tail]) {
+                    continue;
+                }
+
+                if (stack == NULL
+                    && (stack = clv_alloc (CLV_TAG_OPTIMIZE, ir->block_count * sizeof (*stack))) == NULL) {
+                    opt_cfg_free (&cfg);
+                    return false;
+                }
+
+                cfg.in_loop[tail] = true;
+                stack[top++] = tail;
+
+                while (top > 0) {
+                    uint32_t b = stack[--top];
+
+                    for (uint32_t q = cfg.pred_start[b]; q < cfg.pred_start[b + 1]; q++) {
+                        if (!cfg.in_loop[cfg.preds[q]]) {
+                            cfg.in_loop[cfg.preds[q]] = true;
+                            stack[top++] = cfg.preds[q];
+                        }
+                    }
+                }
+            }
+
+            clv_free (stack);
+
+            if (loop && !opt_hoist (ir, &cfg, h, &hoisted)) {
+                opt_cfg_free (&cfg);
+                return false;
+            }
+        }
+
+        ctx->report->hoisted += hoisted;
+        opt_cfg_free (&cfg);
+    }
+
+    return true;
+}
+
+
+/* == Pass manager == */
+
+
+static const struct {
+    clv_str name;
+    opt_pass_fn run;
+} opt_pipeline[] = {
+    { "inline",     opt_inline },
+    { "copyprop",   opt_copyprop },
+    { "fold",       opt_fold },
+    { "dce",        opt_dce },
+    { "licm",       opt_licm },
+    { "dce",        opt_dce },
+};
+
+
+static double
+opt_now () {
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+bool
+clv_optimize (clv_module_t *module, clv_opt_report_t *out_report) {
+    opt_ctx_t ctx = { .module = module, .report = out_report };
+
+    *out_report = (clv_opt_report_t){ .pass_count = CLV_LENGTH (opt_pipeline) };
+
+    for (uint32_t p = 0; p < CLV_LENGTH (opt_pipeline); p++) {
+        out_report->passes[p].name = opt_pipeline[p].name;
+    }
+
+    for (uint32_t i = 0; i < clv_module_function_count (module); i++) {
+        clv_function_t *fn = clv_module_function (module, i);
+        clv_function_t optimized;
+        clv_ir_fn_t ir;
+
+        if (!clv_ir_build (fn, &ir)) {
+            return false;
+        }
+
+        for (uint32_t p = 0; p < CLV_LENGTH (opt_pipeline); p++) {
+            clv_opt_pass_t *pass = &out_report->passes[p];
+
+            pass->before += clv_ir_length (&ir);
+
+            double t0 = opt_now ();
+            bool good = opt_pipeline[p].run (&ctx, &ir);
+
+            pass->seconds += opt_now () - t0;
+            pass->after += clv_ir_length (&ir);
+
+            if (!good) {
+                clv_ir_free (&ir);
+                return false;
+            }
+        }
+
+        if (clv_ir_emit (&ir, clv_module_arena (module), &optimized)) {
+            *fn = optimized;
+        } else if (errno == ERANGE) {
+            out_report->skipped++;
+        } else {
+            clv_ir_free (&ir);
+            return false;
+        }
+
+        clv_ir_free (&ir);
+    }
+
+    return true;
+}
+
+
+void
+clv_opt_report_dump (const clv_opt_report_t *report) {
+    static const struct {
+        unsigned feature;
+        clv_str name;
+    } features[] = {
+        { CLV_CPU_SSE2,  "sse2" },
+        { CLV_CPU_SSE42, "sse4.2" },
+        { CLV_CPU_AVX2,  "avx2" },
+        { CLV_CPU_BMI2,  "bmi2" },
+    };
+
+    clv_log_record_t rec;
+
+    clv_log_begin (&rec, CLV_INFO);
+    clv_log_printf (&rec, "%-10s %10s %8s %8s\n", "pass", "ms", "before", "after");
+
+    for (uint32_t p = 0; p < report->pass_count; p++) {
+        const clv_opt_pass_t *pass = &report->passes[p];
+
+        clv_log_printf (&rec, "%-10s %10.3f %8zu %8zu\n", pass->name, pass->seconds * 1e3, pass->before, pass->after);
+    }
+
+    clv_log_printf (&rec, "inlined %zu, folded %zu, removed %zu, hoisted %zu, skipped %zu\n",
+                    report->inlined, report->folded, report->removed, report->hoisted, report->skipped);
+    clv_log_printf (&rec, "host:");
+
+    for (size_t i = 0; i < CLV_LENGTH (features); i++) {
+        if (clv_cpu_has (features[i].feature)) {
+            clv_log_printf (&rec, " %s", features[i].name);
+        }
+    }
+
+    clv_log_append (&rec, "\n", 1);
+    clv_log_end (&rec);
+}
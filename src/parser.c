@@ -0,0 +1,1413 @@
+#include <clover/parser.h>
+#include <clover/log.h>
+#include <clover/alloc.h>
+
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+
+#define PARSER_MAX_DEPTH        256     /* nesting of statements, types and expressions */
+
+#define PARSER_NODES_PER_TOKEN  2       /* tree size hint, as a divisor */
+
+#define PARSER_EOF              (-1)    /* type past the last token */
+
+#define PARSER_NO_TOKEN         UINT32_MAX
+
+
+/* Binding power of binary operators, 0 for other tokens */
+static const uint8_t parse_precedence[256] = {
+    [CLV_TOKEN_OR]        = 1,
+    [CLV_TOKEN_AND]       = 2,
+    [CLV_TOKEN_EQ]        = 3,
+    [CLV_TOKEN_NE]        = 3,
+    [CLV_TOKEN_LT]        = 4,
+    [CLV_TOKEN_GT]        = 4,
+    [CLV_TOKEN_LE]        = 4,
+    [CLV_TOKEN_GE]        = 4,
+    [CLV_TOKEN_BIT_OR]    = 5,
+    [CLV_TOKEN_BIT_XOR]   = 6,
+    [CLV_TOKEN_BIT_AND]   = 7,
+    [CLV_TOKEN_BIT_SHL]   = 8,
+    [CLV_TOKEN_BIT_SHR]   = 8,
+    [CLV_TOKEN_PLUS]      = 9,
+    [CLV_TOKEN_MINUS]     = 9,
+    [CLV_TOKEN_MULTIPLY]  = 10,
+    [CLV_TOKEN_DIVIDE]    = 10,
+    [CLV_TOKEN_REMAINDER] = 10,
+    [CLV_TOKEN_AS]        = 11,
+};
+
+
+typedef struct {
+    clv_source_t *src;
+    clv_ast_t *ast;
+
+    clv_token_t *tokens;
+    uint32_t count;
+
+    uint32_t pos;       /* current token, never a comment */
+    int type;           /* its type, or PARSER_EOF */
+
+    /* children of the lists being parsed, innermost last */
+    uint32_t *scratch;
+    size_t scratch_length;
+    size_t scratch_capacity;
+
+    int depth;
+    bool no_init;       /* `Name {` opens a block, not an initializer */
+    bool error;
+} parser_state_t;
+
+
+/* == Auxiliary Functions == */
+
+
+static void
+parse_error (parser_state_t *st, clv_str msg, ...) {
+    va_list args;
+
+    clv_log_record_t rec;
+
+    clv_str file = clv_source_get_file (st->src);
+
+    // errors at the end of the file point past the last token
+    clv_token_t *token = NULL;
+    clv_location_t loc = { .line = 1, .column = 1 };
+
+    if (st->pos < st->count) {
+        token = &st->tokens[st->pos];
+        clv_source_locate (st->src, token->offset, &loc);
+    } else if (st->count > 0) {
+        token = &st->tokens[st->count - 1];
+        clv_source_locate (st->src, token->offset, &loc);
+        loc.column += token->length;
+    }
+
+    clv_log_begin (&rec, CLV_ERROR);
+    clv_log_printf (&rec, "%s:%u:%u: ", file, loc.line, loc.column);
+
+    va_start (args, msg);
+    clv_log_vprintf (&rec, msg, args);
+    va_end (args);
+
+    if (st->pos < st->count) {
+        clv_log_printf (&rec, ", found '%.*s'", (int)token->length, clv_source_offset (st->src, token->offset));
+    } else {
+        clv_log_append (&rec, ", found end of file", 19);
+    }
+
+    if (token != NULL) {
+        clv_str line = clv_source_offset (st->src, loc.line_offset);
+
+        clv_log_printf (&rec, "\n %3u | ", loc.line);
+        clv_log_append (&rec, line, strcspn (line, "\r\n"));
+    }
+
+    clv_log_append (&rec, "\n", 1);
+    clv_log_end (&rec);
+
+    st->error = true;
+}
+
+
+/* Whether the token at `index` is the first thing on its line */
+static inline bool
+parse_line_start (parser_state_t *st, size_t index) {
+    uint32_t offset = st->tokens[index].offset;
+    char before = (offset > 0) ? clv_source_cstr (st->src)[offset - 1] : '\n';
+
+    return before == '\n' || before == '\r';
+}
+
+
+static inline void
+parse_advance (parser_state_t *st) {
+    do {
+        st->pos++;
+    } while (st->pos < st->count && st->tokens[st->pos].type == CLV_TOKEN_COMMENT);
+
+    st->type = (st->pos < st->count) ? (int)st->tokens[st->pos].type : PARSER_EOF;
+}
+
+
+static inline bool
+parse_accept (parser_state_t *st, int type) {
+    if (st->type != type) {
+        return false;
+    }
+
+    parse_advance (st);
+
+    return true;
+}
+
+
+/* Consumes a token of `type`, and returns its index */
+static uint32_t
+parse_expect (parser_state_t *st, int type, clv_str what) {
+    if (st->type != type) {
+        parse_error (st, "expected %s", what);
+        return PARSER_NO_TOKEN;
+    }
+
+    uint32_t token = st->pos;
+    parse_advance (st);
+
+    return token;
+}
+
+
+static clv_node_id_t
+parse_node (parser_state_t *st, clv_node_kind_t kind, uint32_t token, uint32_t lhs, uint32_t rhs) {
+    clv_node_id_t id = clv_ast_push (st->ast, kind, token, lhs, rhs);
+
+    if (id == CLV_NODE_NONE) {
+        parse_error (st, "unable to grow syntax tree: %s", strerror (errno));
+    }
+
+    return id;
+}
+
+
+static bool
+parse_enter (parser_state_t *st) {
+    if (st->depth >= PARSER_MAX_DEPTH) {
+        parse_error (st, "nesting is too deep (maximum is %d)", PARSER_MAX_DEPTH);
+        return false;
+    }
+
+    st->depth++;
+
+    return true;
+}
+
+
+static inline void
+parse_leave (parser_state_t *st) {
+    st->depth--;
+}
+
+
+/* == Lists == */
+
+
+static bool
+parse_scratch_push (parser_state_t *st, clv_node_id_t id) {
+    if (st->scratch_length == st->scratch_capacity) {
+        size_t capacity = (st->scratch_capacity == 0) ? 256 : st->scratch_capacity * 2;
+        uint32_t *temp = clv_realloc (CLV_TAG_AST, st->scratch, capacity * sizeof (*temp));
+
+        if (temp == NULL) {
+            parse_error (st, "unable to grow syntax tree: %s", strerror (errno));
+            return false;
+        }
+
+        st->scratch = temp;
+        st->scratch_capacity = capacity;
+    }
+
+    st->scratch[st->scratch_length++] = id;
+
+    return true;
+}
+
+
+/* Moves the children pushed since `top` to the tree as a span, and returns
+ * its start */
+static uint32_t
+parse_span (parser_state_t *st, size_t top, uint32_t *out_count) {
+    *out_count = st->scratch_length - top;
+
+    uint32_t start = clv_ast_push_extra (st->ast, &st->scratch[top], *out_count);
+    st->scratch_length = top;
+
+    if (start == UINT32_MAX) {
+        parse_error (st, "unable to grow syntax tree: %s", strerror (errno));
+    }
+
+    return start;
+}
+
+
+/* Moves the children pushed since `top` to the tree as a list, after the
+ * `prefix` values of a record, and returns the index of the record */
+static uint32_t
+parse_list (parser_state_t *st, size_t top, const uint32_t *prefix, size_t prefix_count) {
+    uint32_t count = st->scratch_length - top;
+
+    uint32_t index = clv_ast_push_extra (st->ast, prefix, prefix_count);
+
+    if (index != UINT32_MAX && clv_ast_push_extra (st->ast, &count, 1) != UINT32_MAX
+        && clv_ast_push_extra (st->ast, &st->scratch[top], count) != UINT32_MAX) {
+        st->scratch_length = top;
+        return index;
+    }
+
+    st->scratch_length = top;
+    parse_error (st, "unable to grow syntax tree: %s", strerror (errno));
+
+    return UINT32_MAX;
+}
+
+
+/* == Types == */
+
+
+static clv_node_id_t parse_expr (parser_state_t *st, int min_precedence);
+static clv_node_id_t parse_block (parser_state_t *st);
+static clv_node_id_t parse_statement (parser_state_t *st);
+
+
+/* path: IDENT ('.' IDENT)* */
+static clv_node_id_t
+parse_path (parser_state_t *st) {
+    uint32_t token = parse_expect (st, CLV_TOKEN_IDENTIFIER, "a name");
+
+    if (token == PARSER_NO_TOKEN) {
+        return CLV_NODE_NONE;
+    }
+
+    clv_node_id_t path = parse_node (st, CLV_NODE_NAME, token, 0, 0);
+
+    while (path != CLV_NODE_NONE && parse_accept (st, CLV_TOKEN_PERIOD)) {
+        if ((token = parse_expect (st, CLV_TOKEN_IDENTIFIER, "a name")) == PARSER_NO_TOKEN) {
+            return CLV_NODE_NONE;
+        }
+
+        path = parse_node (st, CLV_NODE_MEMBER, token, path, 0);
+    }
+
+    return path;
+}
+
+
+static clv_node_id_t parse_type (parser_state_t *st);
+static clv_node_id_t parse_unary (parser_state_t *st);
+
+
+/* '(' [type (',' type)*] ')' [':' type], after 'fn' */
+static clv_node_id_t
+parse_fn_type (parser_state_t *st, uint32_t token) {
+    size_t top = st->scratch_length;
+
+    if (parse_expect (st, CLV_TOKEN_LPARENTHESIS, "'('") == PARSER_NO_TOKEN) {
+        return CLV_NODE_NONE;
+    }
+
+    while (st->type != CLV_TOKEN_RPARENTHESIS) {
+        clv_node_id_t param = parse_type (st);
+
+        if (param == CLV_NODE_NONE || !parse_scratch_push (st, param)) {
+            st->scratch_length = top;
+            return CLV_NODE_NONE;
+        }
+
+        if (!parse_accept (st, CLV_TOKEN_COMMA)) {
+            break;
+        }
+    }
+
+    uint32_t result = CLV_NODE_NONE;
+
+    if (parse_expect (st, CLV_TOKEN_RPARENTHESIS, "')'") == PARSER_NO_TOKEN
+        || (parse_accept (st, CLV_TOKEN_COLON) && (result = parse_type (st)) == CLV_NODE_NONE)) {
+        st->scratch_length = top;
+        return CLV_NODE_NONE;
+    }
+
+    uint32_t sig = parse_list (st, top, &result, 1);
+
+    if (sig == UINT32_MAX) {
+        return CLV_NODE_NONE;
+    }
+
+    return parse_node (st, CLV_NODE_TYPE_FN, token, sig, 0);
+}
+
+
+/* type: '[' type ']' | '?' type | '&' type | 'fn' fn-type | typeof-expr | path */
+static clv_node_id_t
+parse_type (parser_state_t *st) {
+    if (!parse_enter (st)) {
+        return CLV_NODE_NONE;
+    }
+
+    uint32_t token = st->pos;
+    clv_node_id_t type = CLV_NODE_NONE;
+    clv_node_id_t inner;
+
+    switch (st->type) {
+    case CLV_TOKEN_LBRACKET:
+        parse_advance (st);
+
+        if ((inner = parse_type (st)) != CLV_NODE_NONE
+            && parse_expect (st, CLV_TOKEN_RBRACKET, "']'") != PARSER_NO_TOKEN) {
+            type = parse_node (st, CLV_NODE_TYPE_ARRAY, token, inner, 0);
+        }
+
+        break;
+
+    case CLV_TOKEN_QUESTIONMARK:
+        parse_advance (st);
+
+        if ((inner = parse_type (st)) != CLV_NODE_NONE) {
+            type = parse_node (st, CLV_NODE_TYPE_OPTION, token, inner, 0);
+        }
+
+        break;
+
+    case CLV_TOKEN_BIT_AND:
+        parse_advance (st);
+
+        if ((inner = parse_type (st)) != CLV_NODE_NONE) {
+            type = parse_node (st, CLV_NODE_TYPE_REF, token, inner, 0);
+        }
+
+        break;
+
+    case CLV_TOKEN_FN:
+        parse_advance (st);
+        type = parse_fn_type (st, token);
+        break;
+
+    case CLV_TOKEN_TYPEOF:
+        type = parse_unary (st);
+        break;
+
+    case CLV_TOKEN_IDENTIFIER:
+        type = parse_path (st);
+        break;
+
+    default:
+        parse_error (st, "expected a type");
+        break;
+    }
+
+    parse_leave (st);
+
+    return type;
+}
+
+
+/* == Expressions == */
+
+
+/* Parses a comma separated list of expressions up to `close`, which is
+ * consumed, pushing them onto the scratch stack */
+static bool
+parse_exprs (parser_state_t *st, int close, clv_str what) {
+    while (st->type != close) {
+        clv_node_id_t expr = parse_expr (st, 0);
+
+        if (expr == CLV_NODE_NONE || !parse_scratch_push (st, expr)) {
+            return false;
+        }
+
+        if (!parse_accept (st, CLV_TOKEN_COMMA)) {
+            break;
+        }
+    }
+
+    return parse_expect (st, close, what) != PARSER_NO_TOKEN;
+}
+
+
+/* '{' [IDENT ':' expr (',' IDENT ':' expr)* [',']] '}', after a path */
+static clv_node_id_t
+parse_init (parser_state_t *st, clv_node_id_t type) {
+    uint32_t token = st->pos;
+    size_t top = st->scratch_length;
+
+    parse_advance (st);
+
+    while (st->type != CLV_TOKEN_RBRACE) {
+        uint32_t name = parse_expect (st, CLV_TOKEN_IDENTIFIER, "a field name");
+        clv_node_id_t value;
+
+        if (name == PARSER_NO_TOKEN || parse_expect (st, CLV_TOKEN_COLON, "':'") == PARSER_NO_TOKEN
+            || (value = parse_expr (st, 0)) == CLV_NODE_NONE) {
+            st->scratch_length = top;
+            return CLV_NODE_NONE;
+        }
+
+        clv_node_id_t field = parse_node (st, CLV_NODE_FIELD_INIT, name, value, 0);
+
+        if (field == CLV_NODE_NONE || !parse_scratch_push (st, field)) {
+            st->scratch_length = top;
+            return CLV_NODE_NONE;
+        }
+
+        if (!parse_accept (st, CLV_TOKEN_COMMA)) {
+            break;
+        }
+    }
+
+    if (parse_expect (st, CLV_TOKEN_RBRACE, "'}'") == PARSER_NO_TOKEN) {
+        st->scratch_length = top;
+        return CLV_NODE_NONE;
+    }
+
+    uint32_t fields = parse_list (st, top, NULL, 0);
+
+    if (fields == UINT32_MAX) {
+        return CLV_NODE_NONE;
+    }
+
+    return parse_node (st, CLV_NODE_INIT, token, type, fields);
+}
+
+
+static clv_node_id_t
+parse_primary (parser_state_t *st) {
+    uint32_t token = st->pos;
+    clv_node_id_t expr;
+    uint32_t count;
+
+    switch (st->type) {
+    case CLV_TOKEN_IDENTIFIER:
+        parse_advance (st);
+        return parse_node (st, CLV_NODE_NAME, token, 0, 0);
+
+    case CLV_TOKEN_STRING:
+    case CLV_TOKEN_CHARACTER:
+    case CLV_TOKEN_FLOAT:
+    case CLV_TOKEN_INT:
+    case CLV_TOKEN_BIN:
+    case CLV_TOKEN_HEX:
+    case CLV_TOKEN_TRUE:
+    case CLV_TOKEN_FALSE:
+    case CLV_TOKEN_NIL:
+        parse_advance (st);
+        return parse_node (st, CLV_NODE_LITERAL, token, 0, 0);
+
+    case CLV_TOKEN_LPARENTHESIS: {
+        bool no_init = st->no_init;
+
+        parse_advance (st);
+
+        st->no_init = false;
+        expr = parse_expr (st, 0);
+        st->no_init = no_init;
+
+        if (expr == CLV_NODE_NONE || parse_expect (st, CLV_TOKEN_RPARENTHESIS, "')'") == PARSER_NO_TOKEN) {
+            return CLV_NODE_NONE;
+        }
+
+        return expr;
+    }
+
+    case CLV_TOKEN_LBRACKET: {
+        bool no_init = st->no_init;
+        size_t top = st->scratch_length;
+
+        parse_advance (st);
+
+        st->no_init = false;
+        bool good = parse_exprs (st, CLV_TOKEN_RBRACKET, "']'");
+        st->no_init = no_init;
+
+        if (!good) {
+            st->scratch_length = top;
+            return CLV_NODE_NONE;
+        }
+
+        uint32_t start = parse_span (st, top, &count);
+
+        if (start == UINT32_MAX) {
+            return CLV_NODE_NONE;
+        }
+
+        return parse_node (st, CLV_NODE_ARRAY, token, start, count);
+    }
+
+    default:
+        parse_error (st, "expected an expression");
+        return CLV_NODE_NONE;
+    }
+}
+
+
+static clv_node_id_t
+parse_postfix (parser_state_t *st) {
+    clv_node_id_t expr = parse_primary (st);
+
+    while (expr != CLV_NODE_NONE) {
+        uint32_t token = st->pos;
+        clv_node_kind_t kind = clv_ast_node (st->ast, expr)->kind;
+
+        switch (st->type) {
+        case CLV_TOKEN_LPARENTHESIS: {
+            bool no_init = st->no_init;
+            size_t top = st->scratch_length;
+
+            parse_advance (st);
+
+            st->no_init = false;
+            bool good = parse_exprs (st, CLV_TOKEN_RPARENTHESIS, "')'");
+            st->no_init = no_init;
+
+            if (!good) {
+                st->scratch_length = top;
+                return CLV_NODE_NONE;
+            }
+
+            uint32_t args = parse_list (st, top, NULL, 0);
+
+            if (args == UINT32_MAX) {
+                return CLV_NODE_NONE;
+            }
+
+            expr = parse_node (st, CLV_NODE_CALL, token, expr, args);
+            break;
+        }
+
+        case CLV_TOKEN_LBRACKET: {
+            bool no_init = st->no_init;
+
+            parse_advance (st);
+
+            st->no_init = false;
+            clv_node_id_t index = parse_expr (st, 0);
+            st->no_init = no_init;
+
+            if (index == CLV_NODE_NONE || parse_expect (st, CLV_TOKEN_RBRACKET, "']'") == PARSER_NO_TOKEN) {
+                return CLV_NODE_NONE;
+            }
+
+            expr = parse_node (st, CLV_NODE_INDEX, token, expr, index);
+            break;
+        }
+
+        case CLV_TOKEN_PERIOD:
+            parse_advance (st);
+
+            if ((token = parse_expect (st, CLV_TOKEN_IDENTIFIER, "a member name")) == PARSER_NO_TOKEN) {
+                return CLV_NODE_NONE;
+            }
+
+            expr = parse_node (st, CLV_NODE_MEMBER, token, expr, 0);
+            break;
+
+        case CLV_TOKEN_QUESTIONMARK:
+            parse_advance (st);
+            expr = parse_node (st, CLV_NODE_UNWRAP, token, expr, 0);
+            break;
+
+        case CLV_TOKEN_LBRACE:
+            // only paths name the type of an initializer
+            if (st->no_init || (kind != CLV_NODE_NAME && kind != CLV_NODE_MEMBER)) {
+                return expr;
+            }
+
+            expr = parse_init (st, expr);
+            break;
+
+        default:
+            return expr;
+        }
+    }
+
+    return CLV_NODE_NONE;
+}
+
+
+static clv_node_id_t
+parse_unary (parser_state_t *st) {
+    uint32_t token = st->pos;
+    clv_node_kind_t kind;
+
+    switch (st->type) {
+    case CLV_TOKEN_MINUS:
+    case CLV_TOKEN_NOT:
+    case CLV_TOKEN_BIT_NOT:
+        kind = CLV_NODE_UNARY;
+        break;
+
+    case CLV_TOKEN_TRY:
+        kind = CLV_NODE_TRY;
+        break;
+
+    case CLV_TOKEN_TYPEOF:
+        kind = CLV_NODE_TYPEOF;
+        break;
+
+    default:
+        return parse_postfix (st);
+    }
+
+    if (!parse_enter (st)) {
+        return CLV_NODE_NONE;
+    }
+
+    int op = st->type;
+    parse_advance (st);
+
+    clv_node_id_t operand = parse_unary (st);
+    clv_node_id_t expr = CLV_NODE_NONE;
+
+    if (operand != CLV_NODE_NONE && (expr = parse_node (st, kind, token, operand, 0)) != CLV_NODE_NONE) {
+        clv_ast_node (st->ast, expr)->op = op;
+    }
+
+    parse_leave (st);
+
+    return expr;
+}
+
+
+/* Precedence climbing over the binary operators binding at least as tight
+ * as `min_precedence` */
+static clv_node_id_t
+parse_expr (parser_state_t *st, int min_precedence) {
+    if (!parse_enter (st)) {
+        return CLV_NODE_NONE;
+    }
+
+    clv_node_id_t lhs = parse_unary (st);
+
+    while (lhs != CLV_NODE_NONE && st->type != PARSER_EOF) {
+        int op = st->type;
+        int precedence = parse_precedence[op];
+
+        if (precedence == 0 || precedence < min_precedence) {
+            break;
+        }
+
+        uint32_t token = st->pos;
+        parse_advance (st);
+
+        if (op == CLV_TOKEN_AS) {
+            clv_node_id_t type = parse_type (st);
+
+            lhs = (type != CLV_NODE_NONE) ? parse_node (st, CLV_NODE_CAST, token, lhs, type) : CLV_NODE_NONE;
+            continue;
+        }
+
+        // operators are left associative
+        clv_node_id_t rhs = parse_expr (st, precedence + 1);
+
+        if (rhs == CLV_NODE_NONE || (lhs = parse_node (st, CLV_NODE_BINARY, token, lhs, rhs)) == CLV_NODE_NONE) {
+            lhs = CLV_NODE_NONE;
+            break;
+        }
+
+        clv_ast_node (st->ast, lhs)->op = op;
+    }
+
+    parse_leave (st);
+
+    return lhs;
+}
+
+
+/* Expression in front of a block, where `Name {` opens the block */
+static clv_node_id_t
+parse_condition (parser_state_t *st) {
+    bool no_init = st->no_init;
+
+    st->no_init = true;
+    clv_node_id_t expr = parse_expr (st, 0);
+    st->no_init = no_init;
+
+    return expr;
+}
+
+
+/* == Statements == */
+
+
+/* '{' statement* '}' */
+static clv_node_id_t
+parse_block (parser_state_t *st) {
+    uint32_t token = parse_expect (st, CLV_TOKEN_LBRACE, "'{'");
+    size_t top = st->scratch_length;
+    uint32_t count;
+
+    if (token == PARSER_NO_TOKEN) {
+        return CLV_NODE_NONE;
+    }
+
+    bool no_init = st->no_init;
+    st->no_init = false;
+
+    while (st->type != CLV_TOKEN_RBRACE && st->type != PARSER_EOF) {
+        clv_node_id_t stmt = parse_statement (st);
+
+        if (stmt == CLV_NODE_NONE || !parse_scratch_push (st, stmt)) {
+            st->no_init = no_init;
+            st->scratch_length = top;
+            return CLV_NODE_NONE;
+        }
+    }
+
+    st->no_init = no_init;
+
+    if (parse_expect (st, CLV_TOKEN_RBRACE, "'}'") == PARSER_NO_TOKEN) {
+        st->scratch_length = top;
+        return CLV_NODE_NONE;
+    }
+
+    uint32_t start = parse_span (st, top, &count);
+
+    if (start == UINT32_MAX) {
+        return CLV_NODE_NONE;
+    }
+
+    return parse_node (st, CLV_NODE_BLOCK, token, start, count);
+}
+
+
+/* ('let' | 'const') IDENT [':' type] ['=' expr] ';' */
+static clv_node_id_t
+parse_let (parser_state_t *st) {
+    bool is_const = (st->type == CLV_TOKEN_CONST);
+
+    parse_advance (st);
+
+    uint32_t name = parse_expect (st, CLV_TOKEN_IDENTIFIER, "a variable name");
+    clv_node_id_t type = CLV_NODE_NONE;
+    clv_node_id_t value = CLV_NODE_NONE;
+
+    if (name == PARSER_NO_TOKEN) {
+        return CLV_NODE_NONE;
+    }
+
+    if (parse_accept (st, CLV_TOKEN_COLON) && (type = parse_type (st)) == CLV_NODE_NONE) {
+        return CLV_NODE_NONE;
+    }
+
+    if (parse_accept (st, CLV_TOKEN_ASSIGN)) {
+        if ((value = parse_expr (st, 0)) == CLV_NODE_NONE) {
+            return CLV_NODE_NONE;
+        }
+    } else if (is_const) {
+        parse_error (st, "expected '=' after constant");
+        return CLV_NODE_NONE;
+    }
+
+    if (parse_expect (st, CLV_TOKEN_SEMICOLON, "';'") == PARSER_NO_TOKEN) {
+        return CLV_NODE_NONE;
+    }
+
+    clv_node_id_t let = parse_node (st, CLV_NODE_LET, name, type, value);
+
+    if (let != CLV_NODE_NONE && is_const) {
+        clv_ast_node (st->ast, let)->flags |= CLV_NODE_F_CONST;
+    }
+
+    return let;
+}
+
+
+/* ('if' | 'elif') expr block [('elif' ... | 'else' block)] */
+static clv_node_id_t
+parse_if (parser_state_t *st) {
+    uint32_t token = st->pos;
+
+    parse_advance (st);
+
+    clv_node_id_t cond = parse_condition (st);
+    uint32_t branches[2] = { CLV_NODE_NONE, CLV_NODE_NONE };
+
+    if (cond == CLV_NODE_NONE || (branches[0] = parse_block (st)) == CLV_NODE_NONE) {
+        return CLV_NODE_NONE;
+    }
+
+    if (st->type == CLV_TOKEN_ELIF) {
+        if (!parse_enter (st)) {
+            return CLV_NODE_NONE;
+        }
+
+        branches[1] = parse_if (st);
+        parse_leave (st);
+
+        if (branches[1] == CLV_NODE_NONE) {
+            return CLV_NODE_NONE;
+        }
+    } else if (parse_accept (st, CLV_TOKEN_ELSE) && (branches[1] = parse_block (st)) == CLV_NODE_NONE) {
+        return CLV_NODE_NONE;
+    }
+
+    uint32_t record = clv_ast_push_extra (st->ast, branches, 2);
+
+    if (record == UINT32_MAX) {
+        parse_error (st, "unable to grow syntax tree: %s", strerror (errno));
+        return CLV_NODE_NONE;
+    }
+
+    return parse_node (st, CLV_NODE_IF, token, cond, record);
+}
+
+
+/* 'match' expr '{' (('else' | expr (',' expr)*) ':' (block | expr) [','])* '}' */
+static clv_node_id_t
+parse_match (parser_state_t *st) {
+    uint32_t token = st->pos;
+    size_t top = st->scratch_length;
+
+    parse_advance (st);
+
+    clv_node_id_t value = parse_condition (st);
+
+    if (value == CLV_NODE_NONE || parse_expect (st, CLV_TOKEN_LBRACE, "'{'") == PARSER_NO_TOKEN) {
+        return CLV_NODE_NONE;
+    }
+
+    while (st->type != CLV_TOKEN_RBRACE && st->type != PARSER_EOF) {
+        size_t arm_top = st->scratch_length;
+
+        if (!parse_accept (st, CLV_TOKEN_ELSE)) {
+            do {
+                clv_node_id_t pattern = parse_condition (st);
+
+                if (pattern == CLV_NODE_NONE || !parse_scratch_push (st, pattern)) {
+                    st->scratch_length = top;
+                    return CLV_NODE_NONE;
+                }
+            } while (parse_accept (st, CLV_TOKEN_COMMA));
+        }
+
+        uint32_t colon = parse_expect (st, CLV_TOKEN_COLON, "':'");
+        clv_node_id_t body = CLV_NODE_NONE;
+
+        if (colon != PARSER_NO_TOKEN) {
+            body = (st->type == CLV_TOKEN_LBRACE) ? parse_block (st) : parse_expr (st, 0);
+        }
+
+        uint32_t patterns;
+
+        if (body == CLV_NODE_NONE || (patterns = parse_list (st, arm_top, NULL, 0)) == UINT32_MAX) {
+            st->scratch_length = top;
+            return CLV_NODE_NONE;
+        }
+
+        clv_node_id_t arm = parse_node (st, CLV_NODE_ARM, colon, patterns, body);
+
+        if (arm == CLV_NODE_NONE || !parse_scratch_push (st, arm)) {
+            st->scratch_length = top;
+            return CLV_NODE_NONE;
+        }
+
+        parse_accept (st, CLV_TOKEN_COMMA);
+    }
+
+    if (parse_expect (st, CLV_TOKEN_RBRACE, "'}'") == PARSER_NO_TOKEN) {
+        st->scratch_length = top;
+        return CLV_NODE_NONE;
+    }
+
+    uint32_t arms = parse_list (st, top, NULL, 0);
+
+    if (arms == UINT32_MAX) {
+        return CLV_NODE_NONE;
+    }
+
+    return parse_node (st, CLV_NODE_MATCH, token, value, arms);
+}
+
+
+static clv_node_id_t
+parse_statement_inner (parser_state_t *st) {
+    uint32_t token = st->pos;
+    clv_node_id_t lhs = CLV_NODE_NONE;
+    clv_node_id_t rhs;
+
+    switch (st->type) {
+    case CLV_TOKEN_LET:
+    case CLV_TOKEN_CONST:
+        return parse_let (st);
+
+    case CLV_TOKEN_IF:
+        return parse_if (st);
+
+    case CLV_TOKEN_MATCH:
+        return parse_match (st);
+
+    case CLV_TOKEN_LBRACE:
+        return parse_block (st);
+
+    case CLV_TOKEN_WHILE:
+        parse_advance (st);
+
+        if ((lhs = parse_condition (st)) == CLV_NODE_NONE || (rhs = parse_block (st)) == CLV_NODE_NONE) {
+            return CLV_NODE_NONE;
+        }
+
+        return parse_node (st, CLV_NODE_WHILE, token, lhs, rhs);
+
+    case CLV_TOKEN_FOR:
+        parse_advance (st);
+
+        if ((token = parse_expect (st, CLV_TOKEN_IDENTIFIER, "a variable name")) == PARSER_NO_TOKEN
+            || parse_expect (st, CLV_TOKEN_IN, "'in'") == PARSER_NO_TOKEN
+            || (lhs = parse_condition (st)) == CLV_NODE_NONE || (rhs = parse_block (st)) == CLV_NODE_NONE) {
+            return CLV_NODE_NONE;
+        }
+
+        return parse_node (st, CLV_NODE_FOR, token, lhs, rhs);
+
+    case CLV_TOKEN_DEFER:
+        parse_advance (st);
+
+        if ((lhs = parse_statement (st)) == CLV_NODE_NONE) {
+            return CLV_NODE_NONE;
+        }
+
+        return parse_node (st, CLV_NODE_DEFER, token, lhs, 0);
+
+    case CLV_TOKEN_RETURN:
+        parse_advance (st);
+
+        if (st->type != CLV_TOKEN_SEMICOLON && (lhs = parse_expr (st, 0)) == CLV_NODE_NONE) {
+            return CLV_NODE_NONE;
+        }
+
+        if (parse_expect (st, CLV_TOKEN_SEMICOLON, "';'") == PARSER_NO_TOKEN) {
+            return CLV_NODE_NONE;
+        }
+
+        return parse_node (st, CLV_NODE_RETURN, token, lhs, 0);
+
+    case CLV_TOKEN_BREAK:
+    case CLV_TOKEN_CONTINUE:
+        parse_advance (st);
+
+        if (parse_expect (st, CLV_TOKEN_SEMICOLON, "';'") == PARSER_NO_TOKEN) {
+            return CLV_NODE_NONE;
+        }
+
+        return parse_node (st, (st->tokens[token].type == CLV_TOKEN_BREAK) ? CLV_NODE_BREAK : CLV_NODE_CONTINUE, token, 0, 0);
+
+    default:
+        break;
+    }
+
+    // expression or assignment
+    if ((lhs = parse_expr (st, 0)) == CLV_NODE_NONE) {
+        return CLV_NODE_NONE;
+    }
+
+    clv_node_id_t stmt;
+
+    if (st->type == CLV_TOKEN_ASSIGN) {
+        uint32_t assign = st->pos;
+
+        parse_advance (st);
+
+        if ((rhs = parse_expr (st, 0)) == CLV_NODE_NONE) {
+            return CLV_NODE_NONE;
+        }
+
+        stmt = parse_node (st, CLV_NODE_ASSIGN, assign, lhs, rhs);
+    } else {
+        stmt = parse_node (st, CLV_NODE_EXPR, token, lhs, 0);
+    }
+
+    if (stmt == CLV_NODE_NONE || parse_expect (st, CLV_TOKEN_SEMICOLON, "';'") == PARSER_NO_TOKEN) {
+        return CLV_NODE_NONE;
+    }
+
+    return stmt;
+}
+
+
+static clv_node_id_t
+parse_statement (parser_state_t *st) {
+    if (!parse_enter (st)) {
+        return CLV_NODE_NONE;
+    }
+
+    clv_node_id_t stmt = parse_statement_inner (st);
+
+    parse_leave (st);
+
+    return stmt;
+}
+
+
+/* == Items == */
+
+
+/* 'fn' IDENT ['.' IDENT] '(' [param (',' param)*] ')' [':' type] (block | ';') */
+static clv_node_id_t
+parse_fn (parser_state_t *st, bool need_body) {
+    size_t top = st->scratch_length;
+    uint8_t flags = 0;
+
+    parse_advance (st);
+
+    uint32_t name = parse_expect (st, CLV_TOKEN_IDENTIFIER, "a function name");
+
+    if (name == PARSER_NO_TOKEN) {
+        return CLV_NODE_NONE;
+    }
+
+    if (parse_accept (st, CLV_TOKEN_PERIOD)) {
+        if ((name = parse_expect (st, CLV_TOKEN_IDENTIFIER, "a method name")) == PARSER_NO_TOKEN) {
+            return CLV_NODE_NONE;
+        }
+
+        flags |= CLV_NODE_F_METHOD;
+    }
+
+    if (parse_expect (st, CLV_TOKEN_LPARENTHESIS, "'('") == PARSER_NO_TOKEN) {
+        return CLV_NODE_NONE;
+    }
+
+    while (st->type != CLV_TOKEN_RPARENTHESIS) {
+        uint32_t param_name = parse_expect (st, CLV_TOKEN_IDENTIFIER, "a parameter name");
+        clv_node_id_t type = CLV_NODE_NONE;
+
+        if (param_name == PARSER_NO_TOKEN
+            || (parse_accept (st, CLV_TOKEN_COLON) && (type = parse_type (st)) == CLV_NODE_NONE)) {
+            st->scratch_length = top;
+            return CLV_NODE_NONE;
+        }
+
+        clv_node_id_t param = parse_node (st, CLV_NODE_PARAM, param_name, type, 0);
+
+        if (param == CLV_NODE_NONE || !parse_scratch_push (st, param)) {
+            st->scratch_length = top;
+            return CLV_NODE_NONE;
+        }
+
+        if (!parse_accept (st, CLV_TOKEN_COMMA)) {
+            break;
+        }
+    }
+
+    uint32_t result = CLV_NODE_NONE;
+
+    if (parse_expect (st, CLV_TOKEN_RPARENTHESIS, "')'") == PARSER_NO_TOKEN
+        || (parse_accept (st, CLV_TOKEN_COLON) && (result = parse_type (st)) == CLV_NODE_NONE)) {
+        st->scratch_length = top;
+        return CLV_NODE_NONE;
+    }
+
+    uint32_t sig = parse_list (st, top, &result, 1);
+    clv_node_id_t body = CLV_NODE_NONE;
+
+    if (sig == UINT32_MAX) {
+        return CLV_NODE_NONE;
+    }
+
+    if (need_body || st->type == CLV_TOKEN_LBRACE) {
+        if ((body = parse_block (st)) == CLV_NODE_NONE) {
+            return CLV_NODE_NONE;
+        }
+    } else if (parse_expect (st, CLV_TOKEN_SEMICOLON, "';' or a body") == PARSER_NO_TOKEN) {
+        return CLV_NODE_NONE;
+    }
+
+    clv_node_id_t fn = parse_node (st, CLV_NODE_FN, name, sig, body);
+
+    if (fn != CLV_NODE_NONE) {
+        clv_ast_node (st->ast, fn)->flags = flags;
+    }
+
+    return fn;
+}
+
+
+/* Parses '{' [member (',' member)* [',']] '}' of structs and enums, where
+ * a member is IDENT [':' type] ['=' expr] */
+static clv_node_id_t
+parse_members (parser_state_t *st, clv_node_kind_t kind, clv_node_kind_t member_kind) {
+    size_t top = st->scratch_length;
+    uint32_t count;
+
+    parse_advance (st);
+
+    uint32_t name = parse_expect (st, CLV_TOKEN_IDENTIFIER, "a name");
+
+    if (name == PARSER_NO_TOKEN || parse_expect (st, CLV_TOKEN_LBRACE, "'{'") == PARSER_NO_TOKEN) {
+        return CLV_NODE_NONE;
+    }
+
+    while (st->type != CLV_TOKEN_RBRACE) {
+        uint32_t member_name = parse_expect (st, CLV_TOKEN_IDENTIFIER, "a member name");
+        clv_node_id_t type = CLV_NODE_NONE;
+        clv_node_id_t value = CLV_NODE_NONE;
+
+        if (member_name == PARSER_NO_TOKEN) {
+            st->scratch_length = top;
+            return CLV_NODE_NONE;
+        }
+
+        // fields are typed, variants aren't
+        if (member_kind == CLV_NODE_FIELD
+            && (parse_expect (st, CLV_TOKEN_COLON, "':'") == PARSER_NO_TOKEN
+                || (type = parse_type (st)) == CLV_NODE_NONE)) {
+            st->scratch_length = top;
+            return CLV_NODE_NONE;
+        }
+
+        if (parse_accept (st, CLV_TOKEN_ASSIGN) && (value = parse_expr (st, 0)) == CLV_NODE_NONE) {
+            st->scratch_length = top;
+            return CLV_NODE_NONE;
+        }
+
+        clv_node_id_t member = (member_kind == CLV_NODE_FIELD)
+                             ? parse_node (st, member_kind, member_name, type, value)
+                             : parse_node (st, member_kind, member_name, value, 0);
+
+        if (member == CLV_NODE_NONE || !parse_scratch_push (st, member)) {
+            st->scratch_length = top;
+            return CLV_NODE_NONE;
+        }
+
+        if (!parse_accept (st, CLV_TOKEN_COMMA)) {
+            break;
+        }
+    }
+
+    if (parse_expect (st, CLV_TOKEN_RBRACE, "'}'") == PARSER_NO_TOKEN) {
+        st->scratch_length = top;
+        return CLV_NODE_NONE;
+    }
+
+    uint32_t start = parse_span (st, top, &count);
+
+    if (start == UINT32_MAX) {
+        return CLV_NODE_NONE;
+    }
+
+    return parse_node (st, kind, name, start, count);
+}
+
+
+/* 'trait' IDENT '{' fn* '}' */
+static clv_node_id_t
+parse_trait (parser_state_t *st) {
+    size_t top = st->scratch_length;
+    uint32_t count;
+
+    parse_advance (st);
+
+    uint32_t name = parse_expect (st, CLV_TOKEN_IDENTIFIER, "a trait name");
+
+    if (name == PARSER_NO_TOKEN || parse_expect (st, CLV_TOKEN_LBRACE, "'{'") == PARSER_NO_TOKEN) {
+        return CLV_NODE_NONE;
+    }
+
+    while (st->type == CLV_TOKEN_FN) {
+        clv_node_id_t fn = parse_fn (st, false);
+
+        if (fn == CLV_NODE_NONE || !parse_scratch_push (st, fn)) {
+            st->scratch_length = top;
+            return CLV_NODE_NONE;
+        }
+    }
+
+    if (parse_expect (st, CLV_TOKEN_RBRACE, "'}'") == PARSER_NO_TOKEN) {
+        st->scratch_length = top;
+        return CLV_NODE_NONE;
+    }
+
+    uint32_t start = parse_span (st, top, &count);
+
+    if (start == UINT32_MAX) {
+        return CLV_NODE_NONE;
+    }
+
+    return parse_node (st, CLV_NODE_TRAIT, name, start, count);
+}
+
+
+/* ('static' | 'const') IDENT [':' type] '=' expr ';' */
+static clv_node_id_t
+parse_global (parser_state_t *st) {
+    uint8_t flags = (st->type == CLV_TOKEN_CONST) ? CLV_NODE_F_CONST : CLV_NODE_F_STATIC;
+
+    parse_advance (st);
+
+    uint32_t name = parse_expect (st, CLV_TOKEN_IDENTIFIER, "a variable name");
+    clv_node_id_t type = CLV_NODE_NONE;
+    clv_node_id_t value;
+
+    if (name == PARSER_NO_TOKEN
+        || (parse_accept (st, CLV_TOKEN_COLON) && (type = parse_type (st)) == CLV_NODE_NONE)
+        || parse_expect (st, CLV_TOKEN_ASSIGN, "'='") == PARSER_NO_TOKEN
+        || (value = parse_expr (st, 0)) == CLV_NODE_NONE
+        || parse_expect (st, CLV_TOKEN_SEMICOLON, "';'") == PARSER_NO_TOKEN) {
+        return CLV_NODE_NONE;
+    }
+
+    clv_node_id_t global = parse_node (st, CLV_NODE_GLOBAL, name, type, value);
+
+    if (global != CLV_NODE_NONE) {
+        clv_ast_node (st->ast, global)->flags = flags;
+    }
+
+    return global;
+}
+
+
+static clv_node_id_t
+parse_item (parser_state_t *st) {
+    uint8_t flags = 0;
+    uint32_t token;
+    clv_node_id_t item = CLV_NODE_NONE;
+    clv_node_id_t lhs;
+
+    if (parse_accept (st, CLV_TOKEN_PUB)) {
+        flags |= CLV_NODE_F_PUB;
+    }
+
+    token = st->pos;
+
+    switch (st->type) {
+    case CLV_TOKEN_IMPORT:
+        parse_advance (st);
+
+        if ((lhs = parse_path (st)) != CLV_NODE_NONE
+            && parse_expect (st, CLV_TOKEN_SEMICOLON, "';'") != PARSER_NO_TOKEN) {
+            item = parse_node (st, CLV_NODE_IMPORT, token, lhs, 0);
+        }
+
+        break;
+
+    case CLV_TOKEN_FN:
+        item = parse_fn (st, true);
+        break;
+
+    case CLV_TOKEN_STRUCT:
+        item = parse_members (st, CLV_NODE_STRUCT, CLV_NODE_FIELD);
+        break;
+
+    case CLV_TOKEN_ENUM:
+        item = parse_members (st, CLV_NODE_ENUM, CLV_NODE_VARIANT);
+        break;
+
+    case CLV_TOKEN_TRAIT:
+        item = parse_trait (st);
+        break;
+
+    case CLV_TOKEN_TYPE:
+        parse_advance (st);
+
+        if ((token = parse_expect (st, CLV_TOKEN_IDENTIFIER, "a type name")) != PARSER_NO_TOKEN
+            && parse_expect (st, CLV_TOKEN_ASSIGN, "'='") != PARSER_NO_TOKEN
+            && (lhs = parse_type (st)) != CLV_NODE_NONE
+            && parse_expect (st, CLV_TOKEN_SEMICOLON, "';'") != PARSER_NO_TOKEN) {
+            item = parse_node (st, CLV_NODE_TYPEDEF, token, lhs, 0);
+        }
+
+        break;
+
+    case CLV_TOKEN_STATIC:
+    case CLV_TOKEN_CONST:
+        item = parse_global (st);
+        break;
+
+    default:
+        parse_error (st, "expected an item");
+        break;
+    }
+
+    if (item != CLV_NODE_NONE) {
+        clv_ast_node (st->ast, item)->flags |= flags;
+    }
+
+    return item;
+}
+
+
+/* Skips to the start of the next item, after a syntax error in the item
+ * starting at token `start` */
+static void
+parse_recover (parser_state_t *st, uint32_t start) {
+    if (st->pos == start) {
+        parse_advance (st);
+    }
+
+    while (st->type != PARSER_EOF) {
+        switch (st->type) {
+        case CLV_TOKEN_IMPORT:
+        case CLV_TOKEN_FN:
+        case CLV_TOKEN_STRUCT:
+        case CLV_TOKEN_ENUM:
+        case CLV_TOKEN_TRAIT:
+        case CLV_TOKEN_TYPE:
+        case CLV_TOKEN_STATIC:
+        case CLV_TOKEN_PUB:
+            // items start lines
+            if (parse_line_start (st, st->pos)) {
+                return;
+            }
+
+            break;
+
+        default:
+            break;
+        }
+
+        parse_advance (st);
+    }
+}
+
+
+bool
+clv_parse (clv_source_t *src, clv_tokens_t *tokens, clv_arena_t *arena, clv_ast_t **out_ast) {
+    size_t count = clv_tokens_length (tokens);
+
+    if (count >= UINT32_MAX) {
+        clv_error ("%s: too many tokens", clv_source_get_file (src));
+        return false;
+    }
+
+    clv_ast_t *ast = clv_ast_new (count / PARSER_NODES_PER_TOKEN, arena);
+
+    if (ast == NULL) {
+        clv_error ("unable to create syntax tree: %s", strerror (errno));
+        return false;
+    }
+
+    parser_state_t st = {
+        .src = src,
+        .ast = ast,
+        .tokens = clv_tokens_data (tokens),
+        .count = count,
+        .pos = (uint32_t)-1
+    };
+
+    parse_advance (&st);
+
+    size_t top = st.scratch_length;
+    uint32_t items;
+
+    while (st.type != PARSER_EOF) {
+        uint32_t start = st.pos;
+        clv_node_id_t item = parse_item (&st);
+
+        if (item == CLV_NODE_NONE) {
+            parse_recover (&st, start);
+            continue;
+        }
+
+        if (!parse_scratch_push (&st, item)) {
+            break;
+        }
+    }
+
+    if (!st.error) {
+        uint32_t start = parse_span (&st, top, &items);
+
+        if (start != UINT32_MAX) {
+            clv_ast_set_root (ast, parse_node (&st, CLV_NODE_MODULE, 0, start, items));
+        }
+    }
+
+    clv_free (st.scratch);
+
+    if (st.error) {
+        clv_ast_free (ast);
+        return false;
+    }
+
+    *out_ast = ast;
+
+    return true;
+}
@@ -0,0 +1,371 @@
+#include <clover/pool.h>
+#include <clover/alloc.h>
+
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <errno.h>
+
+#define POOL_DEQUE_MIN_CAPACITY     64
+
+
+typedef struct {
+    clv_pool_func_t func;
+    void *arg;
+} pool_task_t;
+
+
+/* Ring buffer of tasks. The owner pushes and pops at the bottom, thieves
+ * take from the top. Tasks are coarse (whole compilation units), so a mutex
+ * per deque is cheap enough and keeps this simple. */
+typedef struct {
+    pthread_mutex_t lock;
+
+    pool_task_t *tasks;
+    size_t capacity;
+    size_t top;
+    size_t bottom;
+} pool_deque_t;
+
+
+typedef struct {
+    clv_pool_t *pool;
+    pthread_t thread;
+    pool_deque_t deque;
+    unsigned seed;
+} pool_worker_t;
+
+
+struct clv_pool {
+    pool_worker_t *workers;
+    unsigned count;
+    unsigned started;
+
+    atomic_uint next;       /* round-robin target of external submissions */
+    atomic_size_t queued;   /* tasks sitting in deques */
+    atomic_size_t pending;  /* tasks submitted but not finished yet */
+
+    pthread_mutex_t lock;
+    pthread_cond_t work;    /* signaled when tasks are queued */
+    pthread_cond_t done;    /* signaled when pending drops to zero */
+
+    bool shutdown;
+};
+
+
+static _Thread_local pool_worker_t *current_worker = NULL;
+
+
+/* == Deque == */
+
+
+static bool
+deque_init (pool_deque_t *dq) {
+    dq->tasks = clv_alloc (CLV_TAG_MISC, POOL_DEQUE_MIN_CAPACITY * sizeof (*dq->tasks));
+
+    if (dq->tasks == NULL) {
+        return false;
+    }
+
+    dq->capacity = POOL_DEQUE_MIN_CAPACITY;
+    dq->top = 0;
+    dq->bottom = 0;
+
+    pthread_mutex_init (&dq->lock, NULL);
+
+    return true;
+}
+
+
+static void
+deque_destroy (pool_deque_t *dq) {
+    pthread_mutex_destroy (&dq->lock);
+    clv_free (dq->tasks);
+}
+
+
+static bool
+deque_push (pool_deque_t *dq, pool_task_t task) {
+    pthread_mutex_lock (&dq->lock);
+
+    if (dq->bottom - dq->top == dq->capacity) {
+        pool_task_t *tasks = clv_alloc (CLV_TAG_MISC, dq->capacity * 2 * sizeof (*tasks));
+
+        if (tasks == NULL) {
+            pthread_mutex_unlock (&dq->lock);
+            return false;
+        }
+
+        for (size_t i = dq->top; i < dq->bottom; i++) {
+            tasks[i % (dq->capacity * 2)] = dq->tasks[i % dq->capacity];
+        }
+
+        clv_free (dq->tasks);
+        dq->tasks = tasks;
+        dq->capacity *= 2;
+    }
+
+    dq->tasks[dq->bottom % dq->capacity] = task;
+    dq->bottom++;
+
+    pthread_mutex_unlock (&dq->lock);
+
+    return true;
+}
+
+
+static bool
+deque_pop (pool_deque_t *dq, pool_task_t *out_task) {
+    bool found = false;
+
+    pthread_mutex_lock (&dq->lock);
+
+    if (dq->bottom > dq->top) {
+        dq->bottom--;
+        *out_task = dq->tasks[dq->bottom % dq->capacity];
+        found = true;
+    }
+
+    pthread_mutex_unlock (&dq->lock);
+
+    return found;
+}
+
+
+static bool
+deque_steal (pool_deque_t *dq, pool_task_t *out_task) {
+    bool found = false;
+
+    // don't wait on a busy victim, there are others to try
+    if (pthread_mutex_trylock (&dq->lock) != 0) {
+        return false;
+    }
+
+    if (dq->bottom > dq->top) {
+        *out_task = dq->tasks[dq->top % dq->capacity];
+        dq->top++;
+        found = true;
+    }
+
+    pthread_mutex_unlock (&dq->lock);
+
+    return found;
+}
+
+
+/* == Workers == */
+
+
+static bool
+worker_find_task (pool_worker_t *self, pool_task_t *out_task) {
+    clv_pool_t *pool = self->pool;
+
+    if (deque_pop (&self->deque, out_task)) {
+        return true;
+    }
+
+    // start stealing at a random victim, so thieves spread out
+    unsigned start = rand_r (&self->seed) % pool->count;
+
+    for (unsigned i = 0; i < pool->count; i++) {
+        pool_worker_t *victim = &pool->workers[(start + i) % pool->count];
+
+        if (victim != self && deque_steal (&victim->deque, out_task)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+static void *
+worker_main (void *arg) {
+    pool_worker_t *self = arg;
+    clv_pool_t *pool = self->pool;
+
+    current_worker = self;
+
+    while (true) {
+        pool_task_t task;
+
+        if (worker_find_task (self, &task)) {
+            atomic_fetch_sub (&pool->queued, 1);
+
+            task.func (task.arg);
+
+            if (atomic_fetch_sub (&pool->pending, 1) == 1) {
+                pthread_mutex_lock (&pool->lock);
+                pthread_cond_broadcast (&pool->done);
+                pthread_mutex_unlock (&pool->lock);
+            }
+
+            continue;
+        }
+
+        pthread_mutex_lock (&pool->lock);
+
+        while (atomic_load (&pool->queued) == 0 && !pool->shutdown) {
+            pthread_cond_wait (&pool->work, &pool->lock);
+        }
+
+        bool shutdown = pool->shutdown && atomic_load (&pool->queued) == 0;
+
+        pthread_mutex_unlock (&pool->lock);
+
+        if (shutdown) {
+            break;
+        }
+    }
+
+    current_worker = NULL;
+
+    return NULL;
+}
+
+
+/* == Pool == */
+
+
+clv_pool_t *
+clv_pool_new (unsigned threads) {
+    if (threads == 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    clv_pool_t *pool = clv_alloc (CLV_TAG_MISC, sizeof (*pool));
+
+    if (pool == NULL) {
+        return NULL;
+    }
+
+    pool->workers = clv_calloc (CLV_TAG_MISC, threads, sizeof (*pool->workers));
+
+    if (pool->workers == NULL) {
+        clv_free (pool);
+        return NULL;
+    }
+
+    pool->count = 0;
+    pool->started = 0;
+    pool->shutdown = false;
+
+    atomic_init (&pool->next, 0);
+    atomic_init (&pool->queued, 0);
+    atomic_init (&pool->pending, 0);
+
+    pthread_mutex_init (&pool->lock, NULL);
+    pthread_cond_init (&pool->work, NULL);
+    pthread_cond_init (&pool->done, NULL);
+
+    for (unsigned i = 0; i < threads; i++) {
+        pool_worker_t *worker = &pool->workers[i];
+
+        worker->pool = pool;
+        worker->seed = i + 1;
+
+        if (!deque_init (&worker->deque)) {
+            clv_pool_free (pool);
+            return NULL;
+        }
+
+        pool->count++;
+    }
+
+    for (unsigned i = 0; i < threads; i++) {
+        if (pthread_create (&pool->workers[i].thread, NULL, worker_main, &pool->workers[i]) != 0) {
+            break;
+        }
+
+        pool->started++;
+    }
+
+    // idle workers steal, so the ones started so far can run every task
+    if (pool->started == 0) {
+        clv_pool_free (pool);
+        return NULL;
+    }
+
+    return pool;
+}
+
+
+bool
+clv_pool_submit (clv_pool_t *self, clv_pool_func_t func, void *arg) {
+    if (self == NULL || func == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+
+    pool_worker_t *worker = current_worker;
+
+    if (worker == NULL || worker->pool != self) {
+        worker = &self->workers[atomic_fetch_add (&self->next, 1) % self->count];
+    }
+
+    atomic_fetch_add (&self->pending, 1);
+
+    if (!deque_push (&worker->deque, (pool_task_t){ func, arg })) {
+        atomic_fetch_sub (&self->pending, 1);
+        return false;
+    }
+
+    atomic_fetch_add (&self->queued, 1);
+
+    pthread_mutex_lock (&self->lock);
+    pthread_cond_signal (&self->work);
+    pthread_mutex_unlock (&self->lock);
+
+    return true;
+}
+
+
+void
+clv_pool_wait (clv_pool_t *self) {
+    if (self == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock (&self->lock);
+
+    while (atomic_load (&self->pending) > 0) {
+        pthread_cond_wait (&self->done, &self->lock);
+    }
+
+    pthread_mutex_unlock (&self->lock);
+}
+
+
+unsigned
+clv_pool_threads (clv_pool_t *self) {
+    return (self != NULL) ? self->started : 0;
+}
+
+
+void
+clv_pool_free (clv_pool_t *self) {
+    if (self == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock (&self->lock);
+    self->shutdown = true;
+    pthread_cond_broadcast (&self->work);
+    pthread_mutex_unlock (&self->lock);
+
+    for (unsigned i = 0; i < self->started; i++) {
+        pthread_join (self->workers[i].thread, NULL);
+    }
+
+    for (unsigned i = 0; i < self->count; i++) {
+        deque_destroy (&self->workers[i].deque);
+    }
+
+    pthread_cond_destroy (&self->done);
+    pthread_cond_destroy (&self->work);
+    pthread_mutex_destroy (&self->lock);
+
+    clv_free (self->workers);
+    clv_free (self);
+}
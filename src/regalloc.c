@@ -0,0 +1,1958 @@
+#include <clover/regalloc.h>
+#include <clover/log.h>
+#include <clover/alloc.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#define POS_MAX             UINT32_MAX
+#define NO_REG              UINT8_MAX
+
+/* Liveness of a value in a block */
+#define LIVE_IN             0x1
+#define LIVE_OUT            0x2
+
+/* Words the checker finds in a location */
+#define WORD(v, w)          (2 * (v) + (w))
+#define WORD_UNKNOWN        UINT32_MAX
+
+#define CHECK_MAX_ERRORS    8
+
+
+/* Positions [start, end) a word is live at, shared by the pieces of its
+ * interval, which clip them */
+typedef struct {
+    uint32_t start;
+    uint32_t end;
+} range_t;
+
+
+typedef struct {
+    uint32_t start;
+    uint32_t end;
+    uint32_t range_first;
+    uint32_t range_end;
+    uint32_t use_first;         /* positions the word is read at */
+    uint32_t use_end;
+    uint32_t cursor;            /* first range not over at the scan position */
+
+    uint32_t value;
+    uint32_t parent;            /* first piece, holding the hints and slot */
+    uint32_t next;              /* piece after, or CLV_SSA_NONE */
+    clv_loc_t loc;
+
+    /* of first pieces */
+    uint32_t hint;              /* interval whose register to prefer, or CLV_SSA_NONE */
+    uint32_t slot;              /* or CLV_SSA_NONE */
+    uint32_t word_end;          /* end of the last range */
+    uint8_t hint_reg;
+
+    uint8_t word;
+    bool fixed;                 /* of a register, where calls and parameters need it */
+} interval_t;
+
+
+typedef struct {
+    uint32_t key;
+    uint32_t value;
+} heap_entry_t;
+
+
+typedef struct {
+    heap_entry_t *data;
+    uint32_t count;
+    uint32_t capacity;
+} heap_t;
+
+
+typedef struct {
+    uint32_t *items;
+    uint32_t count;
+    uint32_t capacity;
+} list_t;
+
+
+/* Moves made all at once, by location */
+typedef struct {
+    uint32_t *readers;          /* pending moves reading each location */
+    uint32_t *writer;           /* pending move writing each location */
+    uint32_t *work;
+    clv_move_t *pending;
+    uint32_t capacity;
+    uint32_t loc_count;
+} sequencer_t;
+
+
+/* Move to make at a position within a block */
+typedef struct {
+    uint32_t pos;
+    clv_move_t move;
+} split_move_t;
+
+
+struct clv_regalloc {
+    const clv_ssa_fn_t *ssa;
+    clv_regalloc_target_t target;
+
+    interval_t *intervals;
+    uint32_t interval_count;
+    uint32_t interval_capacity;
+    uint32_t *word_interval;    /* first piece of each word, or CLV_SSA_NONE */
+
+    range_t *ranges;
+    uint32_t range_count;
+    uint32_t range_capacity;
+
+    uint32_t *uses;
+    uint32_t use_count;
+    uint32_t use_capacity;
+
+    /* values live into each block, but for its phis */
+    uint32_t *live_first;
+    uint32_t *live;
+
+    /* scan */
+    heap_t unhandled;
+    list_t active;
+    list_t inactive;
+    heap_t busy_slots;          /* by the end of the word in each */
+    list_t free_slots;
+    uint32_t slot_count;
+
+    /* pieces of each word, in order */
+    uint32_t *piece_first;
+    uint32_t *pieces;
+
+    /* moves within blocks, by position, then on edges */
+    uint32_t *move_pos;
+    uint32_t *move_first;
+    uint32_t move_pos_count;
+    clv_move_t *moves;
+    uint32_t move_count;
+    uint32_t move_capacity;
+
+    uint32_t *edge_first;       /* 2 * block_count + 1 */
+    clv_move_t *edge_moves;
+    uint32_t edge_move_count;
+    uint32_t edge_move_capacity;
+
+    uint32_t used;
+    clv_regalloc_stats_t stats;
+    bool error;                 /* out of memory while scanning */
+};
+
+
+static bool
+reserve (void **data, uint32_t *capacity, uint32_t need, size_t size) {
+    if (need <= *capacity) {
+        return true;
+    }
+
+    uint32_t new_capacity = (*capacity == 0) ? 64 : *capacity * 2;
+
+    while (new_capacity < need) {
+        new_capacity *= 2;
+    }
+
+    void *temp = clv_realloc (CLV_TAG_REGALLOC, *data, new_capacity * size);
+
+    if (temp == NULL) {
+        return false;
+    }
+
+    *data = temp;
+    *capacity = new_capacity;
+
+    return true;
+}
+
+
+static inline uint32_t
+min_u32 (uint32_t a, uint32_t b) {
+    return (a < b) ? a : b;
+}
+
+
+static inline uint32_t
+max_u32 (uint32_t a, uint32_t b) {
+    return (a > b) ? a : b;
+}
+
+
+static int
+compare_u32 (const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+
+/* == Heaps and lists == */
+
+
+static inline bool
+heap_less (heap_entry_t a, heap_entry_t b) {
+    return a.key < b.key || (a.key == b.key && a.value < b.value);
+}
+
+
+static bool
+heap_push (heap_t *h, uint32_t key, uint32_t value) {
+    if (!reserve ((void **)&h->data, &h->capacity, h->count + 1, sizeof (*h->data))) {
+        return false;
+    }
+
+    heap_entry_t entry = { key, value };
+    uint32_t i = h->count++;
+
+    while (i > 0 && heap_less (entry, h->data[(i - 1) / 2])) {
+        h->data[i] = h->data[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+
+    h->data[i] = entry;
+
+    return true;
+}
+
+
+static heap_entry_t
+heap_pop (heap_t *h) {
+    heap_entry_t top = h->data[0];
+    heap_entry_t last = h->data[--h->count];
+    uint32_t i = 0;
+
+    for (;;) {
+        uint32_t child = 2 * i + 1;
+
+        if (child >= h->count) {
+            break;
+        }
+
+        if (child + 1 < h->count && heap_less (h->data[child + 1], h->data[child])) {
+            child++;
+        }
+
+        if (!heap_less (h->data[child], last)) {
+            break;
+        }
+
+        h->data[i] = h->data[child];
+        i = child;
+    }
+
+    if (h->count > 0) {
+        h->data[i] = last;
+    }
+
+    return top;
+}
+
+
+static inline bool
+list_add (list_t *l, uint32_t item) {
+    if (!reserve ((void **)&l->items, &l->capacity, l->count + 1, sizeof (*l->items))) {
+        return false;
+    }
+
+    l->items[l->count++] = item;
+
+    return true;
+}
+
+
+/* == Intervals == */
+
+
+static inline uint32_t
+range_start (const clv_regalloc_t *ra, const interval_t *it, uint32_t i) {
+    return max_u32 (ra->ranges[i].start, it->start);
+}
+
+
+static inline uint32_t
+range_end (const clv_regalloc_t *ra, const interval_t *it, uint32_t i) {
+    return min_u32 (ra->ranges[i].end, it->end);
+}
+
+
+/* First range of `it` from `from` on ending after `pos` */
+static uint32_t
+range_after (const clv_regalloc_t *ra, const interval_t *it, uint32_t from, uint32_t pos) {
+    uint32_t lo = from;
+    uint32_t hi = it->range_end;
+
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+
+        if (range_end (ra, it, mid) <= pos) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+
+/* First use of `it` from `pos` on */
+static uint32_t
+use_after (const clv_regalloc_t *ra, const interval_t *it, uint32_t pos) {
+    uint32_t lo = it->use_first;
+    uint32_t hi = it->use_end;
+
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+
+        if (ra->uses[mid] < pos) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+
+static inline uint32_t
+next_use (const clv_regalloc_t *ra, const interval_t *it, uint32_t pos) {
+    uint32_t i = use_after (ra, it, pos);
+
+    return (i < it->use_end) ? ra->uses[i] : POS_MAX;
+}
+
+
+/* Whether `it` is live at `pos`, which only ever grows while scanning */
+static bool
+covers (const clv_regalloc_t *ra, interval_t *it, uint32_t pos) {
+    while (it->cursor < it->range_end && range_end (ra, it, it->cursor) <= pos) {
+        it->cursor++;
+    }
+
+    return it->cursor < it->range_end && range_start (ra, it, it->cursor) <= pos;
+}
+
+
+/* First position both intervals are live at, from their cursors on */
+static uint32_t
+intersection (const clv_regalloc_t *ra, const interval_t *a, const interval_t *b) {
+    uint32_t i = a->cursor;
+    uint32_t j = b->cursor;
+
+    while (i < a->range_end && j < b->range_end) {
+        uint32_t a_start = range_start (ra, a, i);
+        uint32_t a_end = range_end (ra, a, i);
+        uint32_t b_start = range_start (ra, b, j);
+        uint32_t b_end = range_end (ra, b, j);
+
+        if (a_start < b_end && b_start < a_end) {
+            return max_u32 (a_start, b_start);
+        }
+
+        if (a_end <= b_start) {
+            i = range_after (ra, a, i + 1, b_start);
+        } else {
+            j = range_after (ra, b, j + 1, a_start);
+        }
+    }
+
+    return POS_MAX;
+}
+
+
+static uint32_t
+interval_add (clv_regalloc_t *ra, uint32_t value, uint8_t word, uint32_t range_first, uint32_t use_first) {
+    if (!reserve ((void **)&ra->intervals, &ra->interval_capacity, ra->interval_count + 1,
+                  sizeof (*ra->intervals))) {
+        return CLV_SSA_NONE;
+    }
+
+    uint32_t index = ra->interval_count++;
+
+    ra->intervals[index] = (interval_t){
+        .start = ra->ranges[range_first].start,
+        .end = ra->ranges[ra->range_count - 1].end,
+        .range_first = range_first,
+        .range_end = ra->range_count,
+        .use_first = use_first,
+        .use_end = ra->use_count,
+        .cursor = range_first,
+        .value = value,
+        .parent = index,
+        .next = CLV_SSA_NONE,
+        .loc = CLV_LOC_NONE,
+        .hint = CLV_SSA_NONE,
+        .slot = CLV_SSA_NONE,
+        .word_end = ra->ranges[ra->range_count - 1].end,
+        .hint_reg = NO_REG,
+        .word = word
+    };
+
+    return index;
+}
+
+
+/* Splits `index` at `pos`, strictly within it, and returns the piece from
+ * `pos` on, which starts later when `pos` is in a hole */
+static uint32_t
+interval_split (clv_regalloc_t *ra, uint32_t index, uint32_t pos) {
+    if (!reserve ((void **)&ra->intervals, &ra->interval_capacity, ra->interval_count + 1,
+                  sizeof (*ra->intervals))) {
+        return CLV_SSA_NONE;
+    }
+
+    interval_t *it = &ra->intervals[index];
+    uint32_t k = range_after (ra, it, it->range_first, pos);
+    uint32_t child = ra->interval_count++;
+    bool within = range_start (ra, it, k) < pos;
+
+    ra->intervals[child] = *it;
+
+    interval_t *c = &ra->intervals[child];
+
+    c->start = within ? pos : range_start (ra, it, k);
+    c->range_first = k;
+    c->cursor = k;
+    c->use_first = use_after (ra, it, pos);
+    c->loc = CLV_LOC_NONE;
+
+    it->range_end = within ? k + 1 : k;
+    it->end = within ? pos : range_end (ra, it, k - 1);
+    it->use_end = c->use_first;
+    it->next = child;
+
+    if (it->cursor > it->range_end) {
+        it->cursor = it->range_end;
+    }
+
+    ra->stats.splits++;
+
+    return child;
+}
+
+
+/* == Liveness == */
+
+
+typedef struct {
+    uint32_t *mark;             /* value the block was last touched for */
+    uint8_t *flags;
+    uint32_t *last;             /* end of the last use in the block */
+    uint32_t *touched;
+    uint32_t touched_count;
+    uint32_t *stack;
+
+    uint32_t *live_pairs;       /* block, value */
+    uint32_t live_count;
+    uint32_t live_capacity;
+} liveness_t;
+
+
+static inline uint32_t
+block_start (const clv_ssa_fn_t *ssa, uint32_t block) {
+    return CLV_REGALLOC_USE (ssa->blocks[block].first);
+}
+
+
+static inline uint32_t
+block_end (const clv_ssa_fn_t *ssa, uint32_t block) {
+    return CLV_REGALLOC_USE (ssa->blocks[block].first + ssa->blocks[block].count);
+}
+
+
+/* Position phis read their operand of the edge from `block` at */
+static inline uint32_t
+block_exit (const clv_ssa_fn_t *ssa, uint32_t block) {
+    return block_end (ssa, block) - 4;
+}
+
+
+static inline void
+live_touch (liveness_t *lv, uint32_t block, uint32_t value) {
+    if (lv->mark[block] != value) {
+        lv->mark[block] = value;
+        lv->flags[block] = 0;
+        lv->last[block] = 0;
+        lv->touched[lv->touched_count++] = block;
+    }
+}
+
+
+/* Makes `value` live into `block`, and so out of its predecessors, up to
+ * its definition in `def` */
+static void
+live_in (const clv_ssa_fn_t *ssa, liveness_t *lv, uint32_t block, uint32_t value, uint32_t def) {
+    uint32_t depth = 0;
+
+    if (lv->flags[block] & LIVE_IN) {
+        return;
+    }
+
+    lv->flags[block] |= LIVE_IN;
+    lv->stack[depth++] = block;
+
+    while (depth > 0) {
+        const clv_ssa_block_t *b = &ssa->blocks[lv->stack[--depth]];
+
+        for (uint32_t i = 0; i < b->pred_count; i++) {
+            uint32_t pred = ssa->preds[b->first_pred + i];
+
+            live_touch (lv, pred, value);
+            lv->flags[pred] |= LIVE_OUT;
+
+            if (pred != def && !(lv->flags[pred] & LIVE_IN)) {
+                lv->flags[pred] |= LIVE_IN;
+                lv->stack[depth++] = pred;
+            }
+        }
+    }
+}
+
+
+/* Walks from each use of `v` back to its definition, which dominates
+ * them, through the blocks `v` is live in, and gives its words intervals */
+static bool
+live_value (clv_regalloc_t *ra, liveness_t *lv, uint32_t v, uint32_t words) {
+    const clv_ssa_fn_t *ssa = ra->ssa;
+    const clv_ssa_insn_t *insn = &ssa->insns[v];
+    uint32_t def = insn->block;
+    uint32_t def_pos = (insn->op == CLV_SSA_PHI) ? block_start (ssa, def) : CLV_REGALLOC_DEF (v);
+    uint32_t use_first = ra->use_count;
+
+    lv->touched_count = 0;
+
+    for (uint32_t u = ssa->use_first[v]; u < ssa->use_first[v + 1]; u++) {
+        uint32_t user = ssa->uses[u];
+        const clv_ssa_insn_t *use = &ssa->insns[user];
+        const clv_ssa_block_t *b = &ssa->blocks[use->block];
+
+        // users reading `v` twice are listed twice
+        if (u > ssa->use_first[v] && user == ssa->uses[u - 1]) {
+            continue;
+        }
+
+        if (!reserve ((void **)&ra->uses, &ra->use_capacity, ra->use_count + b->pred_count + 1,
+                      sizeof (*ra->uses))) {
+            return false;
+        }
+
+        if (use->op != CLV_SSA_PHI) {
+            live_touch (lv, use->block, v);
+            lv->last[use->block] = max_u32 (lv->last[use->block], CLV_REGALLOC_USE (user) + 1);
+            ra->uses[ra->use_count++] = CLV_REGALLOC_USE (user);
+
+            if (use->block != def) {
+                live_in (ssa, lv, use->block, v, def);
+            }
+
+            continue;
+        }
+
+        // phis read on the edge from each predecessor passing `v`
+        for (uint32_t i = 0; i < b->pred_count; i++) {
+            uint32_t pred = ssa->preds[b->first_pred + i];
+
+            if (ssa->operands[use->args[0] + i] != v) {
+                continue;
+            }
+
+            live_touch (lv, pred, v);
+            lv->flags[pred] |= LIVE_OUT;
+            ra->uses[ra->use_count++] = block_exit (ssa, pred);
+
+            if (pred != def) {
+                live_in (ssa, lv, pred, v, def);
+            }
+        }
+    }
+
+    // values never read need no location
+    if (lv->touched_count == 0) {
+        return true;
+    }
+
+    if (!reserve ((void **)&ra->ranges, &ra->range_capacity, ra->range_count + lv->touched_count,
+                  sizeof (*ra->ranges))
+        || !reserve ((void **)&lv->live_pairs, &lv->live_capacity, lv->live_count + 2 * lv->touched_count,
+                     sizeof (*lv->live_pairs))) {
+        return false;
+    }
+
+    // blocks are laid out in order
+    qsort (lv->touched, lv->touched_count, sizeof (*lv->touched), compare_u32);
+    qsort (&ra->uses[use_first], ra->use_count - use_first, sizeof (*ra->uses), compare_u32);
+
+    uint32_t range_first = ra->range_count;
+
+    for (uint32_t i = 0; i < lv->touched_count; i++) {
+        uint32_t block = lv->touched[i];
+        uint32_t start = (block == def) ? def_pos : block_start (ssa, block);
+        uint32_t end = (lv->flags[block] & LIVE_OUT) ? block_end (ssa, block) : lv->last[block];
+
+        if (block != def) {
+            lv->live_pairs[lv->live_count++] = block;
+            lv->live_pairs[lv->live_count++] = v;
+        }
+
+        if (ra->range_count > range_first && ra->ranges[ra->range_count - 1].end == start) {
+            ra->ranges[ra->range_count - 1].end = end;
+        } else {
+            ra->ranges[ra->range_count++] = (range_t){ start, end };
+        }
+    }
+
+    for (uint8_t w = 0; w < CLV_REGALLOC_WORDS; w++) {
+        if (!(words & (1u << w))) {
+            continue;
+        }
+
+        uint32_t index = interval_add (ra, v, w, range_first, use_first);
+
+        if (index == CLV_SSA_NONE) {
+            return false;
+        }
+
+        ra->word_interval[WORD (v, w)] = index;
+        ra->stats.intervals++;
+
+        // parameters arrive in registers
+        if (insn->op != CLV_SSA_PARAM || insn->args[0] >= ra->target.arg_count) {
+            continue;
+        }
+
+        uint8_t reg = ra->target.arg_regs[insn->args[0]][w];
+
+        if (reg < CLV_REGALLOC_MAX_REGS && (ra->target.allocatable & (1u << reg))) {
+            ra->intervals[index].hint_reg = reg;
+        }
+    }
+
+    return true;
+}
+
+
+static bool
+build_intervals (clv_regalloc_t *ra) {
+    const clv_ssa_fn_t *ssa = ra->ssa;
+    uint32_t blocks = ssa->block_count;
+    liveness_t lv = {
+        .mark = clv_alloc (CLV_TAG_REGALLOC, (blocks + 1) * sizeof (*lv.mark)),
+        .flags = clv_alloc (CLV_TAG_REGALLOC, blocks + 1),
+        .last = clv_alloc (CLV_TAG_REGALLOC, (blocks + 1) * sizeof (*lv.last)),
+        .touched = clv_alloc (CLV_TAG_REGALLOC, (blocks + 1) * sizeof (*lv.touched)),
+        .stack = clv_alloc (CLV_TAG_REGALLOC, (blocks + 1) * sizeof (*lv.stack))
+    };
+
+    ra->word_interval = clv_alloc (CLV_TAG_REGALLOC, (2 * ssa->count + 1) * sizeof (*ra->word_interval));
+
+    bool good = ra->word_interval != NULL && lv.mark != NULL && lv.flags != NULL && lv.last != NULL
+        && lv.touched != NULL && lv.stack != NULL;
+
+    if (good) {
+        memset (ra->word_interval, 0xff, (2 * ssa->count + 1) * sizeof (*ra->word_interval));
+        memset (lv.mark, 0xff, (blocks + 1) * sizeof (*lv.mark));
+    }
+
+    for (uint32_t v = 0; good && v < ssa->count; v++) {
+        uint32_t words = ra->target.words (ssa, v, ra->target.data) & ((1u << CLV_REGALLOC_WORDS) - 1);
+
+        good = words == 0 || live_value (ra, &lv, v, words);
+    }
+
+    // values live into each block, counted at b + 2, summed into starts at
+    // b + 1, which filling moves back to b
+    good = good && (ra->live_first = clv_calloc (CLV_TAG_REGALLOC, blocks + 2, sizeof (*ra->live_first))) != NULL
+        && (ra->live = clv_alloc (CLV_TAG_REGALLOC, (lv.live_count / 2 + 1) * sizeof (*ra->live))) != NULL;
+
+    if (good) {
+        for (uint32_t i = 0; i < lv.live_count; i += 2) {
+            ra->live_first[lv.live_pairs[i] + 2]++;
+        }
+
+        for (uint32_t b = 0; b < blocks; b++) {
+            ra->live_first[b + 2] += ra->live_first[b + 1];
+        }
+
+        for (uint32_t i = 0; i < lv.live_count; i += 2) {
+            ra->live[ra->live_first[lv.live_pairs[i] + 1]++] = lv.live_pairs[i + 1];
+        }
+    }
+
+    clv_free (lv.mark);
+    clv_free (lv.flags);
+    clv_free (lv.last);
+    clv_free (lv.touched);
+    clv_free (lv.stack);
+    clv_free (lv.live_pairs);
+
+    return good;
+}
+
+
+/* Intervals of the registers calls clobber, and parameters are passed in
+ * until read, keeping values out of them meanwhile */
+static bool
+build_fixed (clv_regalloc_t *ra) {
+    const clv_ssa_fn_t *ssa = ra->ssa;
+    const clv_regalloc_target_t *t = &ra->target;
+    uint32_t param_end[CLV_REGALLOC_MAX_REGS] = { 0 };
+    list_t calls = { 0 };
+    bool good = true;
+
+    for (uint32_t v = 0; good && v < ssa->count; v++) {
+        const clv_ssa_insn_t *insn = &ssa->insns[v];
+
+        if (insn->op == CLV_SSA_CALL) {
+            good = list_add (&calls, v);
+        } else if (insn->op == CLV_SSA_PARAM && insn->args[0] < t->arg_count) {
+            for (uint8_t w = 0; w < CLV_REGALLOC_WORDS; w++) {
+                uint8_t reg = t->arg_regs[insn->args[0]][w];
+
+                if (reg < CLV_REGALLOC_MAX_REGS) {
+                    param_end[reg] = max_u32 (param_end[reg], CLV_REGALLOC_USE (v) + 1);
+                }
+            }
+        }
+    }
+
+    for (uint32_t r = 0; good && r < CLV_REGALLOC_MAX_REGS; r++) {
+        bool clobbered = (t->caller_saved & (1u << r)) && calls.count > 0;
+
+        if (!(t->allocatable & (1u << r)) || (param_end[r] == 0 && !clobbered)) {
+            continue;
+        }
+
+        if (!reserve ((void **)&ra->ranges, &ra->range_capacity, ra->range_count + calls.count + 1,
+                      sizeof (*ra->ranges))) {
+            good = false;
+            break;
+        }
+
+        uint32_t first = ra->range_count;
+
+        if (param_end[r] > 0) {
+            ra->ranges[ra->range_count++] = (range_t){ 0, param_end[r] };
+        }
+
+        for (uint32_t i = 0; clobbered && i < calls.count; i++) {
+            uint32_t pos = CLV_REGALLOC_USE (calls.items[i]) + 1;
+
+            ra->ranges[ra->range_count++] = (range_t){ pos, pos + 1 };
+        }
+
+        uint32_t index = interval_add (ra, CLV_SSA_NONE, 0, first, ra->use_count);
+
+        if (index == CLV_SSA_NONE || !list_add (&ra->inactive, index)) {
+            good = false;
+            break;
+        }
+
+        ra->intervals[index].fixed = true;
+        ra->intervals[index].loc = r;
+    }
+
+    clv_free (calls.items);
+
+    return good;
+}
+
+
+/* Phis and their operands prefer the same register, so that edges have
+ * nothing to move, and arguments the registers they are passed in */
+static void
+build_hints (clv_regalloc_t *ra) {
+    const clv_ssa_fn_t *ssa = ra->ssa;
+    const clv_regalloc_target_t *t = &ra->target;
+
+    for (uint32_t v = 0; v < ssa->count; v++) {
+        const clv_ssa_insn_t *insn = &ssa->insns[v];
+        uint32_t count;
+        const uint32_t *operands = clv_ssa_operands (ssa, insn, &count);
+
+        for (uint8_t w = 0; w < CLV_REGALLOC_WORDS; w++) {
+            uint32_t phi = ra->word_interval[WORD (v, w)];
+
+            for (uint32_t i = 0; insn->op == CLV_SSA_PHI && phi != CLV_SSA_NONE && i < count; i++) {
+                uint32_t operand = (operands[i] != CLV_SSA_NONE) ? ra->word_interval[WORD (operands[i], w)]
+                                                                 : CLV_SSA_NONE;
+
+                if (operand == CLV_SSA_NONE) {
+                    continue;
+                }
+
+                interval_t *p = &ra->intervals[phi];
+                interval_t *o = &ra->intervals[operand];
+
+                if (p->hint == CLV_SSA_NONE) {
+                    p->hint = operand;
+                }
+
+                if (o->hint == CLV_SSA_NONE && o->hint_reg == NO_REG) {
+                    o->hint = phi;
+                }
+            }
+
+            // operands past the callee are arguments
+            for (uint32_t i = 1; insn->op == CLV_SSA_CALL && i < count && i - 1 < t->arg_count; i++) {
+                uint32_t operand = ra->word_interval[WORD (operands[i], w)];
+                uint8_t reg = t->arg_regs[i - 1][w];
+
+                if (operand == CLV_SSA_NONE || reg >= CLV_REGALLOC_MAX_REGS || !(t->allocatable & (1u << reg))) {
+                    continue;
+                }
+
+                interval_t *o = &ra->intervals[operand];
+
+                if (o->hint == CLV_SSA_NONE && o->hint_reg == NO_REG) {
+                    o->hint_reg = reg;
+                }
+            }
+        }
+    }
+}
+
+
+/* == Scanning == */
+
+
+static uint8_t
+hint_of (const clv_regalloc_t *ra, const interval_t *it) {
+    const interval_t *parent = &ra->intervals[it->parent];
+
+    if (parent->hint_reg != NO_REG) {
+        return parent->hint_reg;
+    }
+
+    if (parent->hint != CLV_SSA_NONE && ra->intervals[parent->hint].loc < CLV_REGALLOC_MAX_REGS) {
+        return ra->intervals[parent->hint].loc;
+    }
+
+    return NO_REG;
+}
+
+
+/* Retires intervals over by `pos`, and moves those in or out of a hole
+ * between the active and inactive lists */
+static bool
+scan_advance (clv_regalloc_t *ra, uint32_t pos) {
+    list_t *active = &ra->active;
+    list_t *inactive = &ra->inactive;
+    uint32_t inactive_count = inactive->count;
+    uint32_t kept = 0;
+
+    if (!reserve ((void **)&inactive->items, &inactive->capacity, inactive->count + active->count,
+                  sizeof (*inactive->items))
+        || !reserve ((void **)&active->items, &active->capacity, active->count + inactive->count,
+                     sizeof (*active->items))) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < active->count; i++) {
+        uint32_t index = active->items[i];
+        interval_t *it = &ra->intervals[index];
+
+        if (it->end <= pos) {
+            continue;
+        }
+
+        if (covers (ra, it, pos)) {
+            active->items[kept++] = index;
+        } else {
+            inactive->items[inactive->count++] = index;
+        }
+    }
+
+    active->count = kept;
+    kept = 0;
+
+    for (uint32_t i = 0; i < inactive->count; i++) {
+        uint32_t index = inactive->items[i];
+        interval_t *it = &ra->intervals[index];
+
+        if (i >= inactive_count) {
+            inactive->items[kept++] = index;
+        } else if (it->end <= pos) {
+            continue;
+        } else if (covers (ra, it, pos)) {
+            active->items[active->count++] = index;
+        } else {
+            inactive->items[kept++] = index;
+        }
+    }
+
+    inactive->count = kept;
+
+    return true;
+}
+
+
+/* Puts back the rest of an interval split at `pos`, or all of it when it
+ * doesn't start before */
+static void
+requeue (clv_regalloc_t *ra, uint32_t index, uint32_t pos) {
+    uint32_t rest = index;
+
+    if (pos > ra->intervals[index].start) {
+        rest = interval_split (ra, index, pos);
+    } else {
+        ra->intervals[index].loc = CLV_LOC_NONE;
+    }
+
+    if (rest == CLV_SSA_NONE || !heap_push (&ra->unhandled, ra->intervals[rest].start, rest)) {
+        ra->error = true;
+    }
+}
+
+
+/* Gives `cur` a register free for all of it, or for as long as one is,
+ * the rest going back to be allocated */
+static bool
+allocate_free (clv_regalloc_t *ra, uint32_t cur) {
+    const clv_regalloc_target_t *t = &ra->target;
+    uint32_t free_until[CLV_REGALLOC_MAX_REGS];
+    interval_t *it = &ra->intervals[cur];
+
+    for (uint32_t r = 0; r < CLV_REGALLOC_MAX_REGS; r++) {
+        free_until[r] = (t->allocatable & (1u << r)) ? POS_MAX : 0;
+    }
+
+    for (uint32_t i = 0; i < ra->active.count; i++) {
+        free_until[ra->intervals[ra->active.items[i]].loc] = 0;
+    }
+
+    for (uint32_t i = 0; i < ra->inactive.count; i++) {
+        const interval_t *x = &ra->intervals[ra->inactive.items[i]];
+
+        if (free_until[x->loc] > 0) {
+            free_until[x->loc] = min_u32 (free_until[x->loc], intersection (ra, x, it));
+        }
+    }
+
+    uint8_t hint = hint_of (ra, it);
+    uint8_t reg = NO_REG;
+
+    if (hint != NO_REG && free_until[hint] >= it->end) {
+        reg = hint;
+    }
+
+    // registers calls keep cost a save, those they clobber don't
+    for (uint8_t r = 0; reg == NO_REG && r < CLV_REGALLOC_MAX_REGS; r++) {
+        if (free_until[r] >= it->end && (t->caller_saved & (1u << r))) {
+            reg = r;
+        }
+    }
+
+    for (uint8_t r = 0; reg == NO_REG && r < CLV_REGALLOC_MAX_REGS; r++) {
+        if (free_until[r] >= it->end) {
+            reg = r;
+        }
+    }
+
+    // else the one free the longest, for part of `cur`
+    if (reg == NO_REG) {
+        for (uint8_t r = 0; r < CLV_REGALLOC_MAX_REGS; r++) {
+            if (free_until[r] > 0 && (reg == NO_REG || free_until[r] > free_until[reg])) {
+                reg = r;
+            }
+        }
+    }
+
+    if (reg == NO_REG || free_until[reg] <= it->start) {
+        return false;
+    }
+
+    if (free_until[reg] < it->end) {
+        uint32_t pos = free_until[reg] & ~1u;
+
+        if (pos <= it->start) {
+            return false;
+        }
+
+        requeue (ra, cur, pos);
+        it = &ra->intervals[cur];
+    }
+
+    it->loc = reg;
+
+    return true;
+}
+
+
+static void
+assign_slot (clv_regalloc_t *ra, uint32_t cur) {
+    uint32_t start = ra->intervals[cur].start;
+    uint32_t parent = ra->intervals[cur].parent;
+
+    if (ra->intervals[parent].slot == CLV_SSA_NONE) {
+        // slots of words over by now are free
+        while (ra->busy_slots.count > 0 && ra->busy_slots.data[0].key <= start) {
+            ra->free_slots.items[ra->free_slots.count++] = heap_pop (&ra->busy_slots).value;
+        }
+
+        uint32_t slot = (ra->free_slots.count > 0) ? ra->free_slots.items[--ra->free_slots.count]
+                                                   : ra->slot_count++;
+
+        if (!reserve ((void **)&ra->free_slots.items, &ra->free_slots.capacity, ra->slot_count,
+                      sizeof (*ra->free_slots.items))
+            || !heap_push (&ra->busy_slots, ra->intervals[parent].word_end, slot)) {
+            ra->error = true;
+            return;
+        }
+
+        ra->intervals[parent].slot = slot;
+    }
+
+    ra->intervals[cur].loc = CLV_LOC_SLOT (ra->intervals[parent].slot);
+    ra->stats.spills++;
+}
+
+
+/* Intervals having `reg` where `cur` needs it give it up from there */
+static void
+evict (clv_regalloc_t *ra, uint32_t cur, uint8_t reg) {
+    uint32_t pos = ra->intervals[cur].start;
+    uint32_t kept = 0;
+
+    for (uint32_t i = 0; i < ra->active.count; i++) {
+        uint32_t index = ra->active.items[i];
+        const interval_t *x = &ra->intervals[index];
+
+        if (x->fixed || x->loc != reg) {
+            ra->active.items[kept++] = index;
+        } else {
+            requeue (ra, index, pos);
+        }
+    }
+
+    ra->active.count = kept;
+    kept = 0;
+
+    for (uint32_t i = 0; i < ra->inactive.count; i++) {
+        uint32_t index = ra->inactive.items[i];
+        const interval_t *x = &ra->intervals[index];
+
+        if (x->fixed || x->loc != reg || intersection (ra, x, &ra->intervals[cur]) == POS_MAX) {
+            ra->inactive.items[kept++] = index;
+        } else {
+            requeue (ra, index, pos);
+        }
+    }
+
+    ra->inactive.count = kept;
+}
+
+
+/* Takes the register needed the furthest away for `cur`, unless `cur` is
+ * needed later still, in which case it goes to a slot until its next use */
+static void
+allocate_blocked (clv_regalloc_t *ra, uint32_t cur) {
+    const clv_regalloc_target_t *t = &ra->target;
+    uint32_t use_pos[CLV_REGALLOC_MAX_REGS];
+    uint32_t block_pos[CLV_REGALLOC_MAX_REGS];
+    interval_t *it = &ra->intervals[cur];
+
+    for (uint32_t r = 0; r < CLV_REGALLOC_MAX_REGS; r++) {
+        use_pos[r] = block_pos[r] = (t->allocatable & (1u << r)) ? POS_MAX : 0;
+    }
+
+    for (uint32_t i = 0; i < ra->active.count; i++) {
+        const interval_t *x = &ra->intervals[ra->active.items[i]];
+
+        if (x->fixed) {
+            use_pos[x->loc] = block_pos[x->loc] = 0;
+        } else {
+            use_pos[x->loc] = min_u32 (use_pos[x->loc], next_use (ra, x, it->start));
+        }
+    }
+
+    for (uint32_t i = 0; i < ra->inactive.count; i++) {
+        const interval_t *x = &ra->intervals[ra->inactive.items[i]];
+        uint32_t pos = intersection (ra, x, it);
+
+        if (pos == POS_MAX) {
+            continue;
+        }
+
+        if (x->fixed) {
+            block_pos[x->loc] = min_u32 (block_pos[x->loc], pos);
+            use_pos[x->loc] = min_u32 (use_pos[x->loc], pos);
+        } else {
+            use_pos[x->loc] = min_u32 (use_pos[x->loc], next_use (ra, x, it->start));
+        }
+    }
+
+    uint8_t reg = NO_REG;
+
+    for (uint8_t r = 0; r < CLV_REGALLOC_MAX_REGS; r++) {
+        if ((t->allocatable & (1u << r)) && (reg == NO_REG || use_pos[r] > use_pos[reg])) {
+            reg = r;
+        }
+    }
+
+    if (reg == NO_REG || use_pos[reg] <= next_use (ra, it, it->start) || (block_pos[reg] & ~1u) <= it->start) {
+        uint32_t next = next_use (ra, it, it->start + 1);
+
+        if (next != POS_MAX && (next & ~1u) > it->start) {
+            requeue (ra, cur, next & ~1u);
+        }
+
+        assign_slot (ra, cur);
+        return;
+    }
+
+    if (block_pos[reg] < it->end) {
+        requeue (ra, cur, block_pos[reg] & ~1u);
+    }
+
+    ra->intervals[cur].loc = reg;
+    evict (ra, cur, reg);
+}
+
+
+static bool
+scan (clv_regalloc_t *ra) {
+    for (uint32_t w = 0; w < 2 * ra->ssa->count; w++) {
+        uint32_t index = ra->word_interval[w];
+
+        if (index != CLV_SSA_NONE && !heap_push (&ra->unhandled, ra->intervals[index].start, index)) {
+            return false;
+        }
+    }
+
+    while (ra->unhandled.count > 0 && !ra->error) {
+        uint32_t cur = heap_pop (&ra->unhandled).value;
+
+        if (!scan_advance (ra, ra->intervals[cur].start)) {
+            return false;
+        }
+
+        if (!allocate_free (ra, cur)) {
+            allocate_blocked (ra, cur);
+        }
+
+        if (ra->intervals[cur].loc < CLV_REGALLOC_MAX_REGS && !list_add (&ra->active, cur)) {
+            return false;
+        }
+    }
+
+    return !ra->error;
+}
+
+
+/* == Moves == */
+
+
+static bool
+sequencer_init (sequencer_t *sq, uint32_t loc_count) {
+    *sq = (sequencer_t){
+        .readers = clv_calloc (CLV_TAG_REGALLOC, loc_count + 1, sizeof (*sq->readers)),
+        .writer = clv_alloc (CLV_TAG_REGALLOC, (loc_count + 1) * sizeof (*sq->writer)),
+        .loc_count = loc_count
+    };
+
+    if (sq->readers == NULL || sq->writer == NULL) {
+        return false;
+    }
+
+    memset (sq->writer, 0xff, (loc_count + 1) * sizeof (*sq->writer));
+
+    return true;
+}
+
+
+static void
+sequencer_free (sequencer_t *sq) {
+    clv_free (sq->readers);
+    clv_free (sq->writer);
+    clv_free (sq->work);
+    clv_free (sq->pending);
+}
+
+
+/* Moves each location read before it's overwritten, parking one location
+ * of each cycle in the temp, and returns how many moves it takes, or
+ * UINT32_MAX when out of memory */
+static uint32_t
+sequence (sequencer_t *sq, const clv_move_t *moves, uint32_t count, clv_move_t *out) {
+    uint32_t capacity = sq->capacity;
+
+    if (!reserve ((void **)&sq->pending, &capacity, count, sizeof (*sq->pending))
+        || !reserve ((void **)&sq->work, &sq->capacity, count, sizeof (*sq->work))) {
+        return UINT32_MAX;
+    }
+
+    clv_move_t *pending = sq->pending;
+    uint32_t n = 0;
+    uint32_t top = 0;
+    uint32_t done = 0;
+    uint32_t length = 0;
+    uint32_t scan = 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (moves[i].src != moves[i].dst) {
+            pending[n++] = moves[i];
+        }
+    }
+
+    for (uint32_t i = 0; i < n; i++) {
+        if (pending[i].src < sq->loc_count) {
+            sq->readers[pending[i].src]++;
+        }
+
+        sq->writer[pending[i].dst] = i;
+    }
+
+    for (uint32_t i = 0; i < n; i++) {
+        if (sq->readers[pending[i].dst] == 0) {
+            sq->work[top++] = i;
+        }
+    }
+
+    while (done < n) {
+        while (top > 0) {
+            clv_move_t m = pending[sq->work[--top]];
+
+            out[length++] = m;
+            sq->writer[m.dst] = CLV_SSA_NONE;
+            done++;
+
+            if (m.src < sq->loc_count && --sq->readers[m.src] == 0 && sq->writer[m.src] != CLV_SSA_NONE) {
+                sq->work[top++] = sq->writer[m.src];
+            }
+        }
+
+        if (done == n) {
+            break;
+        }
+
+        // all that's left are cycles
+        while (sq->writer[pending[scan].dst] != scan) {
+            scan++;
+        }
+
+        clv_loc_t loc = pending[scan].dst;
+        bool parked = false;
+
+        for (uint32_t i = 0; i < n; i++) {
+            if (sq->writer[pending[i].dst] == i && pending[i].src == loc) {
+                if (!parked) {
+                    out[length++] = (clv_move_t){
+                        .dst = CLV_LOC_TEMP,
+                        .src = loc,
+                        .value = pending[i].value,
+                        .word = pending[i].word
+                    };
+                    parked = true;
+                }
+
+                pending[i].src = CLV_LOC_TEMP;
+            }
+        }
+
+        sq->readers[loc] = 0;
+        sq->work[top++] = scan;
+    }
+
+    return length;
+}
+
+
+static bool
+add_moves (sequencer_t *sq, const clv_move_t *moves, uint32_t count, clv_move_t **data, uint32_t *length,
+           uint32_t *capacity) {
+    if (!reserve ((void **)data, capacity, *length + 2 * count, sizeof (**data))) {
+        return false;
+    }
+
+    uint32_t added = sequence (sq, moves, count, *data + *length);
+
+    if (added == UINT32_MAX) {
+        return false;
+    }
+
+    *length += added;
+
+    return true;
+}
+
+
+static clv_loc_t
+loc_at (const clv_regalloc_t *ra, uint32_t word, uint32_t pos) {
+    uint32_t lo = ra->piece_first[word];
+    uint32_t hi = ra->piece_first[word + 1];
+
+    // last piece starting by `pos`
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+
+        if (ra->intervals[ra->pieces[mid]].start <= pos) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return (lo > ra->piece_first[word]) ? ra->intervals[ra->pieces[lo - 1]].loc : CLV_LOC_NONE;
+}
+
+
+static inline bool
+has_loc (const clv_regalloc_t *ra, uint32_t word) {
+    return ra->piece_first[word] < ra->piece_first[word + 1];
+}
+
+
+static inline bool
+is_block_start (const clv_ssa_fn_t *ssa, uint32_t pos) {
+    return pos % 4 == 0 && pos / 4 < ssa->count && ssa->blocks[ssa->insns[pos / 4].block].first == pos / 4;
+}
+
+
+static int
+compare_split_moves (const void *a, const void *b) {
+    const split_move_t *x = a;
+    const split_move_t *y = b;
+
+    return (x->pos > y->pos) - (x->pos < y->pos);
+}
+
+
+/* Lists the pieces of each word in order */
+static bool
+build_pieces (clv_regalloc_t *ra) {
+    uint32_t words = 2 * ra->ssa->count;
+    uint32_t count = 0;
+
+    ra->piece_first = clv_alloc (CLV_TAG_REGALLOC, (words + 1) * sizeof (*ra->piece_first));
+    ra->pieces = clv_alloc (CLV_TAG_REGALLOC, (ra->interval_count + 1) * sizeof (*ra->pieces));
+
+    if (ra->piece_first == NULL || ra->pieces == NULL) {
+        return false;
+    }
+
+    for (uint32_t w = 0; w < words; w++) {
+        ra->piece_first[w] = count;
+
+        for (uint32_t i = ra->word_interval[w]; i != CLV_SSA_NONE; i = ra->intervals[i].next) {
+            ra->pieces[count++] = i;
+
+            if (ra->intervals[i].loc < CLV_REGALLOC_MAX_REGS) {
+                ra->used |= 1u << ra->intervals[i].loc;
+            }
+        }
+    }
+
+    ra->piece_first[words] = count;
+
+    return true;
+}
+
+
+/* Moves between pieces of intervals split within blocks, all those at a
+ * position made at once */
+static bool
+resolve_splits (clv_regalloc_t *ra, sequencer_t *sq) {
+    const clv_ssa_fn_t *ssa = ra->ssa;
+    split_move_t *splits = NULL;
+    uint32_t count = 0;
+    uint32_t capacity = 0;
+    clv_move_t *group = NULL;
+    uint32_t group_capacity = 0;
+    bool good = true;
+
+    for (uint32_t w = 0; good && w < 2 * ssa->count; w++) {
+        for (uint32_t i = ra->piece_first[w]; i + 1 < ra->piece_first[w + 1]; i++) {
+            const interval_t *a = &ra->intervals[ra->pieces[i]];
+            const interval_t *b = &ra->intervals[ra->pieces[i + 1]];
+
+            // pieces starting blocks are moved to on edges
+            if (a->end != b->start || a->loc == b->loc || is_block_start (ssa, b->start)) {
+                continue;
+            }
+
+            if (!reserve ((void **)&splits, &capacity, count + 1, sizeof (*splits))) {
+                good = false;
+                break;
+            }
+
+            splits[count++] = (split_move_t){
+                .pos = b->start,
+                .move = { .dst = b->loc, .src = a->loc, .value = a->value, .word = a->word }
+            };
+        }
+    }
+
+    if (good && count > 0) {
+        qsort (splits, count, sizeof (*splits), compare_split_moves);
+    }
+
+    good = good && (ra->move_pos = clv_alloc (CLV_TAG_REGALLOC, (count + 1) * sizeof (*ra->move_pos))) != NULL
+        && (ra->move_first = clv_alloc (CLV_TAG_REGALLOC, (count + 2) * sizeof (*ra->move_first))) != NULL;
+
+    for (uint32_t i = 0; good && i < count;) {
+        uint32_t j = i;
+
+        while (j < count && splits[j].pos == splits[i].pos) {
+            j++;
+        }
+
+        if (!reserve ((void **)&group, &group_capacity, j - i, sizeof (*group))) {
+            good = false;
+            break;
+        }
+
+        for (uint32_t k = i; k < j; k++) {
+            group[k - i] = splits[k].move;
+        }
+
+        ra->move_pos[ra->move_pos_count] = splits[i].pos;
+        ra->move_first[ra->move_pos_count++] = ra->move_count;
+        good = add_moves (sq, group, j - i, &ra->moves, &ra->move_count, &ra->move_capacity);
+        i = j;
+    }
+
+    if (good) {
+        ra->move_first[ra->move_pos_count] = ra->move_count;
+    }
+
+    clv_free (splits);
+    clv_free (group);
+
+    return good;
+}
+
+
+/* Moves on each edge, of values live across it to where the successor has
+ * them, and of the operands of its phis */
+static bool
+resolve_edges (clv_regalloc_t *ra, sequencer_t *sq) {
+    const clv_ssa_fn_t *ssa = ra->ssa;
+    clv_move_t *moves = NULL;
+    uint32_t capacity = 0;
+
+    ra->edge_first = clv_alloc (CLV_TAG_REGALLOC, (2 * ssa->block_count + 1) * sizeof (*ra->edge_first));
+
+    bool good = ra->edge_first != NULL;
+
+    for (uint32_t from = 0; good && from < ssa->block_count; from++) {
+        uint32_t leaving = block_end (ssa, from) - 1;
+
+        for (uint32_t s = 0; good && s < 2; s++) {
+            uint32_t to = ssa->blocks[from].succ[s];
+            uint32_t count = 0;
+
+            ra->edge_first[2 * from + s] = ra->edge_move_count;
+
+            if (to == CLV_SSA_NONE) {
+                continue;
+            }
+
+            const clv_ssa_block_t *b = &ssa->blocks[to];
+            uint32_t entry = block_start (ssa, to);
+            uint32_t pred = 0;
+
+            while (ssa->preds[b->first_pred + pred] != from) {
+                pred++;
+            }
+
+            for (uint32_t i = ra->live_first[to]; good && i < ra->live_first[to + 1]; i++) {
+                uint32_t v = ra->live[i];
+
+                if (!reserve ((void **)&moves, &capacity, count + CLV_REGALLOC_WORDS, sizeof (*moves))) {
+                    good = false;
+                    break;
+                }
+
+                // words never split are where they were
+                for (uint8_t w = 0; w < CLV_REGALLOC_WORDS; w++) {
+                    if (ra->piece_first[WORD (v, w) + 1] - ra->piece_first[WORD (v, w)] > 1) {
+                        moves[count++] = (clv_move_t){
+                            .dst = loc_at (ra, WORD (v, w), entry),
+                            .src = loc_at (ra, WORD (v, w), leaving),
+                            .value = v,
+                            .word = w
+                        };
+                    }
+                }
+            }
+
+            for (uint32_t phi = b->first; good && phi < b->first + b->count; phi++) {
+                const clv_ssa_insn_t *insn = &ssa->insns[phi];
+
+                if (insn->op != CLV_SSA_PHI) {
+                    break;
+                }
+
+                uint32_t operand = ssa->operands[insn->args[0] + pred];
+
+                if (operand == CLV_SSA_NONE) {
+                    continue;
+                }
+
+                if (!reserve ((void **)&moves, &capacity, count + CLV_REGALLOC_WORDS, sizeof (*moves))) {
+                    good = false;
+                    break;
+                }
+
+                for (uint8_t w = 0; w < CLV_REGALLOC_WORDS; w++) {
+                    if (has_loc (ra, WORD (phi, w))) {
+                        moves[count++] = (clv_move_t){
+                            .dst = loc_at (ra, WORD (phi, w), entry),
+                            .src = has_loc (ra, WORD (operand, w)) ? loc_at (ra, WORD (operand, w), leaving)
+                                                                   : CLV_LOC_NONE,
+                            .value = operand,
+                            .word = w
+                        };
+                    }
+                }
+            }
+
+            good = good && add_moves (sq, moves, count, &ra->edge_moves, &ra->edge_move_count,
+                                      &ra->edge_move_capacity);
+        }
+    }
+
+    if (good) {
+        ra->edge_first[2 * ssa->block_count] = ra->edge_move_count;
+    }
+
+    clv_free (moves);
+
+    return good;
+}
+
+
+static bool
+resolve (clv_regalloc_t *ra) {
+    sequencer_t sq;
+    bool good = sequencer_init (&sq, CLV_REGALLOC_MAX_REGS + ra->slot_count) && build_pieces (ra)
+        && resolve_splits (ra, &sq) && resolve_edges (ra, &sq);
+
+    sequencer_free (&sq);
+
+    ra->stats.slots = ra->slot_count;
+    ra->stats.moves = ra->move_count + ra->edge_move_count;
+
+    return good;
+}
+
+
+/* == Checking == */
+
+
+typedef struct {
+    const clv_regalloc_t *ra;
+    uint32_t loc_count;         /* registers, slots, then the temp */
+    uint32_t *state;            /* word each location holds */
+    uint32_t positions;         /* with moves, visited */
+    uint32_t errors;
+    bool report;
+} checker_t;
+
+
+static inline uint32_t
+check_index (const checker_t *c, clv_loc_t loc) {
+    return (loc == CLV_LOC_TEMP) ? c->loc_count - 1 : loc;
+}
+
+
+static void
+check_error (checker_t *c, uint32_t pos, clv_str what, uint32_t word, clv_loc_t loc) {
+    char where[32];
+    char found[32] = "nothing known";
+
+    if (!c->report || c->errors++ >= CHECK_MAX_ERRORS) {
+        return;
+    }
+
+    if (loc == CLV_LOC_NONE) {
+        snprintf (where, sizeof (where), "no location");
+    } else if (loc == CLV_LOC_TEMP) {
+        snprintf (where, sizeof (where), "the temp");
+    } else if (CLV_LOC_IS_SLOT (loc)) {
+        snprintf (where, sizeof (where), "slot %u", CLV_LOC_SLOT_OF (loc));
+    } else {
+        snprintf (where, sizeof (where), "register %u", loc);
+    }
+
+    if (loc != CLV_LOC_NONE && c->state[check_index (c, loc)] != WORD_UNKNOWN) {
+        uint32_t held = c->state[check_index (c, loc)];
+
+        snprintf (found, sizeof (found), "v%u.%u", held / 2, held % 2);
+    }
+
+    clv_error ("%s: register allocation: at %u, %s v%u.%u in %s, holding %s",
+               (c->ra->ssa->source->name != NULL) ? c->ra->ssa->source->name : "<main>", pos, what, word / 2,
+               word % 2, where, found);
+}
+
+
+static void
+check_moves (checker_t *c, const clv_move_t *moves, uint32_t count, uint32_t pos) {
+    for (uint32_t i = 0; i < count; i++) {
+        const clv_move_t *m = &moves[i];
+        uint32_t word = WORD (m->value, m->word);
+
+        if (m->src != CLV_LOC_NONE && c->state[check_index (c, m->src)] != word) {
+            check_error (c, pos, "move of", word, m->src);
+        }
+
+        c->state[check_index (c, m->dst)] = word;
+    }
+}
+
+
+static void
+check_block (checker_t *c, uint32_t block) {
+    const clv_regalloc_t *ra = c->ra;
+    const clv_ssa_fn_t *ssa = ra->ssa;
+    const clv_ssa_block_t *b = &ssa->blocks[block];
+
+    for (uint32_t v = b->first; v < b->first + b->count; v++) {
+        const clv_ssa_insn_t *insn = &ssa->insns[v];
+        uint32_t count;
+        const clv_move_t *moves = clv_regalloc_moves (ra, CLV_REGALLOC_USE (v), &count);
+
+        c->positions += count > 0;
+        check_moves (c, moves, count, CLV_REGALLOC_USE (v));
+
+        // phis are read on edges
+        const uint32_t *operands = clv_ssa_operands (ssa, insn, &count);
+
+        for (uint32_t i = 0; insn->op != CLV_SSA_PHI && i < count; i++) {
+            for (uint8_t w = 0; operands[i] != CLV_SSA_NONE && w < CLV_REGALLOC_WORDS; w++) {
+                uint32_t word = WORD (operands[i], w);
+                clv_loc_t loc;
+
+                if (!has_loc (ra, word)) {
+                    continue;
+                }
+
+                loc = loc_at (ra, word, CLV_REGALLOC_USE (v));
+
+                if (loc == CLV_LOC_NONE || c->state[check_index (c, loc)] != word) {
+                    check_error (c, CLV_REGALLOC_USE (v), "read of", word, loc);
+                }
+            }
+        }
+
+        if (insn->op == CLV_SSA_CALL) {
+            for (uint32_t r = 0; r < CLV_REGALLOC_MAX_REGS; r++) {
+                if (ra->target.caller_saved & (1u << r)) {
+                    c->state[r] = WORD_UNKNOWN;
+                }
+            }
+
+            c->state[c->loc_count - 1] = WORD_UNKNOWN;
+        }
+
+        moves = clv_regalloc_moves (ra, CLV_REGALLOC_DEF (v), &count);
+        c->positions += count > 0;
+        check_moves (c, moves, count, CLV_REGALLOC_DEF (v));
+
+        for (uint8_t w = 0; w < CLV_REGALLOC_WORDS; w++) {
+            clv_loc_t loc = has_loc (ra, WORD (v, w)) ? loc_at (ra, WORD (v, w), CLV_REGALLOC_DEF (v)) : CLV_LOC_NONE;
+
+            if (insn->op != CLV_SSA_PHI && loc != CLV_LOC_NONE) {
+                c->state[check_index (c, loc)] = WORD (v, w);
+            }
+        }
+    }
+}
+
+
+/* Takes `state`, at the end of `from`, along the edge to its successor #`s`,
+ * where the phis get their operands */
+static void
+check_edge (checker_t *c, uint32_t from, uint32_t s) {
+    const clv_regalloc_t *ra = c->ra;
+    const clv_ssa_fn_t *ssa = ra->ssa;
+    const clv_ssa_block_t *b = &ssa->blocks[ssa->blocks[from].succ[s]];
+    uint32_t entry = CLV_REGALLOC_USE (b->first);
+    uint32_t pred = 0;
+    uint32_t count;
+    const clv_move_t *moves = clv_regalloc_edge (ra, from, s, &count);
+
+    check_moves (c, moves, count, entry);
+
+    while (ssa->preds[b->first_pred + pred] != from) {
+        pred++;
+    }
+
+    for (uint32_t pass = 0; pass < 2; pass++) {
+        for (uint32_t phi = b->first; phi < b->first + b->count && ssa->insns[phi].op == CLV_SSA_PHI; phi++) {
+            uint32_t operand = ssa->operands[ssa->insns[phi].args[0] + pred];
+
+            for (uint8_t w = 0; operand != CLV_SSA_NONE && w < CLV_REGALLOC_WORDS; w++) {
+                clv_loc_t loc;
+
+                if (!has_loc (ra, WORD (phi, w))) {
+                    continue;
+                }
+
+                loc = loc_at (ra, WORD (phi, w), entry);
+
+                // all operands are checked before any phi is set
+                if (pass == 1) {
+                    c->state[check_index (c, loc)] = WORD (phi, w);
+                } else if (c->state[check_index (c, loc)] != WORD (operand, w)) {
+                    check_error (c, entry, "phi operand", WORD (operand, w), loc);
+                }
+            }
+        }
+    }
+}
+
+
+/* Runs block `block` from its state on entry, leaving what it holds on exit
+ * in `out` */
+static void
+check_through (checker_t *c, const uint32_t *states, uint32_t block, uint32_t *out) {
+    c->state = out;
+    memcpy (out, &states[(size_t)block * c->loc_count], c->loc_count * sizeof (*out));
+    check_block (c, block);
+}
+
+
+bool
+clv_regalloc_check (const clv_regalloc_t *self) {
+    const clv_ssa_fn_t *ssa = self->ssa;
+    uint32_t blocks = ssa->block_count;
+    uint32_t locs = CLV_REGALLOC_MAX_REGS + self->slot_count + 1;
+    checker_t c = { .ra = self, .loc_count = locs };
+    uint32_t *states = clv_alloc (CLV_TAG_REGALLOC, (size_t)blocks * locs * sizeof (*states));
+    uint32_t *leaving = clv_alloc (CLV_TAG_REGALLOC, locs * sizeof (*leaving));
+    uint32_t *edge = clv_alloc (CLV_TAG_REGALLOC, locs * sizeof (*edge));
+    uint32_t *work = clv_alloc (CLV_TAG_REGALLOC, (blocks + 1) * sizeof (*work));
+    bool *queued = clv_calloc (CLV_TAG_REGALLOC, blocks + 1, sizeof (*queued));
+    bool *reached = clv_calloc (CLV_TAG_REGALLOC, blocks + 1, sizeof (*reached));
+    uint32_t top = 0;
+    bool good = states != NULL && leaving != NULL && edge != NULL && work != NULL && queued != NULL
+        && reached != NULL;
+
+    if (good) {
+        memset (states, 0xff, locs * sizeof (*states));
+        reached[0] = queued[0] = true;
+        work[top++] = 0;
+    }
+
+    // what each location holds on entry to each block, merged to unknown
+    // where predecessors differ
+    while (top > 0) {
+        uint32_t block = work[--top];
+
+        queued[block] = false;
+        check_through (&c, states, block, leaving);
+
+        for (uint32_t s = 0; s < 2 && ssa->blocks[block].succ[s] != CLV_SSA_NONE; s++) {
+            uint32_t to = ssa->blocks[block].succ[s];
+            uint32_t *state = &states[(size_t)to * locs];
+            bool changed = !reached[to];
+
+            c.state = edge;
+            memcpy (edge, leaving, locs * sizeof (*edge));
+            check_edge (&c, block, s);
+
+            for (uint32_t l = 0; l < locs; l++) {
+                if (!reached[to]) {
+                    state[l] = edge[l];
+                } else if (state[l] != edge[l] && state[l] != WORD_UNKNOWN) {
+                    state[l] = WORD_UNKNOWN;
+                    changed = true;
+                }
+            }
+
+            reached[to] = true;
+
+            if (changed && !queued[to]) {
+                queued[to] = true;
+                work[top++] = to;
+            }
+        }
+    }
+
+    // then once more, reporting
+    c.report = true;
+    c.positions = 0;
+
+    for (uint32_t block = 0; good && block < blocks; block++) {
+        if (!reached[block]) {
+            continue;
+        }
+
+        check_through (&c, states, block, leaving);
+
+        for (uint32_t s = 0; s < 2 && ssa->blocks[block].succ[s] != CLV_SSA_NONE; s++) {
+            c.state = edge;
+            memcpy (edge, leaving, locs * sizeof (*edge));
+            check_edge (&c, block, s);
+        }
+    }
+
+    if (good && c.positions != self->move_pos_count) {
+        clv_error ("%s: register allocation: moves at %u positions are never made",
+                   (ssa->source->name != NULL) ? ssa->source->name : "<main>", self->move_pos_count - c.positions);
+        c.errors++;
+    }
+
+    clv_free (states);
+    clv_free (leaving);
+    clv_free (edge);
+    clv_free (work);
+    clv_free (queued);
+    clv_free (reached);
+
+    if (!good) {
+        errno = ENOMEM;
+    }
+
+    return good && c.errors == 0;
+}
+
+
+/* == Allocating == */
+
+
+clv_regalloc_t *
+clv_regalloc_new (const clv_ssa_fn_t *ssa, const clv_regalloc_target_t *target) {
+    clv_regalloc_t *self = clv_calloc (CLV_TAG_REGALLOC, 1, sizeof (*self));
+
+    if (self == NULL) {
+        return NULL;
+    }
+
+    self->ssa = ssa;
+    self->target = *target;
+
+    bool good = build_intervals (self) && build_fixed (self);
+
+    if (good) {
+        build_hints (self);
+        good = scan (self) && resolve (self);
+    }
+
+    // only needed while scanning
+    clv_free (self->unhandled.data);
+    clv_free (self->active.items);
+    clv_free (self->inactive.items);
+    clv_free (self->busy_slots.data);
+    clv_free (self->free_slots.items);
+    self->unhandled = (heap_t){ 0 };
+    self->busy_slots = (heap_t){ 0 };
+    self->active = self->inactive = self->free_slots = (list_t){ 0 };
+
+    if (!good) {
+        clv_regalloc_free (self);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    return self;
+}
+
+
+clv_loc_t
+clv_regalloc_loc (const clv_regalloc_t *self, uint32_t value, clv_regalloc_word_t word, uint32_t pos) {
+    return loc_at (self, WORD (value, word), pos);
+}
+
+
+const clv_move_t *
+clv_regalloc_moves (const clv_regalloc_t *self, uint32_t pos, uint32_t *out_count) {
+    uint32_t lo = 0;
+    uint32_t hi = self->move_pos_count;
+
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+
+        if (self->move_pos[mid] < pos) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    if (lo == self->move_pos_count || self->move_pos[lo] != pos) {
+        *out_count = 0;
+        return self->moves;
+    }
+
+    *out_count = self->move_first[lo + 1] - self->move_first[lo];
+
+    return &self->moves[self->move_first[lo]];
+}
+
+
+const clv_move_t *
+clv_regalloc_edge (const clv_regalloc_t *self, uint32_t from, uint32_t succ, uint32_t *out_count) {
+    uint32_t edge = 2 * from + succ;
+
+    *out_count = self->edge_first[edge + 1] - self->edge_first[edge];
+
+    return &self->edge_moves[self->edge_first[edge]];
+}
+
+
+uint32_t
+clv_regalloc_used (const clv_regalloc_t *self) {
+    return self->used;
+}
+
+
+void
+clv_regalloc_stats (const clv_regalloc_t *self, clv_regalloc_stats_t *out_stats) {
+    *out_stats = self->stats;
+}
+
+
+bool
+clv_regalloc_sequence (const clv_move_t *moves, uint32_t count, clv_move_t *out_moves, uint32_t *out_count) {
+    uint32_t loc_count = 0;
+    sequencer_t sq;
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (moves[i].src < CLV_LOC_TEMP) {
+            loc_count = max_u32 (loc_count, moves[i].src + 1);
+        }
+
+        loc_count = max_u32 (loc_count, moves[i].dst + 1);
+    }
+
+    bool good = sequencer_init (&sq, loc_count) && (*out_count = sequence (&sq, moves, count, out_moves)) != UINT32_MAX;
+
+    sequencer_free (&sq);
+
+    if (!good) {
+        errno = ENOMEM;
+    }
+
+    return good;
+}
+
+
+void
+clv_regalloc_free (clv_regalloc_t *self) {
+    if (self == NULL) {
+        return;
+    }
+
+    clv_free (self->intervals);
+    clv_free (self->word_interval);
+    clv_free (self->ranges);
+    clv_free (self->uses);
+    clv_free (self->live_first);
+    clv_free (self->live);
+    clv_free (self->piece_first);
+    clv_free (self->pieces);
+    clv_free (self->move_pos);
+    clv_free (self->move_first);
+    clv_free (self->moves);
+    clv_free (self->edge_first);
+    clv_free (self->edge_moves);
+    clv_free (self);
+}
@@ -0,0 +1,187 @@
+#include <clover/runtime.h>
+
+#include <string.h>
+
+
+/* == io == */
+
+
+/* Writes `fmt`, replacing each {} with the next argument; {{ and }} stand
+ * for braces */
+static bool
+io_format (clv_vm_t *vm, clv_value_t *args, unsigned count) {
+    FILE *out = clv_vm_output (vm);
+
+    if (count == 0) {
+        return true;
+    }
+
+    if (args[0].type != CLV_TYPE_STRING) {
+        if (count > 1) {
+            return clv_vm_error (vm, "format must be a string, not %s", clv_type_name (args[0].type));
+        }
+
+        clv_vm_print (vm, &args[0], out);
+        return true;
+    }
+
+    clv_string_t *fmt = (clv_string_t *)args[0].as.object;
+    const char *p = fmt->data;
+    const char *end = fmt->data + fmt->length;
+    unsigned next = 1;
+
+    while (p < end) {
+        const char *brace = p;
+
+        while (brace < end && *brace != '{' && *brace != '}') {
+            brace++;
+        }
+
+        fwrite (p, 1, brace - p, out);
+
+        if (brace == end) {
+            break;
+        }
+
+        if (brace + 1 < end && brace[1] == brace[0]) {
+            fputc (brace[0], out);
+            p = brace + 2;
+            continue;
+        }
+
+        if (brace[0] == '}' || brace + 1 == end || brace[1] != '}') {
+            return clv_vm_error (vm, "invalid format string, use {{ and }} for braces");
+        }
+
+        if (next == count) {
+            return clv_vm_error (vm, "format expects more than %u arguments", count - 1);
+        }
+
+        clv_vm_print (vm, &args[next++], out);
+        p = brace + 2;
+    }
+
+    if (next < count) {
+        return clv_vm_error (vm, "format expects %u arguments, not %u", next - 1, count - 1);
+    }
+
+    return true;
+}
+
+
+static bool
+io_print (clv_vm_t *vm, clv_value_t *args, unsigned count, clv_value_t *out_result) {
+    (void)out_result;
+
+    return io_format (vm, args, count);
+}
+
+
+static bool
+io_println (clv_vm_t *vm, clv_value_t *args, unsigned count, clv_value_t *out_result) {
+    (void)out_result;
+
+    if (!io_format (vm, args, count)) {
+        return false;
+    }
+
+    fputc ('\n', clv_vm_output (vm));
+
+    return true;
+}
+
+
+/* == str == */
+
+
+static bool
+str_len (clv_vm_t *vm, clv_value_t *args, unsigned count, clv_value_t *out_result) {
+    (void)count;
+
+    if (args[0].type != CLV_TYPE_STRING) {
+        return clv_vm_error (vm, "expected a string, not %s", clv_type_name (args[0].type));
+    }
+
+    out_result->type = CLV_TYPE_INT;
+    out_result->as.i = ((clv_string_t *)args[0].as.object)->length;
+
+    return true;
+}
+
+
+static const clv_native_t natives[] = {
+    { "io",  "print",   -1, io_print },
+    { "io",  "println", -1, io_println },
+    { "str", "len",      1, str_len },
+};
+
+
+static inline bool
+name_equal (clv_str name, const char *data, size_t length) {
+    return strncmp (name, data, length) == 0 && name[length] == '\0';
+}
+
+
+int
+clv_native_find (const char *module, size_t module_length, const char *name, size_t name_length) {
+    for (size_t i = 0; i < CLV_LENGTH (natives); i++) {
+        if (name_equal (natives[i].module, module, module_length) && name_equal (natives[i].name, name, name_length)) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+
+bool
+clv_native_module_find (const char *module, size_t length) {
+    for (size_t i = 0; i < CLV_LENGTH (natives); i++) {
+        if (name_equal (natives[i].module, module, length)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+const clv_native_t *
+clv_native_get (uint32_t index) {
+    return (index < CLV_LENGTH (natives)) ? &natives[index] : NULL;
+}
+
+
+/* == UTF-8 == */
+
+
+size_t
+clv_utf8_encode (uint32_t c, char *out) {
+    if (c > 0x10ffff || (c >= 0xd800 && c <= 0xdfff)) {
+        c = 0xfffd;
+    }
+
+    if (c < 0x80) {
+        out[0] = c;
+        return 1;
+    }
+
+    if (c < 0x800) {
+        out[0] = 0xc0 | (c >> 6);
+        out[1] = 0x80 | (c & 0x3f);
+        return 2;
+    }
+
+    if (c < 0x10000) {
+        out[0] = 0xe0 | (c >> 12);
+        out[1] = 0x80 | ((c >> 6) & 0x3f);
+        out[2] = 0x80 | (c & 0x3f);
+        return 3;
+    }
+
+    out[0] = 0xf0 | (c >> 18);
+    out[1] = 0x80 | ((c >> 12) & 0x3f);
+    out[2] = 0x80 | ((c >> 6) & 0x3f);
+    out[3] = 0x80 | (c & 0x3f);
+    return 4;
+}
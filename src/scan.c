@@ -0,0 +1,224 @@
+#include <clover/scan.h>
+#include <clover/cpu.h>
+
+#include <errno.h>
+
+#if defined (__x86_64__) || defined (__i386__)
+#  include <immintrin.h>
+#  define SCAN_X86 1
+#endif
+
+
+typedef const char *(*scan_blank_fn_t)(const char *p);
+typedef const char *(*scan_any3_fn_t)(const char *p, char a, char b, char c);
+
+
+/* == Scalar == */
+
+
+static const char *
+scan_blank_scalar (const char *p) {
+    while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') {
+        p++;
+    }
+
+    return p;
+}
+
+
+static const char *
+scan_any3_scalar (const char *p, char a, char b, char c) {
+    while (*p != a && *p != b && *p != c) {
+        p++;
+    }
+
+    return p;
+}
+
+
+/* == SSE2 / AVX2 == */
+
+
+#if SCAN_X86
+
+__attribute__ ((target ("sse2")))
+static const char *
+scan_blank_sse2 (const char *p) {
+    const __m128i space = _mm_set1_epi8 (' ');
+    const __m128i tab = _mm_set1_epi8 ('\t');
+    const __m128i cr = _mm_set1_epi8 ('\r');
+    const __m128i lf = _mm_set1_epi8 ('\n');
+
+    for (;; p += 16) {
+        __m128i v = _mm_loadu_si128 ((const __m128i *)p);
+
+        __m128i nl = _mm_or_si128 (_mm_cmpeq_epi8 (v, cr), _mm_cmpeq_epi8 (v, lf));
+        __m128i blank = _mm_or_si128 (nl, _mm_or_si128 (_mm_cmpeq_epi8 (v, space), _mm_cmpeq_epi8 (v, tab)));
+
+        uint32_t stop = ~(uint32_t)_mm_movemask_epi8 (blank) & 0xffff;
+
+        if (stop != 0) {
+            return p + __builtin_ctz (stop);
+        }
+    }
+}
+
+
+__attribute__ ((target ("sse2")))
+static const char *
+scan_any3_sse2 (const char *p, char a, char b, char c) {
+    const __m128i va = _mm_set1_epi8 (a);
+    const __m128i vb = _mm_set1_epi8 (b);
+    const __m128i vc = _mm_set1_epi8 (c);
+
+    for (;; p += 16) {
+        __m128i v = _mm_loadu_si128 ((const __m128i *)p);
+
+        __m128i match = _mm_or_si128 (_mm_cmpeq_epi8 (v, va),
+                                      _mm_or_si128 (_mm_cmpeq_epi8 (v, vb), _mm_cmpeq_epi8 (v, vc)));
+
+        uint32_t mask = _mm_movemask_epi8 (match);
+
+        if (mask != 0) {
+            return p + __builtin_ctz (mask);
+        }
+    }
+}
+
+
+__attribute__ ((target ("avx2")))
+static const char *
+scan_blank_avx2 (const char *p) {
+    const __m256i space = _mm256_set1_epi8 (' ');
+    const __m256i tab = _mm256_set1_epi8 ('\t');
+    const __m256i cr = _mm256_set1_epi8 ('\r');
+    const __m256i lf = _mm256_set1_epi8 ('\n');
+
+    for (;; p += 32) {
+        __m256i v = _mm256_loadu_si256 ((const __m256i *)p);
+
+        __m256i nl = _mm256_or_si256 (_mm256_cmpeq_epi8 (v, cr), _mm256_cmpeq_epi8 (v, lf));
+        __m256i blank = _mm256_or_si256 (nl, _mm256_or_si256 (_mm256_cmpeq_epi8 (v, space),
+                                                              _mm256_cmpeq_epi8 (v, tab)));
+
+        uint32_t stop = ~(uint32_t)_mm256_movemask_epi8 (blank);
+
+        if (stop != 0) {
+            return p + __builtin_ctz (stop);
+        }
+    }
+}
+
+
+__attribute__ ((target ("avx2")))
+static const char *
+scan_any3_avx2 (const char *p, char a, char b, char c) {
+    const __m256i va = _mm256_set1_epi8 (a);
+    const __m256i vb = _mm256_set1_epi8 (b);
+    const __m256i vc = _mm256_set1_epi8 (c);
+
+    for (;; p += 32) {
+        __m256i v = _mm256_loadu_si256 ((const __m256i *)p);
+
+        __m256i match = _mm256_or_si256 (_mm256_cmpeq_epi8 (v, va),
+                                         _mm256_or_si256 (_mm256_cmpeq_epi8 (v, vb), _mm256_cmpeq_epi8 (v, vc)));
+
+        uint32_t mask = _mm256_movemask_epi8 (match);
+
+        if (mask != 0) {
+            return p + __builtin_ctz (mask);
+        }
+    }
+}
+
+#endif /* SCAN_X86 */
+
+
+/* == Dispatch == */
+
+
+static struct {
+    clv_scan_isa_t isa;
+    scan_blank_fn_t blank;
+    scan_any3_fn_t any3;
+} scan_impl = {
+    CLV_SCAN_SCALAR,
+    scan_blank_scalar,
+    scan_any3_scalar
+};
+
+
+__attribute__ ((constructor (102)))
+static void
+scan_detect () {
+    if (!clv_scan_set_isa (CLV_SCAN_AVX2)) {
+        clv_scan_set_isa (CLV_SCAN_SSE2);
+    }
+}
+
+
+const char *
+clv_scan_blank (const char *p) {
+    return scan_impl.blank (p);
+}
+
+
+const char *
+clv_scan_any3 (const char *p, char a, char b, char c) {
+    return scan_impl.any3 (p, a, b, c);
+}
+
+
+clv_scan_isa_t
+clv_scan_get_isa () {
+    return scan_impl.isa;
+}
+
+
+bool
+clv_scan_set_isa (clv_scan_isa_t isa) {
+    switch (isa) {
+    case CLV_SCAN_SCALAR:
+        scan_impl.blank = scan_blank_scalar;
+        scan_impl.any3 = scan_any3_scalar;
+        break;
+
+#if SCAN_X86
+    case CLV_SCAN_SSE2:
+        if (!clv_cpu_has (CLV_CPU_SSE2)) {
+            errno = ENOTSUP;
+            return false;
+        }
+
+        scan_impl.blank = scan_blank_sse2;
+        scan_impl.any3 = scan_any3_sse2;
+        break;
+
+    case CLV_SCAN_AVX2:
+        if (!clv_cpu_has (CLV_CPU_AVX2)) {
+            errno = ENOTSUP;
+            return false;
+        }
+
+        scan_impl.blank = scan_blank_avx2;
+        scan_impl.any3 = scan_any3_avx2;
+        break;
+#endif /* SCAN_X86 */
+
+    default:
+        errno = ENOTSUP;
+        return false;
+    }
+
+    scan_impl.isa = isa;
+
+    return true;
+}
+
+
+clv_str
+clv_scan_isa_name (clv_scan_isa_t isa) {
+    static const clv_str names[] = { "scalar", "sse2", "avx2" };
+
+    return CLV_GET_OR (names, isa, "???");
+}
@@ -0,0 +1,1676 @@
+#include <clover/sema.h>
+#include <clover/bytecode.h>
+#include <clover/runtime.h>
+#include <clover/intern.h>
+#include <clover/log.h>
+#include <clover/timer.h>
+#include <clover/assert.h>
+#include <clover/alloc.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+
+#define SEMA_MIN_CAPACITY       64
+
+#define SEMA_MAX_NAME           256     /* of qualified names built on the stack */
+
+/* Functions and globals checked by one task: enough to pay for the task,
+ * few enough that a unit of a few hundred functions keeps workers busy */
+#define SEMA_BATCH              32
+
+/* Static types are the types of values, or: */
+#define TYPE_ANY                0x7f    /* not known until run */
+#define TYPE_OPTION             0x80    /* flag, or nil */
+
+#define TYPE_BASE(t)            ((clv_type_t)((t) & ~TYPE_OPTION))
+
+/* Arguments of "%s%s" that name a known type */
+#define TYPE_ARGS(t)            ((t) & TYPE_OPTION) ? "?" : "", clv_type_name (TYPE_BASE (t))
+
+
+static const struct {
+    clv_str name;
+    uint8_t type;
+} builtin_types[] = {
+    { "bool",   CLV_TYPE_BOOL },
+    { "int",    CLV_TYPE_INT },
+    { "float",  CLV_TYPE_FLOAT },
+    { "char",   CLV_TYPE_CHAR },
+    { "string", CLV_TYPE_STRING },
+};
+
+#define SEMA_BUILTINS           CLV_LENGTH (builtin_types)
+
+
+/* Names defined at module level */
+typedef enum {
+    SYM_FN,
+    SYM_GLOBAL,
+    SYM_MODULE,
+    SYM_VARIANT,
+    SYM_TYPE,
+} symbol_kind_t;
+
+
+typedef struct {
+    clv_atom_t atom;        /* of the name, Type.name for methods and variants */
+
+    uint8_t kind;
+    uint8_t type;           /* of globals, and of what fns return */
+    bool is_const;
+    bool is_pub;
+
+    uint32_t token;
+    clv_node_id_t node;     /* of fns and globals */
+
+    uint32_t params;        /* of fns, index of the types of their params */
+    uint32_t arity;
+
+    uint32_t module;        /* of modules, 1 + their unit, or 0 if native */
+} symbol_t;
+
+
+typedef struct sema_unit {
+    clv_source_t *src;
+    clv_ast_t *ast;
+    clv_token_t *tokens;
+
+    clv_interface_t *iface;         /* declarations are read from, if not parsed */
+
+    const clv_atom_t *builtins;     /* atoms of the names of builtin types */
+
+    /* units of the build, and those of the import items, in order */
+    struct sema_unit *const *units;
+    const uint32_t *imports;
+    uint32_t import_count;
+
+    symbol_t *symbols;
+    uint32_t symbol_count;
+    uint32_t symbol_capacity;
+
+    /* open addressing, symbol index + 1 or 0 for free slots */
+    uint32_t *table;
+    uint32_t table_mask;
+
+    uint8_t *param_types;           /* within the interface, if any */
+    uint32_t param_count;
+    uint32_t param_capacity;
+
+    /* symbols of the fns with a body and globals, in source order */
+    uint32_t *items;
+    uint32_t item_count;
+
+    /* tasks checking the items, in order */
+    uint32_t first_task;
+    uint32_t task_count;
+
+    bool error;             /* in declarations, nothing is checked then */
+    bool skip;              /* known to be free of errors */
+} sema_unit_t;
+
+
+typedef struct {
+    sema_unit_t *unit;
+
+    uint32_t first;         /* of the items of the unit */
+    uint32_t count;
+
+    char *diagnostics;
+    size_t length;
+
+    bool error;
+} sema_task_t;
+
+
+struct clv_sema {
+    clv_atom_t builtins[SEMA_BUILTINS];
+
+    sema_unit_t **units;    /* NULL until declared */
+    uint32_t unit_count;
+
+    sema_task_t *tasks;
+    uint32_t task_count;
+};
+
+
+typedef struct {
+    clv_atom_t atom;
+    uint8_t type;
+    bool is_const;
+} local_t;
+
+
+/* State of checking one function, or the initializer of a global */
+typedef struct {
+    sema_unit_t *unit;
+
+    local_t *locals;
+    uint32_t local_count;
+    uint32_t local_capacity;
+
+    uint32_t loops;         /* around the statement, within the same defer */
+    uint32_t defers;        /* deferred statements being checked */
+    uint8_t result;         /* type the function returns */
+
+    bool error;
+} check_t;
+
+
+/* What a name or a path stands for */
+typedef struct {
+    enum { REF_VALUE, REF_SYMBOL, REF_NATIVE } kind;
+    uint8_t type;
+    bool is_const;
+
+    symbol_t *symbol;
+    sema_unit_t *unit;      /* the symbol is of */
+    int native;
+} ref_t;
+
+
+/* == Auxiliary Functions == */
+
+
+static void
+sema_verror (sema_unit_t *unit, uint32_t token, clv_str msg, va_list args) {
+    clv_log_record_t rec;
+
+    clv_location_t loc = { .line = 1, .column = 1 };
+
+    clv_source_locate (unit->src, unit->tokens[token].offset, &loc);
+
+    clv_str line = clv_source_offset (unit->src, loc.line_offset);
+
+    clv_log_begin (&rec, CLV_ERROR);
+    clv_log_printf (&rec, "%s:%u:%u: ", clv_source_get_file (unit->src), loc.line, loc.column);
+    clv_log_vprintf (&rec, msg, args);
+    clv_log_printf (&rec, "\n %3u | ", loc.line);
+    clv_log_append (&rec, line, strcspn (line, "\r\n"));
+    clv_log_append (&rec, "\n", 1);
+    clv_log_end (&rec);
+}
+
+
+static void
+declare_error (sema_unit_t *unit, uint32_t token, clv_str msg, ...) {
+    va_list args;
+
+    va_start (args, msg);
+    sema_verror (unit, token, msg, args);
+    va_end (args);
+
+    unit->error = true;
+}
+
+
+/* Units are shared by the tasks checking them, so errors are counted in
+ * the state of each check */
+static void
+check_error (check_t *c, uint32_t token, clv_str msg, ...) {
+    va_list args;
+
+    va_start (args, msg);
+    sema_verror (c->unit, token, msg, args);
+    va_end (args);
+
+    c->error = true;
+}
+
+
+static inline clv_node_t *
+node_at (sema_unit_t *unit, clv_node_id_t id) {
+    return clv_ast_node (unit->ast, id);
+}
+
+
+static inline const char *
+token_text (sema_unit_t *unit, uint32_t token) {
+    return clv_source_offset (unit->src, unit->tokens[token].offset);
+}
+
+
+/* Interns outer.name, or only looks it up unless `add` */
+static clv_atom_t
+intern_member (const char *outer, uint32_t outer_length, const char *name, uint32_t length, bool add) {
+    char buffer[SEMA_MAX_NAME];
+    size_t total = (size_t)outer_length + 1 + length;
+    char *qualified = (total <= sizeof (buffer)) ? buffer : clv_alloc (CLV_TAG_SEMA, total);
+
+    if (qualified == NULL) {
+        return CLV_ATOM_NONE;
+    }
+
+    memcpy (qualified, outer, outer_length);
+    qualified[outer_length] = '.';
+    memcpy (qualified + outer_length + 1, name, length);
+
+    clv_atom_t atom = add ? clv_intern (qualified, total) : clv_intern_find (qualified, total);
+
+    if (qualified != buffer) {
+        clv_free (qualified);
+    }
+
+    return atom;
+}
+
+
+/* == Types == */
+
+
+static uint8_t
+literal_type (clv_tktype_t type) {
+    switch (type) {
+    case CLV_TOKEN_INT:
+    case CLV_TOKEN_BIN:
+    case CLV_TOKEN_HEX:
+        return CLV_TYPE_INT;
+
+    case CLV_TOKEN_FLOAT:     return CLV_TYPE_FLOAT;
+    case CLV_TOKEN_STRING:    return CLV_TYPE_STRING;
+    case CLV_TOKEN_CHARACTER: return CLV_TYPE_CHAR;
+    case CLV_TOKEN_TRUE:
+    case CLV_TOKEN_FALSE:     return CLV_TYPE_BOOL;
+    default:                  return CLV_TYPE_NIL;
+    }
+}
+
+
+/* Whether values of type `src` may be stored where `dst` is expected.
+ * Options may be nil, and ints pass for floats, as arithmetic on them
+ * does. */
+static bool
+type_assignable (uint8_t dst, uint8_t src) {
+    if (dst == TYPE_ANY || src == TYPE_ANY || TYPE_BASE (dst) == TYPE_BASE (src)) {
+        return true;
+    }
+
+    if (src == CLV_TYPE_NIL) {
+        return (dst & TYPE_OPTION) != 0;
+    }
+
+    switch (TYPE_BASE (dst)) {
+    case CLV_TYPE_FLOAT: return TYPE_BASE (src) == CLV_TYPE_INT;
+    case CLV_TYPE_FN:    return TYPE_BASE (src) == CLV_TYPE_NATIVE;
+    default:             return false;
+    }
+}
+
+
+/* Type of the annotation `id`. Names of user types only tell the value
+ * is some struct or enum, which isn't tracked yet. On unknown names,
+ * `out_token` is set to the offending token. */
+static uint8_t
+type_annotation (sema_unit_t *unit, clv_node_id_t id, uint32_t *out_token);
+
+
+static symbol_t *symbol_find (sema_unit_t *unit, clv_atom_t atom);
+
+
+static uint8_t
+type_name (sema_unit_t *unit, clv_node_t *node, uint32_t *out_token) {
+    clv_token_t *tk = &unit->tokens[node->token];
+
+    for (size_t i = 0; i < SEMA_BUILTINS; i++) {
+        if (tk->atom == unit->builtins[i]) {
+            return builtin_types[i].type;
+        }
+    }
+
+    symbol_t *symbol = symbol_find (unit, tk->atom);
+
+    if (symbol == NULL || symbol->kind != SYM_TYPE) {
+        *out_token = node->token;
+    }
+
+    return TYPE_ANY;
+}
+
+
+static uint8_t
+type_annotation (sema_unit_t *unit, clv_node_id_t id, uint32_t *out_token) {
+    clv_node_t *node = node_at (unit, id);
+    uint8_t type;
+    uint32_t count;
+
+    switch (node->kind) {
+    case CLV_NODE_NAME:
+        return type_name (unit, node, out_token);
+
+    case CLV_NODE_TYPE_OPTION:
+        type = type_annotation (unit, node->lhs, out_token);
+        return (type == TYPE_ANY) ? TYPE_ANY : (type | TYPE_OPTION);
+
+    case CLV_NODE_TYPE_ARRAY:
+    case CLV_NODE_TYPE_REF:
+        type_annotation (unit, node->lhs, out_token);
+        return TYPE_ANY;
+
+    case CLV_NODE_TYPE_FN: {
+        const uint32_t *sig = clv_ast_extra (unit->ast, node->lhs);
+        const uint32_t *params = clv_ast_extra_list (unit->ast, node->lhs + CLV_SIG_PARAMS, &count);
+
+        if (sig[CLV_SIG_RESULT] != CLV_NODE_NONE) {
+            type_annotation (unit, sig[CLV_SIG_RESULT], out_token);
+        }
+
+        for (uint32_t i = 0; i < count; i++) {
+            type_annotation (unit, params[i], out_token);
+        }
+
+        return CLV_TYPE_FN;
+    }
+
+    default:
+        // typeof and paths into modules
+        return TYPE_ANY;
+    }
+}
+
+
+/* Result of a binary operator on known types, as the virtual machine
+ * computes it. Returns false for operands it rejects. */
+static bool
+type_binary (uint16_t op, uint8_t lhs, uint8_t rhs, uint8_t *out_type) {
+    bool ordering = (op == CLV_TOKEN_LT || op == CLV_TOKEN_LE || op == CLV_TOKEN_GT || op == CLV_TOKEN_GE);
+    bool numeric = (lhs == CLV_TYPE_INT || lhs == CLV_TYPE_FLOAT) && (rhs == CLV_TYPE_INT || rhs == CLV_TYPE_FLOAT);
+
+    if (lhs == CLV_TYPE_INT && rhs == CLV_TYPE_INT) {
+        *out_type = ordering ? CLV_TYPE_BOOL : CLV_TYPE_INT;
+        return true;
+    }
+
+    if (ordering && (numeric || (lhs == rhs && (lhs == CLV_TYPE_STRING || lhs == CLV_TYPE_CHAR)))) {
+        *out_type = CLV_TYPE_BOOL;
+        return true;
+    }
+
+    switch (op) {
+    case CLV_TOKEN_PLUS:
+        if (lhs == CLV_TYPE_STRING && rhs == CLV_TYPE_STRING) {
+            *out_type = CLV_TYPE_STRING;
+            return true;
+        }
+
+        // fall through
+    case CLV_TOKEN_MINUS:
+    case CLV_TOKEN_MULTIPLY:
+    case CLV_TOKEN_DIVIDE:
+    case CLV_TOKEN_REMAINDER:
+        *out_type = CLV_TYPE_FLOAT;
+        return numeric;
+
+    default:
+        return false;
+    }
+}
+
+
+/* Whether casts of `from` to `to` may succeed */
+static bool
+type_castable (uint8_t from, uint8_t to) {
+    if (from == to || to == CLV_TYPE_BOOL || to == CLV_TYPE_STRING) {
+        return true;
+    }
+
+    switch (to) {
+    case CLV_TYPE_INT:   return from == CLV_TYPE_FLOAT || from == CLV_TYPE_CHAR || from == CLV_TYPE_BOOL;
+    case CLV_TYPE_FLOAT:
+    case CLV_TYPE_CHAR:  return from == CLV_TYPE_INT;
+    default:             return false;
+    }
+}
+
+
+/* == Symbols == */
+
+
+/* Atoms are unique already, mixing their bits spares reading the string
+ * table on every lookup */
+#define SYMBOL_HASH(atom)       ((uint32_t)(atom) * 0x9e3779b1u)
+
+
+static symbol_t *
+symbol_find (sema_unit_t *unit, clv_atom_t atom) {
+    if (unit->table == NULL || atom == CLV_ATOM_NONE) {
+        return NULL;
+    }
+
+    for (uint32_t i = SYMBOL_HASH (atom);; i++) {
+        uint32_t slot = unit->table[i & unit->table_mask];
+
+        if (slot == 0) {
+            return NULL;
+        }
+
+        if (unit->symbols[slot - 1].atom == atom) {
+            return &unit->symbols[slot - 1];
+        }
+    }
+}
+
+
+static bool
+symbol_rehash (sema_unit_t *unit, uint32_t capacity) {
+    uint32_t *table = clv_calloc (CLV_TAG_SEMA, capacity, sizeof (*table));
+
+    if (table == NULL) {
+        return false;
+    }
+
+    clv_free (unit->table);
+
+    unit->table = table;
+    unit->table_mask = capacity - 1;
+
+    for (uint32_t i = 0; i < unit->symbol_count; i++) {
+        uint32_t slot = SYMBOL_HASH (unit->symbols[i].atom);
+
+        while (table[slot & unit->table_mask] != 0) {
+            slot++;
+        }
+
+        table[slot & unit->table_mask] = i + 1;
+    }
+
+    return true;
+}
+
+
+static symbol_t *
+symbol_add (sema_unit_t *unit, uint32_t token, clv_atom_t atom, symbol_kind_t kind, clv_node_id_t node) {
+    if (atom == CLV_ATOM_NONE) {
+        declare_error (unit, token, "unable to define symbol: %s", strerror (errno));
+        return NULL;
+    }
+
+    symbol_t *existing = symbol_find (unit, atom);
+
+    if (existing != NULL) {
+        clv_location_t loc = { .line = 0 };
+
+        clv_source_locate (unit->src, unit->tokens[existing->token].offset, &loc);
+        declare_error (unit, token, "'%s' is already defined at line %u", clv_atom_string (atom), loc.line);
+        return NULL;
+    }
+
+    if (unit->symbol_count == unit->symbol_capacity) {
+        uint32_t capacity = (unit->symbol_capacity == 0) ? SEMA_MIN_CAPACITY : unit->symbol_capacity * 2;
+        symbol_t *temp = clv_realloc (CLV_TAG_SEMA, unit->symbols, capacity * sizeof (*temp));
+
+        if (temp == NULL) {
+            declare_error (unit, token, "unable to define symbol: %s", strerror (errno));
+            return NULL;
+        }
+
+        unit->symbols = temp;
+        unit->symbol_capacity = capacity;
+    }
+
+    unit->symbols[unit->symbol_count++] = (symbol_t){
+        .atom = atom,
+        .kind = kind,
+        .type = TYPE_ANY,
+        .token = token,
+        .node = node
+    };
+
+    // at most half full
+    if (unit->symbol_count * 2 > unit->table_mask) {
+        if (!symbol_rehash (unit, (unit->table_mask + 1) * 2)) {
+            unit->symbol_count--;
+            declare_error (unit, token, "unable to define symbol: %s", strerror (errno));
+            return NULL;
+        }
+    } else {
+        uint32_t slot = SYMBOL_HASH (atom);
+
+        while (unit->table[slot & unit->table_mask] != 0) {
+            slot++;
+        }
+
+        unit->table[slot & unit->table_mask] = unit->symbol_count;
+    }
+
+    return &unit->symbols[unit->symbol_count - 1];
+}
+
+
+/* == Declarations == */
+
+
+static bool
+declare_variants (sema_unit_t *unit, clv_node_t *node) {
+    const char *name = token_text (unit, node->token);
+    uint32_t length = unit->tokens[node->token].length;
+    const uint32_t *variants = clv_ast_extra (unit->ast, node->lhs);
+
+    for (uint32_t i = 0; i < node->rhs; i++) {
+        clv_node_t *variant = node_at (unit, variants[i]);
+        clv_atom_t atom = intern_member (name, length, token_text (unit, variant->token),
+                                         unit->tokens[variant->token].length, true);
+        symbol_t *symbol = symbol_add (unit, variant->token, atom, SYM_VARIANT, variants[i]);
+
+        if (symbol == NULL) {
+            return false;
+        }
+
+        symbol->type = CLV_TYPE_INT;
+        symbol->is_const = true;
+    }
+
+    return true;
+}
+
+
+static bool
+declare_item (sema_unit_t *unit, clv_node_t *node, clv_node_id_t id) {
+    clv_atom_t atom = unit->tokens[node->token].atom;
+
+    switch (node->kind) {
+    case CLV_NODE_IMPORT: {
+        clv_node_t *path = clv_ast_import_path (unit->ast, node);
+        const char *name = token_text (unit, path->token);
+        uint32_t length = unit->tokens[path->token].length;
+        uint32_t module = (unit->imports != NULL) ? unit->imports[unit->import_count] : UINT32_MAX;
+
+        unit->import_count++;
+
+        if (module == UINT32_MAX && (path->kind != CLV_NODE_NAME || !clv_native_module_find (name, length))) {
+            declare_error (unit, path->token, "unknown module '%.*s'", (int)length, name);
+            return false;
+        }
+
+        symbol_t *symbol = symbol_add (unit, path->token, unit->tokens[path->token].atom, SYM_MODULE, id);
+
+        if (symbol != NULL) {
+            symbol->module = module + 1;
+        }
+
+        return symbol != NULL;
+    }
+
+    case CLV_NODE_FN: {
+        // methods are named Type.name
+        if (node->flags & CLV_NODE_F_METHOD) {
+            uint32_t type = node->token - 2;
+
+            atom = intern_member (token_text (unit, type), unit->tokens[type].length,
+                                  token_text (unit, node->token), unit->tokens[node->token].length, true);
+        }
+
+        symbol_t *symbol = symbol_add (unit, node->token, atom, SYM_FN, id);
+
+        if (symbol != NULL) {
+            symbol->is_pub = (node->flags & CLV_NODE_F_PUB) != 0;
+        }
+
+        return symbol != NULL;
+    }
+
+    case CLV_NODE_GLOBAL: {
+        symbol_t *symbol = symbol_add (unit, node->token, atom, SYM_GLOBAL, id);
+
+        if (symbol != NULL) {
+            symbol->is_const = (node->flags & CLV_NODE_F_CONST) != 0;
+        }
+
+        return symbol != NULL;
+    }
+
+    case CLV_NODE_ENUM:
+        return symbol_add (unit, node->token, atom, SYM_TYPE, id) != NULL && declare_variants (unit, node);
+
+    default:
+        // structs, traits and type aliases only name types for now
+        return symbol_add (unit, node->token, atom, SYM_TYPE, id) != NULL;
+    }
+}
+
+
+static uint8_t
+declare_type (sema_unit_t *unit, clv_node_id_t id) {
+    uint32_t token = UINT32_MAX;
+    uint8_t type = type_annotation (unit, id, &token);
+
+    if (token != UINT32_MAX) {
+        declare_error (unit, token, "unknown type '%.*s'", (int)unit->tokens[token].length, token_text (unit, token));
+    }
+
+    return type;
+}
+
+
+static bool
+declare_signature (sema_unit_t *unit, symbol_t *symbol) {
+    clv_node_t *node = node_at (unit, symbol->node);
+    const uint32_t *sig = clv_ast_extra (unit->ast, node->lhs);
+    uint32_t count;
+    const uint32_t *params = clv_ast_extra_list (unit->ast, node->lhs + CLV_SIG_PARAMS, &count);
+
+    if (unit->param_count + count > unit->param_capacity) {
+        uint32_t capacity = (unit->param_capacity == 0) ? SEMA_MIN_CAPACITY : unit->param_capacity;
+
+        while (capacity < unit->param_count + count) {
+            capacity *= 2;
+        }
+
+        uint8_t *temp = clv_realloc (CLV_TAG_SEMA, unit->param_types, capacity);
+
+        if (temp == NULL) {
+            declare_error (unit, node->token, "unable to declare function: %s", strerror (errno));
+            return false;
+        }
+
+        unit->param_types = temp;
+        unit->param_capacity = capacity;
+    }
+
+    symbol->params = unit->param_count;
+    symbol->arity = count;
+
+    for (uint32_t i = 0; i < count; i++) {
+        clv_node_t *param = node_at (unit, params[i]);
+
+        unit->param_types[unit->param_count++] = (param->lhs != CLV_NODE_NONE) ? declare_type (unit, param->lhs) : TYPE_ANY;
+    }
+
+    if (sig[CLV_SIG_RESULT] != CLV_NODE_NONE) {
+        symbol->type = declare_type (unit, sig[CLV_SIG_RESULT]);
+    }
+
+    return true;
+}
+
+
+/* Globals take the type they are declared with, and constants initialized
+ * with a literal the type of the literal */
+static void
+declare_global (sema_unit_t *unit, symbol_t *symbol) {
+    clv_node_t *node = node_at (unit, symbol->node);
+
+    if (node->lhs != CLV_NODE_NONE) {
+        symbol->type = declare_type (unit, node->lhs);
+    } else if (symbol->is_const && node_at (unit, node->rhs)->kind == CLV_NODE_LITERAL) {
+        symbol->type = literal_type (unit->tokens[node_at (unit, node->rhs)->token].type);
+    }
+}
+
+
+/* Types are resolved once every name is known, so items may be used
+ * before they are defined */
+static bool
+declare_types (sema_unit_t *unit) {
+    unit->items = clv_alloc (CLV_TAG_SEMA, unit->symbol_count * sizeof (*unit->items));
+
+    if (unit->items == NULL && unit->symbol_count > 0) {
+        clv_error ("unable to declare %s: %s", clv_source_get_file (unit->src), strerror (errno));
+        return false;
+    }
+
+    for (uint32_t i = 0; i < unit->symbol_count; i++) {
+        symbol_t *symbol = &unit->symbols[i];
+
+        if (symbol->kind == SYM_GLOBAL) {
+            declare_global (unit, symbol);
+            unit->items[unit->item_count++] = i;
+        } else if (symbol->kind == SYM_FN) {
+            if (!declare_signature (unit, symbol)) {
+                return false;
+            }
+
+            if (node_at (unit, symbol->node)->rhs != CLV_NODE_NONE) {
+                unit->items[unit->item_count++] = i;
+            }
+        }
+    }
+
+    return true;
+}
+
+
+/* == Names == */
+
+
+static bool
+local_push (check_t *c, uint32_t token, uint8_t type, bool is_const) {
+    if (c->local_count == c->local_capacity) {
+        uint32_t capacity = (c->local_capacity == 0) ? SEMA_MIN_CAPACITY : c->local_capacity * 2;
+        local_t *temp = clv_realloc (CLV_TAG_SEMA, c->locals, capacity * sizeof (*temp));
+
+        if (temp == NULL) {
+            check_error (c, token, "unable to declare variable: %s", strerror (errno));
+            return false;
+        }
+
+        c->locals = temp;
+        c->local_capacity = capacity;
+    }
+
+    c->locals[c->local_count++] = (local_t){
+        .atom = c->unit->tokens[token].atom,
+        .type = type,
+        .is_const = is_const
+    };
+
+    return true;
+}
+
+
+static local_t *
+local_find (check_t *c, clv_atom_t atom) {
+    for (uint32_t i = c->local_count; i-- > 0;) {
+        if (c->locals[i].atom == atom) {
+            return &c->locals[i];
+        }
+    }
+
+    return NULL;
+}
+
+
+static bool
+resolve_symbol (check_t *c, uint32_t token, symbol_t *symbol, ref_t *out_ref) {
+    switch (symbol->kind) {
+    case SYM_FN:
+        *out_ref = (ref_t){ .kind = REF_SYMBOL, .type = CLV_TYPE_FN, .is_const = true, .symbol = symbol, .unit = c->unit };
+        return true;
+
+    case SYM_GLOBAL:
+    case SYM_VARIANT:
+        *out_ref = (ref_t){
+            .kind = REF_SYMBOL,
+            .type = symbol->type,
+            .is_const = symbol->is_const,
+            .symbol = symbol,
+            .unit = c->unit
+        };
+
+        return true;
+
+    case SYM_MODULE:
+        check_error (c, token, "module '%s' is not a value", clv_atom_string (symbol->atom));
+        return false;
+
+    default:
+        check_error (c, token, "type '%s' is not a value", clv_atom_string (symbol->atom));
+        return false;
+    }
+}
+
+
+static uint8_t check_expr (check_t *c, clv_node_id_t id);
+
+
+/* Only public functions of other modules may be used, for now */
+static bool
+resolve_import (check_t *c, clv_node_t *node, sema_unit_t *module, clv_str module_name, ref_t *out_ref) {
+    const char *name = token_text (c->unit, node->token);
+    uint32_t length = c->unit->tokens[node->token].length;
+    symbol_t *member = symbol_find (module, c->unit->tokens[node->token].atom);
+
+    // modules read from their interface only know of their public functions,
+    // and are told apart from parsed ones by nothing
+    if (member == NULL || member->kind != SYM_FN || !member->is_pub) {
+        check_error (c, node->token, "module '%s' has no public function '%.*s'", module_name, (int)length, name);
+        return false;
+    }
+
+    *out_ref = (ref_t){ .kind = REF_SYMBOL, .type = CLV_TYPE_FN, .is_const = true, .symbol = member, .unit = module };
+
+    return true;
+}
+
+
+/* Types names, and paths of module members, variants and methods, as the
+ * locals or symbols they name. Members of values are typed any. */
+static bool
+resolve (check_t *c, clv_node_id_t id, ref_t *out_ref) {
+    sema_unit_t *unit = c->unit;
+    clv_node_t *node = node_at (unit, id);
+
+    const char *name = token_text (unit, node->token);
+    uint32_t length = unit->tokens[node->token].length;
+
+    if (node->kind == CLV_NODE_NAME) {
+        local_t *local = local_find (c, unit->tokens[node->token].atom);
+
+        if (local != NULL) {
+            *out_ref = (ref_t){ .kind = REF_VALUE, .type = local->type, .is_const = local->is_const };
+            return true;
+        }
+
+        symbol_t *symbol = symbol_find (unit, unit->tokens[node->token].atom);
+
+        if (symbol == NULL) {
+            check_error (c, node->token, "unknown name '%.*s'", (int)length, name);
+            return false;
+        }
+
+        return resolve_symbol (c, node->token, symbol, out_ref);
+    }
+
+    clv_node_t *outer = node_at (unit, node->lhs);
+    symbol_t *symbol = NULL;
+
+    if (outer->kind == CLV_NODE_NAME && local_find (c, unit->tokens[outer->token].atom) == NULL) {
+        if ((symbol = symbol_find (unit, unit->tokens[outer->token].atom)) == NULL) {
+            check_error (c, outer->token, "unknown name '%.*s'", (int)unit->tokens[outer->token].length,
+                         token_text (unit, outer->token));
+            return false;
+        }
+    }
+
+    // members of values are left to code generation
+    if (symbol == NULL || (symbol->kind != SYM_MODULE && symbol->kind != SYM_TYPE)) {
+        check_expr (c, node->lhs);
+        *out_ref = (ref_t){ .kind = REF_VALUE, .type = TYPE_ANY };
+        return true;
+    }
+
+    clv_str outer_name = clv_atom_string (symbol->atom);
+    uint32_t outer_length = clv_atom_length (symbol->atom);
+
+    if (symbol->kind == SYM_MODULE && symbol->module != 0) {
+        return resolve_import (c, node, unit->units[symbol->module - 1], outer_name, out_ref);
+    }
+
+    if (symbol->kind == SYM_MODULE) {
+        int native = clv_native_find (outer_name, outer_length, name, length);
+
+        if (native < 0) {
+            check_error (c, node->token, "module '%s' has no member '%.*s'", outer_name, (int)length, name);
+            return false;
+        }
+
+        *out_ref = (ref_t){ .kind = REF_NATIVE, .type = CLV_TYPE_NATIVE, .is_const = true, .native = native };
+        return true;
+    }
+
+    symbol_t *member = symbol_find (unit, intern_member (outer_name, outer_length, name, length, false));
+
+    if (member == NULL) {
+        check_error (c, node->token, "'%s' has no member '%.*s'", outer_name, (int)length, name);
+        return false;
+    }
+
+    return resolve_symbol (c, node->token, member, out_ref);
+}
+
+
+/* == Expressions == */
+
+
+static uint8_t
+check_binary (check_t *c, clv_node_t *node) {
+    uint8_t lhs = check_expr (c, node->lhs);
+    uint8_t rhs = check_expr (c, node->rhs);
+    uint8_t type;
+
+    switch (node->op) {
+    case CLV_TOKEN_AND:
+    case CLV_TOKEN_OR:
+        // either operand may be the result
+        return (lhs == rhs) ? lhs : TYPE_ANY;
+
+    case CLV_TOKEN_EQ:
+    case CLV_TOKEN_NE:
+        return CLV_TYPE_BOOL;
+
+    default:
+        break;
+    }
+
+    // options may hold anything but nil by now
+    if (lhs == TYPE_ANY || rhs == TYPE_ANY || ((lhs | rhs) & TYPE_OPTION)) {
+        return (node->op >= CLV_TOKEN_LT && node->op <= CLV_TOKEN_GE) ? CLV_TYPE_BOOL : TYPE_ANY;
+    }
+
+    if (!type_binary (node->op, lhs, rhs, &type)) {
+        check_error (c, node->token, "unsupported operands for %.*s: %s and %s", (int)c->unit->tokens[node->token].length,
+                     token_text (c->unit, node->token), clv_type_name (lhs), clv_type_name (rhs));
+        return TYPE_ANY;
+    }
+
+    return type;
+}
+
+
+static uint8_t
+check_unary (check_t *c, clv_node_t *node) {
+    uint8_t type = check_expr (c, node->lhs);
+
+    if (node->op == CLV_TOKEN_NOT) {
+        return CLV_TYPE_BOOL;
+    }
+
+    if (type == TYPE_ANY || (type & TYPE_OPTION)) {
+        return TYPE_ANY;
+    }
+
+    if (type == CLV_TYPE_INT || (type == CLV_TYPE_FLOAT && node->op == CLV_TOKEN_MINUS)) {
+        return type;
+    }
+
+    check_error (c, node->token, "unsupported operand for %s: %s", (node->op == CLV_TOKEN_MINUS) ? "-" : "~",
+                 clv_type_name (type));
+
+    return TYPE_ANY;
+}
+
+
+static uint8_t
+check_cast (check_t *c, clv_node_t *node) {
+    sema_unit_t *unit = c->unit;
+    clv_node_t *target = node_at (unit, node->rhs);
+    uint8_t from = check_expr (c, node->lhs);
+    uint32_t token = UINT32_MAX;
+    uint8_t to = (target->kind == CLV_NODE_NAME) ? type_name (unit, target, &token) : TYPE_ANY;
+
+    if (to == TYPE_ANY) {
+        check_error (c, target->token, "only casts to bool, int, float, char and string are supported");
+        return TYPE_ANY;
+    }
+
+    if (from != TYPE_ANY && !(from & TYPE_OPTION) && !type_castable (from, to)) {
+        check_error (c, node->token, "cannot cast %s to %s", clv_type_name (from), clv_type_name (to));
+    }
+
+    return to;
+}
+
+
+static uint8_t
+check_call (check_t *c, clv_node_t *node) {
+    sema_unit_t *unit = c->unit;
+    clv_node_t *callee = node_at (unit, node->lhs);
+    ref_t ref = { .kind = REF_VALUE, .type = TYPE_ANY };
+    bool resolved = true;
+    uint32_t count;
+
+    const uint32_t *args = clv_ast_extra_list (unit->ast, node->rhs, &count);
+
+    if (callee->kind == CLV_NODE_NAME || callee->kind == CLV_NODE_MEMBER) {
+        resolved = resolve (c, node->lhs, &ref);
+    } else {
+        ref.type = check_expr (c, node->lhs);
+    }
+
+    symbol_t *fn = (ref.kind == REF_SYMBOL && ref.symbol->kind == SYM_FN) ? ref.symbol : NULL;
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint8_t type = check_expr (c, args[i]);
+
+        if (fn != NULL && i < fn->arity && !type_assignable (ref.unit->param_types[fn->params + i], type)) {
+            uint8_t expected = ref.unit->param_types[fn->params + i];
+
+            check_error (c, node_at (unit, args[i])->token, "mismatched types: expected %s%s, found %s%s",
+                         TYPE_ARGS (expected), TYPE_ARGS (type));
+        }
+    }
+
+    if (!resolved) {
+        return TYPE_ANY;
+    }
+
+    if (fn != NULL) {
+        if (count != fn->arity) {
+            check_error (c, node->token, "'%s' expects %u arguments, not %u", clv_atom_string (fn->atom), fn->arity, count);
+        }
+
+        return fn->type;
+    }
+
+    if (ref.kind == REF_NATIVE) {
+        const clv_native_t *native = clv_native_get (ref.native);
+
+        if (native->arity >= 0 && count != (uint32_t)native->arity) {
+            check_error (c, node->token, "'%s.%s' expects %d arguments, not %u", native->module, native->name,
+                         native->arity, count);
+        }
+    } else if (ref.type != TYPE_ANY && !(ref.type & TYPE_OPTION) && ref.type != CLV_TYPE_FN) {
+        check_error (c, node->token, "%s is not callable", clv_type_name (ref.type));
+    }
+
+    return TYPE_ANY;
+}
+
+
+static uint8_t
+check_expr (check_t *c, clv_node_id_t id) {
+    clv_node_t *node = node_at (c->unit, id);
+    uint8_t type;
+    ref_t ref;
+
+    switch (node->kind) {
+    case CLV_NODE_LITERAL:
+        return literal_type (c->unit->tokens[node->token].type);
+
+    case CLV_NODE_NAME:
+    case CLV_NODE_MEMBER:
+        return resolve (c, id, &ref) ? ref.type : TYPE_ANY;
+
+    case CLV_NODE_BINARY:
+        return check_binary (c, node);
+
+    case CLV_NODE_UNARY:
+        return check_unary (c, node);
+
+    case CLV_NODE_CAST:
+        return check_cast (c, node);
+
+    case CLV_NODE_CALL:
+        return check_call (c, node);
+
+    case CLV_NODE_TYPEOF:
+        check_expr (c, node->lhs);
+        return CLV_TYPE_STRING;
+
+    case CLV_NODE_UNWRAP:
+        type = check_expr (c, node->lhs);
+        return (type == CLV_TYPE_NIL) ? TYPE_ANY : TYPE_BASE (type);
+
+    default:
+        // what isn't supported yet is reported by code generation
+        return TYPE_ANY;
+    }
+}
+
+
+/* Reports values of `type` where `expected` is */
+static void
+check_assignable (check_t *c, clv_node_id_t value, uint8_t expected, uint8_t type) {
+    if (!type_assignable (expected, type)) {
+        check_error (c, node_at (c->unit, value)->token, "mismatched types: expected %s%s, found %s%s",
+                     TYPE_ARGS (expected), TYPE_ARGS (type));
+    }
+}
+
+
+/* == Statements == */
+
+
+static void check_statement (check_t *c, clv_node_id_t id);
+
+
+static void
+check_block (check_t *c, clv_node_t *node) {
+    const uint32_t *stmts = clv_ast_extra (c->unit->ast, node->lhs);
+    uint32_t locals = c->local_count;
+
+    for (uint32_t i = 0; i < node->rhs; i++) {
+        check_statement (c, stmts[i]);
+    }
+
+    c->local_count = locals;
+}
+
+
+/* Variables have the type they are declared with, and constants the type
+ * of their value. Others may be given values of any type later. */
+static void
+check_let (check_t *c, clv_node_t *node) {
+    sema_unit_t *unit = c->unit;
+    bool is_const = (node->flags & CLV_NODE_F_CONST) != 0;
+    uint8_t declared = TYPE_ANY;
+    uint8_t value = CLV_TYPE_NIL;
+    uint32_t token = UINT32_MAX;
+
+    if (node->lhs != CLV_NODE_NONE) {
+        declared = type_annotation (unit, node->lhs, &token);
+
+        if (token != UINT32_MAX) {
+            check_error (c, token, "unknown type '%.*s'", (int)unit->tokens[token].length, token_text (unit, token));
+        }
+    }
+
+    // the value can't see the variable itself
+    if (node->rhs != CLV_NODE_NONE) {
+        value = check_expr (c, node->rhs);
+        check_assignable (c, node->rhs, declared, value);
+    }
+
+    local_push (c, node->token, (declared != TYPE_ANY || !is_const) ? declared : value, is_const);
+}
+
+
+static void
+check_assign (check_t *c, clv_node_t *node) {
+    sema_unit_t *unit = c->unit;
+    clv_node_t *target = node_at (unit, node->lhs);
+    uint8_t value = check_expr (c, node->rhs);
+    ref_t ref;
+
+    if (target->kind != CLV_NODE_NAME) {
+        check_error (c, target->token, "only variables can be assigned to");
+        return;
+    }
+
+    if (!resolve (c, node->lhs, &ref)) {
+        return;
+    }
+
+    if (ref.is_const) {
+        check_error (c, target->token, "cannot assign to constant '%.*s'", (int)unit->tokens[target->token].length,
+                     token_text (unit, target->token));
+        return;
+    }
+
+    check_assignable (c, node->rhs, ref.type, value);
+}
+
+
+static void
+check_for (check_t *c, clv_node_t *node) {
+    uint8_t type = check_expr (c, node->lhs);
+    uint32_t locals = c->local_count;
+
+    if (type != TYPE_ANY && !(type & TYPE_OPTION) && type != CLV_TYPE_INT && type != CLV_TYPE_STRING) {
+        check_error (c, node->token, "cannot iterate over %s", clv_type_name (type));
+    }
+
+    // counting loops count with ints
+    if (local_push (c, node->token, (type == CLV_TYPE_INT) ? CLV_TYPE_INT : TYPE_ANY, false)) {
+        c->loops++;
+        check_statement (c, node->rhs);
+        c->loops--;
+    }
+
+    c->local_count = locals;
+}
+
+
+static void
+check_match (check_t *c, clv_node_t *node) {
+    sema_unit_t *unit = c->unit;
+    uint32_t count;
+
+    check_expr (c, node->lhs);
+
+    const uint32_t *arms = clv_ast_extra_list (unit->ast, node->rhs, &count);
+
+    for (uint32_t i = 0; i < count; i++) {
+        clv_node_t *arm = node_at (unit, arms[i]);
+        clv_node_t *body = node_at (unit, arm->rhs);
+        uint32_t pattern_count;
+
+        const uint32_t *patterns = clv_ast_extra_list (unit->ast, arm->lhs, &pattern_count);
+
+        for (uint32_t j = 0; j < pattern_count; j++) {
+            check_expr (c, patterns[j]);
+        }
+
+        if (body->kind == CLV_NODE_BLOCK) {
+            check_block (c, body);
+        } else {
+            check_expr (c, arm->rhs);
+        }
+    }
+}
+
+
+static void
+check_statement (check_t *c, clv_node_id_t id) {
+    clv_node_t *node = node_at (c->unit, id);
+    uint32_t loops = c->loops;
+
+    switch (node->kind) {
+    case CLV_NODE_BLOCK:
+        check_block (c, node);
+        break;
+
+    case CLV_NODE_LET:
+        check_let (c, node);
+        break;
+
+    case CLV_NODE_ASSIGN:
+        check_assign (c, node);
+        break;
+
+    case CLV_NODE_IF: {
+        const uint32_t *branches = clv_ast_extra (c->unit->ast, node->rhs);
+
+        check_expr (c, node->lhs);
+        check_statement (c, branches[0]);
+
+        if (branches[1] != CLV_NODE_NONE) {
+            check_statement (c, branches[1]);
+        }
+
+        break;
+    }
+
+    case CLV_NODE_WHILE:
+        check_expr (c, node->lhs);
+        c->loops++;
+        check_statement (c, node->rhs);
+        c->loops--;
+        break;
+
+    case CLV_NODE_FOR:
+        check_for (c, node);
+        break;
+
+    case CLV_NODE_MATCH:
+        check_match (c, node);
+        break;
+
+    case CLV_NODE_RETURN:
+        if (c->defers > 0) {
+            check_error (c, node->token, "cannot return from a deferred statement");
+        } else if (node->lhs != CLV_NODE_NONE) {
+            check_assignable (c, node->lhs, c->result, check_expr (c, node->lhs));
+        }
+
+        break;
+
+    case CLV_NODE_BREAK:
+    case CLV_NODE_CONTINUE:
+        if (c->loops == 0) {
+            check_error (c, node->token, "'%s' outside of a loop", (node->kind == CLV_NODE_BREAK) ? "break" : "continue");
+        }
+
+        break;
+
+    case CLV_NODE_DEFER:
+        // deferred statements run where loops are left, not in them
+        c->loops = 0;
+        c->defers++;
+        check_statement (c, node->lhs);
+        c->defers--;
+        c->loops = loops;
+        break;
+
+    case CLV_NODE_EXPR:
+        check_expr (c, node->lhs);
+        break;
+
+    default:
+        break;
+    }
+}
+
+
+/* == Items == */
+
+
+static void
+check_fn (check_t *c, symbol_t *symbol) {
+    sema_unit_t *unit = c->unit;
+    clv_node_t *node = node_at (unit, symbol->node);
+    uint32_t count;
+
+    const uint32_t *params = clv_ast_extra_list (unit->ast, node->lhs + CLV_SIG_PARAMS, &count);
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (!local_push (c, node_at (unit, params[i])->token, unit->param_types[symbol->params + i], false)) {
+            return;
+        }
+    }
+
+    c->result = symbol->type;
+    check_block (c, node_at (unit, node->rhs));
+}
+
+
+static void
+check_global (check_t *c, symbol_t *symbol) {
+    clv_node_t *node = node_at (c->unit, symbol->node);
+
+    check_assignable (c, node->rhs, symbol->type, check_expr (c, node->rhs));
+}
+
+
+static void
+check_task (void *arg) {
+    sema_task_t *task = arg;
+    sema_unit_t *unit = task->unit;
+
+    clv_timer_begin (CLV_PHASE_CHECK, clv_source_get_file (unit->src));
+
+    FILE *err = open_memstream (&task->diagnostics, &task->length);
+
+    // without a buffer, diagnostics go straight to stderr
+    clv_log_capture (err, err);
+
+    check_t c = { .unit = unit };
+
+    for (uint32_t i = task->first; i < task->first + task->count; i++) {
+        symbol_t *symbol = &unit->symbols[unit->items[i]];
+
+        c.local_count = 0;
+        c.loops = 0;
+        c.defers = 0;
+        c.result = TYPE_ANY;
+
+        if (symbol->kind == SYM_FN) {
+            check_fn (&c, symbol);
+        } else {
+            check_global (&c, symbol);
+        }
+    }
+
+    clv_free (c.locals);
+
+    task->error = c.error;
+
+    clv_log_capture (NULL, NULL);
+
+    if (err != NULL) {
+        fclose (err);
+    }
+
+    clv_timer_end ();
+}
+
+
+/* == Analysis == */
+
+
+clv_sema_t *
+clv_sema_new (uint32_t units) {
+    clv_sema_t *self = clv_calloc (CLV_TAG_SEMA, 1, sizeof (*self));
+
+    if (self == NULL) {
+        return NULL;
+    }
+
+    self->unit_count = units;
+
+    if ((self->units = clv_calloc (CLV_TAG_SEMA, units, sizeof (*self->units))) == NULL && units > 0) {
+        clv_free (self);
+        return NULL;
+    }
+
+    // names are told apart by atom, sparing reads of the source
+    for (size_t i = 0; i < SEMA_BUILTINS; i++) {
+        clv_str name = builtin_types[i].name;
+
+        if ((self->builtins[i] = clv_intern (name, strlen (name))) == CLV_ATOM_NONE) {
+            clv_free (self->units);
+            clv_free (self);
+            return NULL;
+        }
+    }
+
+    return self;
+}
+
+
+bool
+clv_sema_declare (clv_sema_t *self, uint32_t unit, clv_source_t *src, clv_tokens_t *tokens, clv_ast_t *ast,
+                  const uint32_t *imports) {
+    clv_assert (unit < self->unit_count && self->units[unit] == NULL, return false);
+
+    sema_unit_t *u = clv_calloc (CLV_TAG_SEMA, 1, sizeof (*u));
+
+    if (u == NULL || !symbol_rehash (u, SEMA_MIN_CAPACITY)) {
+        clv_error ("unable to declare %s: %s", clv_source_get_file (src), strerror (errno));
+        clv_free (u);
+        return false;
+    }
+
+    u->src = src;
+    u->ast = ast;
+    u->tokens = clv_tokens_data (tokens);
+    u->builtins = self->builtins;
+    u->units = self->units;
+    u->imports = imports;
+
+    clv_node_t *root = clv_ast_node (ast, clv_ast_get_root (ast));
+    const uint32_t *items = clv_ast_extra (ast, root->lhs);
+
+    for (uint32_t i = 0; i < root->rhs; i++) {
+        declare_item (u, node_at (u, items[i]), items[i]);
+    }
+
+    if (!declare_types (u)) {
+        u->error = true;
+    }
+
+    // units importing this one may be declared as soon as it's published
+    self->units[unit] = u;
+
+    return !u->error;
+}
+
+
+bool
+clv_sema_declare_interface (clv_sema_t *self, uint32_t unit, clv_interface_t *iface) {
+    clv_assert (unit < self->unit_count && self->units[unit] == NULL, return false);
+
+    sema_unit_t *u = clv_calloc (CLV_TAG_SEMA, 1, sizeof (*u));
+    uint32_t count = clv_interface_export_count (iface);
+    uint32_t capacity = SEMA_MIN_CAPACITY;
+
+    // at most half full
+    while (capacity < count * 2) {
+        capacity *= 2;
+    }
+
+    if (u == NULL || !symbol_rehash (u, capacity)
+        || ((u->symbols = clv_alloc (CLV_TAG_SEMA, count * sizeof (*u->symbols))) == NULL && count > 0)) {
+        clv_error ("unable to declare interface: %s", strerror (errno));
+
+        if (u != NULL) {
+            clv_free (u->table);
+            clv_free (u);
+        }
+
+        return false;
+    }
+
+    u->iface = iface;
+    u->builtins = self->builtins;
+    u->units = self->units;
+    u->symbol_capacity = count;
+    u->skip = true;
+
+    // params of all exports are laid out in order, from those of the first
+    if (count > 0) {
+        u->param_types = (uint8_t *)clv_interface_export (iface, 0).params;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        clv_export_t e = clv_interface_export (iface, i);
+        clv_atom_t atom = clv_intern (e.name, e.length);
+
+        if (atom == CLV_ATOM_NONE) {
+            clv_error ("unable to declare interface: %s", strerror (errno));
+            u->error = true;
+            break;
+        }
+
+        u->symbols[u->symbol_count++] = (symbol_t){
+            .atom = atom,
+            .kind = SYM_FN,
+            .type = e.result,
+            .is_const = true,
+            .is_pub = true,
+            .params = e.params - u->param_types,
+            .arity = e.arity
+        };
+
+        uint32_t slot = SYMBOL_HASH (atom);
+
+        while (u->table[slot & u->table_mask] != 0) {
+            slot++;
+        }
+
+        u->table[slot & u->table_mask] = u->symbol_count;
+    }
+
+    self->units[unit] = u;
+
+    return !u->error;
+}
+
+
+uint32_t
+clv_sema_exports (clv_sema_t *self, uint32_t unit, clv_export_t **out_exports) {
+    sema_unit_t *u = (unit < self->unit_count) ? self->units[unit] : NULL;
+    uint32_t count = 0;
+
+    *out_exports = NULL;
+
+    if (u == NULL || u->error) {
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < u->symbol_count; i++) {
+        count += u->symbols[i].kind == SYM_FN && u->symbols[i].is_pub;
+    }
+
+    if (count == 0 || (*out_exports = clv_alloc (CLV_TAG_SEMA, count * sizeof (**out_exports))) == NULL) {
+        return (count == 0) ? 0 : UINT32_MAX;
+    }
+
+    for (uint32_t i = 0, n = 0; i < u->symbol_count; i++) {
+        symbol_t *symbol = &u->symbols[i];
+
+        if (symbol->kind == SYM_FN && symbol->is_pub) {
+            (*out_exports)[n++] = (clv_export_t){
+                .name = clv_atom_string (symbol->atom),
+                .length = clv_atom_length (symbol->atom),
+                .arity = symbol->arity,
+                .params = &u->param_types[symbol->params],
+                .result = symbol->type
+            };
+        }
+    }
+
+    return count;
+}
+
+
+void
+clv_sema_skip (clv_sema_t *self, uint32_t unit) {
+    if (unit < self->unit_count && self->units[unit] != NULL) {
+        self->units[unit]->skip = true;
+    }
+}
+
+
+bool
+clv_sema_check (clv_sema_t *self, clv_pool_t *pool) {
+    uint32_t count = 0;
+    bool good = true;
+
+    for (uint32_t i = 0; i < self->unit_count; i++) {
+        sema_unit_t *unit = self->units[i];
+
+        if (unit != NULL && !unit->error && !unit->skip) {
+            count += (unit->item_count + SEMA_BATCH - 1) / SEMA_BATCH;
+        }
+    }
+
+    clv_free (self->tasks);
+
+    self->tasks = clv_calloc (CLV_TAG_SEMA, count, sizeof (*self->tasks));
+    self->task_count = 0;
+
+    if (self->tasks == NULL && count > 0) {
+        clv_error ("unable to check: %s", strerror (errno));
+        return false;
+    }
+
+    for (uint32_t i = 0; i < self->unit_count; i++) {
+        sema_unit_t *unit = self->units[i];
+
+        if (unit == NULL || unit->skip) {
+            continue;
+        }
+
+        unit->first_task = self->task_count;
+        unit->task_count = 0;
+
+        // tasks locate errors, which is only safe once lines are indexed
+        clv_location_t loc;
+
+        if (!unit->error && unit->item_count > 0) {
+            clv_source_locate (unit->src, 0, &loc);
+        }
+
+        for (uint32_t first = 0; !unit->error && first < unit->item_count; first += SEMA_BATCH) {
+            sema_task_t *task = &self->tasks[self->task_count++];
+            uint32_t left = unit->item_count - first;
+
+            *task = (sema_task_t){ .unit = unit, .first = first, .count = (left < SEMA_BATCH) ? left : SEMA_BATCH };
+            unit->task_count++;
+
+            if (pool == NULL || !clv_pool_submit (pool, check_task, task)) {
+                check_task (task);
+            }
+        }
+
+        good = good && !unit->error;
+    }
+
+    clv_pool_wait (pool);
+
+    for (uint32_t i = 0; i < self->task_count; i++) {
+        good = good && !self->tasks[i].error;
+    }
+
+    return good;
+}
+
+
+bool
+clv_sema_report (clv_sema_t *self, uint32_t unit) {
+    sema_unit_t *u = (unit < self->unit_count) ? self->units[unit] : NULL;
+
+    if (u == NULL) {
+        return false;
+    }
+
+    bool good = !u->error;
+
+    for (uint32_t i = u->first_task; i < u->first_task + u->task_count; i++) {
+        sema_task_t *task = &self->tasks[i];
+
+        if (task->diagnostics != NULL && task->length > 0) {
+            clv_log_write (CLV_ERROR, task->diagnostics, task->length);
+        }
+
+        good = good && !task->error;
+    }
+
+    return good;
+}
+
+
+void
+clv_sema_free (clv_sema_t *self) {
+    if (self == NULL) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < self->unit_count; i++) {
+        sema_unit_t *unit = self->units[i];
+
+        if (unit == NULL) {
+            continue;
+        }
+
+        clv_free (unit->symbols);
+        clv_free (unit->table);
+
+        if (unit->iface == NULL) {
+            clv_free (unit->param_types);
+        }
+
+        clv_free (unit->items);
+        clv_free (unit);
+    }
+
+    for (uint32_t i = 0; i < self->task_count; i++) {
+        free (self->tasks[i].diagnostics);
+    }
+
+    clv_free (self->units);
+    clv_free (self->tasks);
+    clv_free (self);
+}
@@ -1,5 +1,9 @@
+#define _DEFAULT_SOURCE /* MAP_ANONYMOUS, madvise */
+
 #include <clover/source.h>
+#include <clover/scan.h>
 #include <clover/log.h>
+#include <clover/alloc.h>
 
 #include <stddef.h>
 #include <stdlib.h>
@@ -7,60 +11,82 @@
 #include <stdio.h>
 
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+#define SOURCE_STDIN            "-"
+#define SOURCE_STDIN_NAME       "<stdin>"
+
+#define SOURCE_MMAP_THRESHOLD   (16 * 1024)     /* smaller files are cheaper to read */
+#define SOURCE_READ_CHUNK       (64 * 1024)
+
+#define SOURCE_BYTES_PER_LINE   32              /* line index size hint */
 
 
 struct clv_source {
     clv_str file;
     clv_str data;
     size_t  length;
+    size_t  mapped;     /* length of the mapping, 0 if data is heap allocated */
+
+    uint32_t *lines;    /* offsets of the line starts, built on first use */
+    size_t line_count;
 };
 
 
 static bool
-read_file (clv_str file, char **out_data, size_t *out_length) {
-    FILE *fp = fopen (file, "r");
+read_fd (int fd, size_t hint, char **out_data, size_t *out_length) {
+    size_t capacity = hint + CLV_SOURCE_PADDING;
+    size_t length = 0;
 
-    if (fp == NULL) {
+    char *data = clv_alloc (CLV_TAG_SOURCE, capacity);
+
+    if (data == NULL) {
         return false;
     }
 
-    char *data = NULL;
-    size_t length = 0;
+    do {
+        if (capacity - length <= CLV_SOURCE_PADDING) {
+            char *temp = clv_realloc (CLV_TAG_SOURCE, data, capacity * 2);
 
-    if (fseek (fp, 0, SEEK_END) != 0) {
-        fclose (fp);
-        return false;
-    }
+            if (temp == NULL) {
+                clv_free (data);
+                return false;
+            }
 
-    length = ftell (fp);
-    rewind (fp);
+            data = temp;
+            capacity *= 2;
+        }
 
-    if (length == 0) {
-        errno = EBADF;
-        fclose (fp);
-        return false;
-    }
+        size_t chunk = capacity - length - CLV_SOURCE_PADDING;
 
-    data = malloc (length + 1);
+        if (chunk > SOURCE_READ_CHUNK) {
+            chunk = SOURCE_READ_CHUNK;
+        }
 
-    if (data == NULL) {
-        fclose (fp);
-        return false;
-    }
+        ssize_t count = read (fd, &data[length], chunk);
 
-    size_t offset = 0;
-    int read = 0;
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
 
-    do {
-        read = fread (&data[offset], 1, 4096, fp);
-        offset += read;
+            clv_free (data);
+            return false;
+        }
 
-        if (read <= 0) {
+        if (count == 0) {
             break;
         }
+
+        length += count;
     } while (true);
 
-    fclose (fp);
+    // the lexer relies on zeroes past the last byte
+    memset (&data[length], 0, CLV_SOURCE_PADDING);
 
     *out_data = data;
     *out_length = length;
@@ -69,24 +95,105 @@ read_file (clv_str file, char **out_data, size_t *out_length) {
 }
 
 
+static bool
+map_fd (int fd, size_t length, char **out_data, size_t *out_mapped) {
+    size_t page = sysconf (_SC_PAGESIZE);
+    size_t mapped = (length + CLV_SOURCE_PADDING + page - 1) & ~(page - 1);
+
+    /* Reserve the padding past the file, rounded to whole pages. The tail of
+     * the last file page is zero-filled by the kernel, and whatever is left
+     * of the padding is provided by the anonymous pages behind it. */
+    char *base = mmap (NULL, mapped, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (base == MAP_FAILED) {
+        return false;
+    }
+
+    if (mmap (base, length, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap (base, mapped);
+        return false;
+    }
+
+    madvise (base, length, MADV_SEQUENTIAL);
+
+    *out_data = base;
+    *out_mapped = mapped;
+
+    return true;
+}
+
+
+static bool
+read_file (clv_source_t *src, clv_str file) {
+    char *data = NULL;
+
+    src->length = 0;
+    src->mapped = 0;
+
+    if (strcmp (file, SOURCE_STDIN) == 0) {
+        if (!read_fd (STDIN_FILENO, SOURCE_READ_CHUNK, &data, &src->length)) {
+            return false;
+        }
+
+        src->data = data;
+        return true;
+    }
+
+    int fd = open (file, O_RDONLY);
+
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+
+    if (fstat (fd, &st) != 0) {
+        close (fd);
+        return false;
+    }
+
+    bool success;
+
+    if (S_ISREG (st.st_mode) && st.st_size >= SOURCE_MMAP_THRESHOLD &&
+        map_fd (fd, st.st_size, &data, &src->mapped)) {
+        src->length = st.st_size;
+        success = true;
+    } else {
+        // pipes, small and empty files, or a failed mapping
+        size_t hint = S_ISREG (st.st_mode) ? (size_t)st.st_size : SOURCE_READ_CHUNK;
+        success = read_fd (fd, hint, &data, &src->length);
+    }
+
+    close (fd);
+
+    src->data = data;
+
+    return success;
+}
+
+
 clv_source_t *
 clv_source_new (clv_str file) {
-    clv_source_t *new_src = malloc (sizeof (*new_src));
+    clv_source_t *new_src = clv_alloc (CLV_TAG_SOURCE, sizeof (*new_src));
 
     if (new_src == NULL) {
         return NULL;
     }
 
-    new_src->file = strdup (file);
+    bool is_stdin = strcmp (file, SOURCE_STDIN) == 0;
+
+    new_src->lines = NULL;
+    new_src->line_count = 0;
+    new_src->file = clv_strdup (CLV_TAG_SOURCE, is_stdin ? SOURCE_STDIN_NAME : file);
 
     if (new_src->file == NULL) {
-        free (new_src);
+        clv_free (new_src);
         return NULL;
     }
 
-    if (!read_file (file, (char **)&new_src->data, &new_src->length)) {
-        free (CLV_VOIDPTR (new_src->file));
-        free (CLV_VOIDPTR (new_src));
+    if (!read_file (new_src, file)) {
+        clv_free (CLV_VOIDPTR (new_src->file));
+        clv_free (CLV_VOIDPTR (new_src));
         return NULL;
     }
 
@@ -127,7 +234,7 @@ clv_source_offset (clv_source_t *self, size_t offset) {
 
 
 clv_str
-clv_source_substr (clv_source_t *self, size_t offset, size_t length) {
+clv_source_substr (clv_source_t *self, size_t offset, size_t length, clv_arena_t *arena) {
     if (self == NULL) {
         errno = EINVAL;
         return NULL;
@@ -138,7 +245,11 @@ clv_source_substr (clv_source_t *self, size_t offset, size_t length) {
         return NULL;
     }
 
-    return strndup ((self->data + offset), length);
+    if (arena != NULL) {
+        return clv_arena_strndup (arena, (self->data + offset), length);
+    }
+
+    return clv_strndup (CLV_TAG_SOURCE, (self->data + offset), length);
 }
 
 
@@ -180,6 +291,96 @@ clv_source_get_file (clv_source_t *self) {
 }
 
 
+/* Indexes the start of every line. Line breaks are \n, \r\n or a lone \r,
+ * as editors count them. */
+static bool
+index_lines (clv_source_t *self) {
+    const char *data = self->data;
+    const char *end = data + self->length;
+
+    size_t capacity = self->length / SOURCE_BYTES_PER_LINE + 16;
+    size_t count = 0;
+
+    uint32_t *lines = clv_alloc (CLV_TAG_SOURCE, capacity * sizeof (*lines));
+
+    if (lines == NULL) {
+        return false;
+    }
+
+    lines[count++] = 0;
+
+    for (const char *p = data; (p = clv_scan_any3 (p, '\n', '\r', '\0')) < end; ) {
+        // NUL bytes in the middle of a source don't end lines
+        if (*p == '\0') {
+            p++;
+            continue;
+        }
+
+        // the padding makes p[1] safe to read
+        p += (p[0] == '\r' && p[1] == '\n') ? 2 : 1;
+
+        if (count == capacity) {
+            uint32_t *temp = clv_realloc (CLV_TAG_SOURCE, lines, capacity * 2 * sizeof (*lines));
+
+            if (temp == NULL) {
+                clv_free (lines);
+                return false;
+            }
+
+            lines = temp;
+            capacity *= 2;
+        }
+
+        lines[count++] = p - data;
+    }
+
+    self->lines = lines;
+    self->line_count = count;
+
+    return true;
+}
+
+
+bool
+clv_source_locate (clv_source_t *self, size_t offset, clv_location_t *out_location) {
+    if (self == NULL || out_location == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+
+    if (offset > self->length) {
+        errno = EOVERFLOW;
+        return false;
+    }
+
+    if (self->lines == NULL && !index_lines (self)) {
+        return false;
+    }
+
+    // the last line starting at or before `offset`
+    size_t low = 0;
+    size_t high = self->line_count;
+
+    while (high - low > 1) {
+        size_t mid = low + (high - low) / 2;
+
+        if (self->lines[mid] <= offset) {
+            low = mid;
+        } else {
+            high = mid;
+        }
+    }
+
+    *out_location = (clv_location_t){
+        .line = low + 1,
+        .column = offset - self->lines[low] + 1,
+        .line_offset = self->lines[low]
+    };
+
+    return true;
+}
+
+
 size_t
 clv_source_length (clv_source_t *self) {
     if (self == NULL) {
@@ -198,7 +399,13 @@ clv_source_free (clv_source_t *self) {
         return;
     }
 
-    free (CLV_VOIDPTR (self->file));
-    free (CLV_VOIDPTR (self->data));
-    free (CLV_VOIDPTR (self));
+    if (self->mapped > 0) {
+        munmap (CLV_VOIDPTR (self->data), self->mapped);
+    } else {
+        clv_free (CLV_VOIDPTR (self->data));
+    }
+
+    clv_free (self->lines);
+    clv_free (CLV_VOIDPTR (self->file));
+    clv_free (CLV_VOIDPTR (self));
 }
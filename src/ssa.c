@@ -0,0 +1,1500 @@
+#include <clover/ssa.h>
+#include <clover/ir.h>
+#include <clover/log.h>
+#include <clover/alloc.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#define DUMP_RECORD_SIZE    (32 * 1024)
+
+/* Type of values not inferred yet */
+#define SSA_UNSET           0xff
+
+
+static const struct {
+    clv_str name;
+    uint8_t fmt;
+} ops[CLV_SSA_OP_COUNT] = {
+#define SSA_OP_INFO(name, fmt)  [CLV_SSA_##name] = { #name, CLV_SSA_FMT_##fmt },
+    CLV_SSA_OPS (SSA_OP_INFO)
+#undef SSA_OP_INFO
+};
+
+
+/* Where blocks of the SSA form come from */
+typedef enum {
+    BLOCK_ENTRY,            // the params, then a jump to the first block
+    BLOCK_CODE,             // a block of the bytecode
+    BLOCK_LOOP,             // the taken edge of the FORLOOP ending the block before
+} block_kind_t;
+
+
+/* Definition replaced while renaming a block, restored once done with the
+ * blocks it dominates */
+typedef struct {
+    uint32_t reg;
+    uint32_t value;
+} rename_undo_t;
+
+
+/* Block to rename, or to leave once the blocks it dominates are */
+typedef struct {
+    uint32_t block;
+    uint32_t undo;          /* CLV_SSA_NONE to enter */
+} rename_step_t;
+
+
+typedef struct {
+    clv_ir_fn_t ir;
+    clv_ssa_fn_t *ssa;
+    uint32_t registers;
+
+    uint32_t *ssa_of;           // of each IR block, CLV_SSA_NONE when unreachable
+    uint32_t *ir_of;            // of each SSA block
+    uint8_t *kinds;
+
+    uint32_t *rpo;              // reverse postorder
+    uint32_t *rpo_index;
+
+    uint32_t *df_first;         // dominance frontiers, block_count + 1
+    uint32_t *df;
+
+    uint32_t *dom_first;        // dominator tree, block_count + 1
+    uint32_t *dom;
+
+    clv_ir_regs_t *uses;        // read before written in the block
+    clv_ir_regs_t *defs;
+    clv_ir_regs_t *live_in;
+    clv_ir_regs_t *phis;        // registers with a phi at the start of the block
+
+    uint32_t *work;             // scratch, block_count
+
+    // renaming
+    uint32_t current[CLV_INSN_MAX_REG + 1];
+    uint32_t nil;
+    rename_undo_t *undo;
+    uint32_t undo_count;
+    uint32_t undo_capacity;
+
+    uint32_t block;
+    uint32_t pos;
+    uint32_t line;
+    uint32_t next_operand;
+} ssa_builder_t;
+
+
+/* == Register sets == */
+
+
+static inline void
+regs_or (clv_ir_regs_t *dst, const clv_ir_regs_t *src) {
+    for (int i = 0; i < 4; i++) {
+        dst->bits[i] |= src->bits[i];
+    }
+}
+
+
+static inline uint32_t
+regs_count (const clv_ir_regs_t *set) {
+    uint32_t count = 0;
+
+    for (int i = 0; i < 4; i++) {
+        count += __builtin_popcountll (set->bits[i]);
+    }
+
+    return count;
+}
+
+
+/* Next register of `set` from `r` on, or CLV_INSN_MAX_REG + 1 */
+static inline uint32_t
+regs_next (const clv_ir_regs_t *set, uint32_t r) {
+    for (uint32_t i = r >> 6; i < 4; i++) {
+        uint64_t word = set->bits[i] & (~(uint64_t)0 << ((i == r >> 6) ? (r & 63) : 0));
+
+        if (word != 0) {
+            return i * 64 + __builtin_ctzll (word);
+        }
+    }
+
+    return CLV_INSN_MAX_REG + 1;
+}
+
+
+/* == Control flow == */
+
+
+static inline const clv_ir_insn_t *
+ir_last (const clv_ir_fn_t *ir, uint32_t block) {
+    const clv_ir_block_t *b = &ir->blocks[block];
+
+    return (b->count > 0) ? &b->insns[b->count - 1] : NULL;
+}
+
+
+static inline bool
+ir_ends_block (const clv_ir_insn_t *insn) {
+    switch (insn->op) {
+    case CLV_OP_JMP:
+    case CLV_OP_JMPF:
+    case CLV_OP_JMPT:
+    case CLV_OP_FORPREP:
+    case CLV_OP_FORLOOP:
+    case CLV_OP_RET:
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+
+/* Numbers the blocks reachable from the first one, giving FORLOOPs an extra
+ * block for their taken edge */
+static bool
+build_blocks (ssa_builder_t *b) {
+    clv_ir_fn_t *ir = &b->ir;
+    uint32_t *stack = clv_alloc (CLV_TAG_SSA, (ir->block_count + 1) * sizeof (*stack));
+    uint32_t sp = 0;
+
+    b->ssa_of = clv_alloc (CLV_TAG_SSA, (ir->block_count + 1) * sizeof (*b->ssa_of));
+
+    if (stack == NULL || b->ssa_of == NULL) {
+        clv_free (stack);
+        return false;
+    }
+
+    for (uint32_t i = 0; i < ir->block_count; i++) {
+        b->ssa_of[i] = CLV_SSA_NONE;
+    }
+
+    if (ir->block_count > 0) {
+        b->ssa_of[0] = 0;
+        stack[sp++] = 0;
+    }
+
+    while (sp > 0) {
+        uint32_t succ[2];
+        uint32_t count = clv_ir_successors (ir, stack[--sp], succ);
+
+        for (uint32_t i = 0; i < count; i++) {
+            if (b->ssa_of[succ[i]] == CLV_SSA_NONE) {
+                b->ssa_of[succ[i]] = 0;
+                stack[sp++] = succ[i];
+            }
+        }
+    }
+
+    clv_free (stack);
+
+    uint32_t count = 1;
+
+    for (uint32_t i = 0; i < ir->block_count; i++) {
+        if (b->ssa_of[i] != CLV_SSA_NONE) {
+            const clv_ir_insn_t *last = ir_last (ir, i);
+
+            b->ssa_of[i] = count++;
+            count += (last != NULL && last->op == CLV_OP_FORLOOP);
+        }
+    }
+
+    clv_ssa_fn_t *ssa = b->ssa;
+
+    ssa->blocks = clv_calloc (CLV_TAG_SSA, count, sizeof (*ssa->blocks));
+    ssa->block_count = count;
+    b->ir_of = clv_alloc (CLV_TAG_SSA, count * sizeof (*b->ir_of));
+    b->kinds = clv_alloc (CLV_TAG_SSA, count);
+
+    if (ssa->blocks == NULL || b->ir_of == NULL || b->kinds == NULL) {
+        return false;
+    }
+
+    b->ir_of[0] = CLV_SSA_NONE;
+    b->kinds[0] = BLOCK_ENTRY;
+
+    for (uint32_t i = 0; i < ir->block_count; i++) {
+        uint32_t id = b->ssa_of[i];
+
+        if (id != CLV_SSA_NONE) {
+            const clv_ir_insn_t *last = ir_last (ir, i);
+
+            b->ir_of[id] = i;
+            b->kinds[id] = BLOCK_CODE;
+
+            if (last != NULL && last->op == CLV_OP_FORLOOP) {
+                b->ir_of[id + 1] = i;
+                b->kinds[id + 1] = BLOCK_LOOP;
+            }
+        }
+    }
+
+    return true;
+}
+
+
+/* Fails with EINVAL when a branch falls off the end of the code */
+static bool
+build_successors (ssa_builder_t *b) {
+    clv_ssa_fn_t *ssa = b->ssa;
+    clv_ir_fn_t *ir = &b->ir;
+
+    for (uint32_t i = 0; i < ssa->block_count; i++) {
+        clv_ssa_block_t *block = &ssa->blocks[i];
+        uint32_t ir_block = b->ir_of[i];
+
+        block->succ[0] = CLV_SSA_NONE;
+        block->succ[1] = CLV_SSA_NONE;
+
+        if (b->kinds[i] == BLOCK_ENTRY) {
+            block->succ[0] = (ir->block_count > 0) ? 1 : CLV_SSA_NONE;
+            continue;
+        }
+
+        const clv_ir_insn_t *last = ir_last (ir, ir_block);
+        uint32_t next = (ir_block + 1 < ir->block_count) ? b->ssa_of[ir_block + 1] : CLV_SSA_NONE;
+
+        if (b->kinds[i] == BLOCK_LOOP) {
+            block->succ[0] = b->ssa_of[last->c];
+            continue;
+        }
+
+        switch ((last != NULL) ? last->op : CLV_OP_MOVE) {
+        case CLV_OP_RET:
+            break;
+
+        case CLV_OP_JMP:
+        case CLV_OP_FORPREP:
+            block->succ[0] = b->ssa_of[last->c];
+            break;
+
+        case CLV_OP_JMPF:
+            block->succ[0] = next;
+            block->succ[1] = b->ssa_of[last->c];
+            break;
+
+        case CLV_OP_JMPT:
+            block->succ[0] = b->ssa_of[last->c];
+            block->succ[1] = next;
+            break;
+
+        case CLV_OP_FORLOOP:
+            block->succ[0] = i + 1;
+            block->succ[1] = next;
+            break;
+
+        default:
+            block->succ[0] = next;
+            break;
+        }
+
+        if (last != NULL && (last->op == CLV_OP_JMPF || last->op == CLV_OP_JMPT || last->op == CLV_OP_FORLOOP)
+            && next == CLV_SSA_NONE) {
+            errno = EINVAL;
+            return false;
+        }
+    }
+
+    // predecessors, each block's in order
+    for (uint32_t i = 0; i < ssa->block_count; i++) {
+        for (int k = 0; k < 2; k++) {
+            if (ssa->blocks[i].succ[k] != CLV_SSA_NONE) {
+                ssa->blocks[ssa->blocks[i].succ[k]].pred_count++;
+            }
+        }
+    }
+
+    uint32_t total = 0;
+
+    for (uint32_t i = 0; i < ssa->block_count; i++) {
+        ssa->blocks[i].first_pred = total;
+        total += ssa->blocks[i].pred_count;
+        b->work[i] = ssa->blocks[i].first_pred;
+    }
+
+    if (total > 0 && (ssa->preds = clv_alloc (CLV_TAG_SSA, total * sizeof (*ssa->preds))) == NULL) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < ssa->block_count; i++) {
+        for (int k = 0; k < 2; k++) {
+            uint32_t s = ssa->blocks[i].succ[k];
+
+            if (s != CLV_SSA_NONE) {
+                ssa->preds[b->work[s]++] = i;
+            }
+        }
+    }
+
+    return true;
+}
+
+
+static inline uint32_t
+dom_intersect (ssa_builder_t *b, uint32_t x, uint32_t y) {
+    while (x != y) {
+        while (b->rpo_index[x] > b->rpo_index[y]) {
+            x = b->ssa->blocks[x].idom;
+        }
+
+        while (b->rpo_index[y] > b->rpo_index[x]) {
+            y = b->ssa->blocks[y].idom;
+        }
+    }
+
+    return x;
+}
+
+
+/* Dominators as Cooper, Harvey and Kennedy's "A Simple, Fast Dominance
+ * Algorithm", their tree, and dominance frontiers */
+static bool
+build_dominators (ssa_builder_t *b) {
+    clv_ssa_fn_t *ssa = b->ssa;
+    uint32_t n = ssa->block_count;
+    uint32_t *stack = clv_alloc (CLV_TAG_SSA, n * sizeof (*stack));
+    uint8_t *next = clv_calloc (CLV_TAG_SSA, n, 1);
+
+    b->rpo = clv_alloc (CLV_TAG_SSA, n * sizeof (*b->rpo));
+    b->rpo_index = clv_alloc (CLV_TAG_SSA, n * sizeof (*b->rpo_index));
+    b->dom_first = clv_calloc (CLV_TAG_SSA, n + 1, sizeof (*b->dom_first));
+    b->df_first = clv_calloc (CLV_TAG_SSA, n + 1, sizeof (*b->df_first));
+
+    if (stack == NULL || next == NULL || b->rpo == NULL || b->rpo_index == NULL || b->dom_first == NULL
+        || b->df_first == NULL) {
+        clv_free (stack);
+        clv_free (next);
+        return false;
+    }
+
+    // postorder, filled from the back
+    uint32_t sp = 0;
+    uint32_t order = n;
+
+    for (uint32_t i = 0; i < n; i++) {
+        b->rpo_index[i] = CLV_SSA_NONE;
+    }
+
+    stack[sp++] = 0;
+    b->rpo_index[0] = 0;
+
+    while (sp > 0) {
+        uint32_t top = stack[sp - 1];
+
+        if (next[top] < 2) {
+            uint32_t s = ssa->blocks[top].succ[next[top]++];
+
+            if (s != CLV_SSA_NONE && b->rpo_index[s] == CLV_SSA_NONE) {
+                b->rpo_index[s] = 0;
+                stack[sp++] = s;
+            }
+
+            continue;
+        }
+
+        b->rpo[--order] = top;
+        sp--;
+    }
+
+    clv_free (stack);
+    clv_free (next);
+
+    for (uint32_t i = 0; i < n; i++) {
+        b->rpo_index[b->rpo[i]] = i;
+        ssa->blocks[i].idom = CLV_SSA_NONE;
+    }
+
+    ssa->blocks[0].idom = 0;
+
+    for (bool changed = true; changed;) {
+        changed = false;
+
+        for (uint32_t i = 1; i < n; i++) {
+            clv_ssa_block_t *block = &ssa->blocks[b->rpo[i]];
+            uint32_t idom = CLV_SSA_NONE;
+
+            for (uint32_t k = 0; k < block->pred_count; k++) {
+                uint32_t p = ssa->preds[block->first_pred + k];
+
+                if (ssa->blocks[p].idom != CLV_SSA_NONE) {
+                    idom = (idom == CLV_SSA_NONE) ? p : dom_intersect (b, p, idom);
+                }
+            }
+
+            if (block->idom != idom) {
+                block->idom = idom;
+                changed = true;
+            }
+        }
+    }
+
+    // frontiers of the blocks from each join up to its dominator, counted
+    // then filled, and only once per join
+    for (int pass = 0; pass < 2; pass++) {
+        for (uint32_t i = 0; i < n; i++) {
+            b->work[i] = CLV_SSA_NONE;
+        }
+
+        for (uint32_t i = 0; i < n; i++) {
+            clv_ssa_block_t *block = &ssa->blocks[i];
+
+            if (block->pred_count < 2) {
+                continue;
+            }
+
+            for (uint32_t k = 0; k < block->pred_count; k++) {
+                for (uint32_t r = ssa->preds[block->first_pred + k]; r != block->idom && b->work[r] != i;
+                     r = ssa->blocks[r].idom) {
+                    b->work[r] = i;
+
+                    if (pass == 0) {
+                        b->df_first[r + 1]++;
+                    } else {
+                        b->df[b->df_first[r]++] = i;
+                    }
+                }
+            }
+        }
+
+        if (pass == 0) {
+            for (uint32_t i = 0; i < n; i++) {
+                b->df_first[i + 1] += b->df_first[i];
+            }
+
+            if (b->df_first[n] > 0 && (b->df = clv_alloc (CLV_TAG_SSA, b->df_first[n] * sizeof (*b->df))) == NULL) {
+                return false;
+            }
+        } else {
+            // filling moved each start to the next one's
+            memmove (b->df_first + 1, b->df_first, n * sizeof (*b->df_first));
+            b->df_first[0] = 0;
+        }
+    }
+
+    ssa->blocks[0].idom = CLV_SSA_NONE;
+
+    // children in the dominator tree
+    for (uint32_t i = 1; i < n; i++) {
+        b->dom_first[ssa->blocks[i].idom + 1]++;
+    }
+
+    for (uint32_t i = 0; i < n; i++) {
+        b->dom_first[i + 1] += b->dom_first[i];
+        b->work[i] = b->dom_first[i];
+    }
+
+    if (n > 1 && (b->dom = clv_alloc (CLV_TAG_SSA, (n - 1) * sizeof (*b->dom))) == NULL) {
+        return false;
+    }
+
+    for (uint32_t i = 1; i < n; i++) {
+        b->dom[b->work[ssa->blocks[i].idom]++] = i;
+    }
+
+    return true;
+}
+
+
+/* == Phis == */
+
+
+/* Registers a block reads before writing them, and those it writes. The
+ * FORLOOP ending a block only reads its registers, as they are written on
+ * the taken edge. */
+static void
+block_effects (ssa_builder_t *b, uint32_t block, clv_ir_regs_t *out_uses, clv_ir_regs_t *out_defs) {
+    *out_uses = (clv_ir_regs_t){ 0 };
+    *out_defs = (clv_ir_regs_t){ 0 };
+
+    if (b->kinds[block] == BLOCK_ENTRY) {
+        for (uint32_t r = 0; r < b->registers; r++) {
+            CLV_IR_REGS_ADD (out_defs, r);
+        }
+
+        return;
+    }
+
+    const clv_ir_block_t *ir_block = &b->ir.blocks[b->ir_of[block]];
+
+    if (b->kinds[block] == BLOCK_LOOP) {
+        const clv_ir_insn_t *loop = &ir_block->insns[ir_block->count - 1];
+
+        CLV_IR_REGS_ADD (out_uses, loop->a);
+        CLV_IR_REGS_ADD (out_uses, loop->a + 1u);
+        CLV_IR_REGS_ADD (out_defs, loop->a + 1u);
+        CLV_IR_REGS_ADD (out_defs, loop->a + 2u);
+        return;
+    }
+
+    for (uint32_t i = 0; i < ir_block->count; i++) {
+        const clv_ir_insn_t *insn = &ir_block->insns[i];
+        clv_ir_regs_t reads, writes;
+
+        clv_ir_reads (insn, &reads);
+
+        for (int k = 0; k < 4; k++) {
+            out_uses->bits[k] |= reads.bits[k] & ~out_defs->bits[k];
+        }
+
+        if (insn->op != CLV_OP_FORLOOP) {
+            clv_ir_writes (insn, &writes);
+            regs_or (out_defs, &writes);
+        }
+    }
+}
+
+
+/* Liveness of registers, so phis only go where their register is read */
+static bool
+build_liveness (ssa_builder_t *b) {
+    uint32_t n = b->ssa->block_count;
+
+    b->uses = clv_alloc (CLV_TAG_SSA, n * sizeof (*b->uses));
+    b->defs = clv_alloc (CLV_TAG_SSA, n * sizeof (*b->defs));
+    b->live_in = clv_calloc (CLV_TAG_SSA, n, sizeof (*b->live_in));
+
+    if (b->uses == NULL || b->defs == NULL || b->live_in == NULL) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < n; i++) {
+        block_effects (b, i, &b->uses[i], &b->defs[i]);
+    }
+
+    for (bool changed = true; changed;) {
+        changed = false;
+
+        for (uint32_t i = n; i-- > 0;) {
+            uint32_t block = b->rpo[i];
+            const clv_ssa_block_t *ssa_block = &b->ssa->blocks[block];
+            clv_ir_regs_t out = { 0 };
+
+            for (int k = 0; k < 2; k++) {
+                if (ssa_block->succ[k] != CLV_SSA_NONE) {
+                    regs_or (&out, &b->live_in[ssa_block->succ[k]]);
+                }
+            }
+
+            for (int k = 0; k < 4; k++) {
+                uint64_t in = b->uses[block].bits[k] | (out.bits[k] & ~b->defs[block].bits[k]);
+
+                changed |= (in != b->live_in[block].bits[k]);
+                b->live_in[block].bits[k] = in;
+            }
+        }
+    }
+
+    return true;
+}
+
+
+/* Places phis on the iterated dominance frontier of the writes of each
+ * register, where it is live */
+static bool
+build_phis (ssa_builder_t *b) {
+    uint32_t n = b->ssa->block_count;
+    uint32_t *queue = clv_alloc (CLV_TAG_SSA, n * sizeof (*queue));
+
+    b->phis = clv_calloc (CLV_TAG_SSA, n, sizeof (*b->phis));
+
+    if (queue == NULL || b->phis == NULL) {
+        clv_free (queue);
+        return false;
+    }
+
+    for (uint32_t i = 0; i < n; i++) {
+        b->work[i] = CLV_SSA_NONE;
+    }
+
+    for (uint32_t r = 0; r < b->registers; r++) {
+        uint32_t head = 0;
+        uint32_t tail = 0;
+
+        for (uint32_t i = 0; i < n; i++) {
+            if (CLV_IR_REGS_HAS (&b->defs[i], r)) {
+                b->work[i] = r;
+                queue[tail++] = i;
+            }
+        }
+
+        while (head < tail) {
+            uint32_t x = queue[head++];
+
+            for (uint32_t k = b->df_first[x]; k < b->df_first[x + 1]; k++) {
+                uint32_t y = b->df[k];
+
+                if (CLV_IR_REGS_HAS (&b->phis[y], r) || !CLV_IR_REGS_HAS (&b->live_in[y], r)) {
+                    continue;
+                }
+
+                CLV_IR_REGS_ADD (&b->phis[y], r);
+
+                if (b->work[y] != r) {
+                    b->work[y] = r;
+                    queue[tail++] = y;
+                }
+            }
+        }
+    }
+
+    clv_free (queue);
+
+    return true;
+}
+
+
+/* == Layout == */
+
+
+/* Instructions a bytecode instruction becomes */
+static inline uint32_t
+insn_length (const clv_ir_insn_t *insn) {
+    switch (insn->op) {
+    case CLV_OP_MOVE:
+        return 0;
+
+    case CLV_OP_ADDI:
+    case CLV_OP_FORPREP:
+    case CLV_OP_FORLOOP:
+        return 2;
+
+    default:
+        return 1;
+    }
+}
+
+
+/* Sizes blocks, and lays out their phis with room for an operand per
+ * predecessor */
+static bool
+build_layout (ssa_builder_t *b) {
+    clv_ssa_fn_t *ssa = b->ssa;
+    uint32_t count = 0;
+    uint32_t operands = 0;
+
+    for (uint32_t i = 0; i < ssa->block_count; i++) {
+        clv_ssa_block_t *block = &ssa->blocks[i];
+        uint32_t phis = regs_count (&b->phis[i]);
+        uint32_t length = phis;
+
+        operands += phis * block->pred_count;
+
+        if (b->kinds[i] == BLOCK_ENTRY) {
+            length += ssa->source->arity + 2;
+        } else if (b->kinds[i] == BLOCK_LOOP) {
+            length += 3;
+        } else {
+            const clv_ir_block_t *ir_block = &b->ir.blocks[b->ir_of[i]];
+
+            for (uint32_t k = 0; k < ir_block->count; k++) {
+                length += insn_length (&ir_block->insns[k]);
+
+                if (ir_block->insns[k].op == CLV_OP_CALL) {
+                    operands += ir_block->insns[k].b + 1u;
+                }
+            }
+
+            length += (ir_block->count == 0 || !ir_ends_block (&ir_block->insns[ir_block->count - 1]));
+        }
+
+        block->first = count;
+        block->count = length;
+        count += length;
+    }
+
+    ssa->insns = clv_alloc (CLV_TAG_SSA, (count + 1) * sizeof (*ssa->insns));
+    ssa->lines = clv_alloc (CLV_TAG_SSA, (count + 1) * sizeof (*ssa->lines));
+    ssa->operands = clv_alloc (CLV_TAG_SSA, (operands + 1) * sizeof (*ssa->operands));
+    ssa->count = count;
+    ssa->operand_count = operands;
+
+    if (ssa->insns == NULL || ssa->lines == NULL || ssa->operands == NULL) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < ssa->block_count; i++) {
+        clv_ssa_block_t *block = &ssa->blocks[i];
+        uint32_t k = 0;
+
+        for (uint32_t r = regs_next (&b->phis[i], 0); r <= CLV_INSN_MAX_REG; r = regs_next (&b->phis[i], r + 1)) {
+            ssa->insns[block->first + k++] = (clv_ssa_insn_t){
+                .op = CLV_SSA_PHI,
+                .type = SSA_UNSET,
+                .reg = r,
+                .block = i,
+                .args = { b->next_operand, block->pred_count }
+            };
+
+            for (uint32_t p = 0; p < block->pred_count; p++) {
+                ssa->operands[b->next_operand++] = CLV_SSA_NONE;
+            }
+        }
+    }
+
+    return true;
+}
+
+
+/* == Renaming == */
+
+
+static uint32_t
+emit (ssa_builder_t *b, clv_ssa_op_t op, uint32_t reg, uint32_t x, uint32_t y) {
+    uint32_t value = b->pos++;
+
+    b->ssa->insns[value] = (clv_ssa_insn_t){
+        .op = op,
+        .type = SSA_UNSET,
+        .reg = (reg <= CLV_INSN_MAX_REG) ? reg : CLV_SSA_NO_REG,
+        .block = b->block,
+        .args = { x, y }
+    };
+
+    b->ssa->lines[value] = b->line;
+
+    return value;
+}
+
+
+static bool
+define (ssa_builder_t *b, uint32_t reg, uint32_t value) {
+    if (b->undo_count == b->undo_capacity) {
+        uint32_t capacity = (b->undo_capacity == 0) ? 64 : b->undo_capacity * 2;
+        rename_undo_t *undo = clv_realloc (CLV_TAG_SSA, b->undo, capacity * sizeof (*undo));
+
+        if (undo == NULL) {
+            return false;
+        }
+
+        b->undo = undo;
+        b->undo_capacity = capacity;
+    }
+
+    b->undo[b->undo_count++] = (rename_undo_t){ .reg = reg, .value = b->current[reg] };
+    b->current[reg] = value;
+
+    return true;
+}
+
+
+static clv_ssa_op_t
+ssa_op_of (clv_opcode_t op) {
+    switch (op) {
+#define SSA_SAME_OP(name)   case CLV_OP_##name: return CLV_SSA_##name;
+    SSA_SAME_OP (ADD) SSA_SAME_OP (SUB) SSA_SAME_OP (MUL) SSA_SAME_OP (DIV) SSA_SAME_OP (MOD)
+    SSA_SAME_OP (BAND) SSA_SAME_OP (BOR) SSA_SAME_OP (BXOR) SSA_SAME_OP (SHL) SSA_SAME_OP (SHR)
+    SSA_SAME_OP (EQ) SSA_SAME_OP (NE) SSA_SAME_OP (LT) SSA_SAME_OP (LE)
+    SSA_SAME_OP (NEG) SSA_SAME_OP (NOT) SSA_SAME_OP (BNOT) SSA_SAME_OP (TYPEOF) SSA_SAME_OP (UNWRAP)
+#undef SSA_SAME_OP
+
+    default:
+        return CLV_SSA_OP_COUNT;
+    }
+}
+
+
+static bool
+rename_insn (ssa_builder_t *b, const clv_ir_insn_t *insn) {
+    uint32_t *cur = b->current;
+    uint32_t a = insn->a;
+
+    b->line = insn->line;
+
+    switch (insn->op) {
+    case CLV_OP_MOVE:
+        return define (b, a, cur[insn->b]);
+
+    case CLV_OP_LOADK:
+        return define (b, a, emit (b, CLV_SSA_CONST, a, insn->b, 0));
+
+    case CLV_OP_LOADI:
+        return define (b, a, emit (b, CLV_SSA_INT, a, (uint32_t)insn->c, 0));
+
+    case CLV_OP_LOADNIL:
+        return define (b, a, emit (b, CLV_SSA_NIL, a, 0, 0));
+
+    case CLV_OP_LOADBOOL:
+        return define (b, a, emit (b, CLV_SSA_BOOL, a, insn->b != 0, 0));
+
+    case CLV_OP_GETGLOBAL:
+        return define (b, a, emit (b, CLV_SSA_GETGLOBAL, a, insn->b, 0));
+
+    case CLV_OP_SETGLOBAL:
+        emit (b, CLV_SSA_SETGLOBAL, CLV_SSA_NO_REG, insn->b, cur[a]);
+        return true;
+
+    case CLV_OP_ADDI: {
+        uint32_t k = emit (b, CLV_SSA_INT, CLV_SSA_NO_REG, (uint32_t)insn->c, 0);
+
+        return define (b, a, emit (b, CLV_SSA_ADD, a, cur[insn->b], k));
+    }
+
+    case CLV_OP_CAST:
+        return define (b, a, emit (b, CLV_SSA_CAST, a, cur[insn->b], (uint32_t)insn->c));
+
+    case CLV_OP_JMP:
+        emit (b, CLV_SSA_JMP, CLV_SSA_NO_REG, 0, 0);
+        return true;
+
+    case CLV_OP_JMPF:
+    case CLV_OP_JMPT:
+        emit (b, CLV_SSA_BRANCH, CLV_SSA_NO_REG, cur[a], 0);
+        return true;
+
+    case CLV_OP_FORPREP:
+        if (!define (b, a + 1, emit (b, CLV_SSA_ITER, a + 1, cur[a], 0))) {
+            return false;
+        }
+
+        emit (b, CLV_SSA_JMP, CLV_SSA_NO_REG, 0, 0);
+        return true;
+
+    case CLV_OP_FORLOOP:
+        emit (b, CLV_SSA_BRANCH, CLV_SSA_NO_REG, emit (b, CLV_SSA_MORE, CLV_SSA_NO_REG, cur[a], cur[a + 1]), 0);
+        return true;
+
+    case CLV_OP_CALL: {
+        uint32_t first = b->next_operand;
+
+        for (uint32_t i = 0; i <= insn->b; i++) {
+            b->ssa->operands[b->next_operand++] = cur[a + i];
+        }
+
+        if (!define (b, a, emit (b, CLV_SSA_CALL, a, first, insn->b + 1u))) {
+            return false;
+        }
+
+        // the callee's frame went over the registers above
+        for (uint32_t r = a + 1; r < b->registers; r++) {
+            if (!define (b, r, b->nil)) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    case CLV_OP_RET:
+        emit (b, CLV_SSA_RET, CLV_SSA_NO_REG, (insn->b != 0) ? cur[a] : CLV_SSA_NONE, 0);
+        return true;
+
+    default: {
+        clv_ssa_op_t op = ssa_op_of (insn->op);
+
+        if (op == CLV_SSA_OP_COUNT) {
+            errno = EINVAL;
+            return false;
+        }
+
+        uint32_t y = (ops[op].fmt == CLV_SSA_FMT_VV) ? cur[(uint32_t)insn->c] : 0;
+
+        return define (b, a, emit (b, op, a, cur[insn->b], y));
+    }
+    }
+}
+
+
+static bool
+rename_block (ssa_builder_t *b, uint32_t i) {
+    clv_ssa_fn_t *ssa = b->ssa;
+    clv_ssa_block_t *block = &ssa->blocks[i];
+    const clv_ir_block_t *ir_block = (b->kinds[i] == BLOCK_ENTRY) ? NULL : &b->ir.blocks[b->ir_of[i]];
+
+    b->block = i;
+    b->pos = block->first;
+    b->line = (ir_block != NULL && ir_block->count > 0) ? ir_block->insns[0].line : 0;
+
+    if (b->kinds[i] == BLOCK_ENTRY && b->ir.block_count > 0 && b->ir.blocks[0].count > 0) {
+        b->line = b->ir.blocks[0].insns[0].line;
+    }
+
+    for (uint32_t r = regs_next (&b->phis[i], 0); r <= CLV_INSN_MAX_REG; r = regs_next (&b->phis[i], r + 1)) {
+        ssa->lines[b->pos] = b->line;
+
+        if (!define (b, r, b->pos++)) {
+            return false;
+        }
+    }
+
+    switch (b->kinds[i]) {
+    case BLOCK_ENTRY:
+        for (uint32_t r = 0; r < ssa->source->arity; r++) {
+            b->current[r] = emit (b, CLV_SSA_PARAM, r, r, 0);
+        }
+
+        // registers are nil until written
+        b->nil = emit (b, CLV_SSA_NIL, CLV_SSA_NO_REG, 0, 0);
+
+        for (uint32_t r = ssa->source->arity; r <= CLV_INSN_MAX_REG; r++) {
+            b->current[r] = b->nil;
+        }
+
+        emit (b, (block->succ[0] != CLV_SSA_NONE) ? CLV_SSA_JMP : CLV_SSA_RET, CLV_SSA_NO_REG, CLV_SSA_NONE, 0);
+        break;
+
+    case BLOCK_LOOP: {
+        const clv_ir_insn_t *loop = &ir_block->insns[ir_block->count - 1];
+        uint32_t a = loop->a;
+
+        b->line = loop->line;
+
+        uint32_t elem = emit (b, CLV_SSA_ELEM, a + 2, b->current[a], b->current[a + 1]);
+        uint32_t step = emit (b, CLV_SSA_STEP, a + 1, b->current[a], b->current[a + 1]);
+
+        if (!define (b, a + 2, elem) || !define (b, a + 1, step)) {
+            return false;
+        }
+
+        emit (b, CLV_SSA_JMP, CLV_SSA_NO_REG, 0, 0);
+        break;
+    }
+
+    default:
+        for (uint32_t k = 0; k < ir_block->count; k++) {
+            if (!rename_insn (b, &ir_block->insns[k])) {
+                return false;
+            }
+        }
+
+        if (ir_block->count == 0 || !ir_ends_block (&ir_block->insns[ir_block->count - 1])) {
+            if (block->succ[0] != CLV_SSA_NONE) {
+                emit (b, CLV_SSA_JMP, CLV_SSA_NO_REG, 0, 0);
+            } else {
+                emit (b, CLV_SSA_RET, CLV_SSA_NO_REG, CLV_SSA_NONE, 0);
+            }
+        }
+
+        break;
+    }
+
+    // operands of the phis of successors, for each edge from here
+    for (int k = 0; k < 2; k++) {
+        uint32_t s = block->succ[k];
+
+        if (s == CLV_SSA_NONE || (k == 1 && s == block->succ[0])) {
+            continue;
+        }
+
+        const clv_ssa_block_t *succ = &ssa->blocks[s];
+        uint32_t phis = regs_count (&b->phis[s]);
+
+        for (uint32_t p = 0; p < succ->pred_count; p++) {
+            if (ssa->preds[succ->first_pred + p] != i) {
+                continue;
+            }
+
+            for (uint32_t phi = succ->first; phi < succ->first + phis; phi++) {
+                ssa->operands[ssa->insns[phi].args[0] + p] = b->current[ssa->insns[phi].reg];
+            }
+        }
+    }
+
+    return true;
+}
+
+
+/* Renames registers to values down the dominator tree, each block seeing
+ * the definitions of those dominating it */
+static bool
+build_values (ssa_builder_t *b) {
+    uint32_t n = b->ssa->block_count;
+
+    rename_step_t *stack = clv_alloc (CLV_TAG_SSA, 2 * n * sizeof (*stack));
+    uint32_t sp = 0;
+
+    if (stack == NULL) {
+        return false;
+    }
+
+    stack[sp++] = (rename_step_t){ 0, CLV_SSA_NONE };
+
+    while (sp > 0) {
+        rename_step_t top = stack[--sp];
+
+        if (top.undo != CLV_SSA_NONE) {
+            while (b->undo_count > top.undo) {
+                rename_undo_t *u = &b->undo[--b->undo_count];
+
+                b->current[u->reg] = u->value;
+            }
+
+            continue;
+        }
+
+        uint32_t undo = b->undo_count;
+
+        if (!rename_block (b, top.block)) {
+            clv_free (stack);
+            return false;
+        }
+
+        stack[sp++] = (rename_step_t){ top.block, undo };
+
+        for (uint32_t k = b->dom_first[top.block + 1]; k-- > b->dom_first[top.block];) {
+            stack[sp++] = (rename_step_t){ b->dom[k], CLV_SSA_NONE };
+        }
+    }
+
+    clv_free (stack);
+
+    return true;
+}
+
+
+/* == Types == */
+
+
+static inline bool
+type_number (uint8_t type) {
+    return type == CLV_TYPE_INT || type == CLV_TYPE_FLOAT;
+}
+
+
+/* Static type of an instruction from those of its operands, SSA_UNSET
+ * while some are */
+static uint8_t
+infer_type (const clv_ssa_fn_t *self, const clv_ssa_insn_t *insn) {
+    uint8_t x = SSA_UNSET;
+    uint8_t y = SSA_UNSET;
+
+    switch (ops[insn->op].fmt) {
+    case CLV_SSA_FMT_VV:
+        y = self->insns[insn->args[1]].type;
+        // fall through
+    case CLV_SSA_FMT_V:
+    case CLV_SSA_FMT_VI:
+        x = (insn->args[0] != CLV_SSA_NONE) ? self->insns[insn->args[0]].type : CLV_TYPE_NIL;
+        break;
+
+    default:
+        break;
+    }
+
+    switch (insn->op) {
+    case CLV_SSA_NIL:
+        return CLV_TYPE_NIL;
+
+    case CLV_SSA_BOOL:
+    case CLV_SSA_EQ:
+    case CLV_SSA_NE:
+    case CLV_SSA_LT:
+    case CLV_SSA_LE:
+    case CLV_SSA_NOT:
+    case CLV_SSA_MORE:
+        return CLV_TYPE_BOOL;
+
+    case CLV_SSA_INT:
+    case CLV_SSA_ITER:
+    case CLV_SSA_STEP:
+        return CLV_TYPE_INT;
+
+    case CLV_SSA_TYPEOF:
+        return CLV_TYPE_STRING;
+
+    case CLV_SSA_CONST:
+        return self->source->constants[insn->args[0]].type;
+
+    case CLV_SSA_CAST:
+        return insn->args[1];
+
+    case CLV_SSA_PARAM:
+    case CLV_SSA_GETGLOBAL:
+    case CLV_SSA_CALL:
+        return CLV_SSA_ANY;
+
+    case CLV_SSA_SETGLOBAL:
+    case CLV_SSA_JMP:
+    case CLV_SSA_BRANCH:
+    case CLV_SSA_RET:
+        return CLV_SSA_VOID;
+
+    case CLV_SSA_PHI: {
+        uint8_t type = SSA_UNSET;
+
+        for (uint32_t k = 0; k < insn->args[1]; k++) {
+            uint8_t t = self->insns[self->operands[insn->args[0] + k]].type;
+
+            if (t != SSA_UNSET) {
+                type = (type == SSA_UNSET || type == t) ? t : CLV_SSA_ANY;
+            }
+        }
+
+        return type;
+    }
+
+    default:
+        break;
+    }
+
+    if (x == SSA_UNSET || (ops[insn->op].fmt == CLV_SSA_FMT_VV && y == SSA_UNSET)) {
+        return SSA_UNSET;
+    }
+
+    switch (insn->op) {
+    case CLV_SSA_ADD:
+        if (x == CLV_TYPE_STRING && y == CLV_TYPE_STRING) {
+            return CLV_TYPE_STRING;
+        }
+
+        // fall through
+    case CLV_SSA_SUB:
+    case CLV_SSA_MUL:
+    case CLV_SSA_DIV:
+    case CLV_SSA_MOD:
+        if (x == CLV_TYPE_INT && y == CLV_TYPE_INT) {
+            return CLV_TYPE_INT;
+        }
+
+        return (type_number (x) && type_number (y)) ? CLV_TYPE_FLOAT : CLV_SSA_ANY;
+
+    case CLV_SSA_BAND:
+    case CLV_SSA_BOR:
+    case CLV_SSA_BXOR:
+    case CLV_SSA_SHL:
+    case CLV_SSA_SHR:
+        return (x == CLV_TYPE_INT && y == CLV_TYPE_INT) ? CLV_TYPE_INT : CLV_SSA_ANY;
+
+    case CLV_SSA_NEG:
+        return type_number (x) ? x : CLV_SSA_ANY;
+
+    case CLV_SSA_BNOT:
+        return (x == CLV_TYPE_INT) ? CLV_TYPE_INT : CLV_SSA_ANY;
+
+    case CLV_SSA_UNWRAP:
+        return (x != CLV_TYPE_NIL) ? x : CLV_SSA_ANY;
+
+    case CLV_SSA_ELEM:
+        return (x == CLV_TYPE_INT) ? CLV_TYPE_INT : (x == CLV_TYPE_STRING) ? CLV_TYPE_CHAR : CLV_SSA_ANY;
+
+    default:
+        return CLV_SSA_ANY;
+    }
+}
+
+
+/* Types start unset and only go up to a known type, then to any, so
+ * inferring them again until none changes ends after a few rounds */
+static void
+build_types (clv_ssa_fn_t *ssa) {
+    for (bool changed = true; changed;) {
+        changed = false;
+
+        for (uint32_t i = 0; i < ssa->count; i++) {
+            uint8_t type = infer_type (ssa, &ssa->insns[i]);
+
+            if (type != ssa->insns[i].type) {
+                ssa->insns[i].type = type;
+                changed = true;
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < ssa->count; i++) {
+        if (ssa->insns[i].type == SSA_UNSET) {
+            ssa->insns[i].type = CLV_SSA_ANY;
+        }
+    }
+}
+
+
+/* == Building == */
+
+
+bool
+clv_ssa_build (const clv_function_t *fn, clv_ssa_fn_t *out_ssa) {
+    ssa_builder_t *b = clv_calloc (CLV_TAG_SSA, 1, sizeof (*b));
+
+    *out_ssa = (clv_ssa_fn_t){ .source = fn };
+
+    if (b == NULL) {
+        return false;
+    }
+
+    b->ssa = out_ssa;
+    b->registers = (fn->registers <= CLV_INSN_MAX_REG + 1) ? fn->registers : CLV_INSN_MAX_REG + 1;
+
+    bool good = clv_ir_build (fn, &b->ir) && build_blocks (b)
+        && (b->work = clv_alloc (CLV_TAG_SSA, out_ssa->block_count * sizeof (*b->work))) != NULL
+        && build_successors (b) && build_dominators (b) && build_liveness (b) && build_phis (b)
+        && build_layout (b) && build_values (b);
+
+    if (good) {
+        build_types (out_ssa);
+    } else {
+        int error = (errno == EINVAL) ? EINVAL : ENOMEM;
+
+        clv_ssa_free (out_ssa);
+        errno = error;
+    }
+
+    clv_ir_free (&b->ir);
+    clv_free (b->ssa_of);
+    clv_free (b->ir_of);
+    clv_free (b->kinds);
+    clv_free (b->rpo);
+    clv_free (b->rpo_index);
+    clv_free (b->df_first);
+    clv_free (b->df);
+    clv_free (b->dom_first);
+    clv_free (b->dom);
+    clv_free (b->uses);
+    clv_free (b->defs);
+    clv_free (b->live_in);
+    clv_free (b->phis);
+    clv_free (b->work);
+    clv_free (b->undo);
+    clv_free (b);
+
+    return good;
+}
+
+
+bool
+clv_ssa_uses (clv_ssa_fn_t *self) {
+    uint32_t *use_first = clv_calloc (CLV_TAG_SSA, self->count + 2, sizeof (*use_first));
+    uint32_t *uses = NULL;
+
+    if (use_first == NULL) {
+        return false;
+    }
+
+    // counted at v + 2, summed into starts at v + 1, which filling moves
+    // back to v
+    for (uint32_t i = 0; i < self->count; i++) {
+        uint32_t count;
+        const uint32_t *values = clv_ssa_operands (self, &self->insns[i], &count);
+
+        for (uint32_t k = 0; k < count; k++) {
+            use_first[values[k] + 2]++;
+        }
+    }
+
+    for (uint32_t v = 0; v < self->count; v++) {
+        use_first[v + 2] += use_first[v + 1];
+    }
+
+    uint32_t total = use_first[self->count + 1];
+
+    if ((uses = clv_alloc (CLV_TAG_SSA, (total + 1) * sizeof (*uses))) == NULL) {
+        clv_free (use_first);
+        return false;
+    }
+
+    for (uint32_t i = 0; i < self->count; i++) {
+        uint32_t count;
+        const uint32_t *values = clv_ssa_operands (self, &self->insns[i], &count);
+
+        for (uint32_t k = 0; k < count; k++) {
+            uses[use_first[values[k] + 1]++] = i;
+        }
+    }
+
+    clv_free (self->use_first);
+    clv_free (self->uses);
+
+    self->use_first = use_first;
+    self->uses = uses;
+
+    return true;
+}
+
+
+/* == Queries == */
+
+
+const uint32_t *
+clv_ssa_operands (const clv_ssa_fn_t *self, const clv_ssa_insn_t *insn, uint32_t *out_count) {
+    switch (ops[insn->op].fmt) {
+    case CLV_SSA_FMT_V:
+        *out_count = (insn->args[0] != CLV_SSA_NONE);
+        return &insn->args[0];
+
+    case CLV_SSA_FMT_VI:
+        *out_count = 1;
+        return &insn->args[0];
+
+    case CLV_SSA_FMT_IV:
+        *out_count = 1;
+        return &insn->args[1];
+
+    case CLV_SSA_FMT_VV:
+        *out_count = 2;
+        return &insn->args[0];
+
+    case CLV_SSA_FMT_LIST:
+        *out_count = insn->args[1];
+        return &self->operands[insn->args[0]];
+
+    default:
+        *out_count = 0;
+        return insn->args;
+    }
+}
+
+
+size_t
+clv_ssa_memory (const clv_ssa_fn_t *self) {
+    size_t size = self->count * (sizeof (*self->insns) + sizeof (*self->lines))
+        + self->block_count * sizeof (*self->blocks) + self->operand_count * sizeof (*self->operands);
+
+    for (uint32_t i = 0; i < self->block_count; i++) {
+        size += self->blocks[i].pred_count * sizeof (*self->preds);
+    }
+
+    if (self->use_first != NULL) {
+        size += (self->count + 2 + self->use_first[self->count]) * sizeof (*self->uses);
+    }
+
+    return size;
+}
+
+
+clv_str
+clv_ssa_op_name (clv_ssa_op_t op) {
+    return (op < CLV_SSA_OP_COUNT) ? ops[op].name : "???";
+}
+
+
+clv_ssa_fmt_t
+clv_ssa_format (clv_ssa_op_t op) {
+    return ops[op].fmt;
+}
+
+
+/* == Dump == */
+
+
+static void
+dump_type (clv_log_record_t *rec, uint8_t type) {
+    if (type == CLV_SSA_ANY) {
+        clv_log_append (rec, "any", 3);
+    } else {
+        clv_log_printf (rec, "%s", clv_type_name (type));
+    }
+}
+
+
+static void
+dump_insn (clv_log_record_t *rec, const clv_ssa_fn_t *self, uint32_t value) {
+    const clv_ssa_insn_t *insn = &self->insns[value];
+    const clv_ssa_block_t *block = &self->blocks[insn->block];
+
+    clv_log_printf (rec, "  [%4u]  ", self->lines[value]);
+
+    if (insn->type != CLV_SSA_VOID) {
+        clv_log_printf (rec, "v%u:", value);
+        dump_type (rec, insn->type);
+        clv_log_append (rec, " = ", 3);
+    }
+
+    clv_log_printf (rec, "%s", clv_ssa_op_name (insn->op));
+
+    switch (ops[insn->op].fmt) {
+    case CLV_SSA_FMT_I:
+        clv_log_printf (rec, " %d", (int32_t)insn->args[0]);
+        break;
+
+    case CLV_SSA_FMT_V:
+        if (insn->args[0] != CLV_SSA_NONE) {
+            clv_log_printf (rec, " v%u", insn->args[0]);
+        }
+
+        break;
+
+    case CLV_SSA_FMT_VV:
+        clv_log_printf (rec, " v%u, v%u", insn->args[0], insn->args[1]);
+        break;
+
+    case CLV_SSA_FMT_VI:
+        clv_log_printf (rec, " v%u, ", insn->args[0]);
+
+        if (insn->op == CLV_SSA_CAST) {
+            dump_type (rec, insn->args[1]);
+        } else {
+            clv_log_printf (rec, "%d", (int32_t)insn->args[1]);
+        }
+
+        break;
+
+    case CLV_SSA_FMT_IV:
+        clv_log_printf (rec, " %u, v%u", insn->args[0], insn->args[1]);
+        break;
+
+    case CLV_SSA_FMT_LIST:
+        for (uint32_t k = 0; k < insn->args[1]; k++) {
+            clv_log_printf (rec, (k == 0) ? " v%u" : ", v%u", self->operands[insn->args[0] + k]);
+        }
+
+        break;
+
+    default:
+        break;
+    }
+
+    if (insn->op == CLV_SSA_JMP || insn->op == CLV_SSA_BRANCH) {
+        clv_log_printf (rec, " -> b%u", block->succ[0]);
+
+        if (insn->op == CLV_SSA_BRANCH) {
+            clv_log_printf (rec, ", b%u", block->succ[1]);
+        }
+    }
+
+    if (insn->reg != CLV_SSA_NO_REG) {
+        clv_log_printf (rec, "\t; r%u", insn->reg);
+    }
+
+    clv_log_append (rec, "\n", 1);
+}
+
+
+void
+clv_ssa_dump (const clv_ssa_fn_t *self) {
+    clv_log_record_t rec;
+
+    clv_log_begin (&rec, CLV_INFO);
+    clv_log_printf (&rec, "ssa %s: %u blocks, %u values, %zu bytes\n",
+                    self->source->name, self->block_count, self->count, clv_ssa_memory (self));
+
+    for (uint32_t i = 0; i < self->block_count; i++) {
+        const clv_ssa_block_t *block = &self->blocks[i];
+
+        clv_log_printf (&rec, "b%u:", i);
+
+        for (uint32_t k = 0; k < block->pred_count; k++) {
+            clv_log_printf (&rec, (k == 0) ? " <- b%u" : ", b%u", self->preds[block->first_pred + k]);
+        }
+
+        if (block->idom != CLV_SSA_NONE) {
+            clv_log_printf (&rec, "\t; idom b%u", block->idom);
+        }
+
+        clv_log_append (&rec, "\n", 1);
+
+        for (uint32_t v = block->first; v < block->first + block->count; v++) {
+            dump_insn (&rec, self, v);
+        }
+
+        // keep the record bounded on large functions
+        if (rec.length >= DUMP_RECORD_SIZE) {
+            clv_log_end (&rec);
+            clv_log_begin (&rec, CLV_INFO);
+        }
+    }
+
+    clv_log_end (&rec);
+}
+
+
+void
+clv_ssa_free (clv_ssa_fn_t *self) {
+    clv_free (self->insns);
+    clv_free (self->lines);
+    clv_free (self->blocks);
+    clv_free (self->operands);
+    clv_free (self->preds);
+    clv_free (self->use_first);
+    clv_free (self->uses);
+
+    *self = (clv_ssa_fn_t){ .source = self->source };
+}
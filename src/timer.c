@@ -0,0 +1,486 @@
+#include <clover/timer.h>
+#include <clover/intern.h>
+#include <clover/log.h>
+#include <clover/alloc.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/resource.h>
+
+#if defined (__GLIBC__)
+#include <malloc.h>
+#endif /* __GLIBC__ */
+
+#define TIMER_DEPTH         32
+#define TIMER_MIN_CAPACITY  256
+
+
+static const clv_str timer_phases[CLV_PHASES] = {
+    [CLV_PHASE_BUILD]    = "build",
+    [CLV_PHASE_READ]     = "read",
+    [CLV_PHASE_LEX]      = "lex",
+    [CLV_PHASE_PARSE]    = "parse",
+    [CLV_PHASE_DECLARE]  = "declare",
+    [CLV_PHASE_CHECK]    = "check",
+    [CLV_PHASE_LOWER]    = "lower",
+    [CLV_PHASE_OPTIMIZE] = "optimize",
+    [CLV_PHASE_EMIT]     = "emit",
+    [CLV_PHASE_SSA]      = "ssa",
+    [CLV_PHASE_REGALLOC] = "regalloc",
+    [CLV_PHASE_CACHE]    = "cache",
+    [CLV_PHASE_LINK]     = "link",
+};
+
+
+/* Closed scope. Self figures leave out the scopes nested in it. */
+typedef struct {
+    uint8_t phase;
+    uint8_t depth;
+    clv_atom_t unit;
+
+    uint64_t start;         /* ns since timing started */
+    uint64_t wall;
+    uint64_t cpu;
+    uint64_t self_wall;
+    uint64_t self_cpu;
+    int64_t alloc;          /* in bytes, or the growth of the heap */
+    int64_t self_alloc;
+    long rss;               /* peak of the process so far, in kB */
+} timer_event_t;
+
+
+/* Open scope */
+typedef struct {
+    uint8_t phase;
+    clv_atom_t unit;
+
+    uint64_t wall;
+    uint64_t cpu;
+    int64_t heap;
+
+    uint64_t child_wall;
+    uint64_t child_cpu;
+    int64_t child_alloc;
+} timer_frame_t;
+
+
+/* Scopes of a thread, kept after it exits until timing stops */
+typedef struct timer_thread {
+    struct timer_thread *next;
+    uint32_t id;
+
+    timer_frame_t frames[TIMER_DEPTH];
+    uint32_t depth;         /* may go past TIMER_DEPTH, whose scopes are lost */
+
+    timer_event_t *events;
+    uint32_t count;
+    uint32_t capacity;
+} timer_thread_t;
+
+
+bool _clv_timer_on = false;
+
+static struct {
+    pthread_mutex_t lock;
+
+    timer_thread_t *threads;
+    uint32_t count;
+
+    uint64_t epoch;
+} timer = { PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0 };
+
+static _Thread_local timer_thread_t *timer_self = NULL;
+
+
+/* == Clocks == */
+
+
+static inline uint64_t
+timer_clock (clockid_t clock) {
+    struct timespec ts;
+
+    clock_gettime (clock, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+
+/* Bytes the calling thread allocated so far, when tracking allocations,
+ * or else bytes the heap hands out. The heap is shared, so scopes of units
+ * built in parallel then count what the others allocate meanwhile. */
+static inline int64_t
+timer_heap () {
+    if (clv_alloc_tracking ()) {
+        return clv_alloc_thread_bytes ();
+    }
+
+#if defined (__GLIBC__)
+    struct mallinfo2 info = mallinfo2 ();
+
+    return info.uordblks + info.hblkhd;
+#else
+    return 0;
+#endif /* __GLIBC__ */
+}
+
+
+static inline long
+timer_rss () {
+    struct rusage usage;
+
+    return (getrusage (RUSAGE_SELF, &usage) == 0) ? usage.ru_maxrss : 0;
+}
+
+
+/* == Scopes == */
+
+
+static timer_thread_t *
+timer_thread () {
+    if (timer_self != NULL) {
+        return timer_self;
+    }
+
+    timer_thread_t *t = clv_calloc (CLV_TAG_MISC, 1, sizeof (*t));
+
+    if (t == NULL) {
+        return NULL;
+    }
+
+    pthread_mutex_lock (&timer.lock);
+    t->id = timer.count++;
+    t->next = timer.threads;
+    timer.threads = t;
+    pthread_mutex_unlock (&timer.lock);
+
+    return timer_self = t;
+}
+
+
+void
+_clv_timer_begin (clv_phase_t phase, clv_str unit) {
+    timer_thread_t *t = timer_thread ();
+
+    if (t == NULL) {
+        return;
+    }
+
+    if (t->depth++ >= TIMER_DEPTH) {
+        return;
+    }
+
+    timer_frame_t *frame = &t->frames[t->depth - 1];
+
+    frame->phase = phase;
+    frame->unit = (unit != NULL) ? clv_intern (unit, strlen (unit))
+                : (t->depth > 1) ? frame[-1].unit : CLV_ATOM_NONE;
+    frame->child_wall = 0;
+    frame->child_cpu = 0;
+    frame->child_alloc = 0;
+
+    // clocks last, to leave out the time taken to get here
+    frame->heap = timer_heap ();
+    frame->cpu = timer_clock (CLOCK_THREAD_CPUTIME_ID);
+    frame->wall = timer_clock (CLOCK_MONOTONIC);
+}
+
+
+void
+_clv_timer_end () {
+    uint64_t wall = timer_clock (CLOCK_MONOTONIC);
+    uint64_t cpu = timer_clock (CLOCK_THREAD_CPUTIME_ID);
+    int64_t heap = timer_heap ();
+    timer_thread_t *t = timer_self;
+
+    if (t == NULL || t->depth == 0 || t->depth-- > TIMER_DEPTH) {
+        return;
+    }
+
+    timer_frame_t *frame = &t->frames[t->depth];
+    timer_event_t event = {
+        .phase = frame->phase,
+        .depth = t->depth,
+        .unit = frame->unit,
+        .start = frame->wall - timer.epoch,
+        .wall = wall - frame->wall,
+        .cpu = cpu - frame->cpu,
+        .alloc = heap - frame->heap,
+        .rss = timer_rss ()
+    };
+
+    event.self_wall = event.wall - frame->child_wall;
+    event.self_cpu = event.cpu - frame->child_cpu;
+    event.self_alloc = event.alloc - frame->child_alloc;
+
+    if (t->depth > 0) {
+        frame[-1].child_wall += event.wall;
+        frame[-1].child_cpu += event.cpu;
+        frame[-1].child_alloc += event.alloc;
+    }
+
+    if (t->count == t->capacity) {
+        uint32_t capacity = (t->capacity > 0) ? 2 * t->capacity : TIMER_MIN_CAPACITY;
+        timer_event_t *events = clv_realloc (CLV_TAG_MISC, t->events, capacity * sizeof (*events));
+
+        // out of memory, the scope is lost
+        if (events == NULL) {
+            return;
+        }
+
+        t->events = events;
+        t->capacity = capacity;
+    }
+
+    t->events[t->count++] = event;
+}
+
+
+void
+clv_timer_enable () {
+    timer.epoch = timer_clock (CLOCK_MONOTONIC);
+    _clv_timer_on = true;
+}
+
+
+clv_str
+clv_timer_phase (clv_phase_t phase) {
+    return (phase < CLV_PHASES) ? timer_phases[phase] : "???";
+}
+
+
+/* == Report == */
+
+
+typedef struct {
+    clv_atom_t unit;
+    uint64_t wall;
+    uint64_t cpu;
+    int64_t alloc;
+    long rss;
+    uint32_t scopes;
+} timer_total_t;
+
+
+static int
+total_compare_unit (const void *a, const void *b) {
+    const timer_total_t *x = a;
+    const timer_total_t *y = b;
+
+    return (x->unit > y->unit) - (x->unit < y->unit);
+}
+
+
+// slowest first
+static int
+total_compare_wall (const void *a, const void *b) {
+    const timer_total_t *x = a;
+    const timer_total_t *y = b;
+
+    return (x->wall < y->wall) - (x->wall > y->wall);
+}
+
+
+static void
+report_row (clv_log_record_t *rec, clv_str name, const timer_total_t *total, uint64_t elapsed) {
+    clv_log_printf (rec, "  %-24.24s %10.3f %6.1f %10.3f %12.1f %10ld %7u\n", name, total->wall * 1e-6,
+                    (elapsed > 0) ? 100.0 * total->wall / elapsed : 0.0, total->cpu * 1e-6, total->alloc / 1024.0,
+                    total->rss, total->scopes);
+}
+
+
+/* Totals of units, on the self figures of their scopes so they add up */
+static void
+report_units (clv_log_record_t *rec, uint64_t elapsed, uint32_t count) {
+    timer_total_t *totals = clv_alloc (CLV_TAG_MISC, count * sizeof (*totals));
+    uint32_t n = 0;
+
+    if (totals == NULL) {
+        return;
+    }
+
+    for (timer_thread_t *t = timer.threads; t != NULL; t = t->next) {
+        for (uint32_t i = 0; i < t->count; i++) {
+            timer_event_t *e = &t->events[i];
+
+            if (e->unit != CLV_ATOM_NONE) {
+                totals[n++] = (timer_total_t){ e->unit, e->self_wall, e->self_cpu, e->self_alloc, e->rss, 1 };
+            }
+        }
+    }
+
+    qsort (totals, n, sizeof (*totals), total_compare_unit);
+
+    uint32_t units = 0;
+
+    for (uint32_t i = 0; i < n; i++) {
+        if (units == 0 || totals[units - 1].unit != totals[i].unit) {
+            totals[units++] = totals[i];
+        } else {
+            timer_total_t *total = &totals[units - 1];
+
+            total->wall += totals[i].wall;
+            total->cpu += totals[i].cpu;
+            total->alloc += totals[i].alloc;
+            total->rss = (totals[i].rss > total->rss) ? totals[i].rss : total->rss;
+            total->scopes++;
+        }
+    }
+
+    qsort (totals, units, sizeof (*totals), total_compare_wall);
+
+    if (units > 0) {
+        clv_log_printf (rec, "\n  %-24s %10s %6s %10s %12s %10s %7s\n", "unit", "wall ms", "%", "cpu ms",
+                        "alloc kB", "rss kB", "scopes");
+    }
+
+    for (uint32_t i = 0; i < units; i++) {
+        clv_str file = clv_atom_string (totals[i].unit);
+        size_t length = strlen (file);
+
+        // the end of long paths tells units apart
+        report_row (rec, (length > 24) ? file + length - 24 : file, &totals[i], elapsed);
+    }
+
+    clv_free (totals);
+}
+
+
+void
+clv_timer_report () {
+    timer_total_t phases[CLV_PHASES] = { 0 };
+    uint32_t count = 0;
+
+    for (timer_thread_t *t = timer.threads; t != NULL; t = t->next) {
+        for (uint32_t i = 0; i < t->count; i++) {
+            timer_event_t *e = &t->events[i];
+            timer_total_t *total = &phases[e->phase];
+
+            total->wall += e->wall;
+            total->cpu += e->cpu;
+            total->alloc += e->alloc;
+            total->rss = (e->rss > total->rss) ? e->rss : total->rss;
+            total->scopes++;
+        }
+
+        count += t->count;
+    }
+
+    uint64_t elapsed = phases[CLV_PHASE_BUILD].wall;
+    clv_log_record_t rec;
+
+    // like diagnostics, on stderr
+    clv_log_begin (&rec, CLV_ERROR);
+    clv_log_printf (&rec, "time report, over %u threads (phases take in those they nest, and units building in "
+                    "parallel add up past 100%%):\n\n", timer.count);
+    clv_log_printf (&rec, "  %-24s %10s %6s %10s %12s %10s %7s\n", "phase", "wall ms", "%", "cpu ms", "alloc kB",
+                    "rss kB", "scopes");
+
+    for (uint32_t p = 0; p < CLV_PHASES; p++) {
+        if (phases[p].scopes > 0) {
+            report_row (&rec, timer_phases[p], &phases[p], elapsed);
+        }
+    }
+
+    report_units (&rec, elapsed, count);
+    clv_log_end (&rec);
+}
+
+
+/* == Trace == */
+
+
+static void
+trace_string (FILE *out, clv_str s) {
+    fputc ('"', out);
+
+    for (; *s != '\0'; s++) {
+        unsigned char c = *s;
+
+        if (c == '"' || c == '\\') {
+            fprintf (out, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf (out, "\\u%04x", c);
+        } else {
+            fputc (c, out);
+        }
+    }
+
+    fputc ('"', out);
+}
+
+
+bool
+clv_timer_trace (clv_str file) {
+    FILE *out = fopen (file, "w");
+
+    if (out == NULL) {
+        return false;
+    }
+
+    int pid = getpid ();
+    bool first = true;
+
+    fputs ("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", out);
+
+    for (timer_thread_t *t = timer.threads; t != NULL; t = t->next) {
+        fprintf (out, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":",
+                 first ? "" : ",", pid, t->id);
+        trace_string (out, (t->id == 0) ? "main" : "worker");
+        fputs ("}}", out);
+        first = false;
+
+        for (uint32_t i = 0; i < t->count; i++) {
+            timer_event_t *e = &t->events[i];
+
+            fprintf (out, ",\n{\"name\":\"%s\",\"cat\":\"build\",\"ph\":\"X\",\"pid\":%d,\"tid\":%u,"
+                     "\"ts\":%.3f,\"dur\":%.3f,\"args\":{", timer_phases[e->phase], pid, t->id, e->start * 1e-3,
+                     e->wall * 1e-3);
+
+            if (e->unit != CLV_ATOM_NONE) {
+                fputs ("\"unit\":", out);
+                trace_string (out, clv_atom_string (e->unit));
+                fputc (',', out);
+            }
+
+            fprintf (out, "\"cpu_us\":%.3f,\"alloc\":%lld,\"rss_kb\":%ld}}", e->cpu * 1e-3, (long long)e->alloc,
+                     e->rss);
+        }
+    }
+
+    fputs ("\n]}\n", out);
+
+    bool good = !ferror (out);
+
+    if (fclose (out) != 0 || !good) {
+        errno = (errno != 0) ? errno : EIO;
+        return false;
+    }
+
+    return true;
+}
+
+
+void
+clv_timer_free () {
+    _clv_timer_on = false;
+
+    pthread_mutex_lock (&timer.lock);
+
+    while (timer.threads != NULL) {
+        timer_thread_t *t = timer.threads;
+
+        timer.threads = t->next;
+        clv_free (t->events);
+        clv_free (t);
+    }
+
+    timer.count = 0;
+    pthread_mutex_unlock (&timer.lock);
+
+    timer_self = NULL;
+}
@@ -0,0 +1,159 @@
+#include <clover/token.h>
+#include <clover/alloc.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#define TOKENS_MIN_CAPACITY     64
+
+
+struct clv_tokens {
+    clv_token_t *data;
+    size_t length;
+    size_t capacity;
+
+    clv_arena_t *arena;     /* owner of data and of the stream, if any */
+};
+
+
+clv_tokens_t *
+clv_tokens_new (size_t hint, clv_arena_t *arena) {
+    clv_tokens_t *tokens = (arena != NULL) ? clv_arena_alloc (arena, sizeof (*tokens))
+                         : clv_alloc (CLV_TAG_LEXER, sizeof (*tokens));
+
+    if (tokens == NULL) {
+        return NULL;
+    }
+
+    tokens->data = NULL;
+    tokens->length = 0;
+    tokens->capacity = 0;
+    tokens->arena = arena;
+
+    if (!clv_tokens_reserve (tokens, hint)) {
+        clv_tokens_free (tokens);
+        return NULL;
+    }
+
+    return tokens;
+}
+
+
+bool
+clv_tokens_reserve (clv_tokens_t *self, size_t capacity) {
+    if (self == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+
+    if (capacity <= self->capacity) {
+        return true;
+    }
+
+    if (capacity < TOKENS_MIN_CAPACITY) {
+        capacity = TOKENS_MIN_CAPACITY;
+    }
+
+    if (capacity > SIZE_MAX / sizeof (*self->data)) {
+        errno = EOVERFLOW;
+        return false;
+    }
+
+    clv_token_t *data;
+
+    if (self->arena != NULL) {
+        data = clv_arena_realloc (self->arena, self->data, self->capacity * sizeof (*data), capacity * sizeof (*data));
+    } else {
+        data = clv_realloc (CLV_TAG_LEXER, self->data, capacity * sizeof (*data));
+    }
+
+    if (data == NULL) {
+        return false;
+    }
+
+    self->data = data;
+    self->capacity = capacity;
+
+    return true;
+}
+
+
+bool
+clv_tokens_push_back (clv_tokens_t *self, const clv_token_t *token) {
+    if (self == NULL || token == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+
+    // grow geometrically, so pushes are amortized O(1)
+    size_t capacity = (self->capacity == 0) ? TOKENS_MIN_CAPACITY : self->capacity * 2;
+
+    if (self->length == self->capacity && !clv_tokens_reserve (self, capacity)) {
+        return false;
+    }
+
+    self->data[self->length++] = *token;
+
+    return true;
+}
+
+
+clv_token_t *
+clv_tokens_at (clv_tokens_t *self, size_t index) {
+    if (self == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (index >= self->length) {
+        errno = EOVERFLOW;
+        return NULL;
+    }
+
+    return &self->data[index];
+}
+
+
+clv_token_t *
+clv_tokens_data (clv_tokens_t *self) {
+    if (self == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    return self->data;
+}
+
+
+size_t
+clv_tokens_length (clv_tokens_t *self) {
+    if (self == NULL) {
+        errno = EINVAL;
+        return 0;
+    }
+
+    return self->length;
+}
+
+
+void
+clv_tokens_clear (clv_tokens_t *self) {
+    if (self == NULL) {
+        errno = EINVAL;
+        return;
+    }
+
+    self->length = 0;
+}
+
+
+void
+clv_tokens_free (clv_tokens_t *self) {
+    if (self == NULL || self->arena != NULL) {
+        return;
+    }
+
+    clv_free (self->data);
+    clv_free (self);
+}
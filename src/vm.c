@@ -0,0 +1,1247 @@
+#include <clover/vm.h>
+#include <clover/runtime.h>
+#include <clover/jit.h>
+#include <clover/log.h>
+#include <clover/alloc.h>
+
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <inttypes.h>
+#include <math.h>
+#include <errno.h>
+
+/* Dispatch through a table of labels, a GNU extension, unless told not to */
+#if defined (__GNUC__) && !defined (CLV_VM_NO_COMPUTED_GOTO)
+#define VM_COMPUTED_GOTO        1
+#else
+#define VM_COMPUTED_GOTO        0
+#endif
+
+#define VM_GC_MIN_THRESHOLD     (1024 * 1024)   /* bytes allocated before the first collection */
+
+#define VM_MESSAGE_SIZE         256
+
+#define VM_BACKTRACE_DEPTH      16
+
+#define VM_JIT_THRESHOLD        1000    /* calls and backward jumps before compiling */
+
+#define VM_FORMAT_SIZE          64      /* longest formatted scalar */
+
+
+typedef struct {
+    const clv_function_t *fn;
+    clv_value_t *constants;
+
+    clv_jit_code_t *jit;
+    uint32_t hotness;
+} vm_function_t;
+
+
+typedef struct {
+    vm_function_t *fn;
+    const clv_insn_t *pc;   /* next instruction, saved on calls and errors */
+    clv_value_t *base;
+} vm_frame_t;
+
+
+struct clv_vm {
+    clv_module_t *module;
+
+    vm_function_t *functions;
+    uint32_t function_count;
+
+    clv_value_t *globals;
+    uint32_t global_count;
+
+    clv_value_t *stack;
+    vm_frame_t *frames;
+    vm_frame_t *frame;      /* innermost */
+
+    /* heap */
+    clv_object_t *objects;
+    clv_object_t *permanent;
+    size_t allocated;
+    size_t threshold;
+
+    clv_string_t *type_names[CLV_TYPE_COUNT];
+
+    clv_vm_stats_t stats;
+    FILE *out;
+    bool jit;
+    unsigned jit_features;
+
+    char message[VM_MESSAGE_SIZE];
+};
+
+
+static const clv_str arith_symbols[CLV_OP_COUNT] = {
+    [CLV_OP_ADD]  = "+",
+    [CLV_OP_SUB]  = "-",
+    [CLV_OP_MUL]  = "*",
+    [CLV_OP_DIV]  = "/",
+    [CLV_OP_MOD]  = "%",
+    [CLV_OP_ADDI] = "+",
+    [CLV_OP_BAND] = "&",
+    [CLV_OP_BOR]  = "|",
+    [CLV_OP_BXOR] = "^",
+    [CLV_OP_SHL]  = "<<",
+    [CLV_OP_SHR]  = ">>",
+    [CLV_OP_LT]   = "<",
+    [CLV_OP_LE]   = "<=",
+    [CLV_OP_NEG]  = "-",
+    [CLV_OP_BNOT] = "~",
+};
+
+
+#define VALUE_NIL           ((clv_value_t){ .type = CLV_TYPE_NIL })
+#define VALUE_BOOL(x)       ((clv_value_t){ .type = CLV_TYPE_BOOL, .as.b = (x) })
+#define VALUE_INT(x)        ((clv_value_t){ .type = CLV_TYPE_INT, .as.i = (x) })
+#define VALUE_FLOAT(x)      ((clv_value_t){ .type = CLV_TYPE_FLOAT, .as.f = (x) })
+#define VALUE_CHAR(x)       ((clv_value_t){ .type = CLV_TYPE_CHAR, .as.c = (x) })
+#define VALUE_OBJECT(t,x)   ((clv_value_t){ .type = (t), .as.object = (clv_object_t *)(x) })
+
+#define AS_STRING(v)        ((clv_string_t *)(v)->as.object)
+
+/* Integer arithmetic wraps around */
+#define INT_WRAP(a,op,b)    ((int64_t)((uint64_t)(a) op (uint64_t)(b)))
+
+
+/* == Values == */
+
+
+static inline bool
+value_falsy (const clv_value_t *value) {
+    return value->type == CLV_TYPE_NIL || (value->type == CLV_TYPE_BOOL && !value->as.b);
+}
+
+
+static inline bool
+value_number (const clv_value_t *value, double *out_number) {
+    if (value->type == CLV_TYPE_INT) {
+        *out_number = (double)value->as.i;
+    } else if (value->type == CLV_TYPE_FLOAT) {
+        *out_number = value->as.f;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+
+static bool
+value_equal (const clv_value_t *a, const clv_value_t *b) {
+    double x, y;
+
+    if (a->type != b->type) {
+        return value_number (a, &x) && value_number (b, &y) && x == y;
+    }
+
+    switch (a->type) {
+    case CLV_TYPE_NIL:
+        return true;
+
+    case CLV_TYPE_BOOL:
+        return a->as.b == b->as.b;
+
+    case CLV_TYPE_INT:
+        return a->as.i == b->as.i;
+
+    case CLV_TYPE_FLOAT:
+        return a->as.f == b->as.f;
+
+    case CLV_TYPE_CHAR:
+        return a->as.c == b->as.c;
+
+    case CLV_TYPE_STRING:
+        return AS_STRING (a)->length == AS_STRING (b)->length
+            && memcmp (AS_STRING (a)->data, AS_STRING (b)->data, AS_STRING (a)->length) == 0;
+
+    default:
+        return a->as.index == b->as.index;
+    }
+}
+
+
+/* Decodes the code point at `p`, and returns its length. Invalid
+ * sequences decode as U+FFFD, one byte at a time. */
+static size_t
+utf8_decode (const unsigned char *p, size_t length, uint32_t *out_c) {
+    size_t count;
+    uint32_t c;
+
+    if (p[0] < 0x80) {
+        *out_c = p[0];
+        return 1;
+    } else if ((p[0] & 0xe0) == 0xc0) {
+        count = 2;
+        c = p[0] & 0x1f;
+    } else if ((p[0] & 0xf0) == 0xe0) {
+        count = 3;
+        c = p[0] & 0x0f;
+    } else if ((p[0] & 0xf8) == 0xf0) {
+        count = 4;
+        c = p[0] & 0x07;
+    } else {
+        count = 0;
+        c = 0;
+    }
+
+    for (size_t i = 1; i < count; i++) {
+        if (i >= length || (p[i] & 0xc0) != 0x80) {
+            count = 0;
+            break;
+        }
+
+        c = (c << 6) | (p[i] & 0x3f);
+    }
+
+    if (count == 0) {
+        *out_c = 0xfffd;
+        return 1;
+    }
+
+    *out_c = c;
+
+    return count;
+}
+
+
+/* Formats scalars, and returns the length of the text */
+static size_t
+value_format (clv_vm_t *vm, const clv_value_t *value, char buffer[VM_FORMAT_SIZE]) {
+    int length = 0;
+
+    switch (value->type) {
+    case CLV_TYPE_NIL:
+        length = snprintf (buffer, VM_FORMAT_SIZE, "nil");
+        break;
+
+    case CLV_TYPE_BOOL:
+        length = snprintf (buffer, VM_FORMAT_SIZE, value->as.b ? "true" : "false");
+        break;
+
+    case CLV_TYPE_INT:
+        length = snprintf (buffer, VM_FORMAT_SIZE, "%" PRId64, value->as.i);
+        break;
+
+    case CLV_TYPE_FLOAT:
+        // the shortest text that reads back as the same number
+        for (int precision = 15; precision <= 17; precision++) {
+            length = snprintf (buffer, VM_FORMAT_SIZE, "%.*g", precision, value->as.f);
+
+            if (strtod (buffer, NULL) == value->as.f) {
+                break;
+            }
+        }
+
+        if (isfinite (value->as.f) && strpbrk (buffer, ".e") == NULL) {
+            length += snprintf (buffer + length, VM_FORMAT_SIZE - length, ".0");
+        }
+
+        break;
+
+    case CLV_TYPE_CHAR:
+        length = clv_utf8_encode (value->as.c, buffer);
+        break;
+
+    case CLV_TYPE_FN:
+        length = snprintf (buffer, VM_FORMAT_SIZE, "<fn %s>", vm->functions[value->as.index].fn->name);
+        break;
+
+    case CLV_TYPE_NATIVE: {
+        const clv_native_t *native = clv_native_get (value->as.index);
+
+        length = snprintf (buffer, VM_FORMAT_SIZE, "<fn %s.%s>", native->module, native->name);
+        break;
+    }
+
+    default:
+        length = snprintf (buffer, VM_FORMAT_SIZE, "<%s>", clv_type_name (value->type));
+        break;
+    }
+
+    return (length < VM_FORMAT_SIZE) ? (size_t)length : VM_FORMAT_SIZE - 1;
+}
+
+
+void
+clv_vm_print (clv_vm_t *self, const clv_value_t *value, FILE *out) {
+    char buffer[VM_FORMAT_SIZE];
+
+    if (value->type == CLV_TYPE_STRING) {
+        fwrite (AS_STRING (value)->data, 1, AS_STRING (value)->length, out);
+    } else {
+        fwrite (buffer, 1, value_format (self, value, buffer), out);
+    }
+}
+
+
+/* == Heap == */
+
+
+static void
+vm_mark_values (clv_value_t *values, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (values[i].type == CLV_TYPE_STRING) {
+            values[i].as.object->marked = true;
+        }
+    }
+}
+
+
+static void
+vm_collect (clv_vm_t *vm) {
+    // registers past the innermost frame are dead
+    if (vm->frame != NULL) {
+        clv_value_t *top = vm->frame->base + vm->frame->fn->fn->registers;
+
+        vm_mark_values (vm->stack, top - vm->stack);
+    }
+
+    vm_mark_values (vm->globals, vm->global_count);
+
+    clv_object_t **link = &vm->objects;
+
+    while (*link != NULL) {
+        clv_object_t *object = *link;
+
+        if (object->marked) {
+            object->marked = false;
+            link = &object->next;
+            continue;
+        }
+
+        *link = object->next;
+        vm->allocated -= sizeof (clv_string_t) + ((clv_string_t *)object)->length + 1;
+        clv_free (object);
+    }
+
+    vm->threshold = (vm->allocated * 2 > VM_GC_MIN_THRESHOLD) ? vm->allocated * 2 : VM_GC_MIN_THRESHOLD;
+    vm->stats.collections++;
+}
+
+
+static clv_string_t *
+vm_alloc_string (clv_vm_t *vm, size_t length, bool permanent) {
+    size_t size = sizeof (clv_string_t) + length + 1;
+
+    if (!permanent && vm->allocated + size > vm->threshold) {
+        vm_collect (vm);
+    }
+
+    clv_string_t *string = clv_alloc (CLV_TAG_VM, size);
+
+    if (string == NULL) {
+        return NULL;
+    }
+
+    string->object = (clv_object_t){ .type = CLV_TYPE_STRING, .permanent = permanent };
+    string->length = length;
+    string->data[length] = '\0';
+
+    if (permanent) {
+        string->object.next = vm->permanent;
+        vm->permanent = &string->object;
+    } else {
+        string->object.next = vm->objects;
+        vm->objects = &string->object;
+        vm->allocated += size;
+    }
+
+    return string;
+}
+
+
+clv_string_t *
+clv_vm_new_string (clv_vm_t *self, const char *data, size_t length) {
+    clv_string_t *string = vm_alloc_string (self, length, false);
+
+    if (string != NULL) {
+        memcpy (string->data, data, length);
+    }
+
+    return string;
+}
+
+
+static void
+vm_free_objects (clv_object_t *object) {
+    while (object != NULL) {
+        clv_object_t *next = object->next;
+
+        clv_free (object);
+        object = next;
+    }
+}
+
+
+/* == Errors == */
+
+
+bool
+clv_vm_error (clv_vm_t *self, clv_str fmt, ...) {
+    va_list args;
+
+    va_start (args, fmt);
+    vsnprintf (self->message, sizeof (self->message), fmt, args);
+    va_end (args);
+
+    return false;
+}
+
+
+static inline uint32_t
+vm_frame_line (vm_frame_t *frame) {
+    const clv_function_t *fn = frame->fn->fn;
+
+    return (frame->pc > fn->code) ? fn->lines[frame->pc - fn->code - 1] : 0;
+}
+
+
+/* Functions linked from other modules have lines in files of their own */
+static inline clv_str
+vm_frame_file (vm_frame_t *frame, clv_str module_file) {
+    return (frame->fn->fn->file != NULL) ? frame->fn->fn->file : module_file;
+}
+
+
+/* Reports the error set by clv_vm_error, and where it happened */
+static void
+vm_report (clv_vm_t *vm) {
+    clv_log_record_t rec;
+
+    clv_str file = clv_module_get_file (vm->module);
+
+    // what the program printed comes first, wherever its output goes
+    fflush (clv_vm_output (vm));
+
+    clv_log_begin (&rec, CLV_ERROR);
+    clv_log_printf (&rec, "%s:%u: runtime error: %s\n", vm_frame_file (vm->frame, file), vm_frame_line (vm->frame),
+                    vm->message);
+
+    int depth = 0;
+
+    for (vm_frame_t *frame = vm->frame; frame >= vm->frames; frame--, depth++) {
+        if (depth == VM_BACKTRACE_DEPTH) {
+            clv_log_printf (&rec, "  ... %td more\n", frame - vm->frames + 1);
+            break;
+        }
+
+        clv_log_printf (&rec, "  at %s (%s:%u)\n", frame->fn->fn->name, vm_frame_file (frame, file), vm_frame_line (frame));
+    }
+
+    clv_log_end (&rec);
+}
+
+
+/* == Operations == */
+
+
+static bool
+vm_concat (clv_vm_t *vm, clv_value_t *dst, const clv_value_t *b, const clv_value_t *c) {
+    size_t length = AS_STRING (b)->length + AS_STRING (c)->length;
+    clv_string_t *string = vm_alloc_string (vm, length, false);
+
+    if (string == NULL) {
+        return clv_vm_error (vm, "out of memory");
+    }
+
+    memcpy (string->data, AS_STRING (b)->data, AS_STRING (b)->length);
+    memcpy (string->data + AS_STRING (b)->length, AS_STRING (c)->data, AS_STRING (c)->length);
+
+    *dst = VALUE_OBJECT (CLV_TYPE_STRING, string);
+
+    return true;
+}
+
+
+/* Slow path of arithmetic, bitwise and ordering operators */
+static bool
+vm_arith (clv_vm_t *vm, clv_opcode_t op, clv_value_t *dst, const clv_value_t *b, const clv_value_t *c) {
+    double x, y;
+
+    if (b->type == CLV_TYPE_INT && c->type == CLV_TYPE_INT) {
+        int64_t i = b->as.i;
+        int64_t j = c->as.i;
+
+        switch (op) {
+        case CLV_OP_ADD:  *dst = VALUE_INT (INT_WRAP (i, +, j)); return true;
+        case CLV_OP_SUB:  *dst = VALUE_INT (INT_WRAP (i, -, j)); return true;
+        case CLV_OP_MUL:  *dst = VALUE_INT (INT_WRAP (i, *, j)); return true;
+        case CLV_OP_BAND: *dst = VALUE_INT (i & j); return true;
+        case CLV_OP_BOR:  *dst = VALUE_INT (i | j); return true;
+        case CLV_OP_BXOR: *dst = VALUE_INT (i ^ j); return true;
+        case CLV_OP_SHL:  *dst = VALUE_INT (INT_WRAP (i, <<, j & 63)); return true;
+        case CLV_OP_SHR:  *dst = VALUE_INT (i >> (j & 63)); return true;
+        case CLV_OP_LT:   *dst = VALUE_BOOL (i < j); return true;
+        case CLV_OP_LE:   *dst = VALUE_BOOL (i <= j); return true;
+
+        case CLV_OP_DIV:
+        case CLV_OP_MOD:
+            if (j == 0) {
+                return clv_vm_error (vm, "division by zero");
+            }
+
+            // the one quotient that doesn't fit wraps around
+            if (j == -1) {
+                *dst = VALUE_INT ((op == CLV_OP_DIV) ? INT_WRAP (0, -, i) : 0);
+            } else {
+                *dst = VALUE_INT ((op == CLV_OP_DIV) ? i / j : i % j);
+            }
+
+            return true;
+
+        default:
+            break;
+        }
+    } else if (value_number (b, &x) && value_number (c, &y)) {
+        switch (op) {
+        case CLV_OP_ADD: *dst = VALUE_FLOAT (x + y); return true;
+        case CLV_OP_SUB: *dst = VALUE_FLOAT (x - y); return true;
+        case CLV_OP_MUL: *dst = VALUE_FLOAT (x * y); return true;
+        case CLV_OP_DIV: *dst = VALUE_FLOAT (x / y); return true;
+        case CLV_OP_MOD: *dst = VALUE_FLOAT (fmod (x, y)); return true;
+        case CLV_OP_LT:  *dst = VALUE_BOOL (x < y); return true;
+        case CLV_OP_LE:  *dst = VALUE_BOOL (x <= y); return true;
+
+        default:
+            break;
+        }
+    } else if (b->type == CLV_TYPE_STRING && c->type == CLV_TYPE_STRING) {
+        clv_string_t *s = AS_STRING (b);
+        clv_string_t *t = AS_STRING (c);
+
+        if (op == CLV_OP_ADD) {
+            return vm_concat (vm, dst, b, c);
+        }
+
+        if (op == CLV_OP_LT || op == CLV_OP_LE) {
+            int order = memcmp (s->data, t->data, (s->length < t->length) ? s->length : t->length);
+
+            if (order == 0) {
+                order = (s->length > t->length) - (s->length < t->length);
+            }
+
+            *dst = VALUE_BOOL ((op == CLV_OP_LT) ? order < 0 : order <= 0);
+            return true;
+        }
+    } else if (b->type == CLV_TYPE_CHAR && c->type == CLV_TYPE_CHAR) {
+        if (op == CLV_OP_LT || op == CLV_OP_LE) {
+            *dst = VALUE_BOOL ((op == CLV_OP_LT) ? b->as.c < c->as.c : b->as.c <= c->as.c);
+            return true;
+        }
+    }
+
+    return clv_vm_error (vm, "unsupported operands for %s: %s and %s",
+                         arith_symbols[op], clv_type_name (b->type), clv_type_name (c->type));
+}
+
+
+static bool
+vm_cast (clv_vm_t *vm, clv_value_t *dst, const clv_value_t *value, clv_type_t type) {
+    if (value->type == type) {
+        *dst = *value;
+        return true;
+    }
+
+    switch (type) {
+    case CLV_TYPE_BOOL:
+        *dst = VALUE_BOOL (!value_falsy (value));
+        return true;
+
+    case CLV_TYPE_INT:
+        if (value->type == CLV_TYPE_FLOAT) {
+            // out of range conversions are undefined in C
+            if (!(value->as.f > -9223372036854775809.0 && value->as.f < 9223372036854775808.0)) {
+                return clv_vm_error (vm, "%g is out of the range of int", value->as.f);
+            }
+
+            *dst = VALUE_INT ((int64_t)value->as.f);
+            return true;
+        } else if (value->type == CLV_TYPE_CHAR) {
+            *dst = VALUE_INT (value->as.c);
+            return true;
+        } else if (value->type == CLV_TYPE_BOOL) {
+            *dst = VALUE_INT (value->as.b);
+            return true;
+        }
+
+        break;
+
+    case CLV_TYPE_FLOAT:
+        if (value->type == CLV_TYPE_INT) {
+            *dst = VALUE_FLOAT ((double)value->as.i);
+            return true;
+        }
+
+        break;
+
+    case CLV_TYPE_CHAR:
+        if (value->type == CLV_TYPE_INT) {
+            if (value->as.i < 0 || value->as.i > 0x10ffff) {
+                return clv_vm_error (vm, "%" PRId64 " is not a code point", value->as.i);
+            }
+
+            *dst = VALUE_CHAR (value->as.i);
+            return true;
+        }
+
+        break;
+
+    case CLV_TYPE_STRING: {
+        char buffer[VM_FORMAT_SIZE];
+        size_t length = value_format (vm, value, buffer);
+        clv_string_t *string = clv_vm_new_string (vm, buffer, length);
+
+        if (string == NULL) {
+            return clv_vm_error (vm, "out of memory");
+        }
+
+        *dst = VALUE_OBJECT (CLV_TYPE_STRING, string);
+        return true;
+    }
+
+    default:
+        break;
+    }
+
+    return clv_vm_error (vm, "cannot cast %s to %s", clv_type_name (value->type), clv_type_name (type));
+}
+
+
+/* == Interpreter == */
+
+
+#define R(x)            base[(x)]
+
+#define A               CLV_INSN_A (insn)
+#define B               CLV_INSN_B (insn)
+#define C               CLV_INSN_C (insn)
+
+/* Leaves the loop with the error set by clv_vm_error */
+#define VM_THROW()      do { frame->pc = pc; goto error; } while (0)
+
+/* Runs the machine code of the current function from pc, if there is any,
+ * up to the instruction it leaves to the interpreter */
+#define VM_JIT_ENTER() \
+    do { \
+        if (frame->fn->jit != NULL) { \
+            pc = frame->fn->fn->code + clv_jit_enter (frame->fn->jit, base, pc - frame->fn->fn->code); \
+        } \
+    } while (0)
+
+/* Counts calls and backward jumps, and compiles functions once hot */
+#define VM_JIT_HOT() \
+    do { \
+        if (vm->jit && frame->fn->jit == NULL && ++frame->fn->hotness == VM_JIT_THRESHOLD) { \
+            vm_jit_compile (vm, frame->fn); \
+        } \
+        VM_JIT_ENTER (); \
+    } while (0)
+
+#if VM_COMPUTED_GOTO
+#define VM_CASE(name)   op_##name
+#define VM_NEXT()       do { insn = *pc++; steps++; goto *dispatch[CLV_INSN_OP (insn)]; } while (0)
+#else
+#define VM_CASE(name)   case CLV_OP_##name
+#define VM_NEXT()       continue
+#endif
+
+
+static void
+vm_jit_compile (clv_vm_t *vm, vm_function_t *fn) {
+    fn->jit = clv_jit_compile (fn->fn, fn->constants, vm->globals, vm->jit_features);
+
+    if (fn->jit == NULL) {
+        // stays interpreted, which is always correct
+        clv_debug ("jit: unable to compile %s: %s", fn->fn->name, strerror (errno));
+        return;
+    }
+
+    vm->stats.compiled++;
+    clv_debug ("jit: compiled %s, %zu bytes", fn->fn->name, clv_jit_size (fn->jit));
+}
+
+
+/* Runs function `index` until it returns to the caller */
+static bool
+vm_execute (clv_vm_t *vm, uint32_t index, clv_value_t *out_result) {
+#if VM_COMPUTED_GOTO
+#define VM_LABEL(name, fmt) &&op_##name,
+    // opcodes come from the code generator, and are always in range
+    static const void *const dispatch[CLV_OP_COUNT] = { CLV_OPCODES (VM_LABEL) };
+#undef VM_LABEL
+#endif
+
+    vm_frame_t *frame = vm->frame = vm->frames;
+    vm_function_t *fn = &vm->functions[index];
+
+    clv_value_t *base = vm->stack + 1;
+    const clv_insn_t *pc = fn->fn->code;
+    const clv_value_t *k = fn->constants;
+    clv_insn_t insn;
+    uint64_t steps = 0;
+
+    *frame = (vm_frame_t){ .fn = fn, .pc = pc, .base = base };
+
+    for (uint32_t i = 0; i < fn->fn->registers; i++) {
+        R (i) = VALUE_NIL;
+    }
+
+    VM_JIT_HOT ();
+
+#if VM_COMPUTED_GOTO
+    VM_NEXT ();
+#else
+    for (;;) {
+        insn = *pc++;
+        steps++;
+
+        switch (CLV_INSN_OP (insn)) {
+#endif
+
+    VM_CASE (MOVE):
+        R (A) = R (B);
+        VM_NEXT ();
+
+    VM_CASE (LOADK):
+        R (A) = k[CLV_INSN_BX (insn)];
+        VM_NEXT ();
+
+    VM_CASE (LOADI):
+        R (A) = VALUE_INT (CLV_INSN_SBX (insn));
+        VM_NEXT ();
+
+    VM_CASE (LOADNIL):
+        R (A) = VALUE_NIL;
+        VM_NEXT ();
+
+    VM_CASE (LOADBOOL):
+        R (A) = VALUE_BOOL (B != 0);
+        VM_NEXT ();
+
+    VM_CASE (GETGLOBAL):
+        R (A) = vm->globals[CLV_INSN_BX (insn)];
+        VM_NEXT ();
+
+    VM_CASE (SETGLOBAL):
+        vm->globals[CLV_INSN_BX (insn)] = R (A);
+        VM_NEXT ();
+
+#define VM_ARITH(name, op) \
+    VM_CASE (name): { \
+        clv_value_t *b = &R (B); \
+        clv_value_t *c = &R (C); \
+        if (b->type == CLV_TYPE_INT && c->type == CLV_TYPE_INT) { \
+            R (A) = VALUE_INT (INT_WRAP (b->as.i, op, c->as.i)); \
+        } else if (b->type == CLV_TYPE_FLOAT && c->type == CLV_TYPE_FLOAT) { \
+            R (A) = VALUE_FLOAT (b->as.f op c->as.f); \
+        } else { \
+            if (!vm_arith (vm, CLV_OP_##name, &R (A), b, c)) { \
+                VM_THROW (); \
+            } \
+        } \
+        VM_NEXT (); \
+    }
+
+    VM_ARITH (ADD, +)
+    VM_ARITH (SUB, -)
+    VM_ARITH (MUL, *)
+
+#undef VM_ARITH
+
+#define VM_SLOW(name) \
+    VM_CASE (name): \
+        if (!vm_arith (vm, CLV_OP_##name, &R (A), &R (B), &R (C))) { \
+            VM_THROW (); \
+        } \
+        VM_NEXT ();
+
+    VM_SLOW (DIV)
+    VM_SLOW (MOD)
+
+#undef VM_SLOW
+
+    VM_CASE (ADDI): {
+        clv_value_t *b = &R (B);
+
+        if (b->type == CLV_TYPE_INT) {
+            R (A) = VALUE_INT (INT_WRAP (b->as.i, +, CLV_INSN_SC (insn)));
+        } else if (b->type == CLV_TYPE_FLOAT) {
+            R (A) = VALUE_FLOAT (b->as.f + CLV_INSN_SC (insn));
+        } else {
+            clv_value_t c = VALUE_INT (CLV_INSN_SC (insn));
+
+            if (!vm_arith (vm, CLV_OP_ADDI, &R (A), b, &c)) {
+                VM_THROW ();
+            }
+        }
+
+        VM_NEXT ();
+    }
+
+#define VM_BITWISE(name, expr) \
+    VM_CASE (name): { \
+        clv_value_t *b = &R (B); \
+        clv_value_t *c = &R (C); \
+        if (b->type == CLV_TYPE_INT && c->type == CLV_TYPE_INT) { \
+            int64_t i = b->as.i; \
+            int64_t j = c->as.i; \
+            R (A) = VALUE_INT (expr); \
+        } else if (!vm_arith (vm, CLV_OP_##name, &R (A), b, c)) { \
+            VM_THROW (); \
+        } \
+        VM_NEXT (); \
+    }
+
+    VM_BITWISE (BAND, i & j)
+    VM_BITWISE (BOR,  i | j)
+    VM_BITWISE (BXOR, i ^ j)
+    VM_BITWISE (SHL,  INT_WRAP (i, <<, j & 63))
+    VM_BITWISE (SHR,  i >> (j & 63))
+
+#undef VM_BITWISE
+
+    VM_CASE (EQ):
+        R (A) = VALUE_BOOL (value_equal (&R (B), &R (C)));
+        VM_NEXT ();
+
+    VM_CASE (NE):
+        R (A) = VALUE_BOOL (!value_equal (&R (B), &R (C)));
+        VM_NEXT ();
+
+#define VM_ORDER(name, op) \
+    VM_CASE (name): { \
+        clv_value_t *b = &R (B); \
+        clv_value_t *c = &R (C); \
+        if (b->type == CLV_TYPE_INT && c->type == CLV_TYPE_INT) { \
+            R (A) = VALUE_BOOL (b->as.i op c->as.i); \
+        } else if (!vm_arith (vm, CLV_OP_##name, &R (A), b, c)) { \
+            VM_THROW (); \
+        } \
+        VM_NEXT (); \
+    }
+
+    VM_ORDER (LT, <)
+    VM_ORDER (LE, <=)
+
+#undef VM_ORDER
+
+    VM_CASE (NEG): {
+        clv_value_t *b = &R (B);
+
+        if (b->type == CLV_TYPE_INT) {
+            R (A) = VALUE_INT (INT_WRAP (0, -, b->as.i));
+        } else if (b->type == CLV_TYPE_FLOAT) {
+            R (A) = VALUE_FLOAT (-b->as.f);
+        } else {
+            clv_vm_error (vm, "unsupported operand for -: %s", clv_type_name (b->type));
+            VM_THROW ();
+        }
+
+        VM_NEXT ();
+    }
+
+    VM_CASE (NOT):
+        R (A) = VALUE_BOOL (value_falsy (&R (B)));
+        VM_NEXT ();
+
+    VM_CASE (BNOT):
+        if (R (B).type != CLV_TYPE_INT) {
+            clv_vm_error (vm, "unsupported operand for ~: %s", clv_type_name (R (B).type));
+            VM_THROW ();
+        }
+
+        R (A) = VALUE_INT (~R (B).as.i);
+        VM_NEXT ();
+
+    VM_CASE (CAST):
+        if (!vm_cast (vm, &R (A), &R (B), C)) {
+            VM_THROW ();
+        }
+
+        VM_NEXT ();
+
+    VM_CASE (TYPEOF):
+        R (A) = VALUE_OBJECT (CLV_TYPE_STRING, vm->type_names[R (B).type]);
+        VM_NEXT ();
+
+    VM_CASE (UNWRAP):
+        if (R (B).type == CLV_TYPE_NIL) {
+            clv_vm_error (vm, "unwrapped a nil value");
+            VM_THROW ();
+        }
+
+        R (A) = R (B);
+        VM_NEXT ();
+
+    VM_CASE (JMP):
+        pc += CLV_INSN_SAX (insn);
+
+        if (CLV_INSN_SAX (insn) < 0) {
+            VM_JIT_HOT ();
+        }
+
+        VM_NEXT ();
+
+    VM_CASE (JMPF):
+        if (value_falsy (&R (A))) {
+            pc += CLV_INSN_SBX (insn);
+
+            if (CLV_INSN_SBX (insn) < 0) {
+                VM_JIT_HOT ();
+            }
+        }
+
+        VM_NEXT ();
+
+    VM_CASE (JMPT):
+        if (!value_falsy (&R (A))) {
+            pc += CLV_INSN_SBX (insn);
+
+            if (CLV_INSN_SBX (insn) < 0) {
+                VM_JIT_HOT ();
+            }
+        }
+
+        VM_NEXT ();
+
+    VM_CASE (FORPREP):
+        if (R (A).type != CLV_TYPE_INT && R (A).type != CLV_TYPE_STRING) {
+            clv_vm_error (vm, "cannot iterate over %s", clv_type_name (R (A).type));
+            VM_THROW ();
+        }
+
+        R (A + 1) = VALUE_INT (0);
+        pc += CLV_INSN_SBX (insn);
+        VM_NEXT ();
+
+    VM_CASE (FORLOOP): {
+        clv_value_t *iter = &R (A);
+        int64_t i = R (A + 1).as.i;
+
+        if (iter->type == CLV_TYPE_INT) {
+            if (i < iter->as.i) {
+                R (A + 1).as.i = i + 1;
+                R (A + 2) = VALUE_INT (i);
+                pc += CLV_INSN_SBX (insn);
+                VM_JIT_HOT ();
+            }
+        } else if ((size_t)i < AS_STRING (iter)->length) {
+            clv_string_t *string = AS_STRING (iter);
+            uint32_t c;
+
+            R (A + 1).as.i = i + utf8_decode ((const unsigned char *)string->data + i, string->length - i, &c);
+            R (A + 2) = VALUE_CHAR (c);
+            pc += CLV_INSN_SBX (insn);
+            VM_JIT_HOT ();
+        }
+
+        VM_NEXT ();
+    }
+
+    VM_CASE (CALL): {
+        clv_value_t *callee = &R (A);
+        uint32_t count = B;
+
+        if (callee->type == CLV_TYPE_FN) {
+            vm_function_t *callee_fn = &vm->functions[callee->as.index];
+            clv_value_t *callee_base = base + A + 1;
+
+            if (count != callee_fn->fn->arity) {
+                clv_vm_error (vm, "%s expects %u arguments, not %u", callee_fn->fn->name, callee_fn->fn->arity, count);
+                VM_THROW ();
+            }
+
+            if (frame + 1 == vm->frames + CLV_VM_MAX_FRAMES
+                || callee_base + callee_fn->fn->registers > vm->stack + CLV_VM_STACK_SIZE) {
+                clv_vm_error (vm, "stack overflow");
+                VM_THROW ();
+            }
+
+            // stale values must not reach the collector
+            for (uint32_t i = count; i < callee_fn->fn->registers; i++) {
+                callee_base[i] = VALUE_NIL;
+            }
+
+            frame->pc = pc;
+            frame++;
+            *frame = (vm_frame_t){ .fn = callee_fn, .base = callee_base };
+            vm->frame = frame;
+
+            base = callee_base;
+            pc = callee_fn->fn->code;
+            k = callee_fn->constants;
+
+            VM_JIT_HOT ();
+        } else if (callee->type == CLV_TYPE_NATIVE) {
+            const clv_native_t *native = clv_native_get (callee->as.index);
+            clv_value_t result = VALUE_NIL;
+
+            if (native->arity >= 0 && count != (uint32_t)native->arity) {
+                clv_vm_error (vm, "%s.%s expects %d arguments, not %u", native->module, native->name, native->arity, count);
+                VM_THROW ();
+            }
+
+            // natives report errors where they were called
+            frame->pc = pc;
+
+            if (!native->fn (vm, &R (A + 1), count, &result)) {
+                VM_THROW ();
+            }
+
+            R (A) = result;
+            VM_JIT_ENTER ();
+        } else {
+            clv_vm_error (vm, "%s is not callable", clv_type_name (callee->type));
+            VM_THROW ();
+        }
+
+        VM_NEXT ();
+    }
+
+    VM_CASE (RET): {
+        clv_value_t result = (B != 0) ? R (A) : VALUE_NIL;
+
+        if (frame == vm->frames) {
+            *out_result = result;
+            vm->stats.instructions += steps;
+            vm->frame = NULL;
+
+            return true;
+        }
+
+        // the callee sits right below its arguments
+        base[-1] = result;
+
+        frame--;
+        vm->frame = frame;
+
+        base = frame->base;
+        pc = frame->pc;
+        k = frame->fn->constants;
+
+        VM_JIT_ENTER ();
+        VM_NEXT ();
+    }
+
+#if !VM_COMPUTED_GOTO
+        default:
+            clv_vm_error (vm, "invalid opcode %u", CLV_INSN_OP (insn));
+            VM_THROW ();
+        }
+    }
+#endif
+
+error:
+    vm->stats.instructions += steps;
+    vm_report (vm);
+    vm->frame = NULL;
+
+    return false;
+}
+
+
+#undef R
+#undef A
+#undef B
+#undef C
+
+
+/* == VM == */
+
+
+static bool
+vm_load_constants (clv_vm_t *vm, vm_function_t *fn) {
+    const clv_function_t *source = fn->fn;
+
+    if (source->constant_count == 0) {
+        return true;
+    }
+
+    if ((fn->constants = clv_calloc (CLV_TAG_VM, source->constant_count, sizeof (*fn->constants))) == NULL) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < source->constant_count; i++) {
+        const clv_const_t *k = &source->constants[i];
+        clv_value_t *value = &fn->constants[i];
+
+        // functions of other modules are only known once linked
+        if (k->module != 0) {
+            errno = EINVAL;
+            return false;
+        }
+
+        value->type = k->type;
+
+        switch (k->type) {
+        case CLV_TYPE_INT:
+            value->as.i = k->as.i;
+            break;
+
+        case CLV_TYPE_FLOAT:
+            value->as.f = k->as.f;
+            break;
+
+        case CLV_TYPE_CHAR:
+            value->as.c = k->as.c;
+            break;
+
+        case CLV_TYPE_STRING: {
+            clv_string_t *string = vm_alloc_string (vm, k->as.s.length, true);
+
+            if (string == NULL) {
+                return false;
+            }
+
+            memcpy (string->data, k->as.s.data, k->as.s.length);
+            value->as.object = &string->object;
+            break;
+        }
+
+        default:
+            value->as.index = k->as.index;
+            break;
+        }
+    }
+
+    return true;
+}
+
+
+clv_vm_t *
+clv_vm_new (clv_module_t *module) {
+    clv_vm_t *vm = clv_calloc (CLV_TAG_VM, 1, sizeof (*vm));
+
+    if (vm == NULL) {
+        return NULL;
+    }
+
+    vm->module = module;
+    vm->out = stdout;
+    vm->threshold = VM_GC_MIN_THRESHOLD;
+    vm->function_count = clv_module_function_count (module);
+    vm->global_count = clv_module_global_count (module);
+
+    // globals start out as nil, which is all zeros
+    vm->functions = clv_calloc (CLV_TAG_VM, vm->function_count, sizeof (*vm->functions));
+    vm->globals = clv_calloc (CLV_TAG_VM, vm->global_count + 1, sizeof (*vm->globals));
+    vm->stack = clv_alloc (CLV_TAG_VM, CLV_VM_STACK_SIZE * sizeof (*vm->stack));
+    vm->frames = clv_alloc (CLV_TAG_VM, CLV_VM_MAX_FRAMES * sizeof (*vm->frames));
+
+    if ((vm->functions == NULL && vm->function_count > 0) || vm->globals == NULL
+        || vm->stack == NULL || vm->frames == NULL) {
+        clv_vm_free (vm);
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < vm->function_count; i++) {
+        vm->functions[i].fn = clv_module_function (module, i);
+
+        if (!vm_load_constants (vm, &vm->functions[i])) {
+            clv_vm_free (vm);
+            return NULL;
+        }
+    }
+
+    for (int type = 0; type < CLV_TYPE_COUNT; type++) {
+        clv_str name = clv_type_name (type);
+        size_t length = strlen (name);
+
+        if ((vm->type_names[type] = vm_alloc_string (vm, length, true)) == NULL) {
+            clv_vm_free (vm);
+            return NULL;
+        }
+
+        memcpy (vm->type_names[type]->data, name, length);
+    }
+
+    return vm;
+}
+
+
+void
+clv_vm_set_output (clv_vm_t *self, FILE *out) {
+    self->out = (out != NULL) ? out : stdout;
+}
+
+
+void
+clv_vm_set_jit (clv_vm_t *self, bool enabled) {
+    self->jit = enabled;
+}
+
+
+void
+clv_vm_set_jit_features (clv_vm_t *self, unsigned features) {
+    self->jit_features = features;
+}
+
+
+FILE *
+clv_vm_output (clv_vm_t *self) {
+    return self->out;
+}
+
+
+bool
+clv_vm_run (clv_vm_t *self, clv_str entry, clv_value_t *out_result) {
+    int64_t index = clv_module_find_function (self->module, entry);
+    clv_value_t result;
+
+    if (index < 0) {
+        clv_error ("%s: no '%s' function", clv_module_get_file (self->module), entry);
+        return false;
+    }
+
+    if (self->functions[index].fn->arity != 0) {
+        clv_error ("%s: '%s' must not take arguments", clv_module_get_file (self->module), entry);
+        return false;
+    }
+
+    // function 0 initializes the globals
+    if (!vm_execute (self, 0, &result) || !vm_execute (self, index, &result)) {
+        fflush (self->out);
+        return false;
+    }
+
+    fflush (self->out);
+
+    if (out_result != NULL) {
+        *out_result = result;
+    }
+
+    return true;
+}
+
+
+void
+clv_vm_get_stats (clv_vm_t *self, clv_vm_stats_t *out_stats) {
+    *out_stats = self->stats;
+    out_stats->allocated = self->allocated;
+}
+
+
+void
+clv_vm_free (clv_vm_t *self) {
+    if (self == NULL) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < self->function_count; i++) {
+        clv_free (self->functions[i].constants);
+        clv_jit_free (self->functions[i].jit);
+    }
+
+    vm_free_objects (self->objects);
+    vm_free_objects (self->permanent);
+
+    clv_free (self->functions);
+    clv_free (self->globals);
+    clv_free (self->stack);
+    clv_free (self->frames);
+    clv_free (self);
+}
@@ -0,0 +1,85 @@
+#include <clover/x86.h>
+
+#include <string.h>
+
+
+void
+clv_x86_bytes (clv_x86_buffer_t *b, const void *data, size_t length) {
+    if (b->length + length > b->capacity) {
+        size_t capacity = (b->capacity == 0) ? 4096 : b->capacity;
+
+        while (b->length + length > capacity) {
+            capacity *= 2;
+        }
+
+        uint8_t *temp = clv_realloc (b->tag, b->data, capacity);
+
+        if (temp == NULL) {
+            b->error = true;
+            return;
+        }
+
+        b->data = temp;
+        b->capacity = capacity;
+    }
+
+    memcpy (b->data + b->length, data, length);
+    b->length += length;
+}
+
+
+void
+clv_x86_u8 (clv_x86_buffer_t *b, uint8_t value) {
+    clv_x86_bytes (b, &value, 1);
+}
+
+
+void
+clv_x86_u16 (clv_x86_buffer_t *b, uint16_t value) {
+    clv_x86_bytes (b, &value, 2);
+}
+
+
+void
+clv_x86_u32 (clv_x86_buffer_t *b, uint32_t value) {
+    clv_x86_bytes (b, &value, 4);
+}
+
+
+void
+clv_x86_u64 (clv_x86_buffer_t *b, uint64_t value) {
+    clv_x86_bytes (b, &value, 8);
+}
+
+
+void
+clv_x86_mem (clv_x86_buffer_t *b, const char *op, size_t length, int reg, int base, int32_t disp) {
+    clv_x86_bytes (b, op, length);
+    clv_x86_u8 (b, 0x80 | ((reg & 7) << 3) | (base & 7));
+    clv_x86_u32 (b, (uint32_t)disp);
+}
+
+
+uint32_t
+clv_x86_branch (clv_x86_buffer_t *b, uint8_t cc) {
+    if (cc == CLV_X86_JMP) {
+        clv_x86_u8 (b, CLV_X86_JMP);
+    } else {
+        clv_x86_u8 (b, 0x0f);
+        clv_x86_u8 (b, cc);
+    }
+
+    clv_x86_u32 (b, 0);
+
+    return b->length - 4;
+}
+
+
+void
+clv_x86_patch (clv_x86_buffer_t *b, uint32_t site, size_t target) {
+    if (!b->error) {
+        int32_t rel = (int32_t)(target - (site + 4));
+
+        memcpy (b->data + site, &rel, 4);
+    }
+}